@@ -22,6 +22,8 @@
 #include <stdbool.h>
 #include <string.h>
 #include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 
 #include "platform.h"
 #include "mqtt_config.h"
@@ -32,6 +34,7 @@
 #include "transport_ws.h"
 #include "platform.h"
 #include "mqtt_outbox.h"
+#include "mqtt_spool.h"
 
 typedef struct esp_mqtt_client* esp_mqtt_client_handle_t;
 
@@ -102,6 +105,9 @@ typedef struct {
     int buffer_size;
     const char *cert_pem;
     esp_mqtt_transport_t transport;
+    const char *spool_dir;      // directory of the persistent spool, NULL: not used
+    int spool_size;
+    int spool_sync;
 } esp_mqtt_client_config_t;
 
 typedef struct mqtt_state
@@ -149,7 +155,9 @@ struct esp_mqtt_client {
     esp_mqtt_event_t event;
     bool run;
     outbox_handle_t outbox;
+    mqtt_spool_handle_t spool;
     EventGroupHandle_t status_bits;
+    SemaphoreHandle_t api_lock;     // serializes the use of out_buffer, outbox and pending message state
     void *mpy_mqtt_obj;
 };
 
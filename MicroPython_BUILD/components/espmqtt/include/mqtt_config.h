@@ -65,4 +65,27 @@
 
 #define OUTBOX_EXPIRED_TIMEOUT_MS   (30*1000)
 #define OUTBOX_MAX_SIZE             (4*1024)
+
+#if CONFIG_MQTT_OUTBOX_SLAB_SIZE
+#define OUTBOX_SLAB_SIZE            CONFIG_MQTT_OUTBOX_SLAB_SIZE
+#else
+#define OUTBOX_SLAB_SIZE            (OUTBOX_MAX_SIZE + MQTT_BUFFER_SIZE_BYTE)
+#endif
+
+#if CONFIG_MQTT_OUTBOX_SLAB_ITEMS
+#define OUTBOX_SLAB_ITEMS           CONFIG_MQTT_OUTBOX_SLAB_ITEMS
+#else
+#define OUTBOX_SLAB_ITEMS           (32)
+#endif
+
+#define OUTBOX_HASH_SIZE            (32)    // must be power of 2
+
+#if CONFIG_MQTT_SPOOL_SEGMENT_SIZE
+#define MQTT_SPOOL_SEGMENT_SIZE     CONFIG_MQTT_SPOOL_SEGMENT_SIZE
+#else
+#define MQTT_SPOOL_SEGMENT_SIZE     (8*1024)
+#endif
+
+#define MQTT_SPOOL_SIZE             (64*1024)   // default spool size
+#define MQTT_SPOOL_INFLIGHT         (4)         // spooled messages sent without acknowledge
 #endif
@@ -19,12 +19,11 @@ typedef struct outbox_item {
     int tick;
     int retry_count;
     bool pending;
-    STAILQ_ENTRY(outbox_item) next;
+    TAILQ_ENTRY(outbox_item) next;
+    struct outbox_item *hnext;
 } outbox_item_t;
 
-STAILQ_HEAD(outbox_list_t, outbox_item);
-
-typedef struct outbox_list_t * outbox_handle_t;
+typedef struct outbox_t * outbox_handle_t;
 typedef outbox_item_t *outbox_item_handle_t;
 
 outbox_handle_t outbox_init();
@@ -35,6 +34,7 @@ esp_err_t outbox_delete(outbox_handle_t outbox, int msg_id, int msg_type);
 esp_err_t outbox_delete_msgid(outbox_handle_t outbox, int msg_id);
 esp_err_t outbox_delete_msgtype(outbox_handle_t outbox, int msg_type);
 esp_err_t outbox_delete_expired(outbox_handle_t outbox, int current_tick, int timeout);
+outbox_item_handle_t outbox_get_expired(outbox_handle_t outbox, int current_tick, int timeout);
 
 esp_err_t outbox_set_pending(outbox_handle_t outbox, int msg_id);
 int outbox_get_size(outbox_handle_t outbox);
@@ -0,0 +1,41 @@
+/*
+ * This file is part of the MicroPython ESP32 project, https://github.com/loboris/MicroPython_ESP32_psRAM_LoBo
+ *
+ * Apache License Version 2.0
+ *
+ * Copyright (c) 2018 LoBo (https://github.com/loboris)
+*/
+
+/*
+ * Persistent store-and-forward spool for outgoing QoS>0 messages.
+ *
+ * Messages are appended to segment files (seg00001.log, ...) in the spool directory.
+ * The position of the oldest unacknowledged message is kept in the 'head' file,
+ * fully acknowledged segments are deleted.
+ */
+#ifndef _MQTT_SPOOL_H_
+#define _MQTT_SPOOL_H_
+#include "platform.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+typedef struct mqtt_spool_t * mqtt_spool_handle_t;
+
+mqtt_spool_handle_t mqtt_spool_init(const char *dir, int max_size, int sync_every);
+esp_err_t mqtt_spool_put(mqtt_spool_handle_t spool, const char *topic, int topic_len, const char *data, int len, int qos, int retain);
+bool mqtt_spool_next(mqtt_spool_handle_t spool, const char **topic, const char **data, int *len, int *qos, int *retain);
+void mqtt_spool_sent(mqtt_spool_handle_t spool, int msg_id);
+bool mqtt_spool_ack(mqtt_spool_handle_t spool, int msg_id);
+bool mqtt_spool_is_inflight(mqtt_spool_handle_t spool, int msg_id);
+void mqtt_spool_rewind(mqtt_spool_handle_t spool);
+void mqtt_spool_sync(mqtt_spool_handle_t spool);
+int mqtt_spool_get_count(mqtt_spool_handle_t spool);
+int mqtt_spool_get_size(mqtt_spool_handle_t spool);
+void mqtt_spool_destroy(mqtt_spool_handle_t spool);
+
+#ifdef  __cplusplus
+}
+#endif
+#endif
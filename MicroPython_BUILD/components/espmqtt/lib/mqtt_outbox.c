@@ -1,34 +1,210 @@
 #include "mqtt_outbox.h"
+#include "mqtt_config.h"
 #include <stdlib.h>
 #include <string.h>
 #include "rom/queue.h"
 #include "esp_log.h"
+#include "esp_heap_caps.h"
 
 static const char *TAG = "OUTBOX";
 
+/*
+ * Items are allocated from a preallocated item pool, their data from a
+ * preallocated slab divided into OUTBOX_SLOT_SIZE slots. Freed items and slots
+ * are reused at once, so a message waiting long for its ack holds only its own
+ * slots. As acks mostly come in order, the slots are allocated next fit.
+ * If the pool or the slab is full, the item or its data is allocated from heap.
+ * Items are also indexed by msg_id, so acks are handled without walking the list.
+ */
+#define OUTBOX_SLOT_SIZE    (32)
+#define OUTBOX_SLOTS        (OUTBOX_SLAB_SIZE / OUTBOX_SLOT_SIZE)
+
+struct outbox_t {
+    TAILQ_HEAD(outbox_list_t, outbox_item) list;    // all items in insertion order
+    outbox_item_handle_t hash[OUTBOX_HASH_SIZE];    // msg_id index
+    int size;                                       // total data size of all items
+    outbox_item_t *items;                           // item pool
+    outbox_item_handle_t free_items;                // unused pool items, linked by hnext
+    uint8_t *slab;                                  // data slab
+    uint32_t slots[(OUTBOX_SLOTS + 31) / 32];       // bit map of the used slab slots
+    int slot_next;                                  // slot after the last allocated data
+};
+
+#define OUTBOX_HASH(msg_id) ((unsigned int)(msg_id) & (OUTBOX_HASH_SIZE - 1))
+
+static void *outbox_alloc_slab(size_t size)
+{
+    void *buf = NULL;
+#if CONFIG_MQTT_OUTBOX_SPIRAM && CONFIG_SPIRAM_SUPPORT
+    buf = heap_caps_malloc(size, MALLOC_CAP_8BIT | MALLOC_CAP_SPIRAM);
+#endif
+    if (buf == NULL) {
+        buf = malloc(size);
+    }
+    return buf;
+}
+
 outbox_handle_t outbox_init()
 {
-    outbox_handle_t outbox = calloc(1, sizeof(struct outbox_list_t));
+    outbox_handle_t outbox = calloc(1, sizeof(struct outbox_t));
     ESP_MEM_CHECK(TAG, outbox, return NULL);
-    STAILQ_INIT(outbox);
+    TAILQ_INIT(&outbox->list);
+    outbox->items = outbox_alloc_slab(OUTBOX_SLAB_ITEMS * sizeof(outbox_item_t));
+    outbox->slab = outbox_alloc_slab(OUTBOX_SLAB_SIZE);
+    if (outbox->items == NULL || outbox->slab == NULL) {
+        // everything will be allocated from heap
+        ESP_LOGW(TAG, "No memory for the outbox slab");
+        free(outbox->items);
+        free(outbox->slab);
+        outbox->items = NULL;
+        outbox->slab = NULL;
+        return outbox;
+    }
+    for (int i = OUTBOX_SLAB_ITEMS - 1; i >= 0; i--) {
+        outbox->items[i].hnext = outbox->free_items;
+        outbox->free_items = &outbox->items[i];
+    }
     return outbox;
 }
 
+static bool outbox_in_pool(outbox_handle_t outbox, outbox_item_handle_t item)
+{
+    return outbox->items != NULL && item >= outbox->items && item < outbox->items + OUTBOX_SLAB_ITEMS;
+}
+
+static bool outbox_in_slab(outbox_handle_t outbox, char *buffer)
+{
+    return outbox->slab != NULL && (uint8_t *)buffer >= outbox->slab && (uint8_t *)buffer < outbox->slab + OUTBOX_SLAB_SIZE;
+}
+
+static int outbox_slot_count(int len)
+{
+    return len > 0 ? (len + OUTBOX_SLOT_SIZE - 1) / OUTBOX_SLOT_SIZE : 1;
+}
+
+// Returns the first used (or free) slot from 'slot' on, OUTBOX_SLOTS if there is none
+static int outbox_slot_find(outbox_handle_t outbox, int slot, bool used)
+{
+    while (slot < OUTBOX_SLOTS) {
+        uint32_t word = used ? outbox->slots[slot / 32] : ~outbox->slots[slot / 32];
+        word &= 0xFFFFFFFF << (slot % 32);
+        if (word != 0) {
+            slot = (slot & ~31) + __builtin_ctz(word);
+            return slot < OUTBOX_SLOTS ? slot : OUTBOX_SLOTS;
+        }
+        slot = (slot & ~31) + 32;
+    }
+    return OUTBOX_SLOTS;
+}
+
+static void outbox_slot_mark(outbox_handle_t outbox, int slot, int count, bool used)
+{
+    while (count > 0) {
+        int n = 32 - slot % 32;
+        if (n > count) {
+            n = count;
+        }
+        uint32_t mask = (n == 32) ? 0xFFFFFFFF : ((1u << n) - 1) << (slot % 32);
+        if (used) {
+            outbox->slots[slot / 32] |= mask;
+        } else {
+            outbox->slots[slot / 32] &= ~mask;
+        }
+        slot += n;
+        count -= n;
+    }
+}
+
+// Allocate the data from the first free run of slots after the last allocated one (next fit),
+// returns NULL if there is none
+static char *outbox_slab_alloc(outbox_handle_t outbox, int len)
+{
+    int count = outbox_slot_count(len);
+    int start = outbox->slot_next;
+    int limit = OUTBOX_SLOTS;
+    for (int pass = 0; pass < 2; pass++) {
+        int slot = outbox_slot_find(outbox, start, false);
+        while (slot + count <= limit) {
+            int end = outbox_slot_find(outbox, slot, true);
+            if (end - slot >= count) {
+                outbox_slot_mark(outbox, slot, count, true);
+                outbox->slot_next = slot + count;
+                return (char *)outbox->slab + slot * OUTBOX_SLOT_SIZE;
+            }
+            slot = outbox_slot_find(outbox, end, false);
+        }
+        // wrap around, a run starting before the start slot may extend past it
+        limit = start + count < OUTBOX_SLOTS ? start + count : OUTBOX_SLOTS;
+        start = 0;
+    }
+    return NULL;
+}
+
+static void outbox_slab_release(outbox_handle_t outbox, char *buffer, int len)
+{
+    int slot = ((uint8_t *)buffer - outbox->slab) / OUTBOX_SLOT_SIZE;
+    outbox_slot_mark(outbox, slot, outbox_slot_count(len), false);
+}
+
+static void outbox_free(outbox_handle_t outbox, outbox_item_handle_t item)
+{
+    TAILQ_REMOVE(&outbox->list, item, next);
+    outbox_item_handle_t *pitem = &outbox->hash[OUTBOX_HASH(item->msg_id)];
+    while (*pitem != item) {
+        pitem = &(*pitem)->hnext;
+    }
+    *pitem = item->hnext;
+    outbox->size -= item->len;
+
+    if (outbox_in_slab(outbox, item->buffer)) {
+        outbox_slab_release(outbox, item->buffer, item->len);
+    } else {
+        free(item->buffer);
+    }
+    if (outbox_in_pool(outbox, item)) {
+        item->hnext = outbox->free_items;
+        outbox->free_items = item;
+    } else {
+        free(item);
+    }
+}
+
 outbox_item_handle_t outbox_enqueue(outbox_handle_t outbox, uint8_t *data, int len, int msg_id, int msg_type, int tick)
 {
-    outbox_item_handle_t item = calloc(1, sizeof(outbox_item_t));
-    ESP_MEM_CHECK(TAG, item, return NULL);
+    outbox_item_handle_t item = outbox->free_items;
+    if (item != NULL) {
+        outbox->free_items = item->hnext;
+        memset(item, 0, sizeof(outbox_item_t));
+    } else {
+        item = calloc(1, sizeof(outbox_item_t));
+        ESP_MEM_CHECK(TAG, item, return NULL);
+    }
+    item->buffer = outbox->slab ? outbox_slab_alloc(outbox, len) : NULL;
+    if (item->buffer == NULL) {
+        item->buffer = malloc(len);
+        ESP_MEM_CHECK(TAG, item->buffer, {
+            if (outbox_in_pool(outbox, item)) {
+                item->hnext = outbox->free_items;
+                outbox->free_items = item;
+            } else {
+                free(item);
+            }
+            return NULL;
+        });
+    }
     item->msg_id = msg_id;
     item->msg_type = msg_type;
     item->tick = tick;
     item->len = len;
-    item->buffer = malloc(len);
-    ESP_MEM_CHECK(TAG, item->buffer, {
-        free(item);
-        return NULL;
-    });
     memcpy(item->buffer, data, len);
-    STAILQ_INSERT_TAIL(outbox, item, next);
+    TAILQ_INSERT_TAIL(&outbox->list, item, next);
+    // keep the insertion order in the index too
+    outbox_item_handle_t *pitem = &outbox->hash[OUTBOX_HASH(msg_id)];
+    while (*pitem != NULL) {
+        pitem = &(*pitem)->hnext;
+    }
+    *pitem = item;
+    outbox->size += len;
     ESP_LOGD(TAG, "ENQUEUE msgid=%d, msg_type=%d, len=%d, size=%d", msg_id, msg_type, len, outbox_get_size(outbox));
     return item;
 }
@@ -36,7 +212,7 @@ outbox_item_handle_t outbox_enqueue(outbox_handle_t outbox, uint8_t *data, int l
 outbox_item_handle_t outbox_get(outbox_handle_t outbox, int msg_id)
 {
     outbox_item_handle_t item;
-    STAILQ_FOREACH(item, outbox, next) {
+    for (item = outbox->hash[OUTBOX_HASH(msg_id)]; item != NULL; item = item->hnext) {
         if (item->msg_id == msg_id) {
             return item;
         }
@@ -47,7 +223,7 @@ outbox_item_handle_t outbox_get(outbox_handle_t outbox, int msg_id)
 outbox_item_handle_t outbox_dequeue(outbox_handle_t outbox)
 {
     outbox_item_handle_t item;
-    STAILQ_FOREACH(item, outbox, next) {
+    TAILQ_FOREACH(item, &outbox->list, next) {
         if (!item->pending) {
             return item;
         }
@@ -56,12 +232,10 @@ outbox_item_handle_t outbox_dequeue(outbox_handle_t outbox)
 }
 esp_err_t outbox_delete(outbox_handle_t outbox, int msg_id, int msg_type)
 {
-    outbox_item_handle_t item, tmp;
-    STAILQ_FOREACH_SAFE(item, outbox, next, tmp) {
+    outbox_item_handle_t item;
+    for (item = outbox->hash[OUTBOX_HASH(msg_id)]; item != NULL; item = item->hnext) {
         if (item->msg_id == msg_id && item->msg_type == msg_type) {
-            STAILQ_REMOVE(outbox, item, outbox_item, next);
-            free(item->buffer);
-            free(item);
+            outbox_free(outbox, item);
             ESP_LOGD(TAG, "DELETED msgid=%d, msg_type=%d, remain size=%d", msg_id, msg_type, outbox_get_size(outbox));
             return ESP_OK;
         }
@@ -72,11 +246,10 @@ esp_err_t outbox_delete(outbox_handle_t outbox, int msg_id, int msg_type)
 esp_err_t outbox_delete_msgid(outbox_handle_t outbox, int msg_id)
 {
     outbox_item_handle_t item, tmp;
-    STAILQ_FOREACH_SAFE(item, outbox, next, tmp) {
+    for (item = outbox->hash[OUTBOX_HASH(msg_id)]; item != NULL; item = tmp) {
+        tmp = item->hnext;
         if (item->msg_id == msg_id) {
-            STAILQ_REMOVE(outbox, item, outbox_item, next);
-            free(item->buffer);
-            free(item);
+            outbox_free(outbox, item);
         }
 
     }
@@ -95,11 +268,9 @@ esp_err_t outbox_set_pending(outbox_handle_t outbox, int msg_id)
 esp_err_t outbox_delete_msgtype(outbox_handle_t outbox, int msg_type)
 {
     outbox_item_handle_t item, tmp;
-    STAILQ_FOREACH_SAFE(item, outbox, next, tmp) {
+    TAILQ_FOREACH_SAFE(item, &outbox->list, next, tmp) {
         if (item->msg_type == msg_type) {
-            STAILQ_REMOVE(outbox, item, outbox_item, next);
-            free(item->buffer);
-            free(item);
+            outbox_free(outbox, item);
         }
 
     }
@@ -109,25 +280,29 @@ esp_err_t outbox_delete_msgtype(outbox_handle_t outbox, int msg_type)
 esp_err_t outbox_delete_expired(outbox_handle_t outbox, int current_tick, int timeout)
 {
     outbox_item_handle_t item, tmp;
-    STAILQ_FOREACH_SAFE(item, outbox, next, tmp) {
+    TAILQ_FOREACH_SAFE(item, &outbox->list, next, tmp) {
         if (current_tick - item->tick > timeout) {
-            STAILQ_REMOVE(outbox, item, outbox_item, next);
-            free(item->buffer);
-            free(item);
+            outbox_free(outbox, item);
         }
 
     }
     return ESP_OK;
 }
 
-int outbox_get_size(outbox_handle_t outbox)
+outbox_item_handle_t outbox_get_expired(outbox_handle_t outbox, int current_tick, int timeout)
 {
-    int siz = 0;
     outbox_item_handle_t item;
-    STAILQ_FOREACH(item, outbox, next) {
-        siz += item->len;
+    TAILQ_FOREACH(item, &outbox->list, next) {
+        if (current_tick - item->tick > timeout) {
+            return item;
+        }
     }
-    return siz;
+    return NULL;
+}
+
+int outbox_get_size(outbox_handle_t outbox)
+{
+    return outbox->size;
 }
 
 esp_err_t outbox_cleanup(outbox_handle_t outbox, int max_size)
@@ -137,9 +312,7 @@ esp_err_t outbox_cleanup(outbox_handle_t outbox, int max_size)
         if (item == NULL) {
             return ESP_FAIL;
         }
-        STAILQ_REMOVE(outbox, item, outbox_item, next);
-        free(item->buffer);
-        free(item);
+        outbox_free(outbox, item);
     }
     return ESP_OK;
 }
@@ -147,5 +320,11 @@ esp_err_t outbox_cleanup(outbox_handle_t outbox, int max_size)
 void outbox_destroy(outbox_handle_t outbox)
 {
     outbox_cleanup(outbox, 0);
+    // pending items are not removed by cleanup
+    while (!TAILQ_EMPTY(&outbox->list)) {
+        outbox_free(outbox, TAILQ_FIRST(&outbox->list));
+    }
+    free(outbox->items);
+    free(outbox->slab);
     free(outbox);
 }
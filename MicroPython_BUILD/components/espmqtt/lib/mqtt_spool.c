@@ -0,0 +1,515 @@
+/*
+ * This file is part of the MicroPython ESP32 project, https://github.com/loboris/MicroPython_ESP32_psRAM_LoBo
+ *
+ * Apache License Version 2.0
+ *
+ * Copyright (c) 2018 LoBo (https://github.com/loboris)
+*/
+
+#include "mqtt_spool.h"
+#include "mqtt_config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "esp_log.h"
+
+static const char *TAG = "SPOOL";
+
+#define SPOOL_MAGIC         0x5A
+#define SPOOL_PATH_MAX      160
+#define SPOOL_HEAD_FILE     "head"
+
+/*
+ * Segment file record: header, topic, data.
+ * A record which is cut short (power loss while writing) ends the segment.
+ */
+typedef struct __attribute__((packed)) {
+    uint8_t magic;
+    uint8_t flags;          // bits 0-1: qos, bit 2: retain
+    uint16_t topic_len;
+    uint32_t data_len;
+} spool_rec_hdr_t;
+
+typedef struct {
+    uint32_t seg;
+    uint32_t off;
+} spool_pos_t;
+
+typedef struct {
+    int msg_id;
+    bool acked;
+    spool_pos_t end;        // position after the record
+} spool_inflight_t;
+
+/*
+ * Positions in the spool, always head <= rd <= tail:
+ *  head: oldest unacknowledged record, persisted in the head file
+ *  rd:   next record to send
+ *  tail: append position
+ * Segments first..tail.seg may exist, segments before head.seg are deleted.
+ */
+struct mqtt_spool_t {
+    char *dir;
+    int max_size;                               // maximal size of all segments
+    int sync_every;                             // records written between fsync(), 0: on segment close only
+    SemaphoreHandle_t lock;
+    spool_pos_t head;
+    spool_pos_t rd;
+    spool_pos_t tail;
+    uint32_t first;                             // oldest existing segment
+    FILE *wfile;                                // tail segment
+    FILE *rfile;                                // rd segment
+    uint32_t rseg;
+    int size;                                   // size of all segments
+    int count;                                  // number of unacknowledged records
+    int unsynced;                               // records written after the last fsync()
+    int head_dirty;                             // head advanced after the last head file write
+    spool_inflight_t inflight[MQTT_SPOOL_INFLIGHT];
+    int n_inflight;
+    spool_pos_t next_end;                       // end of the record returned by mqtt_spool_next()
+    char *buf;                                  // record returned by mqtt_spool_next()
+    int buf_size;
+};
+
+static void spool_seg_path(mqtt_spool_handle_t spool, uint32_t seg, char *path)
+{
+    snprintf(path, SPOOL_PATH_MAX, "%s/seg%05u.log", spool->dir, seg);
+}
+
+static int spool_rec_len(spool_rec_hdr_t *hdr)
+{
+    return sizeof(spool_rec_hdr_t) + hdr->topic_len + hdr->data_len;
+}
+
+static void spool_file_sync(FILE *f)
+{
+    fflush(f);
+    fsync(fileno(f));
+}
+
+// Count the valid records in the segment starting at 'off', returns the segment file size in 'fsize'
+static int spool_scan_segment(mqtt_spool_handle_t spool, uint32_t seg, uint32_t off, int *fsize)
+{
+    char path[SPOOL_PATH_MAX];
+    spool_rec_hdr_t hdr;
+    int n = 0;
+
+    *fsize = 0;
+    spool_seg_path(spool, seg, path);
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return 0;
+    }
+    fseek(f, 0, SEEK_END);
+    *fsize = ftell(f);
+    while (fseek(f, off, SEEK_SET) == 0 && fread(&hdr, 1, sizeof(hdr), f) == sizeof(hdr)) {
+        if (hdr.magic != SPOOL_MAGIC || off + spool_rec_len(&hdr) > *fsize) {
+            break;
+        }
+        off += spool_rec_len(&hdr);
+        n++;
+    }
+    fclose(f);
+    return n;
+}
+
+static void spool_write_head(mqtt_spool_handle_t spool)
+{
+    char path[SPOOL_PATH_MAX];
+    snprintf(path, SPOOL_PATH_MAX, "%s/%s", spool->dir, SPOOL_HEAD_FILE);
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        ESP_LOGE(TAG, "Error writing %s", path);
+        return;
+    }
+    fwrite(&spool->head, 1, sizeof(spool_pos_t), f);
+    spool_file_sync(f);
+    fclose(f);
+    spool->head_dirty = 0;
+}
+
+// Delete the segments which are completely acknowledged
+static bool spool_remove_segments(mqtt_spool_handle_t spool)
+{
+    char path[SPOOL_PATH_MAX];
+    struct stat sb;
+    bool removed = false;
+
+    for (; spool->first < spool->head.seg; spool->first++) {
+        if (spool->rfile && spool->rseg == spool->first) {
+            fclose(spool->rfile);
+            spool->rfile = NULL;
+        }
+        spool_seg_path(spool, spool->first, path);
+        if (stat(path, &sb) == 0) {
+            spool->size -= sb.st_size;
+            remove(path);
+            removed = true;
+        }
+    }
+    return removed;
+}
+
+// Close the tail segment and start a new one
+static void spool_close_segment(mqtt_spool_handle_t spool)
+{
+    if (spool->wfile) {
+        spool_file_sync(spool->wfile);
+        fclose(spool->wfile);
+        spool->wfile = NULL;
+    }
+    spool->unsynced = 0;
+    spool->tail.seg++;
+    spool->tail.off = 0;
+}
+
+// Drop the oldest segment to make room for new records
+static void spool_drop_oldest(mqtt_spool_handle_t spool)
+{
+    int fsize;
+    uint32_t seg = spool->head.seg;
+    int n = spool_scan_segment(spool, seg, spool->head.off, &fsize);
+
+    ESP_LOGW(TAG, "Spool full, %d message(s) dropped", n);
+    spool->count -= n;
+    spool->head.seg = seg + 1;
+    spool->head.off = 0;
+    // records from the dropped segment which are still waiting for acknowledge are forgotten
+    while (spool->n_inflight > 0 && spool->inflight[0].end.seg <= seg) {
+        spool->n_inflight--;
+        memmove(&spool->inflight[0], &spool->inflight[1], spool->n_inflight * sizeof(spool_inflight_t));
+    }
+    if (spool->rd.seg <= seg) {
+        spool->rd = spool->head;
+    }
+    spool_remove_segments(spool);
+    spool_write_head(spool);
+}
+
+// Advance the head over acknowledged records, delete the segments left behind
+static void spool_advance(mqtt_spool_handle_t spool)
+{
+    int n = 0;
+    while (spool->n_inflight > 0 && spool->inflight[0].acked) {
+        spool->head = spool->inflight[0].end;
+        spool->n_inflight--;
+        memmove(&spool->inflight[0], &spool->inflight[1], spool->n_inflight * sizeof(spool_inflight_t));
+        n++;
+    }
+    if (n == 0) {
+        return;
+    }
+    spool->count -= n;
+    if (spool->n_inflight == 0) {
+        // everything sent is acknowledged, rd may be in a newer segment
+        spool->head = spool->rd;
+    }
+
+    bool removed = spool_remove_segments(spool);
+    if (spool->head.seg == spool->tail.seg && spool->head.off == spool->tail.off && spool->tail.off > 0) {
+        // spool is drained, drop the tail segment too
+        if (spool->wfile) {
+            fclose(spool->wfile);
+            spool->wfile = NULL;
+        }
+        spool->unsynced = 0;
+        spool->tail.seg++;
+        spool->tail.off = 0;
+        spool->head = spool->tail;
+        spool->rd = spool->tail;
+        removed |= spool_remove_segments(spool);
+    }
+
+    spool->head_dirty += n;
+    if (removed || spool->head_dirty >= (spool->sync_every > 0 ? spool->sync_every : MQTT_SPOOL_INFLIGHT)) {
+        spool_write_head(spool);
+    }
+}
+
+mqtt_spool_handle_t mqtt_spool_init(const char *dir, int max_size, int sync_every)
+{
+    char path[SPOOL_PATH_MAX];
+    if (strlen(dir) > SPOOL_PATH_MAX - 16) {
+        ESP_LOGE(TAG, "Spool directory name too long");
+        return NULL;
+    }
+    mkdir(dir, 0755);
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        ESP_LOGE(TAG, "Cannot open spool directory %s", dir);
+        return NULL;
+    }
+
+    mqtt_spool_handle_t spool = calloc(1, sizeof(struct mqtt_spool_t));
+    ESP_MEM_CHECK(TAG, spool, {
+        closedir(d);
+        return NULL;
+    });
+    spool->dir = strdup(dir);
+    spool->lock = xSemaphoreCreateMutex();
+    spool->max_size = max_size;
+    spool->sync_every = sync_every;
+    if (spool->dir == NULL || spool->lock == NULL) {
+        closedir(d);
+        mqtt_spool_destroy(spool);
+        ESP_LOGE(TAG, "Memory exhausted");
+        return NULL;
+    }
+
+    // find the existing segments
+    uint32_t seg, min_seg = UINT32_MAX, max_seg = 0;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        if (sscanf(de->d_name, "seg%05u.log", &seg) == 1) {
+            if (seg < min_seg) min_seg = seg;
+            if (seg > max_seg) max_seg = seg;
+        }
+    }
+    closedir(d);
+
+    snprintf(path, SPOOL_PATH_MAX, "%s/%s", spool->dir, SPOOL_HEAD_FILE);
+    FILE *f = fopen(path, "rb");
+    if (f == NULL || fread(&spool->head, 1, sizeof(spool_pos_t), f) != sizeof(spool_pos_t)) {
+        spool->head.seg = (min_seg == UINT32_MAX) ? 1 : min_seg;
+        spool->head.off = 0;
+    }
+    if (f) fclose(f);
+
+    // always append to a new segment, the last one may end with a partly written record
+    spool->tail.seg = (min_seg == UINT32_MAX) ? 1 : max_seg + 1;
+    if (spool->tail.seg < spool->head.seg) {
+        spool->tail.seg = spool->head.seg;
+    }
+    if (spool->head.seg >= spool->tail.seg) {
+        spool->head = spool->tail;
+    }
+    spool->first = (min_seg == UINT32_MAX) ? spool->head.seg : min_seg;
+    spool_remove_segments(spool);
+
+    int fsize;
+    for (seg = spool->head.seg; seg < spool->tail.seg; seg++) {
+        spool->count += spool_scan_segment(spool, seg, (seg == spool->head.seg) ? spool->head.off : 0, &fsize);
+        spool->size += fsize;
+    }
+    spool->rd = spool->head;
+    if (spool->count) {
+        ESP_LOGI(TAG, "%d spooled message(s) in %s", spool->count, spool->dir);
+    }
+    return spool;
+}
+
+esp_err_t mqtt_spool_put(mqtt_spool_handle_t spool, const char *topic, int topic_len, const char *data, int len, int qos, int retain)
+{
+    spool_rec_hdr_t hdr;
+    esp_err_t err = ESP_FAIL;
+
+    hdr.magic = SPOOL_MAGIC;
+    hdr.flags = (qos & 3) | (retain ? 4 : 0);
+    hdr.topic_len = topic_len;
+    hdr.data_len = len;
+    int rec_len = spool_rec_len(&hdr);
+    if (rec_len > spool->max_size) {
+        ESP_LOGE(TAG, "Message too large for the spool");
+        return ESP_FAIL;
+    }
+
+    xSemaphoreTake(spool->lock, portMAX_DELAY);
+    if (spool->tail.off > 0 && spool->tail.off + rec_len > MQTT_SPOOL_SEGMENT_SIZE) {
+        spool_close_segment(spool);
+    }
+    while (spool->size + rec_len > spool->max_size && spool->head.seg < spool->tail.seg) {
+        spool_drop_oldest(spool);
+    }
+    if (spool->size + rec_len > spool->max_size) {
+        ESP_LOGE(TAG, "Spool full");
+        goto exit;
+    }
+    if (spool->wfile == NULL) {
+        char path[SPOOL_PATH_MAX];
+        spool_seg_path(spool, spool->tail.seg, path);
+        spool->wfile = fopen(path, "ab");
+        if (spool->wfile == NULL) {
+            ESP_LOGE(TAG, "Error opening %s", path);
+            goto exit;
+        }
+    }
+    if (fwrite(&hdr, 1, sizeof(hdr), spool->wfile) != sizeof(hdr) ||
+        fwrite(topic, 1, topic_len, spool->wfile) != topic_len ||
+        fwrite(data, 1, len, spool->wfile) != len) {
+        ESP_LOGE(TAG, "Error writing to spool");
+        // the partial record ends this segment
+        spool->size += rec_len;
+        spool_close_segment(spool);
+        goto exit;
+    }
+    spool->tail.off += rec_len;
+    spool->size += rec_len;
+    spool->count++;
+    spool->unsynced++;
+    if (spool->sync_every > 0 && spool->unsynced >= spool->sync_every) {
+        spool_file_sync(spool->wfile);
+        spool->unsynced = 0;
+    }
+    err = ESP_OK;
+exit:
+    xSemaphoreGive(spool->lock);
+    return err;
+}
+
+/*
+ * Get the next record to send.
+ * The returned pointers are valid until the next call.
+ * Returns false if there is nothing to send or the in-flight window is full.
+ */
+bool mqtt_spool_next(mqtt_spool_handle_t spool, const char **topic, const char **data, int *len, int *qos, int *retain)
+{
+    char path[SPOOL_PATH_MAX];
+    spool_rec_hdr_t hdr;
+    bool found = false;
+
+    xSemaphoreTake(spool->lock, portMAX_DELAY);
+    while (spool->n_inflight < MQTT_SPOOL_INFLIGHT) {
+        if (spool->rd.seg > spool->tail.seg || (spool->rd.seg == spool->tail.seg && spool->rd.off >= spool->tail.off)) {
+            break;
+        }
+        if (spool->rd.seg == spool->tail.seg && spool->wfile) {
+            fflush(spool->wfile);
+        }
+        if (spool->rfile == NULL || spool->rseg != spool->rd.seg) {
+            if (spool->rfile) fclose(spool->rfile);
+            spool_seg_path(spool, spool->rd.seg, path);
+            spool->rfile = fopen(path, "rb");
+            spool->rseg = spool->rd.seg;
+        }
+        bool valid = false;
+        if (spool->rfile && fseek(spool->rfile, spool->rd.off, SEEK_SET) == 0 &&
+            fread(&hdr, 1, sizeof(hdr), spool->rfile) == sizeof(hdr) && hdr.magic == SPOOL_MAGIC) {
+            int need = hdr.topic_len + hdr.data_len + 2;
+            if (need > spool->buf_size) {
+                char *buf = realloc(spool->buf, need);
+                if (buf == NULL) {
+                    ESP_LOGE(TAG, "Memory exhausted");
+                    break;
+                }
+                spool->buf = buf;
+                spool->buf_size = need;
+            }
+            valid = (fread(spool->buf, 1, hdr.topic_len, spool->rfile) == hdr.topic_len) &&
+                    (fread(spool->buf + hdr.topic_len + 1, 1, hdr.data_len, spool->rfile) == hdr.data_len);
+        }
+        if (!valid) {
+            if (spool->rd.seg == spool->tail.seg) {
+                break;
+            }
+            // missing segment or end of a segment with partial record, continue with the next one
+            spool->rd.seg++;
+            spool->rd.off = 0;
+            continue;
+        }
+        spool->buf[hdr.topic_len] = '\0';
+        spool->buf[hdr.topic_len + 1 + hdr.data_len] = '\0';
+        *topic = spool->buf;
+        *data = spool->buf + hdr.topic_len + 1;
+        *len = hdr.data_len;
+        *qos = hdr.flags & 3;
+        *retain = (hdr.flags & 4) ? 1 : 0;
+        spool->next_end.seg = spool->rd.seg;
+        spool->next_end.off = spool->rd.off + spool_rec_len(&hdr);
+        found = true;
+        break;
+    }
+    xSemaphoreGive(spool->lock);
+    return found;
+}
+
+// The record returned by mqtt_spool_next() was sent with 'msg_id' (0 for QoS 0)
+void mqtt_spool_sent(mqtt_spool_handle_t spool, int msg_id)
+{
+    xSemaphoreTake(spool->lock, portMAX_DELAY);
+    spool_inflight_t *inf = &spool->inflight[spool->n_inflight++];
+    inf->msg_id = msg_id;
+    inf->acked = (msg_id == 0);
+    inf->end = spool->next_end;
+    spool->rd = spool->next_end;
+    spool_advance(spool);
+    xSemaphoreGive(spool->lock);
+}
+
+// Returns true if 'msg_id' was sent from the spool
+bool mqtt_spool_ack(mqtt_spool_handle_t spool, int msg_id)
+{
+    bool found = false;
+    xSemaphoreTake(spool->lock, portMAX_DELAY);
+    for (int i = 0; i < spool->n_inflight; i++) {
+        if (spool->inflight[i].msg_id == msg_id && !spool->inflight[i].acked) {
+            spool->inflight[i].acked = true;
+            found = true;
+            spool_advance(spool);
+            break;
+        }
+    }
+    xSemaphoreGive(spool->lock);
+    return found;
+}
+
+bool mqtt_spool_is_inflight(mqtt_spool_handle_t spool, int msg_id)
+{
+    bool found = false;
+    xSemaphoreTake(spool->lock, portMAX_DELAY);
+    for (int i = 0; i < spool->n_inflight; i++) {
+        if (spool->inflight[i].msg_id == msg_id) {
+            found = true;
+            break;
+        }
+    }
+    xSemaphoreGive(spool->lock);
+    return found;
+}
+
+// Send all unacknowledged records again
+void mqtt_spool_rewind(mqtt_spool_handle_t spool)
+{
+    xSemaphoreTake(spool->lock, portMAX_DELAY);
+    spool->n_inflight = 0;
+    spool->rd = spool->head;
+    xSemaphoreGive(spool->lock);
+}
+
+void mqtt_spool_sync(mqtt_spool_handle_t spool)
+{
+    xSemaphoreTake(spool->lock, portMAX_DELAY);
+    if (spool->wfile && spool->unsynced) {
+        spool_file_sync(spool->wfile);
+        spool->unsynced = 0;
+    }
+    if (spool->head_dirty) {
+        spool_write_head(spool);
+    }
+    xSemaphoreGive(spool->lock);
+}
+
+int mqtt_spool_get_count(mqtt_spool_handle_t spool)
+{
+    return spool->count;
+}
+
+int mqtt_spool_get_size(mqtt_spool_handle_t spool)
+{
+    return spool->size;
+}
+
+void mqtt_spool_destroy(mqtt_spool_handle_t spool)
+{
+    if (spool->lock) {
+        mqtt_spool_sync(spool);
+        vSemaphoreDelete(spool->lock);
+    }
+    if (spool->wfile) fclose(spool->wfile);
+    if (spool->rfile) fclose(spool->rfile);
+    free(spool->buf);
+    free(spool->dir);
+    free(spool);
+}
@@ -21,6 +21,10 @@ const char *MQTT_TAG = "MQTT_CLIENT";
 
 const static int STOPPED_BIT = BIT0;
 
+// The client lock is recursive, event handlers and the spool replay may publish from the mqtt task
+#define MQTT_API_LOCK(c)          xSemaphoreTakeRecursive(c->api_lock, portMAX_DELAY)
+#define MQTT_API_UNLOCK(c)        xSemaphoreGiveRecursive(c->api_lock)
+
 extern int MainTaskCore;
 
 static esp_err_t esp_mqtt_dispatch_event(esp_mqtt_client_handle_t client);
@@ -205,6 +209,11 @@ static esp_err_t esp_mqtt_abort_connection(esp_mqtt_client_handle_t client)
     client->reconnect_tick = platform_tick_get_ms();
     client->state = MQTT_STATE_WAIT_TIMEOUT;
     ESP_LOGI(MQTT_TAG, "Reconnect after %d ms", client->wait_timeout_ms);
+    if (client->spool) {
+        // unacknowledged spooled messages are sent again after reconnect
+        mqtt_spool_rewind(client->spool);
+        mqtt_spool_sync(client->spool);
+    }
     client->event.event_id = MQTT_EVENT_DISCONNECTED;
     esp_mqtt_dispatch_event(client);
     return ESP_OK;
@@ -296,8 +305,18 @@ esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *co
     client->mqtt_state.connect_info = &client->connect_info;
     client->outbox = outbox_init();
     ESP_MEM_CHECK(MQTT_TAG, client->outbox, goto _mqtt_init_failed);
+    if (config->spool_dir && config->spool_dir[0]) {
+        client->spool = mqtt_spool_init(config->spool_dir,
+                                        (config->spool_size > 0) ? config->spool_size : MQTT_SPOOL_SIZE,
+                                        config->spool_sync);
+        if (client->spool == NULL) {
+            goto _mqtt_init_failed;
+        }
+    }
     client->status_bits = xEventGroupCreate();
     ESP_MEM_CHECK(MQTT_TAG, client->status_bits, goto _mqtt_init_failed);
+    client->api_lock = xSemaphoreCreateRecursiveMutex();
+    ESP_MEM_CHECK(MQTT_TAG, client->api_lock, goto _mqtt_init_failed);
     return client;
 
 _mqtt_init_failed:
@@ -311,7 +330,9 @@ esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client)
     esp_mqtt_destroy_config(client);
     transport_list_destroy(client->transport_list);
     outbox_destroy(client->outbox);
-    vEventGroupDelete(client->status_bits);
+    if (client->spool) mqtt_spool_destroy(client->spool);
+    if (client->status_bits) vEventGroupDelete(client->status_bits);
+    if (client->api_lock) vSemaphoreDelete(client->api_lock);
     free(client->mqtt_state.in_buffer);
     free(client->mqtt_state.out_buffer);
     free(client);
@@ -523,6 +544,8 @@ static esp_err_t mqtt_process_receive(esp_mqtt_client_handle_t client)
         return ESP_OK;
     }
 
+    // the acknowledges are built in the shared out_buffer
+    MQTT_API_LOCK(client);
     msg_type = mqtt_get_type(client->mqtt_state.in_buffer);
     msg_qos = mqtt_get_qos(client->mqtt_state.in_buffer);
     msg_id = mqtt_get_id(client->mqtt_state.in_buffer, client->mqtt_state.in_buffer_length);
@@ -570,6 +593,7 @@ static esp_err_t mqtt_process_receive(esp_mqtt_client_handle_t client)
             deliver_publish(client, client->mqtt_state.in_buffer, client->mqtt_state.message_length_read);
             break;
         case MQTT_MSG_TYPE_PUBACK:
+            if (client->spool) mqtt_spool_ack(client->spool, msg_id);
             if (is_valid_mqtt_msg(client, MQTT_MSG_TYPE_PUBLISH, msg_id)) {
                 ESP_LOGD(MQTT_TAG, "received MQTT_MSG_TYPE_PUBACK, finish QoS1 publish");
             client->event.event_id = MQTT_EVENT_PUBLISHED;
@@ -591,6 +615,7 @@ static esp_err_t mqtt_process_receive(esp_mqtt_client_handle_t client)
             break;
         case MQTT_MSG_TYPE_PUBCOMP:
             ESP_LOGD(MQTT_TAG, "received MQTT_MSG_TYPE_PUBCOMP");
+            if (client->spool) mqtt_spool_ack(client->spool, msg_id);
             if (is_valid_mqtt_msg(client, MQTT_MSG_TYPE_PUBREL, msg_id)) {
                 ESP_LOGD(MQTT_TAG, "Receive MQTT_MSG_TYPE_PUBCOMP, finish QoS2 publish");
             client->event.event_id = MQTT_EVENT_PUBLISHED;
@@ -607,10 +632,53 @@ static esp_err_t mqtt_process_receive(esp_mqtt_client_handle_t client)
             // Ignore
             break;
     }
+    MQTT_API_UNLOCK(client);
 
     return ESP_OK;
 }
 
+// Move the expired and overflowing outbox publish messages to the spool
+static void mqtt_spool_outbox(esp_mqtt_client_handle_t client)
+{
+    outbox_item_handle_t item;
+    while ((item = outbox_get_expired(client->outbox, platform_tick_get_ms(), OUTBOX_EXPIRED_TIMEOUT_MS)) ||
+           (outbox_get_size(client->outbox) > OUTBOX_MAX_SIZE && (item = outbox_dequeue(client->outbox)))) {
+        uint8_t *buffer = (uint8_t *)item->buffer;
+        if (mqtt_get_type(buffer) == MQTT_MSG_TYPE_PUBLISH) {
+            if (mqtt_spool_is_inflight(client->spool, item->msg_id)) {
+                // already in the spool, send all unacknowledged spooled messages again
+                mqtt_spool_rewind(client->spool);
+            } else {
+                uint32_t topic_len = item->len;
+                uint32_t data_len = item->len;
+                const char *topic = mqtt_get_publish_topic(buffer, &topic_len);
+                const char *data = mqtt_get_publish_data(buffer, &data_len);
+                if (topic) {
+                    ESP_LOGD(MQTT_TAG, "Spool unacknowledged message, id: %d", item->msg_id);
+                    mqtt_spool_put(client->spool, topic, topic_len, data ? data : "", data ? data_len : 0,
+                                   mqtt_get_qos(buffer), mqtt_get_retain(buffer));
+                }
+            }
+        }
+        outbox_delete(client->outbox, item->msg_id, item->msg_type);
+    }
+}
+
+// Send the spooled messages, a few at a time
+static void mqtt_spool_replay(esp_mqtt_client_handle_t client)
+{
+    const char *topic, *data;
+    int len, qos, retain;
+    while (client->state == MQTT_STATE_CONNECTED &&
+           mqtt_spool_next(client->spool, &topic, &data, &len, &qos, &retain)) {
+        int msg_id = esp_mqtt_client_publish(client, topic, data, len, qos, retain);
+        if (msg_id < 0) {
+            break;
+        }
+        mqtt_spool_sent(client->spool, msg_id);
+    }
+}
+
 static void esp_mqtt_task(void *pv)
 {
     esp_mqtt_client_handle_t client = (esp_mqtt_client_handle_t) pv;
@@ -665,18 +733,26 @@ static void esp_mqtt_task(void *pv)
                     break;
                 }
 
+                MQTT_API_LOCK(client);
                 if (platform_tick_get_ms() - client->keepalive_tick > client->connect_info.keepalive * 1000 / 2) {
                     if (esp_mqtt_client_ping(client) == ESP_FAIL) {
+                        MQTT_API_UNLOCK(client);
                         esp_mqtt_abort_connection(client);
                         break;
                     }
                     client->keepalive_tick = platform_tick_get_ms();
                 }
 
+                if (client->spool) {
+                    // the replay publishes through the shared out_buffer, as the API calls do
+                    mqtt_spool_outbox(client);
+                    mqtt_spool_replay(client);
+                }
                 //Delete mesaage after 30 senconds
                 outbox_delete_expired(client->outbox, platform_tick_get_ms(), OUTBOX_EXPIRED_TIMEOUT_MS);
                 //
                 outbox_cleanup(client->outbox, OUTBOX_MAX_SIZE);
+                MQTT_API_UNLOCK(client);
                 break;
             case MQTT_STATE_WAIT_TIMEOUT:
 
@@ -741,10 +817,12 @@ static esp_err_t esp_mqtt_client_ping(esp_mqtt_client_handle_t client)
 
 int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos)
 {
+    int msg_id;
     if (client->state != MQTT_STATE_CONNECTED) {
         ESP_LOGE(MQTT_TAG, "Client has not connected");
         return -1;
     }
+    MQTT_API_LOCK(client);
     mqtt_enqueue(client); //move pending msg to outbox (if have)
     client->mqtt_state.outbound_message = mqtt_msg_subscribe(&client->mqtt_state.mqtt_connection,
                                           topic, qos,
@@ -754,20 +832,25 @@ int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic
     client->mqtt_state.pending_msg_count ++;
 
     if (mqtt_write_data(client) != ESP_OK) {
+        MQTT_API_UNLOCK(client);
         ESP_LOGE(MQTT_TAG, "Error to subscribe topic=%s, qos=%d", topic, qos);
         return -1;
     }
 
     ESP_LOGD(MQTT_TAG, "Sent subscribe topic=%s, id: %d, type=%d successful", topic, client->mqtt_state.pending_msg_id, client->mqtt_state.pending_msg_type);
-    return client->mqtt_state.pending_msg_id;
+    msg_id = client->mqtt_state.pending_msg_id;
+    MQTT_API_UNLOCK(client);
+    return msg_id;
 }
 
 int esp_mqtt_client_unsubscribe(esp_mqtt_client_handle_t client, const char *topic)
 {
+    int msg_id;
     if (client->state != MQTT_STATE_CONNECTED) {
         ESP_LOGE(MQTT_TAG, "Client has not connected");
         return -1;
     }
+    MQTT_API_LOCK(client);
     mqtt_enqueue(client);
     client->mqtt_state.outbound_message = mqtt_msg_unsubscribe(&client->mqtt_state.mqtt_connection,
                                           topic,
@@ -778,24 +861,32 @@ int esp_mqtt_client_unsubscribe(esp_mqtt_client_handle_t client, const char *top
     client->mqtt_state.pending_msg_count ++;
 
     if (mqtt_write_data(client) != ESP_OK) {
+        MQTT_API_UNLOCK(client);
         ESP_LOGE(MQTT_TAG, "Error to unsubscribe topic=%s", topic);
         return -1;
     }
 
     ESP_LOGD(MQTT_TAG, "Sent Unsubscribe topic=%s, id: %d, successful", topic, client->mqtt_state.pending_msg_id);
-    return client->mqtt_state.pending_msg_id;
+    msg_id = client->mqtt_state.pending_msg_id;
+    MQTT_API_UNLOCK(client);
+    return msg_id;
 }
 
 int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos, int retain)
 {
     uint16_t pending_msg_id = 0;
+    if (len <= 0) {
+        len = strlen(data);
+    }
     if (client->state != MQTT_STATE_CONNECTED) {
+        if (client->spool && qos > 0) {
+            // store and forward after (re)connect
+            return (mqtt_spool_put(client->spool, topic, strlen(topic), data, len, qos, retain) == ESP_OK) ? 0 : -1;
+        }
         ESP_LOGE(MQTT_TAG, "Client has not connected");
         return -1;
     }
-    if (len <= 0) {
-        len = strlen(data);
-    }
+    MQTT_API_LOCK(client);
     if (qos > 0) {
         mqtt_enqueue(client);
     }
@@ -811,9 +902,11 @@ int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic,
     }
 
     if (mqtt_write_data(client) != ESP_OK) {
+        MQTT_API_UNLOCK(client);
         ESP_LOGE(MQTT_TAG, "Error publishing data to topic=%s, qos=%d", topic, qos);
         return -1;
     }
+    MQTT_API_UNLOCK(client);
     return pending_msg_id;
 }
 
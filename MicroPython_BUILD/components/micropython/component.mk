@@ -291,6 +291,7 @@ LIB_SRC_C += \
 	lib/berkeley-db-1.xx/btree/bt_close.c \
 	lib/berkeley-db-1.xx/btree/bt_debug.c \
 	lib/berkeley-db-1.xx/btree/bt_get.c \
+	lib/berkeley-db-1.xx/btree/bt_load.c \
 	lib/berkeley-db-1.xx/btree/bt_overflow.c \
 	lib/berkeley-db-1.xx/btree/bt_put.c \
 	lib/berkeley-db-1.xx/btree/bt_utils.c \
@@ -30,19 +30,68 @@
  * Copyright (c) 2017, LoBo
  */
 
+#ifdef FTP_HOST_BUILD
+#include "libs/ftp.h"
+#else
 #include "sdkconfig.h"
+#endif
 
 #ifdef CONFIG_MICROPY_USE_FTPSERVER
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <stdio.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <time.h>
 #include <sys/stat.h>
 
+#ifdef FTP_HOST_BUILD
+
+#include <dirent.h>
+#include <sys/time.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+// ==== Host (POSIX) build support ====
+
+#ifndef FTP_HOST_ROOT
+#define FTP_HOST_ROOT                       "."
+#endif
+#define VFS_NATIVE_MOUNT_POINT              FTP_HOST_ROOT "/flash"
+#define VFS_NATIVE_SDCARD_MOUNT_POINT       FTP_HOST_ROOT "/sd"
+#define VFS_NATIVE_INTERNAL_MP              "/flash"
+#define VFS_NATIVE_EXTERNAL_MP              "/sd"
+#define MICROPY_ALLOC_PATH_MAX              128
+#define MAX(a, b)                           (((a) > (b)) ? (a) : (b))
+
+#define ESP_LOGE(tag, fmt, ...)             fprintf(stderr, "E %s " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...)             fprintf(stderr, "W %s " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...)             fprintf(stderr, "I %s " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...)             do {} while (0)
+
+#define pdTRUE                              1
+#define portTICK_PERIOD_MS                  1
+#define closesocket(sd)                     close(sd)
+#define xSemaphoreTake(mutex, ticks)        ((pthread_mutex_lock(mutex) == 0) ? pdTRUE : 0)
+#define xSemaphoreGive(mutex)               pthread_mutex_unlock(mutex)
+#define xSemaphoreCreateMutex()             ftp_host_mutex()
+#define FTP_SEND_FLAGS                      MSG_NOSIGNAL
+
+static bool native_vfs_mounted[2] = { true, false };
+
+//----------------------------------------
+static QueueHandle_t ftp_host_mutex(void) {
+    static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    return &mutex;
+}
+
+#else
+
 #include "py/mpstate.h"
 #include "py/obj.h"
 #include "extmod/vfs_native.h"
@@ -68,7 +117,9 @@
 #include "freertos/task.h"
 #include "freertos/semphr.h"
 
-#include "modnetwork.h"
+#define FTP_SEND_FLAGS                      0
+
+#endif
 
 TaskHandle_t FtpTaskHandle = NULL;
 QueueHandle_t ftp_mutex = NULL;
@@ -80,16 +131,22 @@ const char *FTP_TAG = "[Ftp]";
 /******************************************************************************
  DEFINE PRIVATE CONSTANTS
  ******************************************************************************/
+#ifndef FTP_CMD_PORT						// the ports can be changed for the host build
 #define FTP_CMD_PORT                        21
+#endif
 #define FTP_ACTIVE_DATA_PORT                20
-#define FTP_PASIVE_DATA_PORT                2024
+#ifndef FTP_PASIVE_DATA_PORT
+#define FTP_PASIVE_DATA_PORT                2024	// + session number
+#endif
 #define FTP_CMD_SIZE_MAX                    6
-#define FTP_CMD_CLIENTS_MAX                 1
-#define FTP_DATA_CLIENTS_MAX                1
+#define FTP_MAX_SESSIONS                    CONFIG_MICROPY_FTPSERVER_MAX_SESSIONS
 #define FTP_MAX_PARAM_SIZE                  (MICROPY_ALLOC_PATH_MAX + 1)
+#define FTP_CMD_BUFFER_SIZE                 (FTP_MAX_PARAM_SIZE + FTP_CMD_SIZE_MAX)
 #define FTP_UNIX_SECONDS_180_DAYS           15552000
 #define FTP_DATA_TIMEOUT_MS                 10000	// 10 seconds
-#define FTP_SOCKETFIFO_ELEMENTS_MAX         4
+#define FTP_REPLY_TIMEOUT_MS                200
+#define FTP_SELECT_TIMEOUT_MS               20		// max time spent waiting for socket activity in ftp_run()
+#define FTP_TX_BUDGET                       8		// max buffers transferred per session in one ftp_run() call
 
 /******************************************************************************
  DEFINE PRIVATE TYPES
@@ -111,36 +168,51 @@ typedef enum {
     E_FTP_DIR_OPEN
 } ftp_e_open_t;
 
-typedef enum {
-    E_FTP_CLOSE_NONE = 0,
-    E_FTP_CLOSE_DATA,
-    E_FTP_CLOSE_CMD_AND_DATA,
-} ftp_e_closesocket_t;
-
+/*
+ * Client session
+ * Outgoing data (file or listing) is double buffered: while one buffer is being
+ * sent, the next block is read into the other one, so the flash reads overlap
+ * with the TCP transmission.
+ */
 typedef struct {
-    uint8_t         *dBuffer;
+    uint8_t         *dbuf[2];       // transfer buffers
+    uint32_t        dlen[2];        // data length in each buffer, 0: buffer is free
+    uint32_t        dpos;           // bytes of dbuf[dcur] already sent
+    uint32_t        buff_size;
+    char            *path;
+    char            *scratch;
+    char            *cmd;
     uint32_t        ctimeout;
     union {
         DIR         *dp;
         FILE        *fp;
     };
-    int32_t         lc_sd;
     int32_t         ld_sd;
     int32_t         c_sd;
     int32_t         d_sd;
     int32_t         dtimeout;
     uint32_t        ip_addr;
+    uint16_t        data_port;
+    uint8_t         dcur;           // buffer being sent
     uint8_t         state;
     uint8_t         substate;
-    uint8_t         txRetries;
-    uint8_t         logginRetries;
-    ftp_loggin_t	loggin;
     uint8_t         e_open;
+    ftp_loggin_t	loggin;
+    bool            deof;           // no more data to queue
+    bool            derror;         // reading the file failed
     bool            closechild;
-    bool            enabled;
     bool            listroot;
+    bool            nlist;
     uint32_t		total;
     uint32_t		time;
+} ftp_session_t;
+
+typedef struct {
+    ftp_session_t   session[FTP_MAX_SESSIONS];
+    ftp_stats_t     stats;
+    int32_t         lc_sd;
+    uint8_t         state;
+    bool            enabled;
 } ftp_data_t;
 
 typedef struct {
@@ -185,10 +257,6 @@ char ftp_pass[FTP_USER_PASS_LEN_MAX + 1];
  DECLARE PRIVATE DATA
  ******************************************************************************/
 static ftp_data_t ftp_data = {0};
-static char *ftp_path = NULL;
-static char *ftp_scratch_buffer = NULL;;
-static char *ftp_cmd_buffer = NULL;
-static uint8_t ftp_nlist = 0;
 static const ftp_cmd_t ftp_cmd_table[] = { { "FEAT" }, { "SYST" }, { "CDUP" }, { "CWD"  },
                                            { "PWD"  }, { "XPWD" }, { "SIZE" }, { "MDTM" },
                                            { "TYPE" }, { "USER" }, { "PASS" }, { "PASV" },
@@ -206,78 +274,64 @@ static void stoupper (char *str) {
     }
 }
 
+//-----------------------------------
+static void ftp_sleep_ms(uint32_t ms)
+{
+	#ifdef FTP_HOST_BUILD
+	usleep(ms * 1000);
+	#else
+	vTaskDelay((ms < portTICK_PERIOD_MS) ? 1 : (ms / portTICK_PERIOD_MS));
+	#endif
+}
+
+//------------------------------------------
+static bool ftp_is_transfer(ftp_session_t *s)
+{
+	return ((s->state == E_FTP_STE_CONTINUE_FILE_TX) || (s->state == E_FTP_STE_CONTINUE_FILE_RX));
+}
+
 // ==== File functions =========================================
 
-//--------------------------------------------------------------
-static bool ftp_open_file (const char *path, const char *mode) {
-	ftp_data.fp = fopen(path, mode);
-    if (ftp_data.fp == NULL) {
+//--------------------------------------------------------------------------------
+static bool ftp_open_file (ftp_session_t *s, const char *path, const char *mode) {
+	s->fp = fopen(path, mode);
+    if (s->fp == NULL) {
         return false;
     }
-    ftp_data.e_open = E_FTP_FILE_OPEN;
+    s->e_open = E_FTP_FILE_OPEN;
     return true;
 }
 
-//--------------------------------------
-static void ftp_close_files_dir (void) {
-    if (ftp_data.e_open == E_FTP_FILE_OPEN) {
-        fclose(ftp_data.fp);
-    	ftp_data.fp = NULL;
-    }
-    else if (ftp_data.e_open == E_FTP_DIR_OPEN) {
-        closedir(ftp_data.dp);
-    	ftp_data.dp = NULL;
-    }
-    ftp_data.e_open = E_FTP_NOTHING_OPEN;
-}
-
-//------------------------------------------------
-static void ftp_close_filesystem_on_error (void) {
-    ftp_close_files_dir();
-    if (ftp_data.fp) {
-    	fclose(ftp_data.fp);
-    	ftp_data.fp = NULL;
+//----------------------------------------------------
+static void ftp_close_files_dir (ftp_session_t *s) {
+    if (s->e_open == E_FTP_FILE_OPEN) {
+        fclose(s->fp);
+    	s->fp = NULL;
     }
-    if (ftp_data.dp) {
-    	closedir(ftp_data.dp);
-    	ftp_data.dp = NULL;
+    else if (s->e_open == E_FTP_DIR_OPEN) {
+        closedir(s->dp);
+    	s->dp = NULL;
     }
+    s->e_open = E_FTP_NOTHING_OPEN;
 }
 
-//---------------------------------------------------------------------------------------------
-static ftp_result_t ftp_read_file (char *filebuf, uint32_t desiredsize, uint32_t *actualsize) {
-    ftp_result_t result = E_FTP_RESULT_CONTINUE;
-    *actualsize = fread(filebuf, 1, desiredsize, ftp_data.fp);
-    if (*actualsize == 0) {
-        ftp_close_files_dir();
-        result = E_FTP_RESULT_FAILED;
-    } else if (*actualsize < desiredsize) {
-        ftp_close_files_dir();
-        result = E_FTP_RESULT_OK;
-    }
-    return result;
-}
-
-//-----------------------------------------------------------------
-static ftp_result_t ftp_write_file (char *filebuf, uint32_t size) {
+//-------------------------------------------------------------------
+static ftp_result_t ftp_write_file (ftp_session_t *s, char *filebuf, uint32_t size) {
     ftp_result_t result = E_FTP_RESULT_FAILED;
-    uint32_t actualsize = fwrite(filebuf, 1, size, ftp_data.fp);
+    uint32_t actualsize = fwrite(filebuf, 1, size, s->fp);
     if (actualsize == size) {
         result = E_FTP_RESULT_OK;
     } else {
-        ftp_close_files_dir();
+        ftp_close_files_dir(s);
     }
     return result;
 }
 
-//---------------------------------------------------------------
-static ftp_result_t ftp_open_dir_for_listing (const char *path) {
-    if (ftp_data.dp) {
-    	closedir(ftp_data.dp);
-    	ftp_data.dp = NULL;
-    }
+//---------------------------------------------------------------------------------
+static ftp_result_t ftp_open_dir_for_listing (ftp_session_t *s, const char *path) {
+    if (s->e_open != E_FTP_NOTHING_OPEN) ftp_close_files_dir(s);
     if (path[0] == '/' && path[1] == '\0') {
-        ftp_data.listroot = true;
+        s->listroot = true;
     	ESP_LOGD(FTP_TAG, "ftp_open_dir_for_listing: root");
     }
     else {
@@ -287,26 +341,26 @@ static ftp_result_t ftp_open_dir_for_listing (const char *path) {
     		strcat(fullname, "/");
     	}
     	ESP_LOGD(FTP_TAG, "ftp_open_dir_for_listing: %s", fullname);
-		ftp_data.dp = opendir(fullname);  // Open the directory
-		if (ftp_data.dp == NULL) {
+		s->dp = opendir(fullname);  // Open the directory
+		if (s->dp == NULL) {
 			return E_FTP_RESULT_FAILED;
 		}
-		ftp_data.e_open = E_FTP_DIR_OPEN;
-        ftp_data.listroot = false;
+		s->e_open = E_FTP_DIR_OPEN;
+        s->listroot = false;
     }
     return E_FTP_RESULT_CONTINUE;
 }
 
-//---------------------------------------------------------------------------------
-static int ftp_get_eplf_item (char *dest, uint32_t destsize, struct dirent *de) {
+//---------------------------------------------------------------------------------------------------
+static int ftp_get_eplf_item (ftp_session_t *s, char *dest, uint32_t destsize, struct dirent *de) {
 
     char *type = (de->d_type & DT_DIR) ? "d" : "-";
 
     // Get full file path needed for stat function
     char fullname[128];
-    strcpy(fullname, ftp_path);
+    strcpy(fullname, s->path);
     if (fullname[strlen(fullname)-1] != '/') strcat(fullname, "/");
-    strcat(fullname, de->d_name);
+    strncat(fullname, de->d_name, sizeof(fullname) - strlen(fullname) - 1);
 
     struct stat buf;
 	int res = stat(fullname, &buf);
@@ -322,28 +376,16 @@ static int ftp_get_eplf_item (char *dest, uint32_t destsize, struct dirent *de)
     tm_info = localtime(&buf.st_mtime);		// get broken-down file time
 
     // if file is older than 180 days show dat,month,year else show month, day and time
-    if ((buf.st_mtime + FTP_UNIX_SECONDS_180_DAYS) < now) strftime(str_time, 127, "%b %d %Y", tm_info);
+    if ((buf.st_mtime + FTP_UNIX_SECONDS_180_DAYS) < now) strftime(str_time, 63, "%b %d %Y", tm_info);
     else strftime(str_time, 63, "%b %d %H:%M", tm_info);
 
-    int addsize = destsize + 64;
-
-    while (addsize >= destsize) {
-        if (ftp_nlist) addsize = snprintf(dest, destsize, "%s\r\n", de->d_name);
-        else addsize = snprintf(dest, destsize, "%srw-rw-rw-   1 root  root %9u %s %s\r\n", type, (uint32_t)buf.st_size, str_time, de->d_name);
-        if (addsize >= destsize) {
-			ESP_LOGW(FTP_TAG, "Buffer too small, reallocating [%d > %d]", ftp_buff_size, ftp_buff_size + (addsize - destsize) + 64);
-			char *new_dest = realloc(dest, ftp_buff_size + (addsize - destsize) + 65);
-			if (new_dest) {
-				ftp_buff_size += (addsize - destsize) + 64;
-				destsize += (addsize - destsize) + 64;
-				dest = new_dest;
-				addsize = destsize + 64;
-			}
-			else {
-				ESP_LOGE(FTP_TAG, "Buffer reallocation ERROR");
-				addsize = 0;
-			}
-        }
+    int addsize;
+    if (s->nlist) addsize = snprintf(dest, destsize, "%s\r\n", de->d_name);
+    else addsize = snprintf(dest, destsize, "%srw-rw-rw-   1 root  root %9u %s %s\r\n", type, (uint32_t)buf.st_size, str_time, de->d_name);
+    if (addsize >= destsize) {
+        // does not fit into the buffer, skip the entry
+		ESP_LOGW(FTP_TAG, "List entry too long for the buffer [%d > %u]", addsize, destsize);
+		addsize = 0;
     }
     return addsize;
 }
@@ -361,14 +403,14 @@ static int ftp_get_eplf_drive (char *dest, uint32_t destsize, char *name) {
     return snprintf(dest, destsize, "%srw-rw-rw-   1 root  root %9u %s %s\r\n", type, 0, str_time, name);
 }
 
-//--------------------------------------------------------------------------------------
-static ftp_result_t ftp_list_dir(char *list, uint32_t maxlistsize, uint32_t *listsize) {
-    uint next = 0;
-    uint listcount = 0;
+//--------------------------------------------------------------------------------------------------------
+static ftp_result_t ftp_list_dir(ftp_session_t *s, char *list, uint32_t maxlistsize, uint32_t *listsize) {
+    uint32_t next = 0;
+    uint32_t listcount = 0;
     ftp_result_t result = E_FTP_RESULT_CONTINUE;
 	struct dirent *de;
 
-    if (ftp_data.listroot) {
+    if (s->listroot) {
     	if (native_vfs_mounted[0]) {
             next += ftp_get_eplf_drive((list + next), (maxlistsize - next), "flash");
     	}
@@ -381,7 +423,7 @@ static ftp_result_t ftp_list_dir(char *list, uint32_t maxlistsize, uint32_t *lis
 
     // read up to 8 directory items
     while (((maxlistsize - next) > 64) && (listcount < 8)) {
-		de = readdir(ftp_data.dp);                  										// Read a directory item
+		de = readdir(s->dp);                  												// Read a directory item
 		if (de == NULL) {
 			result = E_FTP_RESULT_OK;
 			break;                                                                          // Break on error or end of dp
@@ -391,42 +433,97 @@ static ftp_result_t ftp_list_dir(char *list, uint32_t maxlistsize, uint32_t *lis
 
 		// add the entry to the list
     	ESP_LOGD(FTP_TAG, "Add to dir list: %s", de->d_name);
-		next += ftp_get_eplf_item((list + next), (maxlistsize - next), de);
+		next += ftp_get_eplf_item(s, (list + next), (maxlistsize - next), de);
         listcount++;
     }
     if (result == E_FTP_RESULT_OK) {
-        ftp_close_files_dir();
+        ftp_close_files_dir(s);
     }
     *listsize = next;
     return result;
 }
 
-// ==== Socket functions ==============================================================
+// ==== Session functions ==============================================================
+
+//-----------------------------------------------
+static void ftp_session_free(ftp_session_t *s) {
+	for (int i=0; i<2; i++) {
+		if (s->dbuf[i]) free(s->dbuf[i]);
+		s->dbuf[i] = NULL;
+	}
+	if (s->path) free(s->path);
+	if (s->scratch) free(s->scratch);
+	if (s->cmd) free(s->cmd);
+	s->path = NULL;
+	s->scratch = NULL;
+	s->cmd = NULL;
+}
 
-//------------------------------------
-static void ftp_close_cmd_data(void) {
-    closesocket(ftp_data.c_sd);
-    closesocket(ftp_data.d_sd);
-    ftp_data.c_sd  = -1;
-    ftp_data.d_sd  = -1;
-    ftp_close_filesystem_on_error ();
+// Allocate the session buffers (from the RTOS heap)
+//-----------------------------------------------
+static bool ftp_session_alloc(ftp_session_t *s) {
+	s->buff_size = ftp_buff_size;
+	s->dbuf[0] = malloc(s->buff_size+1);
+	s->dbuf[1] = malloc(s->buff_size+1);
+	s->path = malloc(FTP_MAX_PARAM_SIZE);
+	s->scratch = malloc(FTP_MAX_PARAM_SIZE);
+	s->cmd = malloc(FTP_CMD_BUFFER_SIZE + 1);
+	if ((s->dbuf[0] == NULL) || (s->dbuf[1] == NULL) || (s->path == NULL) || (s->scratch == NULL) || (s->cmd == NULL)) {
+		ftp_session_free(s);
+		return false;
+	}
+	return true;
+}
+
+//------------------------------------------------
+static void ftp_reset_data(ftp_session_t *s) {
+	s->dlen[0] = 0;
+	s->dlen[1] = 0;
+	s->dpos = 0;
+	s->dcur = 0;
+	s->deof = false;
+	s->derror = false;
+}
+
+//-------------------------------------------------
+static void ftp_close_data(ftp_session_t *s) {
+    if (s->d_sd >= 0) closesocket(s->d_sd);
+    s->d_sd = -1;
+    ftp_close_files_dir(s);
+    ftp_reset_data(s);
+}
+
+// Close all session sockets and free the session
+//--------------------------------------------------
+static void ftp_close_session(ftp_session_t *s) {
+	if (s->c_sd >= 0) {
+		ESP_LOGI(FTP_TAG, "Session %d closed.", (int)(s - ftp_data.session));
+	}
+	ftp_close_data(s);
+    if (s->c_sd >= 0) closesocket(s->c_sd);
+    if (s->ld_sd >= 0) closesocket(s->ld_sd);
+    s->c_sd  = -1;
+    s->ld_sd = -1;
+    s->state = E_FTP_STE_READY;
+    s->substate = E_FTP_STE_SUB_DISCONNECTED;
+    ftp_session_free(s);
 }
 
 //----------------------------
 static void _ftp_reset(void) {
     // close all connections and start all over again
 	ESP_LOGW(FTP_TAG, "FTP RESET");
-    closesocket(ftp_data.lc_sd);
-    closesocket(ftp_data.ld_sd);
+	if (ftp_data.lc_sd >= 0) closesocket(ftp_data.lc_sd);
     ftp_data.lc_sd = -1;
-    ftp_data.ld_sd = -1;
-    ftp_close_cmd_data();
-
-    ftp_data.e_open = E_FTP_NOTHING_OPEN;
+	for (int i=0; i<FTP_MAX_SESSIONS; i++) {
+		ftp_close_session(&ftp_data.session[i]);
+	}
+	ftp_data.stats.sessions = 0;
     ftp_data.state = E_FTP_STE_START;
-    ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
 }
 
+// ==== Socket functions ==============================================================
+
 //-------------------------------------------------------------------------------------
 static bool ftp_create_listening_socket (int32_t *sd, uint32_t port, uint8_t backlog) {
     struct sockaddr_in sServerAddress;
@@ -437,7 +534,7 @@ static bool ftp_create_listening_socket (int32_t *sd, uint32_t port, uint8_t bac
     *sd = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
     _sd = *sd;
 
-    if (_sd > 0) {
+    if (_sd >= 0) {
         // enable non-blocking mode
         uint32_t option = fcntl(_sd, F_GETFL, 0);
         option |= O_NONBLOCK;
@@ -448,9 +545,12 @@ static bool ftp_create_listening_socket (int32_t *sd, uint32_t port, uint8_t bac
         result = setsockopt(_sd, SOL_SOCKET, SO_REUSEADDR, &option, sizeof(option));
 
         // bind the socket to a port number
+        memset(&sServerAddress, 0, sizeof(sServerAddress));
         sServerAddress.sin_family = AF_INET;
         sServerAddress.sin_addr.s_addr = INADDR_ANY;
+		#ifndef FTP_HOST_BUILD
         sServerAddress.sin_len = sizeof(sServerAddress);
+		#endif
         sServerAddress.sin_port = htons(port);
 
         result |= bind(_sd, (const struct sockaddr *)&sServerAddress, sizeof(sServerAddress));
@@ -462,6 +562,7 @@ static bool ftp_create_listening_socket (int32_t *sd, uint32_t port, uint8_t bac
             return true;
         }
         closesocket(*sd);
+        *sd = -1;
     }
     return false;
 }
@@ -469,164 +570,83 @@ static bool ftp_create_listening_socket (int32_t *sd, uint32_t port, uint8_t bac
 //--------------------------------------------------------------------------------------------
 static ftp_result_t ftp_wait_for_connection (int32_t l_sd, int32_t *n_sd, uint32_t *ip_addr) {
     struct sockaddr_in  sClientAddress;
-    socklen_t  in_addrSize;
+    socklen_t  in_addrSize = sizeof(sClientAddress);
 
     // accepts a connection from a TCP client, if there is any, otherwise returns EAGAIN
-    *n_sd = accept(l_sd, (struct sockaddr *)&sClientAddress, (socklen_t *)&in_addrSize);
+    *n_sd = accept(l_sd, (struct sockaddr *)&sClientAddress, &in_addrSize);
     int32_t _sd = *n_sd;
     if (_sd < 0) {
-        if (errno == EAGAIN) {
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
             return E_FTP_RESULT_CONTINUE;
         }
         // error
-        _ftp_reset();
         return E_FTP_RESULT_FAILED;
     }
 
     if (ip_addr) {
-        // check on which network interface the client was connected and save the IP address
-        tcpip_adapter_ip_info_t ip_info = {0};
-        int n_if = network_get_active_interfaces();
-
-        if (n_if > 0) {
-            struct sockaddr_in clientAddr;
-            in_addrSize = sizeof(struct sockaddr_in);
-            getpeername(_sd, (struct sockaddr *)&clientAddr, (socklen_t *)&in_addrSize);
-            ESP_LOGD(FTP_TAG, "Client IP: %08x", clientAddr.sin_addr.s_addr);
-            *ip_addr = 0;
-            for (int i=0; i<n_if; i++) {
-                tcpip_adapter_get_ip_info(tcpip_if[i], &ip_info);
-                ESP_LOGD(FTP_TAG, "Adapter: %08x, %08x", ip_info.ip.addr, ip_info.netmask.addr);
-                if ((ip_info.ip.addr & ip_info.netmask.addr) == (ip_info.netmask.addr & clientAddr.sin_addr.s_addr)) {
-                    *ip_addr = ip_info.ip.addr;
-                    ESP_LOGD(FTP_TAG, "Client connected on interface %d", tcpip_if[i]);
-                    break;
-                }
-            }
-            if (*ip_addr == 0) {
-                ESP_LOGE(FTP_TAG, "No IP address detected (?!)");
-            }
+        // the local address of the connection is the address of the interface
+        // the client is connected on, it is used in the PASV reply
+        struct sockaddr_in localAddr;
+        in_addrSize = sizeof(struct sockaddr_in);
+        if (getsockname(_sd, (struct sockaddr *)&localAddr, &in_addrSize) == 0) {
+            *ip_addr = localAddr.sin_addr.s_addr;
+            ESP_LOGD(FTP_TAG, "Client %08x connected on %08x", sClientAddress.sin_addr.s_addr, *ip_addr);
         }
         else {
-            ESP_LOGE(FTP_TAG, "No active interface (?!)");
+            *ip_addr = 0;
+            ESP_LOGE(FTP_TAG, "No IP address detected (?!)");
         }
     }
 
-    // enable non-blocking mode if not data channel connection
+    // all connections are non-blocking
     uint32_t option = fcntl(_sd, F_GETFL, 0);
-    if (l_sd != ftp_data.ld_sd) option |= O_NONBLOCK;
+    option |= O_NONBLOCK;
     fcntl(_sd, F_SETFL, option);
 
     // client connected, so go on
     return E_FTP_RESULT_OK;
 }
 
-//-----------------------------------------------------------
-static void ftp_send_reply (uint32_t status, char *message) {
-    if (!message) {
-        message = "";
-    }
-    snprintf((char *)ftp_cmd_buffer, 4, "%u", status);
-    strcat ((char *)ftp_cmd_buffer, " ");
-    strcat ((char *)ftp_cmd_buffer, message);
-    strcat ((char *)ftp_cmd_buffer, "\r\n");
-
-    int32_t timeout = 200;
-    ftp_result_t result;
-    uint32_t size = strlen((char *)ftp_cmd_buffer);
-
-    ESP_LOGD(FTP_TAG, "Send reply: [%s]", ftp_cmd_buffer);
-    vTaskDelay(1);
-
-    while (1) {
-        result = send(ftp_data.c_sd, ftp_cmd_buffer, size, 0);
-		if (result == size) {
-			if (status == 221) {
-				closesocket(ftp_data.d_sd);
-				ftp_data.d_sd = -1;
-				closesocket(ftp_data.ld_sd);
-				ftp_data.ld_sd = -1;
-				closesocket(ftp_data.c_sd);
-				ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
-				ftp_close_filesystem_on_error();
-			}
-			else if (status == 426 || status == 451 || status == 550) {
-				closesocket(ftp_data.d_sd);
-				ftp_data.d_sd = -1;
-				ftp_close_filesystem_on_error();
-			}
-			vTaskDelay(1);
-			ESP_LOGD(FTP_TAG, "Send reply: OK (%u)", size);
-			break;
-		}
-		else {
-		    vTaskDelay(1);
-			if ((timeout <= 0) || (errno != EAGAIN)) {
-				// error
-				_ftp_reset();
-	            ESP_LOGW(FTP_TAG, "Error sending command reply.");
-				break;
-			}
-		}
-		timeout -= portTICK_PERIOD_MS;
+// Send all data to the non-blocking socket, waiting max 'timeout' ms if the socket buffer is full
+//-----------------------------------------------------------------------------------
+static bool ftp_send_all (int32_t sd, const uint8_t *data, uint32_t size, int32_t timeout) {
+    while (size > 0) {
+        int32_t sent = send(sd, data, size, FTP_SEND_FLAGS);
+        if (sent > 0) {
+            data += sent;
+            size -= sent;
+            continue;
+        }
+        if ((sent < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)) && (timeout > 0)) {
+            ftp_sleep_ms(portTICK_PERIOD_MS);
+            timeout -= portTICK_PERIOD_MS;
+            continue;
+        }
+        return false;
     }
+    return true;
 }
 
-//------------------------------------------
-static void ftp_send_list(uint32_t datasize)
-{
-    int32_t timeout = 200;
-    ftp_result_t result;
-
-    ESP_LOGD(FTP_TAG, "Send list data: (%u)", datasize);
-    vTaskDelay(1);
-
-    while (1) {
-        result = send(ftp_data.d_sd, ftp_data.dBuffer, datasize, 0);
-		if (result == datasize) {
-			vTaskDelay(1);
-			ESP_LOGD(FTP_TAG, "Send OK");
-			break;
-		}
-		else {
-		    vTaskDelay(1);
-			if ((timeout <= 0) || (errno != EAGAIN)) {
-				// error
-				_ftp_reset();
-				ESP_LOGW(FTP_TAG, "Error sending list data.");
-				break;
-			}
-		}
-		timeout -= portTICK_PERIOD_MS;
+//-----------------------------------------------------------------------------
+static void ftp_send_reply (ftp_session_t *s, uint32_t status, char *message) {
+    if (!message) {
+        message = "";
     }
-}
-
-//-----------------------------------------------
-static void ftp_send_file_data(uint32_t datasize)
-{
-    ftp_result_t result;
-    uint32_t timeout = 200;
+    snprintf(s->cmd, FTP_CMD_BUFFER_SIZE, "%u %s\r\n", status, message);
+    uint32_t size = strlen(s->cmd);
 
-    ESP_LOGD(FTP_TAG, "Send file data: (%u)", datasize);
-    vTaskDelay(1);
+    ESP_LOGD(FTP_TAG, "Send reply: [%s]", s->cmd);
 
-    while (1) {
-        result = send(ftp_data.d_sd, ftp_data.dBuffer, datasize, 0);
-		if (result == datasize) {
-			vTaskDelay(1);
-			ESP_LOGD(FTP_TAG, "Send OK");
-			break;
-		}
-		else {
-		    vTaskDelay(1);
-			if ((timeout <= 0) || (errno != EAGAIN)) {
-				// error
-				_ftp_reset();
-				ESP_LOGW(FTP_TAG, "Error sending file data.");
-				break;
-			}
-		}
-		timeout -= portTICK_PERIOD_MS;
+    if (!ftp_send_all(s->c_sd, (uint8_t *)s->cmd, size, FTP_REPLY_TIMEOUT_MS)) {
+        ESP_LOGW(FTP_TAG, "Error sending command reply.");
+        ftp_close_session(s);
+        return;
+    }
+    if (status == 221) {
+        ftp_close_session(s);
+    }
+    else if (status == 426 || status == 451 || status == 550) {
+        ftp_close_data(s);
     }
 }
 
@@ -637,9 +657,9 @@ static ftp_result_t ftp_recv_non_blocking (int32_t sd, void *buff, int32_t Maxle
 
 	*rxLen = recv(sd, buff, Maxlen, 0);
     if (*rxLen > 0) return E_FTP_RESULT_OK;
-    else if (errno != EAGAIN) return E_FTP_RESULT_FAILED;
+    else if ((*rxLen < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) return E_FTP_RESULT_CONTINUE;
 
-    return E_FTP_RESULT_CONTINUE;
+    return E_FTP_RESULT_FAILED;
 }
 
 // ==== Directory functions =======================
@@ -647,7 +667,7 @@ static ftp_result_t ftp_recv_non_blocking (int32_t sd, void *buff, int32_t Maxle
 //-----------------------------------
 static void ftp_fix_path(char *pwd) {
     char ph_path[128];
-	uint len = strlen(pwd);
+	uint32_t len = strlen(pwd);
 
 	if (len == 0) {
         strcpy (pwd, "/");
@@ -656,12 +676,12 @@ static void ftp_fix_path(char *pwd) {
 
     // Convert to physical path
 	if (strstr(pwd, VFS_NATIVE_INTERNAL_MP) == pwd) {
-		sprintf(ph_path, "%s%s", VFS_NATIVE_MOUNT_POINT, pwd+strlen(VFS_NATIVE_INTERNAL_MP));
+		snprintf(ph_path, sizeof(ph_path), "%s%s", VFS_NATIVE_MOUNT_POINT, pwd+strlen(VFS_NATIVE_INTERNAL_MP));
 		if (strcmp(ph_path, VFS_NATIVE_MOUNT_POINT) == 0) strcat(ph_path, "/");
 		strcpy(pwd, ph_path);
 	}
 	else if (strstr(pwd, VFS_NATIVE_EXTERNAL_MP) == pwd) {
-		sprintf(ph_path, "%s%s", VFS_NATIVE_SDCARD_MOUNT_POINT, pwd+strlen(VFS_NATIVE_EXTERNAL_MP));
+		snprintf(ph_path, sizeof(ph_path), "%s%s", VFS_NATIVE_SDCARD_MOUNT_POINT, pwd+strlen(VFS_NATIVE_EXTERNAL_MP));
 		if (strcmp(ph_path, VFS_NATIVE_SDCARD_MOUNT_POINT) == 0) strcat(ph_path, "/");
 		strcpy(pwd, ph_path);
 	}
@@ -688,7 +708,7 @@ static void ftp_open_child (char *pwd, char *dir) {
 			// add trailing '/' if needed
 			if ((strlen(pwd) > 1) && (pwd[strlen(pwd)-1] != '/') && (dir[0] != '/')) strcat(pwd, "/");
 			// append directory/file name
-			strcat(pwd, dir);
+			strncat(pwd, dir, FTP_MAX_PARAM_SIZE - strlen(pwd) - 1);
 		}
 	    ftp_fix_path(pwd);
     }
@@ -699,7 +719,7 @@ static void ftp_open_child (char *pwd, char *dir) {
 //---------------------------------------
 static void ftp_close_child (char *pwd) {
     ESP_LOGD(FTP_TAG, "close_child: %s", pwd);
-	uint len = strlen(pwd);
+	uint32_t len = strlen(pwd);
 	if (pwd[len-1] == '/') {
 		pwd[len-1] = '\0';
 		len--;
@@ -747,6 +767,7 @@ static void remove_fname_from_path (char *pwd, char *fname) {
 static void ftp_pop_param(char **str, char *param, bool stop_on_space, bool stop_on_newline)
 {
 	char lastc = '\0';
+	char *end = param + FTP_MAX_PARAM_SIZE - 1;
     while (**str != '\0') {
         if (stop_on_space && (**str == ' ')) break;
         if ((**str == '\r') || (**str == '\n')) {
@@ -761,7 +782,7 @@ static void ftp_pop_param(char **str, char *param, bool stop_on_space, bool stop
             continue;
         }
         lastc = **str;
-        *param++ = **str;
+        if (param < end) *param++ = **str;
         (*str)++;
     }
     *param = '\0';
@@ -769,49 +790,76 @@ static void ftp_pop_param(char **str, char *param, bool stop_on_space, bool stop
 
 //--------------------------------------------------
 static ftp_cmd_index_t ftp_pop_command(char **str) {
-    char _cmd[FTP_CMD_SIZE_MAX];
+    char _cmd[FTP_MAX_PARAM_SIZE];
     ftp_pop_param (str, _cmd, true, true);
     stoupper (_cmd);
     for (ftp_cmd_index_t i = 0; i < E_FTP_NUM_FTP_CMDS; i++) {
         if (!strcmp (_cmd, ftp_cmd_table[i].cmd)) {
             // move one step further to skip the space
-            (*str)++;
+            if (**str != '\0') (*str)++;
             return i;
         }
     }
     return E_FTP_CMD_NOT_SUPPORTED;
 }
 
-// Get file name from parameter and append to ftp_path
-//-------------------------------------------------------
-static void ftp_get_param_and_open_child(char **bufptr) {
-    ftp_pop_param(bufptr, ftp_scratch_buffer, false, false);
-    ftp_open_child(ftp_path, ftp_scratch_buffer);
-    ftp_data.closechild = true;
+// Get file name from parameter and append to session path
+//---------------------------------------------------------------------------
+static void ftp_get_param_and_open_child(ftp_session_t *s, char **bufptr) {
+    ftp_pop_param(bufptr, s->scratch, false, false);
+    ftp_open_child(s->path, s->scratch);
+    s->closechild = true;
+}
+
+// Start the data transfer if the client has requested the passive mode
+//---------------------------------------------------------------------------
+static void ftp_start_transfer(ftp_session_t *s, uint8_t state) {
+	ftp_reset_data(s);
+	s->total = 0;
+	s->time = 0;
+	s->dtimeout = 0;
+	s->state = state;
+	ftp_send_reply(s, 150, NULL);
+}
+
+// Open the file for the data transfer
+//------------------------------------------------------------------------------------------------
+static void ftp_open_transfer_file(ftp_session_t *s, char **bufptr, const char *mode, uint8_t state) {
+    ftp_get_param_and_open_child(s, bufptr);
+    if (s->substate == E_FTP_STE_SUB_DISCONNECTED) {
+        ftp_send_reply(s, 425, "Use PASV first");
+    }
+    else if ((strlen(s->path) > 0) && (s->path[strlen(s->path)-1] != '/') && (ftp_open_file(s, s->path, mode))) {
+        ftp_start_transfer(s, state);
+    }
+    else {
+        ftp_send_reply(s, 550, NULL);
+    }
 }
 
 // ==== Ftp command processing =====
 
-//----------------------------------
-static void ftp_process_cmd (void) {
+//-----------------------------------------------
+static void ftp_process_cmd (ftp_session_t *s) {
     int32_t len;
-    char *bufptr = (char *)ftp_cmd_buffer;
+    char *bufptr = s->cmd;
     ftp_result_t result;
 	struct stat buf;
 	int res;
 
-	memset(bufptr, 0, FTP_MAX_PARAM_SIZE + FTP_CMD_SIZE_MAX);
-    ftp_data.closechild = false;
+	memset(bufptr, 0, FTP_CMD_BUFFER_SIZE + 1);
+    s->closechild = false;
 
     // use the reply buffer to receive new commands
-    result = ftp_recv_non_blocking(ftp_data.c_sd, ftp_cmd_buffer, FTP_MAX_PARAM_SIZE + FTP_CMD_SIZE_MAX, &len);
+    result = ftp_recv_non_blocking(s->c_sd, s->cmd, FTP_CMD_BUFFER_SIZE, &len);
     if (result == E_FTP_RESULT_OK) {
-    	ftp_cmd_buffer[len] = '\0';
+    	s->cmd[len] = '\0';
+    	s->ctimeout = 0;
         // bufptr is moved as commands are being popped
         ftp_cmd_index_t cmd = ftp_pop_command(&bufptr);
-        if (!ftp_data.loggin.passvalid &&
+        if (!s->loggin.passvalid &&
         		((cmd != E_FTP_CMD_USER) && (cmd != E_FTP_CMD_PASS) && (cmd != E_FTP_CMD_QUIT) && (cmd != E_FTP_CMD_FEAT) && (cmd != E_FTP_CMD_AUTH))) {
-            ftp_send_reply(332, NULL);
+            ftp_send_reply(s, 332, NULL);
             return;
         }
         if ((cmd >= 0) && (cmd < E_FTP_NUM_FTP_CMDS)) {
@@ -822,49 +870,46 @@ static void ftp_process_cmd (void) {
         }
         switch (cmd) {
         case E_FTP_CMD_FEAT:
-            ftp_send_reply(502, "no-features");
+            ftp_send_reply(s, 502, "no-features");
             break;
         case E_FTP_CMD_AUTH:
-            ftp_send_reply(504, "not-supported");
+            ftp_send_reply(s, 504, "not-supported");
             break;
         case E_FTP_CMD_SYST:
-            ftp_send_reply(215, "UNIX Type: L8");
+            ftp_send_reply(s, 215, "UNIX Type: L8");
             break;
         case E_FTP_CMD_CDUP:
-            ftp_close_child(ftp_path);
-            ftp_send_reply(250, NULL);
+            ftp_close_child(s->path);
+            ftp_send_reply(s, 250, NULL);
             break;
         case E_FTP_CMD_CWD:
-			ftp_pop_param (&bufptr, ftp_scratch_buffer, false, false);
+			ftp_pop_param (&bufptr, s->scratch, false, false);
 
-			if (strlen(ftp_scratch_buffer) > 0) {
-				if ((ftp_scratch_buffer[0] == '.') && (ftp_scratch_buffer[1] == '\0')) {
-					ftp_data.dp = NULL;
-					ftp_send_reply(250, NULL);
+			if (strlen(s->scratch) > 0) {
+				if ((s->scratch[0] == '.') && (s->scratch[1] == '\0')) {
+					ftp_send_reply(s, 250, NULL);
 					break;
 				}
-				if ((ftp_scratch_buffer[0] == '.') && (ftp_scratch_buffer[1] == '.') && (ftp_scratch_buffer[2] == '\0')) {
-					ftp_close_child (ftp_path);
-		            ftp_send_reply(250, NULL);
+				if ((s->scratch[0] == '.') && (s->scratch[1] == '.') && (s->scratch[2] == '\0')) {
+					ftp_close_child (s->path);
+		            ftp_send_reply(s, 250, NULL);
 		            break;
 				}
-				else ftp_open_child (ftp_path, ftp_scratch_buffer);
+				else ftp_open_child (s->path, s->scratch);
 			}
 
-			if ((ftp_path[0] == '/') && (ftp_path[1] == '\0')) {
-				ftp_data.dp = NULL;
-				ftp_send_reply(250, NULL);
+			if ((s->path[0] == '/') && (s->path[1] == '\0')) {
+				ftp_send_reply(s, 250, NULL);
 			}
 			else {
-				ftp_data.dp = opendir(ftp_path);
-				if (ftp_data.dp != NULL) {
-					closedir(ftp_data.dp);
-					ftp_data.dp = NULL;
-					ftp_send_reply(250, NULL);
+				DIR *dp = opendir(s->path);
+				if (dp != NULL) {
+					closedir(dp);
+					ftp_send_reply(s, 250, NULL);
 				}
 				else {
-					ftp_close_child (ftp_path);
-					ftp_send_reply(550, NULL);
+					ftp_close_child (s->path);
+					ftp_send_reply(s, 550, NULL);
 				}
 			}
             break;
@@ -872,239 +917,475 @@ static void ftp_process_cmd (void) {
         case E_FTP_CMD_XPWD:
         	{
         		char lpath[128];
-        		if (strstr(ftp_path, VFS_NATIVE_MOUNT_POINT) == ftp_path) {
-        			sprintf(lpath, "%s%s", VFS_NATIVE_INTERNAL_MP, ftp_path+strlen(VFS_NATIVE_MOUNT_POINT));
+        		if (strstr(s->path, VFS_NATIVE_MOUNT_POINT) == s->path) {
+        			snprintf(lpath, sizeof(lpath), "%s%s", VFS_NATIVE_INTERNAL_MP, s->path+strlen(VFS_NATIVE_MOUNT_POINT));
         		}
-        		else if (strstr(ftp_path, VFS_NATIVE_SDCARD_MOUNT_POINT) == ftp_path) {
-        			sprintf(lpath, "%s%s", VFS_NATIVE_EXTERNAL_MP, ftp_path+strlen(VFS_NATIVE_SDCARD_MOUNT_POINT));
+        		else if (strstr(s->path, VFS_NATIVE_SDCARD_MOUNT_POINT) == s->path) {
+        			snprintf(lpath, sizeof(lpath), "%s%s", VFS_NATIVE_EXTERNAL_MP, s->path+strlen(VFS_NATIVE_SDCARD_MOUNT_POINT));
         		}
-        		else strcpy(lpath,ftp_path);
+        		else strcpy(lpath, s->path);
 
-        		ftp_send_reply(257, lpath);
+        		ftp_send_reply(s, 257, lpath);
         	}
             break;
         case E_FTP_CMD_SIZE:
-            {
-                ftp_get_param_and_open_child (&bufptr);
-            	int res = stat(ftp_path, &buf);
-            	if (res == 0) {
-                    // send the file size
-                    snprintf((char *)ftp_data.dBuffer, ftp_buff_size, "%u", (uint32_t)buf.st_size);
-                    ftp_send_reply(213, (char *)ftp_data.dBuffer);
-                } else {
-                    ftp_send_reply(550, NULL);
-                }
+            ftp_get_param_and_open_child (s, &bufptr);
+        	res = stat(s->path, &buf);
+        	if (res == 0) {
+                // send the file size
+                snprintf((char *)s->dbuf[0], s->buff_size, "%u", (uint32_t)buf.st_size);
+                ftp_send_reply(s, 213, (char *)s->dbuf[0]);
+            } else {
+                ftp_send_reply(s, 550, NULL);
             }
             break;
         case E_FTP_CMD_MDTM:
-            ftp_get_param_and_open_child (&bufptr);
-        	res = stat(ftp_path, &buf);
-        	if (res < 0) {
+            ftp_get_param_and_open_child (s, &bufptr);
+        	res = stat(s->path, &buf);
+        	if (res == 0) {
                 // send the file modification time
-                snprintf((char *)ftp_data.dBuffer, ftp_buff_size, "%u", (uint32_t)buf.st_mtime);
-                ftp_send_reply(213, (char *)ftp_data.dBuffer);
+                snprintf((char *)s->dbuf[0], s->buff_size, "%u", (uint32_t)buf.st_mtime);
+                ftp_send_reply(s, 213, (char *)s->dbuf[0]);
             } else {
-                ftp_send_reply(550, NULL);
+                ftp_send_reply(s, 550, NULL);
             }
             break;
         case E_FTP_CMD_TYPE:
-            ftp_send_reply(200, NULL);
+            ftp_send_reply(s, 200, NULL);
             break;
         case E_FTP_CMD_USER:
-            ftp_pop_param (&bufptr, ftp_scratch_buffer, true, true);
-            if (!memcmp(ftp_scratch_buffer, ftp_user, MAX(strlen(ftp_scratch_buffer), strlen(ftp_user)))) {
-                ftp_data.loggin.uservalid = true && (strlen(ftp_user) == strlen(ftp_scratch_buffer));
+            ftp_pop_param (&bufptr, s->scratch, true, true);
+            if (!memcmp(s->scratch, ftp_user, MAX(strlen(s->scratch), strlen(ftp_user)))) {
+                s->loggin.uservalid = true && (strlen(ftp_user) == strlen(s->scratch));
             }
-            ftp_send_reply(331, NULL);
+            ftp_send_reply(s, 331, NULL);
             break;
         case E_FTP_CMD_PASS:
-            ftp_pop_param (&bufptr, ftp_scratch_buffer, true, true);
-            if (!memcmp(ftp_scratch_buffer, ftp_pass, MAX(strlen(ftp_scratch_buffer), strlen(ftp_pass))) &&
-                    ftp_data.loggin.uservalid) {
-                ftp_data.loggin.passvalid = true && (strlen(ftp_pass) == strlen(ftp_scratch_buffer));
-                if (ftp_data.loggin.passvalid) {
-                    ftp_send_reply(230, NULL);
+            ftp_pop_param (&bufptr, s->scratch, true, true);
+            if (!memcmp(s->scratch, ftp_pass, MAX(strlen(s->scratch), strlen(ftp_pass))) &&
+                    s->loggin.uservalid) {
+                s->loggin.passvalid = true && (strlen(ftp_pass) == strlen(s->scratch));
+                if (s->loggin.passvalid) {
+                    ftp_send_reply(s, 230, NULL);
                     break;
                 }
             }
-            ftp_send_reply(530, NULL);
+            ftp_send_reply(s, 530, NULL);
             break;
         case E_FTP_CMD_PASV:
             {
                 // some servers (e.g. google chrome) send PASV several times very quickly
-                closesocket(ftp_data.d_sd);
-                ftp_data.d_sd = -1;
-                ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
+            	ftp_close_data(s);
+                s->substate = E_FTP_STE_SUB_DISCONNECTED;
                 bool socketcreated = true;
-                if (ftp_data.ld_sd < 0) {
-                    socketcreated = ftp_create_listening_socket(&ftp_data.ld_sd, FTP_PASIVE_DATA_PORT, FTP_DATA_CLIENTS_MAX - 1);
+                if (s->ld_sd < 0) {
+                    socketcreated = ftp_create_listening_socket(&s->ld_sd, s->data_port, 0);
                 }
                 if (socketcreated) {
-                    uint8_t *pip = (uint8_t *)&ftp_data.ip_addr;
-                    ftp_data.dtimeout = 0;
-                    snprintf((char *)ftp_data.dBuffer, ftp_buff_size, "(%u,%u,%u,%u,%u,%u)",
-                             pip[0], pip[1], pip[2], pip[3], (FTP_PASIVE_DATA_PORT >> 8), (FTP_PASIVE_DATA_PORT & 0xFF));
-                    ftp_data.substate = E_FTP_STE_SUB_LISTEN_FOR_DATA;
+                    uint8_t *pip = (uint8_t *)&s->ip_addr;
+                    s->dtimeout = 0;
+                    snprintf((char *)s->dbuf[0], s->buff_size, "(%u,%u,%u,%u,%u,%u)",
+                             pip[0], pip[1], pip[2], pip[3], (s->data_port >> 8), (s->data_port & 0xFF));
+                    s->substate = E_FTP_STE_SUB_LISTEN_FOR_DATA;
                 	ESP_LOGD(FTP_TAG, "Data socket created");
-                    ftp_send_reply(227, (char *)ftp_data.dBuffer);
+                    ftp_send_reply(s, 227, (char *)s->dbuf[0]);
                 }
                 else {
                 	ESP_LOGW(FTP_TAG, "Error creating data socket");
-                    ftp_send_reply(425, NULL);
+                    ftp_send_reply(s, 425, NULL);
                 }
             }
             break;
         case E_FTP_CMD_LIST:
        	case E_FTP_CMD_NLST:
-            ftp_get_param_and_open_child(&bufptr);
-            if (cmd == E_FTP_CMD_LIST) ftp_nlist = 0;
-        	else ftp_nlist = 1;
-            if (ftp_open_dir_for_listing(ftp_path) == E_FTP_RESULT_CONTINUE) {
-                ftp_data.state = E_FTP_STE_CONTINUE_LISTING;
-                ftp_send_reply(150, NULL);
+            ftp_get_param_and_open_child(s, &bufptr);
+            s->nlist = (cmd == E_FTP_CMD_NLST);
+            if (s->substate == E_FTP_STE_SUB_DISCONNECTED) {
+                ftp_send_reply(s, 425, "Use PASV first");
             }
-            else ftp_send_reply(550, NULL);
+            else if (ftp_open_dir_for_listing(s, s->path) == E_FTP_RESULT_CONTINUE) {
+                ftp_start_transfer(s, E_FTP_STE_CONTINUE_LISTING);
+            }
+            else ftp_send_reply(s, 550, NULL);
             break;
         case E_FTP_CMD_RETR:
-        	ftp_data.total = 0;
-        	ftp_data.time = 0;
-            ftp_get_param_and_open_child(&bufptr);
-            if ((strlen(ftp_path) > 0) && (ftp_path[strlen(ftp_path)-1] != '/')) {
-				if (ftp_open_file(ftp_path, "rb")) {
-					ftp_data.state = E_FTP_STE_CONTINUE_FILE_TX;
-					vTaskDelay(20 / portTICK_PERIOD_MS);
-					ftp_send_reply(150, NULL);
-				}
-				else {
-					ftp_data.state = E_FTP_STE_END_TRANSFER;
-					ftp_send_reply(550, NULL);
-				}
-            }
-            else {
-				ftp_data.state = E_FTP_STE_END_TRANSFER;
-				ftp_send_reply(550, NULL);
-            }
+            ftp_open_transfer_file(s, &bufptr, "rb", E_FTP_STE_CONTINUE_FILE_TX);
             break;
         case E_FTP_CMD_APPE:
-        	ftp_data.total = 0;
-        	ftp_data.time = 0;
-            ftp_get_param_and_open_child(&bufptr);
-            if ((strlen(ftp_path) > 0) && (ftp_path[strlen(ftp_path)-1] != '/')) {
-				if (ftp_open_file(ftp_path, "ab")) {
-					ftp_data.state = E_FTP_STE_CONTINUE_FILE_RX;
-					vTaskDelay(20 / portTICK_PERIOD_MS);
-					ftp_send_reply(150, NULL);
-				}
-				else {
-					ftp_data.state = E_FTP_STE_END_TRANSFER;
-					ftp_send_reply(550, NULL);
-				}
-            }
-            else {
-				ftp_data.state = E_FTP_STE_END_TRANSFER;
-				ftp_send_reply(550, NULL);
-            }
+            ftp_open_transfer_file(s, &bufptr, "ab", E_FTP_STE_CONTINUE_FILE_RX);
             break;
         case E_FTP_CMD_STOR:
-        	ftp_data.total = 0;
-        	ftp_data.time = 0;
-            ftp_get_param_and_open_child(&bufptr);
-            if ((strlen(ftp_path) > 0) && (ftp_path[strlen(ftp_path)-1] != '/')) {
-				if (ftp_open_file(ftp_path, "wb")) {
-					ftp_data.state = E_FTP_STE_CONTINUE_FILE_RX;
-					vTaskDelay(20 / portTICK_PERIOD_MS);
-					ftp_send_reply(150, NULL);
-				}
-				else {
-					ftp_data.state = E_FTP_STE_END_TRANSFER;
-					ftp_send_reply(550, NULL);
-				}
-            }
-            else {
-				ftp_data.state = E_FTP_STE_END_TRANSFER;
-				ftp_send_reply(550, NULL);
-            }
+            ftp_open_transfer_file(s, &bufptr, "wb", E_FTP_STE_CONTINUE_FILE_RX);
             break;
         case E_FTP_CMD_DELE:
-            ftp_get_param_and_open_child(&bufptr);
-            if ((strlen(ftp_path) > 0) && (ftp_path[strlen(ftp_path)-1] != '/')) {
-				if (unlink(ftp_path) == 0) {
-					vTaskDelay(20 / portTICK_PERIOD_MS);
-					ftp_send_reply(250, NULL);
-				}
-				else ftp_send_reply(550, NULL);
+            ftp_get_param_and_open_child(s, &bufptr);
+            if ((strlen(s->path) > 0) && (s->path[strlen(s->path)-1] != '/')) {
+				if (unlink(s->path) == 0) ftp_send_reply(s, 250, NULL);
+				else ftp_send_reply(s, 550, NULL);
             }
-            else ftp_send_reply(250, NULL);
+            else ftp_send_reply(s, 250, NULL);
             break;
         case E_FTP_CMD_RMD:
-            ftp_get_param_and_open_child(&bufptr);
-            if ((strlen(ftp_path) > 0) && (ftp_path[strlen(ftp_path)-1] != '/')) {
-				if (rmdir(ftp_path) == 0) {
-					vTaskDelay(20 / portTICK_PERIOD_MS);
-					ftp_send_reply(250, NULL);
-				}
-				else ftp_send_reply(550, NULL);
+            ftp_get_param_and_open_child(s, &bufptr);
+            if ((strlen(s->path) > 0) && (s->path[strlen(s->path)-1] != '/')) {
+				if (rmdir(s->path) == 0) ftp_send_reply(s, 250, NULL);
+				else ftp_send_reply(s, 550, NULL);
             }
-            else ftp_send_reply(250, NULL);
+            else ftp_send_reply(s, 250, NULL);
             break;
         case E_FTP_CMD_MKD:
-            ftp_get_param_and_open_child(&bufptr);
-            if ((strlen(ftp_path) > 0) && (ftp_path[strlen(ftp_path)-1] != '/')) {
-				if (mkdir(ftp_path, 0755) == 0) {
-					vTaskDelay(20 / portTICK_PERIOD_MS);
-					ftp_send_reply(250, NULL);
-				}
-				else ftp_send_reply(550, NULL);
+            ftp_get_param_and_open_child(s, &bufptr);
+            if ((strlen(s->path) > 0) && (s->path[strlen(s->path)-1] != '/')) {
+				if (mkdir(s->path, 0755) == 0) ftp_send_reply(s, 250, NULL);
+				else ftp_send_reply(s, 550, NULL);
             }
-            else ftp_send_reply(250, NULL);
+            else ftp_send_reply(s, 250, NULL);
             break;
         case E_FTP_CMD_RNFR:
-            ftp_get_param_and_open_child(&bufptr);
-        	res = stat(ftp_path, &buf);
+            ftp_get_param_and_open_child(s, &bufptr);
+        	res = stat(s->path, &buf);
         	if (res == 0) {
-                ftp_send_reply(350, NULL);
+                ftp_send_reply(s, 350, NULL);
                 // save the path of the file to rename
-                strcpy((char *)ftp_data.dBuffer, ftp_path);
+                strcpy((char *)s->dbuf[1], s->path);
             } else {
-                ftp_send_reply(550, NULL);
+                ftp_send_reply(s, 550, NULL);
             }
             break;
         case E_FTP_CMD_RNTO:
-            ftp_get_param_and_open_child(&bufptr);
+            ftp_get_param_and_open_child(s, &bufptr);
             // the path of the file to rename was saved in the data buffer
-            if (rename((char *)ftp_data.dBuffer, ftp_path) == 0) {
-                ftp_send_reply(250, NULL);
+            if (rename((char *)s->dbuf[1], s->path) == 0) {
+                ftp_send_reply(s, 250, NULL);
             } else {
-                ftp_send_reply(550, NULL);
+                ftp_send_reply(s, 550, NULL);
             }
             break;
         case E_FTP_CMD_NOOP:
-            ftp_send_reply(200, NULL);
+            ftp_send_reply(s, 200, NULL);
             break;
         case E_FTP_CMD_QUIT:
-            ftp_send_reply(221, NULL);
+            ftp_send_reply(s, 221, NULL);
             break;
         default:
             // command not implemented
-            ftp_send_reply(502, NULL);
+            ftp_send_reply(s, 502, NULL);
             break;
         }
 
-        if (ftp_data.closechild) {
-            remove_fname_from_path(ftp_path, ftp_scratch_buffer);
+        if ((s->c_sd >= 0) && (s->closechild)) {
+            remove_fname_from_path(s->path, s->scratch);
         }
     }
     else if (result == E_FTP_RESULT_CONTINUE) {
-        if (ftp_data.ctimeout > ftp_timeout) {
-            ftp_send_reply(221, NULL);
+        if (s->ctimeout > ftp_timeout) {
         	ESP_LOGI(FTP_TAG, "Connection timeout");
+            ftp_send_reply(s, 221, NULL);
         }
     }
     else {
-        ftp_close_cmd_data();
+        ftp_close_session(s);
     }
 }
 
+// ==== Data transfer =====
+
+// Read the next block of the file or directory listing into the free buffer(s)
+//------------------------------------------------
+static void ftp_fill_data(ftp_session_t *s) {
+	for (int n=0; n<2; n++) {
+		// fill the buffer being sent first, then the other one
+		uint8_t idx = s->dcur ^ n;
+		if (s->deof) break;
+		if (s->dlen[idx] != 0) continue;
+
+		uint32_t size = 0;
+		if (s->state == E_FTP_STE_CONTINUE_LISTING) {
+			if (ftp_list_dir(s, (char *)s->dbuf[idx], s->buff_size, &size) == E_FTP_RESULT_OK) s->deof = true;
+		}
+		else {
+			size = fread(s->dbuf[idx], 1, s->buff_size, s->fp);
+			if (size < s->buff_size) {
+				s->derror = (ferror(s->fp) != 0);
+				s->deof = true;
+				ftp_close_files_dir(s);
+			}
+		}
+		s->dlen[idx] = size;
+		if (size == 0) break;
+	}
+}
+
+//-------------------------------------------------
+static void ftp_continue_tx(ftp_session_t *s) {
+	int budget = FTP_TX_BUDGET;
+
+	while (budget > 0) {
+		ftp_fill_data(s);
+		uint32_t pending = s->dlen[s->dcur] - s->dpos;
+		if (pending == 0) break;
+
+		int32_t sent = send(s->d_sd, s->dbuf[s->dcur] + s->dpos, pending, FTP_SEND_FLAGS);
+		if (sent > 0) {
+			s->dpos += sent;
+			s->dtimeout = 0;
+			if (s->state == E_FTP_STE_CONTINUE_FILE_TX) {
+				s->total += sent;
+				ftp_data.stats.bytes_tx += sent;
+			}
+			if (s->dpos >= s->dlen[s->dcur]) {
+				// buffer sent, continue with the other one
+				s->dlen[s->dcur] = 0;
+				s->dpos = 0;
+				s->dcur ^= 1;
+				budget--;
+			}
+		}
+		else if ((sent < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+			// socket buffer full, the other buffer is already filled
+			if (s->dtimeout > FTP_DATA_TIMEOUT_MS) {
+				ESP_LOGW(FTP_TAG, "Sending data timeout");
+				ftp_send_reply(s, 426, NULL);
+				s->state = E_FTP_STE_END_TRANSFER;
+			}
+			return;
+		}
+		else {
+			ESP_LOGW(FTP_TAG, "Error sending data.");
+			ftp_send_reply(s, 426, NULL);
+			s->state = E_FTP_STE_END_TRANSFER;
+			return;
+		}
+	}
+
+	if (s->deof && (s->dlen[0] == 0) && (s->dlen[1] == 0)) {
+		if (s->derror) ftp_send_reply(s, 451, NULL);
+		else {
+			ftp_send_reply(s, 226, NULL);
+			if (s->state == E_FTP_STE_CONTINUE_FILE_TX) {
+				ftp_data.stats.files_tx++;
+				ESP_LOGI(FTP_TAG, "File sent (%u bytes in %u msek).", s->total, s->time);
+			}
+		}
+		s->state = E_FTP_STE_END_TRANSFER;
+	}
+}
+
+//-------------------------------------------------
+static void ftp_continue_rx(ftp_session_t *s) {
+	int32_t len;
+
+	for (int budget = FTP_TX_BUDGET; budget > 0; budget--) {
+		ftp_result_t result = ftp_recv_non_blocking(s->d_sd, s->dbuf[0], s->buff_size, &len);
+		if (result == E_FTP_RESULT_OK) {
+			// block of data received
+			s->dtimeout = 0;
+			// save received data to file
+			if (E_FTP_RESULT_OK != ftp_write_file (s, (char *)s->dbuf[0], len)) {
+				ESP_LOGW(FTP_TAG, "Error writing to file");
+				ftp_send_reply(s, 451, NULL);
+				s->state = E_FTP_STE_END_TRANSFER;
+				return;
+			}
+			s->total += len;
+			ftp_data.stats.bytes_rx += len;
+			ESP_LOGD(FTP_TAG, "Received %u, total: %u", len, s->total);
+		}
+		else if (result == E_FTP_RESULT_CONTINUE) {
+			// nothing received
+			if (s->dtimeout > FTP_DATA_TIMEOUT_MS) {
+				ftp_close_files_dir(s);
+				ESP_LOGW(FTP_TAG, "Receiving to file timeout");
+				ftp_send_reply(s, 426, NULL);
+				s->state = E_FTP_STE_END_TRANSFER;
+			}
+			return;
+		}
+		else {
+			// File received, data connection closed by the client
+			ftp_close_files_dir(s);
+			ftp_data.stats.files_rx++;
+			ESP_LOGI(FTP_TAG, "File received (%u bytes in %u msek).", s->total, s->time);
+			ftp_send_reply(s, 226, NULL);
+			s->state = E_FTP_STE_END_TRANSFER;
+			return;
+		}
+	}
+}
+
+// Run one step of the session state machine
+//-----------------------------------------------
+static void ftp_session_run(ftp_session_t *s) {
+    switch (s->state) {
+        case E_FTP_STE_READY:
+			if (s->substate != E_FTP_STE_SUB_LISTEN_FOR_DATA) ftp_process_cmd(s);
+            break;
+        case E_FTP_STE_END_TRANSFER:
+        	ftp_close_data(s);
+        	s->substate = E_FTP_STE_SUB_DISCONNECTED;
+            break;
+        case E_FTP_STE_CONTINUE_LISTING:
+        case E_FTP_STE_CONTINUE_FILE_TX:
+            // read and send the next blocks from the file or directory
+            s->ctimeout = 0;
+        	if (s->substate == E_FTP_STE_SUB_DATA_CONNECTED) ftp_continue_tx(s);
+            break;
+        case E_FTP_STE_CONTINUE_FILE_RX:
+            s->ctimeout = 0;
+        	if (s->substate == E_FTP_STE_SUB_DATA_CONNECTED) ftp_continue_rx(s);
+            break;
+        default:
+            break;
+    }
+    if (s->c_sd < 0) return;
+
+    switch (s->substate) {
+    case E_FTP_STE_SUB_DISCONNECTED:
+        break;
+    case E_FTP_STE_SUB_LISTEN_FOR_DATA:
+        {
+            ftp_result_t res = ftp_wait_for_connection(s->ld_sd, &s->d_sd, NULL);
+            if (res == E_FTP_RESULT_OK) {
+                s->dtimeout = 0;
+                s->substate = E_FTP_STE_SUB_DATA_CONNECTED;
+                ESP_LOGD(FTP_TAG, "Data socket connected");
+            }
+            else if ((res == E_FTP_RESULT_FAILED) || (s->dtimeout > FTP_DATA_TIMEOUT_MS)) {
+                ESP_LOGW(FTP_TAG, "Waiting for data connection failed (%d)", s->dtimeout);
+                s->dtimeout = 0;
+                // close the listening socket
+                closesocket(s->ld_sd);
+                s->ld_sd = -1;
+                s->substate = E_FTP_STE_SUB_DISCONNECTED;
+                if (s->state > E_FTP_STE_READY) ftp_send_reply(s, 425, NULL);
+            }
+        }
+        break;
+    case E_FTP_STE_SUB_DATA_CONNECTED:
+        if (s->state == E_FTP_STE_READY && (s->dtimeout > FTP_DATA_TIMEOUT_MS)) {
+            // close the listening and the data socket
+            closesocket(s->ld_sd);
+            s->ld_sd = -1;
+            ftp_close_data(s);
+            s->substate = E_FTP_STE_SUB_DISCONNECTED;
+            ESP_LOGW(FTP_TAG, "Data connection timeout");
+        }
+        break;
+    default:
+        break;
+    }
+
+    // check the state of the data connection
+    if ((s->c_sd >= 0) && (s->substate == E_FTP_STE_SUB_DISCONNECTED) && (s->state > E_FTP_STE_READY)) {
+        ftp_close_data(s);
+        s->state = E_FTP_STE_READY;
+		ESP_LOGD(FTP_TAG, "Data socket disconnected");
+    }
+}
+
+// Accept new clients into the free sessions
+//---------------------------------------
+static void ftp_accept_sessions (void) {
+	int32_t sd;
+	uint32_t ip_addr;
+
+	while (1) {
+		ftp_result_t res = ftp_wait_for_connection(ftp_data.lc_sd, &sd, &ip_addr);
+		if (res == E_FTP_RESULT_CONTINUE) return;
+		if (res == E_FTP_RESULT_FAILED) {
+			// error on the listening socket, recreate it
+			closesocket(ftp_data.lc_sd);
+			ftp_data.lc_sd = -1;
+			ftp_data.state = E_FTP_STE_START;
+			return;
+		}
+
+		ftp_session_t *s = NULL;
+		for (int i=0; i<FTP_MAX_SESSIONS; i++) {
+			if (ftp_data.session[i].c_sd < 0) {
+				s = &ftp_data.session[i];
+				break;
+			}
+		}
+		if ((s == NULL) || (!ftp_session_alloc(s))) {
+			const char *reply = "421 Too many connections\r\n";
+			ftp_send_all(sd, (const uint8_t *)reply, strlen(reply), 0);
+			closesocket(sd);
+			ESP_LOGW(FTP_TAG, "Connection refused, no free session");
+			continue;
+		}
+
+		s->c_sd = sd;
+		s->ip_addr = ip_addr;
+		s->data_port = FTP_PASIVE_DATA_PORT + (s - ftp_data.session);
+		s->state = E_FTP_STE_READY;
+		s->substate = E_FTP_STE_SUB_DISCONNECTED;
+		s->e_open = E_FTP_NOTHING_OPEN;
+		s->ctimeout = 0;
+		s->loggin.uservalid = false;
+		s->loggin.passvalid = false;
+		ftp_reset_data(s);
+		strcpy (s->path, "/");
+		ESP_LOGI(FTP_TAG, "Connected, session %d.", (int)(s - ftp_data.session));
+		ftp_send_reply (s, 220, "Micropython FTP Server");
+	}
+}
+
+//--------------------------------------
+static void ftp_add_fd(int32_t sd, fd_set *set, int32_t *maxfd) {
+	if (sd < 0) return;
+	FD_SET(sd, set);
+	if (sd > *maxfd) *maxfd = sd;
+}
+
+/*
+ * Wait (max FTP_SELECT_TIMEOUT_MS) until some session can make progress
+ * Returns 1 if there was work to do without waiting
+ */
+//----------------------------
+static int ftp_wait_io (void) {
+	fd_set rfds, wfds;
+	int32_t maxfd = -1;
+	FD_ZERO(&rfds);
+	FD_ZERO(&wfds);
+
+	if (ftp_data.state == E_FTP_STE_READY) ftp_add_fd(ftp_data.lc_sd, &rfds, &maxfd);
+
+	for (int i=0; i<FTP_MAX_SESSIONS; i++) {
+		ftp_session_t *s = &ftp_data.session[i];
+		if (s->c_sd < 0) continue;
+		if (s->substate == E_FTP_STE_SUB_LISTEN_FOR_DATA) ftp_add_fd(s->ld_sd, &rfds, &maxfd);
+		switch (s->state) {
+			case E_FTP_STE_READY:
+				// commands are not processed while waiting for the data connection
+				if (s->substate != E_FTP_STE_SUB_LISTEN_FOR_DATA) ftp_add_fd(s->c_sd, &rfds, &maxfd);
+				break;
+			case E_FTP_STE_CONTINUE_LISTING:
+			case E_FTP_STE_CONTINUE_FILE_TX:
+				if (s->substate == E_FTP_STE_SUB_DATA_CONNECTED) {
+					// more data can be read, or the transfer is finished
+					if ((!s->deof && ((s->dlen[0] == 0) || (s->dlen[1] == 0))) || (s->dlen[s->dcur] == 0)) return 1;
+					ftp_add_fd(s->d_sd, &wfds, &maxfd);
+				}
+				break;
+			case E_FTP_STE_CONTINUE_FILE_RX:
+				if (s->substate == E_FTP_STE_SUB_DATA_CONNECTED) ftp_add_fd(s->d_sd, &rfds, &maxfd);
+				break;
+			default:
+				return 1;
+		}
+	}
+
+	if (maxfd < 0) {
+		ftp_sleep_ms(FTP_SELECT_TIMEOUT_MS);
+		return 0;
+	}
+	struct timeval tv;
+	tv.tv_sec = 0;
+	tv.tv_usec = FTP_SELECT_TIMEOUT_MS * 1000;
+	return (select(maxfd + 1, &rfds, &wfds, NULL, &tv) > 0) ? 1 : 0;
+}
+
 //---------------------------------------
 static void ftp_wait_for_enabled (void) {
     // Check if the telnet service has been enabled
@@ -1117,229 +1398,83 @@ static void ftp_wait_for_enabled (void) {
 
 //---------------------
 void ftp_deinit(void) {
-	if (ftp_path) free(ftp_path);
-	if (ftp_cmd_buffer) free(ftp_cmd_buffer);
-	if (ftp_data.dBuffer) free(ftp_data.dBuffer);
-	if (ftp_scratch_buffer) free(ftp_scratch_buffer);
-	ftp_path = NULL;
-	ftp_cmd_buffer = NULL;
-	ftp_data.dBuffer = NULL;
-	ftp_scratch_buffer = NULL;
+	for (int i=0; i<FTP_MAX_SESSIONS; i++) {
+		ftp_session_free(&ftp_data.session[i]);
+	}
 }
 
 //-------------------
 bool ftp_init(void) {
 	ftp_stop = 0;
-    // Allocate memory for the data buffer, and the file system structures (from the RTOS heap)
 	ftp_deinit();
 
 	memset(&ftp_data, 0, sizeof(ftp_data_t));
-	ftp_data.dBuffer = malloc(ftp_buff_size+1);
-	if (ftp_data.dBuffer == NULL) return false;
-	ftp_path = malloc(FTP_MAX_PARAM_SIZE);
-	if (ftp_path == NULL) {
-	    free(ftp_data.dBuffer);
-	    return false;
+	for (int i=0; i<FTP_MAX_SESSIONS; i++) {
+		ftp_session_t *s = &ftp_data.session[i];
+		s->c_sd  = -1;
+		s->d_sd  = -1;
+		s->ld_sd = -1;
+		s->e_open = E_FTP_NOTHING_OPEN;
+		s->state = E_FTP_STE_READY;
+		s->substate = E_FTP_STE_SUB_DISCONNECTED;
 	}
-	ftp_scratch_buffer = malloc(FTP_MAX_PARAM_SIZE);
-    if (ftp_scratch_buffer == NULL) {
-        free(ftp_path);
-        free(ftp_data.dBuffer);
-        return false;
-    }
-	ftp_cmd_buffer = malloc(FTP_MAX_PARAM_SIZE + FTP_CMD_SIZE_MAX);
-    if (ftp_cmd_buffer == NULL) {
-        free(ftp_scratch_buffer);
-        free(ftp_path);
-        free(ftp_data.dBuffer);
-        return false;
-    }
-
-    //SOCKETFIFO_Init((void *)ftp_fifoelements, FTP_SOCKETFIFO_ELEMENTS_MAX);
-
-    ftp_data.c_sd  = -1;
-    ftp_data.d_sd  = -1;
     ftp_data.lc_sd = -1;
-    ftp_data.ld_sd = -1;
-    ftp_data.e_open = E_FTP_NOTHING_OPEN;
     ftp_data.state = E_FTP_STE_DISABLED;
-    ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
+    ftp_data.stats.max_sessions = FTP_MAX_SESSIONS;
 
     if (ftp_mutex == NULL) ftp_mutex = xSemaphoreCreateMutex();
-    return true;
+    return (ftp_mutex != NULL);
 }
 
+/*
+ * Run all sessions, then wait for socket activity
+ * Returns 1 if there is more work to do, 0 if it waited for activity, <0 on error
+ */
 //============================
 int ftp_run (uint32_t elapsed)
 {
     if (xSemaphoreTake(ftp_mutex, FTP_MUTEX_TIMEOUT_MS / portTICK_PERIOD_MS) !=pdTRUE) return -1;
-    if (ftp_stop) return -2;
+    if (ftp_stop) {
+    	xSemaphoreGive(ftp_mutex);
+    	return -2;
+    }
 
-    ftp_data.dtimeout += elapsed;
-	ftp_data.ctimeout += elapsed;
-	ftp_data.time += elapsed;
+    bool transfer = false;
+    ftp_data.stats.sessions = 0;
+	for (int i=0; i<FTP_MAX_SESSIONS; i++) {
+		ftp_session_t *s = &ftp_data.session[i];
+		if (s->c_sd < 0) continue;
+		ftp_data.stats.sessions++;
+		s->dtimeout += elapsed;
+		s->ctimeout += elapsed;
+		s->time += elapsed;
+		if (ftp_is_transfer(s) && (s->substate == E_FTP_STE_SUB_DATA_CONNECTED)) transfer = true;
+	}
+	if (transfer) ftp_data.stats.busy_ms += elapsed;
 
     switch (ftp_data.state) {
         case E_FTP_STE_DISABLED:
             ftp_wait_for_enabled();
             break;
         case E_FTP_STE_START:
-            if (ftp_create_listening_socket(&ftp_data.lc_sd, FTP_CMD_PORT, FTP_CMD_CLIENTS_MAX - 1)) {
+            if (ftp_create_listening_socket(&ftp_data.lc_sd, FTP_CMD_PORT, FTP_MAX_SESSIONS)) {
                 ftp_data.state = E_FTP_STE_READY;
             }
             break;
         case E_FTP_STE_READY:
-            if (ftp_data.c_sd < 0 && ftp_data.substate == E_FTP_STE_SUB_DISCONNECTED) {
-                if (E_FTP_RESULT_OK == ftp_wait_for_connection(ftp_data.lc_sd, &ftp_data.c_sd, &ftp_data.ip_addr)) {
-                    ftp_data.txRetries = 0;
-                    ftp_data.logginRetries = 0;
-                    ftp_data.ctimeout = 0;
-                    ftp_data.loggin.uservalid = false;
-                    ftp_data.loggin.passvalid = false;
-                    strcpy (ftp_path, "/");
-                    ESP_LOGI(FTP_TAG, "Connected.");
-                    ftp_send_reply (220, "Micropython FTP Server");
-                    break;
-                }
-            }
-			if (ftp_data.c_sd > 0 && ftp_data.substate != E_FTP_STE_SUB_LISTEN_FOR_DATA) {
-				ftp_process_cmd();
-				if (ftp_data.state != E_FTP_STE_READY) {
-					break;
-				}
+        	ftp_accept_sessions();
+			for (int i=0; i<FTP_MAX_SESSIONS; i++) {
+				if (ftp_data.session[i].c_sd >= 0) ftp_session_run(&ftp_data.session[i]);
 			}
             break;
-        case E_FTP_STE_END_TRANSFER:
-        	if (ftp_data.d_sd >= 0) {
-				closesocket(ftp_data.d_sd);
-				ftp_data.d_sd = -1;
-        	}
-            break;
-        case E_FTP_STE_CONTINUE_LISTING:
-            // go on with listing
-        	{
-                uint32_t listsize = 0;
-                ftp_result_t list_res = ftp_list_dir((char *)ftp_data.dBuffer, ftp_buff_size, &listsize);
-            	if (listsize > 0) ftp_send_list(listsize);
-                if (list_res == E_FTP_RESULT_OK) {
-                    ftp_send_reply(226, NULL);
-                    ftp_data.state = E_FTP_STE_END_TRANSFER;
-                }
-                ftp_data.ctimeout = 0;
-            }
-            break;
-        case E_FTP_STE_CONTINUE_FILE_TX:
-            // read and send the next block from the file
-        	{
-                uint32_t readsize;
-                ftp_result_t result;
-                ftp_data.ctimeout = 0;
-                result = ftp_read_file ((char *)ftp_data.dBuffer, ftp_buff_size, &readsize);
-                if (result == E_FTP_RESULT_FAILED) {
-                    ftp_send_reply(451, NULL);
-                    ftp_data.state = E_FTP_STE_END_TRANSFER;
-                }
-                else {
-                    if (readsize > 0) {
-                        ftp_send_file_data(readsize);
-                        ftp_data.total += readsize;
-						ESP_LOGD(FTP_TAG, "Sent %u, total: %u", readsize, ftp_data.total);
-                    }
-                    if (result == E_FTP_RESULT_OK) {
-                        ftp_send_reply(226, NULL);
-                        ftp_data.state = E_FTP_STE_END_TRANSFER;
-    					ESP_LOGI(FTP_TAG, "File sent (%u bytes in %u msek).", ftp_data.total, ftp_data.time);
-                    }
-                }
-            }
-            break;
-        case E_FTP_STE_CONTINUE_FILE_RX:
-        	{
-                int32_t len;
-                ftp_result_t result = E_FTP_RESULT_OK;
-
-                result = ftp_recv_non_blocking(ftp_data.d_sd, ftp_data.dBuffer, ftp_buff_size, &len);
-				if (result == E_FTP_RESULT_OK) {
-					// block of data received
-					ftp_data.dtimeout = 0;
-					ftp_data.ctimeout = 0;
-					// save received data to file
-					if (E_FTP_RESULT_OK != ftp_write_file ((char *)ftp_data.dBuffer, len)) {
-						ftp_send_reply(451, NULL);
-						ftp_data.state = E_FTP_STE_END_TRANSFER;
-						ESP_LOGW(FTP_TAG, "Error writing to file");
-					}
-					else {
-						ftp_data.total += len;
-						ESP_LOGD(FTP_TAG, "Received %u, total: %u", len, ftp_data.total);
-					}
-				}
-				else if (result == E_FTP_RESULT_CONTINUE) {
-					// nothing received
-					if (ftp_data.dtimeout > FTP_DATA_TIMEOUT_MS) {
-						ftp_close_files_dir();
-						ftp_send_reply(426, NULL);
-						ftp_data.state = E_FTP_STE_END_TRANSFER;
-						ESP_LOGW(FTP_TAG, "Receiving to file timeout");
-					}
-				}
-				else {
-					// File received (E_FTP_RESULT_FAILED)
-					ftp_close_files_dir();
-					ftp_send_reply(226, NULL);
-					ftp_data.state = E_FTP_STE_END_TRANSFER;
-					ESP_LOGI(FTP_TAG, "File received (%u bytes in %u msek).", ftp_data.total, ftp_data.time);
-					break;
-				}
-        	}
-            break;
         default:
             break;
     }
 
-    switch (ftp_data.substate) {
-    case E_FTP_STE_SUB_DISCONNECTED:
-        break;
-    case E_FTP_STE_SUB_LISTEN_FOR_DATA:
-        if (E_FTP_RESULT_OK == ftp_wait_for_connection(ftp_data.ld_sd, &ftp_data.d_sd, NULL)) {
-            ftp_data.dtimeout = 0;
-            ftp_data.substate = E_FTP_STE_SUB_DATA_CONNECTED;
-			ESP_LOGD(FTP_TAG, "Data socket connected");
-        }
-        else if (ftp_data.dtimeout > FTP_DATA_TIMEOUT_MS) {
-            ESP_LOGW(FTP_TAG, "Waiting for data connection timeout (%d)", ftp_data.dtimeout);
-            ftp_data.dtimeout = 0;
-            // close the listening socket
-            closesocket(ftp_data.ld_sd);
-            ftp_data.ld_sd = -1;
-            ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
-        }
-        break;
-    case E_FTP_STE_SUB_DATA_CONNECTED:
-        if (ftp_data.state == E_FTP_STE_READY && (ftp_data.dtimeout > FTP_DATA_TIMEOUT_MS)) {
-            // close the listening and the data socket
-            closesocket(ftp_data.ld_sd);
-            closesocket(ftp_data.d_sd);
-            ftp_data.ld_sd = -1;
-            ftp_data.d_sd = -1;
-            ftp_close_filesystem_on_error ();
-            ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
-            ESP_LOGW(FTP_TAG, "Data connection timeout");
-        }
-        break;
-    default:
-        break;
-    }
-
-    // check the state of the data sockets
-    if (ftp_data.d_sd < 0 && (ftp_data.state > E_FTP_STE_READY)) {
-        ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
-        ftp_data.state = E_FTP_STE_READY;
-		ESP_LOGD(FTP_TAG, "Data socket disconnected");
-    }
+    int res = ftp_wait_io();
 
     xSemaphoreGive(ftp_mutex);
-    return 0;
+    return res;
 }
 
 //----------------------
@@ -1393,13 +1528,24 @@ bool ftp_reset (void) {
 }
 
 // Return current ftp server state
+// If a client is transferring data, the state of its session is returned
 //------------------
 int ftp_getstate() {
 	if ((FtpTaskHandle == NULL) || (ftp_mutex == NULL)) return -1;
 	if (xSemaphoreTake(ftp_mutex, FTP_MUTEX_TIMEOUT_MS / portTICK_PERIOD_MS) !=pdTRUE) return -2;
 
-	int fstate = ftp_data.state | (ftp_data.substate << 8);
-	if ((ftp_data.state == E_FTP_STE_READY) && (ftp_data.c_sd > 0)) fstate = E_FTP_STE_CONNECTED;
+	int fstate = ftp_data.state;
+	if (ftp_data.state == E_FTP_STE_READY) {
+		for (int i=0; i<FTP_MAX_SESSIONS; i++) {
+			ftp_session_t *s = &ftp_data.session[i];
+			if (s->c_sd < 0) continue;
+			if (s->state > E_FTP_STE_READY) {
+				fstate = s->state | (s->substate << 8);
+				break;
+			}
+			fstate = E_FTP_STE_CONNECTED;
+		}
+	}
 	xSemaphoreGive(ftp_mutex);
 	return fstate;
 }
@@ -1431,12 +1577,37 @@ bool ftp_stop_requested() {
 
 //-------------------------------
 int32_t ftp_get_maxstack (void) {
+	#ifdef FTP_HOST_BUILD
+	return -1;
+	#else
 	if ((FtpTaskHandle == NULL) || (ftp_mutex == NULL)) return -1;
 	if (xSemaphoreTake(ftp_mutex, FTP_MUTEX_TIMEOUT_MS / portTICK_PERIOD_MS) !=pdTRUE) return false;
 
 	int32_t maxstack = ftp_stack_size - uxTaskGetStackHighWaterMark(FtpTaskHandle);
 	xSemaphoreGive(ftp_mutex);
 	return maxstack;
+	#endif
+}
+
+//---------------------------------------------------
+bool ftp_get_stats (ftp_stats_t *stats, bool reset) {
+	if ((FtpTaskHandle == NULL) || (ftp_mutex == NULL)) return false;
+	if (xSemaphoreTake(ftp_mutex, FTP_MUTEX_TIMEOUT_MS / portTICK_PERIOD_MS) !=pdTRUE) return false;
+
+	*stats = ftp_data.stats;
+	if (stats->busy_ms > 0) {
+		stats->rate_tx = (uint32_t)(((uint64_t)stats->bytes_tx * 1000) / stats->busy_ms);
+		stats->rate_rx = (uint32_t)(((uint64_t)stats->bytes_rx * 1000) / stats->busy_ms);
+	}
+	if (reset) {
+		ftp_data.stats.bytes_tx = 0;
+		ftp_data.stats.bytes_rx = 0;
+		ftp_data.stats.files_tx = 0;
+		ftp_data.stats.files_rx = 0;
+		ftp_data.stats.busy_ms = 0;
+	}
+	xSemaphoreGive(ftp_mutex);
+	return true;
 }
 
 #endif
@@ -33,12 +33,42 @@
 #ifndef FTP_H_
 #define FTP_H_
 
+#ifdef FTP_HOST_BUILD
+/*
+ * The server core (ftp.c) can be built on a POSIX host against the system sockets,
+ * e.g. for load testing with several parallel clients:
+ *   make -C tools/host ftp-test
+ * builds it with tools/host/ftp/ftp_host.c, which sets FtpTaskHandle to non NULL,
+ * calls ftp_init(), ftp_enable() and then ftp_run(elapsed_ms) in a loop,
+ * and runs tools/host/ftp/ftp_clients.py against it.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#define CONFIG_MICROPY_USE_FTPSERVER	1
+#ifndef CONFIG_MICROPY_FTPSERVER_TIMEOUT
+#define CONFIG_MICROPY_FTPSERVER_TIMEOUT	300
+#endif
+#ifndef CONFIG_MICROPY_FTPSERVER_BUFFER_SIZE
+#define CONFIG_MICROPY_FTPSERVER_BUFFER_SIZE	1024
+#endif
+
+typedef pthread_mutex_t *QueueHandle_t;
+typedef void *TaskHandle_t;
+#else
 #include "sdkconfig.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
+#include "freertos/task.h"
+#endif
 
 #ifdef CONFIG_MICROPY_USE_FTPSERVER
 
+#ifndef CONFIG_MICROPY_FTPSERVER_MAX_SESSIONS
+#define CONFIG_MICROPY_FTPSERVER_MAX_SESSIONS	2
+#endif
+
 typedef enum {
     E_FTP_STE_DISABLED = 0,
     E_FTP_STE_START,
@@ -62,7 +92,22 @@ typedef enum {
 #define FTP_MUTEX_TIMEOUT_MS    1000
 #define FTP_CMD_TIMEOUT_MS      (CONFIG_MICROPY_FTPSERVER_TIMEOUT*1000)
 
+// Transfer statistics, the rates are measured over the time
+// during which at least one transfer was active
+typedef struct {
+    uint32_t    bytes_tx;
+    uint32_t    bytes_rx;
+    uint32_t    files_tx;
+    uint32_t    files_rx;
+    uint32_t    busy_ms;
+    uint32_t    rate_tx;        // bytes/second
+    uint32_t    rate_rx;        // bytes/second
+    uint8_t     sessions;       // currently connected clients
+    uint8_t     max_sessions;
+} ftp_stats_t;
+
 extern const char *FTP_TAG;
+extern TaskHandle_t FtpTaskHandle;
 extern char ftp_user[FTP_USER_PASS_LEN_MAX + 1];
 extern char ftp_pass[FTP_USER_PASS_LEN_MAX + 1];
 extern uint32_t ftp_stack_size;
@@ -81,6 +126,7 @@ int ftp_getstate();
 bool ftp_terminate (void);
 bool ftp_stop_requested();
 int32_t ftp_get_maxstack (void);
+bool ftp_get_stats (ftp_stats_t *stats, bool reset);
 
 #endif
 
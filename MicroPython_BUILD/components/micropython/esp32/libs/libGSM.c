@@ -605,7 +605,7 @@ static void checkSMS()
 					if (!carg) goto end;
 					if (!make_carg_entry(carg, 0, MP_SCHED_ENTRY_TYPE_STR, strlen(sindexes), (const uint8_t *)sindexes, NULL)) goto end;
 
-					mp_sched_schedule(New_SMS_cb, mp_const_none, carg);
+					mp_sched_schedule_src(New_SMS_cb, mp_const_none, carg, MP_SCHED_SRC_GSM);
 end:
 					free(sindexes);
 				}
@@ -53,6 +53,172 @@ littleFlash_t littleFlash = {0};
 
 static uint8_t *block_buffer = NULL;
 
+// ============================================================================
+// Flash access
+// ============================================================================
+
+//---------------------------------------------------------------------------------------
+static esp_err_t flash_read(littleFlash_t *self, lfs_block_t block, lfs_off_t off, void *buffer, lfs_size_t size)
+{
+	self->stats.reads++;
+	#ifdef CONFIG_LITTLEFLASH_USE_WEAR_LEVELING
+    return wl_read(lfs_wl_handle, (block * self->sector_sz) + off, buffer, size);
+	#else
+    return esp_partition_read(self->part, (block * self->sector_sz) + off, buffer, size);
+	#endif
+}
+
+//------------------------------------------------------------------------------------------------------
+static esp_err_t flash_write(littleFlash_t *self, lfs_block_t block, lfs_off_t off, const void *buffer, lfs_size_t size)
+{
+	self->stats.writes++;
+	// the sector is not erased any more
+	if (self->erased_map) self->erased_map[block / 32] &= ~(1 << (block % 32));
+    #ifdef CONFIG_LITTLEFLASH_USE_WEAR_LEVELING
+    return wl_write(lfs_wl_handle, (block * self->sector_sz) + off, buffer, size);
+	#else
+    return esp_partition_write(self->part, (block * self->sector_sz) + off, buffer, size);
+	#endif
+}
+
+//--------------------------------------------------------------
+static esp_err_t flash_erase(littleFlash_t *self, lfs_block_t block)
+{
+    ESP_LOGV(TAG, "LFS_ERASE: block=%u, sect_sz=%u", block, self->sector_sz);
+	self->stats.erases++;
+	#ifdef CONFIG_LITTLEFLASH_USE_WEAR_LEVELING
+	esp_err_t err = wl_erase_range(lfs_wl_handle, block * self->sector_sz, self->sector_sz);
+	#else
+	esp_err_t err = esp_partition_erase_range(self->part, block * self->sector_sz, self->sector_sz);
+	#endif
+	if ((err == ESP_OK) && (self->erased_map)) self->erased_map[block / 32] |= (1 << (block % 32));
+	return err;
+}
+
+//---------------------------------------------------------------
+static bool flash_known_erased(littleFlash_t *self, lfs_block_t block)
+{
+	if (self->erased_map == NULL) return false;
+	return ((self->erased_map[block / 32] & (1 << (block % 32))) != 0);
+}
+
+// Program the sector data, erase the sector first if needed
+// Writing the sector known to be erased requires no flash read
+//----------------------------------------------------------------------------------------------------------------
+static esp_err_t flash_prog(littleFlash_t *self, lfs_block_t block, lfs_off_t off, const uint8_t *buffer, lfs_size_t size)
+{
+    esp_err_t err;
+	if (!flash_known_erased(self, block)) {
+	    // --- Check if block needs to be erased ---
+	    err = flash_read(self, block, 0, block_buffer, self->sector_sz);
+	    if (err != ESP_OK) return err;
+
+	    // Check if the block was changed in a way that it must be erased before programming
+	    bool erase = false;
+	    for (int i=0; i<size; i++) {
+	    	if (~block_buffer[off+i] & buffer[i]) {
+	    		erase = true;
+				break;
+	    	}
+	    }
+	    if (erase) {
+	    	if ((off > 0) || (size < self->sector_sz)) {
+	    		// preserve the sector content outside of the programmed range
+	    		memcpy(block_buffer+off, buffer, size);
+	    		off = 0;
+	    		size = self->sector_sz;
+	    		buffer = block_buffer;
+	    	}
+    		err = flash_erase(self, block);
+		    if (err != ESP_OK) return err;
+	    }
+	    else if (memcmp(block_buffer+off, buffer, size) == 0) {
+	    	// nothing to program
+	    	return ESP_OK;
+	    }
+	}
+
+    return flash_write(self, block, off, buffer, size);
+}
+
+// ============================================================================
+// Write-back sector cache
+// ============================================================================
+
+//---------------------------------------------------------------------------------
+static littleflash_cache_t *cache_find(littleFlash_t *self, lfs_block_t block)
+{
+	for (int i=0; i<self->cache_n; i++) {
+		if (self->cache[i].block == block) return &self->cache[i];
+	}
+	return NULL;
+}
+
+// Write all dirty sectors to flash in the order they were last programmed,
+// so the metadata committed last is also written last
+//---------------------------------------------
+static int cache_flush(littleFlash_t *self)
+{
+	while (1) {
+		littleflash_cache_t *entry = NULL;
+		for (int i=0; i<self->cache_n; i++) {
+			if ((self->cache[i].dirty) && ((entry == NULL) || (self->cache[i].stamp < entry->stamp))) entry = &self->cache[i];
+		}
+		if (entry == NULL) break;
+
+		esp_err_t err = flash_prog(self, entry->block, 0, entry->data, self->sector_sz);
+	    if (err != ESP_OK) return LFS_ERR_IO;
+	    entry->dirty = false;
+	}
+	return LFS_ERR_OK;
+}
+
+// Get the cache entry for the block, the least recently used entry is reused if the block is not cached
+// Clean entries are reused first, all dirty entries are flushed if there are none
+//-------------------------------------------------------------------------------------------------------------
+static littleflash_cache_t *cache_get(littleFlash_t *self, lfs_block_t block, bool load, int *err)
+{
+	*err = LFS_ERR_OK;
+	littleflash_cache_t *entry = cache_find(self, block);
+	if (entry == NULL) {
+		for (int i=0; i<self->cache_n; i++) {
+			if ((!self->cache[i].dirty) && ((entry == NULL) || (self->cache[i].stamp < entry->stamp))) entry = &self->cache[i];
+		}
+		if (entry == NULL) {
+			*err = cache_flush(self);
+			if (*err != LFS_ERR_OK) return NULL;
+			entry = &self->cache[0];
+			for (int i=1; i<self->cache_n; i++) {
+				if (self->cache[i].stamp < entry->stamp) entry = &self->cache[i];
+			}
+		}
+		entry->block = LITTLEFLASH_CACHE_FREE;
+		if (load) {
+			if (flash_known_erased(self, block)) memset(entry->data, 0xFF, self->sector_sz);
+			else if (flash_read(self, block, 0, entry->data, self->sector_sz) != ESP_OK) {
+				*err = LFS_ERR_IO;
+				return NULL;
+			}
+		}
+		entry->block = block;
+		entry->dirty = false;
+	}
+	else self->stats.cache_hits++;
+
+	entry->stamp = ++self->cache_seq;
+	return entry;
+}
+
+//---------------------------------------------------------------
+static void cache_discard(littleFlash_t *self, lfs_block_t block)
+{
+	littleflash_cache_t *entry = cache_find(self, block);
+	if (entry) {
+		entry->block = LITTLEFLASH_CACHE_FREE;
+		entry->dirty = false;
+	}
+}
+
 // ============================================================================
 // LFS disk interface for internal flash
 // ============================================================================
@@ -63,11 +229,14 @@ static int internal_read(const struct lfs_config *c, lfs_block_t block, lfs_off_
     ESP_LOGV(TAG, "LFS_READ: block=%u off=%u size=%u", block, off, size);
 
     littleFlash_t *self = (littleFlash_t *) c->context;
-	#ifdef CONFIG_LITTLEFLASH_USE_WEAR_LEVELING
-    esp_err_t err = wl_read(lfs_wl_handle, (block * self->sector_sz) + off, buffer, size);
-	#else
-    esp_err_t err = esp_partition_read(self->part, (block * self->sector_sz) + off, buffer, size);
-	#endif
+
+    littleflash_cache_t *entry = cache_find(self, block);
+    if (entry) {
+    	self->stats.cache_hits++;
+    	memcpy(buffer, entry->data + off, size);
+    	return LFS_ERR_OK;
+    }
+    esp_err_t err = flash_read(self, block, off, buffer, size);
 
     return err == ESP_OK ? LFS_ERR_OK : LFS_ERR_IO;
 }
@@ -79,34 +248,17 @@ static int internal_prog(const struct lfs_config *c, lfs_block_t block, lfs_off_
 
     littleFlash_t *self = (littleFlash_t *) c->context;
 
-    // --- Check if block needs to be erased ---
-    // Read the block
-    esp_err_t err;
-    err = internal_read(c, block, 0, block_buffer, self->sector_sz);
-    if (err != ESP_OK) return LFS_ERR_IO;
-
-    // Check if the block was changed in a way that it must be erased before programming
-    uint8_t *buff = (uint8_t *)buffer;
-    for (int i=0; i<size; i++) {
-    	if ( !((block_buffer[off+i] == 0xFF) || (block_buffer[off+i] == buff[i])) ) {
-    		if (~block_buffer[off+i] & buff[i]) {
-    		    ESP_LOGV(TAG, "LFS_ERASE: block=%u, sect_sz=%u", block, self->sector_sz);
-    			#ifdef CONFIG_LITTLEFLASH_USE_WEAR_LEVELING
-    			err = wl_erase_range(lfs_wl_handle, block * self->sector_sz, self->sector_sz);
-    			#else
-    			err = esp_partition_erase_range(self->part, block * self->sector_sz, self->sector_sz);
-    			#endif
-    		    if (err != ESP_OK) return LFS_ERR_IO;
-				break;
-    		}
-    	}
+    if (self->cache_n > 0) {
+    	// Program the cached sector, it is written to flash on sync
+    	int err;
+    	littleflash_cache_t *entry = cache_get(self, block, ((off > 0) || (size < self->sector_sz)), &err);
+    	if (entry == NULL) return err;
+    	memcpy(entry->data + off, buffer, size);
+    	entry->dirty = true;
+    	return LFS_ERR_OK;
     }
 
-    #ifdef CONFIG_LITTLEFLASH_USE_WEAR_LEVELING
-    err = wl_write(lfs_wl_handle, (block * self->sector_sz) + off, buffer, size);
-	#else
-    err = esp_partition_write(self->part, (block * self->sector_sz) + off, buffer, size);
-	#endif
+    esp_err_t err = flash_prog(self, block, off, (const uint8_t *)buffer, size);
 
     return err == ESP_OK ? LFS_ERR_OK : LFS_ERR_IO;
 }
@@ -115,12 +267,10 @@ static int internal_prog(const struct lfs_config *c, lfs_block_t block, lfs_off_
 static bool internal_check_erased(littleFlash_t *self, lfs_block_t block)
 {
     // Check if the sector is already erased
+	if (flash_known_erased(self, block)) return true;
+
     bool f = true;
-	#ifdef CONFIG_LITTLEFLASH_USE_WEAR_LEVELING
-    esp_err_t err = wl_read(lfs_wl_handle, (block * self->sector_sz), block_buffer, self->sector_sz);
-	#else
-    esp_err_t err = esp_partition_read(self->part, (block * self->sector_sz), block_buffer, self->sector_sz);
-	#endif
+    esp_err_t err = flash_read(self, block, 0, block_buffer, self->sector_sz);
 	if (err == ESP_OK) {
 		for (int i=0; i<self->sector_sz; i++) {
 			if (block_buffer[i] != 0xFF) {
@@ -130,6 +280,8 @@ static bool internal_check_erased(littleFlash_t *self, lfs_block_t block)
 		}
 	}
 	else f = false;
+	// remember the erased state
+	if ((f) && (self->erased_map)) self->erased_map[block / 32] |= (1 << (block % 32));
 	return f;
 }
 
@@ -138,14 +290,12 @@ static int internal_erase(const struct lfs_config *c, lfs_block_t block)
 {
     littleFlash_t *self = (littleFlash_t *) c->context;
 
+    // the cached sector content is no longer valid
+    cache_discard(self, block);
+
     esp_err_t err = ESP_OK;
 	if (!internal_check_erased(self, block)) {
-	    ESP_LOGV(TAG, "LFS_ERASE: block=%u, sect_sz=%u", block, self->sector_sz);
-		#ifdef CONFIG_LITTLEFLASH_USE_WEAR_LEVELING
-		err = wl_erase_range(lfs_wl_handle, block * self->sector_sz, self->sector_sz);
-		#else
-		err = esp_partition_erase_range(self->part, block * self->sector_sz, self->sector_sz);
-		#endif
+		err = flash_erase(self, block);
 	}
 	else {
 	    ESP_LOGV(TAG, "LFS_ERASE: block %u already erased", block);
@@ -166,7 +316,57 @@ static int internal_sync(const struct lfs_config *c)
 {
     ESP_LOGV(TAG, "%s", __func__);
 
-    return LFS_ERR_OK;
+    littleFlash_t *self = (littleFlash_t *) c->context;
+
+    return cache_flush(self);
+}
+
+//---------------------------------------------
+static void cache_free(littleFlash_t *self)
+{
+	if (self->cache) {
+		for (int i=0; i<self->cache_n; i++) {
+			if (self->cache[i].data) free(self->cache[i].data);
+		}
+		free(self->cache);
+		self->cache = NULL;
+	}
+	self->cache_n = 0;
+	if (self->erased_map) {
+		free(self->erased_map);
+		self->erased_map = NULL;
+	}
+}
+
+// Allocate the sector cache and the erased sectors bit map
+// Buffers are allocated from psRAM if it is used for malloc
+// If there is not enough memory, the cache is not used
+//------------------------------------------------------------
+static void cache_alloc(littleFlash_t *self, int nsectors)
+{
+	self->erased_map = calloc((self->block_cnt + 31) / 32, sizeof(uint32_t));
+	if (nsectors <= 0) return;
+
+	self->cache = calloc(nsectors, sizeof(littleflash_cache_t));
+	if (self->cache == NULL) goto nomem;
+	self->cache_n = nsectors;
+	for (int i=0; i<nsectors; i++) {
+		self->cache[i].block = LITTLEFLASH_CACHE_FREE;
+		self->cache[i].data = malloc(self->sector_sz);
+		if (self->cache[i].data == NULL) goto nomem;
+	}
+	return;
+
+nomem:
+    ESP_LOGW(TAG, "not enough memory for sector cache");
+	if (self->cache) {
+		for (int i=0; i<self->cache_n; i++) {
+			if (self->cache[i].data) free(self->cache[i].data);
+		}
+		free(self->cache);
+		self->cache = NULL;
+	}
+	self->cache_n = 0;
 }
 
 
@@ -849,6 +1049,9 @@ esp_err_t littleFlash_init(const little_flash_config_t *config)
     littleFlash.lfs_cfg.lookahead   = config->lookahead;
     littleFlash.lfs_cfg.context = (void *)&littleFlash;
 
+    memset(&littleFlash.stats, 0, sizeof(littleflash_stats_t));
+    cache_alloc(&littleFlash, CONFIG_LITTLEFLASH_CACHE_SECTORS);
+
     err = lfs_mount(&littleFlash.lfs, &littleFlash.lfs_cfg);
     if (err < 0)
     {
@@ -940,6 +1143,7 @@ esp_err_t littleFlash_init(const little_flash_config_t *config)
 fail:
     free(block_buffer);
     block_buffer = NULL;
+    cache_free(&littleFlash);
 	#ifdef CONFIG_LITTLEFLASH_USE_WEAR_LEVELING
 	wl_unmount(lfs_wl_handle);
 	lfs_wl_handle = WL_INVALID_HANDLE;
@@ -975,11 +1179,16 @@ void littleFlash_term(const char* partition_label)
 
     if (littleFlash.mounted)
     {
+        cache_flush(&littleFlash);
         lfs_unmount(&littleFlash.lfs);
         littleFlash.mounted = false;
     }
 
+    ESP_LOGD(TAG, "Flash reads=%u writes=%u erases=%u, cache hits=%u",
+    		littleFlash.stats.reads, littleFlash.stats.writes, littleFlash.stats.erases, littleFlash.stats.cache_hits);
+    cache_free(&littleFlash);
     if (block_buffer) free(block_buffer);
+    block_buffer = NULL;
 
 	#ifdef CONFIG_LITTLEFLASH_USE_WEAR_LEVELING
     wl_unmount(lfs_wl_handle);
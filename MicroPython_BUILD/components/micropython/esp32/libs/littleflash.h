@@ -51,6 +51,34 @@ typedef struct vfs_fd
     char *name;
 } vfs_fd_t;
 
+/*
+ * The driver can be built on a POSIX host against a RAM backed partition,
+ * to count the flash reads, writes and erases of the sector cache:
+ *   make -C tools/host littleflash-test
+ * builds it with tools/host/littleflash/littleflash_host.c and the stub
+ * headers in tools/host/littleflash/stub.
+ */
+#ifndef CONFIG_LITTLEFLASH_CACHE_SECTORS
+#define CONFIG_LITTLEFLASH_CACHE_SECTORS 0
+#endif
+
+#define LITTLEFLASH_CACHE_FREE	0xFFFFFFFF
+
+// Write-back sector cache entry
+typedef struct {
+	uint8_t *data;				// sector data
+	lfs_block_t block;			// cached block, LITTLEFLASH_CACHE_FREE if not used
+	uint32_t stamp;				// last access, used for LRU and flush ordering
+	bool dirty;					// programmed, but not yet written to flash
+} littleflash_cache_t;
+
+typedef struct {
+	uint32_t reads;				// flash read operations
+	uint32_t writes;			// flash write operations
+	uint32_t erases;			// flash sector erases
+	uint32_t cache_hits;		// accesses served from the sector cache
+} littleflash_stats_t;
+
 typedef struct {
 	_lock_t lock;
 	struct lfs_config lfs_cfg;	// littlefs configuration
@@ -62,6 +90,11 @@ typedef struct {
 	bool mounted;
 	bool registered;
 	vfs_fd_t *fds;
+	littleflash_cache_t *cache;	// sector cache
+	int cache_n;				// number of cached sectors
+	uint32_t cache_seq;
+	uint32_t *erased_map;		// bit map of the sectors known to be erased
+	littleflash_stats_t stats;
 } littleFlash_t;
 
 extern littleFlash_t littleFlash;
@@ -42,6 +42,8 @@
 #include "py/mpconfig.h"
 #include "py/obj.h"
 #include "py/mphal.h"
+#include "py/mpstate.h"
+#include "py/mpthread.h"
 #include "mpversion.h"
 #include "telnet.h"
 
@@ -64,6 +66,11 @@
 #define TELNET_PORT                         23
 // rxRindex and rxWindex must be uint8_t and TELNET_RX_BUFFER_SIZE == 256
 #define TELNET_RX_BUFFER_SIZE               256
+// TX ring buffer, TELNET_TX_BUFFER_SIZE must be a power of 2
+#define TELNET_TX_BUFFER_SIZE               2048
+#define TELNET_TX_SEGMENT_SIZE              TCP_MSS
+#define TELNET_TX_FLUSH_MS                  5       // send the partial segment if nothing was added for this time
+#define TELNET_TX_STALL_TIMEOUT_MS          1000    // max wait for free space in TX buffer
 #define TELNET_MAX_CLIENTS                  1
 #define TELNET_TX_RETRIES_MAX               50
 #define TELNET_WAIT_TIME_MS                 10
@@ -116,6 +123,7 @@ typedef union {
 
 typedef struct {
     uint8_t             *rxBuffer;
+    uint8_t             *txBuffer;
     uint64_t            timeout;
     telnet_state_t      state;
     telnet_substate_t   substate;
@@ -129,6 +137,12 @@ typedef struct {
     // used to store incoming chars in cases the reception needs to be completed later
     uint8_t             rxIncompleteLen;
 
+    // TX ring buffer indexes are free running, the position in buffer is (index & (TELNET_TX_BUFFER_SIZE-1))
+    // txWindex is advanced by the printing task, txRindex by the telnet task
+    volatile uint32_t   txWindex;
+    volatile uint32_t   txRindex;
+    volatile uint64_t   txLastWrite;
+
     uint8_t             txRetries;
     uint8_t             loginRetries;
     bool                enabled;
@@ -145,6 +159,8 @@ char telnet_user[TELNET_USER_PASS_LEN_MAX + 1];
 char telnet_pass[TELNET_USER_PASS_LEN_MAX + 1];
 
 static telnet_data_t telnet_data = {0};
+static telnet_stats_t telnet_stats = {0};
+static portMUX_TYPE telnet_tx_mux = portMUX_INITIALIZER_UNLOCKED;
 
 static const char* telnet_welcome_msg       = "MicroPython " MICROPY_GIT_TAG " - " MICROPY_BUILD_DATE " on " MICROPY_HW_BOARD_NAME " with " MICROPY_HW_MCU_NAME "\r\n";
 static const char* telnet_request_user      = "Login as: ";
@@ -171,6 +187,10 @@ static void _telnet_reset (void) {
     closesocket(telnet_data.sd);
     telnet_data.sd = -1;
     telnet_data.state = E_TELNET_STE_START;
+    // discard the unsent data
+    portENTER_CRITICAL(&telnet_tx_mux);
+    telnet_data.txRindex = telnet_data.txWindex;
+    portEXIT_CRITICAL(&telnet_tx_mux);
 }
 
 //------------------------------------------
@@ -255,6 +275,10 @@ static void telnet_wait_for_connection (void) {
         option |= O_NONBLOCK;
         fcntl(telnet_data.n_sd, F_SETFL, option);
 
+        // the output is coalesced in the TX buffer, send the partial segments without delay
+        option = 1;
+        setsockopt(telnet_data.n_sd, IPPROTO_TCP, TCP_NODELAY, &option, sizeof(option));
+
         // client connected, so go on
         telnet_data.rxWindex = 0;
         telnet_data.rxRindex = 0;
@@ -408,6 +432,7 @@ static telnet_result_t telnet_recv_text_non_blocking (void *buff, int32_t Maxlen
     // if there's data received, parse it
     if (*rxLen > 0) {
         telnet_data.timeout = mp_hal_ticks_ms();
+        telnet_stats.rx_bytes += *rxLen;
         telnet_parse_input (buff, rxLen);
         if (*rxLen > 0) {
             return E_TELNET_RESULT_OK;
@@ -438,6 +463,44 @@ static void telnet_process (void) {
     }
 }
 
+// Send the data from TX buffer in segments of max TELNET_TX_SEGMENT_SIZE bytes
+// The last partial segment is sent only if no data was added for TELNET_TX_FLUSH_MS
+//---------------------------------
+static void telnet_tx_flush (void) {
+    uint32_t rindex = telnet_data.txRindex;
+    uint32_t pending = telnet_data.txWindex - rindex;
+    bool idle = ((mp_hal_ticks_ms() - telnet_data.txLastWrite) >= TELNET_TX_FLUSH_MS);
+
+    while (pending > 0) {
+        if ((pending < TELNET_TX_SEGMENT_SIZE) && (!idle)) break;
+
+        uint32_t idx = rindex & (TELNET_TX_BUFFER_SIZE - 1);
+        int32_t len = MIN(pending, TELNET_TX_BUFFER_SIZE - idx);
+        if (len > TELNET_TX_SEGMENT_SIZE) len = TELNET_TX_SEGMENT_SIZE;
+
+        int32_t sent = send(telnet_data.n_sd, telnet_data.txBuffer + idx, len, 0);
+        if (sent > 0) {
+            telnet_data.timeout = mp_hal_ticks_ms();
+            telnet_stats.tx_bytes += sent;
+            telnet_stats.tx_segments++;
+            rindex += sent;
+            pending -= sent;
+            portENTER_CRITICAL(&telnet_tx_mux);
+            telnet_data.txRindex = rindex;
+            portEXIT_CRITICAL(&telnet_tx_mux);
+        }
+        else if (errno == EAGAIN) {
+            // socket send buffer full, try again on next run
+            break;
+        }
+        else {
+            printf("[Telnet] Send Error\n");
+            _telnet_reset();
+            break;
+        }
+    }
+}
+
 //----------------------------------------------------------------------
 static int telnet_process_credential (char *credential, int32_t rxLen) {
     telnet_data.rxWindex += rxLen;
@@ -568,6 +631,7 @@ int telnet_run (void) {
             break;
         case E_TELNET_STE_LOGGED_IN:
             telnet_process();
+            if (telnet_data.state == E_TELNET_STE_LOGGED_IN) telnet_tx_flush();
             break;
         default:
             break;
@@ -588,8 +652,11 @@ void telnet_init (void) {
 	telnet_stop = 0;
     // Allocate memory for the receive buffer (from the RTOS heap)
 	if (telnet_data.rxBuffer) free(telnet_data.rxBuffer);
+	if (telnet_data.txBuffer) free(telnet_data.txBuffer);
 	memset(&telnet_data, 0, sizeof(telnet_data_t));
+	memset(&telnet_stats, 0, sizeof(telnet_stats_t));
     telnet_data.rxBuffer = malloc(TELNET_RX_BUFFER_SIZE);
+    telnet_data.txBuffer = malloc(TELNET_TX_BUFFER_SIZE);
     telnet_data.state = E_TELNET_STE_DISABLED;
 	if (telnet_mutex == NULL) telnet_mutex = xSemaphoreCreateMutex();
 }
@@ -597,31 +664,78 @@ void telnet_init (void) {
 //-------------------------
 void telnet_deinit (void) {
 	if (telnet_data.rxBuffer) free(telnet_data.rxBuffer);
+	if (telnet_data.txBuffer) free(telnet_data.txBuffer);
 	memset(&telnet_data, 0, sizeof(telnet_data_t));
 }
 
 
+// Copy the string to the TX buffer, converting '\n' to "\r\n" if 'cooked' is set
+// The buffer is sent by the telnet task, the caller waits only if the buffer is full
+//---------------------------------------------------------------
+static void telnet_tx_put (const char *str, int len, bool cooked) {
+	if ((TelnetTaskHandle == NULL) || (telnet_data.txBuffer == NULL) || (telnet_data.n_sd <= 0)) return;
+
+    static char prev = '\0';
+    uint64_t stall_end = 0;
+    #if MICROPY_PY_THREAD
+    // only MicroPython threads hold the GIL, output from other tasks
+    // (e.g. ESP-IDF log messages) must not release it while waiting
+    bool gil_held = (mp_thread_get_state() != NULL);
+    #endif
+
+    while ((len > 0) && (telnet_data.state == E_TELNET_STE_LOGGED_IN)) {
+        uint64_t now = mp_hal_ticks_ms();
+
+        portENTER_CRITICAL(&telnet_tx_mux);
+        uint32_t windex = telnet_data.txWindex;
+        uint32_t free_len = TELNET_TX_BUFFER_SIZE - (windex - telnet_data.txRindex);
+        while ((len > 0) && (free_len > 0)) {
+            if ((cooked) && (*str == '\n') && (prev != '\r')) {
+                if (free_len < 2) break;
+                telnet_data.txBuffer[windex++ & (TELNET_TX_BUFFER_SIZE - 1)] = '\r';
+                free_len--;
+            }
+            telnet_data.txBuffer[windex++ & (TELNET_TX_BUFFER_SIZE - 1)] = *str;
+            free_len--;
+            prev = *str++;
+            len--;
+        }
+        telnet_data.txWindex = windex;
+        telnet_data.txLastWrite = now;
+        uint32_t pending = windex - telnet_data.txRindex;
+        portEXIT_CRITICAL(&telnet_tx_mux);
+
+        // wake up the telnet task if a full segment can be sent
+        if ((pending >= TELNET_TX_SEGMENT_SIZE) || (len > 0)) xTaskNotifyGive(TelnetTaskHandle);
+
+        if (len > 0) {
+            // buffer full, wait until the telnet task sends some data
+            if (stall_end == 0) {
+                telnet_stats.tx_stalls++;
+                stall_end = now + TELNET_TX_STALL_TIMEOUT_MS;
+            }
+            else if (now > stall_end) break; // client not receiving, drop the rest
+            #if MICROPY_PY_THREAD
+            if (gil_held) MP_THREAD_GIL_EXIT();
+            vTaskDelay(1);
+            if (gil_held) MP_THREAD_GIL_ENTER();
+            #else
+            vTaskDelay(1);
+            #endif
+        }
+    }
+}
+
 // Send string to telnet client
 //----------------------------------------------
 void telnet_tx_strn (const char *str, int len) {
-	if ((TelnetTaskHandle == NULL) || (telnet_mutex == NULL) || (telnet_data.n_sd <= 0)) return;
-    if (xSemaphoreTake(telnet_mutex, TELNET_MUTEX_TIMEOUT_MS / portTICK_PERIOD_MS) !=pdTRUE) return;
-
-    if ((telnet_data.state == E_TELNET_STE_LOGGED_IN) && (len > 0)) {
-        int32_t retries = 0;
-        uint32_t delay = TELNET_WAIT_TIME_MS;
-
-    	do {
-    		if (send(telnet_data.n_sd, str, len, 0) > 0) {
-    			telnet_data.timeout = mp_hal_ticks_ms();
-    			break;
-    		}
-    		else if (EAGAIN != errno) break;
-    		// start with the default delay and increment it on each retry
-    		vTaskDelay(delay++ / portTICK_PERIOD_MS);
-    	} while (++retries <= TELNET_TX_RETRIES_MAX);
-    }
-	xSemaphoreGive(telnet_mutex);
+    telnet_tx_put(str, len, false);
+}
+
+// Send string to telnet client, convert '\n' to "\r\n"
+//------------------------------------------------------
+void telnet_tx_strn_cooked (const char *str, int len) {
+    telnet_tx_put(str, len, true);
 }
 
 // Return true if any character is available in RX buffer
@@ -650,15 +764,31 @@ int telnet_rx_char (void) {
     return rx_char;
 }
 
+// Copy up to 'len' characters from RX buffer to 'buf'
+// Return the number of copied characters
+//-----------------------------------------
+int telnet_rx_strn (char *buf, int len) {
+	if ((TelnetTaskHandle == NULL) || (telnet_mutex == NULL) || (telnet_data.n_sd <= 0)) return 0;
+	if (xSemaphoreTake(telnet_mutex, TELNET_MUTEX_TIMEOUT_MS / portTICK_PERIOD_MS) !=pdTRUE) return 0;
+
+    int n = 0;
+    if (telnet_data.state == E_TELNET_STE_LOGGED_IN) {
+        while ((n < len) && (telnet_data.rxRindex != telnet_data.rxWindex)) {
+            // rxRindex must be uint8_t and TELNET_RX_BUFFER_SIZE == 256 so that it wraps around automatically
+            buf[n++] = (char)telnet_data.rxBuffer[telnet_data.rxRindex++];
+        }
+    }
+	xSemaphoreGive(telnet_mutex);
+    return n;
+}
+
 // Return true if client is logged in
+// Called on every print, the state is read without taking the mutex
 //---------------------------
 bool telnet_loggedin (void) {
 	if ((TelnetTaskHandle == NULL) || (telnet_mutex == NULL) || (telnet_data.n_sd <= 0)) return false;
-	if (xSemaphoreTake(telnet_mutex, TELNET_MUTEX_TIMEOUT_MS / portTICK_PERIOD_MS) !=pdTRUE) return false;
 
-	bool res = (telnet_data.state == E_TELNET_STE_LOGGED_IN);
-	xSemaphoreGive(telnet_mutex);
-    return res;
+    return (telnet_data.state == E_TELNET_STE_LOGGED_IN);
 }
 
 // Enable telnet server
@@ -740,6 +870,14 @@ bool telnet_stop_requested() {
 	return res;
 }
 
+// Get the transfer counters
+//--------------------------------------------
+void telnet_get_stats (telnet_stats_t *stats) {
+    portENTER_CRITICAL(&telnet_tx_mux);
+    *stats = telnet_stats;
+    portEXIT_CRITICAL(&telnet_tx_mux);
+}
+
 //----------------------------------
 int32_t telnet_get_maxstack (void) {
 	if ((TelnetTaskHandle == NULL) || (telnet_mutex == NULL)) return -1;
@@ -56,6 +56,13 @@ typedef enum {
     E_TELNET_STE_LOGGED_IN
 } telnet_state_t;
 
+typedef struct {
+    uint32_t tx_bytes;      // bytes sent to the client
+    uint32_t tx_segments;   // number of send() calls
+    uint32_t tx_stalls;     // times the printing task had to wait for free space in TX buffer
+    uint32_t rx_bytes;      // bytes received from the client
+} telnet_stats_t;
+
 
 extern char telnet_user[TELNET_USER_PASS_LEN_MAX + 1];
 extern char telnet_pass[TELNET_USER_PASS_LEN_MAX + 1];
@@ -72,9 +79,11 @@ void telnet_init (void);
 void telnet_deinit (void);
 int telnet_run (void);
 void telnet_tx_strn (const char *str, int len);
+void telnet_tx_strn_cooked (const char *str, int len);
 bool telnet_rx_any (void);
 bool telnet_loggedin (void);
 int  telnet_rx_char (void);
+int  telnet_rx_strn (char *buf, int len);
 bool telnet_enable (void);
 bool telnet_disable (void);
 bool telnet_isenabled (void);
@@ -83,6 +92,7 @@ int telnet_getstate();
 bool telnet_terminate (void);
 bool telnet_stop_requested();
 int32_t telnet_get_maxstack (void);
+void telnet_get_stats (telnet_stats_t *stats);
 
 #endif
 
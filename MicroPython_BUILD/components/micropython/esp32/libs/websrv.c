@@ -24,12 +24,25 @@
  * THE SOFTWARE.
  */
 
-#include "sdkconfig.h"
+/*
+ * Static file web server
+ *
+ * An accept task hands the client connections to a small pool of worker tasks.
+ * Workers keep the connections alive, serve files from the document root in
+ * buffer sized blocks, answer conditional requests (If-None-Match) with 304
+ * and serve the pre-gzipped 'name.gz' file to clients accepting gzip.
+ * Dynamic routes are handed to the Python callback through the scheduler,
+ * the callback answers with network.websrv.respond().
+ */
+
+#include "libs/websrv.h"
 
 #ifdef CONFIG_MICROPY_USE_WEBSERVER
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <ctype.h>
 #include <stdio.h>
 #include <errno.h>
@@ -37,114 +50,1020 @@
 #include <unistd.h>
 #include <sys/stat.h>
 
+#ifdef WEBSRV_HOST_BUILD
+
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+// ==== Host (POSIX) build support ====
+
+#define ESP_LOGE(tag, fmt, ...)             fprintf(stderr, "E %s " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...)             fprintf(stderr, "W %s " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...)             fprintf(stderr, "I %s " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...)             do {} while (0)
+
+#define closesocket(sd)                     close(sd)
+#define WEBSRV_SEND_FLAGS                   MSG_NOSIGNAL
+
+static pthread_mutex_t websrv_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t websrv_queue_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t websrv_resp_cond = PTHREAD_COND_INITIALIZER;
+#define WEBSRV_LOCK()                       pthread_mutex_lock(&websrv_mutex)
+#define WEBSRV_UNLOCK()                     pthread_mutex_unlock(&websrv_mutex)
+
+#else
+
 #include "py/mpstate.h"
 #include "py/obj.h"
+#include "py/runtime.h"
 #include "extmod/vfs_native.h"
-#include "extmod/vfs.h"
-#include "libs/websrv.h"
-#include "timeutils.h"
-
-#include "dirent.h"
 
-#include "esp_system.h"
-#include "esp_spi_flash.h"
-#include "nvs_flash.h"
-#include "esp_event.h"
 #include "esp_log.h"
 
-#include "esp_wifi.h"
-
-//#include "lwip/sockets.h"
-//#include "lwip/dns.h"
-#include "lwip/api.h"
-#include "lwip/err.h"
-#include "lwip/netdb.h"
+#include "lwip/sockets.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
 #include "freertos/semphr.h"
 
-TaskHandle_t WebSrvTaskHandle = NULL;
-QueueHandle_t websrv_mutex = NULL;
+#define WEBSRV_SEND_FLAGS                   0
+#define WEBSRV_STACK_SIZE                   4096
+
+extern int MainTaskCore;
+
+static SemaphoreHandle_t websrv_mutex = NULL;
+static QueueHandle_t websrv_queue = NULL;
+#define WEBSRV_LOCK()                       xSemaphoreTake(websrv_mutex, portMAX_DELAY)
+#define WEBSRV_UNLOCK()                     xSemaphoreGive(websrv_mutex)
+
+#endif
+
 const char *WEBSRV_TAG = "[WebSrv]";
 
+/******************************************************************************
+ DEFINE PRIVATE CONSTANTS
+ ******************************************************************************/
+#define WEBSRV_WORKERS                      CONFIG_MICROPY_WEBSERVER_WORKERS
+#define WEBSRV_BUFFER_SIZE                  CONFIG_MICROPY_WEBSERVER_BUFFER_SIZE	// file transfer buffer
+#define WEBSRV_REQ_SIZE                     2048	// request headers and body
+#define WEBSRV_QUEUE_LEN                    (WEBSRV_WORKERS * 2)
+#define WEBSRV_PATH_MAX                     (WEBSRV_ROOT_LEN_MAX + 128)
+#define WEBSRV_POLL_MS                      100		// max time the tasks wait without checking for stop request
+#define WEBSRV_REQ_TIMEOUT_MS               5000	// max time to receive the complete request
+#define WEBSRV_SOCK_TIMEOUT_MS              5000
+#define WEBSRV_DYNAMIC_TIMEOUT_MS           5000	// max time the callback can take to respond
+#define WEBSRV_MAX_REQUESTS                 100		// requests served on one connection
+
+/******************************************************************************
+ DEFINE PRIVATE TYPES
+ ******************************************************************************/
+typedef struct {
+    char            *method;
+    char            *path;
+    char            *query;
+    char            *body;
+    uint32_t        body_len;
+    const char      *if_none_match;
+    bool            gzip;
+    bool            keep_alive;
+    bool            head;
+} websrv_request_t;
+
+typedef struct {
+    int32_t         sd;
+    char            *req;           // request buffer
+    uint32_t        req_len;
+    uint8_t         *buf;           // response buffer
+    uint8_t         idx;
+    // response of the Python callback
+    uint16_t        seq;
+    uint32_t        resp_id;
+    bool            resp_ready;
+    int             resp_status;
+    char            resp_ctype[48];
+    uint8_t         *resp_body;
+    uint32_t        resp_len;
+	#ifndef WEBSRV_HOST_BUILD
+    SemaphoreHandle_t resp_sem;
+	#endif
+} websrv_worker_t;
+
+typedef struct {
+    const char      *ext;
+    const char      *type;
+} websrv_mime_t;
+
+/******************************************************************************
+ DECLARE PRIVATE DATA
+ ******************************************************************************/
+static websrv_config_t websrv_config;
+static websrv_worker_t websrv_workers[WEBSRV_WORKERS];
+static websrv_stats_t websrv_stats = {0};
+static volatile bool websrv_stop_req = false;
+static volatile int websrv_tasks = 0;
+
+#ifdef WEBSRV_HOST_BUILD
+static int32_t websrv_queue[WEBSRV_QUEUE_LEN];
+static int websrv_queue_head = 0;
+static int websrv_queue_count = 0;
+websrv_host_callback_t websrv_host_callback = NULL;
+#endif
+
+static const websrv_mime_t websrv_mime_table[] = {
+    { "html", "text/html" },
+    { "htm",  "text/html" },
+    { "css",  "text/css" },
+    { "js",   "application/javascript" },
+    { "json", "application/json" },
+    { "txt",  "text/plain" },
+    { "xml",  "text/xml" },
+    { "png",  "image/png" },
+    { "jpg",  "image/jpeg" },
+    { "jpeg", "image/jpeg" },
+    { "gif",  "image/gif" },
+    { "svg",  "image/svg+xml" },
+    { "ico",  "image/x-icon" },
+    { "wasm", "application/wasm" },
+    { "woff", "font/woff" },
+    { "woff2","font/woff2" },
+    { NULL,   "application/octet-stream" }
+};
+
+// ==== Task and queue functions ============================================
+
+#ifdef WEBSRV_HOST_BUILD
+
+//-----------------------------------------------------------------
+static void websrv_abstime(struct timespec *tm, uint32_t wait) {
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	uint64_t ns = ((uint64_t)now.tv_usec * 1000) + ((uint64_t)wait * 1000000);
+	tm->tv_sec = now.tv_sec + (ns / 1000000000);
+	tm->tv_nsec = ns % 1000000000;
+}
+
+// Put the new connection into the queue, wait max 'wait' ms for free space
+//---------------------------------------------------------
+static bool websrv_queue_put(int32_t sd, uint32_t wait) {
+	struct timespec tm;
+	websrv_abstime(&tm, wait);
+
+	WEBSRV_LOCK();
+	while (websrv_queue_count >= WEBSRV_QUEUE_LEN) {
+		if (pthread_cond_timedwait(&websrv_queue_cond, &websrv_mutex, &tm) != 0) break;
+	}
+	bool res = (websrv_queue_count < WEBSRV_QUEUE_LEN);
+	if (res) {
+		websrv_queue[(websrv_queue_head + websrv_queue_count) % WEBSRV_QUEUE_LEN] = sd;
+		websrv_queue_count++;
+		pthread_cond_broadcast(&websrv_queue_cond);
+	}
+	WEBSRV_UNLOCK();
+	return res;
+}
+
+// Get the next connection, wait max 'wait' ms
+//---------------------------------------------------------
+static bool websrv_queue_get(int32_t *sd, uint32_t wait) {
+	struct timespec tm;
+	websrv_abstime(&tm, wait);
+
+	WEBSRV_LOCK();
+	while (websrv_queue_count == 0) {
+		if (pthread_cond_timedwait(&websrv_queue_cond, &websrv_mutex, &tm) != 0) break;
+	}
+	bool res = (websrv_queue_count > 0);
+	if (res) {
+		*sd = websrv_queue[websrv_queue_head];
+		websrv_queue_head = (websrv_queue_head + 1) % WEBSRV_QUEUE_LEN;
+		websrv_queue_count--;
+		pthread_cond_broadcast(&websrv_queue_cond);
+	}
+	WEBSRV_UNLOCK();
+	return res;
+}
+
+//--------------------------------------
+static int websrv_queue_pending(void) {
+	return websrv_queue_count;
+}
+
+// Wait max 'wait' ms for the response to the worker's current request
+//-------------------------------------------------------------
+static void websrv_resp_wait(websrv_worker_t *w, uint32_t wait) {
+	struct timespec tm;
+	websrv_abstime(&tm, wait);
+
+	WEBSRV_LOCK();
+	while (!w->resp_ready) {
+		if (pthread_cond_timedwait(&websrv_resp_cond, &websrv_mutex, &tm) != 0) break;
+	}
+	WEBSRV_UNLOCK();
+}
+
+//---------------------------------------------------
+static void websrv_resp_signal(websrv_worker_t *w) {
+	(void)w;
+	WEBSRV_LOCK();
+	pthread_cond_broadcast(&websrv_resp_cond);
+	WEBSRV_UNLOCK();
+}
+
+//--------------------------------------------------------------------
+static bool websrv_task_create(void *(*task)(void *), const char *name, void *arg) {
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, task, arg) != 0) return false;
+	pthread_detach(thread);
+	return true;
+}
 
-const static char http_html_hdr[] = "HTTP/1.1 200 OK\nContent-type: text/html\n\n";
-const static char http_index_html[] = "<!DOCTYPE html>"
-                                     "<html>\n"
-                                     "<head>\n"
-                                     "  <meta name=\"viewport\" content=\"width=device-width, initial-scale=1\">\n"
-                                     "  <style type=\"text/css\">\n"
-                                     "    html, body, iframe { margin: 0; padding: 0; height: 100%; }\n"
-                                     "    iframe { display: block; width: 100%; border: none; }\n"
-                                     "  </style>\n"
-                                     "<title>HELLO ESP32</title>\n"
-                                     "</head>\n"
-                                     "<body>\n"
-                                     "<h1>Hello World, from ESP32!</h1>\n";
+#define WEBSRV_TASK_RETURN()                return NULL
+typedef void *websrv_task_ret_t;
+
+#else
+
+//---------------------------------------------------------
+static bool websrv_queue_put(int32_t sd, uint32_t wait) {
+	return (xQueueSend(websrv_queue, &sd, wait / portTICK_PERIOD_MS) == pdTRUE);
+}
+
+//---------------------------------------------------------
+static bool websrv_queue_get(int32_t *sd, uint32_t wait) {
+	return (xQueueReceive(websrv_queue, sd, wait / portTICK_PERIOD_MS) == pdTRUE);
+}
+
+//--------------------------------------
+static int websrv_queue_pending(void) {
+	return uxQueueMessagesWaiting(websrv_queue);
+}
+
+//-------------------------------------------------------------
+static void websrv_resp_wait(websrv_worker_t *w, uint32_t wait) {
+	xSemaphoreTake(w->resp_sem, wait / portTICK_PERIOD_MS);
+}
+
+//---------------------------------------------------
+static void websrv_resp_signal(websrv_worker_t *w) {
+	xSemaphoreGive(w->resp_sem);
+}
+
+//---------------------------------------------------------------------------------------
+static bool websrv_task_create(void (*task)(void *), const char *name, void *arg) {
+	#if CONFIG_MICROPY_USE_BOTH_CORES
+	return (xTaskCreate(task, name, WEBSRV_STACK_SIZE, arg, CONFIG_MICROPY_TASK_PRIORITY, NULL) == pdPASS);
+	#else
+	return (xTaskCreatePinnedToCore(task, name, WEBSRV_STACK_SIZE, arg, CONFIG_MICROPY_TASK_PRIORITY, NULL, MainTaskCore) == pdPASS);
+	#endif
+}
+
+#define WEBSRV_TASK_RETURN()                vTaskDelete(NULL)
+typedef void websrv_task_ret_t;
+
+#endif
+
+//--------------------------------------
+static void websrv_task_exit(void) {
+	WEBSRV_LOCK();
+	websrv_tasks--;
+	WEBSRV_UNLOCK();
+}
+
+// ==== Socket functions ====================================================
+
+// Wait max 'wait' ms until the socket is readable
+//----------------------------------------------------
+static bool websrv_wait_readable(int32_t sd, uint32_t wait) {
+	fd_set rfds;
+	struct timeval tv;
+	FD_ZERO(&rfds);
+	FD_SET(sd, &rfds);
+	tv.tv_sec = wait / 1000;
+	tv.tv_usec = (wait % 1000) * 1000;
+	return (select(sd + 1, &rfds, NULL, NULL, &tv) > 0);
+}
+
+//--------------------------------------------------------------------------
+static bool websrv_send_all(int32_t sd, const void *data, uint32_t size) {
+	const uint8_t *p = (const uint8_t *)data;
+	while (size > 0) {
+		int32_t sent = send(sd, p, size, WEBSRV_SEND_FLAGS);
+		if (sent <= 0) {
+			if ((sent < 0) && (errno == EINTR)) continue;
+			return false;
+		}
+		p += sent;
+		size -= sent;
+	}
+	WEBSRV_LOCK();
+	websrv_stats.bytes_tx += (p - (const uint8_t *)data);
+	WEBSRV_UNLOCK();
+	return true;
+}
+
+//-------------------------------------------------
+static void websrv_set_timeouts(int32_t sd) {
+	struct timeval tv;
+	tv.tv_sec = WEBSRV_SOCK_TIMEOUT_MS / 1000;
+	tv.tv_usec = (WEBSRV_SOCK_TIMEOUT_MS % 1000) * 1000;
+	setsockopt(sd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(sd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+	int option = 1;
+	setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, &option, sizeof(option));
+}
+
+//--------------------------------------------------------
+static int32_t websrv_create_listening_socket(uint16_t port) {
+	struct sockaddr_in addr;
+	int32_t sd = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+	if (sd < 0) return -1;
+
+	int option = 1;
+	setsockopt(sd, SOL_SOCKET, SO_REUSEADDR, &option, sizeof(option));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = INADDR_ANY;
+	addr.sin_port = htons(port);
+	if ((bind(sd, (const struct sockaddr *)&addr, sizeof(addr)) != 0) || (listen(sd, WEBSRV_QUEUE_LEN) != 0)) {
+		closesocket(sd);
+		return -1;
+	}
+	return sd;
+}
+
+// ==== Response functions ==================================================
+
+//--------------------------------------------------
+static const char *websrv_status_text(int status) {
+	switch (status) {
+		case 200: return "OK";
+		case 201: return "Created";
+		case 204: return "No Content";
+		case 301: return "Moved Permanently";
+		case 302: return "Found";
+		case 304: return "Not Modified";
+		case 400: return "Bad Request";
+		case 401: return "Unauthorized";
+		case 403: return "Forbidden";
+		case 404: return "Not Found";
+		case 405: return "Method Not Allowed";
+		case 413: return "Payload Too Large";
+		case 431: return "Request Header Fields Too Large";
+		case 500: return "Internal Server Error";
+		case 503: return "Service Unavailable";
+		case 504: return "Gateway Timeout";
+		default:  return (status < 400) ? "OK" : "Error";
+	}
+}
+
+//-----------------------------------------------------
+static const char *websrv_mime_type(const char *path) {
+	const char *ext = strrchr(path, '.');
+	const websrv_mime_t *mime = websrv_mime_table;
+	if ((ext) && (strchr(ext, '/') == NULL)) {
+		ext++;
+		while (mime->ext) {
+			if (strcasecmp(ext, mime->ext) == 0) break;
+			mime++;
+		}
+	}
+	else {
+		while (mime->ext) mime++;
+	}
+	return mime->type;
+}
+
+// Format the response header into 'buf', 'extra' are additional header lines
+//-------------------------------------------------------------------------------------------------------------
+static int websrv_header(char *buf, uint32_t size, websrv_request_t *r, int status, const char *ctype, int32_t len, const char *extra) {
+	int hlen = snprintf(buf, size, "HTTP/1.1 %d %s\r\n", status, websrv_status_text(status));
+	if (ctype) hlen += snprintf(buf + hlen, size - hlen, "Content-Type: %s\r\n", ctype);
+	if (len >= 0) hlen += snprintf(buf + hlen, size - hlen, "Content-Length: %d\r\n", len);
+	if (extra) hlen += snprintf(buf + hlen, size - hlen, "%s", extra);
+	hlen += snprintf(buf + hlen, size - hlen, "Connection: %s\r\n\r\n", (r->keep_alive) ? "keep-alive" : "close");
+	if (hlen >= (int)size) hlen = size - 1;
+
+	WEBSRV_LOCK();
+	if (status >= 400) websrv_stats.errors++;
+	WEBSRV_UNLOCK();
+	return hlen;
+}
+
+//----------------------------------------------------------------------------------
+static bool websrv_send_status(websrv_worker_t *w, websrv_request_t *r, int status) {
+	char body[48];
+	int blen = snprintf(body, sizeof(body), "%d %s\n", status, websrv_status_text(status));
+	int hlen = websrv_header((char *)w->buf, WEBSRV_BUFFER_SIZE, r, status, "text/plain", blen, NULL);
+	if (!r->head) {
+		memcpy(w->buf + hlen, body, blen);
+		hlen += blen;
+	}
+	return websrv_send_all(w->sd, w->buf, hlen);
+}
+
+// ==== Request functions ===================================================
+
+// Decode %xx escapes in place, returns false on invalid path
+//----------------------------------------
+static bool websrv_url_decode(char *path) {
+	char *src = path;
+	char *dst = path;
+	while (*src) {
+		if ((src[0] == '%') && isxdigit((int)src[1]) && isxdigit((int)src[2])) {
+			char hex[3] = { src[1], src[2], '\0' };
+			*dst = (char)strtol(hex, NULL, 16);
+			if (*dst == '\0') return false;
+			src += 3;
+		}
+		else *dst = *src++;
+		dst++;
+	}
+	*dst = '\0';
+	return ((path[0] == '/') && (strstr(path, "..") == NULL) && (strchr(path, '\\') == NULL));
+}
 
+/*
+ * Parse the Content-Length value, only decimal digits are accepted
+ * Values larger than the request buffer are saturated to WEBSRV_REQ_SIZE + 1
+ */
+//-----------------------------------------------------------------
+static bool websrv_parse_length(const char *val, uint32_t *len) {
+	uint32_t n = 0;
+	if (!isdigit((int)*val)) return false;
+	while (isdigit((int)*val)) {
+		n = n * 10 + (*val++ - '0');
+		if (n > WEBSRV_REQ_SIZE) n = WEBSRV_REQ_SIZE + 1;
+	}
+	while ((*val == ' ') || (*val == '\t')) val++;
+	if (*val != '\0') return false;
+	*len = n;
+	return true;
+}
 
 //-----------------------------------------------------------
-static void http_server_netconn_serve(struct netconn *conn) {
-
-    struct netbuf *inbuf;
-    char *buf;
-    u16_t buflen;
-    err_t err;
-
-    err = netconn_recv(conn, &inbuf);
-
-    if (err == ERR_OK) {
-
-        netbuf_data(inbuf, (void**)&buf, &buflen);
-
-        // extract the first line, with the request
-        char *first_line = strtok(buf, "\n");
-
-        if (first_line) {
-            // default page
-            if (strstr(first_line, "GET / ")) {
-                netconn_write(conn, http_html_hdr, sizeof(http_html_hdr) - 1, NETCONN_NOCOPY);
-                netconn_write(conn, http_index_html, sizeof(http_index_html) - 1, NETCONN_NOCOPY);
-                netconn_write(conn, "</body>\n</html>\n", 16, NETCONN_NOCOPY);
-                ESP_LOGI(WEBSRV_TAG, "Got request from client");
-            }
-            else {
-                ESP_LOGW(WEBSRV_TAG, "Unknown request type [%s]", first_line);
-            }
-        }
-        else {
-            ESP_LOGE(WEBSRV_TAG, "Unknown request");
-        }
-    }
-
-    // close the connection and free the buffer
-    netconn_close(conn);
-    netbuf_delete(inbuf);
-}
-
-
-//========================================
-void web_server_task(void *pvParameters) {
-
-	struct netconn *conn, *newconn;
-	err_t err;
-	conn = netconn_new(NETCONN_TCP);
-	netconn_bind(conn, NULL, 80);
-	netconn_listen(conn);
-    ESP_LOGD(WEBSRV_TAG, "HTTP Server listening...");
-	do {
-		err = netconn_accept(conn, &newconn);
-	    ESP_LOGD(WEBSRV_TAG, "New client connected");
-		if (err == ERR_OK) {
-			http_server_netconn_serve(newconn);
-			netconn_delete(newconn);
-		}
-	} while(err == ERR_OK);
-	netconn_close(conn);
-	netconn_delete(conn);
-    ESP_LOGE(WEBSRV_TAG, "Netconn accept error, task halted!");
+static int websrv_find_header_end(const char *buf, uint32_t len) {
+	for (uint32_t i=0; (i+3)<len; i++) {
+		if ((buf[i] == '\r') && (buf[i+1] == '\n') && (buf[i+2] == '\r') && (buf[i+3] == '\n')) return i + 4;
+	}
+	return -1;
+}
+
+/*
+ * Receive and parse the next request on the connection
+ * Returns the number of request bytes consumed, 0 if the connection is to be closed,
+ * or -1 if an error response was sent
+ */
+//-----------------------------------------------------------------------------
+static int websrv_read_request(websrv_worker_t *w, websrv_request_t *r, bool first) {
+	uint32_t waited = 0;
+	int hdr_len;
+
+	memset(r, 0, sizeof(websrv_request_t));
+	r->keep_alive = true;
+
+	while ((hdr_len = websrv_find_header_end(w->req, w->req_len)) < 0) {
+		if (w->req_len >= WEBSRV_REQ_SIZE) {
+			r->keep_alive = false;
+			websrv_send_status(w, r, 431);
+			return -1;
+		}
+		if (!websrv_wait_readable(w->sd, WEBSRV_POLL_MS)) {
+			if (websrv_stop_req) return 0;
+			waited += WEBSRV_POLL_MS;
+			if (w->req_len == 0) {
+				// idle keep-alive connection, close it when other clients are waiting
+				if ((!first) && ((waited >= websrv_config.keepalive_ms) || (websrv_queue_pending() > 0))) return 0;
+			}
+			if (waited >= WEBSRV_REQ_TIMEOUT_MS) return 0;
+			continue;
+		}
+		int32_t n = recv(w->sd, w->req + w->req_len, WEBSRV_REQ_SIZE - w->req_len, 0);
+		if (n <= 0) return 0;
+		w->req_len += n;
+	}
+
+	// request line
+	w->req[hdr_len - 1] = '\0';
+	char *line = w->req;
+	char *next = strstr(line, "\r\n");
+	*next = '\0';
+	next += 2;
+
+	r->method = line;
+	char *sp = strchr(line, ' ');
+	if (sp == NULL) {
+		r->keep_alive = false;
+		websrv_send_status(w, r, 400);
+		return -1;
+	}
+	*sp++ = '\0';
+	r->path = sp;
+	sp = strchr(sp, ' ');
+	if (sp) {
+		*sp++ = '\0';
+		if (strcmp(sp, "HTTP/1.0") == 0) r->keep_alive = false;
+	}
+	r->query = strchr(r->path, '?');
+	if (r->query) *r->query++ = '\0';
+	else r->query = "";
+	r->head = (strcmp(r->method, "HEAD") == 0);
+
+	// header lines
+	uint32_t content_len = 0;
+	bool bad_len = false;
+	line = next;
+	while ((line) && (*line)) {
+		next = strstr(line, "\r\n");
+		if (next) {
+			*next = '\0';
+			next += 2;
+		}
+		char *val = strchr(line, ':');
+		if (val) {
+			*val++ = '\0';
+			while (*val == ' ') val++;
+			if (strcasecmp(line, "Connection") == 0) {
+				if (strcasecmp(val, "close") == 0) r->keep_alive = false;
+				else if (strcasecmp(val, "keep-alive") == 0) r->keep_alive = true;
+			}
+			else if (strcasecmp(line, "If-None-Match") == 0) r->if_none_match = val;
+			else if (strcasecmp(line, "Accept-Encoding") == 0) r->gzip = (strstr(val, "gzip") != NULL);
+			else if (strcasecmp(line, "Content-Length") == 0) {
+				if (!websrv_parse_length(val, &content_len)) bad_len = true;
+			}
+		}
+		line = next;
+	}
+
+	if (bad_len) {
+		r->keep_alive = false;
+		websrv_send_status(w, r, 400);
+		return -1;
+	}
+	// request body, must fit into the request buffer (hdr_len <= WEBSRV_REQ_SIZE)
+	if (content_len > 0) {
+		if (content_len > (WEBSRV_REQ_SIZE - (uint32_t)hdr_len)) {
+			r->keep_alive = false;
+			websrv_send_status(w, r, 413);
+			return -1;
+		}
+		waited = 0;
+		while (w->req_len < (hdr_len + content_len)) {
+			if (!websrv_wait_readable(w->sd, WEBSRV_POLL_MS)) {
+				waited += WEBSRV_POLL_MS;
+				if ((websrv_stop_req) || (waited >= WEBSRV_REQ_TIMEOUT_MS)) return 0;
+				continue;
+			}
+			int32_t n = recv(w->sd, w->req + w->req_len, (hdr_len + content_len) - w->req_len, 0);
+			if (n <= 0) return 0;
+			w->req_len += n;
+		}
+		r->body = w->req + hdr_len;
+		r->body_len = content_len;
+	}
+
+	if (!websrv_url_decode(r->path)) {
+		r->keep_alive = false;
+		websrv_send_status(w, r, 400);
+		return -1;
+	}
+	WEBSRV_LOCK();
+	websrv_stats.requests++;
+	WEBSRV_UNLOCK();
+	return hdr_len + content_len;
+}
+
+// ==== Static files ========================================================
+
+/*
+ * Send the file from the document root
+ * Returns false if the file does not exist (nothing was sent)
+ */
+//-----------------------------------------------------------------------------
+static bool websrv_serve_file(websrv_worker_t *w, websrv_request_t *r) {
+	char fpath[WEBSRV_PATH_MAX + 4];
+	char extra[128];
+	struct stat st;
+	bool gzip = false;
+
+	int plen = snprintf(fpath, WEBSRV_PATH_MAX, "%s%s", websrv_config.root, r->path);
+	if (plen >= WEBSRV_PATH_MAX - 11) return false;
+	if (fpath[plen-1] == '/') {
+		strcat(fpath, "index.html");
+		plen += 10;
+	}
+	if (stat(fpath, &st) != 0) {
+		if (!r->gzip) return false;
+	}
+	else if (S_ISDIR(st.st_mode)) {
+		// redirect to the directory index
+		snprintf(extra, sizeof(extra), "Location: %s/\r\n", r->path);
+		int hlen = websrv_header((char *)w->buf, WEBSRV_BUFFER_SIZE, r, 301, NULL, 0, extra);
+		websrv_send_all(w->sd, w->buf, hlen);
+		return true;
+	}
+	const char *ctype = websrv_mime_type(fpath);
+
+	// use the pre-compressed file if the client accepts it
+	if (r->gzip) {
+		struct stat gst;
+		strcpy(fpath + plen, ".gz");
+		if (stat(fpath, &gst) == 0) {
+			st = gst;
+			gzip = true;
+		}
+		else {
+			fpath[plen] = '\0';
+			if (stat(fpath, &st) != 0) return false;
+		}
+	}
+
+	char etag[32];
+	snprintf(etag, sizeof(etag), "\"%lx-%lx%s\"", (unsigned long)st.st_size, (unsigned long)st.st_mtime, (gzip) ? "-gz" : "");
+	int elen = snprintf(extra, sizeof(extra), "ETag: %s\r\n", etag);
+	if (websrv_config.max_age > 0) elen += snprintf(extra + elen, sizeof(extra) - elen, "Cache-Control: max-age=%u\r\n", websrv_config.max_age);
+	else elen += snprintf(extra + elen, sizeof(extra) - elen, "Cache-Control: no-cache\r\n");
+	if (gzip) elen += snprintf(extra + elen, sizeof(extra) - elen, "Content-Encoding: gzip\r\nVary: Accept-Encoding\r\n");
+
+	if ((r->if_none_match) && ((strstr(r->if_none_match, etag) != NULL) || (strcmp(r->if_none_match, "*") == 0))) {
+		// the client has the current version
+		int hlen = websrv_header((char *)w->buf, WEBSRV_BUFFER_SIZE, r, 304, NULL, -1, extra);
+		websrv_send_all(w->sd, w->buf, hlen);
+		WEBSRV_LOCK();
+		websrv_stats.not_modified++;
+		WEBSRV_UNLOCK();
+		return true;
+	}
+
+	FILE *fp = fopen(fpath, "rb");
+	if (fp == NULL) {
+		websrv_send_status(w, r, 500);
+		return true;
+	}
+
+	// the first block of the file is sent together with the header
+	uint32_t remaining = st.st_size;
+	uint32_t len = websrv_header((char *)w->buf, WEBSRV_BUFFER_SIZE, r, 200, ctype, remaining, extra);
+	while (!r->head) {
+		uint32_t n = fread(w->buf + len, 1, WEBSRV_BUFFER_SIZE - len, fp);
+		if (n > remaining) n = remaining;
+		remaining -= n;
+		len += n;
+		if ((n == 0) && (remaining > 0)) {
+			// file changed while sending, the length sent does not match
+			r->keep_alive = false;
+			break;
+		}
+		if (remaining == 0) break;
+		if (!websrv_send_all(w->sd, w->buf, len)) {
+			r->keep_alive = false;
+			len = 0;
+			break;
+		}
+		len = 0;
+	}
+	if (len > 0) {
+		if (!websrv_send_all(w->sd, w->buf, len)) r->keep_alive = false;
+	}
+	fclose(fp);
+
+	WEBSRV_LOCK();
+	websrv_stats.files++;
+	if (gzip) websrv_stats.gzip++;
+	WEBSRV_UNLOCK();
+	return true;
+}
+
+// ==== Dynamic routes ======================================================
+
+//---------------------------------------------------
+static bool websrv_is_route(const char *path) {
+	for (int i=0; i<websrv_config.n_routes; i++) {
+		if (strncmp(path, websrv_config.routes[i], strlen(websrv_config.routes[i])) == 0) return true;
+	}
+	return false;
 }
 
+//------------------------------------------------------------------------------
+static void websrv_dynamic(websrv_worker_t *w, websrv_request_t *r) {
+	#ifdef WEBSRV_HOST_BUILD
+	if (websrv_host_callback == NULL) {
+	#else
+	mp_obj_t callback = MP_STATE_PORT(websrv_callback);
+	if ((callback == MP_OBJ_NULL) || (callback == mp_const_none)) {
+	#endif
+		websrv_send_status(w, r, 404);
+		return;
+	}
+
+	WEBSRV_LOCK();
+	w->seq++;
+	if (w->seq == 0) w->seq = 1;
+	uint32_t id = ((w->idx + 1) << 16) | w->seq;
+	w->resp_id = id;
+	w->resp_ready = false;
+	websrv_stats.dynamic++;
+	WEBSRV_UNLOCK();
+
+	bool sched = false;
+	#ifdef WEBSRV_HOST_BUILD
+	sched = websrv_host_callback(id, r->method, r->path, r->query, (const uint8_t *)((r->body) ? r->body : ""), r->body_len);
+	#else
+	xSemaphoreTake(w->resp_sem, 0);
+
+	// callback argument: (id, method, path, query, body)
+	// body_len is limited by WEBSRV_REQ_SIZE, so it fits make_carg_entry's int
+	mp_sched_carg_t *carg = make_cargs(MP_SCHED_CTYPE_TUPLE);
+	if (carg) carg = make_carg_entry(carg, 0, MP_SCHED_ENTRY_TYPE_INT, id, NULL, NULL);
+	if (carg) carg = make_carg_entry(carg, 1, MP_SCHED_ENTRY_TYPE_STR, strlen(r->method), (const uint8_t *)r->method, NULL);
+	if (carg) carg = make_carg_entry(carg, 2, MP_SCHED_ENTRY_TYPE_STR, strlen(r->path), (const uint8_t *)r->path, NULL);
+	if (carg) carg = make_carg_entry(carg, 3, MP_SCHED_ENTRY_TYPE_STR, strlen(r->query), (const uint8_t *)r->query, NULL);
+	if (carg) carg = make_carg_entry(carg, 4, MP_SCHED_ENTRY_TYPE_BYTES, r->body_len, (const uint8_t *)((r->body) ? r->body : ""), NULL);
+	if (carg) sched = mp_sched_schedule_src(callback, mp_const_none, carg, MP_SCHED_SRC_NET);
+	#endif
+
+	bool ready = false;
+	if (sched) websrv_resp_wait(w, WEBSRV_DYNAMIC_TIMEOUT_MS);
+
+	WEBSRV_LOCK();
+	ready = w->resp_ready;
+	w->resp_id = 0;
+	w->resp_ready = false;
+	uint8_t *body = w->resp_body;
+	w->resp_body = NULL;
+	WEBSRV_UNLOCK();
+
+	if (!sched) websrv_send_status(w, r, 503);
+	else if (!ready) websrv_send_status(w, r, 504);
+	else {
+		int hlen = websrv_header((char *)w->buf, WEBSRV_BUFFER_SIZE, r, w->resp_status, w->resp_ctype, w->resp_len, "Cache-Control: no-cache\r\n");
+		bool res = websrv_send_all(w->sd, w->buf, hlen);
+		if ((res) && (!r->head) && (w->resp_len > 0)) res = websrv_send_all(w->sd, body, w->resp_len);
+		if (!res) r->keep_alive = false;
+	}
+	if (body) free(body);
+}
+
+// ==== Worker and accept tasks =============================================
+
+//--------------------------------------------------------------------------
+static void websrv_handle_request(websrv_worker_t *w, websrv_request_t *r) {
+	bool get = ((strcmp(r->method, "GET") == 0) || (r->head));
+
+	if (!get) {
+		if ((websrv_config.n_routes > 0) || (websrv_config.fallback)) websrv_dynamic(w, r);
+		else websrv_send_status(w, r, 405);
+	}
+	else if (websrv_is_route(r->path)) websrv_dynamic(w, r);
+	else if (!websrv_serve_file(w, r)) {
+		if (websrv_config.fallback) websrv_dynamic(w, r);
+		else websrv_send_status(w, r, 404);
+	}
+}
+
+//--------------------------------------------------
+static void websrv_serve_connection(websrv_worker_t *w) {
+	websrv_request_t req;
+
+	w->req_len = 0;
+	for (int n=0; n<WEBSRV_MAX_REQUESTS; n++) {
+		int consumed = websrv_read_request(w, &req, (n == 0));
+		if (consumed <= 0) break;
+
+		// close the connection after this response if other clients are waiting
+		if ((n == (WEBSRV_MAX_REQUESTS-1)) || (websrv_queue_pending() > 0) || (websrv_stop_req)) req.keep_alive = false;
+
+		websrv_handle_request(w, &req);
+		if (!req.keep_alive) break;
+
+		// keep the pipelined data
+		w->req_len -= consumed;
+		if (w->req_len > 0) memmove(w->req, w->req + consumed, w->req_len);
+	}
+}
+
+//-----------------------------------------------------
+static websrv_task_ret_t websrv_worker_task(void *arg) {
+	websrv_worker_t *w = (websrv_worker_t *)arg;
+	int32_t sd;
+
+	while (!websrv_stop_req) {
+		if (!websrv_queue_get(&sd, WEBSRV_POLL_MS * 5)) continue;
+		if (sd < 0) break;
+
+		WEBSRV_LOCK();
+		websrv_stats.busy++;
+		WEBSRV_UNLOCK();
+
+		w->sd = sd;
+		websrv_serve_connection(w);
+		shutdown(sd, SHUT_RDWR);
+		closesocket(sd);
+		w->sd = -1;
+
+		WEBSRV_LOCK();
+		websrv_stats.busy--;
+		WEBSRV_UNLOCK();
+	}
+	websrv_task_exit();
+	WEBSRV_TASK_RETURN();
+}
+
+//-----------------------------------------------------
+static websrv_task_ret_t websrv_accept_task(void *arg) {
+	int32_t lsd = (int32_t)(intptr_t)arg;
+	struct sockaddr_in addr;
+	socklen_t addr_len;
+
+	ESP_LOGI(WEBSRV_TAG, "HTTP Server listening on port %u", websrv_config.port);
+	while (!websrv_stop_req) {
+		if (!websrv_wait_readable(lsd, WEBSRV_POLL_MS * 5)) continue;
+		addr_len = sizeof(addr);
+		int32_t sd = accept(lsd, (struct sockaddr *)&addr, &addr_len);
+		if (sd < 0) continue;
+
+		websrv_set_timeouts(sd);
+		// idle keep-alive connections are closed when clients are waiting, so the queue drains quickly
+		if (!websrv_queue_put(sd, WEBSRV_REQ_TIMEOUT_MS)) {
+			// all workers busy and the queue is full
+			static const char busy[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+			send(sd, busy, sizeof(busy) - 1, WEBSRV_SEND_FLAGS);
+			closesocket(sd);
+			WEBSRV_LOCK();
+			websrv_stats.errors++;
+			WEBSRV_UNLOCK();
+			continue;
+		}
+		WEBSRV_LOCK();
+		websrv_stats.connections++;
+		WEBSRV_UNLOCK();
+	}
+	closesocket(lsd);
+
+	// close the waiting connections and stop the workers
+	int32_t sd;
+	while (websrv_queue_get(&sd, 0)) {
+		if (sd >= 0) closesocket(sd);
+	}
+	for (int i=0; i<WEBSRV_WORKERS; i++) websrv_queue_put(-1, WEBSRV_REQ_TIMEOUT_MS);
+
+	ESP_LOGI(WEBSRV_TAG, "HTTP Server stopped");
+	websrv_task_exit();
+	WEBSRV_TASK_RETURN();
+}
+
+// ==== PUBLIC FUNCTIONS ====================================================
+
+//-------------------------------------------------------
+static void websrv_free_workers(void) {
+	for (int i=0; i<WEBSRV_WORKERS; i++) {
+		websrv_worker_t *w = &websrv_workers[i];
+		if (w->req) free(w->req);
+		if (w->buf) free(w->buf);
+		if (w->resp_body) free(w->resp_body);
+		w->req = NULL;
+		w->buf = NULL;
+		w->resp_body = NULL;
+	}
+}
+
+//-------------------------------------------------------
+bool websrv_start(const websrv_config_t *config) {
+	if (websrv_tasks > 0) return false;
+
+	#ifndef WEBSRV_HOST_BUILD
+	if (websrv_mutex == NULL) websrv_mutex = xSemaphoreCreateMutex();
+	if (websrv_queue == NULL) websrv_queue = xQueueCreate(WEBSRV_QUEUE_LEN, sizeof(int32_t));
+	if ((websrv_mutex == NULL) || (websrv_queue == NULL)) return false;
+	xQueueReset(websrv_queue);
+	#else
+	websrv_queue_head = 0;
+	websrv_queue_count = 0;
+	#endif
+
+	websrv_config = *config;
+	if (websrv_config.keepalive_ms == 0) websrv_config.keepalive_ms = WEBSRV_POLL_MS;
+	websrv_free_workers();
+	for (int i=0; i<WEBSRV_WORKERS; i++) {
+		websrv_worker_t *w = &websrv_workers[i];
+		w->idx = i;
+		w->sd = -1;
+		w->resp_id = 0;
+		w->resp_ready = false;
+		w->req = malloc(WEBSRV_REQ_SIZE + 1);
+		w->buf = malloc(WEBSRV_BUFFER_SIZE);
+		#ifndef WEBSRV_HOST_BUILD
+		if (w->resp_sem == NULL) w->resp_sem = xSemaphoreCreateBinary();
+		if (w->resp_sem == NULL) {
+			websrv_free_workers();
+			return false;
+		}
+		#endif
+		if ((w->req == NULL) || (w->buf == NULL)) {
+			ESP_LOGE(WEBSRV_TAG, "Error allocating buffers");
+			websrv_free_workers();
+			return false;
+		}
+	}
+
+	int32_t lsd = websrv_create_listening_socket(websrv_config.port);
+	if (lsd < 0) {
+		ESP_LOGE(WEBSRV_TAG, "Error creating listening socket");
+		websrv_free_workers();
+		return false;
+	}
+
+	websrv_stop_req = false;
+	memset(&websrv_stats, 0, sizeof(websrv_stats_t));
+	websrv_stats.workers = WEBSRV_WORKERS;
+	websrv_tasks = WEBSRV_WORKERS + 1;
+	for (int i=0; i<WEBSRV_WORKERS; i++) {
+		if (!websrv_task_create(websrv_worker_task, "WebSrvWorker", &websrv_workers[i])) websrv_task_exit();
+	}
+	if (!websrv_task_create(websrv_accept_task, "WebSrv", (void *)(intptr_t)lsd)) {
+		websrv_stop_req = true;
+		closesocket(lsd);
+		websrv_task_exit();
+		return false;
+	}
+	return true;
+}
+
+// Stop the server, wait until all tasks are finished
+//--------------------
+bool websrv_stop(void) {
+	if (websrv_tasks == 0) return false;
+	websrv_stop_req = true;
+	for (int i=0; i<((WEBSRV_REQ_TIMEOUT_MS * 2) / WEBSRV_POLL_MS); i++) {
+		if (websrv_tasks == 0) break;
+		#ifdef WEBSRV_HOST_BUILD
+		usleep(WEBSRV_POLL_MS * 1000);
+		#else
+		vTaskDelay(WEBSRV_POLL_MS / portTICK_PERIOD_MS);
+		#endif
+	}
+	if (websrv_tasks > 0) return false;
+	websrv_free_workers();
+	return true;
+}
+
+//-----------------------
+bool websrv_running(void) {
+	return (websrv_tasks > 0);
+}
+
+// Response of the Python callback to the request 'id'
+//---------------------------------------------------------------------------------------------
+bool websrv_respond(uint32_t id, int status, const char *ctype, const uint8_t *body, size_t len) {
+	int idx = (int)(id >> 16) - 1;
+	if ((websrv_tasks == 0) || (idx < 0) || (idx >= WEBSRV_WORKERS)) return false;
+	websrv_worker_t *w = &websrv_workers[idx];
+
+	uint8_t *copy = NULL;
+	if (len > 0) {
+		copy = malloc(len);
+		if (copy == NULL) return false;
+		memcpy(copy, body, len);
+	}
+
+	WEBSRV_LOCK();
+	bool res = ((w->resp_id == id) && (!w->resp_ready));
+	if (res) {
+		w->resp_status = status;
+		snprintf(w->resp_ctype, sizeof(w->resp_ctype), "%s", (ctype) ? ctype : "text/html");
+		w->resp_body = copy;
+		w->resp_len = len;
+		w->resp_ready = true;
+	}
+	WEBSRV_UNLOCK();
+
+	if (!res) {
+		// no request waiting for this response (timed out)
+		if (copy) free(copy);
+		return false;
+	}
+	websrv_resp_signal(w);
+	return true;
+}
+
+//----------------------------------------------------------
+bool websrv_get_stats(websrv_stats_t *stats, bool reset) {
+	if (websrv_tasks == 0) return false;
+	WEBSRV_LOCK();
+	*stats = websrv_stats;
+	if (reset) {
+		uint8_t busy = websrv_stats.busy;
+		memset(&websrv_stats, 0, sizeof(websrv_stats_t));
+		websrv_stats.workers = WEBSRV_WORKERS;
+		websrv_stats.busy = busy;
+	}
+	WEBSRV_UNLOCK();
+	return true;
+}
 
 #endif
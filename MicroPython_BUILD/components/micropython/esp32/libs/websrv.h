@@ -27,13 +27,74 @@
 #ifndef WEBSRV_H_
 #define WEBSRV_H_
 
+#ifdef WEBSRV_HOST_BUILD
+/*
+ * The server (websrv.c) can be built on a POSIX host for tests and benchmarking with wrk, ab etc.:
+ *   make -C tools/host websrv-test
+ * builds it with tools/host/websrv/websrv_host.c, which fills websrv_config_t (root is
+ * a host directory), sets websrv_host_callback and calls websrv_start().
+ * websrv_host_callback takes the place of scheduling the Python callback: it gets the
+ * request id and returns false if the request can not be handled (503), the response
+ * is then given with websrv_respond() from any thread. Without it dynamic routes get 404.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define CONFIG_MICROPY_USE_WEBSERVER	1
+#else
 #include "sdkconfig.h"
+#endif
 
 #ifdef CONFIG_MICROPY_USE_WEBSERVER
 
+#ifndef CONFIG_MICROPY_WEBSERVER_WORKERS
+#define CONFIG_MICROPY_WEBSERVER_WORKERS		2
+#endif
+#ifndef CONFIG_MICROPY_WEBSERVER_BUFFER_SIZE
+#define CONFIG_MICROPY_WEBSERVER_BUFFER_SIZE	2048
+#endif
+
+#define WEBSRV_MAX_ROUTES			8
+#define WEBSRV_ROUTE_LEN_MAX		32
+#define WEBSRV_ROOT_LEN_MAX			64
+
+typedef struct {
+    char        root[WEBSRV_ROOT_LEN_MAX];      // document root, physical path
+    char        routes[WEBSRV_MAX_ROUTES][WEBSRV_ROUTE_LEN_MAX]; // path prefixes handled by the callback
+    uint8_t     n_routes;
+    bool        fallback;       // requests not matching a file are handled by the callback
+    uint16_t    port;
+    uint32_t    max_age;        // Cache-Control max-age (seconds), 0: always revalidate
+    uint32_t    keepalive_ms;   // idle keep-alive connection timeout
+} websrv_config_t;
+
+typedef struct {
+    uint32_t    connections;
+    uint32_t    requests;
+    uint32_t    files;          // static files sent
+    uint32_t    not_modified;   // 304 responses
+    uint32_t    gzip;           // pre-gzipped files sent
+    uint32_t    dynamic;        // requests handed to the callback
+    uint32_t    errors;         // 4xx and 5xx responses
+    uint32_t    bytes_tx;
+    uint8_t     workers;
+    uint8_t     busy;           // workers serving a connection
+} websrv_stats_t;
 
-void web_server_task(void *pvParameters);
+extern const char *WEBSRV_TAG;
+
+bool websrv_start(const websrv_config_t *config);
+bool websrv_stop(void);
+bool websrv_running(void);
+bool websrv_respond(uint32_t id, int status, const char *ctype, const uint8_t *body, size_t len);
+bool websrv_get_stats(websrv_stats_t *stats, bool reset);
+
+#ifdef WEBSRV_HOST_BUILD
+typedef bool (*websrv_host_callback_t)(uint32_t id, const char *method, const char *path, const char *query, const uint8_t *body, uint32_t len);
+extern websrv_host_callback_t websrv_host_callback;
+#endif
 
 #endif
 
-#endif /* FTP_H_ */
+#endif /* WEBSRV_H_ */
@@ -167,7 +167,7 @@ static void _sched_callback(mp_obj_t function, int8_t client, int type, int iarg
     if (param) {
         if (!make_carg_entry(carg, 3, MP_SCHED_ENTRY_TYPE_STR, strlen(param), (uint8_t *)param, NULL)) return;
     }
-    mp_sched_schedule(function, mp_const_none, carg);
+    mp_sched_schedule_src(function, mp_const_none, carg, MP_SCHED_SRC_BT);
 }
 
 //----------------------------------------------------------------------
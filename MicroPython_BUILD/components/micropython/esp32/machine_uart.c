@@ -29,6 +29,10 @@
 #include <stdint.h>
 #include <string.h>
 
+#ifdef UART_HOST_BUILD
+// only the ring buffer functions, see machine_uart.h
+#include "machine_uart.h"
+#else
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
@@ -37,6 +41,7 @@
 #include "py/mperrno.h"
 #include "py/mphal.h"
 #include "modmachine.h"
+#include "extmod/moduselect.h"
 #include "sdkconfig.h"
 
 
@@ -50,67 +55,134 @@ static TaskHandle_t task_id[2] = {NULL};
 
 static uart_ringbuf_t uart_buffer[2];
 static uart_ringbuf_t *uart_buf[2] = {NULL};
+#if MICROPY_PY_USELECT_NOTIFY
+static mp_poll_notify_t *uart_poll_notify[2] = {NULL};
+#endif
 
+// Ring buffer size is rounded up to the power of 2
 //-----------------------------------------------------------
-static void uart_ringbuf_alloc(uint8_t uart_num, uint16_t sz)
+static void uart_ringbuf_alloc(uint8_t uart_num, uint32_t sz)
 {
-	uart_buffer[uart_num].buf = malloc(sz);
-	uart_buffer[uart_num].size = sz;
+	uint32_t size = 16;
+	while (size < sz) size <<= 1;
+	uart_buffer[uart_num].buf = malloc(size);
+	if (uart_buffer[uart_num].buf == NULL) return;
+	uart_buffer[uart_num].size = size;
 	uart_buffer[uart_num].iget = 0;
 	uart_buffer[uart_num].iput = 0;
 	uart_buf[uart_num] = &uart_buffer[uart_num];
 }
+#endif
 
+// Get up to 'len' bytes from the ring buffer, copied in max two segments
+// Returns the number of bytes copied or -1 if the buffer is empty
 //--------------------------------------------------------------
-int uart_buf_get(uart_ringbuf_t *r, uint8_t *dest, uint16_t len)
+int uart_buf_get(uart_ringbuf_t *r, uint8_t *dest, uint32_t len)
 {
-    if (r->iget == r->iput) return -1; // input buffer empty
-
-    int res = 0;
-	for (int i=0; i<len; i++) {
-		dest[i] = r->buf[r->iget++];
-		res++;
-	    if (r->iget == r->iput) break;
-	}
-	// move the buffer and adjust the pointers
-	memmove(r->buf, r->buf+res, r->iput - res);
-	r->iget -= res;
-	r->iput -= res;
-
-    return res;
+	uint32_t iget = r->iget;
+	uint32_t count = r->iput - iget;
+    if (count == 0) return -1; // input buffer empty
+
+    if (len > count) len = count;
+    uint32_t pos = iget & (r->size - 1);
+    uint32_t seg = r->size - pos;
+    if (seg > len) seg = len;
+    memcpy(dest, r->buf + pos, seg);
+    if (len > seg) memcpy(dest + seg, r->buf, len - seg);
+    // data must be read before the space is released to the producer
+    __sync_synchronize();
+    r->iget = iget + len;
+
+    return len;
 }
 
+// Put 'len' bytes to the ring buffer, copied in max two segments
+// Returns 1 if not all bytes fit into the buffer (overflow), 0 on success
 //----------------------------------------------------------------
-int uart_buf_put(uart_ringbuf_t *r, uint8_t *source, uint16_t len)
+int uart_buf_put(uart_ringbuf_t *r, uint8_t *source, uint32_t len)
 {
 	int res = 0;
-	for (int i=0; i<len; i++) {
-	    if (r->iput >= r->size) return 1; // overflow
-	    r->buf[r->iput++] = source[i];
+	uint32_t iput = r->iput;
+	uint32_t space = r->size - (iput - r->iget);
+	if (len > space) {
+		len = space;
+		res = 1; // overflow
 	}
+    uint32_t pos = iput & (r->size - 1);
+    uint32_t seg = r->size - pos;
+    if (seg > len) seg = len;
+    memcpy(r->buf + pos, source, seg);
+    if (len > seg) memcpy(r->buf, source + seg, len - seg);
+    // data must be written before it is published to the consumer
+    __sync_synchronize();
+    r->iput = iput + len;
+
 	return res;
 }
 
+//------------------------------------
+void uart_buf_flush(uart_ringbuf_t *r)
+{
+	r->iget = r->iput;
+}
+
 //-------------------------------------------------------------------------------------
 int match_pattern(uint8_t *text, int text_length, uint8_t *pattern, int pattern_length)
 {
-	int c, d, e, position = -1;
+	if ((pattern_length <= 0) || (pattern_length > text_length)) return -1;
+
+	uint8_t *last = text + text_length - pattern_length;
+	uint8_t *p = text;
+	while (p <= last) {
+		// find the next occurrence of the first pattern character
+		p = memchr(p, pattern[0], last - p + 1);
+		if (p == NULL) break;
+		if (memcmp(p+1, pattern+1, pattern_length-1) == 0) return p - text;
+		p++;
+	}
 
-	if (pattern_length > text_length) return -1;
+	return -1;
+}
 
-	for (c = 0; c <= (text_length - pattern_length); c++) {
-		position = e = c;
-		// check pattern
-		for (d = 0; d < pattern_length; d++) {
-			if (pattern[d] == text[e]) e++;
-			else break;
+// Find the pattern in the ring buffer data
+// Returns the pattern position relative to the buffer start or -1 if not found
+//------------------------------------------------------------------------------
+int uart_buf_find(uart_ringbuf_t *r, uint8_t *pattern, int pattern_length)
+{
+	uint32_t iget = r->iget;
+	uint32_t count = r->iput - iget;
+	if ((pattern_length <= 0) || (pattern_length > count)) return -1;
+
+	uint32_t mask = r->size - 1;
+	uint32_t pos = iget & mask;
+	uint32_t seg = r->size - pos;
+	if (seg >= count) {
+		// data is not wrapped
+		return match_pattern(r->buf + pos, count, pattern, pattern_length);
+	}
+	// scan both segments for the first pattern character, compare the rest with wrap-around
+	for (uint32_t off = 0; off <= count - pattern_length; ) {
+		uint32_t start = (iget + off) & mask;
+		uint32_t n = r->size - start;
+		if (n > count - pattern_length - off + 1) n = count - pattern_length - off + 1;
+		uint8_t *p = memchr(r->buf + start, pattern[0], n);
+		if (p == NULL) {
+			off += n;
+			continue;
+		}
+		off += p - (r->buf + start);
+		int d;
+		for (d = 1; d < pattern_length; d++) {
+			if (r->buf[(iget + off + d) & mask] != pattern[d]) break;
 		}
-		if (d == pattern_length) return position;
+		if (d == pattern_length) return off;
+		off++;
 	}
 
 	return -1;
 }
 
+#ifndef UART_HOST_BUILD
 //--------------------------------------------------------------------------------------------
 static void _sched_callback(mp_obj_t function, int uart, int type, int iarglen, uint8_t *sarg)
 {
@@ -124,7 +196,7 @@ static void _sched_callback(mp_obj_t function, int uart, int type, int iarglen,
 	else {
 		if (!make_carg_entry(carg, 2, MP_SCHED_ENTRY_TYPE_INT, iarglen, NULL, NULL)) return;
 	}
-	mp_sched_schedule(function, mp_const_none, carg);
+	mp_sched_schedule_src(function, mp_const_none, carg, MP_SCHED_SRC_UART);
 }
 
 //---------------------------------------------
@@ -134,7 +206,9 @@ static void uart_event_task(void *pvParameters)
     uart_event_t event;
     size_t datasize;
     int res;
-    uint8_t* dtmp = (uint8_t*) malloc(UART_BUFF_SIZE);
+    // large enough for any callback data taken from the ring buffer
+    uint32_t dtmp_size = (uart_buf[self->uart_num]->size > UART_BUFF_SIZE) ? uart_buf[self->uart_num]->size : UART_BUFF_SIZE;
+    uint8_t* dtmp = (uint8_t*) malloc(dtmp_size);
 
     for(;;) {
     	if (self->end_task) break;
@@ -145,12 +219,12 @@ static void uart_event_task(void *pvParameters)
         //Waiting for UART event.
         if (xQueueReceive(UART_QUEUE[self->uart_num], (void * )&event, 1000 / portTICK_PERIOD_MS)) {
         	if (uart_mutex) xSemaphoreTake(uart_mutex, 200 / portTICK_PERIOD_MS);
-            bzero(dtmp, UART_BUFF_SIZE);
             switch(event.type) {
                 //Event of UART receiving data
                 case UART_DATA:
                 	// move UART data to MPy buffer
                     uart_get_buffered_data_len(self->uart_num+1, &datasize);
+                    if (datasize > dtmp_size) datasize = dtmp_size;
                     if (datasize > 0) {
                     	// read data from UART buffer
 						if (uart_read_bytes(self->uart_num+1, dtmp, datasize, 0) > 0) {
@@ -162,14 +236,14 @@ static void uart_event_task(void *pvParameters)
 								}
 							}
 							else {
-								if ((self->data_cb) && (self->data_cb_size > 0) && (uart_buf[self->uart_num]->iput >= self->data_cb_size)) {
+								if ((self->data_cb) && (self->data_cb_size > 0) && (uart_buf_count(uart_buf[self->uart_num]) >= self->data_cb_size)) {
 									// ** callback on data length received
 									uart_buf_get(uart_buf[self->uart_num], dtmp, self->data_cb_size);
 									_sched_callback(self->data_cb, self->uart_num+1, UART_CB_TYPE_DATA, self->data_cb_size, dtmp);
 								}
 								else if (self->pattern_cb) {
 									// ** callback on pattern received
-									res = match_pattern(uart_buf[self->uart_num]->buf, uart_buf[self->uart_num]->iput, self->pattern, self->pattern_len);
+									res = uart_buf_find(uart_buf[self->uart_num], self->pattern, self->pattern_len);
 									if (res >= 0) {
 										// found, pull data, including pattern from buffer
 										uart_buf_get(uart_buf[self->uart_num], dtmp, res+self->pattern_len);
@@ -226,6 +300,11 @@ static void uart_event_task(void *pvParameters)
             }
 
         	if (uart_mutex) xSemaphoreGive(uart_mutex);
+        	#if MICROPY_PY_USELECT_NOTIFY
+        	// wake up uselect.poll waiting for this UART; the slot is read under the
+        	// poll lock, the main task may clear it and the entry be freed meanwhile
+        	mp_poll_notify_slot(&uart_poll_notify[self->uart_num]);
+        	#endif
         }
     }
     free(dtmp);
@@ -249,12 +328,12 @@ char *_uart_read(uart_port_t uart_num, int timeout, char *lnend, char *lnstart)
 			}
 		}
     	// check for minimal length
-		if (uart_buf[uart_num]->iput < minlen) {
+		if (uart_buf_count(uart_buf[uart_num]) < minlen) {
 	    	if (uart_mutex) xSemaphoreGive(uart_mutex);
 	    	return NULL;
 		}
 		while (1) {
-			rdlen = match_pattern(uart_buf[uart_num]->buf, uart_buf[uart_num]->iput, (uint8_t *)lnend, strlen(lnend));
+			rdlen = uart_buf_find(uart_buf[uart_num], (uint8_t *)lnend, strlen(lnend));
 			if (rdlen >= 0) {
 				// found, pull data, including pattern from buffer
 				rdlen += 2;
@@ -306,12 +385,12 @@ char *_uart_read(uart_port_t uart_num, int timeout, char *lnend, char *lnstart)
 					continue;
 				}
 			}
-			if (buflen < uart_buf[uart_num]->iput) {
+			if (buflen < uart_buf_count(uart_buf[uart_num])) {
 				// ** new data received, reset timeout
-				buflen = uart_buf[uart_num]->iput;
+				buflen = uart_buf_count(uart_buf[uart_num]);
 				wait = timeout;
 			}
-			if (uart_buf[uart_num]->iput < minlen) {
+			if (uart_buf_count(uart_buf[uart_num]) < minlen) {
 				// ** too few characters received
 		    	if (uart_mutex) xSemaphoreGive(uart_mutex);
 	    		vTaskDelay(10 / portTICK_PERIOD_MS);
@@ -322,7 +401,7 @@ char *_uart_read(uart_port_t uart_num, int timeout, char *lnend, char *lnstart)
 
 			while (1) {
 				// * Check if lineend pattern is received
-				rdlen = match_pattern(uart_buf[uart_num]->buf, uart_buf[uart_num]->iput, (uint8_t *)lnend, strlen(lnend));
+				rdlen = uart_buf_find(uart_buf[uart_num], (uint8_t *)lnend, strlen(lnend));
 				if (rdlen >= 0) {
 					rdlen += 2;
 					// * found, pull data, including pattern from buffer
@@ -769,9 +848,8 @@ STATIC mp_obj_t machine_uart_any(mp_obj_t self_in) {
 
     _check_uart(self);
 
-	if (uart_mutex) xSemaphoreTake(uart_mutex, 200 / portTICK_PERIOD_MS);
-	int res = uart_buf[self->uart_num]->iput;
-	if (uart_mutex) xSemaphoreGive(uart_mutex);
+	// no locking needed, the count is consistent for the consumer
+	int res = uart_buf_count(uart_buf[self->uart_num]);
 
     return MP_OBJ_NEW_SMALL_INT(res);
 }
@@ -785,8 +863,7 @@ STATIC mp_obj_t machine_uart_flush(mp_obj_t self_in) {
 
 	if (uart_mutex) xSemaphoreTake(uart_mutex, 200 / portTICK_PERIOD_MS);
 	uart_flush_input(self->uart_num+1);
-	uart_buf[self->uart_num]->iput = 0;
-	uart_buf[self->uart_num]->iget = 0;
+	uart_buf_flush(uart_buf[self->uart_num]);
 	if (uart_mutex) xSemaphoreGive(uart_mutex);
 
 	return mp_const_none;
@@ -1011,7 +1088,7 @@ STATIC mp_uint_t machine_uart_read(mp_obj_t self_in, void *buf_in, mp_uint_t siz
 					continue;
 				}
 			}
-			if (uart_buf[self->uart_num]->iput < size) {
+			if (uart_buf_count(uart_buf[self->uart_num]) < size) {
 		    	if (uart_mutex) xSemaphoreGive(uart_mutex);
 	    		vTaskDelay(2 / portTICK_PERIOD_MS);
 				wait -= 2;
@@ -1067,9 +1144,7 @@ STATIC mp_uint_t machine_uart_ioctl(mp_obj_t self_in, mp_uint_t request, mp_uint
         mp_uint_t flags = arg;
         ret = 0;
         size_t rxbufsize;
-    	if (uart_mutex) xSemaphoreTake(uart_mutex, 200 / portTICK_PERIOD_MS);
-        rxbufsize = uart_buf[self->uart_num]->iput;
-    	if (uart_mutex) xSemaphoreGive(uart_mutex);
+        rxbufsize = uart_buf_count(uart_buf[self->uart_num]);
 
         if ((flags & MP_STREAM_POLL_RD) && rxbufsize > 0) {
             ret |= MP_STREAM_POLL_RD;
@@ -1077,6 +1152,25 @@ STATIC mp_uint_t machine_uart_ioctl(mp_obj_t self_in, mp_uint_t request, mp_uint
         if ((flags & MP_STREAM_POLL_WR) && 1) { // FIXME: uart_tx_any_room(self->uart_num)
             ret |= MP_STREAM_POLL_WR;
         }
+    #if MICROPY_PY_USELECT_NOTIFY
+    } else if ((request == MP_STREAM_POLL_NOTIFY) || (request == MP_STREAM_POLL_NOTIFY_CLEAR)) {
+        // notified from uart_event_task on received data
+        // only one poll object can be notified, the others poll the UART on each pass
+        mp_poll_notify_t *notify = (mp_poll_notify_t *)arg;
+        ret = 0;
+        mp_hal_poll_lock();
+        if (request == MP_STREAM_POLL_NOTIFY_CLEAR) {
+            if (uart_poll_notify[self->uart_num] == notify) uart_poll_notify[self->uart_num] = NULL;
+        }
+        else if ((uart_poll_notify[self->uart_num] == NULL) || (uart_poll_notify[self->uart_num] == notify)) {
+            uart_poll_notify[self->uart_num] = notify;
+        }
+        else {
+            *errcode = MP_EBUSY;
+            ret = MP_STREAM_ERROR;
+        }
+        mp_hal_poll_unlock();
+    #endif
     } else {
         *errcode = MP_EINVAL;
         ret = MP_STREAM_ERROR;
@@ -1103,3 +1197,5 @@ const mp_obj_type_t machine_uart_type = {
     .protocol = &uart_stream_p,
     .locals_dict = (mp_obj_dict_t*)&machine_uart_locals_dict,
 };
+
+#endif
@@ -1,14 +1,24 @@
 #ifndef INC_MACHINE_UART_H
 #define INC_MACHINE_UART_H
 
+#ifdef UART_HOST_BUILD
+/*
+ * The receive ring buffer functions can be built on a POSIX host:
+ *   make -C tools/host uart-buf-test
+ * builds them with tools/host/uart/uart_buf_host.c, everything else is left out.
+ */
+#include <stdint.h>
+#else
 #include "driver/uart.h"
 #include "py/runtime.h"
+#endif
 
 #define UART_CB_TYPE_DATA		1
 #define UART_CB_TYPE_PATTERN	2
 #define UART_CB_TYPE_ERROR		3
 #define UART_BUFF_SIZE			256
 
+#ifndef UART_HOST_BUILD
 typedef struct _machine_uart_obj_t {
     mp_obj_base_t base;
     uart_port_t uart_num;
@@ -31,18 +41,27 @@ typedef struct _machine_uart_obj_t {
     uint8_t end_task;
     uint8_t lineend[3];
 } machine_uart_obj_t;
+#endif
 
+// Single producer (uart_event_task), single consumer ring buffer
+// 'size' is a power of 2, 'iget' and 'iput' are free running indexes,
+// the number of bytes in the buffer is always 'iput - iget'
 typedef struct _uart_ringbuf_t {
     uint8_t *buf;
-    uint16_t size;
-    uint16_t iget;
-    uint16_t iput;
+    uint32_t size;
+    volatile uint32_t iget;
+    volatile uint32_t iput;
 } uart_ringbuf_t;
 
+#define uart_buf_count(r) ((r)->iput - (r)->iget)
 
+#ifndef UART_HOST_BUILD
 char *_uart_read(uart_port_t uart_num, int timeout, char *lnend, char *lnstart);
+#endif
 int match_pattern(uint8_t *text, int text_length, uint8_t *pattern, int pattern_length);
-int uart_buf_get(uart_ringbuf_t *r, uint8_t *dest, uint16_t len);
-int uart_buf_put(uart_ringbuf_t *r, uint8_t *source, uint16_t len);
+int uart_buf_find(uart_ringbuf_t *r, uint8_t *pattern, int pattern_length);
+int uart_buf_get(uart_ringbuf_t *r, uint8_t *dest, uint32_t len);
+int uart_buf_put(uart_ringbuf_t *r, uint8_t *source, uint32_t len);
+void uart_buf_flush(uart_ringbuf_t *r);
 
 #endif
@@ -144,6 +144,20 @@ void mp_task(void *pvParameter)
     // === Mount internal flash file system ===
     int res = mount_vfs(VFS_NATIVE_TYPE_SPIFLASH, VFS_NATIVE_INTERNAL_MP);
 
+	#if MICROPY_PERSISTENT_CODE_XIP
+    // === Mount the precompiled modules image, if the partition exists ===
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        int nmod = mount_xip_image(MICROPY_PERSISTENT_CODE_XIP_LABEL);
+        if (nmod >= 0) ESP_LOGI("MicroPython", "Mounted modules image, %d module(s)", nmod);
+        nlr_pop();
+    }
+    else {
+        ESP_LOGE("MicroPython", "Error mounting modules image");
+        mp_obj_print_exception(&mp_plat_print, (mp_obj_t)nlr.ret_val);
+    }
+	#endif
+
     if (res == 0) {
     	// run boot-up script 'boot.py'
         pyexec_file("boot.py");
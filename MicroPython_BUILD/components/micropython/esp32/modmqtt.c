@@ -89,7 +89,7 @@ STATIC void connected_cb(mqtt_obj_t *self)
 		mp_sched_carg_t *carg = make_cargs(MP_SCHED_CTYPE_SINGLE);
 		if (!carg) return;
 		if (!make_carg_entry(carg, 0, MP_SCHED_ENTRY_TYPE_STR, strlen(self->name), (const uint8_t *)self->name, NULL)) return;
-		mp_sched_schedule(self->mpy_connected_cb, mp_const_none, carg);
+		mp_sched_schedule_src(self->mpy_connected_cb, mp_const_none, carg, MP_SCHED_SRC_MQTT);
     }
 }
 
@@ -100,7 +100,7 @@ STATIC void disconnected_cb(mqtt_obj_t *self)
 		mp_sched_carg_t *carg = make_cargs(MP_SCHED_CTYPE_SINGLE);
 		if (!carg) return;
 		if (!make_carg_entry(carg, 0, MP_SCHED_ENTRY_TYPE_STR, strlen(self->name), (const uint8_t *)self->name, NULL)) return;
-		mp_sched_schedule(self->mpy_disconnected_cb, mp_const_none, carg);
+		mp_sched_schedule_src(self->mpy_disconnected_cb, mp_const_none, carg, MP_SCHED_SRC_MQTT);
     }
 }
 
@@ -117,7 +117,7 @@ STATIC void subscribed_cb(mqtt_obj_t *self, const char *topic)
    		else {
    	   		if (!make_carg_entry(carg, 1, MP_SCHED_ENTRY_TYPE_STR, 1, (const uint8_t *)"?", NULL)) return;
    		}
-    	mp_sched_schedule(self->mpy_subscribed_cb, mp_const_none, carg);
+    	mp_sched_schedule_src(self->mpy_subscribed_cb, mp_const_none, carg, MP_SCHED_SRC_MQTT);
     }
 }
 
@@ -134,7 +134,7 @@ STATIC void unsubscribed_cb(mqtt_obj_t *self, const char *topic)
    		else {
    	   		if (!make_carg_entry(carg, 1, MP_SCHED_ENTRY_TYPE_STR, 1, (const uint8_t *)"?", NULL)) return;
    		}
-    	mp_sched_schedule(self->mpy_unsubscribed_cb, mp_const_none, carg);
+    	mp_sched_schedule_src(self->mpy_unsubscribed_cb, mp_const_none, carg, MP_SCHED_SRC_MQTT);
     }
 }
 
@@ -152,7 +152,7 @@ STATIC void published_cb(mqtt_obj_t *self, const char *topic, int type)
    	   		if (!make_carg_entry(carg, 1, MP_SCHED_ENTRY_TYPE_STR, 1, (const uint8_t *)"?", NULL)) return;
    		}
    		if (!make_carg_entry(carg, 2, MP_SCHED_ENTRY_TYPE_INT, type, NULL, NULL)) return;
-    	mp_sched_schedule(self->mpy_published_cb, mp_const_none, carg);
+    	mp_sched_schedule_src(self->mpy_published_cb, mp_const_none, carg, MP_SCHED_SRC_MQTT);
     }
 }
 
@@ -196,7 +196,7 @@ STATIC void data_cb(mqtt_obj_t *self, void *params)
 			if (!make_carg_entry(carg, 0, MP_SCHED_ENTRY_TYPE_STR, strlen(self->name), (const uint8_t *)self->name, NULL)) return;
 			if (!make_carg_entry(carg, 1, MP_SCHED_ENTRY_TYPE_STR, event->topic_len, (const uint8_t *)event->topic, NULL)) return;
 			if (!make_carg_entry(carg, 2, MP_SCHED_ENTRY_TYPE_STR, event->data_len, (const uint8_t *)event->data, NULL)) return;
-			mp_sched_schedule(self->mpy_data_cb, mp_const_none, carg);
+			mp_sched_schedule_src(self->mpy_data_cb, mp_const_none, carg, MP_SCHED_SRC_MQTT);
 		}
 	}
 	else {
@@ -212,7 +212,7 @@ STATIC void data_cb(mqtt_obj_t *self, void *params)
 				if (!make_carg_entry(carg, 0, MP_SCHED_ENTRY_TYPE_STR, strlen(self->name), (const uint8_t *)self->name, NULL)) goto freebufs;
 				if (!make_carg_entry(carg, 1, MP_SCHED_ENTRY_TYPE_STR, strlen((const char *)self->topicbuf), self->topicbuf, NULL)) goto freebufs;
 				if (!make_carg_entry(carg, 2, MP_SCHED_ENTRY_TYPE_STR, event->total_data_len, self->msgbuf, NULL)) goto freebufs;
-				mp_sched_schedule(self->mpy_data_cb, mp_const_none, carg);
+				mp_sched_schedule_src(self->mpy_data_cb, mp_const_none, carg, MP_SCHED_SRC_MQTT);
 freebufs:
 				// Free the buffers
 				free(self->msgbuf);
@@ -329,6 +329,10 @@ STATIC void mqtt_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_
 		}
 		else mp_printf(print, "not set)\n");
     }
+    if (self->client->spool) {
+		mp_printf(print, "     Spool: %d message(s), %d bytes\n",
+				mqtt_spool_get_count(self->client->spool), mqtt_spool_get_size(self->client->spool));
+    }
     /*
 	if ((self->client->settings->xMqttTask) && (self->client->settings->xMqttSendingTask)) {
 		mp_printf(print, "     Used stack: %u/%u + %u/%u\n",
@@ -344,7 +348,8 @@ STATIC void mqtt_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_
 STATIC mp_obj_t mqtt_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *all_args)
 {
 	enum { ARG_name, ARG_server, ARG_user, ARG_pass, ARG_port, ARG_reconnect, ARG_clientid, ARG_cleansess, ARG_keepalive, ARG_cert,
-		ARG_lwt_topic, ARG_lwt_msg, ARG_lwt_qos, ARG_lwt_retain, ARG_datacb, ARG_connected, ARG_disconnected, ARG_subscribed, ARG_unsubscribed, ARG_published };
+		ARG_lwt_topic, ARG_lwt_msg, ARG_lwt_qos, ARG_lwt_retain, ARG_datacb, ARG_connected, ARG_disconnected, ARG_subscribed, ARG_unsubscribed, ARG_published,
+		ARG_spool, ARG_spool_size, ARG_spool_sync };
 
     const mp_arg_t mqtt_init_allowed_args[] = {
 			{ MP_QSTR_name,   	    	MP_ARG_REQUIRED | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
@@ -367,6 +372,9 @@ STATIC mp_obj_t mqtt_make_new(const mp_obj_type_t *type, size_t n_args, size_t n
 			{ MP_QSTR_subscribed_cb,  	MP_ARG_KW_ONLY  | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
 			{ MP_QSTR_unsubscribed_cb, 	MP_ARG_KW_ONLY  | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
 			{ MP_QSTR_published_cb,		MP_ARG_KW_ONLY  | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
+			{ MP_QSTR_spool,			MP_ARG_KW_ONLY  | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
+			{ MP_QSTR_spool_size,		MP_ARG_KW_ONLY  | MP_ARG_INT,  {.u_int = MQTT_SPOOL_SIZE} },
+			{ MP_QSTR_spool_sync,		MP_ARG_KW_ONLY  | MP_ARG_INT,  {.u_int = 1} },
 	};
 	mp_arg_val_t args[MP_ARRAY_SIZE(mqtt_init_allowed_args)];
 	mp_arg_parse_all_kw_array(n_args, n_kw, all_args, MP_ARRAY_SIZE(mqtt_init_allowed_args), mqtt_init_allowed_args, args);
@@ -496,6 +504,21 @@ STATIC mp_obj_t mqtt_make_new(const mp_obj_type_t *type, size_t n_args, size_t n
         }
     }
 
+    // Persistent spool for QoS>0 messages published while not connected
+    char spool_dir[128] = {'\0'};
+    if (MP_OBJ_IS_STR(args[ARG_spool].u_obj)) {
+        int res = physicalPath(mp_obj_str_get_str(args[ARG_spool].u_obj), spool_dir);
+        if ((res != 0) || (strlen(spool_dir) == 0)) {
+    		mp_raise_ValueError("Spool directory not valid");
+        }
+        if (args[ARG_spool_size].u_int < 1024) {
+    		mp_raise_ValueError("Spool size too small");
+        }
+        mqtt_cfg.spool_dir = spool_dir;
+        mqtt_cfg.spool_size = args[ARG_spool_size].u_int;
+        mqtt_cfg.spool_sync = (args[ARG_spool_sync].u_int < 0) ? 0 : args[ARG_spool_sync].u_int;
+    }
+
     // Set callbacks
     if ((MP_OBJ_IS_FUN(args[ARG_datacb].u_obj)) || (MP_OBJ_IS_METH(args[ARG_datacb].u_obj))) {
 	    self->mpy_data_cb = args[ARG_datacb].u_obj;
@@ -747,7 +770,8 @@ MP_DEFINE_CONST_FUN_OBJ_2(mqtt_unsubscribe_obj, mqtt_op_unsubscribe);
 STATIC mp_obj_t mqtt_op_publish(mp_uint_t n_args, const mp_obj_t *args)
 {
     mqtt_obj_t *self = args[0];
-    if (checkClient(self) != MQTT_STATE_CONNECTED) return mp_const_false;
+    bool connected = (checkClient(self) == MQTT_STATE_CONNECTED);
+    if ((!connected) && (self->client->spool == NULL)) return mp_const_false;
 
     size_t len;
     const char *topic = mp_obj_str_get_str(args[1]);
@@ -762,6 +786,11 @@ STATIC mp_obj_t mqtt_op_publish(mp_uint_t n_args, const mp_obj_t *args)
     	}
     }
     if (qos == 0) wait = 0;
+    if (!connected) {
+        // the message can only be spooled
+        if (qos == 0) return mp_const_false;
+        wait = 0;
+    }
 
     int retain = 0;
     if (n_args == 5) retain = mp_obj_is_true(args[4]);
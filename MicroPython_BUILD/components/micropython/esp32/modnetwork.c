@@ -215,7 +215,7 @@ static void processPROBEREQRECVED(const uint8_t *frame, int len, int rssi)
 		if (!make_carg_entry(carg, 1, MP_SCHED_ENTRY_TYPE_INT, len, NULL, "len")) goto end;
 		if (!make_carg_entry(carg, 2, MP_SCHED_ENTRY_TYPE_STR, len, frame, "frame")) goto end;
 
-		mp_sched_schedule(probereq_callback, mp_const_none, carg);
+		mp_sched_schedule_src(probereq_callback, mp_const_none, carg, MP_SCHED_SRC_NET);
 end:
 		if (probereq_mutex) xSemaphoreGive(probereq_mutex);
 	}
@@ -358,7 +358,7 @@ static void processEvent_callback(system_event_t *event)
 			// the 3rd tuple item was not added, add it now
 			if (!make_carg_entry(carg, 2, MP_SCHED_ENTRY_TYPE_NONE, 0, NULL, NULL)) return;
 		}
-		mp_sched_schedule(event_callback, mp_const_none, carg);
+		mp_sched_schedule_src(event_callback, mp_const_none, carg, MP_SCHED_SRC_NET);
 	}
 }
 
@@ -1420,6 +1420,22 @@ STATIC mp_obj_t mod_network_TelnetMaxStack()
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(mod_network_TelnetMaxStack_obj, mod_network_TelnetMaxStack);
 
+//--------------------------------------
+STATIC mp_obj_t mod_network_statsTelnet()
+{
+	mp_obj_t tuple[4];
+	telnet_stats_t stats;
+
+	telnet_get_stats(&stats);
+	tuple[0] = mp_obj_new_int_from_uint(stats.tx_bytes);
+	tuple[1] = mp_obj_new_int_from_uint(stats.tx_segments);
+	tuple[2] = mp_obj_new_int_from_uint(stats.tx_stalls);
+	tuple[3] = mp_obj_new_int_from_uint(stats.rx_bytes);
+
+	return mp_obj_new_tuple(4, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(mod_network_statsTelnet_obj, mod_network_statsTelnet);
+
 //--------------------------------------
 STATIC mp_obj_t mod_network_stateTelnet()
 {
@@ -1451,6 +1467,7 @@ STATIC const mp_map_elem_t network_telnet_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_resume),	(mp_obj_t)&mod_network_resumeTelnet_obj },
     { MP_ROM_QSTR(MP_QSTR_stop),	(mp_obj_t)&mod_network_stopTelnet_obj },
     { MP_ROM_QSTR(MP_QSTR_status),	(mp_obj_t)&mod_network_stateTelnet_obj },
+    { MP_ROM_QSTR(MP_QSTR_stats),	(mp_obj_t)&mod_network_statsTelnet_obj },
     { MP_ROM_QSTR(MP_QSTR_stack),	(mp_obj_t)&mod_network_TelnetMaxStack_obj }
 };
 STATIC MP_DEFINE_CONST_DICT(network_telnet_locals_dict, network_telnet_locals_dict_table);
@@ -1592,6 +1609,29 @@ STATIC mp_obj_t mod_network_stateFtp()
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(mod_network_stateFtp_obj, mod_network_stateFtp);
 
+//-------------------------------------------------------------------
+STATIC mp_obj_t mod_network_statsFtp(size_t n_args, const mp_obj_t *args)
+{
+	ftp_stats_t stats;
+	bool reset = false;
+	if (n_args > 0) reset = mp_obj_is_true(args[0]);
+
+	if (!ftp_get_stats(&stats, reset)) return mp_const_none;
+
+	mp_obj_t tuple[8];
+	tuple[0] = mp_obj_new_int(stats.sessions);
+	tuple[1] = mp_obj_new_int(stats.max_sessions);
+	tuple[2] = mp_obj_new_int_from_uint(stats.bytes_tx);
+	tuple[3] = mp_obj_new_int_from_uint(stats.bytes_rx);
+	tuple[4] = mp_obj_new_int_from_uint(stats.files_tx);
+	tuple[5] = mp_obj_new_int_from_uint(stats.files_rx);
+	tuple[6] = mp_obj_new_int_from_uint(stats.rate_tx);
+	tuple[7] = mp_obj_new_int_from_uint(stats.rate_rx);
+
+	return mp_obj_new_tuple(8, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_network_statsFtp_obj, 0, 1, mod_network_statsFtp);
+
 //============================================================
 STATIC const mp_map_elem_t network_ftp_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_start),	(mp_obj_t)&mod_network_startFtp_obj },
@@ -1599,6 +1639,7 @@ STATIC const mp_map_elem_t network_ftp_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_resume),	(mp_obj_t)&mod_network_resumeFtp_obj },
     { MP_ROM_QSTR(MP_QSTR_stop),	(mp_obj_t)&mod_network_stopFtp_obj },
     { MP_ROM_QSTR(MP_QSTR_status),	(mp_obj_t)&mod_network_stateFtp_obj },
+    { MP_ROM_QSTR(MP_QSTR_stats),	(mp_obj_t)&mod_network_statsFtp_obj },
     { MP_ROM_QSTR(MP_QSTR_stack),	(mp_obj_t)&mod_network_FtpMaxStack_obj }
 };
 STATIC MP_DEFINE_CONST_DICT(network_ftp_locals_dict, network_ftp_locals_dict_table);
@@ -1612,6 +1653,162 @@ const mp_obj_type_t network_ftp_type = {
 
 #endif
 
+#ifdef CONFIG_MICROPY_USE_WEBSERVER
+
+#include "libs/websrv.h"
+#include "extmod/vfs_native.h"
+
+//-------------------------------------------------------------------------------------------------
+STATIC mp_obj_t mod_network_startWebsrv(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    enum { ARG_root, ARG_port, ARG_callback, ARG_routes, ARG_fallback, ARG_maxage, ARG_keepalive };
+    const mp_arg_t allowed_args[] = {
+			{ MP_QSTR_root,			MP_ARG_KW_ONLY  | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
+			{ MP_QSTR_port,			MP_ARG_KW_ONLY  | MP_ARG_INT,  {.u_int = 80} },
+			{ MP_QSTR_callback,		MP_ARG_KW_ONLY  | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
+			{ MP_QSTR_routes,		MP_ARG_KW_ONLY  | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
+			{ MP_QSTR_fallback,		MP_ARG_KW_ONLY  | MP_ARG_BOOL, {.u_bool = false} },
+			{ MP_QSTR_maxage,		MP_ARG_KW_ONLY  | MP_ARG_INT,  {.u_int = 0} },
+			{ MP_QSTR_keepalive,	MP_ARG_KW_ONLY  | MP_ARG_INT,  {.u_int = 5} },
+	};
+	mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if (websrv_running()) return mp_const_false;
+
+    websrv_config_t config;
+    memset(&config, 0, sizeof(websrv_config_t));
+
+    // document root
+    char fullname[128] = {'\0'};
+    const char *root = (args[ARG_root].u_obj == mp_const_none) ? "/flash/www" : mp_obj_str_get_str(args[ARG_root].u_obj);
+    int res = physicalPath(root, fullname);
+    if ((res != 0) || (strlen(fullname) == 0) || (strlen(fullname) >= WEBSRV_ROOT_LEN_MAX)) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Error resolving root directory"));
+    }
+    int rlen = strlen(fullname);
+    while ((rlen > 1) && (fullname[rlen-1] == '/')) fullname[--rlen] = '\0';
+    strcpy(config.root, fullname);
+
+    // path prefixes handled by the callback
+    if (args[ARG_routes].u_obj != mp_const_none) {
+        mp_obj_t *routes;
+        size_t n_routes;
+        mp_obj_get_array(args[ARG_routes].u_obj, &n_routes, &routes);
+        if (n_routes > WEBSRV_MAX_ROUTES) {
+            nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_ValueError, "max %d routes allowed", WEBSRV_MAX_ROUTES));
+        }
+        for (int i=0; i<n_routes; i++) {
+            const char *route = mp_obj_str_get_str(routes[i]);
+            if ((route[0] != '/') || (strlen(route) >= WEBSRV_ROUTE_LEN_MAX)) {
+                nlr_raise(mp_obj_new_exception_msg(&mp_type_ValueError, "invalid route"));
+            }
+            strcpy(config.routes[i], route);
+        }
+        config.n_routes = n_routes;
+    }
+
+    if ((MP_OBJ_IS_FUN(args[ARG_callback].u_obj)) || (MP_OBJ_IS_METH(args[ARG_callback].u_obj))) {
+        MP_STATE_PORT(websrv_callback) = args[ARG_callback].u_obj;
+        config.fallback = args[ARG_fallback].u_bool;
+    }
+    else {
+        MP_STATE_PORT(websrv_callback) = mp_const_none;
+        config.n_routes = 0;
+    }
+
+    config.port = args[ARG_port].u_int;
+    config.max_age = (args[ARG_maxage].u_int > 0) ? args[ARG_maxage].u_int : 0;
+    config.keepalive_ms = (args[ARG_keepalive].u_int > 0) ? args[ARG_keepalive].u_int * 1000 : 0;
+
+    if (!websrv_start(&config)) return mp_const_false;
+    return mp_const_true;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mod_network_startWebsrv_obj, 0, mod_network_startWebsrv);
+
+//--------------------------------------------
+STATIC mp_obj_t mod_network_stopWebsrv()
+{
+	bool res = websrv_stop();
+	if (!websrv_running()) MP_STATE_PORT(websrv_callback) = mp_const_none;
+	return (res) ? mp_const_true : mp_const_false;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(mod_network_stopWebsrv_obj, mod_network_stopWebsrv);
+
+//----------------------------------------------
+STATIC mp_obj_t mod_network_stateWebsrv()
+{
+	return (websrv_running()) ? mp_const_true : mp_const_false;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(mod_network_stateWebsrv_obj, mod_network_stateWebsrv);
+
+//----------------------------------------------------------------------
+STATIC mp_obj_t mod_network_statsWebsrv(size_t n_args, const mp_obj_t *args)
+{
+	websrv_stats_t stats;
+	bool reset = false;
+	if (n_args > 0) reset = mp_obj_is_true(args[0]);
+
+	if (!websrv_get_stats(&stats, reset)) return mp_const_none;
+
+	mp_obj_t tuple[10];
+	tuple[0] = mp_obj_new_int(stats.workers);
+	tuple[1] = mp_obj_new_int(stats.busy);
+	tuple[2] = mp_obj_new_int_from_uint(stats.connections);
+	tuple[3] = mp_obj_new_int_from_uint(stats.requests);
+	tuple[4] = mp_obj_new_int_from_uint(stats.files);
+	tuple[5] = mp_obj_new_int_from_uint(stats.not_modified);
+	tuple[6] = mp_obj_new_int_from_uint(stats.gzip);
+	tuple[7] = mp_obj_new_int_from_uint(stats.dynamic);
+	tuple[8] = mp_obj_new_int_from_uint(stats.errors);
+	tuple[9] = mp_obj_new_int_from_uint(stats.bytes_tx);
+
+	return mp_obj_new_tuple(10, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_network_statsWebsrv_obj, 0, 1, mod_network_statsWebsrv);
+
+// Response to the request passed to the callback
+//---------------------------------------------------------------------------------------------------
+STATIC mp_obj_t mod_network_respondWebsrv(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    enum { ARG_id, ARG_status, ARG_body, ARG_ctype };
+    const mp_arg_t allowed_args[] = {
+			{ MP_QSTR_id,			MP_ARG_REQUIRED | MP_ARG_INT,  {.u_int = 0} },
+			{ MP_QSTR_status,		MP_ARG_INT,                    {.u_int = 200} },
+			{ MP_QSTR_body,			MP_ARG_OBJ,                    {.u_obj = mp_const_none} },
+			{ MP_QSTR_ctype,		MP_ARG_KW_ONLY  | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
+	};
+	mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    const char *ctype = (args[ARG_ctype].u_obj == mp_const_none) ? "text/html" : mp_obj_str_get_str(args[ARG_ctype].u_obj);
+    mp_buffer_info_t body = { .buf = NULL, .len = 0 };
+    if (args[ARG_body].u_obj != mp_const_none) mp_get_buffer_raise(args[ARG_body].u_obj, &body, MP_BUFFER_READ);
+
+    if (!websrv_respond(args[ARG_id].u_int, args[ARG_status].u_int, ctype, body.buf, body.len)) return mp_const_false;
+    return mp_const_true;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mod_network_respondWebsrv_obj, 1, mod_network_respondWebsrv);
+
+//===============================================================
+STATIC const mp_map_elem_t network_websrv_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_start),	(mp_obj_t)&mod_network_startWebsrv_obj },
+    { MP_ROM_QSTR(MP_QSTR_stop),	(mp_obj_t)&mod_network_stopWebsrv_obj },
+    { MP_ROM_QSTR(MP_QSTR_status),	(mp_obj_t)&mod_network_stateWebsrv_obj },
+    { MP_ROM_QSTR(MP_QSTR_stats),	(mp_obj_t)&mod_network_statsWebsrv_obj },
+    { MP_ROM_QSTR(MP_QSTR_respond),	(mp_obj_t)&mod_network_respondWebsrv_obj }
+};
+STATIC MP_DEFINE_CONST_DICT(network_websrv_locals_dict, network_websrv_locals_dict_table);
+
+//=========================================
+const mp_obj_type_t network_websrv_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_websrv,
+    .locals_dict = (mp_obj_t)&network_websrv_locals_dict,
+};
+
+#endif
+
 
 #ifdef CONFIG_MICROPY_USE_MDNS
 extern const mp_obj_type_t mdns_type;
@@ -1656,6 +1853,9 @@ STATIC const mp_map_elem_t mp_module_network_globals_table[] = {
 	#ifdef CONFIG_MICROPY_USE_FTPSERVER
 	{ MP_ROM_QSTR(MP_QSTR_ftp),						(mp_obj_type_t *)&network_ftp_type },
 	#endif
+	#ifdef CONFIG_MICROPY_USE_WEBSERVER
+	{ MP_ROM_QSTR(MP_QSTR_websrv),					(mp_obj_type_t *)&network_websrv_type },
+	#endif
 	#ifdef CONFIG_MICROPY_USE_MDNS
 	{ MP_ROM_QSTR(MP_QSTR_mDNS),					(mp_obj_type_t *)&mdns_type },
 	#endif
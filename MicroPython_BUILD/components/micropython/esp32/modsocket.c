@@ -37,6 +37,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
 #include "py/runtime0.h"
 #include "py/nlr.h"
 #include "py/objlist.h"
@@ -55,6 +59,7 @@
 #include "lwip/ip4.h"
 #include "lwip/igmp.h"
 #include "esp_log.h"
+#include "extmod/moduselect.h"
 
 #define SOCKET_POLL_US (100000)
 
@@ -70,6 +75,11 @@ typedef struct _socket_obj_t {
     mp_obj_t events_callback;
     struct _socket_obj_t *events_next;
     #endif
+    #if MICROPY_PY_USELECT_NOTIFY
+    mp_poll_notify_t *poll_notify;
+    struct _socket_obj_t *poll_next;
+    bool poll_armed;
+    #endif
 } socket_obj_t;
 
 void _socket_settimeout(socket_obj_t *sock, uint64_t timeout_ms);
@@ -139,6 +149,129 @@ void usocket_events_handler(void) {
 
 #endif // MICROPY_PY_USOCKET_EVENTS
 
+#if MICROPY_PY_USELECT_NOTIFY
+// Readiness notification for uselect.poll
+//
+// The sockets registered with a poll object are watched by the socket_poll_task,
+// which sleeps in lwip select() on all armed sockets and notifies the poll object
+// when some of them become ready. A notified socket is disarmed until the
+// poll object checks its state again (MP_STREAM_POLL), so a socket which stays
+// ready doesn't keep waking up the task.
+
+// Max time the task waits in select() before picking up newly armed sockets
+#define SOCKET_POLL_WATCH_MS (10)
+
+extern int MainTaskCore;
+
+STATIC socket_obj_t *socket_poll_head = NULL;
+STATIC SemaphoreHandle_t socket_poll_mutex = NULL;
+STATIC TaskHandle_t socket_poll_task_handle = NULL;
+
+STATIC void socket_poll_task(void *pvParameters) {
+    fd_set rfds, wfds, efds;
+    for (;;) {
+        FD_ZERO(&rfds);
+        FD_ZERO(&wfds);
+        FD_ZERO(&efds);
+        int max_fd = -1;
+
+        xSemaphoreTake(socket_poll_mutex, portMAX_DELAY);
+        for (socket_obj_t *s = socket_poll_head; s != NULL; s = s->poll_next) {
+            if (!s->poll_armed || s->fd < 0) {
+                continue;
+            }
+            mp_uint_t flags = s->poll_notify->flags;
+            if (flags & MP_STREAM_POLL_RD) FD_SET(s->fd, &rfds);
+            if (flags & MP_STREAM_POLL_WR) FD_SET(s->fd, &wfds);
+            FD_SET(s->fd, &efds);
+            max_fd = MAX(max_fd, s->fd);
+        }
+        xSemaphoreGive(socket_poll_mutex);
+
+        if (max_fd < 0) {
+            // nothing to watch, wait until some socket is armed
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        struct timeval timeout = { .tv_sec = 0, .tv_usec = SOCKET_POLL_WATCH_MS * 1000 };
+        int r = select(max_fd + 1, &rfds, &wfds, &efds, &timeout);
+        if (r == 0) {
+            continue;
+        }
+
+        xSemaphoreTake(socket_poll_mutex, portMAX_DELAY);
+        for (socket_obj_t *s = socket_poll_head; s != NULL; s = s->poll_next) {
+            if (!s->poll_armed || s->fd < 0) {
+                continue;
+            }
+            // on select error (e.g. socket closed meanwhile) notify all, the poll will find out
+            if ((r < 0) || FD_ISSET(s->fd, &rfds) || FD_ISSET(s->fd, &wfds) || FD_ISSET(s->fd, &efds)) {
+                s->poll_armed = false;
+                mp_poll_notify(s->poll_notify);
+            }
+        }
+        xSemaphoreGive(socket_poll_mutex);
+        if (r < 0) {
+            vTaskDelay(1);
+        }
+    }
+}
+
+// Arm the socket, so the task notifies the poll object on its next state change
+STATIC void socket_poll_arm(socket_obj_t *sock) {
+    if (sock->poll_notify == NULL || sock->poll_armed) {
+        return;
+    }
+    xSemaphoreTake(socket_poll_mutex, portMAX_DELAY);
+    sock->poll_armed = true;
+    xSemaphoreGive(socket_poll_mutex);
+    xTaskNotifyGive(socket_poll_task_handle);
+}
+
+// Set or clear (notify == NULL) the socket's poll notification
+STATIC int socket_poll_set_notify(socket_obj_t *sock, mp_poll_notify_t *notify) {
+    if (socket_poll_mutex == NULL) {
+        if (notify == NULL) {
+            return 0;
+        }
+        socket_poll_mutex = xSemaphoreCreateMutex();
+        if (socket_poll_mutex == NULL) {
+            return MP_ENOMEM;
+        }
+    }
+    if ((notify != NULL) && (socket_poll_task_handle == NULL)) {
+        #if CONFIG_MICROPY_USE_BOTH_CORES
+        xTaskCreate(socket_poll_task, "socket_poll_task", 2048, NULL, CONFIG_MICROPY_TASK_PRIORITY, &socket_poll_task_handle);
+        #else
+        xTaskCreatePinnedToCore(socket_poll_task, "socket_poll_task", 2048, NULL, CONFIG_MICROPY_TASK_PRIORITY, &socket_poll_task_handle, MainTaskCore);
+        #endif
+        if (socket_poll_task_handle == NULL) {
+            return MP_ENOMEM;
+        }
+    }
+
+    xSemaphoreTake(socket_poll_mutex, portMAX_DELAY);
+    if (sock->poll_notify != NULL) {
+        // remove from the list
+        for (socket_obj_t **s = &socket_poll_head; *s != NULL; s = &(*s)->poll_next) {
+            if (*s == sock) {
+                *s = sock->poll_next;
+                break;
+            }
+        }
+    }
+    sock->poll_notify = notify;
+    sock->poll_armed = false;
+    if (notify != NULL) {
+        sock->poll_next = socket_poll_head;
+        socket_poll_head = sock;
+    }
+    xSemaphoreGive(socket_poll_mutex);
+    return 0;
+}
+#endif // MICROPY_PY_USELECT_NOTIFY
+
 NORETURN static void exception_from_errno(int _errno) {
     // Here we need to convert from lwip errno values to MicroPython's standard ones
     if (_errno == EINPROGRESS) {
@@ -600,7 +733,30 @@ STATIC mp_uint_t socket_stream_ioctl(mp_obj_t self_in, mp_uint_t request, uintpt
         if (FD_ISSET(socket->fd, &rfds)) ret |= MP_STREAM_POLL_RD;
         if (FD_ISSET(socket->fd, &wfds)) ret |= MP_STREAM_POLL_WR;
         if (FD_ISSET(socket->fd, &efds)) ret |= MP_STREAM_POLL_HUP;
+        #if MICROPY_PY_USELECT_NOTIFY
+        // state checked, watch for the next change
+        socket_poll_arm(socket);
+        #endif
         return ret;
+    #if MICROPY_PY_USELECT_NOTIFY
+    } else if (request == MP_STREAM_POLL_NOTIFY) {
+        // only one poll object can be notified, the others poll the socket on each pass
+        if ((socket->poll_notify != NULL) && (socket->poll_notify != (mp_poll_notify_t *)arg)) {
+            *errcode = MP_EBUSY;
+            return MP_STREAM_ERROR;
+        }
+        int err = socket_poll_set_notify(socket, (mp_poll_notify_t *)arg);
+        if (err != 0) {
+            *errcode = err;
+            return MP_STREAM_ERROR;
+        }
+        return 0;
+    } else if (request == MP_STREAM_POLL_NOTIFY_CLEAR) {
+        if ((socket->poll_notify != NULL) && (socket->poll_notify == (mp_poll_notify_t *)arg)) {
+            socket_poll_set_notify(socket, NULL);
+        }
+        return 0;
+    #endif
     } else if (request == MP_STREAM_CLOSE) {
         if (socket->fd >= 0) {
             #if MICROPY_PY_USOCKET_EVENTS
@@ -609,6 +765,14 @@ STATIC mp_uint_t socket_stream_ioctl(mp_obj_t self_in, mp_uint_t request, uintpt
                 socket->events_callback = MP_OBJ_NULL;
             }
             #endif
+            #if MICROPY_PY_USELECT_NOTIFY
+            if (socket->poll_notify != NULL) {
+                // the poll object will get an error polling the closed socket
+                mp_poll_notify_t *notify = socket->poll_notify;
+                socket_poll_set_notify(socket, NULL);
+                mp_poll_notify(notify);
+            }
+            #endif
             int ret = lwip_close_r(socket->fd);
             if (ret != 0) {
                 *errcode = errno;
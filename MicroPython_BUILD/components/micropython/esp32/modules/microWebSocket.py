@@ -6,10 +6,14 @@ Copyright © 2018 LoBo (https://github.com/loboris/MicroPython_ESP32_psRAM_LoBo)
 
 from   hashlib     import sha1
 from   binascii    import b2a_base64
-from   struct      import pack
+from   struct      import pack, unpack
 import _thread
 import time
 import gc
+try :
+    from websocket import websocket as _websocket
+except :
+    _websocket = None
 
 class MicroWebSocket :
 
@@ -63,6 +67,8 @@ class MicroWebSocket :
 
     def __init__(self, socket, httpClient, httpResponse, maxRecvLen, threaded, acceptCallback, stackSize=4096) :
         self._socket            = socket
+        # frames are sent by the websocket module, if available
+        self._wsWriter          = _websocket(socket, True) if _websocket else None
         self._httpCli           = httpClient
         self._closed            = True
         self.RecvTextCallback   = None
@@ -157,7 +163,10 @@ class MicroWebSocket :
                     return False
                 length = (b[0] << 8) + b[1]
             elif length == 0x7F :
-                return False
+                b = self._socket.read(8)
+                if not b or len(b) != 8 :
+                    return False
+                length = unpack('>Q', b)[0]
 
             mask = self._socket.read(4) if masked else None
             if masked and (not mask or len(mask) != 4) :
@@ -224,6 +233,13 @@ class MicroWebSocket :
     def _sendFrame(self, opcode, data=None, fin=True) :
         if not self._closed and opcode >= 0x00 and opcode <= 0x0F :
             dataLen = 0 if not data else len(data)
+            if self._wsWriter and fin and dataLen > 0 :
+                # header and payload are sent with one write, any length
+                try :
+                    self._wsWriter.ioctl(9, opcode)
+                    return self._wsWriter.write(data) == dataLen
+                except :
+                    return False
             if dataLen <= 0xFFFF :
                 b1 = (0x80 | opcode) if fin else opcode
                 b2 = 0x7E if dataLen >= 0x7E else dataLen
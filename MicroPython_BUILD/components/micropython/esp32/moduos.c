@@ -45,6 +45,10 @@
 #include "mpversion.h"
 #include "extmod/vfs_native.h"
 #include "modmachine.h"
+#if MICROPY_PERSISTENT_CODE_XIP
+#include "esp_partition.h"
+#include "py/persistentcode.h"
+#endif
 #if CONFIG_MICROPY_FILESYSTEM_TYPE == 2
 #include "libs/littleflash.h"
 #endif
@@ -122,6 +126,57 @@ STATIC mp_obj_t os_mount_sdcard(size_t n_args, const mp_obj_t *args)
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(os_mount_sdcard_obj, 0, 1, os_mount_sdcard);
 
+#if MICROPY_PERSISTENT_CODE_XIP
+// Map the data partition holding an image of precompiled modules
+// (tools/mpy-tool.py --xip) and mount it, the bytecode runs directly from flash.
+// Returns the number of modules in the image or -1 if there is no such partition.
+// The mapping is kept until the next reset.
+//------------------------------------
+int mount_xip_image(const char *label)
+{
+	const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+	if (part == NULL) return -1;
+
+	const void *ptr;
+	spi_flash_mmap_handle_t handle;
+	esp_err_t err = esp_partition_mmap(part, 0, part->size, SPI_FLASH_MMAP_DATA, &ptr, &handle);
+	if (err != ESP_OK) {
+		ESP_LOGE("uos", "Error mapping image partition '%s' (%d)", label, err);
+		mp_raise_OSError(MP_EIO);
+	}
+	// already mounted, the mapping reuses the same address
+	for (mp_xip_image_t *img = MP_STATE_VM(xip_images); img != NULL; img = img->next) {
+		if (img->image == ptr) {
+			spi_flash_munmap(handle);
+			return ((const mp_xip_header_t *)ptr)->n_module;
+		}
+	}
+
+	nlr_buf_t nlr;
+	if (nlr_push(&nlr) == 0) {
+		mp_raw_code_xip_mount(ptr, part->size);
+		nlr_pop();
+	}
+	else {
+		spi_flash_munmap(handle);
+		nlr_jump(nlr.ret_val);
+	}
+	return ((const mp_xip_header_t *)ptr)->n_module;
+}
+
+//------------------------------------------------------------------
+STATIC mp_obj_t os_mount_image(size_t n_args, const mp_obj_t *args)
+{
+	const char *label = MICROPY_PERSISTENT_CODE_XIP_LABEL;
+	if (n_args > 0) label = mp_obj_str_get_str(args[0]);
+
+	int n = mount_xip_image(label);
+	if (n < 0) mp_raise_OSError(MP_ENOENT);
+	return MP_OBJ_NEW_SMALL_INT(n);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(os_mount_image_obj, 0, 1, os_mount_image);
+#endif
+
 //------------------------------------
 STATIC mp_obj_t os_umount_sdcard(void)
 {
@@ -238,6 +293,9 @@ STATIC const mp_rom_map_elem_t os_module_globals_table[] = {
     //{ MP_ROM_QSTR(MP_QSTR_umount),		MP_ROM_PTR(&mp_vfs_umount_obj) },
     { MP_ROM_QSTR(MP_QSTR_mountsd),			MP_ROM_PTR(&os_mount_sdcard_obj) },
     { MP_ROM_QSTR(MP_QSTR_umountsd),		MP_ROM_PTR(&os_umount_sdcard_obj) },
+	#if MICROPY_PERSISTENT_CODE_XIP
+    { MP_ROM_QSTR(MP_QSTR_mountimage),		MP_ROM_PTR(&os_mount_image_obj) },
+	#endif
 	{ MP_ROM_QSTR(MP_QSTR_sdconfig),		MP_ROM_PTR(&os_sdcard_config_obj) },
 	#if CONFIG_MICROPY_FILESYSTEM_TYPE == 2
 	{ MP_ROM_QSTR(MP_QSTR_trim),			MP_ROM_PTR(&os_trim_obj) },
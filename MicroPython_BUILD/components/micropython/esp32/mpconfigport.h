@@ -61,6 +61,9 @@
 
 // emitters
 #define MICROPY_PERSISTENT_CODE_LOAD        (1)
+// precompiled modules run in place from a data partition, see uos.mountimage()
+#define MICROPY_PERSISTENT_CODE_XIP         (1)
+#define MICROPY_PERSISTENT_CODE_XIP_LABEL   "mpyimage"
 #define MICROPY_EMIT_XTENSA					(0)
 
 // compiler configuration
@@ -69,6 +72,7 @@
 
 // optimizations
 #define MICROPY_OPT_COMPUTED_GOTO           (1)
+#define MICROPY_OPT_CACHE_LOAD_METHOD       (1)
 #define MICROPY_OPT_MPZ_BITWISE             (1)
 
 // Python internal features
@@ -84,6 +88,20 @@
 // This helps eliminate stray pointers that hold on to memory that's no longer used.
 // It decreases performance due to unnecessary memory clearing.
 #define MICROPY_GC_CONSERVATIVE_CLEAR       (1)
+// Index free heap runs by size class to speed up multi-block allocations
+#ifdef CONFIG_MICROPY_GC_SIZE_CLASSES
+#define MICROPY_GC_SIZE_CLASSES             (12)
+#define MICROPY_GC_SIZE_CLASS_DEPTH         (16)
+#else
+#define MICROPY_GC_SIZE_CLASSES             (0)
+#endif
+// Incremental (time-sliced) sweep, enabled at runtime with gc.mode(gc.INCREMENTAL)
+#ifdef CONFIG_MICROPY_GC_INCREMENTAL
+#define MICROPY_GC_INCREMENTAL              (1)
+#define MICROPY_GC_STEP_US                  (CONFIG_MICROPY_GC_STEP_US)
+#else
+#define MICROPY_GC_INCREMENTAL              (0)
+#endif
 // Whether to enable finalisers in the garbage collector (ie call __del__)
 #ifdef CONFIG_MICROPY_ENABLE_FINALISER
 #define MICROPY_ENABLE_FINALISER            (1)
@@ -111,12 +129,19 @@
 #define MICROPY_MODULE_FROZEN_STR           (0) // do not support frozen str modules
 #define MICROPY_MODULE_FROZEN_MPY           (1)
 #define MICROPY_QSTR_EXTRA_POOL             mp_qstr_frozen_const_pool
+#ifdef CONFIG_MICROPY_QSTR_HASH_INDEX
+#define MICROPY_QSTR_HASH_INDEX             (1)
+#ifdef CONFIG_MICROPY_QSTR_HASH_INDEX_ROM
+#define MICROPY_QSTR_HASH_INDEX_ROM         (1)
+#endif
+#endif
 #define MICROPY_CAN_OVERRIDE_BUILTINS       (1)
 #define MICROPY_USE_INTERNAL_ERRNO          (1)
 #define MICROPY_USE_INTERNAL_PRINTF         (0) // ESP32 SDK requires its own printf, do NOT change
 #define MICROPY_ENABLE_SCHEDULER            (1) // Do NOT change
 // Maximum number of entries in the scheduler
 #define MICROPY_SCHEDULER_DEPTH             (CONFIG_MICROPY_SCHEDULER_DEPTH)
+#define MICROPY_SCHEDULER_STATS             (1)
 
 #define MICROPY_VFS                         (1) // !! DO NOT CHANGE, MUST BE 1 !!
 #define MICROPY_VFS_FAT                     (0) // !! DO NOT CHANGE, NOT USED  !!
@@ -179,6 +204,7 @@
 #define MICROPY_PY_SYS_STDIO_BUFFER         (1)
 #define MICROPY_PY_UERRNO                   (1)
 #define MICROPY_PY_USELECT                  (1)
+#define MICROPY_PY_USELECT_NOTIFY           (1)
 #define MICROPY_PY_UTIME_MP_HAL             (1)
 #define MICROPY_PY_THREAD                   (1)
 #define MICROPY_PY_THREAD_GIL               (1)
@@ -192,6 +218,7 @@
 #define MICROPY_PY_URE                      (1)
 #define MICROPY_PY_UHEAPQ                   (1)
 #define MICROPY_PY_UTIMEQ                   (1)
+#define MICROPY_PY_UASYNCIO                 (1)
 #define MICROPY_PY_UBINASCII                (1)
 #define MICROPY_PY_UBINASCII_CRC32          (1)
 #define MICROPY_PY_URANDOM                  (1)
@@ -233,6 +260,14 @@
 #define MICROPY_PY_BTREE                    (0)
 #endif
 */
+// btree.open(..., psram=True) places the page cache in psRAM
+#define MICROPY_PY_BTREE_PSRAM_MALLOC       mp_hal_psram_malloc
+
+// native VFS file buffers, open(..., buffering=n) overrides the default size;
+// buffers of MICROPY_VFS_NATIVE_PSRAM_MIN bytes or more are placed in psRAM
+#define MICROPY_VFS_NATIVE_BUFSIZE          (512)
+#define MICROPY_VFS_NATIVE_PSRAM_MIN        (2048)
+#define MICROPY_VFS_NATIVE_PSRAM_MALLOC     mp_hal_psram_malloc
 
 // fatfs configuration
 #if defined(CONFIG_FATFS_LFN_STACK)
@@ -369,6 +404,7 @@ extern const struct _mp_obj_module_t mp_module_bluetooth;
 
 #define MICROPY_PORT_ROOT_POINTERS \
     const char *readline_hist[20]; \
+    mp_obj_t websrv_callback; \
 
 // type definitions for the specific machine
 #define BYTES_PER_WORD (4)
@@ -383,11 +419,31 @@ extern const struct _mp_obj_module_t mp_module_bluetooth;
 #define MICROPY_BEGIN_ATOMIC_SECTION() portENTER_CRITICAL_NESTED()
 #define MICROPY_END_ATOMIC_SECTION(state) portEXIT_CRITICAL_NESTED(state)
 
+// The scheduler pools are used from ISRs on both CPUs, so they need the spinlock.
+// esp_timer_get_time() is in IRAM and safe to call from an ISR, mp_hal_ticks_us() is not.
+extern portMUX_TYPE mp_sched_pool_mux;
+#define MICROPY_SCHEDULER_POOL_ENTER() (portENTER_CRITICAL(&mp_sched_pool_mux), 0)
+#define MICROPY_SCHEDULER_POOL_EXIT(state) do { (void)(state); portEXIT_CRITICAL(&mp_sched_pool_mux); } while (0)
+int64_t esp_timer_get_time(void);
+#define MICROPY_SCHEDULER_TICKS_US() ((uint32_t)esp_timer_get_time())
+
+// Do the pending incremental GC work while waiting for events
+#if MICROPY_GC_INCREMENTAL
+#define MICROPY_GC_IDLE_STEP() do { extern void gc_step(void); gc_step(); } while (0)
+#else
+#define MICROPY_GC_IDLE_STEP()
+#endif
+
 #if MICROPY_PY_THREAD
+// the views of thread message buffers can't be sliced, see mp_thread_msgbuf()
+void mp_thread_msgbuf_derive(const void *buf);
+#define MICROPY_MEMORYVIEW_DERIVE_HOOK(buf) mp_thread_msgbuf_derive(buf)
+
 #define MICROPY_EVENT_POLL_HOOK \
     do { \
         extern void mp_handle_pending(void); \
         mp_handle_pending(); \
+        MICROPY_GC_IDLE_STEP(); \
         MP_THREAD_GIL_EXIT(); \
         vTaskDelay(1); \
         MP_THREAD_GIL_ENTER(); \
@@ -397,6 +453,7 @@ extern const struct _mp_obj_module_t mp_module_bluetooth;
     do { \
         extern void mp_handle_pending(void); \
         mp_handle_pending(); \
+        MICROPY_GC_IDLE_STEP(); \
         asm("waiti 0"); \
     } while (0);
 #endif
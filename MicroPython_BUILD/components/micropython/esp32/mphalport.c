@@ -31,6 +31,7 @@
 #include <sys/time.h>
 #include <time.h>
 #include <string.h>
+#include <stdlib.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -39,11 +40,14 @@
 #include "driver/uart.h"
 #include "esp_task_wdt.h"
 #include "esp_log.h"
+#include "esp_heap_caps.h"
 
 #include "py/obj.h"
 #include "py/mpstate.h"
 #include "py/mphal.h"
+#include "py/runtime.h"
 #include "extmod/misc.h"
+#include "extmod/moduselect.h"
 #include "lib/utils/pyexec.h"
 #include "uart.h"
 #include "machine_rtc.h"
@@ -109,6 +113,12 @@ void mp_hal_set_wdt_tmo()
 }
 
 
+#ifdef CONFIG_MICROPY_USE_TELNET
+static char telnet_rx_buf[32];
+static int telnet_rx_len = 0;
+static int telnet_rx_idx = 0;
+#endif
+
 // wait until at least one character is received or the timeout expires
 //---------------------------------------
 int mp_hal_stdin_rx_chr(uint32_t timeout)
@@ -125,13 +135,18 @@ int mp_hal_stdin_rx_chr(uint32_t timeout)
     	if (mp_hal_ticks_ms() > wait_end) return -1;
 
 		#ifdef CONFIG_MICROPY_USE_TELNET
-		// read telnet first
-		if (telnet_rx_any()) return telnet_rx_char();
+		// read telnet first, the received characters are fetched in chunks
+		if (telnet_rx_idx >= telnet_rx_len) {
+			telnet_rx_len = telnet_rx_strn(telnet_rx_buf, sizeof(telnet_rx_buf));
+			telnet_rx_idx = 0;
+		}
+		if (telnet_rx_idx < telnet_rx_len) return (uint8_t)telnet_rx_buf[telnet_rx_idx++];
 		#endif
 
 		c = ringbuf_get(&stdin_ringbuf);
     	if (c < 0) {
     		// no character in ring buffer
+    		MICROPY_GC_IDLE_STEP();
         	// wait max 10 ms for character
     	   	MP_THREAD_GIL_EXIT();
         	if ( xSemaphoreTake( uart0_semaphore, 10 / portTICK_PERIOD_MS ) == pdTRUE ) {
@@ -190,25 +205,6 @@ int mp_hal_stdin_rx_chr(uint32_t timeout)
     return -1;
 }
 
-#ifdef CONFIG_MICROPY_USE_TELNET
-// Convert '\n' to '\r\n'
-//-------------------------------------------------------------
-static void telnet_stdout_tx_str(const char *str, uint32_t len)
-{
-	char *tstr = malloc(len*2+1);
-	char prev = '\0';
-	uint32_t idx = 0;
-	while (len--) {
-		if ((*str == '\n') && (prev != '\r')) tstr[idx++] = '\r';
-		tstr[idx++] = *str;
-		prev = *str++;
-	}
-	tstr[idx++] = '\0';
-	telnet_tx_strn(tstr, strlen(tstr));
-	free(tstr);
-}
-#endif
-
 // send newline character to printf channel
 //-------------------------------
 void mp_hal_stdout_tx_newline() {
@@ -271,7 +267,7 @@ void mp_hal_stdout_tx_strn(const char *str, uint32_t len) {
 void mp_hal_stdout_tx_strn_cooked(const char *str, uint32_t len) {
 	if (str == NULL) return;
 	#ifdef CONFIG_MICROPY_USE_TELNET
-   	if (telnet_loggedin()) telnet_stdout_tx_str(str, len);
+   	if (telnet_loggedin()) telnet_tx_strn_cooked(str, len);
    	else {
    	   	MP_THREAD_GIL_EXIT();
    	    while (len--) {
@@ -366,6 +362,7 @@ int mp_hal_delay_ms(uint32_t ms)
 	uint32_t tend = tstart;
 	uint32_t nres = tstart + (CONFIG_TASK_WDT_TIMEOUT_S * 500);
 
+	MICROPY_GC_IDLE_STEP();
 	MP_THREAD_GIL_EXIT();
 
 	int ncheck = 0;
@@ -413,3 +410,68 @@ void mp_hal_delay_us(uint32_t us) {
 void mp_hal_delay_us_fast(uint32_t us) {
     ets_delay_us(us);
 }
+
+extern bool mpy_use_spiram;
+
+// Allocate from psRAM if it is available and has room, else from the regular heap
+//----------------------------------------
+void *mp_hal_psram_malloc(size_t size)
+{
+	void *p = NULL;
+	if (mpy_use_spiram) p = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+	if (p == NULL) p = malloc(size);
+	return p;
+}
+
+// Spinlock for the scheduler pool free lists, see mpconfigport.h
+portMUX_TYPE mp_sched_pool_mux = portMUX_INITIALIZER_UNLOCKED;
+
+#if MICROPY_PY_USELECT_NOTIFY
+// Readiness notification support for uselect.poll, see extmod/moduselect.h
+
+static portMUX_TYPE poll_mux = portMUX_INITIALIZER_UNLOCKED;
+
+//----------------------------
+void *mp_hal_poll_sem_new(void)
+{
+	SemaphoreHandle_t sem = xSemaphoreCreateBinary();
+	if (sem == NULL) {
+		mp_raise_msg(&mp_type_MemoryError, "error creating poll semaphore");
+	}
+	return sem;
+}
+
+//-----------------------------------
+void mp_hal_poll_sem_delete(void *sem)
+{
+	vSemaphoreDelete((SemaphoreHandle_t)sem);
+}
+
+//---------------------------------
+void mp_hal_poll_sem_give(void *sem)
+{
+	xSemaphoreGive((SemaphoreHandle_t)sem);
+}
+
+// Called with the GIL held, sleep until the semaphore is given or timeout expires
+//---------------------------------------------------------
+void mp_hal_poll_sem_take(void *sem, mp_uint_t timeout_ms)
+{
+	MICROPY_GC_IDLE_STEP();
+	MP_THREAD_GIL_EXIT();
+	xSemaphoreTake((SemaphoreHandle_t)sem, (timeout_ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS);
+	MP_THREAD_GIL_ENTER();
+}
+
+//-------------------------
+void mp_hal_poll_lock(void)
+{
+	portENTER_CRITICAL(&poll_mux);
+}
+
+//---------------------------
+void mp_hal_poll_unlock(void)
+{
+	portEXIT_CRITICAL(&poll_mux);
+}
+#endif
@@ -64,6 +64,7 @@ void mp_hal_delay_us(uint32_t);
 void mp_hal_delay_us_fast(uint32_t);
 void mp_hal_set_interrupt_char(int c);
 uint32_t mp_hal_get_cpu_freq(void);
+void *mp_hal_psram_malloc(size_t size);
 
 #define mp_hal_quiet_timing_enter() MICROPY_BEGIN_ATOMIC_SECTION()
 #define mp_hal_quiet_timing_exit(irq_state) MICROPY_END_ATOMIC_SECTION(irq_state)
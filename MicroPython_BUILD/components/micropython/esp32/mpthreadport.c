@@ -37,9 +37,11 @@
 #include "soc/cpu.h"
 
 #include "py/mpstate.h"
+#include "py/runtime.h"
 #include "py/gc.h"
 #include "py/mpthread.h"
 #include "py/mphal.h"
+#include "py/objarray.h"
 #include "mpthreadport.h"
 #include "modmachine.h"
 
@@ -72,6 +74,13 @@ uint8_t main_accept_msg = 1;
 
 // this structure forms a linked list, one node per active thread
 //========================
+// message slab buffer
+typedef struct _thread_msg_slot_t {
+    uint8_t state;
+    TaskHandle_t owner;					// sender while reserved, receiver while held
+    mp_obj_t view;						// memoryview given to the owner
+} thread_msg_slot_t;
+
 typedef struct _thread_t {
     TaskHandle_t id;					// system id of thread
     int ready;							// whether the thread is ready and running
@@ -91,13 +100,24 @@ typedef struct _thread_t {
     int8_t deleted;
     int16_t notifyed;
     uint16_t type;
+    uint8_t *msg_slab;					// buffers for messages passed by reference, on the heap
+    thread_msg_slot_t msg_slot[THREAD_MSG_SLAB_ITEMS];	// state of the slab buffers
+    int8_t msg_slab_held;				// a slab buffer is held by the last received message
+    TaskHandle_t msg_dest_id;			// cached destination of the last sent message
+    struct _thread_t *msg_dest;
+    uint32_t msg_dest_gen;
     struct _thread_t *next;
 } thread_t;
 
+// thread local storage index of the thread's linked list node
+#define THREAD_TLS_INDEX	2
+
 // the mutex controls access to the linked list
 STATIC mp_thread_mutex_t thread_mutex;
 STATIC thread_t thread_entry0;
 STATIC thread_t *thread = NULL; // root pointer, handled by mp_thread_gc_others
+// incremented when a node is removed from the list, invalidates the cached destinations
+STATIC uint32_t thread_list_gen = 0;
 
 //~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
 void vPortCleanUpTCB(void *tcb)
@@ -114,9 +134,11 @@ void vPortCleanUpTCB(void *tcb)
 					// move the start pointer
 					thread = th->next;
 				}
+				thread_list_gen++;
 				// explicitly release all its memory
 				if (th->tcb) free(th->tcb);
 				if (th->stack) free(th->stack);
+				// the message slab is on the heap and freed by the GC
 				//m_del(thread_t, th, 1);
 				free(th);
 				break;
@@ -152,8 +174,13 @@ void mp_thread_preinit(void *stack, uint32_t stack_len)
     thread->deleted = 0;
     thread->notifyed = 0;
     thread->type = THREAD_TYPE_MAIN;
+    thread->msg_slab = NULL;
+    memset(thread->msg_slot, 0, sizeof(thread->msg_slot));
+    thread->msg_slab_held = 0;
+    thread->msg_dest_id = NULL;
     thread->next = NULL;
     MainTaskHandle = thread->id;
+    vTaskSetThreadLocalStoragePointer(NULL, THREAD_TLS_INDEX, thread);
 
 }
 
@@ -161,6 +188,13 @@ void mp_thread_preinit(void *stack, uint32_t stack_len)
 void mp_thread_gc_others(int flag) {
     mp_thread_mutex_lock(&thread_mutex, 1);
     for (thread_t *th = thread; th != NULL; th = th->next) {
+    	if (th->msg_slab) {
+			// Mark the message slab and the views given to its buffers' owners
+			gc_collect_root((void **)&th->msg_slab, 1);
+			for (int idx=0; idx<THREAD_MSG_SLAB_ITEMS; idx++) {
+				if (th->msg_slot[idx].view != MP_OBJ_NULL) gc_collect_root((void **)&th->msg_slot[idx].view, 1);
+			}
+    	}
         if (!th->ready) {
             continue;
         }
@@ -219,6 +253,7 @@ void mp_thread_start(void) {
     for (thread_t *th = thread; th != NULL; th = th->next) {
         if (th->id == xTaskGetCurrentTaskHandle()) {
             th->ready = 1;
+            vTaskSetThreadLocalStoragePointer(NULL, THREAD_TLS_INDEX, th);
             break;
         }
     }
@@ -344,6 +379,8 @@ void *mp_thread_create(void *(*entry)(void*), void *arg, size_t *stack_size, cha
     return mp_thread_create_ex(entry, arg, stack_size, MP_THREAD_PRIORITY, name, same_core);
 }
 
+STATIC void mp_thread_slot_set(thread_t *th, int idx, uint8_t state);
+
 //---------------------------------------
 STATIC void mp_clean_thread(thread_t *th)
 {
@@ -354,11 +391,28 @@ STATIC void mp_clean_thread(thread_t *th)
 			if (n > 0) {
 				thread_msg_t msg;
 				xQueueReceive(th->threadQueue, &msg, 0);
-				if (msg.strdata != NULL) free(msg.strdata);
+				// slab buffers are released below
+				if ((msg.strdata != NULL) && (msg.type != THREAD_MSG_TYPE_BUFFER)) free(msg.strdata);
 			}
 		}
 		if (th->threadQueue) vQueueDelete(th->threadQueue);
 		th->threadQueue = NULL;
+		thread_list_gen++;
+	}
+	// Release the thread's slab, the views given to its buffers' owners are emptied
+	for (int idx=0; idx<THREAD_MSG_SLAB_ITEMS; idx++) {
+		mp_thread_slot_set(th, idx, THREAD_MSG_SLOT_FREE);
+	}
+	th->msg_slab = NULL;
+	th->msg_slab_held = 0;
+	// Reclaim the buffers the thread reserved but not sent
+	for (thread_t *dest = thread; dest != NULL; dest = dest->next) {
+		if (dest == th) continue;
+		for (int idx=0; idx<THREAD_MSG_SLAB_ITEMS; idx++) {
+			if ((dest->msg_slot[idx].state == THREAD_MSG_SLOT_ALLOC) && (dest->msg_slot[idx].owner == th->id)) {
+				mp_thread_slot_set(dest, idx, THREAD_MSG_SLOT_FREE);
+			}
+		}
 	}
     th->ready = 0;
 	th->deleted = 1;
@@ -645,80 +699,331 @@ int mp_thread_getname(TaskHandle_t id, char *name) {
     return res;
 }
 
-//-------------------------------------------------------------------------------------------------
-int mp_thread_semdmsg(TaskHandle_t id, int type, uint32_t msg_int, uint8_t *buf, uint32_t buflen) {
-	int res = 0;
-    mp_thread_mutex_lock(&thread_mutex, 1);
+// Find the destination thread of a directed message, thread_mutex must be locked
+// The last destination is cached in the sender's node, so the list is not
+// walked while sending a stream of messages to the same thread
+//------------------------------------------------------
+STATIC thread_t *mp_thread_find_dest(TaskHandle_t id)
+{
+	thread_t *self = pvTaskGetThreadLocalStoragePointer(NULL, THREAD_TLS_INDEX);
+	if ((self) && (self->msg_dest_id == id) && (self->msg_dest_gen == thread_list_gen)) return self->msg_dest;
+
     for (thread_t *th = thread; th != NULL; th = th->next) {
         // don't send to the current task or service thread
         if ((th->id == xTaskGetCurrentTaskHandle()) || (th->type == THREAD_TYPE_SERVICE)) {
             continue;
         }
-        if ((id == 0) || (th->id == id)) {
-        	if (th->threadQueue == NULL) break;
-    		thread_msg_t msg;
-    	    struct timeval tv;
-    	    uint64_t tmstamp;
-    	    gettimeofday(&tv, NULL);
-    	    tmstamp = (tv.tv_sec * 1000) + (tv.tv_usec / 1000);
-    	    msg.timestamp = tmstamp;
-			msg.sender_id = xTaskGetCurrentTaskHandle();
-			if (type == THREAD_MSG_TYPE_INTEGER) {
-				msg.intdata = msg_int;
-				msg.strdata = NULL;
-				msg.type = type;
-				res = 1;
+        if (th->id == id) {
+        	if (self) {
+        		self->msg_dest_id = id;
+        		self->msg_dest = th;
+        		self->msg_dest_gen = thread_list_gen;
+        	}
+        	return th;
+        }
+    }
+    return NULL;
+}
+
+// Returns the index of the slab buffer containing 'buf' or -1
+//----------------------------------------------------------------------------
+STATIC int mp_thread_slab_index(thread_t *th, uint8_t *buf, uint32_t buflen)
+{
+	if ((th->msg_slab == NULL) || (buf < th->msg_slab)) return -1;
+	uint32_t offset = buf - th->msg_slab;
+	int idx = offset / THREAD_MSG_SLAB_BUF_SIZE;
+	if (idx >= THREAD_MSG_SLAB_ITEMS) return -1;
+	if ((offset + buflen) > ((idx+1) * THREAD_MSG_SLAB_BUF_SIZE)) return -1;
+	return idx;
+}
+
+// Give the memoryview of the slab buffer to its current owner
+// The view references the slab's start (and the buffer's offset), so the slab
+// stays allocated as long as any view of it, or its slice, exists
+//-----------------------------------------------------------------------------------------------------------
+STATIC mp_obj_t mp_thread_slot_view(thread_t *th, int idx, mp_obj_array_t *view, uint8_t *buf, uint32_t buflen)
+{
+	view->items = th->msg_slab;
+	view->free = buf - th->msg_slab;
+	view->len = buflen;
+	th->msg_slot[idx].view = MP_OBJ_FROM_PTR(view);
+	return th->msg_slot[idx].view;
+}
+
+// End the ownership of the slab buffer: the owner's view is emptied
+// thread_mutex must be locked, or the caller must be the only possible owner
+//-------------------------------------------------------------------
+STATIC void mp_thread_slot_set(thread_t *th, int idx, uint8_t state)
+{
+	thread_msg_slot_t *slot = &th->msg_slot[idx];
+	if (slot->view != MP_OBJ_NULL) {
+		((mp_obj_array_t *)MP_OBJ_TO_PTR(slot->view))->len = 0;
+		slot->view = MP_OBJ_NULL;
+	}
+	if (state == THREAD_MSG_SLOT_FREE) slot->owner = NULL;
+	slot->state = state;
+}
+
+//------------------------------------------------------------------------------------------------------------
+STATIC int mp_thread_queue_msg(thread_t *th, int type, uint32_t msg_int, uint8_t *buf, uint32_t buflen)
+{
+	int res = 0;
+	int idx = -1;
+	thread_msg_t msg;
+    struct timeval tv;
+    uint64_t tmstamp;
+
+    if (th->threadQueue == NULL) return 0;
+
+    gettimeofday(&tv, NULL);
+    tmstamp = (tv.tv_sec * 1000) + (tv.tv_usec / 1000);
+    msg.timestamp = tmstamp;
+	msg.sender_id = xTaskGetCurrentTaskHandle();
+	if (type == THREAD_MSG_TYPE_INTEGER) {
+		msg.intdata = msg_int;
+		msg.strdata = NULL;
+		msg.type = type;
+		res = 1;
+	}
+	else if (type == THREAD_MSG_TYPE_STRING) {
+		msg.intdata = buflen;
+		msg.strdata = malloc(buflen+1);
+		if (msg.strdata != NULL) {
+			memcpy(msg.strdata, buf, buflen);
+			msg.strdata[buflen] = 0;
+			msg.type = type;
+			res = 1;
+		}
+	}
+	else if (type == THREAD_MSG_TYPE_BUFFER) {
+		// only the buffer reference is passed
+		// the buffer must be reserved by the sender and not already sent (checked by mp_thread_sendbuf)
+		idx = mp_thread_slab_index(th, buf, buflen);
+		if (idx >= 0) {
+			msg.intdata = buflen;
+			msg.strdata = buf;
+			msg.type = type;
+			res = 1;
+		}
+	}
+	if (res) {
+		if (xQueueSend(th->threadQueue, &msg, 0) != pdTRUE) {
+			// queue full, the sender keeps the buffer
+			res = 0;
+			if (type == THREAD_MSG_TYPE_STRING) free(msg.strdata);
+		}
+		else if (type == THREAD_MSG_TYPE_BUFFER) {
+			// the ownership passes to the receiver
+			mp_thread_slot_set(th, idx, THREAD_MSG_SLOT_QUEUED);
+		}
+	}
+	return res;
+}
+
+// Send the message to the thread 'id' or, if 'id' is 0, to all threads
+// Returns the number of threads the message was queued to
+//-------------------------------------------------------------------------------------------------
+int mp_thread_semdmsg(TaskHandle_t id, int type, uint32_t msg_int, uint8_t *buf, uint32_t buflen) {
+	int res = 0;
+	// slab buffers are sent with mp_thread_sendbuf
+	if (type == THREAD_MSG_TYPE_BUFFER) return 0;
+    mp_thread_mutex_lock(&thread_mutex, 1);
+    if (id != 0) {
+    	thread_t *th = mp_thread_find_dest(id);
+    	if (th) res = mp_thread_queue_msg(th, type, msg_int, buf, buflen);
+    }
+    else {
+        for (thread_t *th = thread; th != NULL; th = th->next) {
+            // don't send to the current task or service thread
+            if ((th->id == xTaskGetCurrentTaskHandle()) || (th->type == THREAD_TYPE_SERVICE)) {
+                continue;
+            }
+        	res += mp_thread_queue_msg(th, type, msg_int, buf, buflen);
+        }
+    }
+    mp_thread_mutex_unlock(&thread_mutex);
+    return res;
+}
+
+//-----------------------------------------
+STATIC thread_t *mp_thread_get_self(void)
+{
+	thread_t *self = pvTaskGetThreadLocalStoragePointer(NULL, THREAD_TLS_INDEX);
+	if (self == NULL) {
+		// not a MicroPython thread started with mp_thread_start
+	    mp_thread_mutex_lock(&thread_mutex, 1);
+	    for (thread_t *th = thread; th != NULL; th = th->next) {
+	        if (th->id == xTaskGetCurrentTaskHandle()) {
+	        	self = th;
+	        	break;
+	        }
+	    }
+	    mp_thread_mutex_unlock(&thread_mutex);
+	}
+	return self;
+}
+
+// Get the free buffer from the destination thread's slab
+// The slab is allocated from the heap on first use and is referenced from the thread's node
+// A sender can have only one unsent buffer per destination: if it already
+// reserved one, that buffer is reused and its previous view emptied
+// Heap allocations are made with thread_mutex unlocked, as they can run the GC
+//------------------------------------------
+mp_obj_t mp_thread_msgbuf(TaskHandle_t id)
+{
+	mp_obj_t res = mp_const_none;
+	TaskHandle_t self = xTaskGetCurrentTaskHandle();
+	mp_obj_array_t *view = MP_OBJ_TO_PTR(mp_obj_new_memoryview('B' | 0x80, 0, NULL));
+	uint8_t *slab = NULL;
+
+    mp_thread_mutex_lock(&thread_mutex, 1);
+	thread_t *th = mp_thread_find_dest(id);
+	bool new_slab = ((th) && (th->threadQueue) && (th->msg_slab == NULL));
+    mp_thread_mutex_unlock(&thread_mutex);
+	if (new_slab) {
+		slab = m_new_maybe(uint8_t, THREAD_MSG_SLAB_ITEMS * THREAD_MSG_SLAB_BUF_SIZE);
+		if (slab == NULL) return res;
+	}
+
+    mp_thread_mutex_lock(&thread_mutex, 1);
+	th = mp_thread_find_dest(id);
+	if ((th) && (th->threadQueue)) {
+		// if another sender allocated the slab in the meantime, ours is left to the GC
+		if (th->msg_slab == NULL) th->msg_slab = slab;
+		if (th->msg_slab) {
+			int idx;
+			for (idx=0; idx<THREAD_MSG_SLAB_ITEMS; idx++) {
+				if ((th->msg_slot[idx].state == THREAD_MSG_SLOT_ALLOC) && (th->msg_slot[idx].owner == self)) break;
 			}
-			else if (type == THREAD_MSG_TYPE_STRING) {
-				msg.intdata = buflen;
-				msg.strdata = malloc(buflen+1);
-				if (msg.strdata != NULL) {
-					memcpy(msg.strdata, buf, buflen);
-					msg.strdata[buflen] = 0;
-					msg.type = type;
-					res = 1;
+			if (idx >= THREAD_MSG_SLAB_ITEMS) {
+				for (idx=0; idx<THREAD_MSG_SLAB_ITEMS; idx++) {
+					if (th->msg_slot[idx].state == THREAD_MSG_SLOT_FREE) break;
 				}
 			}
-			if (res) {
-				if (xQueueSend(th->threadQueue, &msg, 0) != pdTRUE) res = 0;
+			if (idx < THREAD_MSG_SLAB_ITEMS) {
+				mp_thread_slot_set(th, idx, THREAD_MSG_SLOT_ALLOC);
+				th->msg_slot[idx].owner = self;
+				res = mp_thread_slot_view(th, idx, view, th->msg_slab + (idx * THREAD_MSG_SLAB_BUF_SIZE), THREAD_MSG_SLAB_BUF_SIZE);
 			}
-            if (id != 0) break;
-        }
-    }
+		}
+	}
+    mp_thread_mutex_unlock(&thread_mutex);
+    return res;
+}
+
+// Send the first 'buflen' bytes of the slab buffer to the thread 'id'
+// 'view' must be the memoryview returned by 'mp_thread_msgbuf' for that thread,
+// reserved by the caller and not yet sent; it is emptied when the buffer is queued.
+// Returns 1 if queued, 0 if the queue is full (the sender keeps the buffer)
+// and -1 if 'view' is not such a buffer, or 'buflen' is too large
+//----------------------------------------------------------------
+int mp_thread_sendbuf(TaskHandle_t id, mp_obj_t view, uint32_t buflen)
+{
+	int res = -1;
+	TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    mp_thread_mutex_lock(&thread_mutex, 1);
+	thread_t *th = mp_thread_find_dest(id);
+	if ((th) && (th->msg_slab) && (buflen <= THREAD_MSG_SLAB_BUF_SIZE)) {
+		for (int idx=0; idx<THREAD_MSG_SLAB_ITEMS; idx++) {
+			thread_msg_slot_t *slot = &th->msg_slot[idx];
+			if ((slot->view == view) && (slot->state == THREAD_MSG_SLOT_ALLOC) && (slot->owner == self)) {
+				res = mp_thread_queue_msg(th, THREAD_MSG_TYPE_BUFFER, 0, th->msg_slab + (idx * THREAD_MSG_SLAB_BUF_SIZE), buflen);
+				break;
+			}
+		}
+	}
+    mp_thread_mutex_unlock(&thread_mutex);
+    return res;
+}
+
+// Refuse to slice a view of a slab buffer, or to make a new memoryview of it:
+// the new view could not be emptied when the ownership of the buffer ends
+// Called by MICROPY_MEMORYVIEW_DERIVE_HOOK
+//--------------------------------------------
+void mp_thread_msgbuf_derive(const void *buf)
+{
+	bool slab = false;
+    mp_thread_mutex_lock(&thread_mutex, 1);
+	for (thread_t *th = thread; th != NULL; th = th->next) {
+		if ((th->msg_slab) && ((const uint8_t *)buf >= th->msg_slab) && ((const uint8_t *)buf < (th->msg_slab + (THREAD_MSG_SLAB_ITEMS * THREAD_MSG_SLAB_BUF_SIZE)))) {
+			slab = true;
+			break;
+		}
+	}
+    mp_thread_mutex_unlock(&thread_mutex);
+	if (slab) mp_raise_ValueError("message buffer can't be sliced, send it with a length");
+}
+
+// Create the view of the buffer received by the last 'mp_thread_getmsg'
+// The view is emptied when the buffer is released by the next 'mp_thread_getmsg'
+//--------------------------------------------------------------
+mp_obj_t mp_thread_msgbuf_view(uint8_t *buf, uint32_t buflen)
+{
+	mp_obj_t res = mp_const_none;
+	thread_t *th = mp_thread_get_self();
+	if (th == NULL) return res;
+	mp_obj_array_t *view = MP_OBJ_TO_PTR(mp_obj_new_memoryview('B' | 0x80, 0, NULL));
+
+    mp_thread_mutex_lock(&thread_mutex, 1);
+	int idx = mp_thread_slab_index(th, buf, buflen);
+	if ((idx >= 0) && (th->msg_slot[idx].state == THREAD_MSG_SLOT_HELD) && (th->msg_slot[idx].view == MP_OBJ_NULL)) {
+		res = mp_thread_slot_view(th, idx, view, buf, buflen);
+	}
     mp_thread_mutex_unlock(&thread_mutex);
     return res;
 }
 
+// The receiving thread's node and queue can only be removed by the thread itself,
+// so the message is received without locking thread_mutex,
+// it is only locked to change the state of the slab buffers
 //------------------------------------------------------------------------------------------
 int mp_thread_getmsg(uint32_t *msg_int, uint8_t **buf, uint32_t *buflen, uint32_t *sender) {
 	int res = 0;
-    mp_thread_mutex_lock(&thread_mutex, 1);
-    for (thread_t *th = thread; th != NULL; th = th->next) {
-        // get message for current task
-        if ((th->id == xTaskGetCurrentTaskHandle()) && (th->type != THREAD_TYPE_SERVICE)) {
-        	if (th->threadQueue == NULL) break;
-
-        	thread_msg_t msg;
-        	if (xQueueReceive(th->threadQueue, &msg, 0) == pdTRUE) {
-        		*sender = (uint32_t)msg.sender_id;
-        		if (msg.type == THREAD_MSG_TYPE_INTEGER) {
-        			*msg_int = msg.intdata;
-        			*buflen = 0;
-        			res = THREAD_MSG_TYPE_INTEGER;
-        		}
-        		else if (msg.type == THREAD_MSG_TYPE_STRING) {
-        			*msg_int = 0;
-        			if ((msg.strdata != NULL) && (msg.intdata > 0)) {
-            			*buflen = msg.intdata;
-            			*buf = msg.strdata;
-            			res = THREAD_MSG_TYPE_STRING;
-        			}
-        		}
-        	}
-        	break;
-        }
-    }
-    mp_thread_mutex_unlock(&thread_mutex);
+	thread_t *th = mp_thread_get_self();
+    // get message for current task
+	if ((th == NULL) || (th->type == THREAD_TYPE_SERVICE) || (th->threadQueue == NULL)) return 0;
+
+	// the buffer received with the previous message is returned to the slab
+	if (th->msg_slab_held) {
+	    mp_thread_mutex_lock(&thread_mutex, 1);
+		for (int idx=0; idx<THREAD_MSG_SLAB_ITEMS; idx++) {
+			if (th->msg_slot[idx].state == THREAD_MSG_SLOT_HELD) mp_thread_slot_set(th, idx, THREAD_MSG_SLOT_FREE);
+		}
+		th->msg_slab_held = 0;
+	    mp_thread_mutex_unlock(&thread_mutex);
+	}
+
+	thread_msg_t msg;
+	if (xQueueReceive(th->threadQueue, &msg, 0) == pdTRUE) {
+		*sender = (uint32_t)msg.sender_id;
+		if (msg.type == THREAD_MSG_TYPE_INTEGER) {
+			*msg_int = msg.intdata;
+			*buflen = 0;
+			res = THREAD_MSG_TYPE_INTEGER;
+		}
+		else if (msg.type == THREAD_MSG_TYPE_STRING) {
+			*msg_int = 0;
+			if ((msg.strdata != NULL) && (msg.intdata > 0)) {
+    			*buflen = msg.intdata;
+    			*buf = msg.strdata;
+    			res = THREAD_MSG_TYPE_STRING;
+			}
+		}
+		else if (msg.type == THREAD_MSG_TYPE_BUFFER) {
+			*msg_int = 0;
+			*buflen = msg.intdata;
+			*buf = msg.strdata;
+		    mp_thread_mutex_lock(&thread_mutex, 1);
+			int idx = mp_thread_slab_index(th, msg.strdata, msg.intdata);
+			if (idx >= 0) {
+				mp_thread_slot_set(th, idx, THREAD_MSG_SLOT_HELD);
+				th->msg_slot[idx].owner = xTaskGetCurrentTaskHandle();
+				th->msg_slab_held = 1;
+			}
+		    mp_thread_mutex_unlock(&thread_mutex);
+			res = THREAD_MSG_TYPE_BUFFER;
+		}
+	}
 
     return res;
 }
@@ -875,7 +1180,8 @@ void telnet_task (void *pvParameters)
             break;
         }
 
-        vTaskDelay(1);
+        // wait for the next run, woken up earlier if there is a full TX segment to send
+        ulTaskNotifyTake(pdTRUE, 1);
 
         // ---- Check if network is still available ----
         if (!_check_network()) {
@@ -921,6 +1227,7 @@ uintptr_t mp_thread_createTelnetTask(size_t stack_size)
 void ftp_task (void *pvParameters)
 {
     uint64_t elapsed, time_ms = mp_hal_ticks_ms();
+    uint32_t busy_ms = 0;
     // Initialize ftp, create rx buffer and mutex
     if (!ftp_init()) {
         ESP_LOGE("[Ftp]", "Init Error");
@@ -950,7 +1257,16 @@ void ftp_task (void *pvParameters)
             break;
         }
 
-        vTaskDelay(1);
+        // ftp_run() waits for the socket activity itself,
+        // while the transfers keep it busy, yield to the lower priority tasks periodically
+        if (res > 0) {
+            busy_ms += elapsed;
+            if (busy_ms >= 100) {
+                vTaskDelay(1);
+                busy_ms = 0;
+            }
+        }
+        else busy_ms = 0;
 
         // ---- Check if network is still available ----
         if (!_check_network()) {
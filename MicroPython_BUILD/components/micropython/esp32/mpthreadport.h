@@ -33,6 +33,7 @@
 #include "freertos/semphr.h"
 #include "freertos/queue.h"
 #include "sdkconfig.h"
+#include "py/obj.h"
 
 
 // Thread types
@@ -86,15 +87,33 @@ typedef struct _mp_thread_mutex_t {
 #define THREAD_MSG_TYPE_NONE		0
 #define THREAD_MSG_TYPE_INTEGER		1
 #define THREAD_MSG_TYPE_STRING		2
+#define THREAD_MSG_TYPE_BUFFER		3
 #define MAX_THREAD_MESSAGES			8
 #define THREAD_QUEUE_MAX_ITEMS		8
 
+// Buffer messages are passed by reference, without copying.
+// The sender gets a buffer from the receiver's slab with 'mp_thread_msgbuf',
+// fills it and sends it with 'mp_thread_sendbuf'; the ownership passes to the
+// receiver, which holds the buffer until its next 'mp_thread_getmsg' call.
+// The memoryview given to the current owner is emptied when the ownership ends.
+// It is the only view of the buffer: only that view is accepted for sending,
+// and it can't be sliced or wrapped in another memoryview, which would keep
+// the buffer accessible after the ownership passed on.
+#define THREAD_MSG_SLAB_ITEMS		4
+#define THREAD_MSG_SLAB_BUF_SIZE	1024
+
+// slab buffer states
+#define THREAD_MSG_SLOT_FREE		0
+#define THREAD_MSG_SLOT_ALLOC		1	// reserved by the sender
+#define THREAD_MSG_SLOT_QUEUED		2	// sent, waiting in the receiver's queue
+#define THREAD_MSG_SLOT_HELD		3	// received, owned by the receiver
+
 // this structure is used for inter-thread communication/data passing
 typedef struct _thread_msg_t {
     int type;						// message type
     TaskHandle_t sender_id;			// id of the message sender
     uint32_t intdata;					// integer data or string data length
-    uint8_t *strdata;				// string data
+    uint8_t *strdata;				// string data or slab buffer
     uint32_t timestamp;				// message timestamp in ms
 } thread_msg_t;
 
@@ -133,6 +152,9 @@ int mp_thread_notifyPending(TaskHandle_t id);
 void mp_thread_resetPending();
 int mp_thread_semdmsg(TaskHandle_t id, int type, uint32_t msg_int, uint8_t *buf, uint32_t buflen);
 int mp_thread_getmsg(uint32_t *msg_int, uint8_t **buf, uint32_t *buflen, uint32_t *sender);
+mp_obj_t mp_thread_msgbuf(TaskHandle_t id);
+int mp_thread_sendbuf(TaskHandle_t id, mp_obj_t view, uint32_t buflen);
+mp_obj_t mp_thread_msgbuf_view(uint8_t *buf, uint32_t buflen);
 int mp_thread_status(TaskHandle_t id);
 
 int mp_thread_set_sp(void *sp, void *top);
@@ -29,8 +29,11 @@
 #include <string.h>
 #include <errno.h> // for declaration of global errno variable
 #include <fcntl.h>
+#include <stdlib.h>
 
+#include "py/nlr.h"
 #include "py/runtime.h"
+#include "py/mphal.h"
 #include "py/stream.h"
 
 #if MICROPY_PY_BTREE
@@ -102,6 +105,73 @@ STATIC mp_obj_t btree_put(size_t n_args, const mp_obj_t *args) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(btree_put_obj, 3, 4, btree_put);
 
+typedef struct _btree_load_t {
+    mp_obj_t iter;
+    mp_obj_t item;  // keeps the current key and value alive
+    mp_obj_t exc;
+} btree_load_t;
+
+// Called by __bt_load() for the next (key, value) pair; an exception is
+// kept and raised after the load has finished, so no page is left pinned
+STATIC int btree_load_next(void *arg, DBT *key, DBT *val) {
+    btree_load_t *ld = arg;
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_obj_t item = mp_iternext(ld->iter);
+        if (item == MP_OBJ_STOP_ITERATION) {
+            nlr_pop();
+            return 0;
+        }
+        mp_obj_t *kv;
+        mp_obj_get_array_fixed_n(item, 2, &kv);
+        key->data = (void*)mp_obj_str_get_data(kv[0], &key->size);
+        val->data = (void*)mp_obj_str_get_data(kv[1], &val->size);
+        ld->item = item;
+        nlr_pop();
+        return 1;
+    } else {
+        ld->exc = MP_OBJ_FROM_PTR(nlr.ret_val);
+        return -1;
+    }
+}
+
+STATIC mp_obj_t btree_load(size_t n_args, const mp_obj_t *args) {
+    mp_obj_btree_t *self = MP_OBJ_TO_PTR(args[0]);
+    mp_int_t fill = 100;
+    if (n_args > 2) {
+        fill = mp_obj_get_int(args[2]);
+        if (fill < 10 || fill > 100) {
+            mp_raise_ValueError("fill must be 10..100");
+        }
+    }
+    btree_load_t ld;
+    ld.iter = mp_getiter(args[1], NULL);
+    ld.item = mp_const_none;
+    ld.exc = MP_OBJ_NULL;
+    int res = __bt_load(self->db, btree_load_next, &ld, fill);
+    if (ld.exc != MP_OBJ_NULL) {
+        nlr_raise(ld.exc);
+    }
+    CHECK_ERROR(res);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(btree_load_obj, 2, 3, btree_load);
+
+STATIC mp_obj_t btree_stats(mp_obj_t self_in) {
+    mp_obj_btree_t *self = MP_OBJ_TO_PTR(self_in);
+    MPOOL *mp = ((BTREE*)self->db->internal)->bt_mp;
+    mp_obj_t tuple[7];
+    tuple[0] = mp_obj_new_int_from_uint(mp->cachehit);
+    tuple[1] = mp_obj_new_int_from_uint(mp->cachemiss);
+    tuple[2] = mp_obj_new_int_from_uint(mp->pageread);
+    tuple[3] = mp_obj_new_int_from_uint(mp->pagewrite);
+    tuple[4] = mp_obj_new_int_from_uint(mp->writeback);
+    tuple[5] = mp_obj_new_int_from_uint(mp->curcache);
+    tuple[6] = mp_obj_new_int_from_uint(mp->npages);
+    return mp_obj_new_tuple(7, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(btree_stats_obj, btree_stats);
+
 STATIC mp_obj_t btree_get(size_t n_args, const mp_obj_t *args) {
     mp_obj_btree_t *self = MP_OBJ_TO_PTR(args[0]);
     DBT key, val;
@@ -301,6 +371,8 @@ STATIC const mp_rom_map_elem_t btree_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_flush), MP_ROM_PTR(&btree_flush_obj) },
     { MP_ROM_QSTR(MP_QSTR_get), MP_ROM_PTR(&btree_get_obj) },
     { MP_ROM_QSTR(MP_QSTR_put), MP_ROM_PTR(&btree_put_obj) },
+    { MP_ROM_QSTR(MP_QSTR_load), MP_ROM_PTR(&btree_load_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stats), MP_ROM_PTR(&btree_stats_obj) },
     { MP_ROM_QSTR(MP_QSTR_seq), MP_ROM_PTR(&btree_seq_obj) },
     { MP_ROM_QSTR(MP_QSTR_keys), MP_ROM_PTR(&btree_keys_obj) },
     { MP_ROM_QSTR(MP_QSTR_values), MP_ROM_PTR(&btree_values_obj) },
@@ -334,6 +406,7 @@ STATIC mp_obj_t mod_btree_open(size_t n_args, const mp_obj_t *pos_args, mp_map_t
         { MP_QSTR_cachesize, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
         { MP_QSTR_pagesize, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
         { MP_QSTR_minkeypage, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_psram, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false} },
     };
 
     // Make sure we got a stream object
@@ -344,6 +417,7 @@ STATIC mp_obj_t mod_btree_open(size_t n_args, const mp_obj_t *pos_args, mp_map_t
         mp_arg_val_t cachesize;
         mp_arg_val_t pagesize;
         mp_arg_val_t minkeypage;
+        mp_arg_val_t psram;
     } args;
     mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args,
         MP_ARRAY_SIZE(allowed_args), allowed_args, (mp_arg_val_t*)&args);
@@ -357,6 +431,16 @@ STATIC mp_obj_t mod_btree_open(size_t n_args, const mp_obj_t *pos_args, mp_map_t
     if (db == NULL) {
         mp_raise_OSError(errno);
     }
+    #ifdef MICROPY_PY_BTREE_PSRAM_MALLOC
+    if (args.psram.u_bool) {
+        // Nothing is pinned after open, the cached pages are moved to psRAM
+        if (mpool_setalloc(((BTREE*)db->internal)->bt_mp, MICROPY_PY_BTREE_PSRAM_MALLOC, free) == RET_ERROR) {
+            int err = errno;
+            __bt_close(db);
+            mp_raise_OSError(err);
+        }
+    }
+    #endif
     return MP_OBJ_FROM_PTR(btree_new(db));
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mod_btree_open_obj, 1, mod_btree_open);
@@ -61,6 +61,35 @@ typedef struct _mp_framebuf_p_t {
 #define FRAMEBUF_MHLSB    (3)
 #define FRAMEBUF_MHMSB    (4)
 
+// Fill a rectangle in a format with several horizontal pixels per byte.
+// The partial bytes at both ends of a row are masked, the bytes in
+// between are set with memset; bpp_log2 is log2 of the bits per pixel.
+STATIC void packed_fill_rect(uint8_t *b, size_t advance, int x, int w, int h, int bpp_log2, bool msb_first, uint8_t fill) {
+    int ppb_mask = (8 >> bpp_log2) - 1;
+    int first = (x & ppb_mask) << bpp_log2;
+    int last = (((x + w - 1) & ppb_mask) + 1) << bpp_log2;
+    int nbytes = ((x + w - 1) >> (3 - bpp_log2)) - (x >> (3 - bpp_log2));
+    uint8_t lmask, rmask;
+    if (msb_first) {
+        lmask = 0xff >> first;
+        rmask = 0xff << (8 - last);
+    } else {
+        lmask = 0xff << first;
+        rmask = 0xff >> (8 - last);
+    }
+    if (nbytes == 0) {
+        lmask &= rmask;
+    }
+    while (h--) {
+        *b = (*b & ~lmask) | (fill & lmask);
+        if (nbytes > 0) {
+            memset(b + 1, fill, nbytes - 1);
+            b[nbytes] = (b[nbytes] & ~rmask) | (fill & rmask);
+        }
+        b += advance;
+    }
+}
+
 // Functions for MHLSB and MHMSB
 
 STATIC void mono_horiz_setpixel(const mp_obj_framebuf_t *fb, int x, int y, uint32_t col) {
@@ -76,17 +105,8 @@ STATIC uint32_t mono_horiz_getpixel(const mp_obj_framebuf_t *fb, int x, int y) {
 }
 
 STATIC void mono_horiz_fill_rect(const mp_obj_framebuf_t *fb, int x, int y, int w, int h, uint32_t col) {
-    int reverse = fb->format == FRAMEBUF_MHMSB;
-    int advance = fb->stride >> 3;
-    while (w--) {
-        uint8_t *b = &((uint8_t*)fb->buf)[(x >> 3) + y * advance];
-        int offset = reverse ?  x & 7 : 7 - (x & 7);
-        for (int hh = h; hh; --hh) {
-            *b = (*b & ~(0x01 << offset)) | ((col != 0) << offset);
-            b += advance;
-        }
-        ++x;
-    }
+    uint8_t *b = &((uint8_t*)fb->buf)[(x + y * fb->stride) >> 3];
+    packed_fill_rect(b, fb->stride >> 3, x, w, h, 0, fb->format == FRAMEBUF_MHLSB, col ? 0xff : 0x00);
 }
 
 // Functions for MVLSB format
@@ -102,14 +122,23 @@ STATIC uint32_t mvlsb_getpixel(const mp_obj_framebuf_t *fb, int x, int y) {
 }
 
 STATIC void mvlsb_fill_rect(const mp_obj_framebuf_t *fb, int x, int y, int w, int h, uint32_t col) {
-    while (h--) {
+    uint8_t fill = col ? 0xff : 0x00;
+    while (h > 0) {
+        // one byte row holds 8 pixel rows
         uint8_t *b = &((uint8_t*)fb->buf)[(y >> 3) * fb->stride + x];
-        uint8_t offset = y & 0x07;
-        for (int ww = w; ww; --ww) {
-            *b = (*b & ~(0x01 << offset)) | ((col != 0) << offset);
-            ++b;
+        int offset = y & 0x07;
+        int n = MIN(h, 8 - offset);
+        uint8_t mask = (0xff << offset) & (0xff >> (8 - offset - n));
+        if (mask == 0xff) {
+            memset(b, fill, w);
+        } else {
+            for (int ww = w; ww; --ww) {
+                *b = (*b & ~mask) | (fill & mask);
+                ++b;
+            }
         }
-        ++y;
+        y += n;
+        h -= n;
     }
 }
 
@@ -125,11 +154,19 @@ STATIC uint32_t rgb565_getpixel(const mp_obj_framebuf_t *fb, int x, int y) {
 
 STATIC void rgb565_fill_rect(const mp_obj_framebuf_t *fb, int x, int y, int w, int h, uint32_t col) {
     uint16_t *b = &((uint16_t*)fb->buf)[x + y * fb->stride];
-    while (h--) {
-        for (int ww = w; ww; --ww) {
-            *b++ = col;
+    if ((col & 0xff) == ((col >> 8) & 0xff)) {
+        while (h--) {
+            memset(b, col, w * 2);
+            b += fb->stride;
         }
-        b += fb->stride - w;
+        return;
+    }
+    // fill the first row, copy it to the others
+    for (int ww = 0; ww < w; ++ww) {
+        b[ww] = col;
+    }
+    for (uint16_t *row = b + fb->stride; --h > 0; row += fb->stride) {
+        memcpy(row, b, w * 2);
     }
 }
 
@@ -150,11 +187,8 @@ STATIC uint32_t gs2_hmsb_getpixel(const mp_obj_framebuf_t *fb, int x, int y) {
 }
 
 STATIC void gs2_hmsb_fill_rect(const mp_obj_framebuf_t *fb, int x, int y, int w, int h, uint32_t col) {
-    for (int xx=x; xx < x+w; xx++) {
-        for (int yy=y; yy < y+h; yy++) {
-            gs2_hmsb_setpixel(fb, xx, yy, col);
-        }
-    }
+    uint8_t *b = &((uint8_t*)fb->buf)[(x + y * fb->stride) >> 2];
+    packed_fill_rect(b, fb->stride >> 2, x, w, h, 1, false, (col & 0x3) * 0x55);
 }
 
 // Functions for GS4_HMSB format
@@ -178,34 +212,8 @@ STATIC uint32_t gs4_hmsb_getpixel(const mp_obj_framebuf_t *fb, int x, int y) {
 }
 
 STATIC void gs4_hmsb_fill_rect(const mp_obj_framebuf_t *fb, int x, int y, int w, int h, uint32_t col) {
-    col &= 0x0f;
-    uint8_t *pixel_pair = &((uint8_t*)fb->buf)[(x + y * fb->stride) >> 1];
-    uint8_t col_shifted_left = col << 4;
-    uint8_t col_pixel_pair = col_shifted_left | col;
-    int pixel_count_till_next_line = (fb->stride - w) >> 1;
-    bool odd_x = (x % 2 == 1);
-
-    while (h--) {
-        int ww = w;
-
-        if (odd_x && ww > 0) {
-            *pixel_pair = (*pixel_pair & 0xf0) | col;
-            pixel_pair++;
-            ww--;
-        }
-
-        memset(pixel_pair, col_pixel_pair, ww >> 1);
-        pixel_pair += ww >> 1;
-
-        if (ww % 2) {
-            *pixel_pair = col_shifted_left | (*pixel_pair & 0x0f);
-            if (!odd_x) {
-                pixel_pair++;
-            }
-        }
-
-        pixel_pair += pixel_count_till_next_line;
-    }
+    uint8_t *b = &((uint8_t*)fb->buf)[(x + y * fb->stride) >> 1];
+    packed_fill_rect(b, fb->stride >> 1, x, w, h, 2, true, (col & 0x0f) * 0x11);
 }
 
 // Functions for GS8 format
@@ -260,6 +268,380 @@ STATIC void fill_rect(const mp_obj_framebuf_t *fb, int x, int y, int w, int h, u
     formats[fb->format].fill_rect(fb, x, y, xend - x, yend - y, col);
 }
 
+// Row-wise pixel transfer, used by blit and scroll
+
+// Pixels converted per step, kept on the C stack
+#define FRAMEBUF_ROW_CHUNK (64)
+
+// Destination value of a pixel which is not drawn (colour key)
+#define FRAMEBUF_TRANSPARENT (0xffffffff)
+
+// log2 of the bits per pixel
+STATIC const uint8_t framebuf_bpp_log2[] = {
+    [FRAMEBUF_MVLSB] = 0,
+    [FRAMEBUF_RGB565] = 4,
+    [FRAMEBUF_GS2_HMSB] = 1,
+    [FRAMEBUF_GS4_HMSB] = 2,
+    [FRAMEBUF_GS8] = 3,
+    [FRAMEBUF_MHLSB] = 0,
+    [FRAMEBUF_MHMSB] = 0,
+};
+
+// Read w pixels of row y, starting at x
+STATIC void get_row(const mp_obj_framebuf_t *fb, int x, int y, int w, uint32_t *out) {
+    const uint8_t *b = (const uint8_t*)fb->buf;
+    switch (fb->format) {
+        case FRAMEBUF_RGB565: {
+            const uint16_t *p = &((const uint16_t*)fb->buf)[x + y * fb->stride];
+            while (w--) {
+                *out++ = *p++;
+            }
+            break;
+        }
+        case FRAMEBUF_GS8: {
+            const uint8_t *p = &b[x + y * fb->stride];
+            while (w--) {
+                *out++ = *p++;
+            }
+            break;
+        }
+        case FRAMEBUF_GS4_HMSB: {
+            const uint8_t *p = &b[(x + y * fb->stride) >> 1];
+            for (; w--; ++x) {
+                if (x & 1) {
+                    *out++ = *p++ & 0x0f;
+                } else {
+                    *out++ = *p >> 4;
+                }
+            }
+            break;
+        }
+        case FRAMEBUF_GS2_HMSB: {
+            const uint8_t *p = &b[(x + y * fb->stride) >> 2];
+            int shift = (x & 0x3) << 1;
+            while (w--) {
+                *out++ = (*p >> shift) & 0x3;
+                if ((shift += 2) == 8) {
+                    shift = 0;
+                    ++p;
+                }
+            }
+            break;
+        }
+        case FRAMEBUF_MHLSB:
+        case FRAMEBUF_MHMSB: {
+            const uint8_t *p = &b[(x + y * fb->stride) >> 3];
+            int bit = x & 0x07;
+            int msb = fb->format == FRAMEBUF_MHLSB ? 7 : 0;
+            while (w--) {
+                *out++ = (*p >> (bit ^ msb)) & 0x01;
+                if (++bit == 8) {
+                    bit = 0;
+                    ++p;
+                }
+            }
+            break;
+        }
+        default: { // FRAMEBUF_MVLSB
+            const uint8_t *p = &b[(y >> 3) * fb->stride + x];
+            int shift = y & 0x07;
+            while (w--) {
+                *out++ = (*p++ >> shift) & 0x01;
+            }
+            break;
+        }
+    }
+}
+
+// Write w pixels to row y, starting at x; FRAMEBUF_TRANSPARENT pixels are skipped
+STATIC void put_row(const mp_obj_framebuf_t *fb, int x, int y, int w, const uint32_t *in) {
+    uint8_t *b = (uint8_t*)fb->buf;
+    switch (fb->format) {
+        case FRAMEBUF_RGB565: {
+            uint16_t *p = &((uint16_t*)fb->buf)[x + y * fb->stride];
+            for (; w--; ++p, ++in) {
+                if (*in != FRAMEBUF_TRANSPARENT) {
+                    *p = *in;
+                }
+            }
+            break;
+        }
+        case FRAMEBUF_GS8: {
+            uint8_t *p = &b[x + y * fb->stride];
+            for (; w--; ++p, ++in) {
+                if (*in != FRAMEBUF_TRANSPARENT) {
+                    *p = *in;
+                }
+            }
+            break;
+        }
+        case FRAMEBUF_GS4_HMSB: {
+            uint8_t *p = &b[(x + y * fb->stride) >> 1];
+            for (; w--; ++x, ++in) {
+                if (x & 1) {
+                    if (*in != FRAMEBUF_TRANSPARENT) {
+                        *p = (*p & 0xf0) | (*in & 0x0f);
+                    }
+                    ++p;
+                } else if (*in != FRAMEBUF_TRANSPARENT) {
+                    *p = (*p & 0x0f) | (*in << 4);
+                }
+            }
+            break;
+        }
+        case FRAMEBUF_GS2_HMSB: {
+            uint8_t *p = &b[(x + y * fb->stride) >> 2];
+            int shift = (x & 0x3) << 1;
+            for (; w--; ++in) {
+                if (*in != FRAMEBUF_TRANSPARENT) {
+                    *p = (*p & ~(0x3 << shift)) | ((*in & 0x3) << shift);
+                }
+                if ((shift += 2) == 8) {
+                    shift = 0;
+                    ++p;
+                }
+            }
+            break;
+        }
+        case FRAMEBUF_MHLSB:
+        case FRAMEBUF_MHMSB: {
+            uint8_t *p = &b[(x + y * fb->stride) >> 3];
+            int bit = x & 0x07;
+            int msb = fb->format == FRAMEBUF_MHLSB ? 7 : 0;
+            for (; w--; ++in) {
+                if (*in != FRAMEBUF_TRANSPARENT) {
+                    int offset = bit ^ msb;
+                    *p = (*p & ~(0x01 << offset)) | ((*in != 0) << offset);
+                }
+                if (++bit == 8) {
+                    bit = 0;
+                    ++p;
+                }
+            }
+            break;
+        }
+        default: { // FRAMEBUF_MVLSB
+            uint8_t *p = &b[(y >> 3) * fb->stride + x];
+            int offset = y & 0x07;
+            for (; w--; ++p, ++in) {
+                if (*in != FRAMEBUF_TRANSPARENT) {
+                    *p = (*p & ~(0x01 << offset)) | ((*in != 0) << offset);
+                }
+            }
+            break;
+        }
+    }
+}
+
+// Colour conversion between formats goes through an 8-bit grey level;
+// colour (RGB565) is reduced to its luminance
+STATIC uint32_t to_grey8(uint8_t format, uint32_t col) {
+    switch (format) {
+        case FRAMEBUF_RGB565: {
+            uint32_t r = (col >> 11) & 0x1f;
+            uint32_t g = (col >> 5) & 0x3f;
+            uint32_t b = col & 0x1f;
+            r = (r << 3) | (r >> 2);
+            g = (g << 2) | (g >> 4);
+            b = (b << 3) | (b >> 2);
+            return (r * 77 + g * 150 + b * 29) >> 8;
+        }
+        case FRAMEBUF_GS8:
+            return col & 0xff;
+        case FRAMEBUF_GS4_HMSB:
+            return (col & 0x0f) * 0x11;
+        case FRAMEBUF_GS2_HMSB:
+            return (col & 0x3) * 0x55;
+        default:
+            return col ? 0xff : 0x00;
+    }
+}
+
+STATIC uint32_t from_grey8(uint8_t format, uint32_t grey) {
+    switch (format) {
+        case FRAMEBUF_RGB565:
+            return ((grey >> 3) << 11) | ((grey >> 2) << 5) | (grey >> 3);
+        case FRAMEBUF_GS8:
+            return grey;
+        case FRAMEBUF_GS4_HMSB:
+            return grey >> 4;
+        case FRAMEBUF_GS2_HMSB:
+            return grey >> 6;
+        default:
+            return grey >> 7;
+    }
+}
+
+// How source pixel values are mapped to destination values
+enum {
+    BLIT_MAP_NONE,      // same format, values are copied
+    BLIT_MAP_LUT,       // source of up to 8 bpp, lut indexed by source value
+    BLIT_MAP_LUMA,      // RGB565 source, lut indexed by its luminance
+    BLIT_MAP_PALETTE,   // RGB565 source, palette looked up per pixel
+};
+
+// Copy whole bytes per row if both rectangles have the same pixel layout
+// and are byte aligned; only for plain copies (no key, no mapping).
+STATIC bool copy_rect_bytes(const mp_obj_framebuf_t *dst, const mp_obj_framebuf_t *src, int x0, int y0, int x1, int y1, int w, int h) {
+    if (dst->format != src->format) {
+        return false;
+    }
+    uint8_t *db = (uint8_t*)dst->buf;
+    const uint8_t *sb = (const uint8_t*)src->buf;
+    size_t dadvance, sadvance, len;
+    if (dst->format == FRAMEBUF_MVLSB) {
+        // rows are copied in bands of 8, the last band may be partial
+        // only at the bottom edge of both framebuffers
+        if ((y0 | y1) & 0x07) {
+            return false;
+        }
+        if ((h & 0x07) && (y0 + h != dst->height || y1 + h != src->height)) {
+            return false;
+        }
+        db += (y0 >> 3) * dst->stride + x0;
+        sb += (y1 >> 3) * src->stride + x1;
+        dadvance = dst->stride;
+        sadvance = src->stride;
+        len = w;
+        h = (h + 7) >> 3;
+        y0 >>= 3;
+        y1 >>= 3;
+    } else {
+        int bpp_log2 = framebuf_bpp_log2[dst->format];
+        if (bpp_log2 < 3 && ((x0 | x1 | w) & ((8 >> bpp_log2) - 1))) {
+            return false;
+        }
+        db += ((x0 + y0 * dst->stride) << bpp_log2) >> 3;
+        sb += ((x1 + y1 * src->stride) << bpp_log2) >> 3;
+        dadvance = (dst->stride << bpp_log2) >> 3;
+        sadvance = (src->stride << bpp_log2) >> 3;
+        len = (w << bpp_log2) >> 3;
+    }
+    if (db > sb) {
+        // may overlap within one buffer, go bottom up
+        db += (h - 1) * dadvance;
+        sb += (h - 1) * sadvance;
+        while (h--) {
+            memmove(db, sb, len);
+            db -= dadvance;
+            sb -= sadvance;
+        }
+    } else {
+        while (h--) {
+            memmove(db, sb, len);
+            db += dadvance;
+            sb += sadvance;
+        }
+    }
+    return true;
+}
+
+// Map the source values of a row to destination values in place,
+// pixels of colour key become FRAMEBUF_TRANSPARENT.  One loop per mapping,
+// so that the per pixel work is only the lookup.
+STATIC void map_row(uint32_t *row, int n, int map, const uint16_t *lut, const uint16_t *luma, uint32_t key, const mp_obj_framebuf_t *palette) {
+    switch (map) {
+        case BLIT_MAP_NONE:
+            for (int i = 0; i < n; ++i) {
+                if (row[i] == key) {
+                    row[i] = FRAMEBUF_TRANSPARENT;
+                }
+            }
+            break;
+        case BLIT_MAP_LUT:
+            for (int i = 0; i < n; ++i) {
+                uint32_t col = row[i];
+                row[i] = (col == key) ? FRAMEBUF_TRANSPARENT : lut[col];
+            }
+            break;
+        case BLIT_MAP_LUMA:
+            // luma[] holds the weighted red, green and blue parts of the luminance
+            for (int i = 0; i < n; ++i) {
+                uint32_t col = row[i];
+                uint32_t grey = (luma[col >> 11] + luma[32 + ((col >> 5) & 0x3f)] + luma[96 + (col & 0x1f)]) >> 8;
+                row[i] = (col == key) ? FRAMEBUF_TRANSPARENT : lut[grey];
+            }
+            break;
+        default: // BLIT_MAP_PALETTE
+            for (int i = 0; i < n; ++i) {
+                uint32_t col = row[i];
+                if (col == key) {
+                    row[i] = FRAMEBUF_TRANSPARENT;
+                } else if (col < (uint32_t)palette->width) {
+                    row[i] = getpixel(palette, col, 0);
+                }
+            }
+            break;
+    }
+}
+
+// Copy the w x h rectangle at (x1, y1) of src to (x0, y0) of dst; both
+// rectangles must already be clipped.  Pixels of colour key (if not -1)
+// are not drawn, palette (if not NULL) maps source colours to dst colours.
+STATIC void copy_rect(const mp_obj_framebuf_t *dst, const mp_obj_framebuf_t *src, int x0, int y0, int x1, int y1, int w, int h, mp_int_t key, const mp_obj_framebuf_t *palette) {
+    int map;
+    uint16_t lut[256];
+    uint16_t luma[128];
+    if (palette == NULL && dst->format == src->format) {
+        if (key == -1 && copy_rect_bytes(dst, src, x0, y0, x1, y1, w, h)) {
+            return;
+        }
+        map = BLIT_MAP_NONE;
+    } else if (src->format != FRAMEBUF_RGB565) {
+        // build the lookup table for all source colours
+        int ncolours = 1 << (1 << framebuf_bpp_log2[src->format]);
+        for (int c = 0; c < ncolours; ++c) {
+            if (palette == NULL) {
+                lut[c] = from_grey8(dst->format, to_grey8(src->format, c));
+            } else if (c < palette->width) {
+                lut[c] = getpixel(palette, c, 0);
+            } else {
+                lut[c] = c;
+            }
+        }
+        map = BLIT_MAP_LUT;
+    } else if (palette == NULL) {
+        // the same luminance as to_grey8(), split by component
+        for (int c = 0; c < 256; ++c) {
+            lut[c] = from_grey8(dst->format, c);
+        }
+        for (int c = 0; c < 32; ++c) {
+            luma[c] = ((c << 3) | (c >> 2)) * 77;
+            luma[96 + c] = ((c << 3) | (c >> 2)) * 29;
+        }
+        for (int c = 0; c < 64; ++c) {
+            luma[32 + c] = ((c << 2) | (c >> 4)) * 150;
+        }
+        map = BLIT_MAP_LUMA;
+    } else {
+        map = BLIT_MAP_PALETTE;
+    }
+
+    // rows are copied bottom up, and chunks right to left, if the
+    // destination lies after the source in the same buffer
+    bool same_buf = dst->buf == src->buf;
+    int dy = 1;
+    if (same_buf && y0 > y1) {
+        y0 += h - 1;
+        y1 += h - 1;
+        dy = -1;
+    }
+    bool backwards = same_buf && x0 > x1;
+
+    uint32_t row[FRAMEBUF_ROW_CHUNK];
+    for (; h--; y0 += dy, y1 += dy) {
+        for (int done = 0; done < w; done += FRAMEBUF_ROW_CHUNK) {
+            int n = MIN(w - done, FRAMEBUF_ROW_CHUNK);
+            int offset = backwards ? w - done - n : done;
+            get_row(src, x1 + offset, y1, n, row);
+            if (map != BLIT_MAP_NONE || key != -1) {
+                map_row(row, n, map, lut, luma, (uint32_t)key, palette);
+            }
+            put_row(dst, x0 + offset, y0, n, row);
+        }
+    }
+}
+
 STATIC mp_obj_t framebuf_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
     mp_arg_check_num(n_args, n_kw, 4, 5, false);
 
@@ -477,6 +859,10 @@ STATIC mp_obj_t framebuf_blit(size_t n_args, const mp_obj_t *args) {
     if (n_args > 4) {
         key = mp_obj_get_int(args[4]);
     }
+    mp_obj_framebuf_t *palette = NULL;
+    if (n_args > 5 && args[5] != mp_const_none) {
+        palette = MP_OBJ_TO_PTR(args[5]);
+    }
 
     if (
         (x >= self->width) ||
@@ -496,49 +882,23 @@ STATIC mp_obj_t framebuf_blit(size_t n_args, const mp_obj_t *args) {
     int x0end = MIN(self->width, x + source->width);
     int y0end = MIN(self->height, y + source->height);
 
-    for (; y0 < y0end; ++y0) {
-        int cx1 = x1;
-        for (int cx0 = x0; cx0 < x0end; ++cx0) {
-            uint32_t col = getpixel(source, cx1, y1);
-            if (col != (uint32_t)key) {
-                setpixel(self, cx0, y0, col);
-            }
-            ++cx1;
-        }
-        ++y1;
-    }
+    copy_rect(self, source, x0, y0, x1, y1, x0end - x0, y0end - y0, key, palette);
     return mp_const_none;
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(framebuf_blit_obj, 4, 5, framebuf_blit);
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(framebuf_blit_obj, 4, 6, framebuf_blit);
 
 STATIC mp_obj_t framebuf_scroll(mp_obj_t self_in, mp_obj_t xstep_in, mp_obj_t ystep_in) {
     mp_obj_framebuf_t *self = MP_OBJ_TO_PTR(self_in);
     mp_int_t xstep = mp_obj_get_int(xstep_in);
     mp_int_t ystep = mp_obj_get_int(ystep_in);
-    int sx, y, xend, yend, dx, dy;
-    if (xstep < 0) {
-        sx = 0;
-        xend = self->width + xstep;
-        dx = 1;
-    } else {
-        sx = self->width - 1;
-        xend = xstep - 1;
-        dx = -1;
-    }
-    if (ystep < 0) {
-        y = 0;
-        yend = self->height + ystep;
-        dy = 1;
-    } else {
-        y = self->height - 1;
-        yend = ystep - 1;
-        dy = -1;
-    }
-    for (; y != yend; y += dy) {
-        for (int x = sx; x != xend; x += dx) {
-            setpixel(self, x, y, getpixel(self, x - xstep, y - ystep));
-        }
+    if (xstep <= -self->width || xstep >= self->width || ystep <= -self->height || ystep >= self->height) {
+        // Everything is scrolled out, no-op.
+        return mp_const_none;
     }
+    // Copy the part that stays visible, the rest keeps its previous contents.
+    int w = self->width - (xstep < 0 ? -xstep : xstep);
+    int h = self->height - (ystep < 0 ? -ystep : ystep);
+    copy_rect(self, self, MAX(0, xstep), MAX(0, ystep), MAX(0, -xstep), MAX(0, -ystep), w, h, -1, NULL);
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_3(framebuf_scroll_obj, framebuf_scroll);
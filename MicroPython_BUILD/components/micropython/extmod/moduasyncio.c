@@ -0,0 +1,564 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "py/runtime.h"
+#include "py/mphal.h"
+#include "py/stream.h"
+#include "extmod/modutimeq.h"
+#include "extmod/moduselect.h"
+
+#if MICROPY_PY_UASYNCIO
+
+// Event loop core of uasyncio implemented in C.
+//
+// The API follows the uasyncio (v2) core: get_event_loop() returns the event loop,
+// with create_task(), call_soon(), call_later(), call_later_ms(), run_forever(),
+// run_until_complete(), add_reader() ... methods.
+// The coroutines are resumed directly from the loop, the value they yield selects
+// what happens next, as in uasyncio:
+//   None             the coroutine is rescheduled
+//   int              sleep for the given number of ms
+//   generator        the generator is scheduled as a new task, the coroutine is rescheduled
+//   False            the coroutine is not rescheduled
+//   sleep_ms(), IORead(), IOWrite(), IOReadDone(), IOWriteDone(), StopLoop() syscalls
+// The run queue is a ring buffer of (callback, args) pairs, timed callbacks are kept
+// in a utimeq, I/O is waited on with uselect.poll (which sleeps until the socket or
+// UART is ready). As in uasyncio, the streams are mapped by id(), most native stream
+// types are not hashable.
+
+enum {
+    SYSCALL_SLEEP_MS,
+    SYSCALL_IOREAD,
+    SYSCALL_IOWRITE,
+    SYSCALL_IOREAD_DONE,
+    SYSCALL_IOWRITE_DONE,
+    SYSCALL_STOP_LOOP,
+};
+
+typedef struct _mp_obj_syscall_t {
+    mp_obj_base_t base;
+    mp_uint_t kind;
+    mp_obj_t arg;
+    bool done;
+} mp_obj_syscall_t;
+
+typedef struct _mp_obj_evloop_t {
+    mp_obj_base_t base;
+    mp_obj_t *runq;         // (callback, args) pairs
+    mp_uint_t runq_alloc;
+    mp_uint_t runq_head;
+    mp_uint_t runq_len;
+    mp_obj_t waitq;         // utimeq of timed callbacks
+    mp_obj_t poller;        // uselect.poll, created on first I/O wait
+    mp_obj_t objmap;        // dict of the callbacks waiting for I/O, by id() of the stream
+    mp_obj_t main_task;     // coroutine run by run_until_complete()
+    mp_obj_t ret_val;
+    bool stop;
+} mp_obj_evloop_t;
+
+STATIC const mp_obj_type_t syscall_type;
+STATIC const mp_obj_type_t evloop_type;
+
+STATIC mp_obj_t syscall_new(mp_uint_t kind, mp_obj_t arg) {
+    mp_obj_syscall_t *o = m_new_obj(mp_obj_syscall_t);
+    o->base.type = &syscall_type;
+    o->kind = kind;
+    o->arg = arg;
+    o->done = false;
+    return MP_OBJ_FROM_PTR(o);
+}
+
+// 'yield from' / 'await' on a syscall yields the syscall itself, once
+STATIC mp_obj_t syscall_iternext(mp_obj_t self_in) {
+    mp_obj_syscall_t *self = MP_OBJ_TO_PTR(self_in);
+    if (self->done) {
+        return MP_OBJ_STOP_ITERATION;
+    }
+    self->done = true;
+    return self_in;
+}
+
+STATIC const mp_obj_type_t syscall_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_SysCall,
+    .getiter = mp_identity_getiter,
+    .iternext = syscall_iternext,
+};
+
+//--------------------------------------------------------------------------
+
+STATIC void evloop_runq_push(mp_obj_evloop_t *self, mp_obj_t callback, mp_obj_t args) {
+    if (self->runq_len == self->runq_alloc) {
+        // grow the queue, unwrapping the ring
+        mp_uint_t alloc = self->runq_alloc * 2;
+        mp_obj_t *runq = m_new(mp_obj_t, alloc * 2);
+        for (mp_uint_t i = 0; i < self->runq_len; i++) {
+            mp_uint_t idx = (self->runq_head + i) % self->runq_alloc;
+            runq[i * 2] = self->runq[idx * 2];
+            runq[i * 2 + 1] = self->runq[idx * 2 + 1];
+        }
+        m_del(mp_obj_t, self->runq, self->runq_alloc * 2);
+        self->runq = runq;
+        self->runq_alloc = alloc;
+        self->runq_head = 0;
+    }
+    mp_uint_t idx = (self->runq_head + self->runq_len) % self->runq_alloc;
+    self->runq[idx * 2] = callback;
+    self->runq[idx * 2 + 1] = args;
+    self->runq_len++;
+}
+
+STATIC void evloop_runq_pop(mp_obj_evloop_t *self, mp_obj_t *callback, mp_obj_t *args) {
+    mp_uint_t idx = self->runq_head;
+    *callback = self->runq[idx * 2];
+    *args = self->runq[idx * 2 + 1];
+    // don't retain the pointers
+    self->runq[idx * 2] = MP_OBJ_NULL;
+    self->runq[idx * 2 + 1] = MP_OBJ_NULL;
+    self->runq_head = (idx + 1) % self->runq_alloc;
+    self->runq_len--;
+}
+
+STATIC void evloop_call_later_ms(mp_obj_evloop_t *self, mp_int_t delay, mp_obj_t callback, mp_obj_t args) {
+    mp_utimeq_push(self->waitq, mp_hal_ticks_ms() + delay, callback, args);
+}
+
+// Wait for 'obj' to become readable/writable, then schedule 'callback'
+// (a coroutine, or a (function, args...) tuple)
+STATIC void evloop_add_io(mp_obj_evloop_t *self, mp_obj_t obj, mp_uint_t flags, mp_obj_t callback) {
+    mp_obj_t dest[4];
+    if (self->poller == MP_OBJ_NULL) {
+        self->poller = mp_call_function_0(MP_OBJ_FROM_PTR(&mp_select_poll_obj));
+    }
+    mp_obj_dict_store(self->objmap, mp_obj_id(obj), callback);
+    mp_load_method(self->poller, MP_QSTR_register, dest);
+    dest[2] = obj;
+    dest[3] = MP_OBJ_NEW_SMALL_INT(flags);
+    mp_call_method_n_kw(2, 0, dest);
+}
+
+STATIC void evloop_remove_io(mp_obj_evloop_t *self, mp_obj_t obj) {
+    mp_map_t *map = mp_obj_dict_get_map(self->objmap);
+    if (mp_map_lookup(map, mp_obj_id(obj), MP_MAP_LOOKUP_REMOVE_IF_FOUND) == NULL) {
+        return;
+    }
+    mp_obj_t dest[3];
+    mp_load_method(self->poller, MP_QSTR_unregister, dest);
+    dest[2] = obj;
+    mp_call_method_n_kw(1, 0, dest);
+}
+
+// Wait for I/O for max 'delay' ms (-1: forever) and schedule the ready callbacks
+STATIC void evloop_wait(mp_obj_evloop_t *self, mp_int_t delay) {
+    mp_map_t *map = mp_obj_dict_get_map(self->objmap);
+    if (map->used == 0) {
+        if (delay < 0) {
+            // nothing can happen, just wait for pending events
+            delay = 1000;
+        }
+        if (delay > 0) {
+            mp_hal_delay_ms(delay);
+        } else {
+            mp_handle_pending();
+        }
+        return;
+    }
+
+    // poller.ipoll(delay, 1), oneshot, the streams are registered again by add_reader/add_writer
+    mp_obj_t dest[4];
+    mp_load_method(self->poller, MP_QSTR_ipoll, dest);
+    dest[2] = MP_OBJ_NEW_SMALL_INT(delay);
+    dest[3] = MP_OBJ_NEW_SMALL_INT(1);
+    mp_obj_t iter = mp_call_method_n_kw(2, 0, dest);
+    mp_obj_t item;
+    while ((item = mp_iternext(iter)) != MP_OBJ_STOP_ITERATION) {
+        // item is a tuple owned by the poll object
+        mp_obj_t *ev;
+        mp_obj_get_array_fixed_n(item, 2, &ev);
+        mp_map_elem_t *elem = mp_map_lookup(map, mp_obj_id(ev[0]), MP_MAP_LOOKUP);
+        if (elem == NULL) {
+            continue;
+        }
+        mp_obj_t callback = elem->value;
+        if (MP_OBJ_IS_TYPE(callback, &mp_type_tuple)) {
+            size_t len;
+            mp_obj_t *items;
+            mp_obj_get_array(callback, &len, &items);
+            evloop_runq_push(self, items[0], mp_obj_new_tuple(len - 1, items + 1));
+        } else {
+            evloop_runq_push(self, callback, mp_const_empty_tuple);
+        }
+    }
+}
+
+// Resume the coroutine and handle the value it yields
+STATIC void evloop_resume(mp_obj_evloop_t *self, mp_obj_t coro, mp_obj_t args) {
+    mp_obj_t send_value = mp_const_none;
+    if (args != mp_const_empty_tuple) {
+        size_t len;
+        mp_obj_t *items;
+        mp_obj_get_array(args, &len, &items);
+        if (len > 0) {
+            send_value = items[0];
+        }
+    }
+
+    mp_obj_t ret;
+    mp_vm_return_kind_t kind = mp_resume(coro, send_value, MP_OBJ_NULL, &ret);
+    if (kind == MP_VM_RETURN_NORMAL) {
+        // coroutine finished
+        if (coro == self->main_task) {
+            self->ret_val = ret;
+            self->stop = true;
+        }
+        return;
+    }
+    if (kind == MP_VM_RETURN_EXCEPTION) {
+        nlr_raise(ret);
+    }
+
+    mp_int_t delay = 0;
+    if (ret == mp_const_none) {
+        // just reschedule
+    } else if (ret == mp_const_false) {
+        // don't reschedule
+        return;
+    } else if (MP_OBJ_IS_SMALL_INT(ret)) {
+        delay = MP_OBJ_SMALL_INT_VALUE(ret);
+    } else if (MP_OBJ_IS_TYPE(ret, &mp_type_gen_instance)) {
+        evloop_runq_push(self, ret, mp_const_empty_tuple);
+    } else if (MP_OBJ_IS_TYPE(ret, &syscall_type)) {
+        mp_obj_syscall_t *sc = MP_OBJ_TO_PTR(ret);
+        switch (sc->kind) {
+            case SYSCALL_SLEEP_MS:
+                delay = mp_obj_get_int(sc->arg);
+                break;
+            case SYSCALL_IOREAD:
+                evloop_add_io(self, sc->arg, MP_STREAM_POLL_RD, coro);
+                return;
+            case SYSCALL_IOWRITE:
+                evloop_add_io(self, sc->arg, MP_STREAM_POLL_WR, coro);
+                return;
+            case SYSCALL_IOREAD_DONE:
+            case SYSCALL_IOWRITE_DONE:
+                evloop_remove_io(self, sc->arg);
+                break;
+            case SYSCALL_STOP_LOOP:
+                self->ret_val = sc->arg;
+                self->stop = true;
+                return;
+        }
+    } else {
+        mp_raise_TypeError("unsupported coroutine yield value");
+    }
+
+    if (delay > 0) {
+        evloop_call_later_ms(self, delay, coro, mp_const_empty_tuple);
+    } else {
+        evloop_runq_push(self, coro, mp_const_empty_tuple);
+    }
+}
+
+STATIC mp_obj_t evloop_run(mp_obj_evloop_t *self, mp_obj_t main_task) {
+    self->main_task = main_task;
+    self->ret_val = mp_const_none;
+    self->stop = false;
+    mp_obj_t callback, args;
+    int64_t t;
+    while (!self->stop) {
+        // move the expired timed callbacks to the run queue
+        int64_t now = mp_hal_ticks_ms();
+        while (mp_utimeq_peektime(self->waitq, &t) && (t <= now)) {
+            mp_utimeq_pop(self->waitq, &callback, &args);
+            evloop_runq_push(self, callback, args);
+        }
+
+        // run the callbacks queued so far, the ones they queue run on the next pass
+        for (mp_uint_t n = self->runq_len; (n > 0) && !self->stop; n--) {
+            evloop_runq_pop(self, &callback, &args);
+            if (MP_OBJ_IS_TYPE(callback, &mp_type_gen_instance)) {
+                evloop_resume(self, callback, args);
+            } else {
+                size_t len;
+                mp_obj_t *items;
+                mp_obj_get_array(args, &len, &items);
+                mp_call_function_n_kw(callback, len, 0, items);
+            }
+        }
+        if (self->stop) {
+            break;
+        }
+
+        // wait for I/O until the next timed callback is due
+        mp_int_t delay = 0;
+        if (self->runq_len == 0) {
+            delay = -1;
+            if (mp_utimeq_peektime(self->waitq, &t)) {
+                delay = t - (int64_t)mp_hal_ticks_ms();
+                if (delay < 0) {
+                    delay = 0;
+                }
+            }
+        }
+        evloop_wait(self, delay);
+    }
+    self->main_task = MP_OBJ_NULL;
+    return self->ret_val;
+}
+
+// Store (callback, args) from the method arguments, starting at 'args[0]' = callback
+STATIC mp_obj_t evloop_args(size_t n_args, const mp_obj_t *args) {
+    return mp_obj_new_tuple(n_args - 1, args + 1);
+}
+
+//--------------------------------------------------------------------------
+
+STATIC mp_obj_t evloop_time(mp_obj_t self_in) {
+    (void)self_in;
+    return mp_obj_new_int_from_ull(mp_hal_ticks_ms());
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(evloop_time_obj, evloop_time);
+
+STATIC mp_obj_t evloop_create_task(mp_obj_t self_in, mp_obj_t coro) {
+    mp_obj_evloop_t *self = MP_OBJ_TO_PTR(self_in);
+    evloop_runq_push(self, coro, mp_const_empty_tuple);
+    return mp_const_true;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(evloop_create_task_obj, evloop_create_task);
+
+STATIC mp_obj_t evloop_call_soon(size_t n_args, const mp_obj_t *args) {
+    mp_obj_evloop_t *self = MP_OBJ_TO_PTR(args[0]);
+    evloop_runq_push(self, args[1], evloop_args(n_args - 1, args + 1));
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR(evloop_call_soon_obj, 2, evloop_call_soon);
+
+STATIC mp_obj_t evloop_call_later(size_t n_args, const mp_obj_t *args) {
+    mp_obj_evloop_t *self = MP_OBJ_TO_PTR(args[0]);
+    #if MICROPY_PY_BUILTINS_FLOAT
+    mp_int_t delay = (mp_int_t)(mp_obj_get_float(args[1]) * 1000);
+    #else
+    mp_int_t delay = mp_obj_get_int(args[1]) * 1000;
+    #endif
+    evloop_call_later_ms(self, delay, args[2], evloop_args(n_args - 2, args + 2));
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR(evloop_call_later_obj, 3, evloop_call_later);
+
+STATIC mp_obj_t evloop_call_later_ms_(size_t n_args, const mp_obj_t *args) {
+    mp_obj_evloop_t *self = MP_OBJ_TO_PTR(args[0]);
+    mp_int_t delay = mp_obj_get_int(args[1]);
+    if (delay > 0) {
+        evloop_call_later_ms(self, delay, args[2], evloop_args(n_args - 2, args + 2));
+    } else {
+        evloop_runq_push(self, args[2], evloop_args(n_args - 2, args + 2));
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR(evloop_call_later_ms_obj, 3, evloop_call_later_ms_);
+
+// call_at_(time, callback, args=())
+STATIC mp_obj_t evloop_call_at_(size_t n_args, const mp_obj_t *args) {
+    mp_obj_evloop_t *self = MP_OBJ_TO_PTR(args[0]);
+    mp_obj_t cb_args = (n_args > 3) ? args[3] : mp_const_empty_tuple;
+    mp_utimeq_push(self->waitq, mp_obj_get_int64(args[1]), args[2], cb_args);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(evloop_call_at__obj, 3, 4, evloop_call_at_);
+
+STATIC mp_obj_t evloop_add_io_helper(size_t n_args, const mp_obj_t *args, mp_uint_t flags) {
+    mp_obj_evloop_t *self = MP_OBJ_TO_PTR(args[0]);
+    mp_obj_t callback = args[2];
+    if (n_args > 3) {
+        callback = mp_obj_new_tuple(n_args - 2, args + 2);
+    }
+    evloop_add_io(self, args[1], flags, callback);
+    return mp_const_none;
+}
+
+STATIC mp_obj_t evloop_add_reader(size_t n_args, const mp_obj_t *args) {
+    return evloop_add_io_helper(n_args, args, MP_STREAM_POLL_RD);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR(evloop_add_reader_obj, 3, evloop_add_reader);
+
+STATIC mp_obj_t evloop_add_writer(size_t n_args, const mp_obj_t *args) {
+    return evloop_add_io_helper(n_args, args, MP_STREAM_POLL_WR);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR(evloop_add_writer_obj, 3, evloop_add_writer);
+
+STATIC mp_obj_t evloop_remove_reader(mp_obj_t self_in, mp_obj_t obj) {
+    evloop_remove_io(MP_OBJ_TO_PTR(self_in), obj);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(evloop_remove_reader_obj, evloop_remove_reader);
+
+STATIC mp_obj_t evloop_run_forever(mp_obj_t self_in) {
+    return evloop_run(MP_OBJ_TO_PTR(self_in), MP_OBJ_NULL);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(evloop_run_forever_obj, evloop_run_forever);
+
+STATIC mp_obj_t evloop_run_until_complete(mp_obj_t self_in, mp_obj_t coro) {
+    mp_obj_evloop_t *self = MP_OBJ_TO_PTR(self_in);
+    evloop_runq_push(self, coro, mp_const_empty_tuple);
+    return evloop_run(self, coro);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(evloop_run_until_complete_obj, evloop_run_until_complete);
+
+STATIC mp_obj_t evloop_stop(mp_obj_t self_in) {
+    mp_obj_evloop_t *self = MP_OBJ_TO_PTR(self_in);
+    self->stop = true;
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(evloop_stop_obj, evloop_stop);
+
+STATIC mp_obj_t evloop_close(mp_obj_t self_in) {
+    (void)self_in;
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(evloop_close_obj, evloop_close);
+
+STATIC const mp_rom_map_elem_t evloop_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_time), MP_ROM_PTR(&evloop_time_obj) },
+    { MP_ROM_QSTR(MP_QSTR_create_task), MP_ROM_PTR(&evloop_create_task_obj) },
+    { MP_ROM_QSTR(MP_QSTR_call_soon), MP_ROM_PTR(&evloop_call_soon_obj) },
+    { MP_ROM_QSTR(MP_QSTR_call_later), MP_ROM_PTR(&evloop_call_later_obj) },
+    { MP_ROM_QSTR(MP_QSTR_call_later_ms), MP_ROM_PTR(&evloop_call_later_ms_obj) },
+    { MP_ROM_QSTR(MP_QSTR_call_at_), MP_ROM_PTR(&evloop_call_at__obj) },
+    { MP_ROM_QSTR(MP_QSTR_add_reader), MP_ROM_PTR(&evloop_add_reader_obj) },
+    { MP_ROM_QSTR(MP_QSTR_remove_reader), MP_ROM_PTR(&evloop_remove_reader_obj) },
+    { MP_ROM_QSTR(MP_QSTR_add_writer), MP_ROM_PTR(&evloop_add_writer_obj) },
+    { MP_ROM_QSTR(MP_QSTR_remove_writer), MP_ROM_PTR(&evloop_remove_reader_obj) },
+    { MP_ROM_QSTR(MP_QSTR_run_forever), MP_ROM_PTR(&evloop_run_forever_obj) },
+    { MP_ROM_QSTR(MP_QSTR_run_until_complete), MP_ROM_PTR(&evloop_run_until_complete_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stop), MP_ROM_PTR(&evloop_stop_obj) },
+    { MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&evloop_close_obj) },
+};
+STATIC MP_DEFINE_CONST_DICT(evloop_locals_dict, evloop_locals_dict_table);
+
+STATIC const mp_obj_type_t evloop_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_EventLoop,
+    .locals_dict = (void*)&evloop_locals_dict,
+};
+
+//--------------------------------------------------------------------------
+
+/// \function get_event_loop(runq_len=16, waitq_len=16)
+/// The event loop is created on the first call, the sizes are used only then.
+/// The run queue grows as needed, waitq_len is the max number of timed callbacks.
+STATIC mp_obj_t mod_uasyncio_get_event_loop(size_t n_args, const mp_obj_t *args) {
+    if (MP_STATE_VM(uasyncio_event_loop) == MP_OBJ_NULL) {
+        mp_int_t runq_len = (n_args > 0) ? mp_obj_get_int(args[0]) : 16;
+        mp_int_t waitq_len = (n_args > 1) ? mp_obj_get_int(args[1]) : 16;
+        if ((runq_len < 1) || (waitq_len < 1)) {
+            mp_raise_ValueError("queue length must be > 0");
+        }
+        mp_obj_evloop_t *self = m_new_obj(mp_obj_evloop_t);
+        self->base.type = &evloop_type;
+        self->runq = m_new0(mp_obj_t, runq_len * 2);
+        self->runq_alloc = runq_len;
+        self->runq_head = 0;
+        self->runq_len = 0;
+        self->waitq = mp_utimeq_new(waitq_len, true);
+        self->poller = MP_OBJ_NULL;
+        self->objmap = mp_obj_new_dict(0);
+        self->main_task = MP_OBJ_NULL;
+        self->ret_val = mp_const_none;
+        self->stop = false;
+        MP_STATE_VM(uasyncio_event_loop) = MP_OBJ_FROM_PTR(self);
+    }
+    return MP_STATE_VM(uasyncio_event_loop);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_uasyncio_get_event_loop_obj, 0, 2, mod_uasyncio_get_event_loop);
+
+STATIC mp_obj_t mod_uasyncio_sleep(mp_obj_t secs) {
+    #if MICROPY_PY_BUILTINS_FLOAT
+    mp_int_t ms = (mp_int_t)(mp_obj_get_float(secs) * 1000);
+    #else
+    mp_int_t ms = mp_obj_get_int(secs) * 1000;
+    #endif
+    return syscall_new(SYSCALL_SLEEP_MS, MP_OBJ_NEW_SMALL_INT(ms));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_uasyncio_sleep_obj, mod_uasyncio_sleep);
+
+STATIC mp_obj_t mod_uasyncio_sleep_ms(mp_obj_t ms) {
+    return syscall_new(SYSCALL_SLEEP_MS, MP_OBJ_NEW_SMALL_INT(mp_obj_get_int(ms)));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_uasyncio_sleep_ms_obj, mod_uasyncio_sleep_ms);
+
+STATIC mp_obj_t mod_uasyncio_ioread(mp_obj_t obj) {
+    return syscall_new(SYSCALL_IOREAD, obj);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_uasyncio_ioread_obj, mod_uasyncio_ioread);
+
+STATIC mp_obj_t mod_uasyncio_iowrite(mp_obj_t obj) {
+    return syscall_new(SYSCALL_IOWRITE, obj);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_uasyncio_iowrite_obj, mod_uasyncio_iowrite);
+
+STATIC mp_obj_t mod_uasyncio_ioread_done(mp_obj_t obj) {
+    return syscall_new(SYSCALL_IOREAD_DONE, obj);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_uasyncio_ioread_done_obj, mod_uasyncio_ioread_done);
+
+STATIC mp_obj_t mod_uasyncio_iowrite_done(mp_obj_t obj) {
+    return syscall_new(SYSCALL_IOWRITE_DONE, obj);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_uasyncio_iowrite_done_obj, mod_uasyncio_iowrite_done);
+
+STATIC mp_obj_t mod_uasyncio_stop_loop(size_t n_args, const mp_obj_t *args) {
+    return syscall_new(SYSCALL_STOP_LOOP, (n_args > 0) ? args[0] : mp_const_none);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_uasyncio_stop_loop_obj, 0, 1, mod_uasyncio_stop_loop);
+
+// @coroutine decorator, coroutines are just generators
+STATIC mp_obj_t mod_uasyncio_coroutine(mp_obj_t f) {
+    return f;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_uasyncio_coroutine_obj, mod_uasyncio_coroutine);
+
+STATIC const mp_rom_map_elem_t mp_module_uasyncio_globals_table[] = {
+    { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR__uasyncio) },
+    { MP_ROM_QSTR(MP_QSTR_get_event_loop), MP_ROM_PTR(&mod_uasyncio_get_event_loop_obj) },
+    { MP_ROM_QSTR(MP_QSTR_sleep), MP_ROM_PTR(&mod_uasyncio_sleep_obj) },
+    { MP_ROM_QSTR(MP_QSTR_sleep_ms), MP_ROM_PTR(&mod_uasyncio_sleep_ms_obj) },
+    { MP_ROM_QSTR(MP_QSTR_IORead), MP_ROM_PTR(&mod_uasyncio_ioread_obj) },
+    { MP_ROM_QSTR(MP_QSTR_IOWrite), MP_ROM_PTR(&mod_uasyncio_iowrite_obj) },
+    { MP_ROM_QSTR(MP_QSTR_IOReadDone), MP_ROM_PTR(&mod_uasyncio_ioread_done_obj) },
+    { MP_ROM_QSTR(MP_QSTR_IOWriteDone), MP_ROM_PTR(&mod_uasyncio_iowrite_done_obj) },
+    { MP_ROM_QSTR(MP_QSTR_StopLoop), MP_ROM_PTR(&mod_uasyncio_stop_loop_obj) },
+    { MP_ROM_QSTR(MP_QSTR_coroutine), MP_ROM_PTR(&mod_uasyncio_coroutine_obj) },
+};
+STATIC MP_DEFINE_CONST_DICT(mp_module_uasyncio_globals, mp_module_uasyncio_globals_table);
+
+const mp_obj_module_t mp_module_uasyncio = {
+    .base = { &mp_type_module },
+    .globals = (mp_obj_dict_t*)&mp_module_uasyncio_globals,
+};
+
+#endif // MICROPY_PY_UASYNCIO
@@ -25,86 +25,332 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 
+#include "py/formatfloat.h"
 #include "py/objlist.h"
-#include "py/objstringio.h"
+#include "py/objstr.h"
 #include "py/parsenum.h"
 #include "py/runtime.h"
+#include "py/stackctrl.h"
 #include "py/stream.h"
+#include "py/unicode.h"
 
 #if MICROPY_PY_UJSON
 
-STATIC mp_obj_t mod_ujson_dump(mp_obj_t obj, mp_obj_t stream) {
-    if (!MP_OBJ_IS_OBJ(stream)) {
-        mp_raise_TypeError(NULL);
+// The functions below implement a JSON encoder which renders into a fixed
+// size buffer and writes it out in chunks, either to a stream or, for dumps,
+// to a vstr.  The common types are encoded directly, everything else goes
+// through the generic print machinery with PRINT_JSON.
+
+// Size of the output buffer used by dump/dumps
+#ifndef UJSON_DUMP_BUF_SIZE
+#define UJSON_DUMP_BUF_SIZE (256)
+#endif
+
+#if MICROPY_PY_BUILTINS_FLOAT
+extern int float_precision;
+#endif
+
+typedef struct _ujson_enc_t {
+    mp_obj_t stream_obj;    // output stream, or MP_OBJ_NULL to output to vstr
+    vstr_t *vstr;
+    int precision;          // float precision, digits
+    size_t len;
+    byte buf[UJSON_DUMP_BUF_SIZE];
+} ujson_enc_t;
+
+STATIC void ujson_enc_flush(ujson_enc_t *e) {
+    if (e->len == 0) {
+        return;
+    }
+    if (e->stream_obj == MP_OBJ_NULL) {
+        vstr_add_strn(e->vstr, (const char*)e->buf, e->len);
+    } else {
+        int errcode;
+        mp_stream_write_exactly(e->stream_obj, e->buf, e->len, &errcode);
+        if (errcode != 0) {
+            mp_raise_OSError(errcode);
+        }
+    }
+    e->len = 0;
+}
+
+STATIC void ujson_enc_write(ujson_enc_t *e, const char *str, size_t len) {
+    while (len > 0) {
+        if (e->len == UJSON_DUMP_BUF_SIZE) {
+            ujson_enc_flush(e);
+        }
+        size_t n = MIN(len, UJSON_DUMP_BUF_SIZE - e->len);
+        memcpy(e->buf + e->len, str, n);
+        e->len += n;
+        str += n;
+        len -= n;
+    }
+}
+
+#define ujson_enc_str(e, s) ujson_enc_write((e), (s), sizeof(s) - 1)
+
+static inline void ujson_enc_byte(ujson_enc_t *e, byte c) {
+    if (e->len == UJSON_DUMP_BUF_SIZE) {
+        ujson_enc_flush(e);
+    }
+    e->buf[e->len++] = c;
+}
+
+// print_strn callback, used for the types not handled by the encoder itself
+STATIC void ujson_enc_print_strn(void *data, const char *str, size_t len) {
+    ujson_enc_write((ujson_enc_t*)data, str, len);
+}
+
+// If esc_high is set, bytes >= 0x80 are escaped as \u00XX, so a bytes object
+// which is not valid UTF-8 is still encoded as a valid JSON string
+STATIC void ujson_enc_string(ujson_enc_t *e, const byte *str, size_t len, bool esc_high) {
+    ujson_enc_byte(e, '"');
+    const byte *top = str + len;
+    while (str < top) {
+        // copy the run of chars which don't need escaping in one go
+        const byte *s = str;
+        while (s < top && *s >= 32 && *s != '"' && *s != '\\' && (!esc_high || *s < 0x80)) {
+            s++;
+        }
+        ujson_enc_write(e, (const char*)str, s - str);
+        if (s == top) {
+            break;
+        }
+        char esc[6] = {'\\', *s};
+        size_t n = 2;
+        if (*s == '\n') {
+            esc[1] = 'n';
+        } else if (*s == '\r') {
+            esc[1] = 'r';
+        } else if (*s == '\t') {
+            esc[1] = 't';
+        } else if (*s < 32 || *s >= 0x80) {
+            // other control chars, and bytes which are not UTF-8
+            static const char hexdig[] = "0123456789abcdef";
+            esc[1] = 'u';
+            esc[2] = '0';
+            esc[3] = '0';
+            esc[4] = hexdig[*s >> 4];
+            esc[5] = hexdig[*s & 0xf];
+            n = 6;
+        }
+        ujson_enc_write(e, esc, n);
+        str = s + 1;
     }
-    mp_print_t print = {MP_OBJ_TO_PTR(stream), mp_stream_write_adaptor};
-    mp_obj_print_helper(&print, obj, PRINT_JSON);
+    ujson_enc_byte(e, '"');
+}
+
+STATIC void ujson_enc_int(ujson_enc_t *e, mp_int_t val) {
+    char buf[24];
+    char *p = buf + sizeof(buf);
+    mp_uint_t u = (val < 0) ? -(mp_uint_t)val : (mp_uint_t)val;
+    do {
+        *--p = '0' + u % 10;
+        u /= 10;
+    } while (u != 0);
+    if (val < 0) {
+        *--p = '-';
+    }
+    ujson_enc_write(e, p, buf + sizeof(buf) - p);
+}
+
+STATIC void ujson_enc_obj(ujson_enc_t *e, mp_obj_t obj) {
+    MP_STACK_CHECK();
+    if (obj == mp_const_none) {
+        ujson_enc_str(e, "null");
+    } else if (obj == mp_const_true) {
+        ujson_enc_str(e, "true");
+    } else if (obj == mp_const_false) {
+        ujson_enc_str(e, "false");
+    } else if (MP_OBJ_IS_SMALL_INT(obj)) {
+        ujson_enc_int(e, MP_OBJ_SMALL_INT_VALUE(obj));
+    } else if (MP_OBJ_IS_STR(obj)) {
+        GET_STR_DATA_LEN(obj, str_data, str_len);
+        ujson_enc_string(e, str_data, str_len, false);
+    } else if (MP_OBJ_IS_TYPE(obj, &mp_type_bytes)) {
+        // bytes are encoded as a string, as the print method did;
+        // if they are not valid UTF-8 the high bytes are escaped
+        GET_STR_DATA_LEN(obj, str_data, str_len);
+        #if MICROPY_PY_BUILTINS_STR_UNICODE
+        ujson_enc_string(e, str_data, str_len, !utf8_check(str_data, str_len));
+        #else
+        ujson_enc_string(e, str_data, str_len, true);
+        #endif
+    #if MICROPY_PY_BUILTINS_FLOAT
+    } else if (mp_obj_is_float(obj)) {
+        char buf[32];
+        mp_format_float(mp_obj_float_get(obj), buf, sizeof(buf), 'g', e->precision, '\0');
+        ujson_enc_write(e, buf, strlen(buf));
+        if (strchr(buf, '.') == NULL && strchr(buf, 'e') == NULL && strchr(buf, 'n') == NULL) {
+            // same as float print, always output decimal point (unless inf or nan)
+            ujson_enc_str(e, ".0");
+        }
+    #endif
+    } else if (MP_OBJ_IS_TYPE(obj, &mp_type_list) || MP_OBJ_IS_TYPE(obj, &mp_type_tuple)) {
+        size_t len;
+        mp_obj_t *items;
+        mp_obj_get_array(obj, &len, &items);
+        ujson_enc_byte(e, '[');
+        for (size_t i = 0; i < len; i++) {
+            if (i > 0) {
+                ujson_enc_str(e, ", ");
+            }
+            ujson_enc_obj(e, items[i]);
+        }
+        ujson_enc_byte(e, ']');
+    } else if (MP_OBJ_IS_TYPE(obj, &mp_type_dict)
+        #if MICROPY_PY_COLLECTIONS_ORDEREDDICT
+        || MP_OBJ_IS_TYPE(obj, &mp_type_ordereddict)
+        #endif
+        ) {
+        mp_map_t *map = mp_obj_dict_get_map(obj);
+        bool first = true;
+        ujson_enc_byte(e, '{');
+        for (size_t i = 0; i < map->alloc; i++) {
+            if (MP_MAP_SLOT_IS_FILLED(map, i)) {
+                if (!first) {
+                    ujson_enc_str(e, ", ");
+                }
+                first = false;
+                ujson_enc_obj(e, map->table[i].key);
+                ujson_enc_str(e, ": ");
+                ujson_enc_obj(e, map->table[i].value);
+            }
+        }
+        ujson_enc_byte(e, '}');
+    } else {
+        mp_print_t print = {e, ujson_enc_print_strn};
+        mp_obj_print_helper(&print, obj, PRINT_JSON);
+    }
+}
+
+STATIC void ujson_enc_init(ujson_enc_t *e, size_t n_args, const mp_obj_t *args) {
+    e->len = 0;
+    #if MICROPY_PY_BUILTINS_FLOAT
+    e->precision = float_precision;
+    if (n_args > 0 && args[0] != mp_const_none) {
+        e->precision = mp_obj_get_int(args[0]);
+        if ((e->precision < 1) || (e->precision > 16)) {
+            mp_raise_ValueError("Precision must be 1 - 16");
+        }
+    }
+    #else
+    (void)n_args;
+    (void)args;
+    e->precision = 0;
+    #endif
+}
+
+// dump(obj, stream[, precision])
+STATIC mp_obj_t mod_ujson_dump(size_t n_args, const mp_obj_t *args) {
+    ujson_enc_t e;
+    mp_get_stream_raise(args[1], MP_STREAM_OP_WRITE);
+    e.stream_obj = args[1];
+    e.vstr = NULL;
+    ujson_enc_init(&e, n_args - 2, args + 2);
+    ujson_enc_obj(&e, args[0]);
+    ujson_enc_flush(&e);
     return mp_const_none;
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_ujson_dump_obj, mod_ujson_dump);
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_ujson_dump_obj, 2, 3, mod_ujson_dump);
 
-STATIC mp_obj_t mod_ujson_dumps(mp_obj_t obj) {
+// dumps(obj[, precision])
+STATIC mp_obj_t mod_ujson_dumps(size_t n_args, const mp_obj_t *args) {
+    ujson_enc_t e;
     vstr_t vstr;
-    mp_print_t print;
-    vstr_init_print(&vstr, 8, &print);
-    mp_obj_print_helper(&print, obj, PRINT_JSON);
+    vstr_init(&vstr, UJSON_DUMP_BUF_SIZE);
+    e.stream_obj = MP_OBJ_NULL;
+    e.vstr = &vstr;
+    ujson_enc_init(&e, n_args - 1, args + 1);
+    ujson_enc_obj(&e, args[0]);
+    ujson_enc_flush(&e);
     return mp_obj_new_str_from_vstr(&mp_type_str, &vstr);
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_ujson_dumps_obj, mod_ujson_dumps);
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_ujson_dumps_obj, 1, 2, mod_ujson_dumps);
 
 // The function below implements a simple non-recursive JSON parser.
 //
 // The JSON specification is at http://www.ietf.org/rfc/rfc4627.txt
 // The parser here will parse any valid JSON and return the correct
-// corresponding Python object.  It allows through a superset of JSON, since
-// it treats commas and colons as "whitespace", and doesn't care if
-// brackets/braces are correctly paired.  It will raise a ValueError if the
+// corresponding Python object.  Commas, colons and closing brackets/braces
+// must be where the grammar puts them.  It will raise a ValueError if the
 // input is outside it's specs.
 //
 // Most of the work is parsing the primitives (null, false, true, numbers,
 // strings).  It does 1 pass over the input stream.  It tries to be fast and
 // small in code size, while not using more RAM than necessary.
 
+// Size of the read buffer used for streams
+#ifndef UJSON_STREAM_BUF_SIZE
+#define UJSON_STREAM_BUF_SIZE (256)
+#endif
+
 typedef struct _ujson_stream_t {
     mp_obj_t stream_obj;
     mp_uint_t (*read)(mp_obj_t obj, void *buf, mp_uint_t size, int *errcode);
     int errcode;
     byte cur;
+    byte *buf;  // read buffer, or the whole input if read is NULL
+    size_t pos;
+    size_t len;
 } ujson_stream_t;
 
 #define S_EOF (0) // null is not allowed in json stream so is ok as EOF marker
-#define S_END(s) ((s).cur == S_EOF)
-#define S_CUR(s) ((s).cur)
-#define S_NEXT(s) (ujson_stream_next(&(s)))
-
-STATIC byte ujson_stream_next(ujson_stream_t *s) {
-    mp_uint_t ret = s->read(s->stream_obj, &s->cur, 1, &s->errcode);
-    if (s->errcode != 0) {
-        mp_raise_OSError(s->errcode);
+#define S_END(s) ((s)->cur == S_EOF)
+#define S_CUR(s) ((s)->cur)
+#define S_NEXT(s) ((s)->pos < (s)->len ? ((s)->cur = (s)->buf[(s)->pos++]) : ujson_stream_fill(s))
+
+STATIC byte ujson_stream_fill(ujson_stream_t *s) {
+    s->pos = 0;
+    s->len = 0;
+    if (s->read != NULL) {
+        mp_uint_t ret = s->read(s->stream_obj, s->buf, UJSON_STREAM_BUF_SIZE, &s->errcode);
+        if (s->errcode != 0) {
+            mp_raise_OSError(s->errcode);
+        }
+        s->len = ret;
     }
-    if (ret == 0) {
+    if (s->len == 0) {
         s->cur = S_EOF;
+        return S_EOF;
     }
+    s->cur = s->buf[s->pos++];
     return s->cur;
 }
 
-STATIC mp_obj_t mod_ujson_load(mp_obj_t stream_obj) {
+STATIC void ujson_stream_init(ujson_stream_t *s, mp_obj_t stream_obj) {
     const mp_stream_p_t *stream_p = mp_get_stream_raise(stream_obj, MP_STREAM_OP_READ);
-    ujson_stream_t s = {stream_obj, stream_p->read, 0, 0};
-    vstr_t vstr;
-    vstr_init(&vstr, 8);
+    s->stream_obj = stream_obj;
+    s->read = stream_p->read;
+    s->errcode = 0;
+    s->cur = 0;
+    s->buf = m_new(byte, UJSON_STREAM_BUF_SIZE);
+    s->pos = 0;
+    s->len = 0;
+}
+
+STATIC NORETURN void ujson_syntax_error(void) {
+    mp_raise_ValueError("syntax error in JSON");
+}
+
+// Parse one JSON value starting at the current character.
+// On return the current character is the one following the value.
+STATIC mp_obj_t ujson_parse(ujson_stream_t *s, vstr_t *vstr) {
     mp_obj_list_t stack; // we use a list as a simple stack for nested JSON
     stack.len = 0;
     stack.items = NULL;
     mp_obj_t stack_top = MP_OBJ_NULL;
     mp_obj_type_t *stack_top_type = NULL;
     mp_obj_t stack_key = MP_OBJ_NULL;
-    S_NEXT(s);
+    // what the open container expects next: a value (or key) 0, ',' or ':'
+    byte expect = 0;
+    bool opened = false; // the container was just opened, it may be closed at once
     for (;;) {
         cont:
         if (S_END(s)) {
-            break;
+            goto fail;
         }
         mp_obj_t next = MP_OBJ_NULL;
         bool enter = false;
@@ -113,6 +359,12 @@ STATIC mp_obj_t mod_ujson_load(mp_obj_t stream_obj) {
         switch (cur) {
             case ',':
             case ':':
+                if (stack_top == MP_OBJ_NULL || expect != cur) {
+                    goto fail;
+                }
+                expect = 0;
+                opened = false;
+                goto cont;
             case ' ':
             case '\t':
             case '\n':
@@ -143,7 +395,7 @@ STATIC mp_obj_t mod_ujson_load(mp_obj_t stream_obj) {
                 }
                 break;
             case '"':
-                vstr_reset(&vstr);
+                vstr_reset(vstr);
                 for (; !S_END(s) && S_CUR(s) != '"';) {
                     byte c = S_CUR(s);
                     if (c == '\\') {
@@ -163,12 +415,12 @@ STATIC mp_obj_t mod_ujson_load(mp_obj_t stream_obj) {
                                     }
                                     num = (num << 4) | c;
                                 }
-                                vstr_add_char(&vstr, num);
+                                vstr_add_char(vstr, num);
                                 goto str_cont;
                             }
                         }
                     }
-                    vstr_add_byte(&vstr, c);
+                    vstr_add_byte(vstr, c);
                 str_cont:
                     S_NEXT(s);
                 }
@@ -176,18 +428,18 @@ STATIC mp_obj_t mod_ujson_load(mp_obj_t stream_obj) {
                     goto fail;
                 }
                 S_NEXT(s);
-                next = mp_obj_new_str(vstr.buf, vstr.len);
+                next = mp_obj_new_str(vstr->buf, vstr->len);
                 break;
             case '-':
             case '0': case '1': case '2': case '3': case '4': case '5': case '6': case '7': case '8': case '9': {
                 bool flt = false;
-                vstr_reset(&vstr);
+                vstr_reset(vstr);
                 for (;;) {
-                    vstr_add_byte(&vstr, cur);
+                    vstr_add_byte(vstr, cur);
                     cur = S_CUR(s);
                     if (cur == '.' || cur == 'E' || cur == 'e') {
                         flt = true;
-                    } else if (cur == '-' || unichar_isdigit(cur)) {
+                    } else if (cur == '-' || cur == '+' || unichar_isdigit(cur)) {
                         // pass
                     } else {
                         break;
@@ -195,9 +447,9 @@ STATIC mp_obj_t mod_ujson_load(mp_obj_t stream_obj) {
                     S_NEXT(s);
                 }
                 if (flt) {
-                    next = mp_parse_num_decimal(vstr.buf, vstr.len, false, false, NULL);
+                    next = mp_parse_num_decimal(vstr->buf, vstr->len, false, false, NULL);
                 } else {
-                    next = mp_parse_num_integer(vstr.buf, vstr.len, 10, NULL);
+                    next = mp_parse_num_integer(vstr->buf, vstr->len, 10, NULL);
                 }
                 break;
             }
@@ -215,6 +467,12 @@ STATIC mp_obj_t mod_ujson_load(mp_obj_t stream_obj) {
                     // no object at all
                     goto fail;
                 }
+                if ((expect != ',' && !opened) || (cur == ']') != (stack_top_type == &mp_type_list)) {
+                    // after a separator, or not matching the open container
+                    goto fail;
+                }
+                expect = ',';
+                opened = false;
                 if (stack.len == 0) {
                     // finished; compound object
                     goto success;
@@ -227,6 +485,12 @@ STATIC mp_obj_t mod_ujson_load(mp_obj_t stream_obj) {
             default:
                 goto fail;
         }
+        if (stack_top != MP_OBJ_NULL && expect != 0) {
+            // missing separator
+            goto fail;
+        }
+        opened = enter;
+        expect = ',';
         if (stack_top == MP_OBJ_NULL) {
             stack_top = next;
             stack_top_type = mp_obj_get_type(stack_top);
@@ -241,9 +505,10 @@ STATIC mp_obj_t mod_ujson_load(mp_obj_t stream_obj) {
             } else {
                 if (stack_key == MP_OBJ_NULL) {
                     stack_key = next;
-                    if (enter) {
+                    if (!MP_OBJ_IS_STR(next)) {
                         goto fail;
                     }
+                    expect = ':';
                 } else {
                     mp_obj_dict_store(stack_top, stack_key, next);
                     stack_key = MP_OBJ_NULL;
@@ -260,43 +525,217 @@ STATIC mp_obj_t mod_ujson_load(mp_obj_t stream_obj) {
                 stack_top_type = mp_obj_get_type(stack_top);
             }
         }
+        if (enter) {
+            expect = 0;
+        }
     }
     success:
-    // eat trailing whitespace
+    if (stack.items != NULL) {
+        m_del(mp_obj_t, stack.items, stack.alloc);
+    }
+    return stack_top;
+
+    fail:
+    ujson_syntax_error();
+}
+
+// Check that only whitespace follows the parsed value
+STATIC void ujson_parse_end(ujson_stream_t *s) {
     while (unichar_isspace(S_CUR(s))) {
         S_NEXT(s);
     }
     if (!S_END(s)) {
         // unexpected chars
-        goto fail;
-    }
-    if (stack_top == MP_OBJ_NULL || stack.len != 0) {
-        // not exactly 1 object
-        goto fail;
+        ujson_syntax_error();
     }
+}
+
+STATIC mp_obj_t ujson_load_stream(ujson_stream_t *s) {
+    vstr_t vstr;
+    vstr_init(&vstr, 8);
+    S_NEXT(s);
+    mp_obj_t obj = ujson_parse(s, &vstr);
+    ujson_parse_end(s);
     vstr_clear(&vstr);
-    return stack_top;
+    return obj;
+}
 
-    fail:
-    mp_raise_ValueError("syntax error in JSON");
+STATIC mp_obj_t mod_ujson_load(mp_obj_t stream_obj) {
+    ujson_stream_t s;
+    ujson_stream_init(&s, stream_obj);
+    mp_obj_t obj = ujson_load_stream(&s);
+    m_del(byte, s.buf, UJSON_STREAM_BUF_SIZE);
+    return obj;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_ujson_load_obj, mod_ujson_load);
 
 STATIC mp_obj_t mod_ujson_loads(mp_obj_t obj) {
     size_t len;
     const char *buf = mp_obj_str_get_data(obj, &len);
-    vstr_t vstr = {len, len, (char*)buf, true};
-    mp_obj_stringio_t sio = {{&mp_type_stringio}, &vstr, 0, MP_OBJ_NULL};
-    return mod_ujson_load(MP_OBJ_FROM_PTR(&sio));
+    // parse directly from the string data, no read function needed
+    ujson_stream_t s = {MP_OBJ_NULL, NULL, 0, 0, (byte*)buf, 0, len};
+    return ujson_load_stream(&s);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_ujson_loads_obj, mod_ujson_loads);
 
+// Iterator returned by iterload(stream, depth=1).
+// Containers nested less than 'depth' levels deep are not built, instead each
+// value inside them is returned as a (path, value) tuple, where path is a tuple
+// of the dict keys and list indices leading to the value.  So only one value at
+// a time is held in memory, e.g. for the elements of a large top-level list.
+// An empty container which is not built is returned as a value itself, so the
+// tuples always describe the whole document.
+typedef struct _ujson_iter_t {
+    mp_obj_base_t base;
+    ujson_stream_t s;
+    vstr_t vstr;
+    mp_uint_t depth;
+    vstr_t kinds;           // kind of each open container: '[' list, '{' dict before key, ':' dict before value
+    mp_obj_list_t path;     // key or index of the current value in each open container
+    byte expect;            // what the innermost open container expects next: 0 value or key, ',' or ':'
+    bool opened;            // the innermost container was just opened, it may be closed at once
+    bool started;
+} ujson_iter_t;
+
+// Move the innermost open container past the value just completed
+STATIC void ujson_iter_advance(ujson_iter_t *self) {
+    size_t level = self->kinds.len;
+    self->expect = ',';
+    self->opened = false;
+    if (level == 0) {
+        return;
+    }
+    char *kind = &self->kinds.buf[level - 1];
+    if (*kind == '[') {
+        self->path.items[level - 1] = MP_OBJ_NEW_SMALL_INT(MP_OBJ_SMALL_INT_VALUE(self->path.items[level - 1]) + 1);
+    } else {
+        *kind = '{';
+    }
+}
+
+STATIC mp_obj_t ujson_iter_iternext(mp_obj_t self_in) {
+    ujson_iter_t *self = MP_OBJ_TO_PTR(self_in);
+    ujson_stream_t *s = &self->s;
+    for (;;) {
+        byte c = S_CUR(s);
+        size_t level = self->kinds.len;
+        if (unichar_isspace(c)) {
+            S_NEXT(s);
+            continue;
+        }
+        if (c == ',' || c == ':') {
+            if (level == 0 || self->expect != c) {
+                ujson_syntax_error();
+            }
+            S_NEXT(s);
+            self->expect = 0;
+            self->opened = false;
+            continue;
+        }
+        if (S_END(s)) {
+            if (level > 0 || !self->started) {
+                ujson_syntax_error();
+            }
+            if (self->s.buf != NULL && self->s.read != NULL) {
+                m_del(byte, self->s.buf, UJSON_STREAM_BUF_SIZE);
+                self->s.buf = NULL;
+            }
+            return MP_OBJ_STOP_ITERATION;
+        }
+        if (level == 0 && self->started) {
+            // more than one top-level value
+            ujson_syntax_error();
+        }
+        char *kind = (level > 0) ? &self->kinds.buf[level - 1] : NULL;
+        if (c == ']' || c == '}') {
+            if (kind == NULL || (c == ']') != (*kind == '[') || (self->expect != ',' && !self->opened)) {
+                ujson_syntax_error();
+            }
+            S_NEXT(s);
+            bool empty = self->opened;
+            self->kinds.len--;
+            self->path.len--;
+            if (empty) {
+                // an empty container has no values inside, return it as a value
+                mp_obj_t tuple[2];
+                tuple[0] = mp_obj_new_tuple(level - 1, self->path.items);
+                tuple[1] = (c == ']') ? mp_obj_new_list(0, NULL) : mp_obj_new_dict(0);
+                ujson_iter_advance(self);
+                return mp_obj_new_tuple(2, tuple);
+            }
+            ujson_iter_advance(self);
+            continue;
+        }
+        if (kind != NULL && self->expect != 0) {
+            // missing separator
+            ujson_syntax_error();
+        }
+        if (kind != NULL && *kind == '{') {
+            // dict key
+            if (c != '"') {
+                ujson_syntax_error();
+            }
+            self->path.items[level - 1] = ujson_parse(s, &self->vstr);
+            *kind = ':';
+            self->expect = ':';
+            self->opened = false;
+            continue;
+        }
+        self->started = true;
+        if (level < self->depth && (c == '[' || c == '{')) {
+            // enter the container without building it
+            S_NEXT(s);
+            vstr_add_byte(&self->kinds, c);
+            mp_obj_list_append(MP_OBJ_FROM_PTR(&self->path), (c == '[') ? MP_OBJ_NEW_SMALL_INT(0) : mp_const_none);
+            self->expect = 0;
+            self->opened = true;
+            continue;
+        }
+        mp_obj_t tuple[2];
+        tuple[1] = ujson_parse(s, &self->vstr);
+        tuple[0] = mp_obj_new_tuple(level, self->path.items);
+        ujson_iter_advance(self);
+        return mp_obj_new_tuple(2, tuple);
+    }
+}
+
+STATIC const mp_obj_type_t ujson_iter_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_iterator,
+    .getiter = mp_identity_getiter,
+    .iternext = ujson_iter_iternext,
+};
+
+STATIC mp_obj_t mod_ujson_iterload(size_t n_args, const mp_obj_t *args) {
+    ujson_iter_t *self = m_new_obj(ujson_iter_t);
+    self->base.type = &ujson_iter_type;
+    if (MP_OBJ_IS_STR_OR_BYTES(args[0])) {
+        size_t len;
+        const char *buf = mp_obj_str_get_data(args[0], &len);
+        ujson_stream_t s = {args[0], NULL, 0, 0, (byte*)buf, 0, len};
+        self->s = s;
+    } else {
+        ujson_stream_init(&self->s, args[0]);
+    }
+    vstr_init(&self->vstr, 8);
+    vstr_init(&self->kinds, 8);
+    mp_obj_list_init(&self->path, 0);
+    self->depth = (n_args > 1) ? mp_obj_get_int(args[1]) : 1;
+    self->expect = 0;
+    self->opened = false;
+    self->started = false;
+    S_NEXT(&self->s);
+    return MP_OBJ_FROM_PTR(self);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_ujson_iterload_obj, 1, 2, mod_ujson_iterload);
+
 STATIC const mp_rom_map_elem_t mp_module_ujson_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_ujson) },
     { MP_ROM_QSTR(MP_QSTR_dump), MP_ROM_PTR(&mod_ujson_dump_obj) },
     { MP_ROM_QSTR(MP_QSTR_dumps), MP_ROM_PTR(&mod_ujson_dumps_obj) },
     { MP_ROM_QSTR(MP_QSTR_load), MP_ROM_PTR(&mod_ujson_load_obj) },
     { MP_ROM_QSTR(MP_QSTR_loads), MP_ROM_PTR(&mod_ujson_loads_obj) },
+    { MP_ROM_QSTR(MP_QSTR_iterload), MP_ROM_PTR(&mod_ujson_iterload_obj) },
 };
 
 STATIC MP_DEFINE_CONST_DICT(mp_module_ujson_globals, mp_module_ujson_globals_table);
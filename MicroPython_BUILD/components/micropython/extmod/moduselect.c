@@ -29,6 +29,7 @@
 #if MICROPY_PY_USELECT
 
 #include <stdio.h>
+#include <stddef.h>
 
 #include "py/runtime.h"
 #include "py/obj.h"
@@ -36,6 +37,7 @@
 #include "py/stream.h"
 #include "py/mperrno.h"
 #include "py/mphal.h"
+#include "extmod/moduselect.h"
 
 // Flags for poll()
 #define FLAG_ONESHOT (1)
@@ -49,8 +51,20 @@ typedef struct _poll_obj_t {
     mp_uint_t (*ioctl)(mp_obj_t obj, mp_uint_t request, mp_uint_t arg, int *errcode);
     mp_uint_t flags;
     mp_uint_t flags_ret;
+    #if MICROPY_PY_USELECT_NOTIFY
+    bool sweep;                 // no readiness notification, poll on each pass
+    mp_poll_notify_t notify;
+    struct _poll_obj_t *ret_next;
+    // on MP_STATE_VM(uselect_notify_entries) while the stream holds the notification
+    struct _poll_obj_t *notify_prev;
+    struct _poll_obj_t *notify_next;
+    #endif
 } poll_obj_t;
 
+#if MICROPY_PY_USELECT_NOTIFY
+#define POLL_OBJ_FROM_NOTIFY(n) ((poll_obj_t*)((byte*)(n) - offsetof(poll_obj_t, notify)))
+#endif
+
 STATIC void poll_map_add(mp_map_t *poll_map, const mp_obj_t *obj, mp_uint_t obj_len, mp_uint_t flags, bool or_flags) {
     for (mp_uint_t i = 0; i < obj_len; i++) {
         mp_map_elem_t *elem = mp_map_lookup(poll_map, mp_obj_id(obj[i]), MP_MAP_LOOKUP_ADD_IF_NOT_FOUND);
@@ -62,6 +76,16 @@ STATIC void poll_map_add(mp_map_t *poll_map, const mp_obj_t *obj, mp_uint_t obj_
             poll_obj->ioctl = stream_p->ioctl;
             poll_obj->flags = flags;
             poll_obj->flags_ret = 0;
+            #if MICROPY_PY_USELECT_NOTIFY
+            poll_obj->sweep = true;
+            poll_obj->notify.next = NULL;
+            poll_obj->notify.ready = NULL;
+            poll_obj->notify.flags = flags;
+            poll_obj->notify.queued = false;
+            poll_obj->ret_next = NULL;
+            poll_obj->notify_prev = NULL;
+            poll_obj->notify_next = NULL;
+            #endif
             elem->value = poll_obj;
         } else {
             // object exists; update its flags
@@ -83,6 +107,12 @@ STATIC mp_uint_t poll_map_poll(mp_map_t *poll_map, mp_uint_t *rwx_num) {
         }
 
         poll_obj_t *poll_obj = (poll_obj_t*)poll_map->table[i].value;
+        #if MICROPY_PY_USELECT_NOTIFY
+        if (!poll_obj->sweep) {
+            // checked from the ready list
+            continue;
+        }
+        #endif
         int errcode;
         mp_int_t ret = poll_obj->ioctl(poll_obj->obj, MP_STREAM_POLL, poll_obj->flags, &errcode);
         poll_obj->flags_ret = ret;
@@ -112,7 +142,7 @@ STATIC mp_uint_t poll_map_poll(mp_map_t *poll_map, mp_uint_t *rwx_num) {
 }
 
 /// \function select(rlist, wlist, xlist[, timeout])
-STATIC mp_obj_t select_select(uint n_args, const mp_obj_t *args) {
+STATIC mp_obj_t select_select(size_t n_args, const mp_obj_t *args) {
     // get array data from tuple/list arguments
     size_t rwx_len[3];
     mp_obj_t *r_array, *w_array, *x_array;
@@ -188,10 +218,195 @@ typedef struct _mp_obj_poll_t {
     int flags;
     // callee-owned tuple
     mp_obj_t ret_tuple;
+    #if MICROPY_PY_USELECT_NOTIFY
+    mp_uint_t n_sweep;          // number of entries without readiness notification
+    mp_poll_ready_t ready;
+    poll_obj_t *ret_head;       // ready entries found by the last poll
+    poll_obj_t *iter_ret;
+    #endif
 } mp_obj_poll_t;
 
+#if MICROPY_PY_USELECT_NOTIFY
+
+// Put the entry on its ready list, the poll lock must be held.
+// Returns the semaphore to give to wake up the sleeping poll, if wake is true.
+STATIC void *poll_ready_queue_locked(mp_poll_notify_t *notify, bool wake) {
+    mp_poll_ready_t *ready = notify->ready;
+    if (ready == NULL || notify->queued) {
+        return NULL;
+    }
+    notify->queued = true;
+    notify->next = NULL;
+    if (ready->tail == NULL) {
+        ready->head = notify;
+    } else {
+        ready->tail->next = notify;
+    }
+    ready->tail = notify;
+    return wake ? ready->sem : NULL;
+}
+
+// Put the entry on its ready list, optionally waking up the sleeping poll
+STATIC void poll_ready_queue(mp_poll_notify_t *notify, bool wake) {
+    mp_hal_poll_lock();
+    void *sem = poll_ready_queue_locked(notify, wake);
+    mp_hal_poll_unlock();
+    if (sem != NULL) {
+        mp_hal_poll_sem_give(sem);
+    }
+}
+
+void mp_poll_notify(mp_poll_notify_t *notify) {
+    if (notify != NULL) {
+        poll_ready_queue(notify, true);
+    }
+}
+
+void mp_poll_notify_slot(mp_poll_notify_t **slot) {
+    void *sem = NULL;
+    mp_hal_poll_lock();
+    mp_poll_notify_t *notify = *slot;
+    if (notify != NULL) {
+        sem = poll_ready_queue_locked(notify, true);
+    }
+    mp_hal_poll_unlock();
+    if (sem != NULL) {
+        mp_hal_poll_sem_give(sem);
+    }
+}
+
+// The entries held by streams are kept on a root list, so they stay allocated
+// until poll_notify_remove, also when the poll object is unreachable: the poll
+// object's finaliser uses the list to remove them, and the streams may notify
+// them until then.
+STATIC void poll_notify_link(poll_obj_t *poll_obj) {
+    poll_obj->notify_prev = NULL;
+    poll_obj->notify_next = MP_STATE_VM(uselect_notify_entries);
+    if (poll_obj->notify_next != NULL) {
+        poll_obj->notify_next->notify_prev = poll_obj;
+    }
+    MP_STATE_VM(uselect_notify_entries) = poll_obj;
+}
+
+STATIC void poll_notify_unlink(poll_obj_t *poll_obj) {
+    if (poll_obj->notify_prev == NULL) {
+        MP_STATE_VM(uselect_notify_entries) = poll_obj->notify_next;
+    } else {
+        poll_obj->notify_prev->notify_next = poll_obj->notify_next;
+    }
+    if (poll_obj->notify_next != NULL) {
+        poll_obj->notify_next->notify_prev = poll_obj->notify_prev;
+    }
+    poll_obj->notify_prev = NULL;
+    poll_obj->notify_next = NULL;
+}
+
+// Register the readiness notification of a new entry, or
+// just queue the entry to be checked if its flags were changed
+STATIC void poll_notify_update(mp_obj_poll_t *self, poll_obj_t *poll_obj, bool is_new) {
+    poll_obj->notify.flags = poll_obj->flags;
+    if (is_new) {
+        poll_obj->notify.ready = &self->ready;
+        int errcode;
+        if (poll_obj->ioctl(poll_obj->obj, MP_STREAM_POLL_NOTIFY, (uintptr_t)&poll_obj->notify, &errcode) != 0) {
+            // not supported by the stream, it will be polled on each pass
+            poll_obj->notify.ready = NULL;
+            self->n_sweep++;
+            return;
+        }
+        poll_obj->sweep = false;
+        poll_notify_link(poll_obj);
+    }
+    if (!poll_obj->sweep) {
+        poll_ready_queue(&poll_obj->notify, false);
+    }
+}
+
+// Remove the readiness notification of the entry
+STATIC void poll_notify_remove(mp_obj_poll_t *self, poll_obj_t *poll_obj) {
+    if (poll_obj->sweep) {
+        self->n_sweep--;
+        return;
+    }
+    int errcode;
+    poll_obj->ioctl(poll_obj->obj, MP_STREAM_POLL_NOTIFY_CLEAR, (uintptr_t)&poll_obj->notify, &errcode);
+    mp_hal_poll_lock();
+    mp_poll_notify_t *notify = &poll_obj->notify;
+    if (notify->queued) {
+        mp_poll_notify_t *prev = NULL;
+        for (mp_poll_notify_t *n = self->ready.head; n != NULL; prev = n, n = n->next) {
+            if (n == notify) {
+                if (prev == NULL) {
+                    self->ready.head = n->next;
+                } else {
+                    prev->next = n->next;
+                }
+                if (self->ready.tail == n) {
+                    self->ready.tail = prev;
+                }
+                break;
+            }
+        }
+        notify->queued = false;
+    }
+    notify->ready = NULL;
+    mp_hal_poll_unlock();
+    poll_notify_unlink(poll_obj);
+}
+
+// Check the entries on the ready list.
+// The ones which are ready are linked on the ret list, and queued again, so they
+// are checked on the next poll, the others are dropped until the next notification.
+STATIC mp_uint_t poll_ready_poll(mp_obj_poll_t *self) {
+    mp_hal_poll_lock();
+    mp_poll_notify_t *notify = self->ready.head;
+    self->ready.head = NULL;
+    self->ready.tail = NULL;
+    mp_hal_poll_unlock();
+
+    mp_uint_t n_ready = 0;
+    poll_obj_t **ret_tail = &self->ret_head;
+    while (notify != NULL) {
+        mp_hal_poll_lock();
+        mp_poll_notify_t *next = notify->next;
+        // from now on a new notification queues the entry again
+        notify->queued = false;
+        mp_hal_poll_unlock();
+
+        poll_obj_t *poll_obj = POLL_OBJ_FROM_NOTIFY(notify);
+        int errcode;
+        mp_int_t ret = poll_obj->ioctl(poll_obj->obj, MP_STREAM_POLL, poll_obj->flags, &errcode);
+        poll_obj->flags_ret = ret;
+
+        if (ret == -1) {
+            // error doing ioctl, put the entries back on the ready list
+            *ret_tail = NULL;
+            poll_ready_queue(notify, false);
+            for (notify = next; notify != NULL; notify = next) {
+                next = notify->next;
+                notify->queued = false;
+                poll_ready_queue(notify, false);
+            }
+            mp_raise_OSError(errcode);
+        }
+
+        if (ret != 0) {
+            // object is ready
+            n_ready += 1;
+            *ret_tail = poll_obj;
+            ret_tail = &poll_obj->ret_next;
+            poll_ready_queue(notify, false);
+        }
+        notify = next;
+    }
+    *ret_tail = NULL;
+    return n_ready;
+}
+
+#endif // MICROPY_PY_USELECT_NOTIFY
+
 /// \method register(obj[, eventmask])
-STATIC mp_obj_t poll_register(uint n_args, const mp_obj_t *args) {
+STATIC mp_obj_t poll_register(size_t n_args, const mp_obj_t *args) {
     mp_obj_poll_t *self = args[0];
     mp_uint_t flags;
     if (n_args == 3) {
@@ -199,7 +414,14 @@ STATIC mp_obj_t poll_register(uint n_args, const mp_obj_t *args) {
     } else {
         flags = MP_STREAM_POLL_RD | MP_STREAM_POLL_WR;
     }
+    #if MICROPY_PY_USELECT_NOTIFY
+    bool is_new = (mp_map_lookup(&self->poll_map, mp_obj_id(args[1]), MP_MAP_LOOKUP) == NULL);
+    #endif
     poll_map_add(&self->poll_map, &args[1], 1, flags, false);
+    #if MICROPY_PY_USELECT_NOTIFY
+    mp_map_elem_t *elem = mp_map_lookup(&self->poll_map, mp_obj_id(args[1]), MP_MAP_LOOKUP);
+    poll_notify_update(self, (poll_obj_t*)elem->value, is_new);
+    #endif
     return mp_const_none;
 }
 MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(poll_register_obj, 2, 3, poll_register);
@@ -207,8 +429,15 @@ MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(poll_register_obj, 2, 3, poll_register);
 /// \method unregister(obj)
 STATIC mp_obj_t poll_unregister(mp_obj_t self_in, mp_obj_t obj_in) {
     mp_obj_poll_t *self = self_in;
-    mp_map_lookup(&self->poll_map, mp_obj_id(obj_in), MP_MAP_LOOKUP_REMOVE_IF_FOUND);
+    mp_map_elem_t *elem = mp_map_lookup(&self->poll_map, mp_obj_id(obj_in), MP_MAP_LOOKUP_REMOVE_IF_FOUND);
     // TODO raise KeyError if obj didn't exist in map
+    #if MICROPY_PY_USELECT_NOTIFY
+    if (elem != NULL) {
+        poll_notify_remove(self, (poll_obj_t*)elem->value);
+    }
+    #else
+    (void)elem;
+    #endif
     return mp_const_none;
 }
 MP_DEFINE_CONST_FUN_OBJ_2(poll_unregister_obj, poll_unregister);
@@ -221,11 +450,14 @@ STATIC mp_obj_t poll_modify(mp_obj_t self_in, mp_obj_t obj_in, mp_obj_t eventmas
         mp_raise_OSError(MP_ENOENT);
     }
     ((poll_obj_t*)elem->value)->flags = mp_obj_get_int(eventmask_in);
+    #if MICROPY_PY_USELECT_NOTIFY
+    poll_notify_update(self, (poll_obj_t*)elem->value, false);
+    #endif
     return mp_const_none;
 }
 MP_DEFINE_CONST_FUN_OBJ_3(poll_modify_obj, poll_modify);
 
-STATIC mp_uint_t poll_poll_internal(uint n_args, const mp_obj_t *args) {
+STATIC mp_uint_t poll_poll_internal(size_t n_args, const mp_obj_t *args) {
     mp_obj_poll_t *self = args[0];
 
     // work out timeout (its given already in ms)
@@ -248,29 +480,69 @@ STATIC mp_uint_t poll_poll_internal(uint n_args, const mp_obj_t *args) {
     int64_t start_tick = mp_hal_ticks_ms();
     mp_uint_t n_ready;
     for (;;) {
+        #if MICROPY_PY_USELECT_NOTIFY
+        // poll the objects without notification, and check the ready ones
+        n_ready = 0;
+        if (self->n_sweep > 0) {
+            n_ready = poll_map_poll(&self->poll_map, NULL);
+        }
+        n_ready += poll_ready_poll(self);
+        #else
         // poll the objects
         n_ready = poll_map_poll(&self->poll_map, NULL);
+        #endif
         if (n_ready > 0 || (timeout != -1 && mp_hal_ticks_ms() - start_tick >= timeout)) {
             break;
         }
+        #if MICROPY_PY_USELECT_NOTIFY
+        if (self->n_sweep == 0) {
+            // nothing to poll, sleep until notified
+            int64_t wait = MICROPY_PY_USELECT_NOTIFY_SLICE_MS;
+            if (timeout != -1) {
+                wait = MIN(wait, timeout - (int64_t)(mp_hal_ticks_ms() - start_tick));
+            }
+            mp_handle_pending();
+            mp_hal_poll_sem_take(self->ready.sem, wait);
+            continue;
+        }
+        #endif
         MICROPY_EVENT_POLL_HOOK
     }
 
     return n_ready;
 }
 
-STATIC mp_obj_t poll_poll(uint n_args, const mp_obj_t *args) {
+STATIC mp_obj_t poll_poll(size_t n_args, const mp_obj_t *args) {
     mp_obj_poll_t *self = args[0];
     mp_uint_t n_ready = poll_poll_internal(n_args, args);
 
     // one or more objects are ready, or we had a timeout
     mp_obj_list_t *ret_list = mp_obj_new_list(n_ready, NULL);
     n_ready = 0;
+    #if MICROPY_PY_USELECT_NOTIFY
+    for (poll_obj_t *poll_obj = self->ret_head; poll_obj != NULL; poll_obj = poll_obj->ret_next) {
+        mp_obj_t tuple[2] = {poll_obj->obj, MP_OBJ_NEW_SMALL_INT(poll_obj->flags_ret)};
+        ret_list->items[n_ready++] = mp_obj_new_tuple(2, tuple);
+        if (self->flags & FLAG_ONESHOT) {
+            // Don't poll next time, until new event flags will be set explicitly
+            poll_obj->flags = 0;
+            poll_obj->notify.flags = 0;
+        }
+    }
+    if (self->n_sweep == 0) {
+        return ret_list;
+    }
+    #endif
     for (mp_uint_t i = 0; i < self->poll_map.alloc; ++i) {
         if (!MP_MAP_SLOT_IS_FILLED(&self->poll_map, i)) {
             continue;
         }
         poll_obj_t *poll_obj = (poll_obj_t*)self->poll_map.table[i].value;
+        #if MICROPY_PY_USELECT_NOTIFY
+        if (!poll_obj->sweep) {
+            continue;
+        }
+        #endif
         if (poll_obj->flags_ret != 0) {
             mp_obj_t tuple[2] = {poll_obj->obj, MP_OBJ_NEW_SMALL_INT(poll_obj->flags_ret)};
             ret_list->items[n_ready++] = mp_obj_new_tuple(2, tuple);
@@ -294,6 +566,9 @@ STATIC mp_obj_t poll_ipoll(size_t n_args, const mp_obj_t *args) {
     int n_ready = poll_poll_internal(n_args, args);
     self->iter_cnt = n_ready;
     self->iter_idx = 0;
+    #if MICROPY_PY_USELECT_NOTIFY
+    self->iter_ret = self->ret_head;
+    #endif
 
     return args[0];
 }
@@ -308,12 +583,33 @@ STATIC mp_obj_t poll_iternext(mp_obj_t self_in) {
 
     self->iter_cnt--;
 
+    #if MICROPY_PY_USELECT_NOTIFY
+    if (self->iter_ret != NULL) {
+        poll_obj_t *poll_obj = self->iter_ret;
+        self->iter_ret = poll_obj->ret_next;
+        mp_obj_tuple_t *t = MP_OBJ_TO_PTR(self->ret_tuple);
+        t->items[0] = poll_obj->obj;
+        t->items[1] = MP_OBJ_NEW_SMALL_INT(poll_obj->flags_ret);
+        if (self->flags & FLAG_ONESHOT) {
+            // Don't poll next time, until new event flags will be set explicitly
+            poll_obj->flags = 0;
+            poll_obj->notify.flags = 0;
+        }
+        return MP_OBJ_FROM_PTR(t);
+    }
+    #endif
+
     for (mp_uint_t i = self->iter_idx; i < self->poll_map.alloc; ++i) {
         self->iter_idx++;
         if (!MP_MAP_SLOT_IS_FILLED(&self->poll_map, i)) {
             continue;
         }
         poll_obj_t *poll_obj = (poll_obj_t*)self->poll_map.table[i].value;
+        #if MICROPY_PY_USELECT_NOTIFY
+        if (!poll_obj->sweep) {
+            continue;
+        }
+        #endif
         if (poll_obj->flags_ret != 0) {
             mp_obj_tuple_t *t = MP_OBJ_TO_PTR(self->ret_tuple);
             t->items[0] = poll_obj->obj;
@@ -331,12 +627,36 @@ STATIC mp_obj_t poll_iternext(mp_obj_t self_in) {
     return MP_OBJ_STOP_ITERATION;
 }
 
+#if MICROPY_PY_USELECT_NOTIFY
+STATIC mp_obj_t poll_del(mp_obj_t self_in) {
+    mp_obj_poll_t *self = MP_OBJ_TO_PTR(self_in);
+    if (self->ready.sem == NULL) {
+        return mp_const_none;
+    }
+    // The streams must not keep pointers to the entries.  The entries are
+    // found on the root list: the map table is only referenced by this object.
+    for (poll_obj_t *poll_obj = MP_STATE_VM(uselect_notify_entries), *next; poll_obj != NULL; poll_obj = next) {
+        next = poll_obj->notify_next;
+        if (poll_obj->notify.ready == &self->ready) {
+            poll_notify_remove(self, poll_obj);
+        }
+    }
+    mp_hal_poll_sem_delete(self->ready.sem);
+    self->ready.sem = NULL;
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(poll_del_obj, poll_del);
+#endif
+
 STATIC const mp_rom_map_elem_t poll_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_register), MP_ROM_PTR(&poll_register_obj) },
     { MP_ROM_QSTR(MP_QSTR_unregister), MP_ROM_PTR(&poll_unregister_obj) },
     { MP_ROM_QSTR(MP_QSTR_modify), MP_ROM_PTR(&poll_modify_obj) },
     { MP_ROM_QSTR(MP_QSTR_poll), MP_ROM_PTR(&poll_poll_obj) },
     { MP_ROM_QSTR(MP_QSTR_ipoll), MP_ROM_PTR(&poll_ipoll_obj) },
+    #if MICROPY_PY_USELECT_NOTIFY
+    { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&poll_del_obj) },
+    #endif
 };
 STATIC MP_DEFINE_CONST_DICT(poll_locals_dict, poll_locals_dict_table);
 
@@ -350,11 +670,23 @@ STATIC const mp_obj_type_t mp_type_poll = {
 
 /// \function poll()
 STATIC mp_obj_t select_poll(void) {
+    #if MICROPY_PY_USELECT_NOTIFY
+    mp_obj_poll_t *poll = m_new_obj_with_finaliser(mp_obj_poll_t);
+    #else
     mp_obj_poll_t *poll = m_new_obj(mp_obj_poll_t);
+    #endif
     poll->base.type = &mp_type_poll;
     mp_map_init(&poll->poll_map, 0);
     poll->iter_cnt = 0;
     poll->ret_tuple = MP_OBJ_NULL;
+    #if MICROPY_PY_USELECT_NOTIFY
+    poll->n_sweep = 0;
+    poll->ready.head = NULL;
+    poll->ready.tail = NULL;
+    poll->ready.sem = mp_hal_poll_sem_new();
+    poll->ret_head = NULL;
+    poll->iter_ret = NULL;
+    #endif
     return poll;
 }
 MP_DEFINE_CONST_FUN_OBJ_0(mp_select_poll_obj, select_poll);
@@ -0,0 +1,82 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef MICROPY_INCLUDED_EXTMOD_MODUSELECT_H
+#define MICROPY_INCLUDED_EXTMOD_MODUSELECT_H
+
+#include "py/obj.h"
+
+// uselect.poll(), for use by other modules
+MP_DECLARE_CONST_FUN_OBJ_0(mp_select_poll_obj);
+
+#if MICROPY_PY_USELECT_NOTIFY
+
+// Readiness notification used by uselect.poll objects.
+//
+// When a stream is registered with a poll object, its ioctl is called with
+// MP_STREAM_POLL_NOTIFY and a pointer to the mp_poll_notify_t of the entry.
+// A stream which supports it keeps the pointer and calls mp_poll_notify()
+// (from any task) whenever its poll state may have changed for 'flags'.
+// The entry is then queued on the poll object's ready list and the sleeping
+// poll() is woken up; poll() confirms the state with MP_STREAM_POLL.
+// MP_STREAM_POLL_NOTIFY_CLEAR with the same pointer removes the notification;
+// the stream clears it only if it still holds that pointer.
+// Streams not supporting it return an error and are polled as before. A stream
+// keeping a single notification returns MP_EBUSY while it is held by another
+// poll object, which then polls the stream on each pass.
+
+struct _mp_poll_ready_t;
+
+typedef struct _mp_poll_notify_t {
+    struct _mp_poll_notify_t *next;     // next entry on the ready list
+    struct _mp_poll_ready_t *ready;     // ready list to queue on, NULL if not registered
+    volatile mp_uint_t flags;           // requested event flags
+    volatile bool queued;
+} mp_poll_notify_t;
+
+typedef struct _mp_poll_ready_t {
+    mp_poll_notify_t *head;
+    mp_poll_notify_t *tail;
+    void *sem;
+} mp_poll_ready_t;
+
+void mp_poll_notify(mp_poll_notify_t *notify);
+
+// Notify the entry *slot points to, if any.  The slot is read under the poll
+// lock, for streams notifying from another task and setting and clearing the
+// slot under the same lock: the entry can't be removed while it is queued.
+void mp_poll_notify_slot(mp_poll_notify_t **slot);
+
+// Provided by the port
+void *mp_hal_poll_sem_new(void);
+void mp_hal_poll_sem_delete(void *sem);
+void mp_hal_poll_sem_give(void *sem);
+void mp_hal_poll_sem_take(void *sem, mp_uint_t timeout_ms);
+void mp_hal_poll_lock(void);
+void mp_hal_poll_unlock(void);
+
+#endif // MICROPY_PY_USELECT_NOTIFY
+
+#endif // MICROPY_INCLUDED_EXTMOD_MODUSELECT_H
@@ -31,6 +31,7 @@
 #include "py/objlist.h"
 #include "py/runtime.h"
 #include "py/smallint.h"
+#include "extmod/modutimeq.h"
 
 #if MICROPY_PY_UTIMEQ
 
@@ -50,30 +51,75 @@ typedef struct _mp_obj_utimeq_t {
 } mp_obj_utimeq_t;
 
 STATIC mp_uint_t utimeq_id = 0;
-STATIC bool sort_asc = true;
 
 //--------------------------------------------------
 STATIC mp_obj_utimeq_t *get_heap(mp_obj_t heap_in) {
     return MP_OBJ_TO_PTR(heap_in);
 }
 
-//----------------------------------------------------------------
-STATIC int compare_times(const void * item, const void * parent) {
-    int ret = 0;
-    int64_t res = ((struct qentry *)parent)->time - ((struct qentry *)item)->time;
-	ret = (res < 0) ? -1 : 1;
-    if (res == 0) {
-    	ret = (((struct qentry *)parent)->id - ((struct qentry *)item)->id);
+// The items are kept sorted by time, items with the same time in order of insertion
+// (reversed for descending queue). Find the position for the new item by binary search.
+//-------------------------------------------------------------------------
+STATIC mp_uint_t find_pos(mp_obj_utimeq_t *heap, int64_t time) {
+    mp_uint_t lo = 0;
+    mp_uint_t hi = heap->len;
+    while (lo < hi) {
+        mp_uint_t mid = (lo + hi) / 2;
+        bool before = (heap->ascending) ? (time < heap->items[mid].time) : (time >= heap->items[mid].time);
+        if (before) hi = mid;
+        else lo = mid + 1;
     }
-	if (sort_asc) ret *= -1;
+    return lo;
+}
 
-	return ret;
+//-----------------------------------------------------------------------------------------
+void mp_utimeq_push(mp_obj_t heap_in, int64_t time, mp_obj_t callback, mp_obj_t args) {
+    mp_obj_utimeq_t *heap = get_heap(heap_in);
+    if (heap->len == heap->alloc) {
+        mp_raise_msg(&mp_type_IndexError, "queue overflow");
+    }
+    mp_uint_t pos = find_pos(heap, time);
+    memmove(&heap->items[pos + 1], &heap->items[pos], sizeof(struct qentry) * (heap->len - pos));
+    heap->items[pos].time = time;
+    heap->items[pos].id = utimeq_id++;
+    heap->items[pos].callback = callback;
+    heap->items[pos].args = args;
+    heap->len++;
+}
+
+//---------------------------------------------------------
+bool mp_utimeq_peektime(mp_obj_t heap_in, int64_t *time) {
+    mp_obj_utimeq_t *heap = get_heap(heap_in);
+    if (heap->len == 0) {
+        return false;
+    }
+    *time = heap->items[0].time;
+    return true;
 }
 
-//---------------------------------------------
-STATIC void sort_items(mp_obj_utimeq_t *heap) {
-	sort_asc = heap->ascending;
-    qsort(&heap->items, heap->len, sizeof(struct qentry), compare_times);
+//----------------------------------------------------------------------------
+void mp_utimeq_pop(mp_obj_t heap_in, mp_obj_t *callback, mp_obj_t *args) {
+    mp_obj_utimeq_t *heap = get_heap(heap_in);
+    if (heap->len == 0) {
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_IndexError, "empty heap"));
+    }
+    *callback = heap->items[0].callback;
+    *args = heap->items[0].args;
+    heap->len -= 1;
+    memmove(&heap->items[0], &heap->items[1], sizeof(struct qentry) * heap->len);
+    // we don't want to retain a pointers !
+    memset(&heap->items[heap->len], 0, sizeof(struct qentry));
+}
+
+//------------------------------------------------------
+mp_obj_t mp_utimeq_new(mp_uint_t alloc, bool ascending) {
+    mp_obj_utimeq_t *o = m_new_obj_var(mp_obj_utimeq_t, struct qentry, alloc);
+    o->base.type = &mp_type_utimeq;
+    memset(o->items, 0, sizeof(*o->items) * alloc);
+    o->alloc = alloc;
+    o->len = 0;
+    o->ascending = ascending;
+    return MP_OBJ_FROM_PTR(o);
 }
 
 //----------------------------------------------------------------------------------------------------------------
@@ -88,27 +134,14 @@ STATIC mp_obj_t utimeq_make_new(const mp_obj_type_t *type, size_t n_args, size_t
 	mp_arg_parse_all_kw_array(n_args, n_kw, all_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
 
     mp_arg_check_num(n_args, n_kw, 1, 1, true);
+    (void)type;
 
-    mp_uint_t alloc = mp_obj_get_int(args[ARG_size].u_obj);
-    mp_obj_utimeq_t *o = m_new_obj_var(mp_obj_utimeq_t, struct qentry, alloc);
-    o->base.type = type;
-    memset(o->items, 0, sizeof(*o->items) * alloc);
-    o->alloc = alloc;
-    o->len = 0;
-    o->ascending = args[ARG_sort].u_bool;
-
-    return MP_OBJ_FROM_PTR(o);
+    return mp_utimeq_new(mp_obj_get_int(args[ARG_size].u_obj), args[ARG_sort].u_bool);
 }
 
 //------------------------------------------------------------------------
 STATIC mp_obj_t mod_utimeq_heappush(size_t n_args, const mp_obj_t *args) {
     (void)n_args;
-    mp_obj_t heap_in = args[0];
-    mp_obj_utimeq_t *heap = get_heap(heap_in);
-    if (heap->len == heap->alloc) {
-        mp_raise_msg(&mp_type_IndexError, "queue overflow");
-    }
-    mp_uint_t l = heap->len;
     // time argument can be float or integer
     // if float, convert it to 64-bit integer
     int64_t itime;
@@ -118,13 +151,7 @@ STATIC mp_obj_t mod_utimeq_heappush(size_t n_args, const mp_obj_t *args) {
     }
     else itime = mp_obj_get_int64(args[1]);
 
-    heap->items[l].time = itime;
-    heap->items[l].id = utimeq_id++;
-    heap->items[l].callback = args[2];
-    heap->items[l].args = args[3];
-    heap->len++;
-
-    sort_items(heap);
+    mp_utimeq_push(args[0], itime, args[2], args[3]);
 
     return mp_const_none;
 }
@@ -141,19 +168,8 @@ STATIC mp_obj_t mod_utimeq_heappop(mp_obj_t heap_in, mp_obj_t list_ref) {
         mp_raise_TypeError(NULL);
     }
 
-    struct qentry *item = &heap->items[0];
-    ret->items[0] = mp_obj_new_int_from_ll(item->time);
-    ret->items[1] = item->callback;
-    ret->items[2] = item->args;
-
-    heap->len -= 1;
-
-    if (heap->len) {
-    	memmove(&heap->items[0], &heap->items[1], sizeof(struct qentry) * heap->len);
-        //sort_items(heap);
-        // we don't want to retain a pointers !
-        memset(&heap->items[heap->len], 0, sizeof(struct qentry));
-    }
+    ret->items[0] = mp_obj_new_int_from_ll(heap->items[0].time);
+    mp_utimeq_pop(heap_in, &ret->items[1], &ret->items[2]);
 
     return mp_const_none;
 }
@@ -257,7 +273,7 @@ STATIC const mp_rom_map_elem_t utimeq_locals_dict_table[] = {
 STATIC MP_DEFINE_CONST_DICT(utimeq_locals_dict, utimeq_locals_dict_table);
 
 //========================================
-STATIC const mp_obj_type_t utimeq_type = {
+const mp_obj_type_t mp_type_utimeq = {
     { &mp_type_type },
     .name = MP_QSTR_utimeq,
     .make_new = utimeq_make_new,
@@ -268,7 +284,7 @@ STATIC const mp_obj_type_t utimeq_type = {
 //=================================================================
 STATIC const mp_rom_map_elem_t mp_module_utimeq_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_utimeq) },
-    { MP_ROM_QSTR(MP_QSTR_utimeq),   MP_ROM_PTR(&utimeq_type) },
+    { MP_ROM_QSTR(MP_QSTR_utimeq),   MP_ROM_PTR(&mp_type_utimeq) },
 };
 STATIC MP_DEFINE_CONST_DICT(mp_module_utimeq_globals, mp_module_utimeq_globals_table);
 
@@ -0,0 +1,39 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef MICROPY_INCLUDED_EXTMOD_MODUTIMEQ_H
+#define MICROPY_INCLUDED_EXTMOD_MODUTIMEQ_H
+
+#include "py/obj.h"
+
+// C interface to utimeq objects, used by other modules
+extern const mp_obj_type_t mp_type_utimeq;
+
+mp_obj_t mp_utimeq_new(mp_uint_t alloc, bool ascending);
+void mp_utimeq_push(mp_obj_t heap_in, int64_t time, mp_obj_t callback, mp_obj_t args);
+bool mp_utimeq_peektime(mp_obj_t heap_in, int64_t *time);
+void mp_utimeq_pop(mp_obj_t heap_in, mp_obj_t *callback, mp_obj_t *args);
+
+#endif // MICROPY_INCLUDED_EXTMOD_MODUTIMEQ_H
@@ -199,10 +199,206 @@ error:
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_uzlib_decompress_obj, 1, 3, mod_uzlib_decompress);
 
+typedef struct _mp_obj_compio_t {
+    mp_obj_base_t base;
+    mp_obj_t stream;
+    vstr_t out;
+    size_t out_pos;
+    byte mode;
+    bool src_eof;
+    UZLIB_DEFL comp;
+} mp_obj_compio_t;
+
+#define COMPIO_MODE_NONE  (0)
+#define COMPIO_MODE_READ  (1)
+#define COMPIO_MODE_WRITE (2)
+#define COMPIO_MODE_CLOSED (3)
+
+// Compressed output either goes straight to the wrapped stream (write mode),
+// or is queued in the out buffer to be picked up by read() or compress().
+STATIC void compio_write_dest(UZLIB_DEFL *data, const unsigned char *buf, unsigned int len) {
+    byte *p = (void*)data;
+    p -= offsetof(mp_obj_compio_t, comp);
+    mp_obj_compio_t *self = (mp_obj_compio_t*)p;
+
+    if (self->mode == COMPIO_MODE_WRITE) {
+        int err;
+        mp_get_stream_raise(self->stream, MP_STREAM_OP_WRITE);
+        mp_stream_write_exactly(self->stream, buf, len, &err);
+        if (err) {
+            mp_raise_OSError(err);
+        }
+    } else {
+        vstr_add_strn(&self->out, (const char*)buf, len);
+    }
+}
+
+// wbits follows decompress(): 9..15 for zlib, -9..-15 for raw deflate,
+// 25..31 for gzip; level is 0..9, or -1 for the default.
+STATIC void compio_init(mp_obj_compio_t *o, mp_int_t level, mp_int_t wbits) {
+    int chksum = TINF_CHKSUM_ADLER;
+    if (wbits < 0) {
+        wbits = -wbits;
+        chksum = TINF_CHKSUM_NONE;
+    } else if (wbits >= 16) {
+        wbits -= 16;
+        chksum = TINF_CHKSUM_CRC;
+    }
+    if (wbits < 9 || wbits > 15) {
+        mp_raise_ValueError("invalid wbits");
+    }
+    if (level < 0) {
+        level = MICROPY_PY_UZLIB_DEFAULT_LEVEL;
+    } else if (level > 9) {
+        mp_raise_ValueError("invalid level");
+    }
+
+    vstr_init(&o->out, 0);
+    o->out_pos = 0;
+    o->src_eof = false;
+    o->comp.writeDest = compio_write_dest;
+    uzlib_deflate_init(&o->comp, m_new(byte, uzlib_deflate_memsize(wbits)), wbits, level, chksum);
+}
+
+STATIC const mp_arg_t compio_allowed_args[] = {
+    { MP_QSTR_level, MP_ARG_INT, {.u_int = -1} },
+    { MP_QSTR_wbits, MP_ARG_INT, {.u_int = MICROPY_PY_UZLIB_DEFAULT_WBITS} },
+};
+
+STATIC mp_obj_t compio_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    mp_arg_check_num(n_args, n_kw, 1, 3, true);
+    mp_arg_val_t vals[MP_ARRAY_SIZE(compio_allowed_args)];
+    mp_map_t kw_args;
+    mp_map_init_fixed_table(&kw_args, n_kw, args + n_args);
+    mp_arg_parse_all(n_args - 1, args + 1, &kw_args, MP_ARRAY_SIZE(compio_allowed_args), compio_allowed_args, vals);
+
+    mp_obj_compio_t *o = m_new_obj(mp_obj_compio_t);
+    o->base.type = type;
+    o->stream = args[0];
+    o->mode = COMPIO_MODE_NONE;
+    compio_init(o, vals[0].u_int, vals[1].u_int);
+    return MP_OBJ_FROM_PTR(o);
+}
+
+// Reading pulls uncompressed data from the wrapped stream and returns it
+// compressed; the stream is finished when the source reaches EOF.
+STATIC mp_uint_t compio_read(mp_obj_t o_in, void *buf, mp_uint_t size, int *errcode) {
+    mp_obj_compio_t *o = MP_OBJ_TO_PTR(o_in);
+    if (o->mode == COMPIO_MODE_WRITE) {
+        *errcode = MP_EPERM;
+        return MP_STREAM_ERROR;
+    }
+    if (o->mode == COMPIO_MODE_CLOSED) {
+        return 0;
+    }
+    o->mode = COMPIO_MODE_READ;
+    mp_get_stream_raise(o->stream, MP_STREAM_OP_READ);
+
+    while (o->out_pos == o->out.len && !o->src_eof) {
+        byte chunk[256];
+        o->out.len = o->out_pos = 0;
+        mp_uint_t n = mp_stream_rw(o->stream, chunk, sizeof(chunk), errcode, MP_STREAM_RW_READ | MP_STREAM_RW_ONCE);
+        if (*errcode != 0) {
+            return MP_STREAM_ERROR;
+        }
+        if (n == 0) {
+            o->src_eof = true;
+            uzlib_deflate(&o->comp, NULL, 0, UZLIB_FINISH);
+        } else {
+            uzlib_deflate(&o->comp, chunk, n, UZLIB_NO_FLUSH);
+        }
+    }
+
+    mp_uint_t avail = o->out.len - o->out_pos;
+    if (size > avail) {
+        size = avail;
+    }
+    memcpy(buf, o->out.buf + o->out_pos, size);
+    o->out_pos += size;
+    return size;
+}
+
+// Writing compresses data into the wrapped stream.
+STATIC mp_uint_t compio_write(mp_obj_t o_in, const void *buf, mp_uint_t size, int *errcode) {
+    mp_obj_compio_t *o = MP_OBJ_TO_PTR(o_in);
+    if (o->mode == COMPIO_MODE_READ || o->mode == COMPIO_MODE_CLOSED) {
+        *errcode = MP_EPERM;
+        return MP_STREAM_ERROR;
+    }
+    o->mode = COMPIO_MODE_WRITE;
+    uzlib_deflate(&o->comp, buf, size, UZLIB_NO_FLUSH);
+    return size;
+}
+
+STATIC mp_uint_t compio_ioctl(mp_obj_t o_in, mp_uint_t request, uintptr_t arg, int *errcode) {
+    mp_obj_compio_t *o = MP_OBJ_TO_PTR(o_in);
+    (void)arg;
+    if (request == MP_STREAM_FLUSH || request == MP_STREAM_CLOSE) {
+        // Flush ends with a byte-aligned empty block so the receiver can
+        // decode everything written so far; close writes the final block
+        // and checksum. The wrapped stream itself is left open.
+        if (o->mode == COMPIO_MODE_WRITE) {
+            uzlib_deflate(&o->comp, NULL, 0, request == MP_STREAM_FLUSH ? UZLIB_SYNC_FLUSH : UZLIB_FINISH);
+        }
+        if (request == MP_STREAM_CLOSE) {
+            o->mode = COMPIO_MODE_CLOSED;
+        }
+        return 0;
+    }
+    *errcode = MP_EINVAL;
+    return MP_STREAM_ERROR;
+}
+
+STATIC const mp_rom_map_elem_t compio_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_read), MP_ROM_PTR(&mp_stream_read_obj) },
+    { MP_ROM_QSTR(MP_QSTR_readinto), MP_ROM_PTR(&mp_stream_readinto_obj) },
+    { MP_ROM_QSTR(MP_QSTR_write), MP_ROM_PTR(&mp_stream_write_obj) },
+    { MP_ROM_QSTR(MP_QSTR_flush), MP_ROM_PTR(&mp_stream_flush_obj) },
+    { MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&mp_stream_close_obj) },
+};
+
+STATIC MP_DEFINE_CONST_DICT(compio_locals_dict, compio_locals_dict_table);
+
+STATIC const mp_stream_p_t compio_stream_p = {
+    .read = compio_read,
+    .write = compio_write,
+    .ioctl = compio_ioctl,
+};
+
+STATIC const mp_obj_type_t compio_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_CompIO,
+    .make_new = compio_make_new,
+    .protocol = &compio_stream_p,
+    .locals_dict = (void*)&compio_locals_dict,
+};
+
+STATIC mp_obj_t mod_uzlib_compress(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    mp_arg_val_t vals[MP_ARRAY_SIZE(compio_allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(compio_allowed_args), compio_allowed_args, vals);
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(pos_args[0], &bufinfo, MP_BUFFER_READ);
+
+    mp_obj_compio_t *o = m_new_obj(mp_obj_compio_t);
+    o->mode = COMPIO_MODE_NONE;
+    compio_init(o, vals[0].u_int, vals[1].u_int);
+    DEBUG_printf("sizeof(UZLIB_DEFL)=" UINT_FMT "\n", sizeof(o->comp));
+    uzlib_deflate(&o->comp, bufinfo.buf, bufinfo.len, UZLIB_FINISH);
+
+    // the encoder's buffers were allocated as one block starting at prev
+    m_del(byte, o->comp.prev, uzlib_deflate_memsize(o->comp.wbits));
+    mp_obj_t res = mp_obj_new_str_from_vstr(&mp_type_bytes, &o->out);
+    m_del_obj(mp_obj_compio_t, o);
+    return res;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mod_uzlib_compress_obj, 1, mod_uzlib_compress);
+
 STATIC const mp_rom_map_elem_t mp_module_uzlib_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_uzlib) },
     { MP_ROM_QSTR(MP_QSTR_decompress), MP_ROM_PTR(&mod_uzlib_decompress_obj) },
     { MP_ROM_QSTR(MP_QSTR_DecompIO), MP_ROM_PTR(&decompio_type) },
+    { MP_ROM_QSTR(MP_QSTR_compress), MP_ROM_PTR(&mod_uzlib_compress_obj) },
+    { MP_ROM_QSTR(MP_QSTR_CompIO), MP_ROM_PTR(&compio_type) },
 };
 
 STATIC MP_DEFINE_CONST_DICT(mp_module_uzlib_globals, mp_module_uzlib_globals_table);
@@ -220,5 +416,6 @@ const mp_obj_module_t mp_module_uzlib = {
 #include "uzlib/tinfgzip.c"
 #include "uzlib/adler32.c"
 #include "uzlib/crc32.c"
+#include "uzlib/defl.c"
 
 #endif // MICROPY_PY_UZLIB
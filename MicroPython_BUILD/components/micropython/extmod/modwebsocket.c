@@ -30,6 +30,7 @@
 
 #include "py/runtime.h"
 #include "py/stream.h"
+#include "py/mperrno.h"
 #include "extmod/modwebsocket.h"
 
 #if MICROPY_PY_WEBSOCKET
@@ -38,16 +39,23 @@ enum { FRAME_HEADER, FRAME_OPT, PAYLOAD, CONTROL };
 
 enum { BLOCKING_WRITE = 0x80 };
 
+// Frames up to this size (with header) are sent with a single write
+#define WEBSOCKET_WRITE_GATHER_MAX (1460)
+// Frames up to this size are gathered on stack, larger in a temporary heap buffer
+#define WEBSOCKET_WRITE_GATHER_STACK (128)
+
 typedef struct _mp_obj_websocket_t {
     mp_obj_base_t base;
     mp_obj_t sock;
-    uint32_t msg_sz;
+    uint64_t msg_sz;
     byte mask[4];
     byte state;
     byte to_recv;
     byte mask_pos;
     byte buf_pos;
-    byte buf[6];
+    byte buf[12];       // 8 bytes extended payload length + 4 bytes mask
+    byte len_sz;        // size of extended payload length of current frame
+    bool masked;
     byte opts;
     // Copy of last data frame flags
     byte ws_flags;
@@ -55,7 +63,7 @@ typedef struct _mp_obj_websocket_t {
     byte last_flags;
 } mp_obj_websocket_t;
 
-STATIC mp_uint_t websocket_write(mp_obj_t self_in, const void *buf, mp_uint_t size, int *errcode);
+STATIC mp_uint_t websocket_write_all(mp_obj_websocket_t *self, const byte *hdr, mp_uint_t hdr_sz, const byte *buf, mp_uint_t size, int *errcode);
 
 STATIC mp_obj_t websocket_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
     mp_arg_check_num(n_args, n_kw, 1, 2, false);
@@ -73,6 +81,33 @@ STATIC mp_obj_t websocket_make_new(const mp_obj_type_t *type, size_t n_args, siz
     return  MP_OBJ_FROM_PTR(o);
 }
 
+// XOR the payload with the mask, a word at a time
+STATIC void websocket_unmask(mp_obj_websocket_t *self, byte *buf, size_t len) {
+    byte pos = self->mask_pos;
+    while (len > 0 && ((uintptr_t)buf & 3) != 0) {
+        *buf++ ^= self->mask[pos++ & 3];
+        len--;
+    }
+    if (len >= 4) {
+        // mask rotated to the current position, in memory order
+        byte mb[4];
+        for (int i = 0; i < 4; i++) {
+            mb[i] = self->mask[(pos + i) & 3];
+        }
+        uint32_t m;
+        memcpy(&m, mb, 4);
+        uint32_t *p = (uint32_t*)buf;
+        for (; len >= 4; len -= 4) {
+            *p++ ^= m;
+        }
+        buf = (byte*)p;
+    }
+    while (len-- > 0) {
+        *buf++ ^= self->mask[pos++ & 3];
+    }
+    self->mask_pos = pos;
+}
+
 STATIC mp_uint_t websocket_read(mp_obj_t self_in, void *buf, mp_uint_t size, int *errcode) {
     mp_obj_websocket_t *self =  MP_OBJ_TO_PTR(self_in);
     const mp_stream_p_t *stream_p = mp_get_stream_raise(self->sock, MP_STREAM_OP_READ);
@@ -113,16 +148,18 @@ STATIC mp_uint_t websocket_read(mp_obj_t self_in, void *buf, mp_uint_t size, int
                 // without masks.
                 memset(self->mask, 0, sizeof(self->mask));
 
-                int to_recv = 0;
                 size_t sz = self->buf[1] & 0x7f;
+                self->len_sz = 0;
                 if (sz == 126) {
                     // Msg size is next 2 bytes
-                    to_recv += 2;
+                    self->len_sz = 2;
                 } else if (sz == 127) {
                     // Msg size is next 8 bytes
-                    assert(0);
+                    self->len_sz = 8;
                 }
-                if (self->buf[1] & 0x80) {
+                int to_recv = self->len_sz;
+                self->masked = (self->buf[1] & 0x80) != 0;
+                if (self->masked) {
                     // Next 4 bytes is mask
                     to_recv += 4;
                 }
@@ -143,13 +180,16 @@ STATIC mp_uint_t websocket_read(mp_obj_t self_in, void *buf, mp_uint_t size, int
             }
 
             case FRAME_OPT: {
-                if ((self->buf_pos & 3) == 2) {
-                    // First two bytes are message length
-                    self->msg_sz = (self->buf[0] << 8) | self->buf[1];
+                if (self->len_sz != 0) {
+                    // First 2 or 8 bytes are message length, big endian
+                    self->msg_sz = 0;
+                    for (int i = 0; i < self->len_sz; i++) {
+                        self->msg_sz = (self->msg_sz << 8) | self->buf[i];
+                    }
                 }
-                if (self->buf_pos >= 4) {
+                if (self->masked) {
                     // Last 4 bytes is mask
-                    memcpy(self->mask, self->buf + self->buf_pos - 4, 4);
+                    memcpy(self->mask, self->buf + self->len_sz, 4);
                 }
                 self->buf_pos = 0;
                 if ((self->last_flags & FRAME_OPCODE_MASK) >= FRAME_CLOSE) {
@@ -168,15 +208,15 @@ STATIC mp_uint_t websocket_read(mp_obj_t self_in, void *buf, mp_uint_t size, int
                     goto no_payload;
                 }
 
-                size_t sz = MIN(size, self->msg_sz);
+                // the payload is read directly to the caller's buffer
+                mp_uint_t sz = (self->msg_sz < size) ? (mp_uint_t)self->msg_sz : size;
                 out_sz = stream_p->read(self->sock, buf, sz, errcode);
                 if (out_sz == 0 || out_sz == MP_STREAM_ERROR) {
                     return out_sz;
                 }
 
-                sz = out_sz;
-                for (byte *p = buf; sz--; p++) {
-                    *p ^= self->mask[self->mask_pos++ & 3];
+                if (self->masked) {
+                    websocket_unmask(self, buf, out_sz);
                 }
 
                 self->msg_sz -= out_sz;
@@ -193,9 +233,9 @@ no_payload:
                     if (last_state == CONTROL) {
                         byte frame_type = self->last_flags & FRAME_OPCODE_MASK;
                         if (frame_type == FRAME_CLOSE) {
-                            static char close_resp[2] = {0x88, 0};
+                            static const byte close_resp[2] = {0x88, 0};
                             int err;
-                            websocket_write(self_in, close_resp, sizeof(close_resp), &err);
+                            websocket_write_all(self, close_resp, sizeof(close_resp), NULL, 0, &err);
                             return 0;
                         }
 
@@ -215,42 +255,89 @@ no_payload:
     }
 }
 
+// Write the frame header and the payload to the socket, as one unit
+// If BLOCKING_WRITE is set, or a part of the frame was already written, wait
+// for the socket to become writable instead of returning EAGAIN, so a frame
+// is never left half-written
+STATIC mp_uint_t websocket_write_all(mp_obj_websocket_t *self, const byte *hdr, mp_uint_t hdr_sz, const byte *buf, mp_uint_t size, int *errcode) {
+    const mp_stream_p_t *stream_p = mp_get_stream_raise(self->sock, MP_STREAM_OP_WRITE);
+    mp_uint_t total = hdr_sz + size;
+    mp_uint_t done = 0;
+    *errcode = 0;
+    while (done < total) {
+        mp_uint_t out_sz;
+        if (done < hdr_sz) {
+            out_sz = stream_p->write(self->sock, hdr + done, hdr_sz - done, errcode);
+        } else {
+            out_sz = stream_p->write(self->sock, buf + (done - hdr_sz), total - done, errcode);
+        }
+        if (out_sz == MP_STREAM_ERROR) {
+            if (!mp_is_nonblocking_error(*errcode) || ((done == 0) && !(self->opts & BLOCKING_WRITE))) {
+                return MP_STREAM_ERROR;
+            }
+            *errcode = 0;
+            #ifdef MICROPY_EVENT_POLL_HOOK
+            MICROPY_EVENT_POLL_HOOK
+            #else
+            mp_handle_pending();
+            #endif
+            continue;
+        }
+        if (out_sz == 0) {
+            *errcode = MP_EIO;
+            return MP_STREAM_ERROR;
+        }
+        done += out_sz;
+    }
+    return done;
+}
+
 STATIC mp_uint_t websocket_write(mp_obj_t self_in, const void *buf, mp_uint_t size, int *errcode) {
     mp_obj_websocket_t *self =  MP_OBJ_TO_PTR(self_in);
-    assert(size < 0x10000);
-    byte header[4] = {0x80 | (self->opts & FRAME_OPCODE_MASK)};
+    byte header[10] = {0x80 | (self->opts & FRAME_OPCODE_MASK)};
     int hdr_sz;
     if (size < 126) {
         header[1] = size;
         hdr_sz = 2;
-    } else {
+    } else if (size < 0x10000) {
         header[1] = 126;
         header[2] = size >> 8;
         header[3] = size & 0xff;
         hdr_sz = 4;
+    } else {
+        header[1] = 127;
+        uint64_t sz = size;
+        for (int i = 9; i >= 2; i--) {
+            header[i] = sz & 0xff;
+            sz >>= 8;
+        }
+        hdr_sz = 10;
     }
 
-    mp_obj_t dest[3];
-    if (self->opts & BLOCKING_WRITE) {
-        mp_load_method(self->sock, MP_QSTR_setblocking, dest);
-        dest[2] = mp_const_true;
-        mp_call_method_n_kw(1, 0, dest);
-    }
-
-    mp_uint_t out_sz = mp_stream_write_exactly(self->sock, header, hdr_sz, errcode);
-    if (*errcode == 0) {
-        out_sz = mp_stream_write_exactly(self->sock, buf, size, errcode);
-    }
-
-    if (self->opts & BLOCKING_WRITE) {
-        dest[2] = mp_const_false;
-        mp_call_method_n_kw(1, 0, dest);
+    // Send small frames with a single write, so that the header is not sent
+    // in a separate TCP segment (which also delays the payload with Nagle's algorithm)
+    mp_uint_t frame_sz = hdr_sz + size;
+    if (frame_sz <= WEBSOCKET_WRITE_GATHER_MAX) {
+        byte stack_buf[WEBSOCKET_WRITE_GATHER_STACK];
+        byte *frame = stack_buf;
+        if (frame_sz > sizeof(stack_buf)) {
+            frame = m_new_maybe(byte, frame_sz);
+        }
+        if (frame != NULL) {
+            memcpy(frame, header, hdr_sz);
+            memcpy(frame + hdr_sz, buf, size);
+            mp_uint_t out_sz = websocket_write_all(self, frame, frame_sz, NULL, 0, errcode);
+            if (frame != stack_buf) {
+                m_del(byte, frame, frame_sz);
+            }
+            return (out_sz == MP_STREAM_ERROR) ? MP_STREAM_ERROR : size;
+        }
     }
 
-    if (*errcode != 0) {
+    if (websocket_write_all(self, header, hdr_sz, buf, size, errcode) == MP_STREAM_ERROR) {
         return MP_STREAM_ERROR;
     }
-    return out_sz;
+    return size;
 }
 
 STATIC mp_uint_t websocket_ioctl(mp_obj_t self_in, mp_uint_t request, uintptr_t arg, int *errcode) {
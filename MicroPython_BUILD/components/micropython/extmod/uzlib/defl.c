@@ -0,0 +1,743 @@
+/*
+ * defl  -  tiny streaming deflate compressor
+ *
+ * Copyright (c) 2003 by Joergen Ibsen / Jibz
+ * All Rights Reserved
+ *
+ * http://www.ibsensoftware.com/
+ *
+ * Copyright (c) 2014-2016 by Paul Sokolovsky
+ *
+ * This software is provided 'as-is', without any express
+ * or implied warranty.  In no event will the authors be
+ * held liable for any damages arising from the use of
+ * this software.
+ *
+ * Permission is granted to anyone to use this software
+ * for any purpose, including commercial applications,
+ * and to alter it and redistribute it freely, subject to
+ * the following restrictions:
+ *
+ * 1. The origin of this software must not be
+ *    misrepresented; you must not claim that you
+ *    wrote the original software. If you use this
+ *    software in a product, an acknowledgment in
+ *    the product documentation would be appreciated
+ *    but is not required.
+ *
+ * 2. Altered source versions must be plainly marked
+ *    as such, and must not be misrepresented as
+ *    being the original software.
+ *
+ * 3. This notice may not be removed or altered from
+ *    any source distribution.
+ */
+
+/*
+ * The matcher follows the lazy evaluation scheme of zlib's deflate_slow(),
+ * with the window kept as a 2 * wsize buffer that slides down by wsize when
+ * full. Blocks are written stored, with fixed codes or with dynamic codes,
+ * whichever is shortest.
+ */
+
+#include <string.h>
+#include "tinf.h"
+
+/* base and extra bits tables shared with tinflate.c */
+#ifdef RUNTIME_BITS_TABLES
+extern unsigned char length_bits[30];
+extern unsigned short length_base[30];
+extern unsigned char dist_bits[30];
+extern unsigned short dist_base[30];
+#else
+extern const unsigned char length_bits[30];
+extern const unsigned short length_base[30];
+extern const unsigned char dist_bits[30];
+extern const unsigned short dist_base[30];
+#endif
+extern const unsigned char clcidx[19];
+
+#define NIL 0
+#define MAX_DIST(d) ((d)->wsize - UZLIB_MIN_LOOKAHEAD)
+/* a match of length 3 further away than this costs more than 3 literals */
+#define TOO_FAR 4096
+
+#define STATE_HEADER 0
+#define STATE_BODY   1
+#define STATE_DONE   2
+
+/* good_match, max_lazy, nice_match, max_chain per level (from zlib) */
+static const unsigned short defl_config[10][4] = {
+   {  0,   0,   0,    0 },
+   {  4,   4,   8,    4 },
+   {  4,   5,  16,    8 },
+   {  4,   6,  32,   32 },
+   {  4,   4,  16,   16 },
+   {  8,  16,  32,   32 },
+   {  8,  16, 128,  128 },
+   {  8,  32, 128,  256 },
+   { 32, 128, 258, 1024 },
+   { 32, 258, 258, 4096 }
+};
+
+/* ----------------------- *
+ * -- utility functions -- *
+ * ----------------------- */
+
+static unsigned int defl_hash_bits(int wbits)
+{
+   return wbits - 1;
+}
+
+static unsigned int defl_sym_max(int wbits)
+{
+   return 1 << (wbits > 14 ? 14 : wbits);
+}
+
+/* length symbol (0..28, add 257) for a match length of 3..258 */
+static unsigned int defl_len_sym(unsigned int len)
+{
+   unsigned int l = len - 3, nb;
+
+   if (l < 8) return l;
+   if (len == UZLIB_MAX_MATCH) return 28;
+   nb = 31 - __builtin_clz(l);
+   return 4 * (nb - 1) + ((l >> (nb - 2)) & 3);
+}
+
+/* distance symbol (0..29) for a distance of 1..32768 */
+static unsigned int defl_dist_sym(unsigned int dist)
+{
+   unsigned int d = dist - 1, nb;
+
+   if (d < 4) return d;
+   nb = 31 - __builtin_clz(d);
+   return 2 * nb + ((d >> (nb - 1)) & 1);
+}
+
+static unsigned int defl_fixed_len(unsigned int sym)
+{
+   if (sym < 144) return 8;
+   if (sym < 256) return 9;
+   if (sym < 280) return 7;
+   return 8;
+}
+
+/* ------------------- *
+ * -- output stream -- *
+ * ------------------- */
+
+static void defl_put_byte(UZLIB_DEFL *d, unsigned char c)
+{
+   d->outbuf[d->outlen++] = c;
+   if (d->outlen == sizeof(d->outbuf))
+   {
+      d->outlen = 0;
+      d->writeDest(d, d->outbuf, sizeof(d->outbuf));
+   }
+}
+
+/* write num (at most 16) bits, least significant first */
+static void defl_put_bits(UZLIB_DEFL *d, unsigned int bits, unsigned int num)
+{
+   d->bitbuf |= (uint32_t)bits << d->bitcount;
+   d->bitcount += num;
+   while (d->bitcount >= 8)
+   {
+      defl_put_byte(d, d->bitbuf);
+      d->bitbuf >>= 8;
+      d->bitcount -= 8;
+   }
+}
+
+static void defl_align(UZLIB_DEFL *d)
+{
+   if (d->bitcount) defl_put_byte(d, d->bitbuf);
+   d->bitbuf = 0;
+   d->bitcount = 0;
+}
+
+static void defl_put_uint32(UZLIB_DEFL *d, uint32_t val, int big_endian)
+{
+   int i;
+
+   for (i = 0; i < 4; ++i)
+   {
+      defl_put_byte(d, big_endian ? val >> (24 - 8 * i) : val >> (8 * i));
+   }
+}
+
+static void defl_drain(UZLIB_DEFL *d)
+{
+   if (d->outlen)
+   {
+      unsigned int len = d->outlen;
+      d->outlen = 0;
+      d->writeDest(d, d->outbuf, len);
+   }
+}
+
+/* ------------------------ *
+ * -- Huffman code build -- *
+ * ------------------------ */
+
+/* compute code lengths of at most maxbits for the given frequencies; at
+   least two codes are always assigned, so that decoders never see an
+   incomplete code */
+static void defl_build_lengths(UZLIB_DEFL *d, const unsigned short *freq, unsigned int num,
+                               unsigned int maxbits, unsigned char *lengths)
+{
+   uint32_t *w = d->tweight;
+   unsigned short *parent = d->tparent;
+   unsigned short *sym = d->tsym;
+   unsigned int shift, n, i, j;
+
+   for (shift = 0; ; ++shift)
+   {
+      unsigned int leaf, node, next, max;
+
+      /* sort used symbols by (scaled) frequency */
+      for (n = 0, i = 0; i < num; ++i)
+      {
+         uint32_t f;
+
+         lengths[i] = 0;
+         if (!freq[i]) continue;
+         f = (freq[i] >> shift) | 1;
+         for (j = n; j > 0 && w[j - 1] > f; --j)
+         {
+            w[j] = w[j - 1];
+            sym[j] = sym[j - 1];
+         }
+         w[j] = f;
+         sym[j] = i;
+         ++n;
+      }
+
+      if (n < 2)
+      {
+         unsigned int s = n ? sym[0] : 0;
+
+         lengths[s] = 1;
+         lengths[s ? 0 : 1] = 1;
+         return;
+      }
+
+      /* two-queue Huffman: leaves 0..n-1, internal nodes n..2n-2 are
+         created in order of non-decreasing weight */
+      for (leaf = 0, node = n, next = n; next < 2 * n - 1; ++next)
+      {
+         uint32_t sum = 0;
+
+         for (j = 0; j < 2; ++j)
+         {
+            if (leaf < n && (node == next || w[leaf] <= w[node]))
+            {
+               sum += w[leaf];
+               parent[leaf++] = next;
+            } else {
+               sum += w[node];
+               parent[node++] = next;
+            }
+         }
+         w[next] = sum;
+      }
+
+      /* depths, from the root down; weights are no longer needed */
+      w[2 * n - 2] = 0;
+      for (i = 2 * n - 2; i-- > 0;) w[i] = w[parent[i]] + 1;
+
+      for (max = 0, i = 0; i < n; ++i)
+      {
+         lengths[sym[i]] = w[i];
+         if (w[i] > max) max = w[i];
+      }
+      if (max <= maxbits) return;
+
+      /* flatten the distribution and try again */
+   }
+}
+
+/* assign canonical codes, bit-reversed for LSB-first output */
+static void defl_build_codes(const unsigned char *lengths, unsigned short *codes, unsigned int num)
+{
+   unsigned short count[16], next[16];
+   unsigned int i, code;
+
+   for (i = 0; i < 16; ++i) count[i] = 0;
+   for (i = 0; i < num; ++i) count[lengths[i]]++;
+   count[0] = 0;
+
+   for (code = 0, i = 1; i < 16; ++i)
+   {
+      code = (code + count[i - 1]) << 1;
+      next[i] = code;
+   }
+
+   for (i = 0; i < num; ++i)
+   {
+      unsigned int len = lengths[i], c, rev, k;
+
+      if (!len) continue;
+      c = next[len]++;
+      for (rev = 0, k = 0; k < len; ++k)
+      {
+         rev = (rev << 1) | (c & 1);
+         c >>= 1;
+      }
+      codes[i] = rev;
+   }
+}
+
+/* run-length encode code lengths with symbols 16/17/18; counts into
+   cfreq and returns the number of extra bits when not emitting */
+static unsigned int defl_send_lengths(UZLIB_DEFL *d, const unsigned char *lengths, unsigned int num, int emit)
+{
+   unsigned int i = 0, extra = 0;
+
+   while (i < num)
+   {
+      unsigned int cur = lengths[i], run = 1, sym, xbits, xval;
+
+      while (i + run < num && lengths[i + run] == cur && run < 138) ++run;
+
+      if (cur == 0 && run >= 3)
+      {
+         if (run >= 11)
+         {
+            sym = 18; xbits = 7; xval = run - 11;
+         } else {
+            sym = 17; xbits = 3; xval = run - 3;
+         }
+         i += run;
+      } else if (cur != 0 && run >= 4) {
+         /* the value itself, then repeats of it */
+         if (emit) defl_put_bits(d, d->ccode[cur], d->clen[cur]);
+         else d->cfreq[cur]++;
+         if (run > 7) run = 7;
+         sym = 16; xbits = 2; xval = run - 4;
+         i += run;
+      } else {
+         sym = cur; xbits = 0; xval = 0;
+         i += 1;
+      }
+
+      if (emit)
+      {
+         defl_put_bits(d, d->ccode[sym], d->clen[sym]);
+         if (xbits) defl_put_bits(d, xval, xbits);
+      } else {
+         d->cfreq[sym]++;
+         extra += xbits;
+      }
+   }
+
+   return extra;
+}
+
+/* ------------------------ *
+ * -- block output -------- *
+ * ------------------------ */
+
+static void defl_send_symbols(UZLIB_DEFL *d)
+{
+   unsigned int i;
+
+   for (i = 0; i < d->sym_num; ++i)
+   {
+      unsigned int lc = d->sym_lc[i], dist = d->sym_dist[i];
+
+      if (!dist)
+      {
+         defl_put_bits(d, d->lcode[lc], d->llen[lc]);
+      } else {
+         unsigned int ls = defl_len_sym(lc + 3), ds = defl_dist_sym(dist);
+
+         defl_put_bits(d, d->lcode[257 + ls], d->llen[257 + ls]);
+         if (length_bits[ls]) defl_put_bits(d, lc + 3 - length_base[ls], length_bits[ls]);
+         defl_put_bits(d, d->dcode[ds], d->dlen[ds]);
+         if (dist_bits[ds]) defl_put_bits(d, dist - dist_base[ds], dist_bits[ds]);
+      }
+   }
+   defl_put_bits(d, d->lcode[256], d->llen[256]);
+}
+
+/* write out the collected symbols as one block */
+static void defl_flush_block(UZLIB_DEFL *d, int last)
+{
+   unsigned char lens[286 + 30];
+   unsigned int i, hlit, hdist, hclen, extra = 0;
+   uint32_t dyn_bits, fix_bits, stored_bits = 0xffffffff;
+   int stored_len = (int)(d->strstart - d->match_available) - d->block_start;
+
+   for (i = 0; i < 286; ++i) d->lfreq[i] = 0;
+   for (i = 0; i < 30; ++i) d->dfreq[i] = 0;
+   for (i = 0; i < 19; ++i) d->cfreq[i] = 0;
+
+   for (i = 0; i < d->sym_num; ++i)
+   {
+      unsigned int lc = d->sym_lc[i], dist = d->sym_dist[i];
+
+      if (!dist)
+      {
+         d->lfreq[lc]++;
+      } else {
+         unsigned int ls = defl_len_sym(lc + 3), ds = defl_dist_sym(dist);
+
+         d->lfreq[257 + ls]++;
+         d->dfreq[ds]++;
+         extra += length_bits[ls] + dist_bits[ds];
+      }
+   }
+   d->lfreq[256] = 1;
+
+   /* dynamic trees */
+   defl_build_lengths(d, d->lfreq, 286, 15, d->llen);
+   defl_build_lengths(d, d->dfreq, 30, 15, d->dlen);
+   for (hlit = 286; hlit > 257 && !d->llen[hlit - 1]; --hlit);
+   for (hdist = 30; hdist > 1 && !d->dlen[hdist - 1]; --hdist);
+   memcpy(lens, d->llen, hlit);
+   memcpy(lens + hlit, d->dlen, hdist);
+
+   dyn_bits = 3 + 5 + 5 + 4 + extra + defl_send_lengths(d, lens, hlit + hdist, 0);
+   defl_build_lengths(d, d->cfreq, 19, 7, d->clen);
+   for (hclen = 19; hclen > 4 && !d->clen[clcidx[hclen - 1]]; --hclen);
+   dyn_bits += 3 * hclen;
+   for (i = 0; i < 19; ++i) dyn_bits += d->cfreq[i] * d->clen[i];
+
+   fix_bits = 3 + extra;
+   for (i = 0; i < 286; ++i)
+   {
+      dyn_bits += d->lfreq[i] * d->llen[i];
+      fix_bits += d->lfreq[i] * defl_fixed_len(i);
+   }
+   for (i = 0; i < 30; ++i)
+   {
+      dyn_bits += d->dfreq[i] * d->dlen[i];
+      fix_bits += d->dfreq[i] * 5;
+   }
+
+   /* stored is only possible while the block's data is still in the window */
+   if (d->block_start >= 0 && stored_len > 0)
+   {
+      stored_bits = (stored_len + 5 * ((stored_len + 65534) / 65535)) * 8;
+   }
+
+   if (stored_bits <= fix_bits && stored_bits <= dyn_bits)
+   {
+      const unsigned char *p = d->window + d->block_start;
+
+      while (stored_len > 0)
+      {
+         unsigned int len = stored_len > 65535 ? 65535 : stored_len;
+
+         stored_len -= len;
+         defl_put_bits(d, last && !stored_len, 1);
+         defl_put_bits(d, 0, 2);
+         defl_align(d);
+         defl_put_byte(d, len);
+         defl_put_byte(d, len >> 8);
+         defl_put_byte(d, ~len);
+         defl_put_byte(d, ~len >> 8);
+         while (len--) defl_put_byte(d, *p++);
+      }
+   } else if (fix_bits <= dyn_bits) {
+      for (i = 0; i < 288; ++i) d->llen[i] = defl_fixed_len(i);
+      for (i = 0; i < 30; ++i) d->dlen[i] = 5;
+      defl_build_codes(d->llen, d->lcode, 288);
+      defl_build_codes(d->dlen, d->dcode, 30);
+      defl_put_bits(d, last, 1);
+      defl_put_bits(d, 1, 2);
+      defl_send_symbols(d);
+   } else {
+      defl_build_codes(d->llen, d->lcode, 286);
+      defl_build_codes(d->dlen, d->dcode, 30);
+      defl_build_codes(d->clen, d->ccode, 19);
+      defl_put_bits(d, last, 1);
+      defl_put_bits(d, 2, 2);
+      defl_put_bits(d, hlit - 257, 5);
+      defl_put_bits(d, hdist - 1, 5);
+      defl_put_bits(d, hclen - 4, 4);
+      for (i = 0; i < hclen; ++i) defl_put_bits(d, d->clen[clcidx[i]], 3);
+      defl_send_lengths(d, lens, hlit + hdist, 1);
+      defl_send_symbols(d);
+   }
+
+   d->sym_num = 0;
+   d->block_start = d->strstart - d->match_available;
+}
+
+/* ---------------------- *
+ * -- LZ77 matcher ------ *
+ * ---------------------- */
+
+static void defl_tally(UZLIB_DEFL *d, unsigned int dist, unsigned int lc)
+{
+   d->sym_lc[d->sym_num] = dist ? lc - UZLIB_MIN_MATCH : lc;
+   d->sym_dist[d->sym_num] = dist;
+   d->sym_num++;
+}
+
+/* insert string at pos into the hash chains, return previous chain head */
+static unsigned int defl_insert(UZLIB_DEFL *d, unsigned int pos)
+{
+   const unsigned char *p = d->window + pos;
+   uint32_t h = ((uint32_t)p[0] << 16 | p[1] << 8 | p[2]) * 2654435761u >> d->hshift;
+   unsigned int head = d->head[h];
+
+   d->prev[pos & d->wmask] = head;
+   d->head[h] = pos;
+   return head;
+}
+
+static unsigned int defl_longest_match(UZLIB_DEFL *d, unsigned int cur)
+{
+   const unsigned char *scan = d->window + d->strstart;
+   unsigned int chain = d->max_chain;
+   unsigned int best = d->prev_length;
+   unsigned int nice = d->nice_match;
+   unsigned int limit = d->strstart > MAX_DIST(d) ? d->strstart - MAX_DIST(d) : NIL;
+   unsigned int maxlen = d->lookahead < UZLIB_MAX_MATCH ? d->lookahead : UZLIB_MAX_MATCH;
+
+   if (best >= maxlen) return best;
+   if (best >= d->good_match) chain >>= 2;
+   if (nice > maxlen) nice = maxlen;
+
+   do {
+      const unsigned char *match = d->window + cur;
+      unsigned int len;
+
+      if (match[best] != scan[best] || match[0] != scan[0] || match[1] != scan[1]) continue;
+
+      for (len = 2; len < maxlen && match[len] == scan[len]; ++len);
+
+      if (len > best)
+      {
+         d->match_start = cur;
+         best = len;
+         if (len >= nice) break;
+      }
+   } while ((cur = d->prev[cur & d->wmask]) > limit && --chain != 0);
+
+   return best;
+}
+
+/* move the upper half of the window down, rebasing the hash chains */
+static void defl_slide(UZLIB_DEFL *d)
+{
+   unsigned int n, wsize = d->wsize;
+
+   memcpy(d->window, d->window + wsize, wsize);
+   d->strstart -= wsize;
+   d->match_start = d->match_start >= wsize ? d->match_start - wsize : NIL;
+   d->block_start -= wsize;
+
+   for (n = 1u << (32 - d->hshift); n--;)
+   {
+      d->head[n] = d->head[n] >= wsize ? d->head[n] - wsize : NIL;
+   }
+   for (n = wsize; n--;)
+   {
+      d->prev[n] = d->prev[n] >= wsize ? d->prev[n] - wsize : NIL;
+   }
+}
+
+/* run the matcher over the lookahead; unless flushing, stop while there
+   is still enough input ahead to find a maximum length match */
+static void defl_process(UZLIB_DEFL *d, int flush)
+{
+   while (d->lookahead >= UZLIB_MIN_LOOKAHEAD || (flush && d->lookahead))
+   {
+      unsigned int hash_head = NIL;
+
+      if (d->lookahead >= UZLIB_MIN_MATCH) hash_head = defl_insert(d, d->strstart);
+
+      d->prev_length = d->match_length;
+      d->prev_match = d->match_start;
+      d->match_length = UZLIB_MIN_MATCH - 1;
+
+      if (hash_head != NIL && d->max_chain && d->prev_length < d->max_lazy &&
+          d->strstart - hash_head <= MAX_DIST(d))
+      {
+         d->match_length = defl_longest_match(d, hash_head);
+
+         if (d->match_length == UZLIB_MIN_MATCH && d->strstart - d->match_start > TOO_FAR)
+         {
+            d->match_length = UZLIB_MIN_MATCH - 1;
+         }
+      }
+
+      if (d->prev_length >= UZLIB_MIN_MATCH && d->match_length <= d->prev_length)
+      {
+         /* the previous match was better, emit it */
+         unsigned int max_insert = d->strstart + d->lookahead - UZLIB_MIN_MATCH;
+
+         defl_tally(d, d->strstart - 1 - d->prev_match, d->prev_length);
+         d->lookahead -= d->prev_length - 1;
+         d->prev_length -= 2;
+         do {
+            if (++d->strstart <= max_insert) defl_insert(d, d->strstart);
+         } while (--d->prev_length != 0);
+         d->match_available = 0;
+         d->match_length = UZLIB_MIN_MATCH - 1;
+         d->strstart++;
+      } else if (d->match_available) {
+         defl_tally(d, 0, d->window[d->strstart - 1]);
+         d->strstart++;
+         d->lookahead--;
+      } else {
+         d->match_available = 1;
+         d->strstart++;
+         d->lookahead--;
+      }
+
+      if (d->sym_num == d->sym_max) defl_flush_block(d, 0);
+   }
+
+   if (flush && d->match_available)
+   {
+      defl_tally(d, 0, d->window[d->strstart - 1]);
+      d->match_available = 0;
+   }
+}
+
+/* ---------------------- *
+ * -- public functions -- *
+ * ---------------------- */
+
+unsigned int uzlib_deflate_memsize(int wbits)
+{
+   unsigned int wsize = 1u << wbits;
+
+   return wsize * sizeof(unsigned short)
+        + (1u << defl_hash_bits(wbits)) * sizeof(unsigned short)
+        + defl_sym_max(wbits) * (sizeof(unsigned short) + 1)
+        + 2 * wsize;
+}
+
+void uzlib_deflate_init(UZLIB_DEFL *d, void *mem, int wbits, int level, int checksum_type)
+{
+   unsigned char *p = mem;
+   unsigned int hsize = 1u << defl_hash_bits(wbits);
+
+   d->wbits = wbits;
+   d->wsize = 1u << wbits;
+   d->wmask = d->wsize - 1;
+   d->hshift = 32 - defl_hash_bits(wbits);
+   d->sym_max = defl_sym_max(wbits);
+
+   d->prev = (unsigned short *)p;
+   p += d->wsize * sizeof(unsigned short);
+   d->head = (unsigned short *)p;
+   p += hsize * sizeof(unsigned short);
+   d->sym_dist = (unsigned short *)p;
+   p += d->sym_max * sizeof(unsigned short);
+   d->window = p;
+   p += 2 * d->wsize;
+   d->sym_lc = p;
+
+   memset(d->head, 0, hsize * sizeof(unsigned short));
+   /* prev entries are always written before they are read */
+
+   d->level = level;
+   d->good_match = defl_config[level][0];
+   d->max_lazy = defl_config[level][1];
+   d->nice_match = defl_config[level][2];
+   d->max_chain = defl_config[level][3];
+
+   /* position 0 doubles as NIL, so start one byte into the window */
+   d->strstart = 1;
+   d->block_start = 1;
+   d->lookahead = 0;
+   d->match_start = 0;
+   d->match_length = UZLIB_MIN_MATCH - 1;
+   d->prev_length = UZLIB_MIN_MATCH - 1;
+   d->match_available = 0;
+   d->sym_num = 0;
+
+   d->bitbuf = 0;
+   d->bitcount = 0;
+   d->outlen = 0;
+
+   d->checksum_type = checksum_type;
+   d->checksum = checksum_type == TINF_CHKSUM_CRC ? ~0 : 1;
+   d->total_in = 0;
+   d->state = STATE_HEADER;
+}
+
+void uzlib_deflate(UZLIB_DEFL *d, const void *src, unsigned int len, int flush)
+{
+   const unsigned char *in = src;
+
+   if (d->state == STATE_DONE) return;
+
+   if (d->state == STATE_HEADER)
+   {
+      if (d->checksum_type == TINF_CHKSUM_ADLER)
+      {
+         unsigned int cmf = ((d->wbits - 8) << 4) | 8;
+         unsigned int flg = (d->level < 2 ? 0 : d->level < 6 ? 1 : d->level == 6 ? 2 : 3) << 6;
+
+         flg |= 31 - (cmf * 256 + flg) % 31;
+         defl_put_byte(d, cmf);
+         defl_put_byte(d, flg);
+      } else if (d->checksum_type == TINF_CHKSUM_CRC) {
+         static const unsigned char gzip_header[10] = {
+            0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff
+         };
+         unsigned int i;
+
+         for (i = 0; i < sizeof(gzip_header); ++i) defl_put_byte(d, gzip_header[i]);
+      }
+      d->state = STATE_BODY;
+   }
+
+   for (;;)
+   {
+      unsigned int room;
+
+      if (d->strstart + d->lookahead == 2 * d->wsize) defl_slide(d);
+
+      room = 2 * d->wsize - (d->strstart + d->lookahead);
+      if (room > len) room = len;
+      if (room)
+      {
+         memcpy(d->window + d->strstart + d->lookahead, in, room);
+         if (d->checksum_type == TINF_CHKSUM_ADLER)
+         {
+            d->checksum = uzlib_adler32(in, room, d->checksum);
+         } else if (d->checksum_type == TINF_CHKSUM_CRC) {
+            d->checksum = uzlib_crc32(in, room, d->checksum);
+         }
+         d->total_in += room;
+         d->lookahead += room;
+         in += room;
+         len -= room;
+      }
+
+      defl_process(d, flush != UZLIB_NO_FLUSH && !len);
+      if (!len) break;
+   }
+
+   if (flush == UZLIB_SYNC_FLUSH)
+   {
+      if (d->sym_num) defl_flush_block(d, 0);
+      /* empty stored block to byte-align the output */
+      defl_put_bits(d, 0, 3);
+      defl_align(d);
+      defl_put_uint32(d, 0xffff0000, 0);
+      defl_drain(d);
+   } else if (flush == UZLIB_FINISH) {
+      defl_flush_block(d, 1);
+      defl_align(d);
+      if (d->checksum_type == TINF_CHKSUM_ADLER)
+      {
+         defl_put_uint32(d, d->checksum, 1);
+      } else if (d->checksum_type == TINF_CHKSUM_CRC) {
+         defl_put_uint32(d, ~d->checksum, 0);
+         defl_put_uint32(d, d->total_in, 0);
+      }
+      defl_drain(d);
+      d->state = STATE_DONE;
+   }
+}
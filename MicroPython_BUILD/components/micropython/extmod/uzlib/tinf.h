@@ -101,7 +101,80 @@ int TINFCC uzlib_gzip_parse_header(TINF_DATA *d);
 
 /* Compression API */
 
-void TINFCC uzlib_compress(void *data, const uint8_t *src, unsigned slen);
+#define UZLIB_MIN_MATCH 3
+#define UZLIB_MAX_MATCH 258
+/* the matcher needs this much input ahead of the current position */
+#define UZLIB_MIN_LOOKAHEAD (UZLIB_MAX_MATCH + UZLIB_MIN_MATCH + 1)
+
+/* flush modes for uzlib_deflate() */
+#define UZLIB_NO_FLUSH   0
+#define UZLIB_SYNC_FLUSH 2
+#define UZLIB_FINISH     4
+
+struct UZLIB_DEFL;
+typedef struct UZLIB_DEFL {
+   /* Called with each chunk of compressed output */
+   void (*writeDest)(struct UZLIB_DEFL *data, const unsigned char *buf, unsigned int len);
+
+   /* LZ77 window of 2 * wsize bytes, and hash chains into it */
+   unsigned char *window;
+   unsigned short *head;
+   unsigned short *prev;
+   unsigned int wsize;
+   unsigned int wmask;
+   unsigned int hshift;
+
+   unsigned int strstart;
+   unsigned int lookahead;
+   int block_start;
+   unsigned int match_start;
+   unsigned int match_length;
+   unsigned int prev_match;
+   unsigned int prev_length;
+   int match_available;
+
+   /* matcher tuning, set from the compression level */
+   unsigned short max_chain;
+   unsigned short good_match;
+   unsigned short max_lazy;
+   unsigned short nice_match;
+
+   /* symbols of the block being collected: literal or length-3, and
+      distance (0 for literals) */
+   unsigned char *sym_lc;
+   unsigned short *sym_dist;
+   unsigned int sym_num;
+   unsigned int sym_max;
+
+   /* bit output */
+   uint32_t bitbuf;
+   unsigned int bitcount;
+   unsigned int outlen;
+   unsigned char outbuf[128];
+
+   /* Accumulating checksum */
+   uint32_t checksum;
+   char checksum_type;
+   char level;
+   char wbits;
+   char state;
+   uint32_t total_in;
+
+   /* Huffman tree construction */
+   unsigned short lfreq[286], dfreq[30], cfreq[19];
+   unsigned char llen[288], dlen[30], clen[19];
+   unsigned short lcode[288], dcode[30], ccode[19];
+   uint32_t tweight[2 * 286];
+   unsigned short tparent[2 * 286];
+   unsigned short tsym[286];
+} UZLIB_DEFL;
+
+/* size of the buffer to pass to uzlib_deflate_init() for a given window */
+unsigned int TINFCC uzlib_deflate_memsize(int wbits);
+/* wbits is 9..15, level is 0..9, checksum_type selects raw deflate
+   (TINF_CHKSUM_NONE), zlib (TINF_CHKSUM_ADLER) or gzip (TINF_CHKSUM_CRC) */
+void TINFCC uzlib_deflate_init(UZLIB_DEFL *d, void *mem, int wbits, int level, int checksum_type);
+void TINFCC uzlib_deflate(UZLIB_DEFL *d, const void *src, unsigned int len, int flush);
 
 /* Checksum API */
 
@@ -324,7 +324,12 @@ STATIC mp_obj_t native_vfs_mkfs(mp_obj_t bdev_in) {
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(native_vfs_mkfs_fun_obj, native_vfs_mkfs);
 STATIC MP_DEFINE_CONST_STATICMETHOD_OBJ(native_vfs_mkfs_obj, MP_ROM_PTR(&native_vfs_mkfs_fun_obj));
 
-STATIC MP_DEFINE_CONST_FUN_OBJ_3(native_vfs_open_obj, nativefs_builtin_open_self);
+//---------------------------------------------------------------
+STATIC mp_obj_t native_vfs_open(size_t n_args, const mp_obj_t *args) {
+	mp_int_t buffering = (n_args > 3) ? mp_obj_get_int(args[3]) : -1;
+	return nativefs_builtin_open_self(args[0], args[1], args[2], buffering);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(native_vfs_open_obj, 3, 4, native_vfs_open);
 
 //-----------------------------------------------------------------------------
 STATIC mp_obj_t native_vfs_ilistdir_func(size_t n_args, const mp_obj_t *args) {
@@ -77,8 +77,11 @@ int physicalPath(const char *path, char *ph_path);
 char *getcwd(char *buf, size_t size);
 const char * mkabspath(fs_user_mount_t *vfs, const char *path, char *absbuf, int buflen);
 mp_import_stat_t native_vfs_import_stat(struct _fs_user_mount_t *vfs, const char *path);
-mp_obj_t nativefs_builtin_open_self(mp_obj_t self_in, mp_obj_t path, mp_obj_t mode);
+mp_obj_t nativefs_builtin_open_self(mp_obj_t self_in, mp_obj_t path, mp_obj_t mode, mp_int_t buffering);
 int mount_vfs(int type, char *chdir_to);
+#if MICROPY_PERSISTENT_CODE_XIP
+int mount_xip_image(const char *label);
+#endif
 MP_DECLARE_CONST_FUN_OBJ_KW(mp_builtin_open_obj);
 MP_DECLARE_CONST_FUN_OBJ_0(native_vfs_getdrive_obj);
 //MP_DECLARE_CONST_FUN_OBJ_2(native_vfs_chdir_obj);
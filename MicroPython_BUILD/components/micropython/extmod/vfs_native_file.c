@@ -38,6 +38,8 @@
 #if MICROPY_VFS
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
@@ -48,18 +50,37 @@
 
 #include "py/nlr.h"
 #include "py/runtime.h"
+#include "py/mphal.h"
 #include "py/stream.h"
 #include "py/mperrno.h"
 #include "extmod/vfs_native.h"
 
+#ifndef MICROPY_VFS_NATIVE_BUFSIZE
+#define MICROPY_VFS_NATIVE_BUFSIZE (512)
+#endif
+
 static const char *TAG = "vfs_native_file";
 
 extern const mp_obj_type_t mp_type_fileio;
 extern const mp_obj_type_t mp_type_textio;
 
+// Files are buffered: buf[buf_pos..buf_len) holds data read ahead of the
+// file position, or buf[0..buf_len) holds written data not yet passed to
+// the fd when buf_dirty is set. Buffers of MICROPY_VFS_NATIVE_PSRAM_MIN
+// bytes or more are malloc'd in psRAM, smaller ones are allocated inline
+// after the object. The buffer must not be a separate block on the
+// MicroPython heap: __del__ flushes it and the GC may already have swept it.
 typedef struct _pyb_file_obj_t {
 	mp_obj_base_t base;
 	int fd;
+	byte *buf;
+	mp_uint_t buf_size;
+	mp_uint_t buf_pos;
+	mp_uint_t buf_len;
+	bool buf_dirty;
+	bool buf_psram;
+	bool line_buf;
+	byte inline_buf[];
 } pyb_file_obj_t;
 
 //-------------------------------------------------------------------------------------------
@@ -71,9 +92,7 @@ STATIC void file_obj_print(const mp_print_t *print, mp_obj_t self_in, mp_print_k
 }
 
 //-----------------------------------------------------------------------------------------
-STATIC mp_uint_t file_obj_read(mp_obj_t self_in, void *buf, mp_uint_t size, int *errcode) {
-	pyb_file_obj_t *self = MP_OBJ_TO_PTR(self_in);
-
+STATIC mp_uint_t file_fd_read(pyb_file_obj_t *self, void *buf, mp_uint_t size, int *errcode) {
 	int sz_out = read(self->fd, buf, size);
 	if (sz_out < 0) {
 		ESP_LOGD(TAG, "read(%d, buf, %d): error %d", self->fd, size, errno);
@@ -84,9 +103,7 @@ STATIC mp_uint_t file_obj_read(mp_obj_t self_in, void *buf, mp_uint_t size, int
 }
 
 //------------------------------------------------------------------------------------------------
-STATIC mp_uint_t file_obj_write(mp_obj_t self_in, const void *buf, mp_uint_t size, int *errcode) {
-	pyb_file_obj_t *self = MP_OBJ_TO_PTR(self_in);
-
+STATIC mp_uint_t file_fd_write(pyb_file_obj_t *self, const void *buf, mp_uint_t size, int *errcode) {
 	int sz_out = write(self->fd, buf, size);
 	if (sz_out < 0) {
 		ESP_LOGD(TAG, "write(%d, buf, %d): error %d", self->fd, size, errno);
@@ -94,7 +111,8 @@ STATIC mp_uint_t file_obj_write(mp_obj_t self_in, const void *buf, mp_uint_t siz
 		return MP_STREAM_ERROR;
 	}
 	mp_uint_t sz_out_sum = sz_out;
-	while (sz_out > 0) {
+	// write the rest after a short write, without a final zero length write()
+	while ((sz_out > 0) && ((mp_uint_t)sz_out < size)) {
 		buf = &((const uint8_t *) buf)[sz_out];
 		size -= sz_out;
 		sz_out = write(self->fd, buf, size);
@@ -109,17 +127,167 @@ STATIC mp_uint_t file_obj_write(mp_obj_t self_in, const void *buf, mp_uint_t siz
 	return sz_out_sum;
 }
 
-//------------------------------------------------
-STATIC mp_obj_t file_obj_close(mp_obj_t self_in) {
+// Write out buffered data, or give back read-ahead data by seeking the fd back,
+// so that the fd position matches the file position and the buffer is empty
+//------------------------------------------------------------
+STATIC int file_buf_sync(pyb_file_obj_t *self, int *errcode) {
+	if (self->buf_dirty) {
+		mp_uint_t len = self->buf_len;
+		self->buf_dirty = false;
+		self->buf_pos = self->buf_len = 0;
+		if (file_fd_write(self, self->buf, len, errcode) == MP_STREAM_ERROR) return -1;
+	}
+	else if (self->buf_pos < self->buf_len) {
+		off_t back = self->buf_len - self->buf_pos;
+		self->buf_pos = self->buf_len = 0;
+		if (lseek(self->fd, -back, SEEK_CUR) == (off_t)-1) {
+			*errcode = errno;
+			return -1;
+		}
+	}
+	else self->buf_pos = self->buf_len = 0;
+	return 0;
+}
+
+// Refill the (empty) read buffer, returns the number of bytes available
+//-------------------------------------------------------------------
+STATIC mp_uint_t file_buf_fill(pyb_file_obj_t *self, int *errcode) {
+	if (self->buf_dirty) {
+		if (file_buf_sync(self, errcode) < 0) return MP_STREAM_ERROR;
+	}
+	mp_uint_t n = file_fd_read(self, self->buf, self->buf_size, errcode);
+	if (n == MP_STREAM_ERROR) return n;
+	self->buf_pos = 0;
+	self->buf_len = n;
+	return n;
+}
+
+//-----------------------------------------------------------------------------------------
+STATIC mp_uint_t file_obj_read(mp_obj_t self_in, void *buf, mp_uint_t size, int *errcode) {
+	pyb_file_obj_t *self = MP_OBJ_TO_PTR(self_in);
+
+	if (self->buf == NULL) return file_fd_read(self, buf, size, errcode);
+
+	if (self->buf_pos == self->buf_len) {
+		if (self->buf_dirty) {
+			if (file_buf_sync(self, errcode) < 0) return MP_STREAM_ERROR;
+		}
+		// large reads go straight into the caller's buffer
+		if (size >= self->buf_size) return file_fd_read(self, buf, size, errcode);
+		mp_uint_t n = file_buf_fill(self, errcode);
+		if ((n == MP_STREAM_ERROR) || (n == 0)) return n;
+	}
+
+	mp_uint_t avail = self->buf_len - self->buf_pos;
+	if (size > avail) size = avail;
+	memcpy(buf, self->buf + self->buf_pos, size);
+	self->buf_pos += size;
+	return size;
+}
+
+//------------------------------------------------------------------------------------------------
+STATIC mp_uint_t file_obj_write(mp_obj_t self_in, const void *buf, mp_uint_t size, int *errcode) {
 	pyb_file_obj_t *self = MP_OBJ_TO_PTR(self_in);
-	// if fs==NULL then the file is closed and in that case this method is a no-op
+
+	if (self->buf == NULL) return file_fd_write(self, buf, size, errcode);
+
+	if (!self->buf_dirty) {
+		// drop read-ahead data
+		if (file_buf_sync(self, errcode) < 0) return MP_STREAM_ERROR;
+	}
+	if (self->buf_len + size > self->buf_size) {
+		if (file_buf_sync(self, errcode) < 0) return MP_STREAM_ERROR;
+	}
+	if (size >= self->buf_size) return file_fd_write(self, buf, size, errcode);
+
+	memcpy(self->buf + self->buf_len, buf, size);
+	self->buf_len += size;
+	self->buf_pos = self->buf_len;
+	self->buf_dirty = true;
+	if ((self->line_buf) && (memchr(buf, '\n', size))) {
+		if (file_buf_sync(self, errcode) < 0) return MP_STREAM_ERROR;
+	}
+	return size;
+}
+
+// Flush and close the fd and release the buffer
+//---------------------------------------------------------
+STATIC int file_close_fd(pyb_file_obj_t *self, int *errcode) {
+	int res = 0;
 	if (self->fd != -1) {
-		int res = close(self->fd);
-		self->fd = -1;
-		if (res < 0) {
+		if (self->buf_dirty) res = file_buf_sync(self, errcode);
+		if (close(self->fd) < 0) {
 			ESP_LOGD(TAG, "close(%d): error %d", self->fd, errno);
-			mp_raise_OSError(errno);
+			if (res == 0) *errcode = errno;
+			res = -1;
+		}
+		self->fd = -1;
+	}
+	if (self->buf) {
+		if (self->buf_psram) free(self->buf);
+		self->buf = NULL;
+	}
+	return res;
+}
+
+//------------------------------------------------------------------------
+STATIC mp_obj_t file_obj_readline(size_t n_args, const mp_obj_t *args) {
+	pyb_file_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+	if (self->buf == NULL) return mp_stream_unbuffered_readline_obj.fun.var(n_args, args);
+
+	const mp_stream_p_t *stream_p = mp_get_stream_raise(args[0], MP_STREAM_OP_READ);
+	mp_int_t max_size = -1;
+	if ((n_args > 1) && (args[1] != mp_const_none)) max_size = mp_obj_get_int(args[1]);
+
+	vstr_t vstr;
+	vstr_init(&vstr, 16);
+	int errcode;
+	while (max_size != 0) {
+		if (self->buf_pos == self->buf_len) {
+			mp_uint_t n = file_buf_fill(self, &errcode);
+			if (n == MP_STREAM_ERROR) mp_raise_OSError(errcode);
+			if (n == 0) break;
 		}
+		const byte *start = self->buf + self->buf_pos;
+		mp_uint_t len = self->buf_len - self->buf_pos;
+		if ((max_size > 0) && (len > (mp_uint_t)max_size)) len = max_size;
+		const byte *nl = memchr(start, '\n', len);
+		if (nl) len = nl - start + 1;
+		vstr_add_strn(&vstr, (const char *)start, len);
+		self->buf_pos += len;
+		if (max_size > 0) max_size -= len;
+		if (nl) break;
+	}
+	return mp_obj_new_str_from_vstr(stream_p->is_text ? &mp_type_str : &mp_type_bytes, &vstr);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(file_obj_readline_obj, 1, 2, file_obj_readline);
+
+//----------------------------------------------------
+STATIC mp_obj_t file_obj_readlines(mp_obj_t self_in) {
+	mp_obj_t lines = mp_obj_new_list(0, NULL);
+	for (;;) {
+		mp_obj_t line = file_obj_readline(1, &self_in);
+		if (!mp_obj_is_true(line)) break;
+		mp_obj_list_append(lines, line);
+	}
+	return lines;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(file_obj_readlines_obj, file_obj_readlines);
+
+//----------------------------------------------------
+STATIC mp_obj_t file_obj_iternext(mp_obj_t self_in) {
+	mp_obj_t line = file_obj_readline(1, &self_in);
+	if (!mp_obj_is_true(line)) return MP_OBJ_STOP_ITERATION;
+	return line;
+}
+
+//------------------------------------------------
+STATIC mp_obj_t file_obj_close(mp_obj_t self_in) {
+	pyb_file_obj_t *self = MP_OBJ_TO_PTR(self_in);
+	// if fd==-1 then the file is closed and in that case this method is a no-op
+	int errcode;
+	if (file_close_fd(self, &errcode) < 0) {
+		mp_raise_OSError(errcode);
 	}
 	return mp_const_none;
 }
@@ -139,6 +307,20 @@ STATIC mp_uint_t file_obj_ioctl(mp_obj_t o_in, mp_uint_t request, uintptr_t arg,
 	if (request == MP_STREAM_SEEK) {
 		struct mp_stream_seek_t *s = (struct mp_stream_seek_t*)(uintptr_t)arg;
 
+		if ((s->whence == SEEK_CUR) && (s->offset == 0)) {
+			// tell(), keep the buffer
+			off_t off = lseek(self->fd, 0, SEEK_CUR);
+			if (off == (off_t)-1) {
+				*errcode = errno;
+				return MP_STREAM_ERROR;
+			}
+			if (self->buf_dirty) off += self->buf_len;
+			else off -= self->buf_len - self->buf_pos;
+			s->offset = off;
+			return 0;
+		}
+		if (file_buf_sync(self, errcode) < 0) return MP_STREAM_ERROR;
+
 		off_t off = lseek(self->fd, s->offset, s->whence);
 		if (off == (off_t)-1) {
 			ESP_LOGD(TAG, "ioctl(%d, %d, ..): error %d", self->fd, request, errno);
@@ -149,19 +331,13 @@ STATIC mp_uint_t file_obj_ioctl(mp_obj_t o_in, mp_uint_t request, uintptr_t arg,
 		return 0;
 
 	} else if (request == MP_STREAM_FLUSH) {
-		// fsync() not implemented.
+		// fsync() not implemented, only the buffer is written out
+		if ((self->buf_dirty) && (file_buf_sync(self, errcode) < 0)) return MP_STREAM_ERROR;
 		return 0;
 
     } else if (request == MP_STREAM_CLOSE) {
-        // if fs==NULL then the file is closed and in that case this method is a no-op
-        if (self->fd != -1) {
-    		int res = close(self->fd);
-    		self->fd = -1;
-    		if (res < 0) {
-                *errcode = errno;
-                return MP_STREAM_ERROR;
-    		}
-        }
+        // if fd==-1 then the file is closed and in that case this method is a no-op
+        if (file_close_fd(self, errcode) < 0) return MP_STREAM_ERROR;
         return 0;
 
     } else {
@@ -177,14 +353,13 @@ STATIC mp_uint_t file_obj_ioctl(mp_obj_t o_in, mp_uint_t request, uintptr_t arg,
 STATIC const mp_arg_t file_open_args[] = {
 	{ MP_QSTR_file, MP_ARG_OBJ | MP_ARG_REQUIRED, {.u_rom_obj = MP_ROM_PTR(&mp_const_none_obj)} },
 	{ MP_QSTR_mode, MP_ARG_OBJ, {.u_obj = MP_OBJ_NEW_QSTR(MP_QSTR_r)} },
+	{ MP_QSTR_buffering, MP_ARG_INT, {.u_int = -1} },
 	{ MP_QSTR_encoding, MP_ARG_OBJ | MP_ARG_KW_ONLY, {.u_rom_obj = MP_ROM_PTR(&mp_const_none_obj)} },
 };
 #define FILE_OPEN_NUM_ARGS MP_ARRAY_SIZE(file_open_args)
 
 //----------------------------------------------------------------------------------------------
 STATIC mp_obj_t file_open(fs_user_mount_t *vfs, const mp_obj_type_t *type, mp_arg_val_t *args) {
-	pyb_file_obj_t *o = m_new_obj_with_finaliser(pyb_file_obj_t);
-
 	const char *fname = mp_obj_str_get_str(args[0].u_obj);
 	const char *mode_s = mp_obj_str_get_str(args[1].u_obj);
 
@@ -226,13 +401,37 @@ STATIC mp_obj_t file_open(fs_user_mount_t *vfs, const mp_obj_type_t *type, mp_ar
 #endif
 		}
 	}
+
+	// buffering: -1 default size, 0 unbuffered, 1 line buffered text file, >1 buffer size
+	mp_int_t bufsize = args[2].u_int;
+	bool line_buf = ((bufsize == 1) && (type == &mp_type_textio));
+	if (bufsize < 0 || bufsize == 1) bufsize = MICROPY_VFS_NATIVE_BUFSIZE;
+
+	byte *buf = NULL;
+	#ifdef MICROPY_VFS_NATIVE_PSRAM_MALLOC
+	if (bufsize >= MICROPY_VFS_NATIVE_PSRAM_MIN) buf = MICROPY_VFS_NATIVE_PSRAM_MALLOC(bufsize);
+	#endif
+	pyb_file_obj_t *o;
+	if ((buf != NULL) || (bufsize == 0)) o = m_new_obj_with_finaliser(pyb_file_obj_t);
+	else {
+		o = m_new_obj_var_with_finaliser(pyb_file_obj_t, byte, bufsize);
+		buf = o->inline_buf;
+	}
 	o->base.type = type;
+	o->buf = buf;
+	o->buf_size = bufsize;
+	o->buf_pos = o->buf_len = 0;
+	o->buf_dirty = false;
+	o->buf_psram = ((buf != NULL) && (buf != o->inline_buf));
+	o->line_buf = line_buf;
 
 	assert(vfs != NULL);
 	int fd = open(fname, mode_x | mode_rw, 0644);
 	if (fd == -1) {
 		ESP_LOGD(TAG, "open('%s', '%s'): error %d", fname, mode_s_orig, errno);
-		m_del_obj(pyb_file_obj_t, o);
+		if (o->buf_psram) free(o->buf);
+		o->buf = NULL;
+		o->fd = -1;
 		mp_raise_OSError(errno);
 	}
 	o->fd = fd;
@@ -255,8 +454,8 @@ STATIC mp_obj_t file_obj_make_new(const mp_obj_type_t *type, size_t n_args, size
 STATIC const mp_rom_map_elem_t rawfile_locals_dict_table[] = {
 	{ MP_ROM_QSTR(MP_QSTR_read), MP_ROM_PTR(&mp_stream_read_obj) },
 	{ MP_ROM_QSTR(MP_QSTR_readinto), MP_ROM_PTR(&mp_stream_readinto_obj) },
-	{ MP_ROM_QSTR(MP_QSTR_readline), MP_ROM_PTR(&mp_stream_unbuffered_readline_obj) },
-	{ MP_ROM_QSTR(MP_QSTR_readlines), MP_ROM_PTR(&mp_stream_unbuffered_readlines_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_readline), MP_ROM_PTR(&file_obj_readline_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_readlines), MP_ROM_PTR(&file_obj_readlines_obj) },
 	{ MP_ROM_QSTR(MP_QSTR_write), MP_ROM_PTR(&mp_stream_write_obj) },
 	{ MP_ROM_QSTR(MP_QSTR_flush), MP_ROM_PTR(&mp_stream_flush_obj) },
 	{ MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&file_obj_close_obj) },
@@ -285,7 +484,7 @@ const mp_obj_type_t mp_type_fileio = {
 	.print = file_obj_print,
 	.make_new = file_obj_make_new,
 	.getiter = mp_identity_getiter,
-	.iternext = mp_stream_unbuffered_iter,
+	.iternext = file_obj_iternext,
 	.protocol = &fileio_stream_p,
 	.locals_dict = (mp_obj_dict_t*)&rawfile_locals_dict,
 };
@@ -306,20 +505,20 @@ const mp_obj_type_t mp_type_textio = {
 	.print = file_obj_print,
 	.make_new = file_obj_make_new,
 	.getiter = mp_identity_getiter,
-	.iternext = mp_stream_unbuffered_iter,
+	.iternext = file_obj_iternext,
 	.protocol = &textio_stream_p,
 	.locals_dict = (mp_obj_dict_t*)&rawfile_locals_dict,
 };
 
 // Factory function for I/O stream classes
-//-----------------------------------------------------------------------------------
-mp_obj_t nativefs_builtin_open_self(mp_obj_t self_in, mp_obj_t path, mp_obj_t mode) {
-	// TODO: analyze buffering args and instantiate appropriate type
+//---------------------------------------------------------------------------------------------------------------
+mp_obj_t nativefs_builtin_open_self(mp_obj_t self_in, mp_obj_t path, mp_obj_t mode, mp_int_t buffering) {
 	fs_user_mount_t *self = MP_OBJ_TO_PTR(self_in);
 	mp_arg_val_t arg_vals[FILE_OPEN_NUM_ARGS];
 	arg_vals[0].u_obj = path;
 	arg_vals[1].u_obj = mode;
-	arg_vals[2].u_obj = mp_const_none;
+	arg_vals[2].u_int = buffering;
+	arg_vals[3].u_obj = mp_const_none;
 	return file_open(self, &mp_type_textio, arg_vals);
 }
 
@@ -0,0 +1,355 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <sys/types.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "lib/berkeley-db-1.xx/include/db.h"
+#include "lib/berkeley-db-1.xx/btree/btree.h"
+
+/* Maximum tree height built by the loader. */
+#define	MAXLEVELS	32
+
+/* The page being filled on each level of the tree. */
+typedef struct _level {
+	PAGE	*page;			/* the (pinned) page */
+	pgno_t	 first;			/* leftmost page of the level */
+} LEVEL;
+
+typedef struct _load {
+	BTREE	*t;
+	LEVEL	 lv[MAXLEVELS];
+	int	 nlevels;
+	u_int32_t limit;		/* bytes to fill on a page */
+} LOAD;
+
+static int	 bt_ladd __P((LOAD *, int, const DBT *, int, pgno_t));
+static char	*bt_lappend __P((PAGE *, u_int32_t));
+static int	 bt_lfinish __P((LOAD *));
+static int	 bt_lfits __P((LOAD *, PAGE *, u_int32_t));
+static int	 bt_lnew __P((LOAD *, int, const DBT *, int));
+
+/*
+ * __BT_LOAD -- Bulk load key/data pairs in ascending key order.
+ *
+ * Parameters:
+ *	dbp:	pointer to access method
+ *	next:	returns the next pair: 1, 0 at the end, -1 on error
+ *	arg:	argument for next
+ *	fill:	page fill factor in percent
+ *
+ * Returns:
+ *	RET_ERROR, RET_SUCCESS
+ *
+ * On an empty tree the pages are filled left to right and the internal
+ * levels are built bottom-up, without searches or page splits.  Once a
+ * key is out of order, or if the tree is not empty, the (remaining) pairs
+ * are added with __bt_put.
+ */
+int
+__bt_load(dbp, next, arg, fill)
+	const DB *dbp;
+	int (*next) __P((void *, DBT *, DBT *));
+	void *arg;
+	u_int fill;
+{
+	LOAD l;
+	BTREE *t;
+	DBT ukey, udata, tkey, tdata, *key, *data;
+	EPG e;
+	PAGE *h;
+	pgno_t pg;
+	u_int32_t nbytes;
+	int cmp, dflags, empty, status;
+	char *dest, db[NOVFLSIZE], kb[NOVFLSIZE];
+
+	t = dbp->internal;
+
+	/* Toss any page pinned across calls. */
+	if (t->bt_pinned != NULL) {
+		mpool_put(t->bt_mp, t->bt_pinned, 0);
+		t->bt_pinned = NULL;
+	}
+
+	/* Check for change to a read-only tree. */
+	if (F_ISSET(t, B_RDONLY)) {
+		errno = EPERM;
+		return (RET_ERROR);
+	}
+
+	if ((h = mpool_get(t->bt_mp, P_ROOT, 0)) == NULL)
+		return (RET_ERROR);
+	empty = (h->flags & P_BLEAF) && NEXTINDEX(h) == 0;
+	mpool_put(t->bt_mp, h, 0);
+	if (!empty)
+		goto put;
+
+	if (fill == 0 || fill > 100)
+		fill = 100;
+	l.t = t;
+	l.nlevels = 0;
+	l.limit = (t->bt_psize - BTDATAOFF) * fill / 100;
+
+	while ((status = next(arg, &ukey, &udata)) == 1) {
+		/* Keys must ascend, equal keys only if duplicates are allowed. */
+		if (l.nlevels > 0) {
+			e.page = l.lv[0].page;
+			e.index = NEXTINDEX(e.page) - 1;
+			cmp = __bt_cmp(t, &ukey, &e);
+			if (cmp < 0 || (cmp == 0 && F_ISSET(t, B_NODUPS)))
+				break;
+		}
+
+		/* Move big keys and data to overflow pages, as __bt_put does. */
+		key = &ukey;
+		data = &udata;
+		dflags = 0;
+		if (key->size + data->size > t->bt_ovflsize) {
+			if (key->size > t->bt_ovflsize) {
+storekey:			if (__ovfl_put(t, key, &pg) == RET_ERROR)
+					goto err;
+				tkey.data = kb;
+				tkey.size = NOVFLSIZE;
+				memmove(kb, &pg, sizeof(pgno_t));
+				memmove(kb + sizeof(pgno_t),
+				    &key->size, sizeof(u_int32_t));
+				dflags |= P_BIGKEY;
+				key = &tkey;
+			}
+			if (key->size + data->size > t->bt_ovflsize) {
+				if (__ovfl_put(t, data, &pg) == RET_ERROR)
+					goto err;
+				tdata.data = db;
+				tdata.size = NOVFLSIZE;
+				memmove(db, &pg, sizeof(pgno_t));
+				memmove(db + sizeof(pgno_t),
+				    &data->size, sizeof(u_int32_t));
+				dflags |= P_BIGDATA;
+				data = &tdata;
+			}
+			if (key->size + data->size > t->bt_ovflsize)
+				goto storekey;
+		}
+
+		nbytes = NBLEAFDBT(key->size, data->size);
+		if (l.nlevels == 0 || !bt_lfits(&l, l.lv[0].page, nbytes))
+			if (bt_lnew(&l, 0, key, dflags & P_BIGKEY) == RET_ERROR)
+				goto err;
+		dest = bt_lappend(l.lv[0].page, nbytes);
+		WR_BLEAF(dest, key, data, dflags);
+	}
+
+	if (bt_lfinish(&l) == RET_ERROR)
+		return (RET_ERROR);
+	if (status < 0)
+		return (RET_ERROR);
+	if (status == 0)
+		return (RET_SUCCESS);
+
+	/* Out of order key, add it and the rest with __bt_put. */
+	if (__bt_put(dbp, &ukey, &udata, 0) == RET_ERROR)
+		return (RET_ERROR);
+put:
+	while ((status = next(arg, &ukey, &udata)) == 1)
+		if (__bt_put(dbp, &ukey, &udata, 0) == RET_ERROR)
+			return (RET_ERROR);
+	return (status < 0 ? RET_ERROR : RET_SUCCESS);
+
+err:
+	/* Unpin the pages, the tree is left empty. */
+	for (cmp = 0; cmp < l.nlevels; ++cmp)
+		mpool_put(t->bt_mp, l.lv[cmp].page, MPOOL_DIRTY);
+	return (RET_ERROR);
+}
+
+/*
+ * BT_LFITS -- Check if an entry of nbytes fits on the page being filled.
+ *
+ *	A page always gets at least two entries, so that every level has
+ *	fewer pages than the level below it.
+ */
+static int
+bt_lfits(l, h, nbytes)
+	LOAD *l;
+	PAGE *h;
+	u_int32_t nbytes;
+{
+	if (NEXTINDEX(h) < 2)
+		return (h->upper - h->lower >= nbytes + sizeof(indx_t));
+	return ((h->lower - BTDATAOFF) + (l->t->bt_psize - h->upper) +
+	    nbytes + sizeof(indx_t) <= l->limit);
+}
+
+/*
+ * BT_LAPPEND -- Reserve nbytes for a new last entry of the page.
+ */
+static char *
+bt_lappend(h, nbytes)
+	PAGE *h;
+	u_int32_t nbytes;
+{
+	h->linp[NEXTINDEX(h)] = h->upper -= nbytes;
+	h->lower += sizeof(indx_t);
+	return ((char *)h + h->upper);
+}
+
+/*
+ * BT_LNEW -- Start a new page on a level.
+ *
+ *	The full page is linked to the new one and released; key, the
+ *	first key of the new page, is added to the level above.
+ */
+static int
+bt_lnew(l, level, key, kflags)
+	LOAD *l;
+	int level;
+	const DBT *key;
+	int kflags;
+{
+	BTREE *t;
+	PAGE *h, *prev;
+	pgno_t pg;
+
+	t = l->t;
+	if (level >= MAXLEVELS) {
+		errno = EINVAL;
+		return (RET_ERROR);
+	}
+	if ((h = __bt_new(t, &pg)) == NULL)
+		return (RET_ERROR);
+	h->pgno = pg;
+	h->nextpg = P_INVALID;
+	h->flags = level ? P_BINTERNAL : P_BLEAF;
+	h->lower = BTDATAOFF;
+	h->upper = t->bt_psize;
+
+	if (level == l->nlevels) {
+		h->prevpg = P_INVALID;
+		l->lv[level].page = h;
+		l->lv[level].first = pg;
+		++l->nlevels;
+		return (RET_SUCCESS);
+	}
+
+	prev = l->lv[level].page;
+	h->prevpg = prev->pgno;
+	prev->nextpg = pg;
+	mpool_put(t->bt_mp, prev, MPOOL_DIRTY);
+	l->lv[level].page = h;
+	return (bt_ladd(l, level + 1, key, kflags, pg));
+}
+
+/*
+ * BT_LADD -- Add a {key, pgno} entry to an internal level.
+ */
+static int
+bt_ladd(l, level, key, kflags, pgno)
+	LOAD *l;
+	int level;
+	const DBT *key;
+	int kflags;
+	pgno_t pgno;
+{
+	BTREE *t;
+	PAGE *h;
+	pgno_t pg;
+	u_int32_t nbytes;
+	char *dest;
+
+	t = l->t;
+	if (level == l->nlevels) {
+		/*
+		 * New top level.  Its first entry is the leftmost page of
+		 * the level below; the leftmost key on internal pages is
+		 * never compared, so it is stored empty.
+		 */
+		if (bt_lnew(l, level, NULL, 0) == RET_ERROR)
+			return (RET_ERROR);
+		dest = bt_lappend(l->lv[level].page, NBINTERNAL(0));
+		WR_BINTERNAL(dest, 0, l->lv[level - 1].first, 0);
+	}
+
+	nbytes = NBINTERNAL(key->size);
+	if (!bt_lfits(l, l->lv[level].page, nbytes) &&
+	    bt_lnew(l, level, key, kflags) == RET_ERROR)
+		return (RET_ERROR);
+	dest = bt_lappend(l->lv[level].page, nbytes);
+	WR_BINTERNAL(dest, key->size, pgno, kflags);
+	memmove(dest, key->data, key->size);
+
+	/*
+	 * If the key is on an overflow page, mark the overflow chain so it
+	 * isn't deleted when the leaf copy of the key is deleted.
+	 */
+	if (kflags & P_BIGKEY) {
+		memcpy(&pg, key->data, sizeof(pgno_t));
+		if ((h = mpool_get(t->bt_mp, pg, 0)) == NULL)
+			return (RET_ERROR);
+		h->flags |= P_PRESERVE;
+		mpool_put(t->bt_mp, h, MPOOL_DIRTY);
+	}
+	return (RET_SUCCESS);
+}
+
+/*
+ * BT_LFINISH -- Release the pages and move the top page to the root.
+ */
+static int
+bt_lfinish(l)
+	LOAD *l;
+{
+	BTREE *t;
+	PAGE *root, *top;
+	int i;
+
+	t = l->t;
+	if (l->nlevels == 0)
+		return (RET_SUCCESS);
+	for (i = 0; i < l->nlevels - 1; ++i)
+		mpool_put(t->bt_mp, l->lv[i].page, MPOOL_DIRTY);
+
+	/* The top level has a single page, copy it to the root page. */
+	top = l->lv[l->nlevels - 1].page;
+	if ((root = mpool_get(t->bt_mp, P_ROOT, 0)) == NULL) {
+		mpool_put(t->bt_mp, top, MPOOL_DIRTY);
+		return (RET_ERROR);
+	}
+	memmove(root, top, t->bt_psize);
+	root->pgno = P_ROOT;
+	root->prevpg = root->nextpg = P_INVALID;
+	mpool_put(t->bt_mp, root, MPOOL_DIRTY);
+	if (__bt_free(t, top) == RET_ERROR)
+		return (RET_ERROR);
+
+	/* The cursor and the sorted insert hint refer to the old tree. */
+	t->bt_cursor.flags = 0;
+	t->bt_order = NOT;
+	F_SET(t, B_MODIFIED);
+	return (RET_SUCCESS);
+}
@@ -43,6 +43,8 @@ int	 __bt_dleaf __P((BTREE *, const DBT *, PAGE *, u_int));
 int	 __bt_fd __P((const DB *));
 int	 __bt_free __P((BTREE *, PAGE *));
 int	 __bt_get __P((const DB *, const DBT *, DBT *, u_int));
+int	 __bt_load __P((const DB *,
+	    int (*)(void *, DBT *, DBT *), void *, u_int));
 PAGE	*__bt_new __P((BTREE *, pgno_t *));
 void	 __bt_pgin __P((void *, pgno_t, void *));
 void	 __bt_pgout __P((void *, pgno_t, void *));
@@ -73,7 +73,10 @@ typedef struct MPOOL {
 					/* page out conversion routine */
 	void    (*pgout) __P((void *, pgno_t, void *));
 	void	*pgcookie;		/* cookie for page in/out routines */
-#ifdef STATISTICS
+					/* page buffer allocation */
+	void	*(*bktalloc) __P((size_t));
+	void	(*bktfree) __P((void *));
+	off_t	filepos;		/* file offset, -1 if unknown */
 	u_long	cachehit;
 	u_long	cachemiss;
 	u_long	pagealloc;
@@ -83,9 +86,17 @@ typedef struct MPOOL {
 	u_long	pageput;
 	u_long	pageread;
 	u_long	pagewrite;
-#endif
+	u_long	writeback;		/* batched write-backs */
 } MPOOL;
 
+/*
+ * Dirty pages are written back in batches of up to MPOOL_WBATCH pages,
+ * in page number order, when a dirty page has to be evicted.
+ */
+#ifndef	MPOOL_WBATCH
+#define	MPOOL_WBATCH	8
+#endif
+
 __BEGIN_DECLS
 MPOOL	*mpool_open __P((void *, virt_fd_t, const FILEVTABLE *, pgno_t, pgno_t));
 void	 mpool_filter __P((MPOOL *, void (*)(void *, pgno_t, void *),
@@ -95,6 +106,7 @@ void	*mpool_get __P((MPOOL *, pgno_t, u_int));
 int	 mpool_put __P((MPOOL *, void *, u_int));
 int	 mpool_sync __P((MPOOL *));
 int	 mpool_close __P((MPOOL *));
+int	 mpool_setalloc __P((MPOOL *, void *(*)(size_t), void (*)(void *)));
 #ifdef STATISTICS
 void	 mpool_stat __P((MPOOL *));
 #endif
@@ -51,6 +51,7 @@ static char sccsid[] = "@(#)mpool.c	8.5 (Berkeley) 7/26/94";
 static BKT *mpool_bkt __P((MPOOL *));
 static BKT *mpool_look __P((MPOOL *, pgno_t));
 static int  mpool_write __P((MPOOL *, BKT *));
+static int  mpool_writeback __P((MPOOL *, int, int));
 
 /*
  * mpool_open --
@@ -74,9 +75,14 @@ mpool_open(key, fd, fvtable, pagesize, maxcache)
 		CIRCLEQ_INIT(&mp->hqh[entry]);
 	mp->maxcache = maxcache;
 	mp->fvtable = fvtable;
+	mp->bktalloc = malloc;
+	mp->bktfree = free;
 	off_t file_size = mp->fvtable->lseek(fd, 0, SEEK_END);
-	if (file_size == (off_t)-1)
+	if (file_size == (off_t)-1) {
+		free(mp);
 		return (NULL);
+	}
+	mp->filepos = file_size;
 	mp->npages = file_size / pagesize;
 	mp->pagesize = pagesize;
 	mp->fd = fd;
@@ -99,6 +105,45 @@ mpool_filter(mp, pgin, pgout, pgcookie)
 	mp->pgcookie = pgcookie;
 }
 	
+/*
+ * mpool_setalloc --
+ *	Set the allocator for the page buffers.  The pages already cached
+ *	are moved to buffers from the new allocator, so all buffers can be
+ *	released with the new free function.  Fails if a page is pinned.
+ */
+int
+mpool_setalloc(mp, bktalloc, bktfree)
+	MPOOL *mp;
+	void *(*bktalloc) __P((size_t));
+	void (*bktfree) __P((void *));
+{
+	struct _hqh *head;
+	BKT *bp, *nbp;
+
+	for (bp = mp->lqh.cqh_first;
+	    bp != (void *)&mp->lqh; bp = bp->q.cqe_next)
+		if (bp->flags & MPOOL_PINNED) {
+			errno = EBUSY;
+			return (RET_ERROR);
+		}
+	for (bp = mp->lqh.cqh_first; bp != (void *)&mp->lqh; bp = nbp) {
+		if ((nbp = (BKT *)bktalloc(sizeof(BKT) + mp->pagesize)) == NULL)
+			return (RET_ERROR);
+		memmove(nbp, bp, sizeof(BKT) + mp->pagesize);
+		nbp->page = (char *)nbp + sizeof(BKT);
+		head = &mp->hqh[HASHKEY(bp->pgno)];
+		CIRCLEQ_INSERT_AFTER(head, bp, nbp, hq);
+		CIRCLEQ_REMOVE(head, bp, hq);
+		CIRCLEQ_INSERT_AFTER(&mp->lqh, bp, nbp, q);
+		CIRCLEQ_REMOVE(&mp->lqh, bp, q);
+		mp->bktfree(bp);
+		nbp = nbp->q.cqe_next;
+	}
+	mp->bktalloc = bktalloc;
+	mp->bktfree = bktfree;
+	return (RET_SUCCESS);
+}
+
 /*
  * mpool_new --
  *	Get a new page of memory.
@@ -115,9 +160,7 @@ mpool_new(mp, pgnoaddr)
 		mpool_error("mpool_new: page allocation overflow.\n");
 		abort();
 	}
-#ifdef STATISTICS
 	++mp->pagenew;
-#endif
 	/*
 	 * Get a BKT from the cache.  Assign a new page number, attach
 	 * it to the head of the hash chain, the tail of the lru chain,
@@ -155,9 +198,7 @@ mpool_get(mp, pgno, flags)
 		return (NULL);
 	}
 
-#ifdef STATISTICS
 	++mp->pageget;
-#endif
 
 	/* Check for a page that is cached. */
 	if ((bp = mpool_look(mp, pgno)) != NULL) {
@@ -188,17 +229,20 @@ mpool_get(mp, pgno, flags)
 		return (NULL);
 
 	/* Read in the contents. */
-#ifdef STATISTICS
 	++mp->pageread;
-#endif
 	off = mp->pagesize * pgno;
-	if (mp->fvtable->lseek(mp->fd, off, SEEK_SET) != off)
-		return (NULL);
+	if (mp->filepos != off) {
+		mp->filepos = -1;
+		if (mp->fvtable->lseek(mp->fd, off, SEEK_SET) != off)
+			return (NULL);
+	}
 	if ((nr = mp->fvtable->read(mp->fd, bp->page, mp->pagesize)) != mp->pagesize) {
+		mp->filepos = -1;
 		if (nr >= 0)
 			errno = EFTYPE;
 		return (NULL);
 	}
+	mp->filepos = off + mp->pagesize;
 
 	/* Set the page number, pin the page. */
 	bp->pgno = pgno;
@@ -231,9 +275,7 @@ mpool_put(mp, page, flags)
 {
 	BKT *bp;
 
-#ifdef STATISTICS
 	++mp->pageput;
-#endif
 	bp = (BKT *)((char *)page - sizeof(BKT));
 #ifdef DEBUG
 	if (!(bp->flags & MPOOL_PINNED)) {
@@ -260,7 +302,7 @@ mpool_close(mp)
 	/* Free up any space allocated to the lru pages. */
 	while ((bp = mp->lqh.cqh_first) != (void *)&mp->lqh) {
 		CIRCLEQ_REMOVE(&mp->lqh, mp->lqh.cqh_first, q);
-		free(bp);
+		mp->bktfree(bp);
 	}
 
 	/* Free the MPOOL cookie. */
@@ -276,14 +318,13 @@ int
 mpool_sync(mp)
 	MPOOL *mp;
 {
-	BKT *bp;
+	int n;
 
-	/* Walk the lru chain, flushing any dirty pages to disk. */
-	for (bp = mp->lqh.cqh_first;
-	    bp != (void *)&mp->lqh; bp = bp->q.cqe_next)
-		if (bp->flags & MPOOL_DIRTY &&
-		    mpool_write(mp, bp) == RET_ERROR)
-			return (RET_ERROR);
+	/* Flush all dirty pages to disk, in batches sorted by page number. */
+	while ((n = mpool_writeback(mp, MPOOL_WBATCH, 1)) > 0)
+		;
+	if (n < 0)
+		return (RET_ERROR);
 
 	/* Sync the file descriptor. */
 	return (mp->fvtable->fsync(mp->fd) ? RET_ERROR : RET_SUCCESS);
@@ -313,13 +354,15 @@ mpool_bkt(mp)
 	for (bp = mp->lqh.cqh_first;
 	    bp != (void *)&mp->lqh; bp = bp->q.cqe_next)
 		if (!(bp->flags & MPOOL_PINNED)) {
-			/* Flush if dirty. */
+			/*
+			 * Flush if dirty, together with the next dirty
+			 * pages on the lru chain; they are likely to be
+			 * evicted next and are written in page order.
+			 */
 			if (bp->flags & MPOOL_DIRTY &&
-			    mpool_write(mp, bp) == RET_ERROR)
+			    mpool_writeback(mp, MPOOL_WBATCH, 0) < 0)
 				return (NULL);
-#ifdef STATISTICS
 			++mp->pageflush;
-#endif
 			/* Remove from the hash and lru queues. */
 			head = &mp->hqh[HASHKEY(bp->pgno)];
 			CIRCLEQ_REMOVE(head, bp, hq);
@@ -334,11 +377,9 @@ mpool_bkt(mp)
 			return (bp);
 		}
 
-new:	if ((bp = (BKT *)malloc(sizeof(BKT) + mp->pagesize)) == NULL)
+new:	if ((bp = (BKT *)mp->bktalloc(sizeof(BKT) + mp->pagesize)) == NULL)
 		return (NULL);
-#ifdef STATISTICS
 	++mp->pagealloc;
-#endif
 #if defined(DEBUG) || defined(PURIFY)
 	memset(bp, 0xff, sizeof(BKT) + mp->pagesize);
 #endif
@@ -358,24 +399,65 @@ mpool_write(mp, bp)
 {
 	off_t off;
 
-#ifdef STATISTICS
 	++mp->pagewrite;
-#endif
 
 	/* Run through the user's filter. */
 	if (mp->pgout)
 		(mp->pgout)(mp->pgcookie, bp->pgno, bp->page);
 
 	off = mp->pagesize * bp->pgno;
-	if (mp->fvtable->lseek(mp->fd, off, SEEK_SET) != off)
-		return (RET_ERROR);
-	if (mp->fvtable->write(mp->fd, bp->page, mp->pagesize) != mp->pagesize)
+	if (mp->filepos != off) {
+		mp->filepos = -1;
+		if (mp->fvtable->lseek(mp->fd, off, SEEK_SET) != off)
+			return (RET_ERROR);
+	}
+	if (mp->fvtable->write(mp->fd, bp->page, mp->pagesize) != mp->pagesize) {
+		mp->filepos = -1;
 		return (RET_ERROR);
+	}
+	mp->filepos = off + mp->pagesize;
 
 	bp->flags &= ~MPOOL_DIRTY;
 	return (RET_SUCCESS);
 }
 
+/*
+ * mpool_writeback
+ *	Write up to max dirty pages, taken in lru order, to disk in page
+ *	number order; consecutive pages are written without seeking.
+ *	Pinned pages are written only if pinned is set.  Returns the
+ *	number of pages written, -1 on error.
+ */
+static int
+mpool_writeback(mp, max, pinned)
+	MPOOL *mp;
+	int max, pinned;
+{
+	BKT *bp, *batch[MPOOL_WBATCH];
+	int i, j, n;
+
+	if (max > MPOOL_WBATCH)
+		max = MPOOL_WBATCH;
+	n = 0;
+	for (bp = mp->lqh.cqh_first;
+	    bp != (void *)&mp->lqh && n < max; bp = bp->q.cqe_next) {
+		if (!(bp->flags & MPOOL_DIRTY) ||
+		    (!pinned && bp->flags & MPOOL_PINNED))
+			continue;
+		/* Insertion sort by page number. */
+		for (i = n++; i > 0 && batch[i - 1]->pgno > bp->pgno; --i)
+			batch[i] = batch[i - 1];
+		batch[i] = bp;
+	}
+	if (n == 0)
+		return (0);
+	++mp->writeback;
+	for (j = 0; j < n; ++j)
+		if (mpool_write(mp, batch[j]) == RET_ERROR)
+			return (-1);
+	return (n);
+}
+
 /*
  * mpool_look
  *	Lookup a page in the cache.
@@ -391,14 +473,10 @@ mpool_look(mp, pgno)
 	head = &mp->hqh[HASHKEY(pgno)];
 	for (bp = head->cqh_first; bp != (void *)head; bp = bp->hq.cqe_next)
 		if (bp->pgno == pgno) {
-#ifdef STATISTICS
 			++mp->cachehit;
-#endif
 			return (bp);
 		}
-#ifdef STATISTICS
 	++mp->cachemiss;
-#endif
 	return (NULL);
 }
 
@@ -448,6 +448,9 @@ STATIC void check_notifications(const char *prompt)
 			mp_printf(&mp_plat_print,"\n[Message from thread \"%s\"] %s\n", th_name, msg_buf);
 			free(msg_buf);
 		}
+		else if (type == THREAD_MSG_TYPE_BUFFER) {
+			mp_printf(&mp_plat_print,"\n[Message from thread \"%s\"] <buffer, %u bytes>\n", th_name, msg_buflen);
+		}
 		//mp_hal_stdout_tx_str(prompt);
 	}
 }
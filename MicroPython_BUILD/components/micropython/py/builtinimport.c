@@ -144,7 +144,7 @@ STATIC void do_load_from_lexer(mp_obj_t module_obj, mp_lexer_t *lex) {
 }
 #endif
 
-#if MICROPY_PERSISTENT_CODE_LOAD || MICROPY_MODULE_FROZEN_MPY
+#if MICROPY_PERSISTENT_CODE_LOAD || MICROPY_MODULE_FROZEN_MPY || MICROPY_PERSISTENT_CODE_XIP
 STATIC void do_execute_raw_code(mp_obj_t module_obj, mp_raw_code_t *raw_code) {
     #if MICROPY_PY___FILE__
     // TODO
@@ -204,7 +204,7 @@ STATIC void do_load(mp_obj_t module_obj, vstr_t *file) {
 
     // If we support frozen mpy modules and we found a corresponding file (and
     // its data) in the list of frozen files, execute it.
-    #if MICROPY_MODULE_FROZEN_MPY
+    #if MICROPY_MODULE_FROZEN_MPY || MICROPY_PERSISTENT_CODE_XIP
     if (frozen_type == MP_FROZEN_MPY) {
         do_execute_raw_code(module_obj, modref);
         return;
@@ -30,6 +30,7 @@
 
 #include "py/lexer.h"
 #include "py/frozenmod.h"
+#include "py/persistentcode.h"
 
 #if MICROPY_MODULE_FROZEN_STR
 
@@ -132,6 +133,13 @@ mp_import_stat_t mp_frozen_stat(const char *str) {
     }
     #endif
 
+    #if MICROPY_PERSISTENT_CODE_XIP
+    stat = mp_raw_code_xip_stat(str);
+    if (stat != MP_IMPORT_STAT_NO_EXIST) {
+        return stat;
+    }
+    #endif
+
     return MP_IMPORT_STAT_NO_EXIST;
 }
 
@@ -150,6 +158,14 @@ int mp_find_frozen_module(const char *str, size_t len, void **data) {
         return MP_FROZEN_MPY;
     }
     #endif
+    #if MICROPY_PERSISTENT_CODE_XIP
+    // modules of a mounted image are executed like frozen mpy
+    mp_raw_code_t *xip_rc = mp_raw_code_xip_find(str, len);
+    if (xip_rc != NULL) {
+        *data = xip_rc;
+        return MP_FROZEN_MPY;
+    }
+    #endif
     return MP_FROZEN_NONE;
 }
 
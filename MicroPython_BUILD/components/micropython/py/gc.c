@@ -31,6 +31,7 @@
 #include "esp_log.h"
 #include "py/gc.h"
 #include "py/runtime.h"
+#include "py/mphal.h"
 
 #if MICROPY_ENABLE_GC
 
@@ -105,6 +106,86 @@
 #define GC_EXIT()
 #endif
 
+#define GC_TOTAL_BLOCKS() (MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB)
+
+#if MICROPY_GC_INCREMENTAL
+// In incremental mode the sweep is not done at the end of the collection,
+// it proceeds in time bounded steps from gc_alloc and gc_step instead.
+// Blocks allocated ahead of the sweep position are marked (allocated black)
+// so the pending sweep does not free them.
+#define GC_SWEEP_PENDING() (MP_STATE_MEM(gc_sweep_block) < GC_TOTAL_BLOCKS())
+// number of blocks swept between checks of the time budget
+#define GC_SWEEP_CHUNK (256)
+#else
+#define GC_SWEEP_PENDING() (0)
+#endif
+
+#if MICROPY_GC_SIZE_CLASSES
+// Segregated size-class index of free block runs.
+// Class k holds runs of 2^k..2^(k+1)-1 blocks, the last class holds all larger runs.
+// The index is rebuilt during sweep and updated on free, so an entry can only
+// become stale by a later allocation taking some of its blocks.  Entries are
+// therefore validated when they are used, and dropped if no longer free.
+
+STATIC inline size_t gc_sc_class(size_t n_blocks) {
+    size_t c = 0;
+    while (n_blocks >>= 1) {
+        c++;
+    }
+    return (c < MICROPY_GC_SIZE_CLASSES) ? c : MICROPY_GC_SIZE_CLASSES - 1;
+}
+
+STATIC void gc_sc_reset(void) {
+    memset(MP_STATE_MEM(gc_sc_count), 0, sizeof(MP_STATE_MEM(gc_sc_count)));
+}
+
+// Remember a free run of blocks; single blocks are handled by gc_last_free_atb_index
+STATIC void gc_sc_push(size_t start, size_t len) {
+    if (len < 2) {
+        return;
+    }
+    size_t c = gc_sc_class(len);
+    size_t n = MP_STATE_MEM(gc_sc_count)[c];
+    if (n < MICROPY_GC_SIZE_CLASS_DEPTH) {
+        MP_STATE_MEM(gc_sc_start)[c][n] = start;
+        MP_STATE_MEM(gc_sc_len)[c][n] = len;
+        MP_STATE_MEM(gc_sc_count)[c] = n + 1;
+    }
+}
+
+// Take n_blocks free blocks from the index, the unused rest of the run is put back
+STATIC bool gc_sc_pop(size_t n_blocks, size_t *start_block) {
+    for (size_t c = gc_sc_class(n_blocks); c < MICROPY_GC_SIZE_CLASSES; c++) {
+        for (size_t j = MP_STATE_MEM(gc_sc_count)[c]; j > 0; j--) {
+            size_t start = MP_STATE_MEM(gc_sc_start)[c][j - 1];
+            size_t len = MP_STATE_MEM(gc_sc_len)[c][j - 1];
+            if (len < n_blocks) {
+                // only possible in the first class searched
+                continue;
+            }
+            // remove the entry, replacing it with the last one in this class
+            size_t last = --MP_STATE_MEM(gc_sc_count)[c];
+            MP_STATE_MEM(gc_sc_start)[c][j - 1] = MP_STATE_MEM(gc_sc_start)[c][last];
+            MP_STATE_MEM(gc_sc_len)[c][j - 1] = MP_STATE_MEM(gc_sc_len)[c][last];
+
+            // validate the blocks we are going to use
+            size_t bl = start;
+            while (bl < start + n_blocks && ATB_GET_KIND(bl) == AT_FREE) {
+                bl++;
+            }
+            if (bl < start + n_blocks) {
+                // stale entry
+                continue;
+            }
+            gc_sc_push(start + n_blocks, len - n_blocks);
+            *start_block = start;
+            return true;
+        }
+    }
+    return false;
+}
+#endif
+
 // TODO waste less memory; currently requires that all entries in alloc_table have a corresponding block in pool
 void gc_init(void *start, void *end) {
     // align end pointer on block boundary
@@ -149,6 +230,23 @@ void gc_init(void *start, void *end) {
     // set last free ATB index to start of heap
     MP_STATE_MEM(gc_last_free_atb_index) = 0;
 
+    #if MICROPY_GC_SIZE_CLASSES
+    // the whole pool is one free run
+    gc_sc_reset();
+    gc_sc_push(0, gc_pool_block_len);
+    #endif
+
+    // no sweep pending
+    MP_STATE_MEM(gc_sweep_block) = gc_pool_block_len;
+    MP_STATE_MEM(gc_sweep_free_tail) = 0;
+
+    #if MICROPY_GC_INCREMENTAL
+    MP_STATE_MEM(gc_mode) = GC_MODE_FULL;
+    MP_STATE_MEM(gc_step_us) = MICROPY_GC_STEP_US;
+    MP_STATE_MEM(gc_pause_us) = 0;
+    MP_STATE_MEM(gc_pause_max_us) = 0;
+    #endif
+
     // unlock the GC
     MP_STATE_MEM(gc_lock_depth) = 0;
 
@@ -264,35 +362,75 @@ STATIC void gc_deal_with_stack_overflow(void) {
     }
 }
 
-STATIC void gc_sweep(void) {
+STATIC void gc_sweep_begin(void) {
     MP_STATE_MEM(gc_collected) = 0;
-    // free unmarked heads and their tails
-    int free_tail = 0;
-    for (size_t block = 0; block < MP_STATE_MEM(gc_alloc_table_byte_len) * BLOCKS_PER_ATB; block++) {
-        switch (ATB_GET_KIND(block)) {
-            case AT_HEAD:
+    MP_STATE_MEM(gc_sweep_block) = 0;
+    MP_STATE_MEM(gc_sweep_free_tail) = 0;
+    #if MICROPY_GC_SIZE_CLASSES
+    // rebuild the size-class index from the free runs found while sweeping
+    MP_STATE_MEM(gc_sc_run_start) = 0;
+    MP_STATE_MEM(gc_sc_run_len) = 0;
+    gc_sc_reset();
+    #endif
+}
+
 #if MICROPY_ENABLE_FINALISER
-                if (FTB_GET(block)) {
-                    mp_obj_base_t *obj = (mp_obj_base_t*)PTR_FROM_BLOCK(block);
-                    if (obj->type != NULL) {
-                        // if the object has a type then see if it has a __del__ method
-                        mp_obj_t dest[2];
-                        mp_load_method_maybe(MP_OBJ_FROM_PTR(obj), MP_QSTR___del__, dest);
-                        if (dest[0] != MP_OBJ_NULL) {
-                            // load_method returned a method, execute it in a protected environment
-                            #if MICROPY_ENABLE_SCHEDULER
-                            mp_sched_lock();
-                            #endif
-                            mp_call_function_1_protected(dest[0], dest[1]);
-                            #if MICROPY_ENABLE_SCHEDULER
-                            mp_sched_unlock();
-                            #endif
-                        }
-                    }
-                    // clear finaliser flag
-                    FTB_CLEAR(block);
+// Run the finalisers of all unreachable objects at the end of the mark phase,
+// before the sweep frees any block.  A finaliser can then still read the
+// objects only it referenced, also when the sweep is spread over many
+// incremental steps and freed blocks are reused before the sweep ends.
+// The GC must be locked.
+STATIC void gc_run_finalisers(void) {
+    byte *ftb = MP_STATE_MEM(gc_finaliser_table_start);
+    for (size_t i = 0; i < GC_TOTAL_BLOCKS() / BLOCKS_PER_FTB; i++) {
+        if (ftb[i] == 0) {
+            continue;
+        }
+        for (size_t block = i * BLOCKS_PER_FTB; block < (i + 1) * BLOCKS_PER_FTB; block++) {
+            if (!FTB_GET(block) || ATB_GET_KIND(block) != AT_HEAD) {
+                continue;
+            }
+            mp_obj_base_t *obj = (mp_obj_base_t*)PTR_FROM_BLOCK(block);
+            if (obj->type != NULL) {
+                // if the object has a type then see if it has a __del__ method
+                mp_obj_t dest[2];
+                mp_load_method_maybe(MP_OBJ_FROM_PTR(obj), MP_QSTR___del__, dest);
+                if (dest[0] != MP_OBJ_NULL) {
+                    // load_method returned a method, execute it in a protected environment
+                    #if MICROPY_ENABLE_SCHEDULER
+                    mp_sched_lock();
+                    #endif
+                    mp_call_function_1_protected(dest[0], dest[1]);
+                    #if MICROPY_ENABLE_SCHEDULER
+                    mp_sched_unlock();
+                    #endif
                 }
+            }
+            // clear finaliser flag
+            FTB_CLEAR(block);
+        }
+    }
+}
 #endif
+
+// Sweep at most n_blocks blocks from the current sweep position.
+// Returns true when the end of the pool has been reached.
+STATIC bool gc_sweep(size_t n_blocks) {
+    size_t block = MP_STATE_MEM(gc_sweep_block);
+    size_t end = GC_TOTAL_BLOCKS();
+    if (n_blocks < end - block) {
+        end = block + n_blocks;
+    }
+    #if MICROPY_GC_SIZE_CLASSES
+    size_t run_start = MP_STATE_MEM(gc_sc_run_start);
+    size_t run_len = MP_STATE_MEM(gc_sc_run_len);
+    #endif
+    // free unmarked heads and their tails
+    int free_tail = MP_STATE_MEM(gc_sweep_free_tail);
+    for (; block < end; block++) {
+        switch (ATB_GET_KIND(block)) {
+            case AT_HEAD:
+                // the finaliser, if any, was run by gc_run_finalisers
                 free_tail = 1;
                 DEBUG_printf("gc_sweep(%p)\n", (void*)PTR_FROM_BLOCK(block));
                 MP_STATE_MEM(gc_collected)++;
@@ -304,6 +442,18 @@ STATIC void gc_sweep(void) {
                     #if CLEAR_ON_SWEEP
                     memset((void*)PTR_FROM_BLOCK(block), 0, BYTES_PER_BLOCK);
                     #endif
+                    #if MICROPY_GC_INCREMENTAL
+                    // the allocator may already have moved past this block
+                    // (both are reset at the end of a full collection anyway)
+                    if (block / BLOCKS_PER_ATB < MP_STATE_MEM(gc_last_free_atb_index)) {
+                        MP_STATE_MEM(gc_last_free_atb_index) = block / BLOCKS_PER_ATB;
+                    }
+                    #if MICROPY_GC_ALLOC_THRESHOLD
+                    if (MP_STATE_MEM(gc_alloc_amount) > 0) {
+                        MP_STATE_MEM(gc_alloc_amount)--;
+                    }
+                    #endif
+                    #endif
                 }
                 break;
 
@@ -312,14 +462,108 @@ STATIC void gc_sweep(void) {
                 free_tail = 0;
                 break;
         }
+        #if MICROPY_GC_SIZE_CLASSES
+        if (ATB_GET_KIND(block) == AT_FREE) {
+            if (run_len++ == 0) {
+                run_start = block;
+            }
+        } else if (run_len > 0) {
+            gc_sc_push(run_start, run_len);
+            run_len = 0;
+        }
+        #endif
+    }
+    MP_STATE_MEM(gc_sweep_block) = block;
+    MP_STATE_MEM(gc_sweep_free_tail) = free_tail;
+    #if MICROPY_GC_SIZE_CLASSES
+    MP_STATE_MEM(gc_sc_run_start) = run_start;
+    MP_STATE_MEM(gc_sc_run_len) = run_len;
+    #endif
+    if (block < GC_TOTAL_BLOCKS()) {
+        return false;
+    }
+    #if MICROPY_GC_SIZE_CLASSES
+    gc_sc_push(run_start, run_len);
+    #endif
+    return true;
+}
+
+#if MICROPY_GC_INCREMENTAL
+STATIC void gc_record_pause(uint32_t us) {
+    MP_STATE_MEM(gc_pause_us) = us;
+    if (us > MP_STATE_MEM(gc_pause_max_us)) {
+        MP_STATE_MEM(gc_pause_max_us) = us;
+    }
+}
+
+// Blocks start_block..end_block (inclusive) were just taken from free blocks.
+// If they straddle the sweep position the head has already been passed, but the
+// next sweep step would resume with the free_tail state of the blocks before it
+// and free the new tail blocks.  Move the sweep past them instead.
+STATIC void gc_sweep_skip(size_t start_block, size_t end_block) {
+    if (start_block < MP_STATE_MEM(gc_sweep_block) && end_block >= MP_STATE_MEM(gc_sweep_block)) {
+        MP_STATE_MEM(gc_sweep_block) = end_block + 1;
+        MP_STATE_MEM(gc_sweep_free_tail) = 0;
+        #if MICROPY_GC_SIZE_CLASSES
+        // the free run being collected now ends in allocated blocks
+        MP_STATE_MEM(gc_sc_run_len) = 0;
+        #endif
+    }
+}
+
+// Continue the pending sweep for at most gc_step_us microseconds,
+// or to the end if finish is true.  The GC must be entered.
+STATIC void gc_sweep_step(bool finish) {
+    uint64_t t_start = mp_hal_ticks_us();
+    uint32_t t_elapsed;
+    // nothing may allocate while the sweep state is updated
+    MP_STATE_MEM(gc_lock_depth)++;
+    do {
+        if (gc_sweep(finish ? (size_t)-1 : GC_SWEEP_CHUNK)) {
+            break;
+        }
+        t_elapsed = mp_hal_ticks_us() - t_start;
+    } while (t_elapsed < MP_STATE_MEM(gc_step_us));
+    MP_STATE_MEM(gc_lock_depth)--;
+    gc_record_pause(mp_hal_ticks_us() - t_start);
+}
+
+void gc_step(void) {
+    GC_ENTER();
+    if (GC_SWEEP_PENDING() && MP_STATE_MEM(gc_lock_depth) == 0) {
+        gc_sweep_step(false);
+    }
+    GC_EXIT();
+}
+
+void gc_set_mode(int mode) {
+    GC_ENTER();
+    if (mode == GC_MODE_FULL && GC_SWEEP_PENDING() && MP_STATE_MEM(gc_lock_depth) == 0) {
+        gc_sweep_step(true);
     }
+    MP_STATE_MEM(gc_mode) = mode;
+    GC_EXIT();
 }
+#endif
 
 void gc_collect_start(void) {
     GC_ENTER();
+    #if MICROPY_GC_INCREMENTAL
+    MP_STATE_MEM(gc_pause_start) = mp_hal_ticks_us();
+    // the mark phase needs the marks of the previous collection to be swept
+    if (GC_SWEEP_PENDING()) {
+        MP_STATE_MEM(gc_lock_depth)++;
+        gc_sweep((size_t)-1);
+        MP_STATE_MEM(gc_lock_depth)--;
+    }
+    #endif
 	MP_STATE_MEM(gc_marked) = 0;
     MP_STATE_MEM(gc_lock_depth)++;
     #if MICROPY_GC_ALLOC_THRESHOLD
+    #if MICROPY_GC_INCREMENTAL
+    // in incremental mode the amount is kept up to date by the sweep
+    if (MP_STATE_MEM(gc_mode) == GC_MODE_FULL)
+    #endif
     MP_STATE_MEM(gc_alloc_amount) = 0;
     #endif
     MP_STATE_MEM(gc_stack_overflow) = 0;
@@ -372,6 +616,8 @@ static void _gc_info(gc_info_t *info) {
                 break;
 
             case AT_HEAD:
+            case AT_MARK:
+                // marked heads exist while an incremental sweep is pending
                 info->used += 1;
                 len = 1;
                 break;
@@ -380,10 +626,6 @@ static void _gc_info(gc_info_t *info) {
                 info->used += 1;
                 len += 1;
                 break;
-
-            case AT_MARK:
-                // shouldn't happen
-                break;
         }
 
         block++;
@@ -393,7 +635,7 @@ static void _gc_info(gc_info_t *info) {
             kind = ATB_GET_KIND(block);
         }
 
-        if (finish || kind == AT_FREE || kind == AT_HEAD) {
+        if (finish || kind == AT_FREE || kind == AT_HEAD || kind == AT_MARK) {
             if (len == 1) {
                 info->num_1block += 1;
             } else if (len == 2) {
@@ -402,7 +644,7 @@ static void _gc_info(gc_info_t *info) {
             if (len > info->max_block) {
                 info->max_block = len;
             }
-            if (finish || kind == AT_HEAD) {
+            if (finish || kind == AT_HEAD || kind == AT_MARK) {
                 if (len_free > info->max_free) {
                     info->max_free = len_free;
                 }
@@ -417,7 +659,24 @@ static void _gc_info(gc_info_t *info) {
 
 void gc_collect_end(void) {
     gc_deal_with_stack_overflow();
-    gc_sweep();
+    #if MICROPY_ENABLE_FINALISER
+    gc_run_finalisers();
+    #endif
+    gc_sweep_begin();
+    #if MICROPY_QSTR_HASH_INDEX
+    qstr_gc_collected();
+    #endif
+    #if MICROPY_GC_INCREMENTAL
+    if (MP_STATE_MEM(gc_mode) == GC_MODE_INCREMENTAL) {
+        // leave the sweep to gc_step and gc_alloc
+        MP_STATE_MEM(gc_last_free_atb_index) = 0;
+        MP_STATE_MEM(gc_lock_depth)--;
+        gc_record_pause(mp_hal_ticks_us() - MP_STATE_MEM(gc_pause_start));
+        GC_EXIT();
+        return;
+    }
+    #endif
+    gc_sweep((size_t)-1);
     MP_STATE_MEM(gc_last_free_atb_index) = 0;
     MP_STATE_MEM(gc_lock_depth)--;
 
@@ -430,6 +689,9 @@ void gc_collect_end(void) {
 	}
 	#endif
 
+    #if MICROPY_GC_INCREMENTAL
+    gc_record_pause(mp_hal_ticks_us() - MP_STATE_MEM(gc_pause_start));
+    #endif
 	GC_EXIT();
 }
 
@@ -462,8 +724,15 @@ void *gc_alloc(size_t n_bytes, bool has_finaliser) {
     size_t n_free = 0;
     int collected = !MP_STATE_MEM(gc_auto_collect_enabled);
 
+    #if MICROPY_GC_INCREMENTAL
+    if (GC_SWEEP_PENDING()) {
+        // continue the pending sweep
+        gc_sweep_step(false);
+    }
+    #endif
+
     #if MICROPY_GC_ALLOC_THRESHOLD
-    if (!collected && MP_STATE_MEM(gc_alloc_amount) >= MP_STATE_MEM(gc_alloc_threshold)) {
+    if (!collected && MP_STATE_MEM(gc_alloc_amount) >= MP_STATE_MEM(gc_alloc_threshold) && !GC_SWEEP_PENDING()) {
     	if (MP_STATE_MEM(gc_auto_collect_debug)) {
     		printf("gc_alloc: gc_collect trigered [%d >= %d]\n", MP_STATE_MEM(gc_alloc_amount)*BYTES_PER_BLOCK, MP_STATE_MEM(gc_alloc_threshold)*BYTES_PER_BLOCK);
     	}
@@ -475,6 +744,15 @@ void *gc_alloc(size_t n_bytes, bool has_finaliser) {
 
     for (;;) {
 
+        #if MICROPY_GC_SIZE_CLASSES
+        // try the size-class index first
+        if (n_blocks > 1 && gc_sc_pop(n_blocks, &start_block)) {
+            i = start_block + n_blocks - 1;
+            n_free = n_blocks;
+            goto found;
+        }
+        #endif
+
         // look for a run of n_blocks available blocks
         for (i = MP_STATE_MEM(gc_last_free_atb_index); i < MP_STATE_MEM(gc_alloc_table_byte_len); i++) {
             byte a = MP_STATE_MEM(gc_alloc_table_start)[i];
@@ -484,6 +762,15 @@ void *gc_alloc(size_t n_bytes, bool has_finaliser) {
             if (ATB_3_IS_FREE(a)) { if (++n_free >= n_blocks) { i = i * BLOCKS_PER_ATB + 3; goto found; } } else { n_free = 0; }
         }
 
+        #if MICROPY_GC_INCREMENTAL
+        if (GC_SWEEP_PENDING()) {
+            // finish the pending sweep before resorting to a new collection
+            gc_sweep_step(true);
+            n_free = 0;
+            continue;
+        }
+        #endif
+
         GC_EXIT();
         // nothing found!
         if (collected) {
@@ -522,6 +809,17 @@ found:
         ATB_FREE_TO_TAIL(bl);
     }
 
+    #if MICROPY_GC_INCREMENTAL
+    if (GC_SWEEP_PENDING()) {
+        if (start_block >= MP_STATE_MEM(gc_sweep_block)) {
+            // allocated ahead of the pending sweep, mark it so it is not freed
+            ATB_HEAD_TO_MARK(start_block);
+        } else {
+            gc_sweep_skip(start_block, end_block);
+        }
+    }
+    #endif
+
     // get pointer to first block
     // we must create this pointer before unlocking the GC so a collection can find it
     void *ret_ptr = (void*)(MP_STATE_MEM(gc_pool_start) + start_block * BYTES_PER_BLOCK);
@@ -593,7 +891,7 @@ void gc_free(void *ptr) {
         // get the GC block number corresponding to this pointer
         assert(VERIFY_PTR(ptr));
         size_t block = BLOCK_FROM_PTR(ptr);
-        assert(ATB_GET_KIND(block) == AT_HEAD);
+        assert(ATB_GET_KIND(block) == AT_HEAD || ATB_GET_KIND(block) == AT_MARK);
 
         #if MICROPY_ENABLE_FINALISER
         FTB_CLEAR(block);
@@ -612,6 +910,10 @@ void gc_free(void *ptr) {
             n_blocks++;
         } while (ATB_GET_KIND(block) == AT_TAIL);
 
+        #if MICROPY_GC_SIZE_CLASSES
+        gc_sc_push(block - n_blocks, n_blocks);
+        #endif
+
 		#if MICROPY_GC_ALLOC_THRESHOLD
 		MP_STATE_MEM(gc_alloc_amount) -= n_blocks;
 		#endif
@@ -627,7 +929,7 @@ size_t gc_nbytes(const void *ptr) {
     GC_ENTER();
     if (VERIFY_PTR(ptr)) {
         size_t block = BLOCK_FROM_PTR(ptr);
-        if (ATB_GET_KIND(block) == AT_HEAD) {
+        if (ATB_GET_KIND(block) == AT_HEAD || ATB_GET_KIND(block) == AT_MARK) {
             // work out number of consecutive blocks in the chain starting with this on
             size_t n_blocks = 0;
             do {
@@ -696,7 +998,7 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
     // get the GC block number corresponding to this pointer
     assert(VERIFY_PTR(ptr));
     size_t block = BLOCK_FROM_PTR(ptr);
-    assert(ATB_GET_KIND(block) == AT_HEAD);
+    assert(ATB_GET_KIND(block) == AT_HEAD || ATB_GET_KIND(block) == AT_MARK);
 
     // compute number of new blocks that are requested
     size_t new_blocks = (n_bytes + BYTES_PER_BLOCK - 1) / BYTES_PER_BLOCK;
@@ -747,6 +1049,10 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
             MP_STATE_MEM(gc_last_free_atb_index) = (block + new_blocks) / BLOCKS_PER_ATB;
         }
 
+        #if MICROPY_GC_SIZE_CLASSES
+        gc_sc_push(block + new_blocks, n_freed);
+        #endif
+
 		#if MICROPY_GC_ALLOC_THRESHOLD
 		MP_STATE_MEM(gc_alloc_amount) -= n_freed;
 		#endif
@@ -769,6 +1075,12 @@ void *gc_realloc(void *ptr_in, size_t n_bytes, bool allow_move) {
             n_added++;
         }
 
+        #if MICROPY_GC_INCREMENTAL
+        if (GC_SWEEP_PENDING()) {
+            gc_sweep_skip(block, block + new_blocks - 1);
+        }
+        #endif
+
 		#if MICROPY_GC_ALLOC_THRESHOLD
 		MP_STATE_MEM(gc_alloc_amount) += n_added;
 		#endif
@@ -45,6 +45,15 @@ void gc_collect_start(void);
 void gc_collect_root(void **ptrs, size_t len);
 void gc_collect_end(void);
 
+#define GC_MODE_FULL        (0)
+#define GC_MODE_INCREMENTAL (1)
+
+#if MICROPY_GC_INCREMENTAL
+// Do a time bounded step of the pending incremental GC work (called when idle)
+void gc_step(void);
+void gc_set_mode(int mode);
+#endif
+
 void *gc_alloc(size_t n_bytes, bool has_finaliser);
 void gc_free(void *ptr); // does not call finaliser
 size_t gc_nbytes(const void *ptr);
@@ -28,6 +28,7 @@
 #include "py/mpstate.h"
 #include "py/obj.h"
 #include "py/gc.h"
+#include "py/runtime.h"
 
 #if MICROPY_PY_GC && MICROPY_ENABLE_GC
 
@@ -125,6 +126,46 @@ STATIC mp_obj_t gc_threshold(size_t n_args, const mp_obj_t *args) {
 MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(gc_threshold_obj, 0, 2, gc_threshold);
 #endif
 
+#if MICROPY_GC_INCREMENTAL
+// mode([mode]): get or set the collection mode, gc.FULL or gc.INCREMENTAL
+STATIC mp_obj_t gc_mode(size_t n_args, const mp_obj_t *args) {
+    if (n_args > 0) {
+        mp_int_t mode = mp_obj_get_int(args[0]);
+        if ((mode != GC_MODE_FULL) && (mode != GC_MODE_INCREMENTAL)) {
+            mp_raise_ValueError("invalid gc mode");
+        }
+        gc_set_mode(mode);
+    }
+    return MP_OBJ_NEW_SMALL_INT(MP_STATE_MEM(gc_mode));
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(gc_mode_obj, 0, 1, gc_mode);
+
+// step_us([us]): get or set the time budget of one incremental step
+STATIC mp_obj_t gc_step_us(size_t n_args, const mp_obj_t *args) {
+    if (n_args > 0) {
+        mp_int_t us = mp_obj_get_int(args[0]);
+        if (us < 10) {
+            mp_raise_ValueError("step must be at least 10 us");
+        }
+        MP_STATE_MEM(gc_step_us) = us;
+    }
+    return mp_obj_new_int(MP_STATE_MEM(gc_step_us));
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(gc_step_us_obj, 0, 1, gc_step_us);
+
+// pause_us([reset]): return the last and the maximal GC pause in microseconds
+STATIC mp_obj_t gc_pause_us(size_t n_args, const mp_obj_t *args) {
+    mp_obj_t tuple[2];
+    tuple[0] = mp_obj_new_int(MP_STATE_MEM(gc_pause_us));
+    tuple[1] = mp_obj_new_int(MP_STATE_MEM(gc_pause_max_us));
+    if ((n_args > 0) && mp_obj_is_true(args[0])) {
+        MP_STATE_MEM(gc_pause_max_us) = 0;
+    }
+    return mp_obj_new_tuple(2, tuple);
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(gc_pause_us_obj, 0, 1, gc_pause_us);
+#endif
+
 STATIC const mp_rom_map_elem_t mp_module_gc_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__),	MP_ROM_QSTR(MP_QSTR_gc) },
     { MP_ROM_QSTR(MP_QSTR_collect),		MP_ROM_PTR(&gc_collect_obj) },
@@ -137,6 +178,13 @@ STATIC const mp_rom_map_elem_t mp_module_gc_globals_table[] = {
     #if MICROPY_GC_ALLOC_THRESHOLD
     { MP_ROM_QSTR(MP_QSTR_threshold),	MP_ROM_PTR(&gc_threshold_obj) },
     #endif
+    #if MICROPY_GC_INCREMENTAL
+    { MP_ROM_QSTR(MP_QSTR_mode),		MP_ROM_PTR(&gc_mode_obj) },
+    { MP_ROM_QSTR(MP_QSTR_step_us),		MP_ROM_PTR(&gc_step_us_obj) },
+    { MP_ROM_QSTR(MP_QSTR_pause_us),	MP_ROM_PTR(&gc_pause_us_obj) },
+    { MP_ROM_QSTR(MP_QSTR_FULL),		MP_ROM_INT(GC_MODE_FULL) },
+    { MP_ROM_QSTR(MP_QSTR_INCREMENTAL),	MP_ROM_INT(GC_MODE_INCREMENTAL) },
+    #endif
 };
 
 STATIC MP_DEFINE_CONST_DICT(mp_module_gc_globals, mp_module_gc_globals_table);
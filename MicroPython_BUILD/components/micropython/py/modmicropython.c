@@ -156,6 +156,29 @@ STATIC mp_obj_t mp_micropython_schedule(mp_obj_t function, mp_obj_t arg) {
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(mp_micropython_schedule_obj, mp_micropython_schedule);
+
+#if MICROPY_SCHEDULER_STATS
+// Return a tuple indexed by callback source of
+// (queued, dropped, run, average latency us, max latency us)
+STATIC mp_obj_t mp_micropython_schedule_stats(size_t n_args, const mp_obj_t *args) {
+    bool reset = (n_args > 0) && mp_obj_is_true(args[0]);
+    mp_obj_t items[MP_SCHED_SRC_MAX];
+    for (int src = 0; src < MP_SCHED_SRC_MAX; src++) {
+        mp_sched_stats_t st;
+        mp_sched_get_stats(src, &st, reset);
+        mp_obj_t tuple[5] = {
+            mp_obj_new_int_from_uint(st.queued),
+            mp_obj_new_int_from_uint(st.dropped),
+            mp_obj_new_int_from_uint(st.run),
+            mp_obj_new_int_from_uint(st.run ? (uint32_t)(st.sum_latency / st.run) : 0),
+            mp_obj_new_int_from_uint(st.max_latency),
+        };
+        items[src] = mp_obj_new_tuple(5, tuple);
+    }
+    return mp_obj_new_tuple(MP_SCHED_SRC_MAX, items);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_micropython_schedule_stats_obj, 0, 1, mp_micropython_schedule_stats);
+#endif
 #endif
 
 STATIC const mp_rom_map_elem_t mp_module_micropython_globals_table[] = {
@@ -191,6 +214,9 @@ STATIC const mp_rom_map_elem_t mp_module_micropython_globals_table[] = {
     #endif
     #if MICROPY_ENABLE_SCHEDULER
     { MP_ROM_QSTR(MP_QSTR_schedule), MP_ROM_PTR(&mp_micropython_schedule_obj) },
+    #if MICROPY_SCHEDULER_STATS
+    { MP_ROM_QSTR(MP_QSTR_schedule_stats), MP_ROM_PTR(&mp_micropython_schedule_stats_obj) },
+    #endif
     #endif
 };
 
@@ -341,6 +341,7 @@ STATIC mp_obj_t mod_thread_sendmsg(size_t n_args, const mp_obj_t *pos_args, mp_m
     const mp_arg_t allowed_args[] = {
        { MP_QSTR_ThreadID, MP_ARG_REQUIRED | MP_ARG_OBJ, { .u_obj = mp_const_none } },
        { MP_QSTR_Message,  MP_ARG_REQUIRED | MP_ARG_OBJ, { .u_obj = mp_const_none } },
+       { MP_QSTR_Length,   MP_ARG_INT, { .u_int = -1 } },
     };
     mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
     mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
@@ -365,6 +366,23 @@ STATIC mp_obj_t mod_thread_sendmsg(size_t n_args, const mp_obj_t *pos_args, mp_m
 	else if (MP_OBJ_IS_INT(args[1].u_obj)) {
     	msg_int = mp_obj_get_int(args[1].u_obj);
     }
+	else if (MP_OBJ_IS_TYPE(args[1].u_obj, &mp_type_memoryview)) {
+		// buffer obtained with msgbuf(), passed by reference
+		// it can be sent only once, to the thread it was obtained for,
+		// after sending, the sender's view is emptied
+		// its first 'Length' bytes are sent, all of them by default
+		mp_buffer_info_t bufinfo;
+		mp_get_buffer_raise(args[1].u_obj, &bufinfo, MP_BUFFER_READ);
+		msglen = (args[2].u_int < 0) ? bufinfo.len : args[2].u_int;
+		if ((msglen == 0) || (msglen > bufinfo.len)) {
+			mp_raise_ValueError("invalid length");
+		}
+		int res = mp_thread_sendbuf((void *)thr_id, args[1].u_obj, msglen);
+		if (res < 0) {
+			mp_raise_ValueError("not a buffer from msgbuf() for this thread");
+		}
+		return MP_OBJ_NEW_SMALL_INT(res);
+	}
 	else return mp_const_false;
 
 	int res = mp_thread_semdmsg((void *)thr_id, type, msg_int, (uint8_t *)msg, msglen);
@@ -400,11 +418,29 @@ STATIC mp_obj_t mod_thread_getmsg()
 		}
 		else tuple[2] = mp_const_none;
 	}
+	else if (res == THREAD_MSG_TYPE_BUFFER) {
+		// the buffer is owned by this thread until the next getmsg() call,
+		// then the view is emptied
+		tuple[2] = mp_thread_msgbuf_view(buf, buflen);
+	}
 
     return mp_obj_new_tuple(3, tuple);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(mod_thread_getmsg_obj, mod_thread_getmsg);
 
+// Returns the writable memoryview of the free message buffer owned by the destination thread
+// After filling it, the buffer is sent with sendmsg(id, buf, length) without copying
+// The view can't be sliced, only the returned view itself can be sent
+// Only one unsent buffer per destination is kept, calling msgbuf() again returns the same buffer
+//------------------------------------------------
+STATIC mp_obj_t mod_thread_msgbuf(mp_obj_t in_id)
+{
+	uintptr_t thr_id = mp_obj_get_int(in_id);
+
+	return mp_thread_msgbuf((void *)thr_id);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_thread_msgbuf_obj, mod_thread_msgbuf);
+
 //--------------------------------------------------
 STATIC mp_obj_t mod_thread_getname(mp_obj_t in_id) {
 	uintptr_t thr_id = mp_obj_get_int(in_id);
@@ -619,6 +655,7 @@ STATIC const mp_rom_map_elem_t mp_module_thread_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_mainAcceptMsg),		MP_ROM_PTR(&mod_thread_mainAcceptMsg_obj) },
     { MP_ROM_QSTR(MP_QSTR_sendmsg),				MP_ROM_PTR(&mod_thread_sendmsg_obj) },
     { MP_ROM_QSTR(MP_QSTR_getmsg),				MP_ROM_PTR(&mod_thread_getmsg_obj) },
+    { MP_ROM_QSTR(MP_QSTR_msgbuf),				MP_ROM_PTR(&mod_thread_msgbuf_obj) },
     { MP_ROM_QSTR(MP_QSTR_list),				MP_ROM_PTR(&mod_thread_list_obj) },
     { MP_ROM_QSTR(MP_QSTR_getThreadName),		MP_ROM_PTR(&mod_thread_getname_obj) },
     { MP_ROM_QSTR(MP_QSTR_getSelfName),			MP_ROM_PTR(&mod_thread_getSelfname_obj) },
@@ -122,6 +122,30 @@
 #define MICROPY_GC_ALLOC_THRESHOLD (1)
 #endif
 
+// Number of segregated size classes used to index free runs of GC blocks
+// (0 disables).  Class k holds runs of 2^k..2^(k+1)-1 blocks, the last class
+// holds all larger runs.  The index is rebuilt on every sweep and lets
+// multi-block allocations avoid a linear scan of the allocation table.
+#ifndef MICROPY_GC_SIZE_CLASSES
+#define MICROPY_GC_SIZE_CLASSES (0)
+#endif
+
+// Support incremental GC: the mark phase is still done at once, but the
+// sweep is done in time bounded steps, selectable at runtime by gc.mode()
+#ifndef MICROPY_GC_INCREMENTAL
+#define MICROPY_GC_INCREMENTAL (0)
+#endif
+
+// Default time budget of one incremental GC step in microseconds
+#ifndef MICROPY_GC_STEP_US
+#define MICROPY_GC_STEP_US (500)
+#endif
+
+// Maximum number of free runs remembered per size class
+#ifndef MICROPY_GC_SIZE_CLASS_DEPTH
+#define MICROPY_GC_SIZE_CLASS_DEPTH (16)
+#endif
+
 // Number of bytes to allocate initially when creating new chunks to store
 // interned string data.  Smaller numbers lead to more chunks being needed
 // and more wastage at the end of the chunk.  Larger numbers lead to wasted
@@ -210,6 +234,19 @@
 #define MICROPY_QSTR_BYTES_IN_HASH (2)
 #endif
 
+// Whether to keep an open-addressing hash index of the interned strings,
+// so qstr_find_strn does not have to scan every qstr pool
+#ifndef MICROPY_QSTR_HASH_INDEX
+#define MICROPY_QSTR_HASH_INDEX (0)
+#endif
+
+// Whether the qstr hash index also covers the ROM (const and frozen) pools.
+// This costs 2 words of heap per ROM qstr, otherwise the ROM pools are
+// still searched linearly when a string is not found in the index.
+#ifndef MICROPY_QSTR_HASH_INDEX_ROM
+#define MICROPY_QSTR_HASH_INDEX_ROM (0)
+#endif
+
 // Avoid using C stack when making Python function calls. C stack still
 // may be used if there's no free heap.
 #ifndef MICROPY_STACKLESS
@@ -246,6 +283,13 @@
 #define MICROPY_PERSISTENT_CODE_SAVE (0)
 #endif
 
+// Whether to support execute-in-place images of precompiled modules, as
+// written by tools/mpy-tool.py --xip; the bytecode is run directly from the
+// (memory mapped) image. Requires MICROPY_PERSISTENT_CODE_LOAD
+#ifndef MICROPY_PERSISTENT_CODE_XIP
+#define MICROPY_PERSISTENT_CODE_XIP (0)
+#endif
+
 // Whether generated code can persist independently of the VM/runtime instance
 // This is enabled automatically when needed by other features
 #ifndef MICROPY_PERSISTENT_CODE
@@ -396,6 +440,20 @@
 #define MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE (0)
 #endif
 
+// Whether to cache the result of LOAD_METHOD per instruction and type of the
+// object, so repeated method calls on objects of the same type skip the lookup
+// in the locals dict of the type (and its bases).  The cache is a side table
+// indexed by the bytecode address, so the bytecode format is not changed.
+// Uses 4 words of RAM for each cache entry: the address, type, name and method.
+#ifndef MICROPY_OPT_CACHE_LOAD_METHOD
+#define MICROPY_OPT_CACHE_LOAD_METHOD (0)
+#endif
+
+// Number of entries in the LOAD_METHOD cache, must be a power of 2
+#ifndef MICROPY_OPT_LOAD_METHOD_CACHE_SIZE
+#define MICROPY_OPT_LOAD_METHOD_CACHE_SIZE (64)
+#endif
+
 // Whether to use fast versions of bitwise operations (and, or, xor) when the
 // arguments are both positive.  Increases Thumb2 code size by about 250 bytes.
 #ifndef MICROPY_OPT_MPZ_BITWISE
@@ -639,7 +697,7 @@ typedef double mp_float_t;
 
 // Convenience macro for whether frozen modules are supported
 #ifndef MICROPY_MODULE_FROZEN
-#define MICROPY_MODULE_FROZEN (MICROPY_MODULE_FROZEN_STR || MICROPY_MODULE_FROZEN_MPY)
+#define MICROPY_MODULE_FROZEN (MICROPY_MODULE_FROZEN_STR || MICROPY_MODULE_FROZEN_MPY || MICROPY_PERSISTENT_CODE_XIP)
 #endif
 
 // Whether you can override builtins in the builtins module
@@ -671,11 +729,42 @@ typedef double mp_float_t;
 #define MICROPY_ENABLE_SCHEDULER (0)
 #endif
 
-// Maximum number of entries in the scheduler
+// Maximum number of entries in the scheduler, per priority level
 #ifndef MICROPY_SCHEDULER_DEPTH
 #define MICROPY_SCHEDULER_DEPTH (4)
 #endif
 
+// Number of C-argument trees and entries preallocated for scheduled callbacks;
+// when a pool runs out the argument is allocated from the C heap instead
+#ifndef MICROPY_SCHEDULER_CARG_POOL
+#define MICROPY_SCHEDULER_CARG_POOL (MICROPY_SCHEDULER_DEPTH * 2)
+#endif
+#ifndef MICROPY_SCHEDULER_ENTRY_POOL
+#define MICROPY_SCHEDULER_ENTRY_POOL (MICROPY_SCHEDULER_DEPTH * 6)
+#endif
+
+// String/bytes values up to this size are stored in the C-argument entry itself
+#ifndef MICROPY_SCHEDULER_CARG_INLINE
+#define MICROPY_SCHEDULER_CARG_INLINE (32)
+#endif
+
+// Whether to count scheduled, dropped callbacks and their latency per source
+#ifndef MICROPY_SCHEDULER_STATS
+#define MICROPY_SCHEDULER_STATS (0)
+#endif
+
+// Time stamp in microseconds for the scheduler statistics; it is taken when a
+// callback is queued, so it must be callable from an ISR
+#ifndef MICROPY_SCHEDULER_TICKS_US
+#define MICROPY_SCHEDULER_TICKS_US() mp_hal_ticks_us()
+#endif
+
+// Lock protecting the free lists of the scheduler pools
+#ifndef MICROPY_SCHEDULER_POOL_ENTER
+#define MICROPY_SCHEDULER_POOL_ENTER() MICROPY_BEGIN_ATOMIC_SECTION()
+#define MICROPY_SCHEDULER_POOL_EXIT(state) MICROPY_END_ATOMIC_SECTION(state)
+#endif
+
 // Support for generic VFS sub-system
 #ifndef MICROPY_VFS
 #define MICROPY_VFS (0)
@@ -762,6 +851,13 @@ typedef double mp_float_t;
 #define MICROPY_PY_BUILTINS_MEMORYVIEW (0)
 #endif
 
+// Hook called with the buffer address when a memoryview is sliced, or created
+// from another buffer object; the port can raise to refuse views of buffers
+// whose owner changes (e.g. the esp32 thread message buffers)
+#ifndef MICROPY_MEMORYVIEW_DERIVE_HOOK
+#define MICROPY_MEMORYVIEW_DERIVE_HOOK(buf)
+#endif
+
 // Whether to support set object
 #ifndef MICROPY_PY_BUILTINS_SET
 #define MICROPY_PY_BUILTINS_SET (1)
@@ -1069,6 +1165,18 @@ typedef double mp_float_t;
 #define MICROPY_PY_USELECT (0)
 #endif
 
+// Whether uselect.poll objects sleep until the registered streams signal
+// readiness (MP_STREAM_POLL_NOTIFY), instead of polling all of them on each
+// pass.  The port must provide the mp_hal_poll_* functions.
+#ifndef MICROPY_PY_USELECT_NOTIFY
+#define MICROPY_PY_USELECT_NOTIFY (0)
+#endif
+
+// Max time in ms uselect.poll sleeps between handling pending events
+#ifndef MICROPY_PY_USELECT_NOTIFY_SLICE_MS
+#define MICROPY_PY_USELECT_NOTIFY_SLICE_MS (10)
+#endif
+
 // Whether to provide "utime" module functions implementation
 // in terms of mp_hal_* functions.
 #ifndef MICROPY_PY_UTIME_MP_HAL
@@ -1112,6 +1220,15 @@ typedef double mp_float_t;
 #define MICROPY_PY_UZLIB (0)
 #endif
 
+// Defaults for uzlib.compress() and uzlib.CompIO; the encoder needs about
+// 8 * 2^wbits bytes of heap (window, hash chains and block symbols)
+#ifndef MICROPY_PY_UZLIB_DEFAULT_WBITS
+#define MICROPY_PY_UZLIB_DEFAULT_WBITS (12)
+#endif
+#ifndef MICROPY_PY_UZLIB_DEFAULT_LEVEL
+#define MICROPY_PY_UZLIB_DEFAULT_LEVEL (6)
+#endif
+
 #ifndef MICROPY_PY_UJSON
 #define MICROPY_PY_UJSON (0)
 #endif
@@ -1129,6 +1246,11 @@ typedef double mp_float_t;
 #define MICROPY_PY_UTIMEQ (0)
 #endif
 
+// Event loop core of uasyncio implemented in C (_uasyncio module), requires utimeq and uselect
+#ifndef MICROPY_PY_UASYNCIO
+#define MICROPY_PY_UASYNCIO (0)
+#endif
+
 #ifndef MICROPY_PY_UHASHLIB
 #define MICROPY_PY_UHASHLIB (0)
 #endif
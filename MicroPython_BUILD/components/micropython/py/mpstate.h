@@ -56,10 +56,19 @@ extern mp_dynamic_compiler_t mp_dynamic_compiler;
 #define MP_SCHED_LOCKED (-1)
 #define MP_SCHED_PENDING (0) // 0 so it's a quick check in the VM
 
+// Scheduler priority levels, higher priority items are run first
+#define MP_SCHED_PRIO_HIGH (0)
+#define MP_SCHED_PRIO_NORMAL (1)
+#define MP_SCHED_NUM_PRIO (2)
+
 typedef struct _mp_sched_item_t {
     mp_obj_t func;
     mp_obj_t arg;
     void     *carg;
+    #if MICROPY_SCHEDULER_STATS
+    uint32_t queued_us;
+    uint8_t  src;
+    #endif
 } mp_sched_item_t;
 
 // This structure hold information about the memory allocation system.
@@ -95,6 +104,28 @@ typedef struct _mp_state_mem_t {
 
     size_t gc_last_free_atb_index;
 
+    // sweep position and state, the sweep is pending while gc_sweep_block
+    // is below the number of blocks in the pool
+    size_t gc_sweep_block;
+    int gc_sweep_free_tail;
+
+    #if MICROPY_GC_INCREMENTAL
+    uint16_t gc_mode;
+    uint32_t gc_step_us;
+    uint32_t gc_pause_us;
+    uint32_t gc_pause_max_us;
+    uint64_t gc_pause_start;
+    #endif
+
+    #if MICROPY_GC_SIZE_CLASSES
+    // Free runs of blocks, indexed by size class (see gc_sc_* in gc.c)
+    size_t gc_sc_start[MICROPY_GC_SIZE_CLASSES][MICROPY_GC_SIZE_CLASS_DEPTH];
+    size_t gc_sc_len[MICROPY_GC_SIZE_CLASSES][MICROPY_GC_SIZE_CLASS_DEPTH];
+    uint16_t gc_sc_count[MICROPY_GC_SIZE_CLASSES];
+    size_t gc_sc_run_start;
+    size_t gc_sc_run_len;
+    #endif
+
     size_t gc_collected;
     size_t gc_marked;
 
@@ -104,6 +135,15 @@ typedef struct _mp_state_mem_t {
     #endif
 } mp_state_mem_t;
 
+#if MICROPY_OPT_CACHE_LOAD_METHOD
+typedef struct _mp_load_method_cache_t {
+    const byte *ip;
+    const mp_obj_type_t *type;
+    qstr attr;
+    mp_obj_t meth;
+} mp_load_method_cache_t;
+#endif
+
 // This structure hold runtime and VM information.  It includes a section
 // which contains root pointers that must be scanned by the GC.
 typedef struct _mp_state_vm_t {
@@ -142,7 +182,8 @@ typedef struct _mp_state_vm_t {
     volatile mp_obj_t mp_pending_exception;
 
     #if MICROPY_ENABLE_SCHEDULER
-    mp_sched_item_t sched_stack[MICROPY_SCHEDULER_DEPTH];
+    // one ring queue per priority level
+    mp_sched_item_t sched_queue[MP_SCHED_NUM_PRIO][MICROPY_SCHEDULER_DEPTH];
     #endif
 
     // current exception being handled, for sys.exc_info()
@@ -185,6 +226,31 @@ typedef struct _mp_state_vm_t {
     struct _mp_vfs_mount_t *vfs_mount_table;
     #endif
 
+    #if MICROPY_QSTR_HASH_INDEX
+    // hash index of interned strings
+    qstr *qstr_index;
+    #endif
+
+    #if MICROPY_PERSISTENT_CODE_XIP
+    // mounted execute-in-place images, see mp_raw_code_xip_mount()
+    struct _mp_xip_image_t *xip_images;
+    #endif
+
+    #if MICROPY_OPT_CACHE_LOAD_METHOD
+    // cached LOAD_METHOD lookups, see mp_load_method_cached()
+    mp_load_method_cache_t load_method_cache[MICROPY_OPT_LOAD_METHOD_CACHE_SIZE];
+    #endif
+
+    #if MICROPY_PY_UASYNCIO
+    // event loop created by _uasyncio.get_event_loop()
+    mp_obj_t uasyncio_event_loop;
+    #endif
+
+    #if MICROPY_PY_USELECT_NOTIFY
+    // uselect.poll entries whose stream holds the readiness notification
+    struct _poll_obj_t *uselect_notify_entries;
+    #endif
+
     //
     // END ROOT POINTER SECTION
     ////////////////////////////////////////////////////////////
@@ -195,6 +261,13 @@ typedef struct _mp_state_vm_t {
     size_t qstr_last_alloc;
     size_t qstr_last_used;
 
+    #if MICROPY_QSTR_HASH_INDEX
+    size_t qstr_index_alloc;
+    size_t qstr_index_used;
+    // set when the index could not be allocated, cleared by the next GC
+    bool qstr_index_failed;
+    #endif
+
     #if MICROPY_PY_THREAD
     // This is a global mutex used to make qstr interning thread-safe.
     mp_thread_mutex_t qstr_mutex;
@@ -211,7 +284,9 @@ typedef struct _mp_state_vm_t {
 
     #if MICROPY_ENABLE_SCHEDULER
     volatile int16_t sched_state;
-    uint16_t sched_sp;
+    uint16_t sched_len;
+    uint8_t sched_idx[MP_SCHED_NUM_PRIO];
+    uint8_t sched_cnt[MP_SCHED_NUM_PRIO];
     #endif
 
     #if MICROPY_PY_THREAD_GIL
@@ -259,6 +259,7 @@ STATIC mp_obj_t memoryview_make_new(const mp_obj_type_t *type_in, size_t n_args,
 
     mp_buffer_info_t bufinfo;
     mp_get_buffer_raise(args[0], &bufinfo, MP_BUFFER_READ);
+    MICROPY_MEMORYVIEW_DERIVE_HOOK(bufinfo.buf);
 
     mp_obj_array_t *self = MP_OBJ_TO_PTR(mp_obj_new_memoryview(bufinfo.typecode,
         bufinfo.len / mp_binary_get_size('@', bufinfo.typecode, NULL),
@@ -499,6 +500,7 @@ STATIC mp_obj_t array_subscr(mp_obj_t self_in, mp_obj_t index_in, mp_obj_t value
                 // dummy
             #if MICROPY_PY_BUILTINS_MEMORYVIEW
             } else if (o->base.type == &mp_type_memoryview) {
+                MICROPY_MEMORYVIEW_DERIVE_HOOK(o->items);
                 res = m_new_obj(mp_obj_array_t);
                 *res = *o;
                 res->free += slice.start;
@@ -33,6 +33,7 @@
 #include "py/runtime.h"
 #include "py/bc.h"
 #include "py/stackctrl.h"
+#include "py/persistentcode.h"
 
 #if MICROPY_DEBUG_VERBOSE // print debugging info
 #define DEBUG_PRINT (1)
@@ -163,6 +164,12 @@ qstr mp_obj_fun_get_name(mp_const_obj_t fun_in) {
     const byte *bc = fun->bytecode;
     bc = mp_decode_uint_skip(bc); // skip n_state
     bc = mp_decode_uint_skip(bc); // skip n_exc_stack
+    #if MICROPY_PERSISTENT_CODE_XIP
+    if (*bc & MP_SCOPE_FLAG_XIP) {
+        // name is an index into the image's qstr map
+        return mp_raw_code_xip_qstr_map(fun->bytecode)[mp_obj_code_get_name(bc + 4)];
+    }
+    #endif
     bc++; // skip scope_params
     bc++; // skip n_pos_args
     bc++; // skip n_kwonly_args
@@ -29,7 +29,7 @@
 
 #include "py/objlist.h"
 #include "py/runtime.h"
-#include "py/stackctrl.h"
+#include "py/objstr.h"
 
 STATIC mp_obj_t mp_obj_new_list_iterator(mp_obj_t list, size_t cur, mp_obj_iter_buf_t *iter_buf);
 STATIC mp_obj_list_t *list_new(size_t n);
@@ -283,35 +283,542 @@ STATIC mp_obj_t list_pop(size_t n_args, const mp_obj_t *args) {
     return ret;
 }
 
-STATIC void mp_quicksort(mp_obj_t *head, mp_obj_t *tail, mp_obj_t key_fn, mp_obj_t binop_less_result) {
-    MP_STACK_CHECK();
-    while (head < tail) {
-        mp_obj_t *h = head - 1;
-        mp_obj_t *t = tail;
-        mp_obj_t v = key_fn == MP_OBJ_NULL ? tail[0] : mp_call_function_1(key_fn, tail[0]); // get pivot using key_fn
-        for (;;) {
-            do ++h; while (h < t && mp_binary_op(MP_BINARY_OP_LESS, key_fn == MP_OBJ_NULL ? h[0] : mp_call_function_1(key_fn, h[0]), v) == binop_less_result);
-            do --t; while (h < t && mp_binary_op(MP_BINARY_OP_LESS, v, key_fn == MP_OBJ_NULL ? t[0] : mp_call_function_1(key_fn, t[0])) == binop_less_result);
-            if (h >= t) break;
-            mp_obj_t x = h[0];
-            h[0] = t[0];
-            t[0] = x;
-        }
-        mp_obj_t x = h[0];
-        h[0] = tail[0];
-        tail[0] = x;
-        // do the smaller recursive call first, to keep stack within O(log(N))
-        if (t - head < tail - h - 1) {
-            mp_quicksort(head, t, key_fn, binop_less_result);
-            head = h + 1;
+// Stable, adaptive merge sort (based on CPython's TimSort, see its listsort.txt).
+// Natural runs are found and extended to min_run with binary insertion sort,
+// then merged, galloping when one run wins consistently.
+// The elements are 1 object (the item), or 2 objects (key, item) when sorting
+// with a key function, so that the key is computed only once for each item.
+
+#define LIST_SORT_MIN_GALLOP (7)
+// enough for 2^32 items, the run lengths grow at least as fast as Fibonacci numbers
+#define LIST_SORT_MAX_RUNS (64)
+
+typedef bool (*list_sort_lt_t)(mp_obj_t a, mp_obj_t b);
+
+typedef struct _list_sort_t {
+    mp_obj_t *tmp;          // temporary storage for merging, n/2 elements
+    size_t w;               // element width, in objects
+    list_sort_lt_t lt;
+    bool reverse;
+    mp_int_t min_gallop;
+} list_sort_t;
+
+typedef struct _list_sort_run_t {
+    mp_obj_t *base;
+    size_t len;
+} list_sort_run_t;
+
+STATIC bool list_sort_lt_generic(mp_obj_t a, mp_obj_t b) {
+    return mp_obj_is_true(mp_binary_op(MP_BINARY_OP_LESS, a, b));
+}
+
+STATIC bool list_sort_lt_small_int(mp_obj_t a, mp_obj_t b) {
+    return MP_OBJ_SMALL_INT_VALUE(a) < MP_OBJ_SMALL_INT_VALUE(b);
+}
+
+#if MICROPY_PY_BUILTINS_FLOAT
+STATIC bool list_sort_lt_float(mp_obj_t a, mp_obj_t b) {
+    return mp_obj_float_get(a) < mp_obj_float_get(b);
+}
+#endif
+
+STATIC bool list_sort_lt_str(mp_obj_t a, mp_obj_t b) {
+    GET_STR_DATA_LEN(a, data_a, len_a);
+    GET_STR_DATA_LEN(b, data_b, len_b);
+    return mp_seq_cmp_bytes(MP_BINARY_OP_LESS, data_a, len_a, data_b, len_b);
+}
+
+// Select the comparison function; if all keys are small ints, floats or strs
+// they are compared directly, without mp_binary_op dispatch
+STATIC list_sort_lt_t list_sort_select_lt(const mp_obj_t *a, size_t n, size_t w) {
+    size_t i;
+    for (i = 0; i < n && MP_OBJ_IS_SMALL_INT(a[i * w]); i++) {
+    }
+    if (i == n) {
+        return list_sort_lt_small_int;
+    }
+    #if MICROPY_PY_BUILTINS_FLOAT
+    for (i = 0; i < n && mp_obj_is_float(a[i * w]); i++) {
+    }
+    if (i == n) {
+        return list_sort_lt_float;
+    }
+    #endif
+    for (i = 0; i < n && MP_OBJ_IS_STR(a[i * w]); i++) {
+    }
+    if (i == n) {
+        return list_sort_lt_str;
+    }
+    return list_sort_lt_generic;
+}
+
+static inline bool list_sort_lt(list_sort_t *s, mp_obj_t a, mp_obj_t b) {
+    // reversed sort keeps the order of equal elements, as in CPython
+    return s->reverse ? s->lt(b, a) : s->lt(a, b);
+}
+
+static inline void list_sort_copy(list_sort_t *s, mp_obj_t *dest, const mp_obj_t *src, size_t n) {
+    if (n == 1) {
+        // most copies are single elements, which never partially overlap
+        dest[0] = src[0];
+        if (s->w == 2) {
+            dest[1] = src[1];
+        }
+        return;
+    }
+    memmove(dest, src, n * s->w * sizeof(mp_obj_t));
+}
+
+// Sort a[0:n] by binary insertion, a[0:start] is already sorted
+STATIC void list_sort_binary_insertion(list_sort_t *s, mp_obj_t *a, size_t n, size_t start) {
+    size_t w = s->w;
+    mp_obj_t pivot[2];
+    for (; start < n; start++) {
+        mp_obj_t key = a[start * w];
+        size_t lo = 0;
+        size_t hi = start;
+        while (lo < hi) {
+            size_t m = lo + ((hi - lo) >> 1);
+            if (list_sort_lt(s, key, a[m * w])) {
+                hi = m;
+            } else {
+                lo = m + 1;
+            }
+        }
+        // insert after the equal elements, to keep the sort stable
+        list_sort_copy(s, pivot, a + start * w, 1);
+        list_sort_copy(s, a + (lo + 1) * w, a + lo * w, start - lo);
+        list_sort_copy(s, a + lo * w, pivot, 1);
+    }
+}
+
+// Return the length of the run at the start of a[0:n]
+// A strictly descending run is reversed in place
+STATIC size_t list_sort_count_run(list_sort_t *s, mp_obj_t *a, size_t n) {
+    size_t w = s->w;
+    if (n == 1) {
+        return 1;
+    }
+    size_t k = 2;
+    if (list_sort_lt(s, a[w], a[0])) {
+        while (k < n && list_sort_lt(s, a[k * w], a[(k - 1) * w])) {
+            k++;
+        }
+        mp_obj_t t[2];
+        for (size_t lo = 0, hi = k - 1; lo < hi; lo++, hi--) {
+            list_sort_copy(s, t, a + lo * w, 1);
+            list_sort_copy(s, a + lo * w, a + hi * w, 1);
+            list_sort_copy(s, a + hi * w, t, 1);
+        }
+    } else {
+        while (k < n && !list_sort_lt(s, a[k * w], a[(k - 1) * w])) {
+            k++;
+        }
+    }
+    return k;
+}
+
+STATIC size_t list_sort_min_run(size_t n) {
+    size_t r = 0;
+    while (n >= 64) {
+        r |= n & 1;
+        n >>= 1;
+    }
+    return n + r;
+}
+
+// Return k such that a[k-1] < key <= a[k], starting the search at a[hint]
+STATIC size_t list_sort_gallop_left(list_sort_t *s, mp_obj_t key, mp_obj_t *a, mp_int_t n, mp_int_t hint) {
+    size_t w = s->w;
+    mp_int_t ofs = 1;
+    mp_int_t lastofs = 0;
+    mp_int_t maxofs;
+    if (list_sort_lt(s, a[hint * w], key)) {
+        // a[hint] < key, gallop right until a[hint+lastofs] < key <= a[hint+ofs]
+        maxofs = n - hint;
+        while (ofs < maxofs && list_sort_lt(s, a[(hint + ofs) * w], key)) {
+            lastofs = ofs;
+            ofs = (ofs << 1) + 1;
+        }
+        if (ofs > maxofs) {
+            ofs = maxofs;
+        }
+        lastofs += hint;
+        ofs += hint;
+    } else {
+        // key <= a[hint], gallop left until a[hint-ofs] < key <= a[hint-lastofs]
+        maxofs = hint + 1;
+        while (ofs < maxofs && !list_sort_lt(s, a[(hint - ofs) * w], key)) {
+            lastofs = ofs;
+            ofs = (ofs << 1) + 1;
+        }
+        if (ofs > maxofs) {
+            ofs = maxofs;
+        }
+        mp_int_t k = lastofs;
+        lastofs = hint - ofs;
+        ofs = hint - k;
+    }
+    // a[lastofs] < key <= a[ofs], binary search in between
+    lastofs++;
+    while (lastofs < ofs) {
+        mp_int_t m = lastofs + ((ofs - lastofs) >> 1);
+        if (list_sort_lt(s, a[m * w], key)) {
+            lastofs = m + 1;
+        } else {
+            ofs = m;
+        }
+    }
+    return ofs;
+}
+
+// Return k such that a[k-1] <= key < a[k], starting the search at a[hint]
+STATIC size_t list_sort_gallop_right(list_sort_t *s, mp_obj_t key, mp_obj_t *a, mp_int_t n, mp_int_t hint) {
+    size_t w = s->w;
+    mp_int_t ofs = 1;
+    mp_int_t lastofs = 0;
+    mp_int_t maxofs;
+    if (list_sort_lt(s, key, a[hint * w])) {
+        // key < a[hint], gallop left until a[hint-ofs] <= key < a[hint-lastofs]
+        maxofs = hint + 1;
+        while (ofs < maxofs && list_sort_lt(s, key, a[(hint - ofs) * w])) {
+            lastofs = ofs;
+            ofs = (ofs << 1) + 1;
+        }
+        if (ofs > maxofs) {
+            ofs = maxofs;
+        }
+        mp_int_t k = lastofs;
+        lastofs = hint - ofs;
+        ofs = hint - k;
+    } else {
+        // a[hint] <= key, gallop right until a[hint+lastofs] <= key < a[hint+ofs]
+        maxofs = n - hint;
+        while (ofs < maxofs && !list_sort_lt(s, key, a[(hint + ofs) * w])) {
+            lastofs = ofs;
+            ofs = (ofs << 1) + 1;
+        }
+        if (ofs > maxofs) {
+            ofs = maxofs;
+        }
+        lastofs += hint;
+        ofs += hint;
+    }
+    // a[lastofs] <= key < a[ofs], binary search in between
+    lastofs++;
+    while (lastofs < ofs) {
+        mp_int_t m = lastofs + ((ofs - lastofs) >> 1);
+        if (list_sort_lt(s, key, a[m * w])) {
+            ofs = m;
         } else {
-            mp_quicksort(h + 1, tail, key_fn, binop_less_result);
-            tail = t;
+            lastofs = m + 1;
+        }
+    }
+    return ofs;
+}
+
+// Merge the adjacent runs pa[0:na] and pb[0:nb], na <= nb
+// pb[0] < pa[0] and pa[na-1] > pb[nb-1]
+STATIC void list_sort_merge_lo(list_sort_t *s, mp_obj_t *pa, size_t na, mp_obj_t *pb, size_t nb) {
+    size_t w = s->w;
+    mp_obj_t *dest = pa;
+    mp_obj_t *a = s->tmp;
+    mp_obj_t *b = pb;
+    mp_int_t min_gallop = s->min_gallop;
+    list_sort_copy(s, a, pa, na);
+
+    list_sort_copy(s, dest, b, 1);
+    dest += w;
+    b += w;
+    if (--nb == 0) {
+        goto done;
+    }
+    if (na == 1) {
+        goto copy_b;
+    }
+
+    for (;;) {
+        size_t acount = 0;
+        size_t bcount = 0;
+        // one pair at a time, until one run wins consistently
+        for (;;) {
+            if (list_sort_lt(s, b[0], a[0])) {
+                list_sort_copy(s, dest, b, 1);
+                dest += w;
+                b += w;
+                bcount++;
+                acount = 0;
+                if (--nb == 0) {
+                    goto done;
+                }
+                if (bcount >= (size_t)min_gallop) {
+                    break;
+                }
+            } else {
+                list_sort_copy(s, dest, a, 1);
+                dest += w;
+                a += w;
+                acount++;
+                bcount = 0;
+                if (--na == 1) {
+                    goto copy_b;
+                }
+                if (acount >= (size_t)min_gallop) {
+                    break;
+                }
+            }
+        }
+        // galloping, copy whole slices while it pays off
+        min_gallop++;
+        do {
+            min_gallop -= (min_gallop > 1);
+            s->min_gallop = min_gallop;
+            size_t k = list_sort_gallop_right(s, b[0], a, na, 0);
+            acount = k;
+            if (k) {
+                list_sort_copy(s, dest, a, k);
+                dest += k * w;
+                a += k * w;
+                na -= k;
+                if (na == 1) {
+                    goto copy_b;
+                }
+                if (na == 0) {
+                    // only possible with inconsistent comparison
+                    goto done;
+                }
+            }
+            list_sort_copy(s, dest, b, 1);
+            dest += w;
+            b += w;
+            if (--nb == 0) {
+                goto done;
+            }
+            k = list_sort_gallop_left(s, a[0], b, nb, 0);
+            bcount = k;
+            if (k) {
+                list_sort_copy(s, dest, b, k);
+                dest += k * w;
+                b += k * w;
+                nb -= k;
+                if (nb == 0) {
+                    goto done;
+                }
+            }
+            list_sort_copy(s, dest, a, 1);
+            dest += w;
+            a += w;
+            if (--na == 1) {
+                goto copy_b;
+            }
+        } while (acount >= LIST_SORT_MIN_GALLOP || bcount >= LIST_SORT_MIN_GALLOP);
+        min_gallop++;
+        s->min_gallop = min_gallop;
+    }
+
+done:
+    if (na) {
+        list_sort_copy(s, dest, a, na);
+    }
+    return;
+
+copy_b:
+    // the last element of A belongs at the end
+    list_sort_copy(s, dest, b, nb);
+    list_sort_copy(s, dest + nb * w, a, 1);
+}
+
+// Merge the adjacent runs pa[0:na] and pb[0:nb], na > nb
+// pb[0] < pa[0] and pa[na-1] > pb[nb-1]
+STATIC void list_sort_merge_hi(list_sort_t *s, mp_obj_t *pa, size_t na, mp_obj_t *pb, size_t nb) {
+    size_t w = s->w;
+    mp_obj_t *dest = pb + (nb - 1) * w;
+    mp_obj_t *a = pa + (na - 1) * w;
+    mp_obj_t *b = s->tmp + (nb - 1) * w;
+    mp_int_t min_gallop = s->min_gallop;
+    list_sort_copy(s, s->tmp, pb, nb);
+
+    list_sort_copy(s, dest, a, 1);
+    dest -= w;
+    a -= w;
+    if (--na == 0) {
+        goto done;
+    }
+    if (nb == 1) {
+        goto copy_a;
+    }
+
+    for (;;) {
+        size_t acount = 0;
+        size_t bcount = 0;
+        // one pair at a time, until one run wins consistently
+        for (;;) {
+            if (list_sort_lt(s, b[0], a[0])) {
+                list_sort_copy(s, dest, a, 1);
+                dest -= w;
+                a -= w;
+                acount++;
+                bcount = 0;
+                if (--na == 0) {
+                    goto done;
+                }
+                if (acount >= (size_t)min_gallop) {
+                    break;
+                }
+            } else {
+                list_sort_copy(s, dest, b, 1);
+                dest -= w;
+                b -= w;
+                bcount++;
+                acount = 0;
+                if (--nb == 1) {
+                    goto copy_a;
+                }
+                if (bcount >= (size_t)min_gallop) {
+                    break;
+                }
+            }
+        }
+        // galloping, copy whole slices while it pays off
+        min_gallop++;
+        do {
+            min_gallop -= (min_gallop > 1);
+            s->min_gallop = min_gallop;
+            size_t k = na - list_sort_gallop_right(s, b[0], pa, na, na - 1);
+            acount = k;
+            if (k) {
+                dest -= k * w;
+                a -= k * w;
+                list_sort_copy(s, dest + w, a + w, k);
+                na -= k;
+                if (na == 0) {
+                    goto done;
+                }
+            }
+            list_sort_copy(s, dest, b, 1);
+            dest -= w;
+            b -= w;
+            if (--nb == 1) {
+                goto copy_a;
+            }
+            k = nb - list_sort_gallop_left(s, a[0], s->tmp, nb, nb - 1);
+            bcount = k;
+            if (k) {
+                dest -= k * w;
+                b -= k * w;
+                list_sort_copy(s, dest + w, b + w, k);
+                nb -= k;
+                if (nb == 1) {
+                    goto copy_a;
+                }
+                if (nb == 0) {
+                    // only possible with inconsistent comparison
+                    goto done;
+                }
+            }
+            list_sort_copy(s, dest, a, 1);
+            dest -= w;
+            a -= w;
+            if (--na == 0) {
+                goto done;
+            }
+        } while (acount >= LIST_SORT_MIN_GALLOP || bcount >= LIST_SORT_MIN_GALLOP);
+        min_gallop++;
+        s->min_gallop = min_gallop;
+    }
+
+done:
+    if (nb) {
+        list_sort_copy(s, dest - (nb - 1) * w, s->tmp, nb);
+    }
+    return;
+
+copy_a:
+    // the first element of B belongs at the start
+    dest -= na * w;
+    a -= na * w;
+    list_sort_copy(s, dest + w, a + w, na);
+    list_sort_copy(s, dest, b, 1);
+}
+
+// Merge the runs i and i+1
+STATIC void list_sort_merge_at(list_sort_t *s, list_sort_run_t *runs, size_t *n_runs, size_t i) {
+    mp_obj_t *pa = runs[i].base;
+    size_t na = runs[i].len;
+    mp_obj_t *pb = runs[i + 1].base;
+    size_t nb = runs[i + 1].len;
+
+    runs[i].len = na + nb;
+    if (i == *n_runs - 3) {
+        runs[i + 1] = runs[i + 2];
+    }
+    (*n_runs)--;
+
+    // the elements of A before the position of B[0] are already in place
+    size_t k = list_sort_gallop_right(s, pb[0], pa, na, 0);
+    pa += k * s->w;
+    na -= k;
+    if (na == 0) {
+        return;
+    }
+    // and so are the elements of B after the position of A[na-1]
+    nb = list_sort_gallop_left(s, pa[(na - 1) * s->w], pb, nb, nb - 1);
+    if (nb == 0) {
+        return;
+    }
+    if (na <= nb) {
+        list_sort_merge_lo(s, pa, na, pb, nb);
+    } else {
+        list_sort_merge_hi(s, pa, na, pb, nb);
+    }
+}
+
+STATIC void list_sort_elements(list_sort_t *s, mp_obj_t *a, size_t n) {
+    list_sort_run_t runs[LIST_SORT_MAX_RUNS];
+    size_t n_runs = 0;
+    size_t min_run = list_sort_min_run(n);
+    s->min_gallop = LIST_SORT_MIN_GALLOP;
+
+    while (n > 0) {
+        size_t len = list_sort_count_run(s, a, n);
+        if (len < min_run) {
+            // extend the run to min_run
+            size_t force = (n < min_run) ? n : min_run;
+            list_sort_binary_insertion(s, a, force, len);
+            len = force;
+        }
+        assert(n_runs < LIST_SORT_MAX_RUNS);
+        runs[n_runs].base = a;
+        runs[n_runs].len = len;
+        n_runs++;
+        a += len * s->w;
+        n -= len;
+
+        // merge the runs at the top of the stack until the lengths satisfy
+        // runs[i-2] > runs[i-1] + runs[i] and runs[i-1] > runs[i]
+        while (n_runs > 1) {
+            size_t i = n_runs - 2;
+            if ((i > 0 && runs[i - 1].len <= runs[i].len + runs[i + 1].len)
+                || (i > 1 && runs[i - 2].len <= runs[i - 1].len + runs[i].len)) {
+                if (runs[i - 1].len < runs[i + 1].len) {
+                    i--;
+                }
+            } else if (runs[i].len > runs[i + 1].len) {
+                break;
+            }
+            list_sort_merge_at(s, runs, &n_runs, i);
         }
     }
+
+    while (n_runs > 1) {
+        size_t i = n_runs - 2;
+        if (i > 0 && runs[i - 1].len < runs[i + 1].len) {
+            i--;
+        }
+        list_sort_merge_at(s, runs, &n_runs, i);
+    }
 }
 
-// TODO Python defines sort to be stable but ours is not
 mp_obj_t mp_obj_list_sort(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
     static const mp_arg_t allowed_args[] = {
         { MP_QSTR_key, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_rom_obj = MP_ROM_PTR(&mp_const_none_obj)} },
@@ -328,10 +835,47 @@ mp_obj_t mp_obj_list_sort(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_
     mp_check_self(MP_OBJ_IS_TYPE(pos_args[0], &mp_type_list));
     mp_obj_list_t *self = MP_OBJ_TO_PTR(pos_args[0]);
 
-    if (self->len > 1) {
-        mp_quicksort(self->items, self->items + self->len - 1,
-                     args.key.u_obj == mp_const_none ? MP_OBJ_NULL : args.key.u_obj,
-                     args.reverse.u_bool ? mp_const_false : mp_const_true);
+    size_t n = self->len;
+    if (n > 1) {
+        list_sort_t s;
+        mp_obj_t *a;
+        s.reverse = args.reverse.u_bool;
+        if (args.key.u_obj == mp_const_none) {
+            s.w = 1;
+            a = self->items;
+        } else {
+            // sort (key, item) pairs, calling the key function once for each item
+            s.w = 2;
+            a = m_new(mp_obj_t, n * 2);
+            for (size_t i = 0; i < n; i++) {
+                if (i >= self->len) {
+                    mp_raise_ValueError("list modified during sort");
+                }
+                a[i * 2 + 1] = self->items[i];
+                a[i * 2] = mp_call_function_1(args.key.u_obj, a[i * 2 + 1]);
+            }
+        }
+        s.lt = list_sort_select_lt(a, n, s.w);
+        if ((a == self->items) && (s.lt == list_sort_lt_generic)) {
+            // the comparison may raise an exception, or modify the list,
+            // sort a copy so that the list is not left in an inconsistent state
+            a = m_new(mp_obj_t, n);
+            memcpy(a, self->items, n * sizeof(mp_obj_t));
+        }
+        s.tmp = m_new(mp_obj_t, (n / 2) * s.w);
+
+        list_sort_elements(&s, a, n);
+
+        m_del(mp_obj_t, s.tmp, (n / 2) * s.w);
+        if (a != self->items) {
+            if (self->len != n) {
+                mp_raise_ValueError("list modified during sort");
+            }
+            for (size_t i = 0; i < n; i++) {
+                self->items[i] = a[i * s.w + s.w - 1];
+            }
+            m_del(mp_obj_t, a, n * s.w);
+        }
     }
 
     return mp_const_none;
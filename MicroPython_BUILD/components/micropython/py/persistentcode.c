@@ -238,6 +238,251 @@ mp_raw_code_t *mp_raw_code_load_file(const char *filename) {
     return mp_raw_code_load(&reader);
 }
 
+#if MICROPY_PERSISTENT_CODE_XIP
+
+#include "py/objstr.h"
+
+STATIC NORETURN void xip_raise_corrupt(void) {
+    mp_raise_ValueError("corrupt image");
+}
+
+// Return a pointer to size bytes at offset off in the image, checking bounds and alignment
+STATIC const void *xip_ptr(const mp_xip_image_t *img, uint32_t off, size_t size, size_t align) {
+    const mp_xip_header_t *hdr = (const mp_xip_header_t*)img->image;
+    if (off > hdr->len || size > hdr->len - off || (off & (align - 1)) != 0) {
+        xip_raise_corrupt();
+    }
+    return img->image + off;
+}
+
+STATIC qstr xip_qstr(const mp_xip_image_t *img, size_t idx) {
+    if (idx >= img->n_qstr) {
+        xip_raise_corrupt();
+    }
+    return img->qstr_map[idx];
+}
+
+STATIC size_t xip_decode_uint(const byte **ip, const byte *top) {
+    size_t val = 0;
+    for (;;) {
+        if (*ip >= top) {
+            xip_raise_corrupt();
+        }
+        byte b = *(*ip)++;
+        val = (val << 7) | (b & 0x7f);
+        if (!(b & 0x80)) {
+            return val;
+        }
+    }
+}
+
+// The VM translates the qstr operands of bytecode in an image through the
+// qstr map without checking them, so check the prelude and every operand here
+STATIC void xip_check_bytecode(const mp_xip_image_t *img, const byte *ip, const byte *top) {
+    xip_decode_uint(&ip, top); // n_state
+    xip_decode_uint(&ip, top); // n_exc_stack
+    if (top - ip < 4) {
+        xip_raise_corrupt();
+    }
+    ip += 4; // scope_flags, n_pos_args, n_kwonly_args, n_def_pos_args
+    const byte *ci = ip;
+    size_t code_info_size = xip_decode_uint(&ci, top);
+    if (top - ci < 4 || code_info_size < (size_t)(ci - ip) + 4 || code_info_size > (size_t)(top - ip)) {
+        xip_raise_corrupt();
+    }
+    xip_qstr(img, ci[0] | ci[1] << 8); // simple_name
+    xip_qstr(img, ci[2] | ci[3] << 8); // source_file
+    ip += code_info_size;
+    // cell locals, terminated by 255
+    while (ip < top && *ip != 255) {
+        ++ip;
+    }
+    if (ip == top) {
+        xip_raise_corrupt();
+    }
+    ++ip;
+    while (ip < top) {
+        size_t sz;
+        uint f = mp_opcode_format(ip, &sz);
+        if (sz > (size_t)(top - ip)) {
+            xip_raise_corrupt();
+        }
+        if (f == MP_OPCODE_QSTR) {
+            xip_qstr(img, ip[1] | ip[2] << 8);
+        }
+        ip += sz;
+    }
+}
+
+STATIC mp_obj_t load_xip_obj(const mp_xip_image_t *img, uint32_t off) {
+    const byte *obj = xip_ptr(img, off, 8, 4);
+    byte obj_type = obj[0];
+    if (obj_type == 'e') {
+        return MP_OBJ_FROM_PTR(&mp_const_ellipsis_obj);
+    }
+    size_t len = *(const uint32_t*)(obj + 4);
+    const char *data = xip_ptr(img, off + 8, len + 1, 1);
+    if (obj_type == 's' || obj_type == 'b') {
+        // the str/bytes object refers to the data in the image
+        mp_obj_str_t *o = m_new_obj(mp_obj_str_t);
+        o->base.type = (obj_type == 's') ? &mp_type_str : &mp_type_bytes;
+        o->hash = qstr_compute_hash((const byte*)data, len);
+        o->len = len;
+        o->data = (const byte*)data;
+        return MP_OBJ_FROM_PTR(o);
+    } else if (obj_type == 'i') {
+        return mp_parse_num_integer(data, len, 10, NULL);
+    } else if (obj_type == 'f' || obj_type == 'c') {
+        return mp_parse_num_decimal(data, len, obj_type == 'c', false, NULL);
+    }
+    xip_raise_corrupt();
+}
+
+// Nesting of raw code records deeper than this means a corrupt (or cyclic) image
+#define XIP_MAX_DEPTH (32)
+
+STATIC mp_raw_code_t *load_xip_raw_code(const mp_xip_image_t *img, uint32_t off, size_t depth) {
+    if (depth > XIP_MAX_DEPTH) {
+        xip_raise_corrupt();
+    }
+    const mp_xip_rc_t *xrc = xip_ptr(img, off, sizeof(mp_xip_rc_t), 4);
+    const byte *bytecode = xip_ptr(img, xrc->bytecode, xrc->bc_len, 1);
+    xip_check_bytecode(img, bytecode, bytecode + xrc->bc_len);
+    size_t n_arg_pad = (xrc->n_arg + 1) & ~1;
+    const uint16_t *arg_names = xip_ptr(img, off + sizeof(mp_xip_rc_t), n_arg_pad * 2, 2);
+    const uint32_t *offs = xip_ptr(img, off + sizeof(mp_xip_rc_t) + n_arg_pad * 2,
+        (xrc->n_obj + xrc->n_raw_code) * 4, 4);
+
+    // the bytecode stays in the image, only the prelude is decoded
+    const byte *ip = bytecode;
+    const byte *ip2;
+    bytecode_prelude_t prelude;
+    extract_prelude(&ip, &ip2, &prelude);
+    if (!(prelude.scope_flags & MP_SCOPE_FLAG_XIP) || xrc->n_arg != prelude.n_pos_args + prelude.n_kwonly_args) {
+        xip_raise_corrupt();
+    }
+
+    // the constant table is built in RAM
+    mp_uint_t *const_table = m_new(mp_uint_t, xrc->n_arg + xrc->n_obj + xrc->n_raw_code);
+    mp_uint_t *ct = const_table;
+    for (size_t i = 0; i < xrc->n_arg; ++i) {
+        *ct++ = (mp_uint_t)MP_OBJ_NEW_QSTR(xip_qstr(img, arg_names[i]));
+    }
+    for (size_t i = 0; i < xrc->n_obj; ++i) {
+        *ct++ = (mp_uint_t)load_xip_obj(img, *offs++);
+    }
+    for (size_t i = 0; i < xrc->n_raw_code; ++i) {
+        *ct++ = (mp_uint_t)(uintptr_t)load_xip_raw_code(img, *offs++, depth + 1);
+    }
+
+    mp_raw_code_t *rc = mp_emit_glue_new_raw_code();
+    mp_emit_glue_assign_bytecode(rc, bytecode,
+        #if MICROPY_PERSISTENT_CODE_SAVE || MICROPY_DEBUG_PRINTERS
+        xrc->bc_len,
+        #endif
+        const_table,
+        #if MICROPY_PERSISTENT_CODE_SAVE
+        xrc->n_obj, xrc->n_raw_code,
+        #endif
+        prelude.scope_flags);
+    return rc;
+}
+
+// Check an image and intern its qstrs; the image must stay valid and unchanged
+// for the life of the VM. Its modules are then found by the import machinery.
+mp_xip_image_t *mp_raw_code_xip_mount(const byte *image, size_t len) {
+    const mp_xip_header_t *hdr = (const mp_xip_header_t*)image;
+    if (((uintptr_t)image & 3) != 0 || len < sizeof(mp_xip_header_t)
+        || hdr->magic[0] != 'M' || hdr->magic[1] != 'X'
+        || hdr->magic[2] != MPY_VERSION
+        || hdr->magic[3] != MPY_FEATURE_FLAGS
+        || hdr->small_int_bits > mp_small_int_bits()
+        || hdr->qstr_bytes_in_hash != MICROPY_QSTR_BYTES_IN_HASH
+        || hdr->qstr_bytes_in_len != MICROPY_QSTR_BYTES_IN_LEN) {
+        mp_raise_ValueError("incompatible image");
+    }
+    if (hdr->len > len) {
+        xip_raise_corrupt();
+    }
+
+    mp_xip_image_t *img = m_new_obj_var(mp_xip_image_t, uint16_t, hdr->n_qstr);
+    img->image = image;
+    img->n_qstr = 0;
+    const uint32_t *qoffs = xip_ptr(img, hdr->qstr_table, hdr->n_qstr * 4, 4);
+    const uint32_t *mod = xip_ptr(img, hdr->module_table, hdr->n_module * 8, 4);
+    for (size_t i = 0; i < hdr->n_module; ++i, mod += 2) {
+        const byte *mod_name = xip_ptr(img, mod[0], 1, 1);
+        if (memchr(mod_name, 0, hdr->len - mod[0]) == NULL) {
+            xip_raise_corrupt();
+        }
+        xip_ptr(img, mod[1], sizeof(mp_xip_rc_t), 4);
+    }
+    for (size_t i = 0; i < hdr->n_qstr; ++i) {
+        const byte *q = xip_ptr(img, qoffs[i], MICROPY_QSTR_BYTES_IN_HASH + MICROPY_QSTR_BYTES_IN_LEN, 1);
+        size_t qlen = q[MICROPY_QSTR_BYTES_IN_HASH];
+        #if MICROPY_QSTR_BYTES_IN_LEN > 1
+        qlen |= q[MICROPY_QSTR_BYTES_IN_HASH + 1] << 8;
+        #endif
+        xip_ptr(img, qoffs[i], MICROPY_QSTR_BYTES_IN_HASH + MICROPY_QSTR_BYTES_IN_LEN + qlen + 1, 1);
+        img->qstr_map[i] = qstr_from_const(q);
+    }
+    img->n_qstr = hdr->n_qstr;
+
+    img->next = MP_STATE_VM(xip_images);
+    MP_STATE_VM(xip_images) = img;
+    return img;
+}
+
+// Return the qstr map of the image holding the given bytecode; used by the VM
+// to resolve the qstr operands of bytecode with MP_SCOPE_FLAG_XIP set
+const uint16_t *mp_raw_code_xip_qstr_map(const byte *bytecode) {
+    for (mp_xip_image_t *img = MP_STATE_VM(xip_images); img != NULL; img = img->next) {
+        const mp_xip_header_t *hdr = (const mp_xip_header_t*)img->image;
+        if (bytecode >= img->image && bytecode < img->image + hdr->len) {
+            return img->qstr_map;
+        }
+    }
+    // images are never unmounted, so this is not reached
+    assert(0);
+    return NULL;
+}
+
+// Find a module by its file name and build its raw code
+mp_raw_code_t *mp_raw_code_xip_find(const char *name, size_t len) {
+    for (mp_xip_image_t *img = MP_STATE_VM(xip_images); img != NULL; img = img->next) {
+        const mp_xip_header_t *hdr = (const mp_xip_header_t*)img->image;
+        const uint32_t *mod = (const uint32_t*)(img->image + hdr->module_table);
+        for (size_t i = 0; i < hdr->n_module; ++i, mod += 2) {
+            const char *mod_name = (const char*)img->image + mod[0];
+            if (strncmp(mod_name, name, len) == 0 && mod_name[len] == '\0') {
+                return load_xip_raw_code(img, mod[1], 0);
+            }
+        }
+    }
+    return NULL;
+}
+
+mp_import_stat_t mp_raw_code_xip_stat(const char *path) {
+    size_t len = strlen(path);
+    for (mp_xip_image_t *img = MP_STATE_VM(xip_images); img != NULL; img = img->next) {
+        const mp_xip_header_t *hdr = (const mp_xip_header_t*)img->image;
+        const uint32_t *mod = (const uint32_t*)(img->image + hdr->module_table);
+        for (size_t i = 0; i < hdr->n_module; ++i, mod += 2) {
+            const char *mod_name = (const char*)img->image + mod[0];
+            if (strncmp(mod_name, path, len) == 0) {
+                if (mod_name[len] == '\0') {
+                    return MP_IMPORT_STAT_FILE;
+                } else if (mod_name[len] == '/') {
+                    return MP_IMPORT_STAT_DIR;
+                }
+            }
+        }
+    }
+    return MP_IMPORT_STAT_NO_EXIST;
+}
+
+#endif // MICROPY_PERSISTENT_CODE_XIP
+
 #endif // MICROPY_PERSISTENT_CODE_LOAD
 
 #if MICROPY_PERSISTENT_CODE_SAVE
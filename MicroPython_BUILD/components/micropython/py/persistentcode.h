@@ -27,6 +27,7 @@
 #define MICROPY_INCLUDED_PY_PERSISTENTCODE_H
 
 #include "py/mpprint.h"
+#include "py/lexer.h"
 #include "py/reader.h"
 #include "py/emitglue.h"
 
@@ -34,6 +35,59 @@ mp_raw_code_t *mp_raw_code_load(mp_reader_t *reader);
 mp_raw_code_t *mp_raw_code_load_mem(const byte *buf, size_t len);
 mp_raw_code_t *mp_raw_code_load_file(const char *filename);
 
+#if MICROPY_PERSISTENT_CODE_XIP
+// An execute-in-place image holds the modules of an application precompiled
+// by mpy-cross and linked by tools/mpy-tool.py --xip. It is used in place,
+// typically memory mapped from flash. All multi-byte fields are little endian
+// and naturally aligned, offsets are from the start of the image.
+// The image starts with this header, followed by:
+//  - the qstr entries, each laid out as in a qstr pool (hash, length, data, nul)
+//  - a table of n_qstr uint32 offsets of the qstr entries
+//  - a table of n_module pairs of uint32 offsets: nul terminated module
+//    file name (e.g. "pkg/mod.py") and its outer raw code record
+//  - bytecode, constant objects and raw code records (mp_xip_rc_t)
+// Bytecode has MP_SCOPE_FLAG_XIP set and its qstr operands are indices into
+// the qstr table; the VM translates them with mp_raw_code_xip_qstr_map().
+typedef struct _mp_xip_header_t {
+    byte magic[4]; // 'M', 'X', MPY_VERSION, feature flags
+    byte small_int_bits;
+    byte qstr_bytes_in_hash;
+    byte qstr_bytes_in_len;
+    byte reserved;
+    uint32_t len;
+    uint32_t n_qstr;
+    uint32_t qstr_table;
+    uint32_t n_module;
+    uint32_t module_table;
+} mp_xip_header_t;
+
+// A raw code record is followed by uint16 qstr indices of the n_arg argument
+// names (padded to a multiple of 2), then uint32 offsets of the n_obj
+// constant objects and of the n_raw_code child raw code records.
+// A constant object is a type byte as in a .mpy file, 3 padding bytes, a
+// uint32 length and that many bytes of data followed by a nul.
+typedef struct _mp_xip_rc_t {
+    uint32_t bytecode;
+    uint32_t bc_len;
+    uint16_t n_obj;
+    uint16_t n_raw_code;
+    uint16_t n_arg;
+    uint16_t reserved;
+} mp_xip_rc_t;
+
+typedef struct _mp_xip_image_t {
+    struct _mp_xip_image_t *next;
+    const byte *image;
+    size_t n_qstr;
+    uint16_t qstr_map[]; // image qstr index -> qstr id
+} mp_xip_image_t;
+
+mp_xip_image_t *mp_raw_code_xip_mount(const byte *image, size_t len);
+mp_raw_code_t *mp_raw_code_xip_find(const char *name, size_t len);
+const uint16_t *mp_raw_code_xip_qstr_map(const byte *bytecode);
+mp_import_stat_t mp_raw_code_xip_stat(const char *path);
+#endif
+
 void mp_raw_code_save(mp_raw_code_t *rc, mp_print_t *print);
 void mp_raw_code_save_file(mp_raw_code_t *rc, const char *filename);
 
@@ -44,6 +44,7 @@ btree/bt_conv.c \
 btree/bt_debug.c \
 btree/bt_delete.c \
 btree/bt_get.c \
+btree/bt_load.c \
 btree/bt_open.c \
 btree/bt_overflow.c \
 btree/bt_page.c \
@@ -179,6 +180,7 @@ PY_O_BASENAME = \
 	../extmod/moduzlib.o \
 	../extmod/moduheapq.o \
 	../extmod/modutimeq.o \
+	../extmod/moduasyncio.o \
 	../extmod/moduhashlib.o \
 	../extmod/modubinascii.o \
 	../extmod/virtpin.o \
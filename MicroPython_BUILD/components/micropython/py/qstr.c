@@ -116,10 +116,81 @@ extern const qstr_pool_t MICROPY_QSTR_EXTRA_POOL;
 #define CONST_POOL mp_qstr_const_pool
 #endif
 
+#if MICROPY_QSTR_HASH_INDEX
+// The hash index is an open-addressing table (linear probing) of qstr ids,
+// its size is a power of 2 and it is kept at most half full.
+// It covers all qstrs from Q_INDEX_FIRST up, the pools below that are searched linearly.
+#if MICROPY_QSTR_HASH_INDEX_ROM
+#define Q_INDEX_FIRST (0)
+#else
+#define Q_INDEX_FIRST (CONST_POOL.total_prev_len + CONST_POOL.len)
+#endif
+#define Q_INDEX_MIN_ALLOC (32)
+
+STATIC void qstr_index_insert(qstr *index, size_t alloc, qstr q, mp_uint_t hash) {
+    size_t mask = alloc - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        if (index[i] == 0) {
+            index[i] = q;
+            return;
+        }
+    }
+}
+
+// (Re)build the index for all qstrs currently interned.
+// On allocation failure the index is dropped and the pools are searched linearly
+// until the next GC.
+STATIC void qstr_index_rebuild(void) {
+    size_t n = QSTR_TOTAL() - Q_INDEX_FIRST;
+    size_t alloc = Q_INDEX_MIN_ALLOC;
+    while (alloc < 2 * (n + 1)) {
+        alloc *= 2;
+    }
+    qstr *index = m_new_maybe(qstr, alloc);
+    if (MP_STATE_VM(qstr_index) != NULL) {
+        m_del(qstr, MP_STATE_VM(qstr_index), MP_STATE_VM(qstr_index_alloc));
+    }
+    MP_STATE_VM(qstr_index) = index;
+    if (index == NULL) {
+        // don't retry on every new qstr, wait until a GC has freed memory
+        MP_STATE_VM(qstr_index_failed) = true;
+        return;
+    }
+    memset(index, 0, alloc * sizeof(qstr));
+    for (qstr_pool_t *pool = MP_STATE_VM(last_pool); pool != NULL; pool = pool->prev) {
+        for (size_t i = 0; i < pool->len; i++) {
+            qstr q = pool->total_prev_len + i;
+            // MP_QSTR_NULL is never indexed
+            if (q >= Q_INDEX_FIRST && q != 0) {
+                qstr_index_insert(index, alloc, q, Q_GET_HASH(pool->qstrs[i]));
+            }
+        }
+    }
+    MP_STATE_VM(qstr_index_alloc) = alloc;
+    MP_STATE_VM(qstr_index_used) = n;
+}
+
+// Called by the GC after a collection, memory may be free for the index now
+void qstr_gc_collected(void) {
+    MP_STATE_VM(qstr_index_failed) = false;
+}
+#endif
+
 void qstr_init(void) {
     MP_STATE_VM(last_pool) = (qstr_pool_t*)&CONST_POOL; // we won't modify the const_pool since it has no allocated room left
     MP_STATE_VM(qstr_last_chunk) = NULL;
 
+    #if MICROPY_QSTR_HASH_INDEX
+    MP_STATE_VM(qstr_index) = NULL;
+    MP_STATE_VM(qstr_index_alloc) = 0;
+    MP_STATE_VM(qstr_index_used) = 0;
+    MP_STATE_VM(qstr_index_failed) = false;
+    #if MICROPY_QSTR_HASH_INDEX_ROM
+    // index the ROM pools now, the index for dynamic pools is created by the first qstr_add
+    qstr_index_rebuild();
+    #endif
+    #endif
+
     #if MICROPY_PY_THREAD
     mp_thread_mutex_init(&MP_STATE_VM(qstr_mutex));
     #endif
@@ -156,17 +227,50 @@ STATIC qstr qstr_add(const byte *q_ptr) {
 
     // add the new qstr
     MP_STATE_VM(last_pool)->qstrs[MP_STATE_VM(last_pool)->len++] = q_ptr;
+    qstr q = MP_STATE_VM(last_pool)->total_prev_len + MP_STATE_VM(last_pool)->len - 1;
+
+    #if MICROPY_QSTR_HASH_INDEX
+    if (MP_STATE_VM(qstr_index) == NULL || (MP_STATE_VM(qstr_index_used) + 1) * 2 > MP_STATE_VM(qstr_index_alloc)) {
+        // grow the index (the new qstr is included)
+        if (!MP_STATE_VM(qstr_index_failed)) {
+            qstr_index_rebuild();
+        }
+    } else {
+        qstr_index_insert(MP_STATE_VM(qstr_index), MP_STATE_VM(qstr_index_alloc), q, Q_GET_HASH(q_ptr));
+        MP_STATE_VM(qstr_index_used)++;
+    }
+    #endif
 
     // return id for the newly-added qstr
-    return MP_STATE_VM(last_pool)->total_prev_len + MP_STATE_VM(last_pool)->len - 1;
+    return q;
 }
 
 qstr qstr_find_strn(const char *str, size_t str_len) {
     // work out hash of str
     mp_uint_t str_hash = qstr_compute_hash((const byte*)str, str_len);
 
+    #if MICROPY_QSTR_HASH_INDEX
+    qstr *index = MP_STATE_VM(qstr_index);
+    if (index != NULL) {
+        // probe the index
+        size_t mask = MP_STATE_VM(qstr_index_alloc) - 1;
+        for (size_t i = str_hash & mask; index[i] != 0; i = (i + 1) & mask) {
+            const byte *q = find_qstr(index[i]);
+            if (Q_GET_HASH(q) == str_hash && Q_GET_LENGTH(q) == str_len && memcmp(Q_GET_DATA(q), str, str_len) == 0) {
+                return index[i];
+            }
+        }
+    }
+    #endif
+
     // search pools for the data
     for (qstr_pool_t *pool = MP_STATE_VM(last_pool); pool != NULL; pool = pool->prev) {
+        #if MICROPY_QSTR_HASH_INDEX
+        if (index != NULL && pool->total_prev_len >= Q_INDEX_FIRST) {
+            // already searched via the index
+            continue;
+        }
+        #endif
         for (const byte **q = pool->qstrs, **q_top = pool->qstrs + pool->len; q < q_top; q++) {
             if (Q_GET_HASH(*q) == str_hash && Q_GET_LENGTH(*q) == str_len && memcmp(Q_GET_DATA(*q), str, str_len) == 0) {
                 return pool->total_prev_len + (q - pool->qstrs);
@@ -241,6 +345,19 @@ qstr qstr_from_strn(const char *str, size_t len) {
     return q;
 }
 
+// Intern a string given as a complete pool entry (hash, length, data, nul)
+// which stays valid and unchanged for the life of the VM, e.g. in a memory
+// mapped image. The data is referenced, not copied.
+qstr qstr_from_const(const byte *q_ptr) {
+    QSTR_ENTER();
+    qstr q = qstr_find_strn((const char*)Q_GET_DATA(q_ptr), Q_GET_LENGTH(q_ptr));
+    if (q == 0) {
+        q = qstr_add(q_ptr);
+    }
+    QSTR_EXIT();
+    return q;
+}
+
 mp_uint_t qstr_hash(qstr q) {
     return Q_GET_HASH(find_qstr(q));
 }
@@ -59,12 +59,16 @@ typedef struct _qstr_pool_t {
 #define QSTR_TOTAL() (MP_STATE_VM(last_pool)->total_prev_len + MP_STATE_VM(last_pool)->len)
 
 void qstr_init(void);
+#if MICROPY_QSTR_HASH_INDEX
+void qstr_gc_collected(void);
+#endif
 
 mp_uint_t qstr_compute_hash(const byte *data, size_t len);
 qstr qstr_find_strn(const char *str, size_t str_len); // returns MP_QSTR_NULL if not found
 
 qstr qstr_from_str(const char *str);
 qstr qstr_from_strn(const char *str, size_t len);
+qstr qstr_from_const(const byte *q_ptr); // q_ptr is a complete entry that is not copied
 
 mp_uint_t qstr_hash(qstr q);
 const char *qstr_str(qstr q);
@@ -35,6 +35,7 @@
 #include "py/objlist.h"
 #include "py/objmodule.h"
 #include "py/objgenerator.h"
+#include "py/objtype.h"
 #include "py/smallint.h"
 #include "py/runtime.h"
 #include "py/builtin.h"
@@ -61,14 +62,26 @@ void mp_init(void) {
     // no pending exceptions to start with
     MP_STATE_VM(mp_pending_exception) = MP_OBJ_NULL;
     #if MICROPY_ENABLE_SCHEDULER
-    MP_STATE_VM(sched_state) = MP_SCHED_IDLE;
-    MP_STATE_VM(sched_sp) = 0;
+    mp_sched_init();
     #endif
 
 #if MICROPY_ENABLE_EMERGENCY_EXCEPTION_BUF
     mp_init_emergency_exception_buf();
 #endif
 
+    #if MICROPY_OPT_CACHE_LOAD_METHOD
+    // entries may point to the bytecode and types of the previous session
+    mp_load_method_cache_clear();
+    #endif
+
+    #if MICROPY_PY_UASYNCIO
+    MP_STATE_VM(uasyncio_event_loop) = MP_OBJ_NULL;
+    #endif
+
+    #if MICROPY_PY_USELECT_NOTIFY
+    MP_STATE_VM(uselect_notify_entries) = NULL;
+    #endif
+
     #if MICROPY_KBD_EXCEPTION
     // initialize the exception object for raising KeyboardInterrupt
     MP_STATE_VM(mp_kbd_exception).base.type = &mp_type_KeyboardInterrupt;
@@ -122,6 +135,10 @@ void mp_init(void) {
     MP_STATE_VM(vfs_mount_table) = NULL;
     #endif
 
+    #if MICROPY_PERSISTENT_CODE_XIP
+    MP_STATE_VM(xip_images) = NULL;
+    #endif
+
     #if MICROPY_PY_THREAD_GIL
     mp_thread_mutex_init(&MP_STATE_VM(gil_mutex));
     #endif
@@ -1086,6 +1103,44 @@ void mp_load_method(mp_obj_t base, qstr attr, mp_obj_t *dest) {
     }
 }
 
+#if MICROPY_OPT_CACHE_LOAD_METHOD
+// Like mp_load_method, but uses a cache indexed by the address of the LOAD_METHOD
+// instruction.  Only bound methods which depend on nothing but the type of the
+// object are cached: methods of native types without an attr handler, and methods
+// found in the class of an instance which has no member of the same name.
+// The entry is keyed on the type and the attribute name; the address only selects
+// the entry, as the bytecode it points to may be freed and its memory reused.
+void mp_load_method_cached(mp_obj_t base, qstr attr, mp_obj_t *dest, const byte *ip) {
+    mp_obj_type_t *type = mp_obj_get_type(base);
+    bool cacheable = type->attr == NULL;
+    if (type->attr == mp_obj_instance_attr) {
+        mp_obj_instance_t *self = MP_OBJ_TO_PTR(base);
+        cacheable = mp_map_lookup(&self->members, MP_OBJ_NEW_QSTR(attr), MP_MAP_LOOKUP) == NULL;
+    }
+
+    mp_load_method_cache_t *entry = &MP_STATE_VM(load_method_cache)[(uintptr_t)ip & (MICROPY_OPT_LOAD_METHOD_CACHE_SIZE - 1)];
+    if (cacheable && entry->ip == ip && entry->type == type && entry->attr == attr) {
+        dest[0] = entry->meth;
+        dest[1] = base;
+        return;
+    }
+
+    mp_load_method(base, attr, dest);
+
+    if (cacheable && dest[1] == base) {
+        entry->ip = ip;
+        entry->type = type;
+        entry->attr = attr;
+        entry->meth = dest[0];
+    }
+}
+
+// Must be called when the locals dict of a type is modified
+void mp_load_method_cache_clear(void) {
+    memset(MP_STATE_VM(load_method_cache), 0, sizeof(MP_STATE_VM(load_method_cache)));
+}
+#endif
+
 // Acts like mp_load_method_maybe but catches AttributeError, and all other exceptions if requested
 void mp_load_method_protected(mp_obj_t obj, qstr attr, mp_obj_t *dest, bool catch_all_exc) {
     nlr_buf_t nlr;
@@ -89,8 +89,32 @@ typedef struct _mp_sched_carg_entry_t {
 	uint8_t			*sval;
 	char 			key[16];
 	mp_sched_carg_t	*carg;
+	uint8_t			sbuf[MICROPY_SCHEDULER_CARG_INLINE];	// sval points here for short values
 } mp_sched_carg_entry_t;
 
+// Sources of scheduled callbacks, used to select the priority and for statistics
+#define MP_SCHED_SRC_PY		0	// micropython.schedule() and unclassified
+#define MP_SCHED_SRC_PIN	1
+#define MP_SCHED_SRC_TIMER	2
+#define MP_SCHED_SRC_UART	3
+#define MP_SCHED_SRC_I2C	4
+#define MP_SCHED_SRC_ADC	5
+#define MP_SCHED_SRC_MQTT	6
+#define MP_SCHED_SRC_NET	7
+#define MP_SCHED_SRC_BT		8
+#define MP_SCHED_SRC_GSM	9
+#define MP_SCHED_SRC_MAX	10
+
+#if MICROPY_SCHEDULER_STATS
+typedef struct _mp_sched_stats_t {
+	uint32_t	queued;
+	uint32_t	dropped;
+	uint32_t	run;
+	uint32_t	max_latency;	// us
+	uint64_t	sum_latency;	// us
+} mp_sched_stats_t;
+#endif
+
 #endif
 
 // Tables mapping operator enums to qstrs, defined in objtype.c
@@ -107,8 +131,13 @@ void mp_handle_pending_tail(mp_uint_t atomic_state);
 
 void mp_sched_lock(void);
 void mp_sched_unlock(void);
-static inline unsigned int mp_sched_num_pending(void) { return MP_STATE_VM(sched_sp); }
+static inline unsigned int mp_sched_num_pending(void) { return MP_STATE_VM(sched_len); }
+void mp_sched_init(void);
 bool mp_sched_schedule(mp_obj_t function, mp_obj_t arg, void *carg);
+bool mp_sched_schedule_src(mp_obj_t function, mp_obj_t arg, void *carg, int src);
+#if MICROPY_SCHEDULER_STATS
+void mp_sched_get_stats(int src, mp_sched_stats_t *stats, bool reset);
+#endif
 
 void free_carg(mp_sched_carg_t *carg);
 mp_sched_carg_t *make_carg_entry(mp_sched_carg_t *carg, int idx, uint8_t type, int val, const uint8_t *sval, const char *key);
@@ -176,6 +205,10 @@ void mp_convert_member_lookup(mp_obj_t obj, const mp_obj_type_t *type, mp_obj_t
 void mp_load_method(mp_obj_t base, qstr attr, mp_obj_t *dest);
 void mp_load_method_maybe(mp_obj_t base, qstr attr, mp_obj_t *dest);
 void mp_load_method_protected(mp_obj_t obj, qstr attr, mp_obj_t *dest, bool catch_all_exc);
+#if MICROPY_OPT_CACHE_LOAD_METHOD
+void mp_load_method_cached(mp_obj_t base, qstr attr, mp_obj_t *dest, const byte *ip);
+void mp_load_method_cache_clear(void);
+#endif
 void mp_load_super_method(qstr attr, mp_obj_t *dest);
 void mp_store_attr(mp_obj_t base, qstr attr, mp_obj_t val);
 
@@ -31,6 +31,8 @@
 #define MP_SCOPE_FLAG_VARKEYWORDS  (0x02)
 #define MP_SCOPE_FLAG_GENERATOR    (0x04)
 #define MP_SCOPE_FLAG_DEFKWARGS    (0x08)
+// bytecode qstrs are indices into the qstr table of an execute-in-place image
+#define MP_SCOPE_FLAG_XIP          (0x40)
 
 // types for native (viper) function signature
 #define MP_NATIVE_TYPE_OBJ  (0x00)
@@ -26,10 +26,12 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "py/runtime.h"
 #include "py/objstr.h"
+#include "py/mphal.h"
 
 #if MICROPY_ENABLE_SCHEDULER
 
@@ -58,27 +60,93 @@ void mp_handle_pending(void) {
     }
 }
 
+// C arguments of scheduled callbacks are built by drivers from ISRs and tasks,
+// so their nodes are taken from fixed-size block pools instead of the C heap.
+// The heap is only used when a pool runs out, or for long string values.
+typedef struct _sched_pool_t {
+    void    *free;
+    uint8_t *start;
+    uint8_t *end;
+} sched_pool_t;
+
+static mp_sched_carg_t carg_pool_mem[MICROPY_SCHEDULER_CARG_POOL];
+static mp_sched_carg_entry_t entry_pool_mem[MICROPY_SCHEDULER_ENTRY_POOL];
+static sched_pool_t carg_pool;
+static sched_pool_t entry_pool;
+
+// Priority of each callback source
+static const uint8_t sched_src_prio[MP_SCHED_SRC_MAX] = {
+    [MP_SCHED_SRC_PY]    = MP_SCHED_PRIO_NORMAL,
+    [MP_SCHED_SRC_PIN]   = MP_SCHED_PRIO_HIGH,
+    [MP_SCHED_SRC_TIMER] = MP_SCHED_PRIO_HIGH,
+    [MP_SCHED_SRC_UART]  = MP_SCHED_PRIO_NORMAL,
+    [MP_SCHED_SRC_I2C]   = MP_SCHED_PRIO_HIGH,
+    [MP_SCHED_SRC_ADC]   = MP_SCHED_PRIO_NORMAL,
+    [MP_SCHED_SRC_MQTT]  = MP_SCHED_PRIO_NORMAL,
+    [MP_SCHED_SRC_NET]   = MP_SCHED_PRIO_NORMAL,
+    [MP_SCHED_SRC_BT]    = MP_SCHED_PRIO_NORMAL,
+    [MP_SCHED_SRC_GSM]   = MP_SCHED_PRIO_NORMAL,
+};
+
+#if MICROPY_SCHEDULER_STATS
+static mp_sched_stats_t sched_stats[MP_SCHED_SRC_MAX];
+#endif
+
+//---------------------------------------------------------------------------------
+static void sched_pool_init(sched_pool_t *pool, void *mem, size_t size, size_t n)
+{
+	pool->start = mem;
+	pool->end = pool->start + size * n;
+	pool->free = NULL;
+	while (n-- > 0) {
+		void **blk = (void **)(pool->start + size * n);
+		*blk = pool->free;
+		pool->free = blk;
+	}
+}
+
+//---------------------------------------------------------
+static void *sched_pool_alloc(sched_pool_t *pool, size_t size)
+{
+	mp_uint_t atomic_state = MICROPY_SCHEDULER_POOL_ENTER();
+	void **blk = pool->free;
+	if (blk) pool->free = *blk;
+	MICROPY_SCHEDULER_POOL_EXIT(atomic_state);
+
+	if (blk == NULL) return calloc(size, 1);
+	memset(blk, 0, size);
+	return blk;
+}
+
+//-------------------------------------------------------
+static void sched_pool_free(sched_pool_t *pool, void *ptr)
+{
+	if (((uint8_t *)ptr >= pool->start) && ((uint8_t *)ptr < pool->end)) {
+		mp_uint_t atomic_state = MICROPY_SCHEDULER_POOL_ENTER();
+		*(void **)ptr = pool->free;
+		pool->free = ptr;
+		MICROPY_SCHEDULER_POOL_EXIT(atomic_state);
+	}
+	else free(ptr);
+}
+
 //-----------------------------------
 void free_carg(mp_sched_carg_t *carg)
 {
 	for (int i=0; i<MP_SCHED_CTYPE_MAX_ITEMS; i++) {
-		if (carg->entry[i]) {
-			if (carg->type == MP_SCHED_ENTRY_TYPE_CARG) {
-				free_carg((mp_sched_carg_t *)carg->entry[i]);
+		mp_sched_carg_entry_t *entry = (mp_sched_carg_entry_t *)carg->entry[i];
+		if (entry) {
+			if ((entry->type == MP_SCHED_ENTRY_TYPE_CARG) && (entry->carg)) {
+				free_carg(entry->carg);
 			}
-			else {
-				mp_sched_carg_entry_t *entry = (mp_sched_carg_entry_t *)carg->entry[i];
-				if (entry->sval) {
-					free(entry->sval);
-					entry->sval = NULL;
-				}
+			if ((entry->sval) && (entry->sval != entry->sbuf)) {
+				free(entry->sval);
 			}
-			free(carg->entry[i]);
+			sched_pool_free(&entry_pool, entry);
 			carg->entry[i] = NULL;
 		}
 	}
-	free(carg);
-	carg = NULL;
+	sched_pool_free(&carg_pool, carg);
 }
 
 //---------------------------------------------------------------------------------------------------------------------------
@@ -94,7 +162,7 @@ mp_sched_carg_t *make_carg_entry(mp_sched_carg_t *carg, int idx, uint8_t type, i
         return NULL;
     }
 
-    carg->entry[idx] = calloc(sizeof(mp_sched_carg_entry_t), 1);
+    carg->entry[idx] = sched_pool_alloc(&entry_pool, sizeof(mp_sched_carg_entry_t));
 	if (carg->entry[idx] == NULL) {
 		free_carg(carg);
 		return NULL;
@@ -107,7 +175,8 @@ mp_sched_carg_t *make_carg_entry(mp_sched_carg_t *carg, int idx, uint8_t type, i
 
 	if (sval) {
 		entry->ival = val;
-		entry->sval = malloc(val);
+		if (val <= MICROPY_SCHEDULER_CARG_INLINE) entry->sval = entry->sbuf;
+		else entry->sval = malloc(val);
 		if (entry->sval == NULL) {
 			free_carg(carg);
 			return NULL;
@@ -124,8 +193,9 @@ mp_sched_carg_t *make_carg_entry(mp_sched_carg_t *carg, int idx, uint8_t type, i
 //------------------------------------------------------------------------------------------
 mp_sched_carg_t *make_carg_entry_carg(mp_sched_carg_t *carg, int idx, mp_sched_carg_t *darg)
 {
-	carg->entry[idx] = calloc(sizeof(mp_sched_carg_entry_t), 1);
+	carg->entry[idx] = sched_pool_alloc(&entry_pool, sizeof(mp_sched_carg_entry_t));
 	if (carg->entry[idx] == NULL) {
+		free_carg(darg);
 		free_carg(carg);
 		return NULL;
 	}
@@ -141,7 +211,7 @@ mp_sched_carg_t *make_carg_entry_carg(mp_sched_carg_t *carg, int idx, mp_sched_c
 mp_sched_carg_t *make_cargs(int type)
 {
 	// Create scheduler function arguments
-	mp_sched_carg_t *carg = calloc(sizeof(mp_sched_carg_t), 1);
+	mp_sched_carg_t *carg = sched_pool_alloc(&carg_pool, sizeof(mp_sched_carg_t));
 	if (carg == NULL) return NULL;
 
 	carg->type = type;
@@ -189,6 +259,7 @@ static mp_obj_t make_arg_from_carg(mp_sched_carg_t *carg, int level, int *n_cbit
 			}
 			else if ((level == 0) && (entry->type == MP_SCHED_ENTRY_TYPE_CARG) && (strlen(entry->key) > 0) && (entry->carg)) {
 				mp_obj_t darg = make_arg_from_carg(entry->carg, 1, n_cbitems);
+				entry->carg = NULL;
 				mp_obj_dict_store(dct, mp_obj_new_str_copy(&mp_type_str, (const byte*)entry->key, strlen(entry->key)), darg);
 				#if FREE_CBOBJECT_AFTER
 				if (*n_cbitems < (MAX_CB_OBJECTS-1)) cb_objects[(*n_cbitems)++] = darg;
@@ -231,6 +302,7 @@ static mp_obj_t make_arg_from_carg(mp_sched_carg_t *carg, int level, int *n_cbit
 			}
 			else if ((level == 0) && (entry->type == MP_SCHED_ENTRY_TYPE_CARG) && (entry->carg)) {
 				mp_obj_t darg = make_arg_from_carg(entry->carg, 1, n_cbitems);
+				entry->carg = NULL;
 				tuple[i] = darg;
 				#if FREE_CBOBJECT_AFTER
 				if (*n_cbitems < (MAX_CB_OBJECTS-1)) cb_objects[(*n_cbitems)++] = tuple[i];
@@ -277,33 +349,85 @@ static mp_obj_t make_arg_from_carg(mp_sched_carg_t *carg, int level, int *n_cbit
 	return arg;
 }
 
+// Take the oldest item of the highest priority non-empty queue.
+// Must be called inside an atomic section.
+//-----------------------------------------------
+static bool sched_pop(mp_sched_item_t *item)
+{
+	for (int prio = 0; prio < MP_SCHED_NUM_PRIO; prio++) {
+		if (MP_STATE_VM(sched_cnt)[prio]) {
+			unsigned int idx = MP_STATE_VM(sched_idx)[prio];
+			mp_sched_item_t *slot = &MP_STATE_VM(sched_queue)[prio][idx];
+			*item = *slot;
+			// don't keep the callback alive for the GC
+			memset(slot, 0, sizeof(mp_sched_item_t));
+			if (++idx == MICROPY_SCHEDULER_DEPTH) idx = 0;
+			MP_STATE_VM(sched_idx)[prio] = idx;
+			MP_STATE_VM(sched_cnt)[prio]--;
+			MP_STATE_VM(sched_len)--;
+			return true;
+		}
+	}
+	return false;
+}
+
+//------------------------
+void mp_sched_init(void)
+{
+	static bool pools_ready = false;
+	if (!pools_ready) {
+		sched_pool_init(&carg_pool, carg_pool_mem, sizeof(mp_sched_carg_t), MICROPY_SCHEDULER_CARG_POOL);
+		sched_pool_init(&entry_pool, entry_pool_mem, sizeof(mp_sched_carg_entry_t), MICROPY_SCHEDULER_ENTRY_POOL);
+		pools_ready = true;
+	}
+
+	// Drop callbacks still queued from the previous session
+	mp_sched_item_t item;
+	while (1) {
+		mp_uint_t atomic_state = MICROPY_BEGIN_ATOMIC_SECTION();
+		bool have = sched_pop(&item);
+		MICROPY_END_ATOMIC_SECTION(atomic_state);
+		if (!have) break;
+		if (item.carg) free_carg((mp_sched_carg_t *)item.carg);
+	}
+	MP_STATE_VM(sched_state) = MP_SCHED_IDLE;
+}
+
 // This function should only be called by mp_sched_handle_pending,
 // or by the VM's inlined version of that function.
 //---------------------------------------------------
 void mp_handle_pending_tail(mp_uint_t atomic_state) {
     MP_STATE_VM(sched_state) = MP_SCHED_LOCKED;
-    if (MP_STATE_VM(sched_sp) > 0) {
+    mp_sched_item_t item;
+    if (sched_pop(&item)) {
+        MICROPY_END_ATOMIC_SECTION(atomic_state);
     	int n_cbitems = 0;
-        // get the first scheduled item from stack
-        mp_sched_item_t item = MP_STATE_VM(sched_stack)[0];
-        // Move other items down on stack
-        MP_STATE_VM(sched_sp)--;
-        int i = 0;
-        while (i < MP_STATE_VM(sched_sp)) {
-        	memcpy(&(MP_STATE_VM(sched_stack)[i]), &(MP_STATE_VM(sched_stack)[i+1]), sizeof(mp_sched_item_t));
-        	i++;
-        }
 
-        mp_obj_t arg = mp_const_none;
+		#if MICROPY_SCHEDULER_STATS
+        uint32_t latency = (uint32_t)MICROPY_SCHEDULER_TICKS_US() - item.queued_us;
+        mp_sched_stats_t *stats = &sched_stats[item.src];
+        stats->run++;
+        stats->sum_latency += latency;
+        if (latency > stats->max_latency) stats->max_latency = latency;
+		#endif
+
+        mp_obj_t arg = item.arg;
         if (item.carg != NULL) {
         	// === C argument is present, create the MicroPython object argument from it ===
-        	arg = make_arg_from_carg((mp_sched_carg_t *)item.carg, 0, &n_cbitems);
+        	nlr_buf_t nlr;
+        	if (nlr_push(&nlr) == 0) {
+        		arg = make_arg_from_carg((mp_sched_carg_t *)item.carg, 0, &n_cbitems);
+        		nlr_pop();
+        	}
+        	else {
+        		// no memory for the argument objects, the callback is not run
+        		free_carg((mp_sched_carg_t *)item.carg);
+        		item.func = MP_OBJ_NULL;
+        	}
         }
-        else arg = item.arg;
 
-        MICROPY_END_ATOMIC_SECTION(atomic_state);
         // Execute callback function
-        mp_call_function_1_protected(item.func, arg);
+        if (item.func != MP_OBJ_NULL) mp_call_function_1_protected(item.func, arg);
 
 		#if FREE_CBOBJECT_AFTER
         if (n_cbitems) {
@@ -344,27 +468,62 @@ void mp_sched_unlock(void) {
     MICROPY_END_ATOMIC_SECTION(atomic_state);
 }
 
-//-------------------------------------------------------------------
-bool mp_sched_schedule(mp_obj_t function, mp_obj_t arg, void *carg) {
+// Queue a callback; on failure the C argument, if any, is freed.
+//-------------------------------------------------------------------------------------
+bool mp_sched_schedule_src(mp_obj_t function, mp_obj_t arg, void *carg, int src) {
+    if ((src < 0) || (src >= MP_SCHED_SRC_MAX)) src = MP_SCHED_SRC_PY;
+    int prio = sched_src_prio[src];
+	#if MICROPY_SCHEDULER_STATS
+    uint32_t now = MICROPY_SCHEDULER_TICKS_US();
+	#endif
     mp_uint_t atomic_state = MICROPY_BEGIN_ATOMIC_SECTION();
     bool ret;
-    if (MP_STATE_VM(sched_sp) < MICROPY_SCHEDULER_DEPTH) {
+    if (MP_STATE_VM(sched_cnt)[prio] < MICROPY_SCHEDULER_DEPTH) {
         if (MP_STATE_VM(sched_state) == MP_SCHED_IDLE) {
             MP_STATE_VM(sched_state) = MP_SCHED_PENDING;
         }
-        MP_STATE_VM(sched_stack)[MP_STATE_VM(sched_sp)].func = function;
-        MP_STATE_VM(sched_stack)[MP_STATE_VM(sched_sp)].arg = arg;
-        MP_STATE_VM(sched_stack)[MP_STATE_VM(sched_sp)].carg = carg;
-        ++MP_STATE_VM(sched_sp);
+        unsigned int idx = MP_STATE_VM(sched_idx)[prio] + MP_STATE_VM(sched_cnt)[prio];
+        if (idx >= MICROPY_SCHEDULER_DEPTH) idx -= MICROPY_SCHEDULER_DEPTH;
+        mp_sched_item_t *item = &MP_STATE_VM(sched_queue)[prio][idx];
+        item->func = function;
+        item->arg = arg;
+        item->carg = carg;
+		#if MICROPY_SCHEDULER_STATS
+        item->queued_us = now;
+        item->src = src;
+        sched_stats[src].queued++;
+		#endif
+        MP_STATE_VM(sched_cnt)[prio]++;
+        MP_STATE_VM(sched_len)++;
         ret = true;
     } else {
-        // schedule stack is full
+        // schedule queue is full
+		#if MICROPY_SCHEDULER_STATS
+        sched_stats[src].dropped++;
+		#endif
         ret = false;
     }
     MICROPY_END_ATOMIC_SECTION(atomic_state);
+    if ((!ret) && (carg)) free_carg((mp_sched_carg_t *)carg);
     return ret;
 }
 
+//-------------------------------------------------------------------
+bool mp_sched_schedule(mp_obj_t function, mp_obj_t arg, void *carg) {
+    return mp_sched_schedule_src(function, arg, carg, MP_SCHED_SRC_PY);
+}
+
+#if MICROPY_SCHEDULER_STATS
+//-------------------------------------------------------------------
+void mp_sched_get_stats(int src, mp_sched_stats_t *stats, bool reset)
+{
+    mp_uint_t atomic_state = MICROPY_BEGIN_ATOMIC_SECTION();
+    *stats = sched_stats[src];
+    if (reset) memset(&sched_stats[src], 0, sizeof(mp_sched_stats_t));
+    MICROPY_END_ATOMIC_SECTION(atomic_state);
+}
+#endif
+
 #else // MICROPY_ENABLE_SCHEDULER
 
 // A variant of this is inlined in the VM at the pending exception check
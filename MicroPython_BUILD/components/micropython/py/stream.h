@@ -41,6 +41,8 @@
 #define MP_STREAM_SET_OPTS      (7)  // Set stream options
 #define MP_STREAM_GET_DATA_OPTS (8)  // Get data/message options
 #define MP_STREAM_SET_DATA_OPTS (9)  // Set data/message options
+#define MP_STREAM_POLL_NOTIFY   (10) // Set poll readiness notification, see extmod/moduselect.h
+#define MP_STREAM_POLL_NOTIFY_CLEAR (11) // Clear poll readiness notification
 
 // These poll ioctl values are compatible with Linux
 #define MP_STREAM_POLL_RD  (0x0001)
@@ -37,6 +37,7 @@
 #include "py/runtime.h"
 #include "py/bc0.h"
 #include "py/bc.h"
+#include "py/persistentcode.h"
 
 #if 0 && MICROPY_DEBUG_PRINTERS
 #define TRACE(ip) printf("sp=%d ", (int)(sp - &code_state->state[0] + 1)); mp_bytecode_print2(ip, 1, code_state->fun_bc->const_table);
@@ -61,8 +62,15 @@
 
 #if MICROPY_PERSISTENT_CODE
 
+#if MICROPY_PERSISTENT_CODE_XIP
+// bytecode run in place from an image refers to qstrs by their index in the image
+#define XIP_QSTR(q) ((qstr_map != NULL) ? qstr_map[q] : (q))
+#else
+#define XIP_QSTR(q) (q)
+#endif
+
 #define DECODE_QSTR \
-    qstr qst = ip[0] | ip[1] << 8; \
+    qstr qst = XIP_QSTR(ip[0] | ip[1] << 8); \
     ip += 2;
 #define DECODE_PTR \
     DECODE_UINT; \
@@ -160,10 +168,20 @@ run_code_state: ;
     // Pointers which are constant for particular invocation of mp_execute_bytecode()
     mp_obj_t * /*const*/ fastn;
     mp_exc_stack_t * /*const*/ exc_stack;
+    #if MICROPY_PERSISTENT_CODE_XIP
+    const uint16_t * /*const*/ qstr_map = NULL;
+    #endif
     {
         size_t n_state = mp_decode_uint_value(code_state->fun_bc->bytecode);
         fastn = &code_state->state[n_state - 1];
         exc_stack = (mp_exc_stack_t*)(code_state->state + n_state);
+        #if MICROPY_PERSISTENT_CODE_XIP
+        const byte *bc = mp_decode_uint_skip(code_state->fun_bc->bytecode); // skip n_state
+        bc = mp_decode_uint_skip(bc); // skip n_exc_stack
+        if (*bc & MP_SCOPE_FLAG_XIP) {
+            qstr_map = mp_raw_code_xip_qstr_map(code_state->fun_bc->bytecode);
+        }
+        #endif
     }
 
     // variables that are visible to the exception handler (declared volatile)
@@ -371,7 +389,11 @@ dispatch_loop:
                 ENTRY(MP_BC_LOAD_METHOD): {
                     MARK_EXC_IP_SELECTIVE();
                     DECODE_QSTR;
+                    #if MICROPY_OPT_CACHE_LOAD_METHOD
+                    mp_load_method_cached(*sp, qst, sp, ip);
+                    #else
                     mp_load_method(*sp, qst, sp);
+                    #endif
                     sp += 1;
                     DISPATCH();
                 }
@@ -1408,8 +1430,8 @@ unwind_loop:
                 ip = mp_decode_uint_skip(ip); // skip code_info_size
                 bc -= code_info_size;
                 #if MICROPY_PERSISTENT_CODE
-                qstr block_name = ip[0] | (ip[1] << 8);
-                qstr source_file = ip[2] | (ip[3] << 8);
+                qstr block_name = XIP_QSTR(ip[0] | (ip[1] << 8));
+                qstr source_file = XIP_QSTR(ip[2] | (ip[3] << 8));
                 ip += 4;
                 #else
                 qstr block_name = mp_decode_uint_value(ip);
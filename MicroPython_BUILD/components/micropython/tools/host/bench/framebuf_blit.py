@@ -0,0 +1,139 @@
+# framebuf blit() (extmod/modframebuf.c): pixels per second for every pair of
+# source and destination formats, with and without a colour key, and a check
+# of small blits at unaligned and negative offsets against pixel() per pixel.
+
+import utime
+import framebuf
+
+FORMATS = (
+    ('MONO_VLSB', framebuf.MONO_VLSB, 1),
+    ('MONO_HLSB', framebuf.MONO_HLSB, 1),
+    ('MONO_HMSB', framebuf.MONO_HMSB, 1),
+    ('GS2_HMSB', framebuf.GS2_HMSB, 2),
+    ('GS4_HMSB', framebuf.GS4_HMSB, 4),
+    ('GS8', framebuf.GS8, 8),
+    ('RGB565', framebuf.RGB565, 16),
+)
+
+def new_fb(fmt, bpp, w, h):
+    if fmt == framebuf.MONO_VLSB:
+        size = w * ((h + 7) // 8)
+    else:
+        size = ((w * bpp + 7) // 8) * h
+    return framebuf.FrameBuffer(bytearray(size), w, h, fmt)
+
+def pattern(fb, bpp, w, h):
+    mask = (1 << bpp) - 1
+    for y in range(h):
+        for x in range(w):
+            fb.pixel(x, y, ((x * 7 + y * 13) ^ (x >> 2)) & mask)
+
+# blit performance, a 128x64 source on a 320x240 destination
+SW, SH = 128, 64
+DW, DH = 320, 240
+ROUNDS = 40
+
+# the best of 5 runs, the host timing is noisy
+def rate(dst, src, x, y, key=-1):
+    best = None
+    for r in range(5):
+        t = utime.ticks_us()
+        for i in range(ROUNDS):
+            dst.blit(src, x, y, key)
+        t = utime.ticks_diff(utime.ticks_us(), t)
+        if best is None or t < best:
+            best = t
+    return SW * SH * ROUNDS * 1000000 // max(best, 1)
+
+srcs = []
+for name, fmt, bpp in FORMATS:
+    fb = new_fb(fmt, bpp, SW, SH)
+    pattern(fb, bpp, SW, SH)
+    srcs.append(fb)
+dsts = [new_fb(fmt, bpp, DW, DH) for name, fmt, bpp in FORMATS]
+
+for title, x, y, key in (('at (8, 8)', 8, 8, -1), ('at (3, 5)', 3, 5, -1), ('at (3, 5), key 0', 3, 5, 0)):
+    print('Mpixels/s, blit %s' % title)
+    print('%-10s' % 'src\\dst' + ''.join('%10s' % f[0] for f in FORMATS))
+    for i, (name, fmt, bpp) in enumerate(FORMATS):
+        print('%-10s' % name + ''.join('%10d' % (rate(dst, srcs[i], x, y, key) // 1000000) for dst in dsts))
+
+t = utime.ticks_us()
+for i in range(ROUNDS):
+    dsts[-1].scroll(3, 5)
+t = utime.ticks_diff(utime.ticks_us(), t)
+print('RGB565 scroll(3, 5): %.1f Mpixels/s' % (DW * DH * ROUNDS / t))
+
+# correctness: same format blits copy the colour, palette blits map it
+def check(src, w, h, dfmt, dbpp, x, y, key, pal):
+    dst = new_fb(dfmt, dbpp, 29, 21)
+    ref = new_fb(dfmt, dbpp, 29, 21)
+    dmask = (1 << dbpp) - 1
+    for yy in range(21):
+        for xx in range(29):
+            c = (xx * 5 + yy * 3) & dmask
+            dst.pixel(xx, yy, c)
+            ref.pixel(xx, yy, c)
+    if pal is None:
+        dst.blit(src, x, y, key)
+    else:
+        dst.blit(src, x, y, key, pal)
+    for j in range(h):
+        for i in range(w):
+            if 0 <= x + i < 29 and 0 <= y + j < 21:
+                c = src.pixel(i, j)
+                if c != key:
+                    ref.pixel(x + i, y + j, c if pal is None else pal.pixel(c, 0))
+    for yy in range(21):
+        for xx in range(29):
+            if dst.pixel(xx, yy) != ref.pixel(xx, yy):
+                return False
+    return True
+
+n = 0
+for sname, sfmt, sbpp in FORMATS:
+    src = new_fb(sfmt, sbpp, 19, 13)
+    pattern(src, sbpp, 19, 13)
+    for dname, dfmt, dbpp in FORMATS:
+        pal = None
+        if sfmt != dfmt:
+            if sbpp > 8:
+                continue
+            pal = new_fb(dfmt, dbpp, 1 << sbpp, 1)
+            for c in range(1 << sbpp):
+                pal.pixel(c, 0, (c * 3 + 1) & ((1 << dbpp) - 1))
+        for x, y in ((0, 0), (3, 5), (-4, -3), (17, 11), (8, 8)):
+            for key in (-1, 1):
+                if not check(src, 19, 13, dfmt, dbpp, x, y, key, pal):
+                    raise AssertionError('%s -> %s at (%d, %d) key %d' % (sname, dname, x, y, key))
+                n += 1
+
+# without a palette the colours are converted through an 8-bit grey level
+def to_grey8(bpp, c):
+    if bpp == 16:
+        r, g, b = c >> 11, (c >> 5) & 0x3f, c & 0x1f
+        r, g, b = (r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2)
+        return (r * 77 + g * 150 + b * 29) >> 8
+    return (c * 255) // ((1 << bpp) - 1)
+
+def from_grey8(bpp, g):
+    if bpp == 16:
+        return ((g >> 3) << 11) | ((g >> 2) << 5) | (g >> 3)
+    return g >> (8 - bpp)
+
+for sname, sfmt, sbpp in FORMATS:
+    src = new_fb(sfmt, sbpp, 19, 13)
+    for y in range(13):
+        for x in range(19):
+            src.pixel(x, y, (x * 3371 + y * 7919) & ((1 << sbpp) - 1))
+    for dname, dfmt, dbpp in FORMATS:
+        if sfmt == dfmt:
+            continue
+        dst = new_fb(dfmt, dbpp, 19, 13)
+        dst.blit(src, 0, 0)
+        for y in range(13):
+            for x in range(19):
+                if dst.pixel(x, y) != from_grey8(dbpp, to_grey8(sbpp, src.pixel(x, y))):
+                    raise AssertionError('%s -> %s grey conversion at (%d, %d)' % (sname, dname, x, y))
+        n += 1
+print('%d blits checked against pixel(): ok' % n)
@@ -0,0 +1,87 @@
+# GC allocator (py/gc.c), for the size-class index of free runs of
+# MICROPY_GC_SIZE_CLASSES: time of multi-block allocations (bytearrays,
+# lists, dict tables) of several sizes in a heap fragmented by single-block
+# holes, which the linear scan of the allocation table has to step over on
+# each allocation, and of single-block allocations for comparison.  Also the
+# time of gc.collect(), which rebuilds the index.  "make bench-off" runs it
+# also with the linear scan only.
+
+import gc
+import utime
+
+# the best of 3 runs, the host timing is noisy
+def timed(fn, *args):
+    best = None
+    for r in range(3):
+        # the objects of the previous run are not kept while allocating
+        res = None
+        gc.collect()
+        t = utime.ticks_us()
+        res = fn(*args)
+        t = utime.ticks_diff(utime.ticks_us(), t)
+        if best is None or t < best:
+            best = t
+    return res, best
+
+# fill the heap with small objects and free every other one: 'n' single-block
+# holes spread over the heap
+def fragment(n):
+    keep = []
+    for i in range(n):
+        a = bytearray(8)
+        b = bytearray(8)
+        keep.append(b)
+        a = None
+    return keep
+
+def alloc_bytearray(n, size):
+    live = []
+    for i in range(n):
+        b = bytearray(size)
+        b[-1] = i & 0xff
+        live.append(b)
+    return live
+
+def alloc_list(n, size):
+    live = []
+    for i in range(n):
+        live.append([i] * size)
+    return live
+
+def alloc_dict(n, size):
+    live = []
+    for i in range(n):
+        d = {}
+        for k in range(size):
+            d[k] = i
+        live.append(d)
+    return live
+
+def check(live, fn, size):
+    for i, o in enumerate(live):
+        if fn == alloc_bytearray and (len(o) != size or o[-1] != i & 0xff):
+            raise AssertionError('bytearray %d corrupted' % i)
+        if fn == alloc_list and (len(o) != size or o[0] != i or o[-1] != i):
+            raise AssertionError('list %d corrupted' % i)
+        if fn == alloc_dict and (len(o) != size or o[size - 1] != i):
+            raise AssertionError('dict %d corrupted' % i)
+
+def bench(holes):
+    keep = fragment(holes)
+    gc.collect()
+    for name, fn, sizes, n in (
+            ('bytearray', alloc_bytearray, (8, 100, 1000, 4000), 2000),
+            ('list', alloc_list, (10, 100, 500), 2000),
+            ('dict', alloc_dict, (10, 50), 1000)):
+        for size in sizes:
+            live, t = timed(fn, n, size)
+            check(live, fn, size)
+            live = None
+            print('%6d holes  %-9s %5d  %7.0f ns/object' % (holes, name, size, t * 1000 / n))
+    _, t = timed(gc.collect)
+    print('%6d holes  gc.collect() %7d us' % (holes, t))
+    keep = None
+    gc.collect()
+
+for holes in (1000, 30000):
+    bench(holes)
@@ -0,0 +1,73 @@
+# list.sort() (py/objlist.c) on random, sorted, reversed and nearly sorted
+# inputs: time per sort, and the number of comparisons made with a class
+# that counts its __lt__ calls.
+
+import utime
+
+N = 10000
+
+def lcg(n, seed=12345):
+    res = []
+    x = seed
+    for i in range(n):
+        x = (x * 1103515245 + 12345) & 0x7fffffff
+        res.append(x)
+    return res
+
+class Cnt:
+    n = 0
+    def __init__(self, v):
+        self.v = v
+    def __lt__(self, other):
+        Cnt.n += 1
+        return self.v < other.v
+
+def inputs(n):
+    rnd = lcg(n)
+    srt = sorted(rnd)
+    near = list(srt)
+    for i in range(0, n, 100):
+        near[i], near[-1 - i] = near[-1 - i], near[i]
+    return (
+        ('random', rnd),
+        ('sorted', srt),
+        ('reversed', srt[::-1]),
+        ('nearly sorted', near),
+        ('few unique', [x % 8 for x in rnd]),
+    )
+
+def timed(l, **kw):
+    t = utime.ticks_us()
+    l.sort(**kw)
+    return utime.ticks_diff(utime.ticks_us(), t)
+
+def check(l, **kw):
+    for i in range(1, len(l)):
+        a, b = l[i - 1], l[i]
+        if 'key' in kw:
+            a, b = kw['key'](a), kw['key'](b)
+        if (b > a) if kw.get('reverse') else (b < a):
+            raise AssertionError('not sorted')
+
+print('%d items              int us   str us  float us  key= us   __lt__ calls' % N)
+for name, data in inputs(N):
+    ti = timed(list(data))
+    ts = timed([str(x) for x in data])
+    tf = timed([x / 3 for x in data])
+    l = list(data)
+    tk = timed(l, key=lambda x: -x)
+    check(l, key=lambda x: -x)
+    objs = [Cnt(x) for x in data]
+    Cnt.n = 0
+    objs.sort()
+    check([o.v for o in objs])
+    print('%-16s %9d %8d %9d %8d %14d' % (name, ti, ts, tf, tk, Cnt.n))
+
+# stability: equal keys keep their order, also with reverse=True
+l = [(x % 8, i) for i, x in enumerate(lcg(N))]
+for rev in (False, True):
+    s = sorted(l, key=lambda p: p[0], reverse=rev)
+    for i in range(1, N):
+        if s[i - 1][0] == s[i][0] and s[i - 1][1] > s[i][1]:
+            raise AssertionError('not stable')
+print('stable: ok')
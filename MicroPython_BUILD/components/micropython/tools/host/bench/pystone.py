@@ -0,0 +1,242 @@
+# Method call speed, for the LOAD_METHOD cache (MICROPY_OPT_CACHE_LOAD_METHOD):
+# pystone 1.1 rewritten with its procedures as methods of a class, a driver
+# class calling self.spi.write() in a loop, and method calls on lists, strings
+# and bytearrays.  "make bench-off" runs it also without the cache.
+
+import utime
+
+LOOPS = 20000
+
+Ident1, Ident2, Ident3, Ident4, Ident5 = range(1, 6)
+
+class Record:
+    def __init__(self, PtrComp=None, Discr=0, EnumComp=0, IntComp=0, StringComp=0):
+        self.PtrComp = PtrComp
+        self.Discr = Discr
+        self.EnumComp = EnumComp
+        self.IntComp = IntComp
+        self.StringComp = StringComp
+
+    def copy(self):
+        return Record(self.PtrComp, self.Discr, self.EnumComp, self.IntComp, self.StringComp)
+
+class Pystone:
+    def __init__(self):
+        self.IntGlob = 0
+        self.BoolGlob = False
+        self.Char1Glob = '\0'
+        self.Char2Glob = '\0'
+        self.Array1Glob = [0] * 51
+        self.Array2Glob = [[0] * 51 for i in range(51)]
+        self.PtrGlb = None
+        self.PtrGlbNext = None
+
+    def run(self, loops):
+        self.PtrGlbNext = Record()
+        self.PtrGlb = Record()
+        self.PtrGlb.PtrComp = self.PtrGlbNext
+        self.PtrGlb.Discr = Ident1
+        self.PtrGlb.EnumComp = Ident3
+        self.PtrGlb.IntComp = 40
+        self.PtrGlb.StringComp = "DHRYSTONE PROGRAM, SOME STRING"
+        String1Loc = "DHRYSTONE PROGRAM, 1'ST STRING"
+        self.Array2Glob[8][7] = 10
+
+        for i in range(loops):
+            self.Proc5()
+            self.Proc4()
+            IntLoc1 = 2
+            IntLoc2 = 3
+            String2Loc = "DHRYSTONE PROGRAM, 2'ND STRING"
+            EnumLoc = Ident2
+            self.BoolGlob = not self.Func2(String1Loc, String2Loc)
+            while IntLoc1 < IntLoc2:
+                IntLoc3 = 5 * IntLoc1 - IntLoc2
+                IntLoc3 = self.Proc7(IntLoc1, IntLoc2)
+                IntLoc1 = IntLoc1 + 1
+            self.Proc8(self.Array1Glob, self.Array2Glob, IntLoc1, IntLoc3)
+            self.PtrGlb = self.Proc1(self.PtrGlb)
+            CharIndex = 'A'
+            while CharIndex <= self.Char2Glob:
+                if EnumLoc == self.Func1(CharIndex, 'C'):
+                    EnumLoc = self.Proc6(Ident1)
+                CharIndex = chr(ord(CharIndex) + 1)
+            IntLoc3 = IntLoc2 * IntLoc1
+            IntLoc2 = IntLoc3 // IntLoc1
+            IntLoc2 = 7 * (IntLoc3 - IntLoc2) - IntLoc1
+            IntLoc1 = self.Proc2(IntLoc1)
+        return IntLoc1, IntLoc2, IntLoc3
+
+    def Proc1(self, PtrParIn):
+        PtrParIn.PtrComp = NextRecord = self.PtrGlb.copy()
+        PtrParIn.IntComp = 5
+        NextRecord.IntComp = PtrParIn.IntComp
+        NextRecord.PtrComp = PtrParIn.PtrComp
+        NextRecord.PtrComp = self.Proc3(NextRecord.PtrComp)
+        if NextRecord.Discr == Ident1:
+            NextRecord.IntComp = 6
+            NextRecord.EnumComp = self.Proc6(PtrParIn.EnumComp)
+            NextRecord.PtrComp = self.PtrGlb.PtrComp
+            NextRecord.IntComp = self.Proc7(NextRecord.IntComp, 10)
+        else:
+            PtrParIn = NextRecord.copy()
+        NextRecord.PtrComp = None
+        return PtrParIn
+
+    def Proc2(self, IntParIO):
+        IntLoc = IntParIO + 10
+        while True:
+            if self.Char1Glob == 'A':
+                IntLoc = IntLoc - 1
+                IntParIO = IntLoc - self.IntGlob
+                EnumLoc = Ident1
+            if EnumLoc == Ident1:
+                break
+        return IntParIO
+
+    def Proc3(self, PtrParOut):
+        if self.PtrGlb is not None:
+            PtrParOut = self.PtrGlb.PtrComp
+        else:
+            self.IntGlob = 100
+        self.PtrGlb.IntComp = self.Proc7(10, self.IntGlob)
+        return PtrParOut
+
+    def Proc4(self):
+        BoolLoc = self.Char1Glob == 'A'
+        BoolLoc = BoolLoc or self.BoolGlob
+        self.Char2Glob = 'B'
+
+    def Proc5(self):
+        self.Char1Glob = 'A'
+        self.BoolGlob = False
+
+    def Proc6(self, EnumParIn):
+        EnumParOut = EnumParIn
+        if not self.Func3(EnumParIn):
+            EnumParOut = Ident4
+        if EnumParIn == Ident1:
+            EnumParOut = Ident1
+        elif EnumParIn == Ident2:
+            if self.IntGlob > 100:
+                EnumParOut = Ident1
+            else:
+                EnumParOut = Ident4
+        elif EnumParIn == Ident3:
+            EnumParOut = Ident2
+        elif EnumParIn == Ident5:
+            EnumParOut = Ident3
+        return EnumParOut
+
+    def Proc7(self, IntParI1, IntParI2):
+        IntLoc = IntParI1 + 2
+        return IntParI2 + IntLoc
+
+    def Proc8(self, Array1Par, Array2Par, IntParI1, IntParI2):
+        IntLoc = IntParI1 + 5
+        Array1Par[IntLoc] = IntParI2
+        Array1Par[IntLoc + 1] = Array1Par[IntLoc]
+        Array1Par[IntLoc + 30] = IntLoc
+        for IntIndex in range(IntLoc, IntLoc + 2):
+            Array2Par[IntLoc][IntIndex] = IntLoc
+        Array2Par[IntLoc][IntLoc - 1] = Array2Par[IntLoc][IntLoc - 1] + 1
+        Array2Par[IntLoc + 20][IntLoc] = Array1Par[IntLoc]
+        self.IntGlob = 5
+
+    def Func1(self, CharPar1, CharPar2):
+        CharLoc1 = CharPar1
+        CharLoc2 = CharLoc1
+        if CharLoc2 != CharPar2:
+            return Ident1
+        else:
+            return Ident2
+
+    def Func2(self, StrParI1, StrParI2):
+        IntLoc = 1
+        while IntLoc <= 1:
+            if self.Func1(StrParI1[IntLoc], StrParI2[IntLoc + 1]) == Ident1:
+                CharLoc = 'A'
+                IntLoc = IntLoc + 1
+        if CharLoc >= 'W' and CharLoc <= 'Z':
+            IntLoc = 7
+        if CharLoc == 'X':
+            return True
+        else:
+            if StrParI1 > StrParI2:
+                IntLoc = IntLoc + 7
+                return True
+            else:
+                return False
+
+    def Func3(self, EnumParIn):
+        EnumLoc = EnumParIn
+        if EnumLoc == Ident3:
+            return True
+        return False
+
+# a display driver as written for the boards: each call goes through self.spi
+class Spi:
+    def __init__(self):
+        self.n = 0
+
+    def write(self, buf):
+        self.n += len(buf)
+
+    def write_cmd(self, cmd):
+        self.n += 1
+
+class Display:
+    def __init__(self, spi):
+        self.spi = spi
+        self.buf = bytearray(8)
+
+    def fill_rect(self, x, y, w, h):
+        self.spi.write_cmd(0x2a)
+        self.spi.write(self.buf)
+        self.spi.write_cmd(0x2b)
+        self.spi.write(self.buf)
+        for i in range(h):
+            self.spi.write(self.buf)
+
+def drive(n):
+    d = Display(Spi())
+    for i in range(n):
+        d.fill_rect(0, i & 63, 8, 8)
+    return d.spi.n
+
+# methods of native types
+def builtins(n):
+    l = []
+    b = bytearray()
+    s = 'a,b,c'
+    k = 0
+    for i in range(n):
+        l.append(i)
+        b.extend(b'xy')
+        k += len(s.split(',')) + s.find('c') + s.count('b')
+        if len(l) > 64:
+            l.clear()
+            b = bytearray()
+    return k
+
+# the best of 3 runs, the host timing is noisy
+def timed(fn, n):
+    best = None
+    for r in range(3):
+        t = utime.ticks_us()
+        res = fn(n)
+        t = utime.ticks_diff(utime.ticks_us(), t)
+        if best is None or t < best:
+            best = t
+    return res, best
+
+res, t = timed(lambda n: Pystone().run(n), LOOPS)
+if res != (7, 39, 9):
+    raise AssertionError('pystone result %r' % (res,))
+print('pystone  %6d loops  %8d us  %7d pystones/s' % (LOOPS, t, LOOPS * 1000000 // t))
+res, t = timed(drive, 20000)
+if res != 20000 * (2 + 10 * 8):
+    raise AssertionError('driver result %d' % res)
+print('driver   %6d calls  %8d us  %7.0f ns/method call' % (20000 * 12, t, t * 1000 / (20000 * 12)))
+res, t = timed(builtins, 50000)
+print('builtins %6d calls  %8d us  %7.0f ns/method call' % (50000 * 5, t, t * 1000 / (50000 * 5)))
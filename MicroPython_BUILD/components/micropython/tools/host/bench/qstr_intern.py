@@ -0,0 +1,57 @@
+# qstr interning (py/qstr.c), for the hash index of MICROPY_QSTR_HASH_INDEX:
+# N attribute names built at run time, as from JSON keys or MQTT topics, are
+# interned with setattr(), then built again and looked up with getattr().
+# Each str built at run time is looked up in the qstr pools (see
+# mp_obj_new_str_from_vstr), so building the name is where the lookup is;
+# the time includes the formatting.  Also the lookups of names of the ROM
+# pool.  "make bench-off" runs it also without the index.
+
+import utime
+
+class Obj:
+    pass
+
+# the best of 3 runs, the host timing is noisy
+def timed(fn, *args):
+    best = None
+    for r in range(3):
+        t = utime.ticks_us()
+        res = fn(*args)
+        t = utime.ticks_diff(utime.ticks_us(), t)
+        if best is None or t < best:
+            best = t
+    return res, best
+
+def intern(o, n):
+    for i in range(n):
+        setattr(o, 'n%d_topic/%d/value' % (n, i), i)
+
+def lookup(o, n, rounds):
+    k = 0
+    for r in range(rounds):
+        for i in range(n):
+            k += getattr(o, 'n%d_topic/%d/value' % (n, i))
+    return k
+
+def bench(n, rounds):
+    o = Obj()
+    # a fresh prefix for each size, so every name is new to the pools
+    t = utime.ticks_us()
+    intern(o, n)
+    t_intern = utime.ticks_diff(utime.ticks_us(), t)
+    k, t = timed(lookup, o, n, rounds)
+    if k != rounds * n * (n - 1) // 2:
+        raise AssertionError('lookup result %d' % k)
+    print('%6d names: intern %8.0f /s  lookup %9.0f /s' % (n, n * 1000000 / t_intern, rounds * n * 1000000 / t))
+
+for n in (100, 1000, 5000, 20000):
+    bench(n, 100000 // n)
+
+# names of the ROM pool, built at run time
+rom = ('append', 'write', 'read', '__init__', 'decode', 'startswith', 'items', 'keys')
+def lookup_rom(rounds):
+    for r in range(rounds):
+        for name in rom:
+            getattr(str, '%s' % name, None)
+_, t = timed(lookup_rom, 10000)
+print('   ROM names: lookup %9.0f /s' % (10000 * len(rom) * 1000000 / t))
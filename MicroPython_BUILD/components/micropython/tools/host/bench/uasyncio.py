@@ -0,0 +1,86 @@
+# Event loop core in C (_uasyncio, extmod/moduasyncio.c) against the same
+# round-robin loop written in Python, as in uasyncio: context switches per
+# second with a number of tasks that only yield, and utimeq push/pop rate.
+
+import utime
+import utimeq
+import _uasyncio
+
+TASKS = 10
+SWITCHES = 20000
+
+def task(cnt, n):
+    for i in range(n):
+        cnt[0] += 1
+        yield
+
+def waiter(cnt, total):
+    while cnt[0] < total:
+        yield
+
+def c_loop(tasks, n):
+    cnt = [0]
+    loop = _uasyncio.get_event_loop(tasks + 1)
+    for i in range(tasks):
+        loop.create_task(task(cnt, n))
+    loop.run_until_complete(waiter(cnt, tasks * n))
+    return cnt[0]
+
+# the run queue and the yield handling of the uasyncio (v2) core loop
+def py_loop(tasks, n):
+    cnt = [0]
+    runq = [task(cnt, n) for i in range(tasks)]
+    main = waiter(cnt, tasks * n)
+    runq.append(main)
+    waitq = utimeq.utimeq(16)
+    head = 0
+    while True:
+        tail = len(runq)
+        while head < tail:
+            cb = runq[head]
+            head += 1
+            try:
+                ret = cb.send(None)
+            except StopIteration:
+                if cb is main:
+                    return cnt[0]
+                continue
+            if ret is None:
+                runq.append(cb)
+            elif isinstance(ret, int):
+                waitq.push(utime.ticks_add(utime.ticks_ms(), ret), cb, ())
+            elif ret is not False:
+                runq.append(ret)
+                runq.append(cb)
+        del runq[:head]
+        head = 0
+
+def run(name, fn, *args):
+    t = utime.ticks_us()
+    n = fn(*args)
+    t = utime.ticks_diff(utime.ticks_us(), t)
+    print('%-32s %8d switches %8d us %9d switches/s' % (name, n, t, n * 1000000 // t))
+    return n * 1000000 // t
+
+def utimeq_rate(size, rounds):
+    q = utimeq.utimeq(size)
+    res = [0, 0, 0]
+    t = utime.ticks_us()
+    for r in range(rounds):
+        for i in range(size):
+            # pseudo random times, not in order
+            q.push((i * 7919 + r) % 10007, None, None)
+        for i in range(size):
+            q.pop(res)
+    t = utime.ticks_diff(utime.ticks_us(), t)
+    n = 2 * size * rounds
+    print('utimeq size %-4d %8d push+pop %8d us %9d ops/s' % (size, n, t, n * 1000000 // t))
+
+for tasks in (1, TASKS, 100):
+    n = SWITCHES * TASKS // tasks
+    c = run('C loop, %d tasks' % tasks, c_loop, tasks, n)
+    p = run('Python loop, %d tasks' % tasks, py_loop, tasks, n)
+    print('  C loop %d.%dx faster' % (c // p, c * 10 // p % 10))
+
+for size in (16, 64, 256):
+    utimeq_rate(size, 20000 // size)
@@ -0,0 +1,72 @@
+# ujson.dump/dumps with the buffered encoder (extmod/modujson.c) against the
+# previous path through the generic print machinery, host.json_print(), for
+# a telemetry dict as sent to MQTT every second and for a large list of
+# records.  Both must produce the same text.  Printed for each: MB/s of
+# dumps(), MB/s of dump() to an unbuffered file, the write() calls made by
+# dump() and the heap it allocates.
+
+import gc
+import utime
+import ujson
+import host
+
+def telemetry(n):
+    return {
+        'device': 'esp32-%04d' % n,
+        'ts': 1530000000 + n,
+        'uptime': n * 10,
+        'rssi': -67,
+        'online': True,
+        'fw': None,
+        'temp': [20 + i * 0.25 for i in range(8)],
+        'counters': {'rx': n * 3, 'tx': n * 2, 'err': 0, 'retry': 7},
+        'status': 'ok, "nominal"\n',
+        'sensors': [{'id': i, 'name': 'sensor%d' % i, 'value': i * 1.5, 'alarm': i == 3} for i in range(6)],
+    }
+
+def records(n):
+    return [{'t': 1530000000 + i * 10, 'ch': i % 8, 'v': i * 37 % 1024, 'tag': 'rec%d' % i} for i in range(n)]
+
+# the best of 3 runs, the host timing is noisy
+def timed(fn, n, *args):
+    best = None
+    for r in range(3):
+        t = utime.ticks_us()
+        for i in range(n):
+            fn(*args)
+        t = utime.ticks_diff(utime.ticks_us(), t)
+        if best is None or t < best:
+            best = t
+    return best
+
+def writes(fn, obj, f):
+    n = host.syscalls()[1]
+    fn(obj, f)
+    return host.syscalls()[1] - n
+
+def heap(fn, obj, f):
+    gc.collect()
+    gc.disable()
+    m = gc.mem_alloc()
+    fn(obj, f)
+    m = gc.mem_alloc() - m
+    gc.enable()
+    return m
+
+def bench(name, obj, n):
+    text = ujson.dumps(obj)
+    if host.json_print(obj) != text:
+        raise AssertionError('%s: output differs from the print path' % name)
+    if ujson.loads(text) != ujson.loads(host.json_print(obj)):
+        raise AssertionError('%s: round trip failed' % name)
+    size = len(text) * n
+    f = open('/dev/null', 'w', buffering=0)
+    for label, dumps, dump in (('print', host.json_print, host.json_print), ('encoder', ujson.dumps, ujson.dump)):
+        ts = timed(dumps, n, obj)
+        td = timed(dump, n, obj, f)
+        print('%-9s %-8s %7d bytes  dumps %6.1f MB/s  dump %6.1f MB/s  %5d writes  %6d bytes of heap' % (
+            name, label, len(text), size / ts, size / td, writes(dump, obj, f), heap(dump, obj, f)))
+    f.close()
+
+bench('telemetry', telemetry(1), 500)
+bench('records', records(2000), 3)
@@ -0,0 +1,85 @@
+# ujson parser (extmod/modujson.c): MB/s of loads() from a string, load()
+# from a BytesIO and from an unbuffered file, and iterload() going through
+# the records of the same documents one at a time, with the number of read()
+# calls for the file (one per byte before the reads were buffered).
+# Documents: an API response with a list of 2000 records and a config of
+# nested dicts, about 200 KB each.  Every result is checked against loads().
+
+import utime
+import uio
+import ujson
+import host
+
+FN = '/tmp/ujson_load_bench.json'
+
+def response(n):
+    return {'status': 'ok', 'count': n, 'items': [
+        {'id': i, 'name': 'item "%d"\n' % i, 'price': i * 0.25, 'tags': ['a', 'b', 'c'][:i % 4],
+         'stock': None if i % 5 else i, 'active': i % 3 == 0, 'meta': {}} for i in range(n)]}
+
+def config(n):
+    return {'section%d' % s: {'key%d' % k: {'value': s * k, 'unit': 'ms', 'limits': [0, 1000], 'enabled': True}
+        for k in range(n)} for s in range(n)}
+
+# the best of 3 runs, the host timing is noisy
+def timed(fn):
+    best = None
+    for i in range(3):
+        t = utime.ticks_us()
+        res = fn()
+        t = utime.ticks_diff(utime.ticks_us(), t)
+        if best is None or t < best:
+            best = t
+    return res, best
+
+def from_file(fn):
+    with open(FN, 'rb', 0) as f:
+        return fn(f)
+
+def reads(fn):
+    r = host.syscalls()[0]
+    fn()
+    return host.syscalls()[0] - r
+
+def iter_count(src, depth):
+    n = 0
+    for path, value in ujson.iterload(src, depth):
+        n += 1
+    return n
+
+def bench(name, obj, depth):
+    text = ujson.dumps(obj)
+    data = text.encode()
+    with open(FN, 'wb') as f:
+        f.write(data)
+    ref = ujson.loads(text)
+    if ref != obj:
+        raise AssertionError('%s: round trip failed' % name)
+    for label, fn in (
+            ('loads', lambda: ujson.loads(text)),
+            ('load BytesIO', lambda: ujson.load(uio.BytesIO(data))),
+            ('load file', lambda: from_file(ujson.load))):
+        res, t = timed(fn)
+        if res != ref:
+            raise AssertionError('%s: %s result differs' % (name, label))
+        print('%-8s %7d bytes  %-14s %6.1f MB/s  %6s reads' % (name, len(data), label, len(data) / t,
+            reads(fn) if label == 'load file' else '-'))
+    # the values of iterload, put back together, give the document again
+    items = list(ujson.iterload(uio.BytesIO(data), depth))
+    for path, value in items:
+        o = ref
+        for k in path:
+            o = o[k]
+        if o != value:
+            raise AssertionError('%s: iterload value at %s differs' % (name, path))
+    for label, fn in (
+            ('iterload str', lambda: iter_count(text, depth)),
+            ('iterload file', lambda: from_file(lambda f: iter_count(f, depth)))):
+        n, t = timed(fn)
+        if n != len(items):
+            raise AssertionError('%s: %s count differs' % (name, label))
+        print('%-8s %7d bytes  %-14s %6.1f MB/s  %6s reads  %d values at depth %d' % (name, len(data), label,
+            len(data) / t, reads(fn) if label == 'iterload file' else '-', n, depth))
+
+bench('response', response(2000), 2)
+bench('config', config(40), 2)
@@ -0,0 +1,215 @@
+# uselect.poll with readiness notification (extmod/moduselect.c), using the
+# fake streams of host.Stream: Stream() notifies the poll object when its
+# state changes, as the esp32 UARTs and sockets do, Stream(False) does not
+# and is polled on each pass, as before.
+# First the poll semantics are checked, also with poll objects collected by
+# the incremental GC, then the cost of poll() with many idle streams, the CPU
+# used while waiting and the wake-up latency are measured for both kinds of
+# streams.
+
+import gc
+import utime
+import uselect
+import host
+
+IN = uselect.POLLIN
+OUT = uselect.POLLOUT
+N_IDLE = 30
+
+def check(cond, what):
+    if not cond:
+        raise AssertionError(what)
+
+def ready(p, timeout=0):
+    return [(s, ev) for s, ev in p.poll(timeout)]
+
+def test_semantics():
+    s = host.Stream()
+    p = uselect.poll()
+    p.register(s, IN)
+    check(s.notifying(), 'notification taken on register')
+    check(ready(p) == [], 'idle stream not ready')
+    check(s.polls() == 1, 'checked once after register')
+    ready(p)
+    check(s.polls() == 0, 'idle stream not checked again')
+
+    s.set(IN)
+    check(ready(p) == [(s, IN)], 'ready after notification')
+    # level triggered: stays ready until the state changes
+    check(ready(p) == [(s, IN)], 'still ready')
+    s.set(0)
+    check(ready(p) == [], 'not ready after reset')
+    ready(p)
+    check(s.polls() == 3, 'dropped from the ready list once idle')
+
+    # event mask
+    s.set(IN)
+    p.modify(s, OUT)
+    check(ready(p) == [], 'masked event')
+    p.modify(s, IN | OUT)
+    check(ready(p) == [(s, IN)], 'modify queues the stream')
+
+    # oneshot ipoll
+    res = [(o, ev) for o, ev in p.ipoll(0, 1)]
+    check(res == [(s, IN)], 'ipoll oneshot')
+    check(ready(p) == [], 'oneshot disables the stream')
+    p.modify(s, IN)
+    check(ready(p) == [(s, IN)], 'enabled again by modify')
+
+    # stream without notification
+    legacy = host.Stream(False)
+    p.register(legacy, IN)
+    check(not legacy.notifying(), 'no notification')
+    legacy.set(IN)
+    res = ready(p)
+    check(len(res) == 2 and (legacy, IN) in res and (s, IN) in res, 'mixed streams')
+    p.unregister(legacy)
+    s.set(0)
+    ready(p)
+
+    # one stream in two poll objects: the second polls it on each pass
+    p2 = uselect.poll()
+    p2.register(s, IN)
+    s.set(IN)
+    check(ready(p) == [(s, IN)] and ready(p2) == [(s, IN)], 'both poll objects see it')
+    p2.unregister(s)
+    check(s.notifying(), 'unregister from the second keeps the notification')
+    p3 = uselect.poll()
+    p3.register(s, IN)
+    p.unregister(s)
+    check(not s.notifying(), 'unregister from the first clears it')
+    p4 = uselect.poll()
+    p4.register(s, IN)
+    check(s.notifying(), 'a new poll object takes it')
+    check(ready(p4) == [(s, IN)] and ready(p3) == [(s, IN)], 'ready in both')
+    p3.unregister(s)
+    p4.unregister(s)
+
+    # woken from another thread
+    s.set(0)
+    p.register(s, IN)
+    ready(p)
+    s.set_later(IN, 20)
+    t = utime.ticks_ms()
+    check(ready(p, 2000) == [(s, IN)], 'woken by the notification')
+    check(utime.ticks_diff(utime.ticks_ms(), t) < 1000, 'woken before the timeout')
+    check(ready(p, 50) == [(s, IN)], 'still ready after wake-up')
+    s.set(0)
+    t = utime.ticks_ms()
+    check(ready(p, 50) == [], 'timeout')
+    check(utime.ticks_diff(utime.ticks_ms(), t) >= 50, 'full timeout')
+    p.unregister(s)
+
+# A poll object dropped without unregister, its entries allocated in free
+# blocks far below it, so the incremental sweep reaches them long before the
+# poll object itself.
+def drop_poll(streams):
+    gc.mode(gc.FULL)
+    hold = [bytearray(16) for i in range(20000)]
+    p = uselect.poll()
+    hold = None
+    gc.collect()
+    for s in streams:
+        p.register(s, IN)
+    for s in streams:
+        check(s.notifying(), 'notification taken')
+    gc.mode(gc.INCREMENTAL)
+
+def n_notifying(streams):
+    return sum(1 for s in streams if s.notifying())
+
+# The poll object's finaliser must remove the notifications before its
+# entries are freed and reused, while the sweep is spread over many steps.
+def test_incremental_gc():
+    gc.step_us(10)
+    streams = [host.Stream() for i in range(16)]
+    for r in range(20):
+        drop_poll(streams)
+        gc.collect()
+        # allocate over the freed entries while the sweep is pending, each
+        # allocation continues the sweep by one step
+        junk = [[i, r] * 4 for i in range(2000)]
+        # the poll object can still be found on the C stack, give it a few tries
+        for i in range(4):
+            if n_notifying(streams) == 0:
+                break
+            gc.collect()
+        check(n_notifying(streams) == 0, 'notifications removed by the finaliser')
+        # a stream notifying a freed entry would overwrite the new objects
+        for s in streams:
+            s.set(IN)
+            s.set(0)
+        check(all(j == [i, r] * 4 for i, j in enumerate(junk)), 'heap intact')
+        # a live poll object is not affected
+        p = uselect.poll()
+        p.register(streams[0], IN)
+        gc.collect()
+        streams[0].set(IN)
+        check(ready(p) == [(streams[0], IN)], 'live poll object notified')
+        streams[0].set(0)
+        p.unregister(streams[0])
+    check(gc.pause_us()[1] > 0, 'incremental pauses recorded')
+    gc.mode(gc.FULL)
+    gc.step_us(500)
+
+def make(notify):
+    p = uselect.poll()
+    streams = [host.Stream(notify) for i in range(N_IDLE + 1)]
+    for s in streams:
+        p.register(s, IN)
+    return p, streams
+
+# poll(0) with N_IDLE idle streams and one ready one
+def bench_poll(notify, n=20000):
+    p, streams = make(notify)
+    streams[-1].set(IN)
+    ready(p)
+    for s in streams:
+        s.polls()
+    best = None
+    for r in range(3):
+        t = utime.ticks_us()
+        for i in range(n):
+            p.poll(0)
+        t = utime.ticks_diff(utime.ticks_us(), t)
+        if best is None or t < best:
+            best = t
+    checks = sum(s.polls() for s in streams)
+    return best * 1000 / n, checks / (3 * n)
+
+# CPU used by poll(ms) with N_IDLE idle streams
+def bench_idle(notify, ms=500):
+    p, streams = make(notify)
+    ready(p)
+    t = host.cpu_us()
+    p.poll(ms)
+    return host.cpu_us() - t
+
+# time from the state change in the other thread to poll() returning
+def bench_wake(notify, n=30):
+    p, streams = make(notify)
+    s = streams[-1]
+    lat = []
+    for i in range(n):
+        s.set(0)
+        ready(p)
+        s.set_later(IN, 5)
+        p.poll(1000)
+        lat.append(utime.ticks_diff(utime.ticks_us(), s.set_time()))
+    lat.sort()
+    return lat[n // 2], lat[-1]
+
+test_semantics()
+print('poll semantics ok')
+test_incremental_gc()
+print('poll objects collected by the incremental GC ok')
+
+for notify in (True, False):
+    name = 'notifying' if notify else 'polled'
+    ns, checks = bench_poll(notify)
+    print('%-9s %d idle + 1 ready: poll(0) %6.0f ns, %5.1f stream checks/poll' % (name, N_IDLE, ns, checks))
+for notify in (True, False):
+    name = 'notifying' if notify else 'polled'
+    cpu = bench_idle(notify)
+    med, worst = bench_wake(notify)
+    print('%-9s %d idle: poll(500) uses %6d us CPU, wake-up latency %4d us median, %5d us worst' % (name, N_IDLE, cpu, med, worst))
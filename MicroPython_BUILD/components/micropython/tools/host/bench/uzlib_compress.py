@@ -0,0 +1,87 @@
+# uzlib compressor (extmod/uzlib/defl.c): compression ratio and MB/s of
+# compress() for a CSV log, C source text and random data at several levels
+# and window sizes, decompression speed, and CompIO writing in 512 byte
+# chunks.  Every output is decompressed and compared with the input.
+
+import utime
+import uzlib
+import uio
+
+def csv_data(lines):
+    b = uio.BytesIO()
+    for i in range(lines):
+        b.write(b'%d,sensor%d,%d.%02d,%d\n' % (1530000000 + i * 10, i % 8, 20 + i % 15, (i * 37) % 100, (i * 7919) % 1024))
+    return b.getvalue()
+
+def text_data():
+    res = b''
+    for fn in ('vm.c', 'runtime.c', 'objlist.c', 'compile.c'):
+        with open('../../../py/' + fn, 'rb') as f:
+            res += f.read()
+    return res
+
+def random_data(n):
+    b = bytearray(n)
+    x = 12345
+    for i in range(n):
+        x = (x * 1103515245 + 12345) & 0x7fffffff
+        b[i] = x >> 16
+    return bytes(b)
+
+def mbs(n, us):
+    return n / max(us, 1)
+
+# the best of 3 runs, the host timing is noisy
+def timed(fn, *args):
+    best = None
+    for i in range(3):
+        t = utime.ticks_us()
+        res = fn(*args)
+        t = utime.ticks_diff(utime.ticks_us(), t)
+        if best is None or t < best:
+            best = t
+    return res, best
+
+def bench(name, data, level, wbits):
+    c, tc = timed(uzlib.compress, data, level, wbits)
+    d, td = timed(uzlib.decompress, c, wbits)
+    if d != data:
+        raise AssertionError('%s level %d wbits %d: round trip failed' % (name, level, wbits))
+    # DecompIO sizes its dictionary from the zlib header
+    if uzlib.DecompIO(uio.BytesIO(c)).read() != data:
+        raise AssertionError('%s level %d wbits %d: DecompIO round trip failed' % (name, level, wbits))
+    print('%-8s %8d  level %d wbits %2d  %6.1f%%  compress %6.1f MB/s  decompress %6.1f MB/s' % (
+        name, len(data), level, wbits, len(c) * 100 / len(data), mbs(len(data), tc), mbs(len(data), td)))
+
+DATA = (
+    ('csv', csv_data(20000)),
+    ('text', text_data()),
+    ('random', random_data(200000)),
+)
+
+for name, data in DATA:
+    for level, wbits in ((1, 12), (6, 9), (6, 12), (6, 15), (9, 12), (9, 15)):
+        bench(name, data, level, wbits)
+    bench(name, data, 0, 12)
+
+# raw and gzip framing, decompress() has no gzip support
+data = DATA[0][1]
+if uzlib.decompress(uzlib.compress(data, 6, -12), -12) != data:
+    raise AssertionError('raw deflate: round trip failed')
+if uzlib.DecompIO(uio.BytesIO(uzlib.compress(data, 6, 28)), 28).read() != data:
+    raise AssertionError('gzip: round trip failed')
+
+# streaming: CompIO writes, sync flush half way, DecompIO reads back
+out = uio.BytesIO()
+c = uzlib.CompIO(out, 6, 12)
+t = utime.ticks_us()
+for i in range(0, len(data), 512):
+    c.write(data[i:i + 512])
+    if i == len(data) // 1024 * 512:
+        c.flush()
+c.close()
+t = utime.ticks_diff(utime.ticks_us(), t)
+comp = out.getvalue()
+if uzlib.DecompIO(uio.BytesIO(comp), 12).read() != data:
+    raise AssertionError('CompIO round trip failed')
+print('CompIO 512 byte writes: %.1f%%, %.1f MB/s, round trip ok' % (len(comp) * 100 / len(data), mbs(len(data), t)))
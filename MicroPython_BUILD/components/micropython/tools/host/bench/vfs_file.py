@@ -0,0 +1,98 @@
+# Buffered native VFS files (extmod/vfs_native_file.c) against the unbuffered
+# path: time and number of read()/write() calls for line iteration, readline,
+# small writes and large reads of a 1 MB CSV log.
+
+import gc
+import utime
+import host
+
+FN = '/tmp/vfs_file_bench.csv'
+LINES = 20000
+
+def run(name, fn):
+    gc.collect()
+    r0, w0 = host.syscalls()
+    t = utime.ticks_us()
+    res = fn()
+    t = utime.ticks_diff(utime.ticks_us(), t)
+    r1, w1 = host.syscalls()
+    print('%-28s %8d us  %7d reads  %6d writes' % (name, t, r1 - r0, w1 - w0))
+    return res
+
+def write_small(buffering):
+    def f():
+        with open(FN, 'w', buffering) as f:
+            for i in range(LINES):
+                f.write('%d,sensor%d,%d.%02d\n' % (1530000000 + i, i % 8, 20 + i % 15, i % 100))
+    return f
+
+def file_size():
+    with open(FN, 'rb') as f:
+        return f.seek(0, 2)
+
+def iter_lines(buffering):
+    def f():
+        n = 0
+        with open(FN, 'r', buffering) as f:
+            for line in f:
+                n += len(line)
+        return n
+    return f
+
+def readline_bytes(buffering):
+    def f():
+        n = 0
+        with open(FN, 'rb', buffering) as f:
+            while True:
+                line = f.readline()
+                if not line:
+                    break
+                n += 1
+        return n
+    return f
+
+def readinto(buffering):
+    def f():
+        buf = bytearray(4096)
+        n = 0
+        with open(FN, 'rb', buffering) as f:
+            while True:
+                k = f.readinto(buf)
+                if not k:
+                    break
+                n += k
+        return n
+    return f
+
+run('write, buffering=0', write_small(0))
+size = file_size()
+run('write, default buffer', write_small(-1))
+assert file_size() == size
+run('write, 4096 (malloc)', write_small(4096))
+assert file_size() == size
+print()
+assert run('iterate, buffering=0', iter_lines(0)) == size
+assert run('iterate, default buffer', iter_lines(-1)) == size
+assert run('iterate, 4096 (malloc)', iter_lines(4096)) == size
+print()
+assert run('readline, buffering=0', readline_bytes(0)) == LINES
+assert run('readline, default buffer', readline_bytes(-1)) == LINES
+print()
+assert run('readinto 4K, buffering=0', readinto(0)) == size
+assert run('readinto 4K, default buffer', readinto(-1)) == size
+
+# files that are not closed are flushed by their finaliser, the buffer must
+# still be valid when the GC runs it
+def leak(i, buffering):
+    f = open('%s.%d' % (FN, i), 'w', buffering)
+    f.write('line %d\n' % i)
+
+for i in range(200):
+    leak(i, 4096 if i & 1 else -1)
+    junk = [bytearray(64) for k in range(50)]
+gc.collect()
+gc.collect()
+for i in range(200):
+    with open('%s.%d' % (FN, i)) as f:
+        assert f.read() == 'line %d\n' % i, i
+print('\nfinaliser flush of 200 dropped files ok')
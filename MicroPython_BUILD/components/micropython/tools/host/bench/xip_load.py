@@ -0,0 +1,62 @@
+# Loading the esp32/modules from .mpy files against an execute-in-place image
+# (py/persistentcode.c), and rejection of corrupt images. The image and the
+# .mpy files are made by "make bench".
+
+import gc
+import ustruct as struct
+import utime
+import host
+
+DIR = '../build/xip/'
+
+names = open(DIR + 'modules.txt').read().split()
+mpys = [open(DIR + n + '.mpy', 'rb').read() for n in names]
+image = open(DIR + 'modules.img', 'rb').read()
+print('%d modules, %d bytes of .mpy, %d byte image' % (len(names), sum(len(m) for m in mpys), len(image)))
+
+def run(name, fn):
+    h = host.heap_used()
+    t = utime.ticks_us()
+    res = fn()
+    t = utime.ticks_diff(utime.ticks_us(), t)
+    print('%-20s %6d us  %7d bytes of heap' % (name, t, host.heap_used() - h))
+    return res
+
+funs = run('load .mpy', lambda: [host.load_mpy(m) for m in mpys])
+del funs
+run('mount image', lambda: host.xip_mount(image))
+funs = run('load from image', lambda: [host.load_xip(n + '.py') for n in names])
+
+# bytecode run in place resolves its qstrs through the image's table
+import functools
+assert functools.partial(lambda a, b: a - b, 10)(3) == 7
+assert functools.reduce(lambda a, b: a * b, [1, 2, 3, 4]) == 24
+print('functools from the image ok')
+
+def expect_corrupt(what, img):
+    host.xip_mount(img)
+    for n in names:
+        try:
+            host.load_xip(n + '.py')
+        except ValueError as e:
+            print('%s: %s' % (what, e))
+            return
+    raise AssertionError(what + ' not detected')
+
+# the last qstr of the table is out of range once n_qstr is one less
+bad = bytearray(image)
+n_qstr = struct.unpack_from('<I', bad, 12)[0]
+struct.pack_into('<I', bad, 12, n_qstr - 1)
+expect_corrupt('qstr index beyond the table', bad)
+
+# a raw code record that lists itself as its child
+bad = bytearray(image)
+n_module, module_table = struct.unpack_from('<II', bad, 20)
+for i in range(n_module):
+    off = struct.unpack_from('<I', bad, module_table + 8 * i + 4)[0]
+    bc, bc_len, n_obj, n_raw_code, n_arg = struct.unpack_from('<IIHHH', bad, off)
+    if n_raw_code:
+        child = off + 16 + ((n_arg + 1) & ~1) * 2 + n_obj * 4
+        struct.pack_into('<I', bad, child, off)
+        break
+expect_corrupt('raw code cycle', bad)
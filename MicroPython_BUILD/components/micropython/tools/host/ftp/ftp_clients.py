@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+#
+# Load test for the FTP server built for the host (ftp_host.c): starts the
+# server, runs several clients in parallel that download a large file, upload
+# a file and list the directory, and checks every transfer.
+#
+#   python3 ftp_clients.py --server ../build/ftpd --root ../build/ftproot
+
+import argparse
+import ftplib
+import hashlib
+import io
+import os
+import subprocess
+import sys
+import threading
+import time
+
+def client(args, i, big, res):
+    f = ftplib.FTP()
+    f.connect('127.0.0.1', args.port, timeout=30)
+    f.login('micro', 'python')
+    f.cwd('/flash')
+    t = time.time()
+    buf = io.BytesIO()
+    f.retrbinary('RETR big.bin', buf.write)
+    t_retr = time.time() - t
+    up = os.urandom(args.upload + i)
+    t = time.time()
+    f.storbinary('STOR up%d.bin' % i, io.BytesIO(up))
+    t_stor = time.time() - t
+    listing = []
+    f.retrlines('LIST', listing.append)
+    names = f.nlst()
+    f.quit()
+    res[i] = (buf.getvalue() == big, up, t_retr, t_stor, len(listing), names)
+
+def main():
+    p = argparse.ArgumentParser()
+    p.add_argument('--server', required=True, help='ftp server binary built with FTP_HOST_BUILD')
+    p.add_argument('--root', required=True, help='FTP_HOST_ROOT the server was built with')
+    p.add_argument('--port', type=int, default=2121)
+    p.add_argument('--clients', type=int, default=4)
+    p.add_argument('--size', type=int, default=3 * 1024 * 1024, help='size of the downloaded file')
+    p.add_argument('--upload', type=int, default=500000, help='size of the uploaded files')
+    args = p.parse_args()
+
+    flash = os.path.join(args.root, 'flash')
+    os.makedirs(flash, exist_ok=True)
+    big = os.urandom(args.size)
+    with open(os.path.join(flash, 'big.bin'), 'wb') as f:
+        f.write(big)
+
+    server = subprocess.Popen([args.server])
+    time.sleep(0.5)
+    ok = True
+    try:
+        res = [None] * args.clients
+        threads = [threading.Thread(target=client, args=(args, i, big, res)) for i in range(args.clients)]
+        t = time.time()
+        for th in threads:
+            th.start()
+        for th in threads:
+            th.join()
+        t = time.time() - t
+
+        for i, r in enumerate(res):
+            if r is None:
+                print('client %d: failed' % i)
+                ok = False
+                continue
+            retr_ok, up, t_retr, t_stor, n_list, names = r
+            with open(os.path.join(flash, 'up%d.bin' % i), 'rb') as f:
+                stor_ok = f.read() == up
+            nlst_ok = 'big.bin' in names and ('up%d.bin' % i) in names
+            print('client %d: RETR %s %.2f MB/s, STOR %s %.2f MB/s, LIST %d entries, NLST %s' % (i,
+                'ok' if retr_ok else 'CORRUPT', args.size / t_retr / 1e6,
+                'ok' if stor_ok else 'CORRUPT', len(up) / t_stor / 1e6, n_list, 'ok' if nlst_ok else 'MISSING'))
+            ok = ok and retr_ok and stor_ok and nlst_ok
+        total = args.clients * args.size + sum(len(r[1]) for r in res if r)
+        print('%d clients in parallel: %.2f s, %.2f MB/s in total' % (args.clients, t, total / t / 1e6))
+    finally:
+        server.terminate()
+        server.wait()
+    if not ok:
+        sys.exit(1)
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,101 @@
+/*
+ * This file is part of the MicroPython ESP32 project, https://github.com/loboris/MicroPython_ESP32_psRAM_LoBo
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Runs the FTP server core (esp32/libs/ftp.c) on a POSIX host, for load tests
+ * with several parallel clients, see ftp_clients.py and "make ftp-test".
+ * The host directory FTP_HOST_ROOT/flash is served as /flash.
+ * Statistics are printed to stderr every two seconds.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <sys/time.h>
+
+#include "libs/ftp.h"
+
+static volatile bool ftp_host_quit = false;
+
+//---------------------------------
+static void ftp_host_sig(int sig) {
+	(void)sig;
+	ftp_host_quit = true;
+}
+
+//-----------------------------
+static uint64_t ftp_host_ms(void) {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000ULL + tv.tv_usec / 1000;
+}
+
+//-------------------------------------
+static void ftp_host_print_stats(void) {
+	ftp_stats_t st;
+	if (!ftp_get_stats(&st, false)) return;
+	fprintf(stderr, "sessions %u/%u, tx %u bytes in %u files, rx %u bytes in %u files, busy %u ms, rate tx %u rx %u bytes/s\n",
+		st.sessions, st.max_sessions, st.bytes_tx, st.files_tx, st.bytes_rx, st.files_rx, st.busy_ms, st.rate_tx, st.rate_rx);
+}
+
+//----------------------------------
+int main(int argc, char **argv) {
+	signal(SIGINT, ftp_host_sig);
+	signal(SIGTERM, ftp_host_sig);
+	signal(SIGPIPE, SIG_IGN);
+
+	// ftp_run() only checks that the server task exists
+	FtpTaskHandle = (TaskHandle_t)1;
+	strcpy(ftp_user, FTP_DEF_USER);
+	strcpy(ftp_pass, FTP_DEF_PASS);
+	if (argc > 2) {
+		snprintf(ftp_user, sizeof(ftp_user), "%s", argv[1]);
+		snprintf(ftp_pass, sizeof(ftp_pass), "%s", argv[2]);
+	}
+	if (!ftp_init()) {
+		fprintf(stderr, "ftp_init failed\n");
+		return 1;
+	}
+	ftp_enable();
+	fprintf(stderr, "ftp server running\n");
+
+	uint64_t last = ftp_host_ms();
+	uint64_t last_stats = last;
+	while (!ftp_host_quit) {
+		uint64_t now = ftp_host_ms();
+		if (ftp_run(now - last) < 0) break;
+		last = now;
+		if (now - last_stats >= 2000) {
+			ftp_host_print_stats();
+			last_stats = now;
+		}
+	}
+	ftp_host_print_stats();
+	ftp_deinit();
+	return 0;
+}
@@ -0,0 +1,446 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Modules of the host build: utime, open() on the native VFS file objects
+ * and 'host' with helpers for the benchmark scripts.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "py/runtime.h"
+#include "py/gc.h"
+#include "py/stream.h"
+#include "py/mperrno.h"
+#include "py/mphal.h"
+#include "py/smallint.h"
+#include "py/emitglue.h"
+#include "py/persistentcode.h"
+#include "extmod/utime_mphal.h"
+#include "extmod/vfs_native.h"
+#include "extmod/moduselect.h"
+
+// ==== utime ====
+
+//========================================================
+STATIC const mp_rom_map_elem_t utime_globals_table[] = {
+	{ MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_utime) },
+	{ MP_ROM_QSTR(MP_QSTR_sleep), MP_ROM_PTR(&mp_utime_sleep_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_sleep_ms), MP_ROM_PTR(&mp_utime_sleep_ms_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_sleep_us), MP_ROM_PTR(&mp_utime_sleep_us_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_ticks_ms), MP_ROM_PTR(&mp_utime_ticks_ms_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_ticks_us), MP_ROM_PTR(&mp_utime_ticks_us_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_ticks_diff), MP_ROM_PTR(&mp_utime_ticks_diff_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_ticks_add), MP_ROM_PTR(&mp_utime_ticks_add_obj) },
+};
+STATIC MP_DEFINE_CONST_DICT(utime_globals, utime_globals_table);
+
+//====================================
+const mp_obj_module_t mp_module_utime = {
+	.base = { &mp_type_module },
+	.globals = (mp_obj_dict_t*)&utime_globals,
+};
+
+// ==== open() on the native VFS file objects, paths are host paths ====
+
+STATIC fs_user_mount_t host_vfs = { { NULL }, 0 };
+
+//----------------------------------------------------------------------------------------
+const char *mkabspath(fs_user_mount_t *vfs, const char *path, char *absbuf, int buflen) {
+	(void)vfs;
+	if (strlen(path) >= (size_t)buflen) return NULL;
+	strcpy(absbuf, path);
+	return absbuf;
+}
+
+//------------------------------------------------------------------------------
+STATIC mp_obj_t host_open(size_t n_args, const mp_obj_t *args, mp_map_t *kwargs) {
+	enum { ARG_file, ARG_mode, ARG_buffering };
+	static const mp_arg_t allowed_args[] = {
+		{ MP_QSTR_file, MP_ARG_OBJ | MP_ARG_REQUIRED, {.u_rom_obj = MP_ROM_PTR(&mp_const_none_obj)} },
+		{ MP_QSTR_mode, MP_ARG_OBJ, {.u_obj = MP_OBJ_NEW_QSTR(MP_QSTR_r)} },
+		{ MP_QSTR_buffering, MP_ARG_INT, {.u_int = -1} },
+	};
+	mp_arg_val_t vals[MP_ARRAY_SIZE(allowed_args)];
+	mp_arg_parse_all(n_args, args, kwargs, MP_ARRAY_SIZE(allowed_args), allowed_args, vals);
+	return nativefs_builtin_open_self(MP_OBJ_FROM_PTR(&host_vfs), vals[ARG_file].u_obj, vals[ARG_mode].u_obj, vals[ARG_buffering].u_int);
+}
+MP_DEFINE_CONST_FUN_OBJ_KW(mp_builtin_open_obj, 1, host_open);
+
+// ==== host ====
+
+// Heap in use after a full collection
+//-------------------------------------
+STATIC mp_obj_t host_heap_used(void) {
+	gc_collect(0);
+	gc_info_t info;
+	gc_info(&info);
+	return MP_OBJ_NEW_SMALL_INT(info.used);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(host_heap_used_obj, host_heap_used);
+
+// Number of read() and write() calls made by the program so far,
+// counted by wrapping the libc functions (-Wl,--wrap, see Makefile)
+static int host_n_read, host_n_write;
+
+ssize_t __real_read(int fd, void *buf, size_t count);
+ssize_t __real_write(int fd, const void *buf, size_t count);
+
+//--------------------------------------------------------
+ssize_t __wrap_read(int fd, void *buf, size_t count) {
+	host_n_read++;
+	return __real_read(fd, buf, count);
+}
+
+//---------------------------------------------------------------
+ssize_t __wrap_write(int fd, const void *buf, size_t count) {
+	host_n_write++;
+	return __real_write(fd, buf, count);
+}
+
+//----------------------------------
+STATIC mp_obj_t host_syscalls(void) {
+	mp_obj_t t[2] = { MP_OBJ_NEW_SMALL_INT(host_n_read), MP_OBJ_NEW_SMALL_INT(host_n_write) };
+	return mp_obj_new_tuple(2, t);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(host_syscalls_obj, host_syscalls);
+
+#if MICROPY_PERSISTENT_CODE_XIP
+// Loader helpers: build the raw code of a module, without running it
+
+// Mount an image; it is copied to the C heap where it stays, as a mapped partition would
+//-------------------------------------------
+STATIC mp_obj_t host_xip_mount(mp_obj_t data) {
+	mp_buffer_info_t bufinfo;
+	mp_get_buffer_raise(data, &bufinfo, MP_BUFFER_READ);
+	byte *image = malloc(bufinfo.len);
+	memcpy(image, bufinfo.buf, bufinfo.len);
+	mp_raw_code_xip_mount(image, bufinfo.len);
+	return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(host_xip_mount_obj, host_xip_mount);
+
+//-------------------------------------------
+STATIC mp_obj_t host_load_xip(mp_obj_t name) {
+	size_t len;
+	const char *str = mp_obj_str_get_data(name, &len);
+	mp_raw_code_t *rc = mp_raw_code_xip_find(str, len);
+	if (rc == NULL) mp_raise_OSError(MP_ENOENT);
+	return mp_make_function_from_raw_code(rc, MP_OBJ_NULL, MP_OBJ_NULL);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(host_load_xip_obj, host_load_xip);
+
+//-------------------------------------------
+STATIC mp_obj_t host_load_mpy(mp_obj_t data) {
+	mp_buffer_info_t bufinfo;
+	mp_get_buffer_raise(data, &bufinfo, MP_BUFFER_READ);
+	mp_raw_code_t *rc = mp_raw_code_load_mem(bufinfo.buf, bufinfo.len);
+	return mp_make_function_from_raw_code(rc, MP_OBJ_NULL, MP_OBJ_NULL);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(host_load_mpy_obj, host_load_mpy);
+#endif
+
+// Process CPU time, to see how much a waiting poll() burns
+//--------------------------------
+STATIC mp_obj_t host_cpu_us(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+	return mp_obj_new_int_from_ull(t.tv_sec * 1000000ULL + t.tv_nsec / 1000);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(host_cpu_us_obj, host_cpu_us);
+
+#if MICROPY_PY_UJSON
+// JSON output through the generic print machinery, as ujson.dump/dumps did
+// before the buffered encoder, to compare with it: json_print(obj[, stream])
+//-------------------------------------------------------------------
+STATIC mp_obj_t host_json_print(size_t n_args, const mp_obj_t *args) {
+	if (n_args > 1) {
+		mp_print_t print = {MP_OBJ_TO_PTR(args[1]), mp_stream_write_adaptor};
+		mp_obj_print_helper(&print, args[0], PRINT_JSON);
+		return mp_const_none;
+	}
+	vstr_t vstr;
+	mp_print_t print;
+	vstr_init_print(&vstr, 8, &print);
+	mp_obj_print_helper(&print, args[0], PRINT_JSON);
+	return mp_obj_new_str_from_vstr(&mp_type_str, &vstr);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(host_json_print_obj, 1, 2, host_json_print);
+#endif
+
+#if MICROPY_PY_USELECT_NOTIFY
+// ==== uselect.poll readiness notification, the semaphore is a condition variable ====
+
+typedef struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool given;
+} host_poll_sem_t;
+
+static pthread_mutex_t host_poll_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+//----------------------------
+void *mp_hal_poll_sem_new(void) {
+	host_poll_sem_t *sem = malloc(sizeof(host_poll_sem_t));
+	if (sem == NULL) mp_raise_msg(&mp_type_MemoryError, "error creating poll semaphore");
+	pthread_mutex_init(&sem->mutex, NULL);
+	pthread_cond_init(&sem->cond, NULL);
+	sem->given = false;
+	return sem;
+}
+
+//-----------------------------------
+void mp_hal_poll_sem_delete(void *sem) {
+	host_poll_sem_t *s = sem;
+	pthread_cond_destroy(&s->cond);
+	pthread_mutex_destroy(&s->mutex);
+	free(s);
+}
+
+//---------------------------------
+void mp_hal_poll_sem_give(void *sem) {
+	host_poll_sem_t *s = sem;
+	pthread_mutex_lock(&s->mutex);
+	s->given = true;
+	pthread_cond_signal(&s->cond);
+	pthread_mutex_unlock(&s->mutex);
+}
+
+//---------------------------------------------------------
+void mp_hal_poll_sem_take(void *sem, mp_uint_t timeout_ms) {
+	host_poll_sem_t *s = sem;
+	struct timespec t;
+	#if MICROPY_GC_INCREMENTAL
+	// as on esp32, the pending sweep continues while waiting
+	gc_step();
+	#endif
+	clock_gettime(CLOCK_REALTIME, &t);
+	t.tv_sec += timeout_ms / 1000;
+	t.tv_nsec += (timeout_ms % 1000) * 1000000;
+	if (t.tv_nsec >= 1000000000) {
+		t.tv_sec++;
+		t.tv_nsec -= 1000000000;
+	}
+	pthread_mutex_lock(&s->mutex);
+	while (!s->given) {
+		if (pthread_cond_timedwait(&s->cond, &s->mutex, &t) != 0) break;
+	}
+	s->given = false;
+	pthread_mutex_unlock(&s->mutex);
+}
+
+//-------------------------
+void mp_hal_poll_lock(void) {
+	pthread_mutex_lock(&host_poll_mutex);
+}
+
+//---------------------------
+void mp_hal_poll_unlock(void) {
+	pthread_mutex_unlock(&host_poll_mutex);
+}
+
+// ==== host.Stream, a fake stream for the poll tests ====
+// Its poll state is set with set(), or with set_later() from another thread.
+// With notify=False it has no readiness notification, as most streams.
+
+typedef struct _host_stream_obj_t {
+	mp_obj_base_t base;
+	volatile mp_uint_t state;
+	bool notify;
+	mp_uint_t n_polls;			// MP_STREAM_POLL requests
+	mp_poll_notify_t *notifier;
+	uint64_t set_us;			// when set_later() set the state
+} host_stream_obj_t;
+
+STATIC const mp_obj_type_t host_stream_type;
+
+//---------------------------------------------------------------------------------------------------------
+STATIC mp_obj_t host_stream_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+	mp_arg_check_num(n_args, n_kw, 0, 1, false);
+	host_stream_obj_t *self = m_new_obj(host_stream_obj_t);
+	self->base.type = &host_stream_type;
+	self->state = 0;
+	self->notify = (n_args == 0) || mp_obj_is_true(args[0]);
+	self->n_polls = 0;
+	self->notifier = NULL;
+	self->set_us = 0;
+	return MP_OBJ_FROM_PTR(self);
+}
+
+//------------------------------------------------------------------------------------------------
+STATIC mp_uint_t host_stream_ioctl(mp_obj_t self_in, mp_uint_t request, uintptr_t arg, int *errcode) {
+	host_stream_obj_t *self = MP_OBJ_TO_PTR(self_in);
+	if (request == MP_STREAM_POLL) {
+		self->n_polls++;
+		return self->state & arg;
+	}
+	if (self->notify && ((request == MP_STREAM_POLL_NOTIFY) || (request == MP_STREAM_POLL_NOTIFY_CLEAR))) {
+		// a single notifier, as the UART and socket streams
+		mp_poll_notify_t *notify = (mp_poll_notify_t *)arg;
+		mp_uint_t ret = 0;
+		mp_hal_poll_lock();
+		if (request == MP_STREAM_POLL_NOTIFY_CLEAR) {
+			if (self->notifier == notify) self->notifier = NULL;
+		}
+		else if ((self->notifier == NULL) || (self->notifier == notify)) self->notifier = notify;
+		else {
+			*errcode = MP_EBUSY;
+			ret = MP_STREAM_ERROR;
+		}
+		mp_hal_poll_unlock();
+		return ret;
+	}
+	*errcode = MP_EINVAL;
+	return MP_STREAM_ERROR;
+}
+
+//-----------------------------------------------------------
+STATIC void host_stream_set_state(host_stream_obj_t *self, mp_uint_t state) {
+	self->state = state;
+	mp_poll_notify_slot(&self->notifier);
+}
+
+//----------------------------------------------------------------
+STATIC mp_obj_t host_stream_set(mp_obj_t self_in, mp_obj_t state_in) {
+	host_stream_set_state(MP_OBJ_TO_PTR(self_in), mp_obj_get_int(state_in));
+	return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(host_stream_set_obj, host_stream_set);
+
+typedef struct {
+	host_stream_obj_t *stream;
+	mp_uint_t state;
+	mp_uint_t delay_ms;
+} host_stream_later_t;
+
+//---------------------------------------------
+STATIC void *host_stream_later_task(void *arg) {
+	host_stream_later_t *later = arg;
+	usleep(later->delay_ms * 1000);
+	later->stream->set_us = mp_hal_ticks_us();
+	host_stream_set_state(later->stream, later->state);
+	free(later);
+	return NULL;
+}
+
+// Set the state from another thread after delay_ms, as a driver task would
+//------------------------------------------------------------------------------------
+STATIC mp_obj_t host_stream_set_later(mp_obj_t self_in, mp_obj_t state_in, mp_obj_t delay_in) {
+	host_stream_later_t *later = malloc(sizeof(host_stream_later_t));
+	later->stream = MP_OBJ_TO_PTR(self_in);
+	later->state = mp_obj_get_int(state_in);
+	later->delay_ms = mp_obj_get_int(delay_in);
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, host_stream_later_task, later) != 0) {
+		free(later);
+		mp_raise_OSError(MP_ENOMEM);
+	}
+	pthread_detach(thread);
+	return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(host_stream_set_later_obj, host_stream_set_later);
+
+// Time of the last set_later(), in ticks_us()
+//---------------------------------------------------
+STATIC mp_obj_t host_stream_set_time(mp_obj_t self_in) {
+	host_stream_obj_t *self = MP_OBJ_TO_PTR(self_in);
+	return mp_obj_new_int_from_ull(self->set_us & (MICROPY_PY_UTIME_TICKS_PERIOD - 1));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(host_stream_set_time_obj, host_stream_set_time);
+
+// Number of MP_STREAM_POLL requests since the last call
+//-----------------------------------------------
+STATIC mp_obj_t host_stream_polls(mp_obj_t self_in) {
+	host_stream_obj_t *self = MP_OBJ_TO_PTR(self_in);
+	mp_uint_t n = self->n_polls;
+	self->n_polls = 0;
+	return MP_OBJ_NEW_SMALL_INT(n);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(host_stream_polls_obj, host_stream_polls);
+
+// True if a poll object holds the readiness notification
+//---------------------------------------------------
+STATIC mp_obj_t host_stream_notifying(mp_obj_t self_in) {
+	host_stream_obj_t *self = MP_OBJ_TO_PTR(self_in);
+	return mp_obj_new_bool(self->notifier != NULL);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(host_stream_notifying_obj, host_stream_notifying);
+
+//=============================================================
+STATIC const mp_rom_map_elem_t host_stream_locals_dict_table[] = {
+	{ MP_ROM_QSTR(MP_QSTR_set), MP_ROM_PTR(&host_stream_set_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_set_later), MP_ROM_PTR(&host_stream_set_later_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_set_time), MP_ROM_PTR(&host_stream_set_time_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_polls), MP_ROM_PTR(&host_stream_polls_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_notifying), MP_ROM_PTR(&host_stream_notifying_obj) },
+};
+STATIC MP_DEFINE_CONST_DICT(host_stream_locals_dict, host_stream_locals_dict_table);
+
+//=============================================
+STATIC const mp_stream_p_t host_stream_p = {
+	.ioctl = host_stream_ioctl,
+};
+
+//=============================================
+STATIC const mp_obj_type_t host_stream_type = {
+	{ &mp_type_type },
+	.name = MP_QSTR_Stream,
+	.make_new = host_stream_make_new,
+	.protocol = &host_stream_p,
+	.locals_dict = (mp_obj_dict_t*)&host_stream_locals_dict,
+};
+#endif
+
+//=======================================================
+STATIC const mp_rom_map_elem_t host_globals_table[] = {
+	{ MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_host) },
+	{ MP_ROM_QSTR(MP_QSTR_heap_used), MP_ROM_PTR(&host_heap_used_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_syscalls), MP_ROM_PTR(&host_syscalls_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_cpu_us), MP_ROM_PTR(&host_cpu_us_obj) },
+	#if MICROPY_PY_UJSON
+	{ MP_ROM_QSTR(MP_QSTR_json_print), MP_ROM_PTR(&host_json_print_obj) },
+	#endif
+	#if MICROPY_PY_USELECT_NOTIFY
+	{ MP_ROM_QSTR(MP_QSTR_Stream), MP_ROM_PTR(&host_stream_type) },
+	#endif
+	#if MICROPY_PERSISTENT_CODE_XIP
+	{ MP_ROM_QSTR(MP_QSTR_xip_mount), MP_ROM_PTR(&host_xip_mount_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_load_xip), MP_ROM_PTR(&host_load_xip_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_load_mpy), MP_ROM_PTR(&host_load_mpy_obj) },
+	#endif
+};
+STATIC MP_DEFINE_CONST_DICT(host_globals, host_globals_table);
+
+//===================================
+const mp_obj_module_t mp_module_host = {
+	.base = { &mp_type_module },
+	.globals = (mp_obj_dict_t*)&host_globals,
+};
@@ -0,0 +1,256 @@
+/*
+ * This file is part of the MicroPython ESP32 project, https://github.com/loboris/MicroPython_ESP32_psRAM_LoBo
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Runs the LittleFS driver (esp32/libs/littleflash.c) on a RAM backed flash
+ * partition, see "make littleflash-test".
+ * The partition behaves like NOR flash: erase sets a sector to 0xFF, writes
+ * can only clear bits. A write which would set a bit fails the test.
+ * For each workload the flash reads, writes and erases and the bytes
+ * transferred are printed, then the file system is remounted and all files
+ * are checked.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <fcntl.h>
+
+#include "sdkconfig.h"
+#include "libs/littleflash.h"
+
+#define HOST_PART_SIZE	(256 * 1024)
+
+typedef struct {
+	uint32_t reads;
+	uint32_t writes;
+	uint32_t erases;
+	uint64_t read_bytes;
+	uint64_t write_bytes;
+} host_flash_stats_t;
+
+static uint8_t host_flash[HOST_PART_SIZE];
+static host_flash_stats_t host_stats;
+static bool host_flash_bad = false;
+
+static esp_vfs_t host_vfs;
+static void *host_vfs_ctx = NULL;
+
+// ============================================================================
+// RAM backed partition
+// ============================================================================
+
+//----------------------------------------------------------------------------------------------
+esp_err_t esp_partition_read(const esp_partition_t *part, size_t src_offset, void *dst, size_t size)
+{
+	if ((src_offset + size) > part->size) return ESP_FAIL;
+	host_stats.reads++;
+	host_stats.read_bytes += size;
+	memcpy(dst, host_flash + src_offset, size);
+	return ESP_OK;
+}
+
+//----------------------------------------------------------------------------------------------------
+esp_err_t esp_partition_write(const esp_partition_t *part, size_t dst_offset, const void *src, size_t size)
+{
+	if ((dst_offset + size) > part->size) return ESP_FAIL;
+	host_stats.writes++;
+	host_stats.write_bytes += size;
+	const uint8_t *data = src;
+	for (size_t i=0; i<size; i++) {
+		// NOR flash can only clear bits
+		if (~host_flash[dst_offset+i] & data[i]) {
+			if (!host_flash_bad) printf("write to 0x%06x sets bits of a programmed byte\n", (unsigned)(dst_offset+i));
+			host_flash_bad = true;
+		}
+		host_flash[dst_offset+i] &= data[i];
+	}
+	return ESP_OK;
+}
+
+//-----------------------------------------------------------------------------------------
+esp_err_t esp_partition_erase_range(const esp_partition_t *part, size_t start_addr, size_t size)
+{
+	if (((start_addr % SPI_FLASH_SEC_SIZE) != 0) || ((size % SPI_FLASH_SEC_SIZE) != 0)) return ESP_FAIL;
+	if ((start_addr + size) > part->size) return ESP_FAIL;
+	host_stats.erases += size / SPI_FLASH_SEC_SIZE;
+	memset(host_flash + start_addr, 0xFF, size);
+	return ESP_OK;
+}
+
+//------------------------------------------------------------------------
+esp_err_t esp_vfs_register(const char *base_path, const esp_vfs_t *vfs, void *ctx)
+{
+	host_vfs = *vfs;
+	host_vfs_ctx = ctx;
+	return ESP_OK;
+}
+
+//------------------------------------------------
+esp_err_t esp_vfs_unregister(const char *base_path)
+{
+	host_vfs_ctx = NULL;
+	return ESP_OK;
+}
+
+#ifdef LITTLEFLASH_HOST_STRLCPY
+//-------------------------------------------------------
+size_t strlcpy(char *dst, const char *src, size_t size)
+{
+	size_t len = strlen(src);
+	if (size > 0) {
+		size_t n = (len < size) ? len : size - 1;
+		memcpy(dst, src, n);
+		dst[n] = '\0';
+	}
+	return len;
+}
+#endif
+
+// ============================================================================
+// Workloads
+// ============================================================================
+
+static esp_partition_t host_part = { HOST_PART_SIZE, "internalfs" };
+static little_flash_config_t host_cfg = { &host_part, "/flash", 4, true, 32 };
+
+//----------------------------------------------
+static void host_report(const char *name, int ops)
+{
+	printf("%-34s %5u reads %5u writes %4u erases  %8llu B read %8llu B written",
+			name, host_stats.reads, host_stats.writes, host_stats.erases,
+			(unsigned long long)host_stats.read_bytes, (unsigned long long)host_stats.write_bytes);
+	if (ops > 0) printf("  %5.1f flash ops/op", (double)(host_stats.reads + host_stats.writes + host_stats.erases) / ops);
+	printf("\n");
+	memset(&host_stats, 0, sizeof(host_stats));
+}
+
+//------------------------------------------------------------------------------------
+static int host_write_file(const char *path, int flags, const uint8_t *data, int size, int chunk)
+{
+	int fd = host_vfs.open_p(host_vfs_ctx, path, flags, 0);
+	if (fd < 0) {
+		printf("open %s failed\n", path);
+		return -1;
+	}
+	for (int pos=0; pos<size; pos+=chunk) {
+		int n = ((size - pos) < chunk) ? (size - pos) : chunk;
+		if (host_vfs.write_p(host_vfs_ctx, fd, data + pos, n) != n) {
+			printf("write %s failed\n", path);
+			host_vfs.close_p(host_vfs_ctx, fd);
+			return -1;
+		}
+	}
+	return host_vfs.close_p(host_vfs_ctx, fd);
+}
+
+//----------------------------------------------------------------------------
+static bool host_check_file(const char *path, const uint8_t *data, int size)
+{
+	static uint8_t buf[HOST_PART_SIZE];
+	int fd = host_vfs.open_p(host_vfs_ctx, path, O_RDONLY, 0);
+	if (fd < 0) {
+		printf("%s: open failed\n", path);
+		return false;
+	}
+	int n = host_vfs.read_p(host_vfs_ctx, fd, buf, sizeof(buf));
+	host_vfs.close_p(host_vfs_ctx, fd);
+	if ((n != size) || (memcmp(buf, data, size) != 0)) {
+		printf("%s: read %d bytes, expected %d, content %s\n", path, n, size, (n == size) ? "differs" : "not checked");
+		return false;
+	}
+	return true;
+}
+
+//-------------------------
+int main(int argc, char **argv)
+{
+	static uint8_t log_data[16384];
+	static uint8_t cfg_data[256];
+	static uint8_t bulk_data[64 * 1024];
+	int log_len = 0;
+	int res = 0;
+
+	printf("littleflash on a %d KB RAM partition, %d cached sectors\n", HOST_PART_SIZE / 1024, CONFIG_LITTLEFLASH_CACHE_SECTORS);
+
+	// not formatted, as a new partition
+	memset(host_flash, 0x5A, sizeof(host_flash));
+	if (littleFlash_init(&host_cfg) != ESP_OK) {
+		printf("init failed\n");
+		return 1;
+	}
+	host_report("format and mount", 0);
+
+	// log file, each line appended with open/write/close
+	for (int i=0; i<200; i++) {
+		int n = sprintf((char *)log_data + log_len, "%06d,sensor,%d.%02d\n", i, 20 + (i % 7), (i * 37) % 100);
+		if (host_write_file("/log.csv", O_WRONLY | O_CREAT | O_APPEND, log_data + log_len, n, n) < 0) return 1;
+		log_len += n;
+	}
+	host_report("200 log line appends", 200);
+
+	// small configuration file, rewritten
+	for (int i=0; i<50; i++) {
+		for (int j=0; j<sizeof(cfg_data); j++) cfg_data[j] = (uint8_t)(i + j);
+		if (host_write_file("/config.bin", O_WRONLY | O_CREAT | O_TRUNC, cfg_data, sizeof(cfg_data), sizeof(cfg_data)) < 0) return 1;
+	}
+	host_report("50 rewrites of a 256 B file", 50);
+
+	// large file written in 512 byte chunks
+	uint32_t seed = 12345;
+	for (int i=0; i<sizeof(bulk_data); i++) {
+		seed = seed * 1103515245 + 12345;
+		bulk_data[i] = (uint8_t)(seed >> 16);
+	}
+	if (host_write_file("/bulk.bin", O_WRONLY | O_CREAT | O_TRUNC, bulk_data, sizeof(bulk_data), 512) < 0) return 1;
+	host_report("64 KB file in 512 B writes", sizeof(bulk_data) / 512);
+
+	if (!host_check_file("/bulk.bin", bulk_data, sizeof(bulk_data))) res = 1;
+	host_report("64 KB file read back", 0);
+
+	printf("driver stats: %u reads %u writes %u erases %u cache hits\n",
+			littleFlash.stats.reads, littleFlash.stats.writes, littleFlash.stats.erases, littleFlash.stats.cache_hits);
+	littleFlash_term(host_cfg.base_path);
+	host_report("unmount", 0);
+
+	// remount and check the content
+	memset(&littleFlash, 0, sizeof(littleFlash));
+	host_cfg.auto_format = false;
+	if (littleFlash_init(&host_cfg) != ESP_OK) {
+		printf("remount failed\n");
+		return 1;
+	}
+	if (!host_check_file("/log.csv", log_data, log_len)) res = 1;
+	if (!host_check_file("/config.bin", cfg_data, sizeof(cfg_data))) res = 1;
+	if (!host_check_file("/bulk.bin", bulk_data, sizeof(bulk_data))) res = 1;
+	host_report("remount and check", 0);
+	littleFlash_term(host_cfg.base_path);
+
+	if (host_flash_bad) res = 1;
+	printf("%s\n", (res == 0) ? "ok" : "FAILED");
+	return res;
+}
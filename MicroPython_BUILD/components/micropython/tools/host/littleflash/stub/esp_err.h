@@ -0,0 +1,6 @@
+// ESP-IDF error codes used by the littleflash driver in the host build
+#pragma once
+typedef int esp_err_t;
+#define ESP_OK          0
+#define ESP_FAIL        -1
+#define ESP_ERR_NO_MEM  0x101
@@ -0,0 +1,5 @@
+// DMA capable memory is plain malloc in the host build
+#pragma once
+#include <stdlib.h>
+#define MALLOC_CAP_DMA (1 << 3)
+#define heap_caps_malloc(size, caps) malloc(size)
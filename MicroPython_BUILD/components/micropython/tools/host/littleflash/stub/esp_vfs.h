@@ -0,0 +1,40 @@
+// ESP-IDF VFS interface, esp_vfs_register() is implemented by littleflash_host.c
+#pragma once
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include "esp_err.h"
+
+// the driver embeds DIR in its directory object, as newlib defines it
+struct __dirstream {
+    int dd_vfs_idx;
+    int dd_rsv;
+};
+
+#define ESP_VFS_FLAG_CONTEXT_PTR 1
+
+typedef struct {
+    int flags;
+    ssize_t (*write_p)(void *ctx, int fd, const void *data, size_t size);
+    off_t (*lseek_p)(void *ctx, int fd, off_t size, int mode);
+    ssize_t (*read_p)(void *ctx, int fd, void *dst, size_t size);
+    int (*open_p)(void *ctx, const char *path, int flags, int mode);
+    int (*close_p)(void *ctx, int fd);
+    int (*fstat_p)(void *ctx, int fd, struct stat *st);
+    int (*stat_p)(void *ctx, const char *path, struct stat *st);
+    int (*unlink_p)(void *ctx, const char *path);
+    int (*rename_p)(void *ctx, const char *src, const char *dst);
+    DIR *(*opendir_p)(void *ctx, const char *name);
+    struct dirent *(*readdir_p)(void *ctx, DIR *pdir);
+    int (*readdir_r_p)(void *ctx, DIR *pdir, struct dirent *entry, struct dirent **out_dirent);
+    long (*telldir_p)(void *ctx, DIR *pdir);
+    void (*seekdir_p)(void *ctx, DIR *pdir, long offset);
+    int (*closedir_p)(void *ctx, DIR *pdir);
+    int (*mkdir_p)(void *ctx, const char *name, mode_t mode);
+    int (*rmdir_p)(void *ctx, const char *name);
+    int (*fsync_p)(void *ctx, int fd);
+} esp_vfs_t;
+
+esp_err_t esp_vfs_register(const char *base_path, const esp_vfs_t *vfs, void *ctx);
+esp_err_t esp_vfs_unregister(const char *base_path);
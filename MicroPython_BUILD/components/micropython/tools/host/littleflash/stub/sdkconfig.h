@@ -0,0 +1,10 @@
+// sdkconfig settings for the littleflash host test
+#pragma once
+#define CONFIG_MICROPY_FILESYSTEM_TYPE 2
+
+// newlib has strlcpy, glibc only since 2.38, littleflash_host.c provides it
+#include <string.h>
+#if defined(__GLIBC__) && !__GLIBC_PREREQ(2, 38)
+#define LITTLEFLASH_HOST_STRLCPY 1
+size_t strlcpy(char *dst, const char *src, size_t size);
+#endif
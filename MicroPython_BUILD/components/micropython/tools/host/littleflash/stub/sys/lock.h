@@ -0,0 +1,7 @@
+// newlib locks, the host test is single threaded
+#pragma once
+typedef int _lock_t;
+#define _lock_init(lock) (void)(lock)
+#define _lock_close(lock) (void)(lock)
+#define _lock_acquire(lock) (void)(lock)
+#define _lock_release(lock) (void)(lock)
@@ -0,0 +1,129 @@
+/*
+ * This file is part of the MicroPython project, http://micropython.org/
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Runs a script with the MicroPython core built for the host:
+ *   ./micropython script.py [heap_kb]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <sys/stat.h>
+
+#include "py/compile.h"
+#include "py/runtime.h"
+#include "py/gc.h"
+#include "py/mperrno.h"
+#include "py/lexer.h"
+
+static char *stack_top;
+
+#if defined(__SANITIZE_ADDRESS__)
+// The stack contains AddressSanitizer redzones, scan a copy of it
+//----------------------------------------------------------------------------
+__attribute__((no_sanitize_address)) static void collect_stack(void **sp, size_t len) {
+    void **copy = malloc(len * sizeof(void *));
+    for (size_t i = 0; i < len; i++) copy[i] = sp[i];
+    gc_collect_root(copy, len);
+    free(copy);
+}
+#else
+#define collect_stack gc_collect_root
+#endif
+
+//-------------------------
+void gc_collect(int flag) {
+    (void)flag;
+    // registers are spilled to the stack by setjmp
+    jmp_buf regs;
+    setjmp(regs);
+    void **sp = (void **)((uintptr_t)&regs & ~(sizeof(void *) - 1));
+    gc_collect_start();
+    collect_stack(sp, ((uintptr_t)stack_top - (uintptr_t)sp) / sizeof(void *));
+    gc_collect_end();
+}
+
+//-----------------------------------------------------
+mp_import_stat_t mp_import_stat(const char *path) {
+    struct stat st;
+    if (stat(path, &st) == 0) return S_ISDIR(st.st_mode) ? MP_IMPORT_STAT_DIR : MP_IMPORT_STAT_FILE;
+    return MP_IMPORT_STAT_NO_EXIST;
+}
+
+//---------------------------------
+void nlr_jump_fail(void *val) {
+    printf("FATAL: uncaught NLR %p\n", val);
+    exit(1);
+}
+
+//----------------------------------------------
+void NORETURN __fatal_error(const char *msg) {
+    printf("%s\n", msg);
+    exit(1);
+}
+
+//-------------------------------------------------------------
+void mp_hal_stdout_tx_strn_cooked(const char *str, size_t len) {
+    fwrite(str, 1, len, stdout);
+}
+
+//----------------------------------
+int main(int argc, char **argv) {
+    char dummy;
+    stack_top = &dummy;
+
+    if (argc < 2) {
+        printf("usage: %s script.py [heap_kb]\n", argv[0]);
+        return 2;
+    }
+    size_t heap_size = ((argc > 2) ? atoi(argv[2]) : 16 * 1024) * 1024;
+    char *heap = malloc(heap_size);
+    gc_init(heap, heap + heap_size);
+    mp_init();
+    mp_obj_list_init(MP_OBJ_TO_PTR(mp_sys_path), 0);
+    mp_obj_list_append(mp_sys_path, MP_OBJ_NEW_QSTR(MP_QSTR_));
+    mp_obj_list_init(MP_OBJ_TO_PTR(mp_sys_argv), 0);
+
+    int ret = 0;
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        mp_lexer_t *lex = mp_lexer_new_from_file(argv[1]);
+        qstr source_name = lex->source_name;
+        mp_parse_tree_t parse_tree = mp_parse(lex, MP_PARSE_FILE_INPUT);
+        mp_obj_t module_fun = mp_compile(&parse_tree, source_name, MP_EMIT_OPT_NONE, false);
+        mp_call_function_0(module_fun);
+        nlr_pop();
+    }
+    else {
+        mp_obj_print_exception(&mp_plat_print, (mp_obj_t)nlr.ret_val);
+        ret = 1;
+    }
+    mp_deinit();
+    free(heap);
+    return ret;
+}
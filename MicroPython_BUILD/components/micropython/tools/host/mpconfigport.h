@@ -0,0 +1,97 @@
+// Options for the host build, see Makefile
+
+#include <stdint.h>
+#include <alloca.h>
+#include <stdio.h>
+
+#define MICROPY_ALLOC_PATH_MAX              (256)
+#define MICROPY_ENABLE_COMPILER             (1)
+#define MICROPY_ENABLE_GC                   (1)
+#define MICROPY_ENABLE_FINALISER            (1)
+#define MICROPY_GC_INCREMENTAL              (1)
+#define MICROPY_STACK_CHECK                 (0)
+#define MICROPY_NLR_SETJMP                  (1)
+#define MICROPY_HELPER_REPL                 (0)
+#define MICROPY_READER_POSIX                (1)
+#define MICROPY_HELPER_LEXER_UNIX           (1)
+#define MICROPY_LONGINT_IMPL                (MICROPY_LONGINT_IMPL_MPZ)
+#define MICROPY_FLOAT_IMPL                  (MICROPY_FLOAT_IMPL_DOUBLE)
+#define MICROPY_ENABLE_SOURCE_LINE          (1)
+#define MICROPY_ERROR_REPORTING             (MICROPY_ERROR_REPORTING_DETAILED)
+#define MICROPY_CPYTHON_COMPAT              (1)
+#define MICROPY_USE_INTERNAL_PRINTF         (0)
+#define MICROPY_OPT_COMPUTED_GOTO           (1)
+#define MICROPY_MODULE_BUILTIN_INIT         (1)
+#define MICROPY_ENABLE_SCHEDULER            (1)
+#define MICROPY_STREAMS_NON_BLOCK           (1)
+#define MICROPY_STREAMS_POSIX_API           (1)
+#define MICROPY_PERSISTENT_CODE_LOAD        (1)
+#define MICROPY_PERSISTENT_CODE_XIP         (1)
+
+// optimisations which "make bench-off" also measures disabled, see Makefile
+#ifndef MICROPY_OPT_CACHE_LOAD_METHOD
+#define MICROPY_OPT_CACHE_LOAD_METHOD       (1)
+#endif
+#ifndef MICROPY_QSTR_HASH_INDEX
+#define MICROPY_QSTR_HASH_INDEX             (1)
+#endif
+#ifndef MICROPY_GC_SIZE_CLASSES
+#define MICROPY_GC_SIZE_CLASSES             (12)
+#endif
+
+#define MICROPY_PY_BUILTINS_STR_UNICODE     (1)
+#define MICROPY_PY_BUILTINS_BYTEARRAY       (1)
+#define MICROPY_PY_BUILTINS_MEMORYVIEW      (1)
+#define MICROPY_PY_BUILTINS_SLICE           (1)
+#define MICROPY_PY_BUILTINS_PROPERTY        (1)
+#define MICROPY_PY_BUILTINS_ENUMERATE       (1)
+#define MICROPY_PY_BUILTINS_SET             (1)
+#define MICROPY_PY_BUILTINS_FROZENSET       (1)
+#define MICROPY_PY_ALL_SPECIAL_METHODS      (1)
+#define MICROPY_PY_ARRAY                    (1)
+#define MICROPY_PY_COLLECTIONS              (1)
+#define MICROPY_PY_MATH                     (1)
+#define MICROPY_PY_GC                       (1)
+#define MICROPY_PY_IO                       (1)
+#define MICROPY_PY_IO_FILEIO                (1)
+#define MICROPY_PY_IO_BYTESIO               (1)
+#define MICROPY_PY_SYS                      (0)
+#define MICROPY_PY_STRUCT                   (1)
+#define MICROPY_PY_MICROPYTHON_MEM_INFO     (1)
+#define MICROPY_PY_UTIME_MP_HAL             (1)
+#define MICROPY_PY_UTIMEQ                   (1)
+#define MICROPY_PY_USELECT                  (1)
+#define MICROPY_PY_USELECT_NOTIFY           (1)
+#define MICROPY_PY_UASYNCIO                 (1)
+#define MICROPY_PY_FRAMEBUF                 (1)
+#define MICROPY_PY_UZLIB                    (1)
+#define MICROPY_PY_UJSON                    (1)
+
+// native VFS files (extmod/vfs_native_file.c) on top of the host file system;
+// the "psRAM" buffers come from the C heap, as on boards without psRAM
+#define MICROPY_VFS_NATIVE_BUFSIZE          (512)
+#define MICROPY_VFS_NATIVE_PSRAM_MIN        (2048)
+#define MICROPY_VFS_NATIVE_PSRAM_MALLOC     malloc
+
+#define MICROPY_PORT_BUILTINS \
+    { MP_ROM_QSTR(MP_QSTR_open), MP_ROM_PTR(&mp_builtin_open_obj) },
+
+#define MICROPY_PORT_BUILTIN_MODULES \
+    { MP_ROM_QSTR(MP_QSTR_utime), MP_ROM_PTR(&mp_module_utime) }, \
+    { MP_ROM_QSTR(MP_QSTR_host), MP_ROM_PTR(&mp_module_host) }, \
+
+extern const struct _mp_obj_module_t mp_module_utime;
+extern const struct _mp_obj_module_t mp_module_host;
+
+#define MICROPY_PORT_ROOT_POINTERS
+
+#define MICROPY_EVENT_POLL_HOOK usleep(1000);
+
+#define MP_STATE_PORT MP_STATE_VM
+#define MP_PLAT_PRINT_STRN(str, len) fwrite(str, 1, len, stdout)
+
+typedef long mp_int_t;
+typedef unsigned long mp_uint_t;
+typedef long mp_off_t;
+
+#include <unistd.h>
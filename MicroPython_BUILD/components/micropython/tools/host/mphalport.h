@@ -0,0 +1,15 @@
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+static inline uint64_t mp_hal_ticks_us(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000ULL + t.tv_nsec / 1000;
+}
+#define mp_hal_ticks_ms() (mp_hal_ticks_us() / 1000)
+#define mp_hal_ticks_cpu() ((mp_uint_t)mp_hal_ticks_us())
+static inline void mp_hal_delay_us(uint32_t us) { usleep(us); }
+static inline int mp_hal_delay_ms(uint32_t ms) { usleep(ms * 1000); return ms; }
+static inline void mp_hal_set_wdt_tmo(void) {}
+static inline void mp_hal_reset_wdt(void) {}
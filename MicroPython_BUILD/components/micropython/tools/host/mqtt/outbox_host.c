@@ -0,0 +1,322 @@
+/*
+ * This file is part of the MicroPython ESP32 project, https://github.com/loboris/MicroPython_ESP32_psRAM_LoBo
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Tests the MQTT outbox (espmqtt/lib/mqtt_outbox.c) on the host, see
+ * "make mqtt-outbox-test".
+ * First random enqueue, ack, cleanup and expiry operations are checked
+ * against a reference model: size, data, lookup and dequeue order.
+ * Then QoS1 publishes are run with a window of messages in flight, acked
+ * out of order with duplicate acks, the way the client task drives the
+ * outbox over a flaky link. The message rate and the heap calls per
+ * message are printed for each window size.
+ * Only the outbox API is used, so the test also builds with older outbox
+ * implementations for comparison.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mqtt_outbox.h"
+#include "mqtt_config.h"
+
+#define HOST_MSG_PUBLISH    3
+#define HOST_MSG_PUBREL     6
+#define HOST_MODEL_ITEMS    2048
+#define HOST_STORM_MSGS     200000
+
+// heap calls, counted with ld --wrap
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void __real_free(void *ptr);
+static unsigned long host_allocs = 0;
+
+void *__wrap_malloc(size_t size)
+{
+    host_allocs++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    host_allocs++;
+    return __real_calloc(n, size);
+}
+
+void __wrap_free(void *ptr)
+{
+    __real_free(ptr);
+}
+
+static uint32_t host_seed = 1;
+
+static uint32_t host_rand(void)
+{
+    host_seed = host_seed * 1103515245 + 12345;
+    return host_seed >> 8;
+}
+
+static double host_time(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// ============================================================================
+// Reference model
+// ============================================================================
+
+typedef struct {
+    int msg_id;
+    int msg_type;
+    int tick;
+    int len;
+    bool pending;
+    uint8_t data[256];
+} host_ref_t;
+
+static host_ref_t model[HOST_MODEL_ITEMS];     // live items in insertion order
+static int model_n = 0;
+
+static void model_remove(int i)
+{
+    memmove(&model[i], &model[i + 1], (model_n - i - 1) * sizeof(host_ref_t));
+    model_n--;
+}
+
+static int model_find(int msg_id, int msg_type)
+{
+    for (int i = 0; i < model_n; i++) {
+        if (model[i].msg_id == msg_id && (msg_type < 0 || model[i].msg_type == msg_type)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool model_check(outbox_handle_t outbox, int step)
+{
+    int size = 0;
+    for (int i = 0; i < model_n; i++) {
+        size += model[i].len;
+    }
+    if (outbox_get_size(outbox) != size) {
+        printf("step %d: size %d, expected %d\n", step, outbox_get_size(outbox), size);
+        return false;
+    }
+    for (int i = 0; i < model_n; i++) {
+        outbox_item_handle_t item = outbox_get(outbox, model[i].msg_id);
+        int k = model_find(model[i].msg_id, -1);
+        if (item == NULL || item->msg_type != model[k].msg_type || item->len != model[k].len ||
+            memcmp(item->buffer, model[k].data, item->len) != 0) {
+            printf("step %d: msg_id %d differs from the model\n", step, model[i].msg_id);
+            return false;
+        }
+    }
+    outbox_item_handle_t item = outbox_dequeue(outbox);
+    int k = 0;
+    while (k < model_n && model[k].pending) {
+        k++;
+    }
+    if ((k == model_n) != (item == NULL) || (item && (item->msg_id != model[k].msg_id || item->tick != model[k].tick))) {
+        printf("step %d: dequeue returned the wrong item\n", step);
+        return false;
+    }
+    return true;
+}
+
+static bool run_model(int steps)
+{
+    outbox_handle_t outbox = outbox_init();
+    model_n = 0;
+    for (int step = 0; step < steps; step++) {
+        int op = host_rand() % 100;
+        if (op < 45 && model_n < HOST_MODEL_ITEMS) {
+            // publish, small ids so they collide in the index and repeat
+            host_ref_t *ref = &model[model_n];
+            ref->msg_id = 1 + host_rand() % 300;
+            ref->msg_type = (host_rand() % 4) ? HOST_MSG_PUBLISH : HOST_MSG_PUBREL;
+            ref->tick = step;
+            ref->len = 1 + host_rand() % ((host_rand() % 8) ? 64 : sizeof(ref->data));
+            ref->pending = false;
+            for (int i = 0; i < ref->len; i++) {
+                ref->data[i] = host_rand();
+            }
+            if (outbox_enqueue(outbox, ref->data, ref->len, ref->msg_id, ref->msg_type, ref->tick) == NULL) {
+                printf("step %d: enqueue failed\n", step);
+                return false;
+            }
+            model_n++;
+        } else if (op < 55) {
+            // sent, waiting for the ack
+            int msg_id = 1 + host_rand() % 300;
+            int k = model_find(msg_id, -1);
+            if ((outbox_set_pending(outbox, msg_id) == ESP_OK) != (k >= 0)) {
+                printf("step %d: set_pending result differs\n", step);
+                return false;
+            }
+            if (k >= 0) {
+                model[k].pending = true;
+            }
+        } else if (op < 90) {
+            // ack, also for messages which are not in the outbox any more
+            int msg_id = 1 + host_rand() % 300;
+            int msg_type = (host_rand() % 4) ? HOST_MSG_PUBLISH : HOST_MSG_PUBREL;
+            int k = model_find(msg_id, msg_type);
+            if ((outbox_delete(outbox, msg_id, msg_type) == ESP_OK) != (k >= 0)) {
+                printf("step %d: delete result differs\n", step);
+                return false;
+            }
+            if (k >= 0) {
+                model_remove(k);
+            }
+        } else if (op < 94) {
+            int max_size = host_rand() % (OUTBOX_MAX_SIZE * 2);
+            outbox_cleanup(outbox, max_size);
+            int size = 0;
+            for (int i = 0; i < model_n; i++) {
+                size += model[i].len;
+            }
+            for (int i = 0; i < model_n && size > max_size; ) {
+                if (model[i].pending) {
+                    i++;
+                    continue;
+                }
+                size -= model[i].len;
+                model_remove(i);
+            }
+        } else if (op < 97) {
+            int timeout = host_rand() % 2000;
+            outbox_delete_expired(outbox, step, timeout);
+            for (int i = 0; i < model_n; ) {
+                if (step - model[i].tick > timeout) {
+                    model_remove(i);
+                } else {
+                    i++;
+                }
+            }
+        } else {
+            int msg_id = 1 + host_rand() % 300;
+            outbox_delete_msgid(outbox, msg_id);
+            for (int k; (k = model_find(msg_id, -1)) >= 0; ) {
+                model_remove(k);
+            }
+        }
+        if (!model_check(outbox, step)) {
+            return false;
+        }
+    }
+    outbox_destroy(outbox);
+    return true;
+}
+
+// ============================================================================
+// Ack storm
+// ============================================================================
+
+// QoS1 publishes with 'window' messages in flight, acked in random order
+static double run_storm(int window, int msgs, unsigned long *allocs)
+{
+    static int inflight[4096];
+    static int acked[4096];
+    uint8_t data[200];
+    int n_inflight = 0;
+    int n_acked = 0;
+    int msg_id = 0;
+    memset(data, 0x55, sizeof(data));
+
+    outbox_handle_t outbox = outbox_init();
+    unsigned long allocs_start = host_allocs;
+    double t = host_time();
+    for (int i = 0; i < msgs; i++) {
+        msg_id = (msg_id % 65535) + 1;
+        int len = 20 + host_rand() % 180;
+        if (outbox_enqueue(outbox, data, len, msg_id, HOST_MSG_PUBLISH, i) == NULL) {
+            printf("enqueue failed\n");
+            exit(1);
+        }
+        outbox_set_pending(outbox, msg_id);
+        inflight[n_inflight++] = msg_id;
+        while (n_inflight >= window) {
+            int k = host_rand() % n_inflight;
+            int id = inflight[k];
+            inflight[k] = inflight[--n_inflight];
+            if (outbox_delete(outbox, id, HOST_MSG_PUBLISH) != ESP_OK) {
+                printf("ack of msg_id %d failed\n", id);
+                exit(1);
+            }
+            acked[n_acked++ % 4096] = id;
+            // the broker acks again after a retransmit, one in 8
+            if ((host_rand() % 8) == 0) {
+                outbox_delete(outbox, acked[host_rand() % (n_acked < 4096 ? n_acked : 4096)], HOST_MSG_PUBLISH);
+            }
+        }
+        // the client task checks the outbox on each loop
+        if ((i % 16) == 0) {
+            outbox_get_size(outbox);
+            outbox_delete_expired(outbox, i, msgs);
+        }
+    }
+    t = host_time() - t;
+    *allocs = host_allocs - allocs_start;
+    outbox_destroy(outbox);
+    return msgs / t;
+}
+
+int main(int argc, char **argv)
+{
+#ifdef OUTBOX_SLAB_ITEMS
+    printf("MQTT outbox, %d pool items, %d byte slab\n", OUTBOX_SLAB_ITEMS, OUTBOX_SLAB_SIZE);
+#else
+    printf("MQTT outbox\n");
+#endif
+
+    if (!run_model(200000)) {
+        printf("FAILED\n");
+        return 1;
+    }
+    printf("model check: 200000 random operations ok\n");
+
+    static const int windows[] = { 8, 32, 128, 512 };
+    for (int w = 0; w < sizeof(windows) / sizeof(windows[0]); w++) {
+        double best = 0;
+        unsigned long allocs = 0;
+        // best of 3, the host timing is noisy
+        for (int r = 0; r < 3; r++) {
+            double rate = run_storm(windows[w], HOST_STORM_MSGS, &allocs);
+            if (rate > best) {
+                best = rate;
+            }
+        }
+        printf("ack storm, %3d in flight: %9.0f msgs/s, %.2f heap allocations/msg\n",
+               windows[w], best, (double)allocs / HOST_STORM_MSGS);
+    }
+    printf("ok\n");
+    return 0;
+}
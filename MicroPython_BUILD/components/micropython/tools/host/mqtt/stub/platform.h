@@ -0,0 +1,19 @@
+// espmqtt platform layer, only what mqtt_outbox.c needs in the host build
+// Included with -include, its guard keeps lib/include/platform.h out
+#ifndef _PLATFORM_H__
+#define _PLATFORM_H__
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "rom/queue.h"
+#include "esp_log.h"
+
+typedef int esp_err_t;
+#define ESP_OK      0
+#define ESP_FAIL    -1
+
+#define ESP_MEM_CHECK(TAG, a, action) if (!(a)) {                       \
+        ESP_LOGE(TAG,"%s:%d (%s): %s", __FILE__, __LINE__, __FUNCTION__, "Memory exhausted"); \
+        action;                                                         \
+        }
+#endif
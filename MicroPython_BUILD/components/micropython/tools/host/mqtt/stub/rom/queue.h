@@ -0,0 +1,16 @@
+// the ESP32 ROM queue.h is the BSD one, glibc lacks the _SAFE iterators
+#pragma once
+#include <sys/queue.h>
+
+#ifndef TAILQ_FOREACH_SAFE
+#define TAILQ_FOREACH_SAFE(var, head, field, tvar)                      \
+    for ((var) = TAILQ_FIRST((head));                                   \
+        (var) && ((tvar) = TAILQ_NEXT((var), field), 1);                \
+        (var) = (tvar))
+#endif
+#ifndef STAILQ_FOREACH_SAFE
+#define STAILQ_FOREACH_SAFE(var, head, field, tvar)                     \
+    for ((var) = STAILQ_FIRST((head));                                  \
+        (var) && ((tvar) = STAILQ_NEXT((var), field), 1);               \
+        (var) = (tvar))
+#endif
@@ -0,0 +1 @@
+#define IRAM_ATTR
@@ -0,0 +1,8 @@
+// ESP-IDF logging, silent in the host build
+#include <stdio.h>
+#define ESP_LOG_HOST(tag, fmt, ...) do { (void)(tag); if (0) printf(fmt, ##__VA_ARGS__); } while (0)
+#define ESP_LOGE ESP_LOG_HOST
+#define ESP_LOGW ESP_LOG_HOST
+#define ESP_LOGI ESP_LOG_HOST
+#define ESP_LOGD ESP_LOG_HOST
+#define ESP_LOGV ESP_LOG_HOST
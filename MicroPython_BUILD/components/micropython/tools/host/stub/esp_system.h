@@ -0,0 +1 @@
+// nothing needed from esp_system.h in the host build
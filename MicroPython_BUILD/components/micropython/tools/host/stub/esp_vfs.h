@@ -0,0 +1 @@
+// nothing needed from esp_vfs.h in the host build
@@ -0,0 +1,2 @@
+// sdkconfig settings for the host build
+#define CONFIG_MICROPY_FILESYSTEM_TYPE 2
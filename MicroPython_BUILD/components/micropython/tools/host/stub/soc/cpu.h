@@ -0,0 +1 @@
+// nothing needed from soc/cpu.h in the host build
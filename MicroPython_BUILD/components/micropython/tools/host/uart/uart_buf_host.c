@@ -0,0 +1,394 @@
+/*
+ * This file is part of the MicroPython ESP32 project, https://github.com/loboris/MicroPython_ESP32_psRAM_LoBo
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Tests the machine.UART receive ring buffer (uart_buf_get, uart_buf_put and
+ * uart_buf_find of esp32/machine_uart.c) on the host, see "make uart-buf-test".
+ * First the data read back and the pattern positions are checked against a
+ * reference model for random put/get/find sequences, then the cases around the
+ * wrap point and overflow are checked directly. The throughput of a GPS/modem
+ * like workload is printed for the ring buffer and for the previous linear
+ * buffer, which moved the remaining data to the front on every read.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "machine_uart.h"
+
+#define HOST_MODEL_SIZE		(1024 * 1024)
+
+static uint32_t host_seed = 1;
+
+//-----------------------------
+static uint32_t host_rand(void)
+{
+	host_seed = host_seed * 1103515245 + 12345;
+	return host_seed >> 8;
+}
+
+//----------------------------
+static double host_time(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+//------------------------------------------------------
+static void ring_init(uart_ringbuf_t *r, uint32_t size)
+{
+	r->buf = malloc(size);
+	r->size = size;
+	r->iget = 0;
+	r->iput = 0;
+}
+
+// ============================================================================
+// Previous linear buffer, for the throughput comparison
+// ============================================================================
+
+typedef struct {
+	uint8_t *buf;
+	uint16_t size;
+	uint16_t iget;
+	uint16_t iput;
+} old_buf_t;
+
+//--------------------------------------------------------------
+static int old_buf_get(old_buf_t *r, uint8_t *dest, uint16_t len)
+{
+	if (r->iget == r->iput) return -1; // input buffer empty
+
+	int res = 0;
+	for (int i=0; i<len; i++) {
+		dest[i] = r->buf[r->iget++];
+		res++;
+		if (r->iget == r->iput) break;
+	}
+	// move the buffer and adjust the pointers
+	memmove(r->buf, r->buf+res, r->iput - res);
+	r->iget -= res;
+	r->iput -= res;
+
+	return res;
+}
+
+//----------------------------------------------------------------
+static int old_buf_put(old_buf_t *r, uint8_t *source, uint16_t len)
+{
+	int res = 0;
+	for (int i=0; i<len; i++) {
+		if (r->iput >= r->size) return 1; // overflow
+		r->buf[r->iput++] = source[i];
+	}
+	return res;
+}
+
+//-------------------------------------------------------------------------------------------------
+static int old_match_pattern(uint8_t *text, int text_length, uint8_t *pattern, int pattern_length)
+{
+	int c, d, e, position = -1;
+
+	if (pattern_length > text_length) return -1;
+
+	for (c = 0; c <= (text_length - pattern_length); c++) {
+		position = e = c;
+		// check pattern
+		for (d = 0; d < pattern_length; d++) {
+			if (pattern[d] == text[e]) e++;
+			else break;
+		}
+		if (d == pattern_length) return position;
+	}
+
+	return -1;
+}
+
+// ============================================================================
+// Reference model
+// ============================================================================
+
+static uint8_t model[HOST_MODEL_SIZE];	// bytes in the buffer are model[model_get..model_put)
+static uint32_t model_get, model_put;
+
+//-------------------------------------------------------------------------------
+static int model_find(uint8_t *pattern, int pattern_length)
+{
+	uint32_t count = model_put - model_get;
+	for (uint32_t off = 0; (int)(count - off) >= pattern_length && pattern_length > 0; off++) {
+		if (memcmp(model + model_get + off, pattern, pattern_length) == 0) return off;
+	}
+	return -1;
+}
+
+// Random puts, gets and finds, with a small alphabet so the patterns are found
+// often, also across the wrap point
+//----------------------------------------------
+static bool run_model(uint32_t size, int steps)
+{
+	uart_ringbuf_t r;
+	uint8_t data[512];
+	uint8_t out[512];
+	ring_init(&r, size);
+	// start near the end of the 32-bit index range, the indexes wrap around too
+	r.iget = r.iput = 0xFFFFFF00;
+	model_get = model_put = 0;
+
+	for (int step = 0; step < steps; step++) {
+		int op = host_rand() % 3;
+		uint32_t len = 1 + host_rand() % ((host_rand() % 4) ? 32 : (size + 16 < sizeof(data) ? size + 16 : sizeof(data)));
+		if (op == 0) {
+			for (uint32_t i = 0; i < len; i++) {
+				data[i] = "\r\nAB$"[host_rand() % 5];
+			}
+			uint32_t space = size - (model_put - model_get);
+			int res = uart_buf_put(&r, data, len);
+			if (res != (len > space)) {
+				printf("step %d: put of %u bytes with %u free returned %d\n", step, len, space, res);
+				return false;
+			}
+			if (len > space) len = space;
+			if (model_put + len > HOST_MODEL_SIZE) {
+				// keep the model buffer short
+				memmove(model, model + model_get, model_put - model_get);
+				model_put -= model_get;
+				model_get = 0;
+			}
+			memcpy(model + model_put, data, len);
+			model_put += len;
+		}
+		else if (op == 1) {
+			uint32_t count = model_put - model_get;
+			int res = uart_buf_get(&r, out, len);
+			if ((count == 0 && res != -1) || (count > 0 && res != (int)(len < count ? len : count))) {
+				printf("step %d: get of %u bytes with %u buffered returned %d\n", step, len, count, res);
+				return false;
+			}
+			if (res > 0) {
+				if (memcmp(out, model + model_get, res) != 0) {
+					printf("step %d: data read differs from the model\n", step);
+					return false;
+				}
+				model_get += res;
+			}
+		}
+		else {
+			static const char *patterns[] = { "\r\n", "AB", "$AB\r", "B\r\nA", "\n" };
+			const char *pattern = patterns[host_rand() % 5];
+			int res = uart_buf_find(&r, (uint8_t *)pattern, strlen(pattern));
+			int ref = model_find((uint8_t *)pattern, strlen(pattern));
+			if (res != ref) {
+				printf("step %d: find returned %d, expected %d\n", step, res, ref);
+				return false;
+			}
+		}
+		if (uart_buf_count(&r) != model_put - model_get) {
+			printf("step %d: count %u, expected %u\n", step, uart_buf_count(&r), model_put - model_get);
+			return false;
+		}
+	}
+	free(r.buf);
+	return true;
+}
+
+// ============================================================================
+// Edge cases
+// ============================================================================
+
+#define CHECK(cond, what) do { if (!(cond)) { printf("FAILED: %s\n", what); return false; } } while (0)
+
+//-------------------------
+static bool run_edges(void)
+{
+	uart_ringbuf_t r;
+	uint8_t out[64];
+	ring_init(&r, 16);
+
+	// read across the wrap point, in one call and in pieces
+	r.iget = r.iput = 12;
+	CHECK(uart_buf_put(&r, (uint8_t *)"0123456789", 10) == 0, "put across the wrap point");
+	CHECK((r.iput & (r.size - 1)) == 6, "put index wrapped");
+	CHECK(uart_buf_get(&r, out, 64) == 10 && memcmp(out, "0123456789", 10) == 0, "get across the wrap point");
+	CHECK(uart_buf_get(&r, out, 1) == -1, "empty after reading all");
+	r.iget = r.iput = 14;
+	uart_buf_put(&r, (uint8_t *)"abcdefgh", 8);
+	CHECK(uart_buf_get(&r, out, 1) == 1 && out[0] == 'a', "first byte before the wrap point");
+	CHECK(uart_buf_get(&r, out, 2) == 2 && memcmp(out, "bc", 2) == 0, "piece across the wrap point");
+	CHECK(uart_buf_get(&r, out, 10) == 5 && memcmp(out, "defgh", 5) == 0, "rest after the wrap point");
+
+	// pattern straddling the wrap point, at every split
+	for (int split = 1; split < 4; split++) {
+		r.iget = r.iput = 16 - 6 - split;
+		uart_buf_put(&r, (uint8_t *)"xxxxxx\r\r\n\nyy", 12);
+		// "\r\r\n\n" starts at offset 6, 'split' bytes of it are before the wrap point
+		CHECK(uart_buf_find(&r, (uint8_t *)"\r\n\n", 3) == 7, "pattern across the wrap point");
+		CHECK(uart_buf_find(&r, (uint8_t *)"\r\r\n\n", 4) == 6, "whole pattern across the wrap point");
+		CHECK(uart_buf_find(&r, (uint8_t *)"\n\ny", 3) == 8, "pattern after a partial match");
+		CHECK(uart_buf_find(&r, (uint8_t *)"\r\n\r", 3) == -1, "no match");
+		CHECK(uart_buf_find(&r, (uint8_t *)"yyy", 3) == -1, "partial match at the end of the data");
+		uart_buf_flush(&r);
+	}
+	// first pattern byte is the last byte before the wrap point
+	r.iget = r.iput = 10;
+	uart_buf_put(&r, (uint8_t *)"abcde\r\nfg", 9);
+	CHECK(uart_buf_find(&r, (uint8_t *)"\r\n", 2) == 5, "pattern split after its first byte");
+	CHECK(uart_buf_find(&r, (uint8_t *)"abcde\r\nfgh", 10) == -1, "pattern longer than the data");
+	CHECK(uart_buf_find(&r, (uint8_t *)"", 0) == -1, "empty pattern");
+	uart_buf_flush(&r);
+	CHECK(uart_buf_count(&r) == 0 && uart_buf_find(&r, (uint8_t *)"\n", 1) == -1, "flush");
+
+	// overflow: the bytes which fit are kept, in order
+	r.iget = r.iput = 5;
+	CHECK(uart_buf_put(&r, (uint8_t *)"0123456789", 10) == 0, "put below the size");
+	CHECK(uart_buf_put(&r, (uint8_t *)"ABCDEFGHIJ", 10) == 1, "overflow reported");
+	CHECK(uart_buf_count(&r) == 16, "buffer full after overflow");
+	CHECK(uart_buf_put(&r, (uint8_t *)"Z", 1) == 1, "overflow of a full buffer");
+	CHECK(uart_buf_get(&r, out, 64) == 16 && memcmp(out, "0123456789ABCDEF", 16) == 0, "data kept on overflow");
+	CHECK(uart_buf_put(&r, (uint8_t *)"0123456789ABCDEF", 16) == 0 && uart_buf_count(&r) == 16, "fill to the size exactly");
+	CHECK(uart_buf_find(&r, (uint8_t *)"EF", 2) == 14, "find in a full buffer");
+	CHECK(uart_buf_get(&r, out, 16) == 16 && memcmp(out, "0123456789ABCDEF", 16) == 0, "read of a full buffer");
+
+	free(r.buf);
+	return true;
+}
+
+// ============================================================================
+// Throughput
+// ============================================================================
+
+// NMEA sentences and modem replies, ~70 byte lines
+//-------------------------------------------------------
+static uint32_t make_stream(uint8_t *data, uint32_t len)
+{
+	static const char *lines[] = {
+		"$GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,*47\r\n",
+		"$GPRMC,123519,A,4807.038,N,01131.000,E,022.4,084.4,230394,003.1,W*6A\r\n",
+		"+CREG: 0,1\r\n",
+		"$GPGSV,2,1,08,01,40,083,46,02,17,308,41,12,07,344,39,14,22,228,45*75\r\n",
+		"OK\r\n",
+	};
+	uint32_t n = 0;
+	while (n < len) {
+		const char *l = lines[host_rand() % 5];
+		uint32_t ll = strlen(l);
+		if (n + ll > len) ll = len - n;
+		memcpy(data + n, l, ll);
+		n += ll;
+	}
+	return n;
+}
+
+// The event task puts the FIFO chunks (120 bytes at most), the reader takes
+// 'backlog' bytes behind: lines ending with "\r\n", or 'chunk' byte reads if
+// 'chunk' is not 0. Returns MB/s
+//------------------------------------------------------------------------------------------------------
+static double run_stream(bool old, uint32_t size, uint8_t *data, uint32_t len, uint32_t backlog, int chunk)
+{
+	uart_ringbuf_t r;
+	old_buf_t o;
+	uint8_t out[4096];
+	uint32_t in = 0, got = 0;
+	ring_init(&r, size);
+	o.buf = r.buf;
+	o.size = size;
+	o.iget = o.iput = 0;
+
+	double t = host_time();
+	while (got < len) {
+		// receive until 'backlog' bytes are buffered
+		while (in < len && (old ? o.iput - o.iget : uart_buf_count(&r)) < backlog) {
+			uint32_t n = 1 + host_rand() % 120;
+			if (n > len - in) n = len - in;
+			if (old) old_buf_put(&o, data + in, n);
+			else uart_buf_put(&r, data + in, n);
+			in += n;
+		}
+		int n;
+		if (chunk) {
+			n = old ? old_buf_get(&o, out, chunk) : uart_buf_get(&r, out, chunk);
+		}
+		else {
+			int pos = old ? old_match_pattern(o.buf, o.iput, (uint8_t *)"\r\n", 2) : uart_buf_find(&r, (uint8_t *)"\r\n", 2);
+			if (pos < 0) pos = (old ? o.iput - o.iget : uart_buf_count(&r)) - 2;
+			n = old ? old_buf_get(&o, out, pos + 2) : uart_buf_get(&r, out, pos + 2);
+		}
+		if (n <= 0 || memcmp(out, data + got, n) != 0) {
+			printf("%s buffer: data read differs at %u\n", old ? "old" : "ring", got);
+			exit(1);
+		}
+		got += n;
+	}
+	t = host_time() - t;
+	free(r.buf);
+	return len / t / 1e6;
+}
+
+//------------------------------
+int main(int argc, char **argv)
+{
+	if (!run_edges()) return 1;
+	printf("wrap-around, pattern across the wrap point, overflow: ok\n");
+
+	static const uint32_t sizes[] = { 16, 64, 256, 4096 };
+	for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		if (!run_model(sizes[i], 200000)) {
+			printf("FAILED, %u byte buffer\n", sizes[i]);
+			return 1;
+		}
+	}
+	printf("model check: 200000 random operations for 16 - 4096 byte buffers ok\n");
+
+	uint32_t len = 4 * 1024 * 1024;
+	uint8_t *data = malloc(len);
+	make_stream(data, len);
+	static const struct { uint32_t size; uint32_t backlog; int chunk; const char *what; } runs[] = {
+		{ 1024, 256, 0, "lines" },
+		{ 8192, 4096, 0, "lines" },
+		{ 16384, 8192, 0, "lines" },
+		{ 8192, 4096, 64, "64 byte reads" },
+		{ 16384, 8192, 256, "256 byte reads" },
+	};
+	for (int i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+		double best[2] = { 0, 0 };
+		// best of 3, the host timing is noisy
+		for (int k = 0; k < 3; k++) {
+			for (int old = 0; old < 2; old++) {
+				double rate = run_stream(old, runs[i].size, data, len, runs[i].backlog, runs[i].chunk);
+				if (rate > best[old]) best[old] = rate;
+			}
+		}
+		printf("%5u byte buffer, %4u buffered, %-14s ring %8.1f MB/s, linear %7.1f MB/s\n",
+			runs[i].size, runs[i].backlog, runs[i].what, best[0], best[1]);
+	}
+	free(data);
+	printf("ok\n");
+	return 0;
+}
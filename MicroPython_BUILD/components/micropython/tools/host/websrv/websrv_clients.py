@@ -0,0 +1,144 @@
+#!/usr/bin/env python3
+#
+# Test and load test for the web server built for the host (websrv_host.c):
+# creates a document root, starts the server, checks the responses to static,
+# dynamic and malformed requests and then measures the request rate of several
+# keep-alive clients in parallel.
+#
+#   python3 websrv_clients.py --server ../build/websrv --root ../build/www
+
+import argparse
+import gzip
+import http.client
+import os
+import socket
+import subprocess
+import sys
+import threading
+import time
+
+failed = 0
+
+def check(name, ok, info=''):
+    global failed
+    print('%-44s %s %s' % (name, 'ok' if ok else 'FAIL', info))
+    if not ok:
+        failed += 1
+
+def raw(port, data):
+    # send a raw request, return the status line of the response
+    s = socket.create_connection(('127.0.0.1', port), timeout=10)
+    s.sendall(data)
+    resp = b''
+    while b'\r\n' not in resp:
+        d = s.recv(256)
+        if not d:
+            break
+        resp += d
+    s.close()
+    return resp.split(b'\r\n')[0].decode()
+
+def make_root(root, size):
+    os.makedirs(os.path.join(root, 'sub'), exist_ok=True)
+    files = {
+        'index.html': b'<html>index</html>\n',
+        'sub/index.html': b'<html>sub</html>\n',
+        'app.js': b'console.log("app");\n' * 50,
+        'big.bin': os.urandom(size),
+    }
+    for name, data in files.items():
+        with open(os.path.join(root, name), 'wb') as f:
+            f.write(data)
+    with open(os.path.join(root, 'app.js.gz'), 'wb') as f:
+        f.write(gzip.compress(files['app.js']))
+    return files
+
+def functional(port, files):
+    c = http.client.HTTPConnection('127.0.0.1', port, timeout=10)
+    def get(path, method='GET', body=None, headers={}):
+        c.request(method, path, body=body, headers=headers)
+        r = c.getresponse()
+        return r, r.read()
+
+    r, b = get('/')
+    check('GET / index.html', r.status == 200 and b == files['index.html'])
+    r, b = get('/', headers={'If-None-Match': r.getheader('ETag')})
+    check('GET / If-None-Match 304', r.status == 304 and b == b'')
+    r, b = get('/app.js', headers={'Accept-Encoding': 'gzip'})
+    check('GET /app.js gzip', r.status == 200 and r.getheader('Content-Encoding') == 'gzip'
+          and gzip.decompress(b) == files['app.js'])
+    r, b = get('/big.bin')
+    check('GET /big.bin', r.status == 200 and b == files['big.bin'])
+    r, b = get('/big.bin', method='HEAD')
+    check('HEAD /big.bin', r.status == 200 and int(r.getheader('Content-Length')) == len(files['big.bin']) and b == b'')
+    r, b = get('/sub')
+    check('GET /sub redirect', r.status == 301 and r.getheader('Location') == '/sub/')
+    r, b = get('/nope')
+    check('GET /nope 404', r.status == 404)
+    r, b = get('/api/echo?a=1', method='POST', body=b'hello')
+    check('POST /api/echo', r.status == 200 and b == b'POST /api/echo?a=1\nhello', repr(b))
+    r, b = get('/api/echo')
+    check('GET /api/echo', r.status == 200 and b == b'GET /api/echo?\n', repr(b))
+    r, b = get('/api/busy')
+    check('GET /api/busy 503', r.status == 503)
+    c.close()
+
+    req = b'POST /api/echo HTTP/1.1\r\nHost: x\r\nContent-Length: %s\r\n\r\n'
+    for val, status in ((b'abc', 400), (b'-1', 400), (b'12x', 400), (b'', 400),
+                        (b'4294967297', 413), (b'18446744073709551617', 413), (b'2048', 413)):
+        st = raw(port, req % val)
+        check('Content-Length %r' % val.decode(), st.startswith('HTTP/1.1 %d' % status), st)
+    # the largest body that fits the request buffer together with the header
+    hdr = req % b'0000'
+    body = b'x' * (2048 - len(hdr))
+    hdr = req % str(len(body)).encode()
+    st = raw(port, hdr + body)
+    check('Content-Length %d (buffer full)' % len(body), st.startswith('HTTP/1.1 200'), st)
+
+def load(port, clients, count, path):
+    res = [0] * clients
+    def client(i):
+        c = http.client.HTTPConnection('127.0.0.1', port, timeout=30)
+        for j in range(count):
+            c.request('GET', path)
+            r = c.getresponse()
+            r.read()
+            res[i] += r.status == 200
+        c.close()
+    threads = [threading.Thread(target=client, args=(i,)) for i in range(clients)]
+    t = time.time()
+    for th in threads:
+        th.start()
+    for th in threads:
+        th.join()
+    t = time.time() - t
+    n = clients * count
+    check('%d x %d GET %s' % (clients, count, path), sum(res) == n, '%.0f requests/s' % (n / t))
+
+def main():
+    p = argparse.ArgumentParser()
+    p.add_argument('--server', required=True, help='web server binary built with WEBSRV_HOST_BUILD')
+    p.add_argument('--root', required=True, help='document root to create')
+    p.add_argument('--port', type=int, default=8088)
+    p.add_argument('--clients', type=int, default=2, help='parallel clients, the server has 2 workers')
+    p.add_argument('--requests', type=int, default=2000, help='requests per client')
+    p.add_argument('--slow', action='store_true', help='also check the callback timeout (504)')
+    args = p.parse_args()
+
+    files = make_root(args.root, 1024 * 1024)
+    server = subprocess.Popen([args.server, args.root, str(args.port)])
+    time.sleep(0.5)
+    try:
+        functional(args.port, files)
+        if args.slow:
+            c = http.client.HTTPConnection('127.0.0.1', args.port, timeout=30)
+            c.request('GET', '/api/slow')
+            check('GET /api/slow 504', c.getresponse().status == 504)
+        load(args.port, args.clients, args.requests, '/index.html')
+        load(args.port, args.clients, args.requests, '/api/echo')
+    finally:
+        server.terminate()
+        server.wait()
+    sys.exit(1 if failed else 0)
+
+main()
@@ -0,0 +1,152 @@
+/*
+ * This file is part of the MicroPython ESP32 project, https://github.com/loboris/MicroPython_ESP32_psRAM_LoBo
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Runs the web server (esp32/libs/websrv.c) on a POSIX host, for tests and
+ * load tests, see websrv_clients.py and "make websrv-test".
+ *
+ *   websrv [root [port]]
+ *
+ * Requests for /api/ are handed to a dispatcher thread which takes the place of
+ * the MicroPython task running the callback, and answered with websrv_respond():
+ *   /api/echo   the request line and the body are sent back
+ *   /api/busy   the callback can not be scheduled (503)
+ *   /api/slow   never answered (504 after the callback timeout)
+ * Statistics are printed to stderr on exit.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "libs/websrv.h"
+
+#define WEBSRV_HOST_PENDING     8       // like the MicroPython scheduler queue
+
+typedef struct {
+    uint32_t    id;
+    char        *text;      // "METHOD path?query\n" followed by the body
+    uint32_t    len;
+    bool        slow;       // not answered
+} websrv_host_req_t;
+
+static volatile bool websrv_host_quit = false;
+static pthread_mutex_t websrv_host_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t websrv_host_cond = PTHREAD_COND_INITIALIZER;
+static websrv_host_req_t websrv_host_pending[WEBSRV_HOST_PENDING];
+static int websrv_host_head = 0;
+static int websrv_host_count = 0;
+
+//------------------------------------
+static void websrv_host_sig(int sig) {
+	(void)sig;
+	websrv_host_quit = true;
+}
+
+// Called from the worker task, the request data is only valid during the call
+//------------------------------------------------------------------------------------------------------------------------------------
+static bool websrv_host_schedule(uint32_t id, const char *method, const char *path, const char *query, const uint8_t *body, uint32_t len) {
+	if (strcmp(path, "/api/busy") == 0) return false;
+
+	int hlen = snprintf(NULL, 0, "%s %s?%s\n", method, path, query);
+	char *text = malloc(hlen + 1 + len);
+	if (text == NULL) return false;
+	sprintf(text, "%s %s?%s\n", method, path, query);
+	memcpy(text + hlen, body, len);
+
+	pthread_mutex_lock(&websrv_host_mutex);
+	bool res = (websrv_host_count < WEBSRV_HOST_PENDING);
+	if (res) {
+		websrv_host_req_t *req = &websrv_host_pending[(websrv_host_head + websrv_host_count) % WEBSRV_HOST_PENDING];
+		req->id = id;
+		req->text = text;
+		req->len = hlen + len;
+		req->slow = (strcmp(path, "/api/slow") == 0);
+		websrv_host_count++;
+		pthread_cond_signal(&websrv_host_cond);
+	}
+	pthread_mutex_unlock(&websrv_host_mutex);
+	if (!res) free(text);
+	return res;
+}
+
+//----------------------------------------------
+static void *websrv_host_dispatcher(void *arg) {
+	(void)arg;
+	while (true) {
+		pthread_mutex_lock(&websrv_host_mutex);
+		while (websrv_host_count == 0) pthread_cond_wait(&websrv_host_cond, &websrv_host_mutex);
+		websrv_host_req_t req = websrv_host_pending[websrv_host_head];
+		websrv_host_head = (websrv_host_head + 1) % WEBSRV_HOST_PENDING;
+		websrv_host_count--;
+		pthread_mutex_unlock(&websrv_host_mutex);
+
+		if (!req.slow) websrv_respond(req.id, 200, "text/plain", (const uint8_t *)req.text, req.len);
+		free(req.text);
+	}
+	return NULL;
+}
+
+//----------------------------------
+int main(int argc, char **argv) {
+	websrv_config_t config;
+	pthread_t thread;
+
+	signal(SIGINT, websrv_host_sig);
+	signal(SIGTERM, websrv_host_sig);
+	signal(SIGPIPE, SIG_IGN);
+
+	memset(&config, 0, sizeof(config));
+	const char *root = (argc > 1) ? argv[1] : ".";
+	if (strlen(root) >= sizeof(config.root)) {
+		fprintf(stderr, "root path longer than %d characters\n", (int)sizeof(config.root) - 1);
+		return 1;
+	}
+	strcpy(config.root, root);
+	config.port = (argc > 2) ? atoi(argv[2]) : 8088;
+	strcpy(config.routes[0], "/api/");
+	config.n_routes = 1;
+	config.keepalive_ms = 2000;
+
+	if (pthread_create(&thread, NULL, websrv_host_dispatcher, NULL) != 0) return 1;
+	websrv_host_callback = websrv_host_schedule;
+	if (!websrv_start(&config)) {
+		fprintf(stderr, "websrv_start failed\n");
+		return 1;
+	}
+	while (!websrv_host_quit) usleep(100000);
+
+	websrv_stats_t st;
+	websrv_get_stats(&st, false);
+	fprintf(stderr, "connections %u, requests %u, files %u, 304 %u, gzip %u, dynamic %u, errors %u, tx %u bytes\n",
+		st.connections, st.requests, st.files, st.not_modified, st.gzip, st.dynamic, st.errors, st.bytes_tx);
+	return (websrv_stop()) ? 0 : 1;
+}
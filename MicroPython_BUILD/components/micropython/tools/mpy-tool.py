@@ -54,6 +54,8 @@ class FreezeError(Exception):
         self.msg = msg
 
     def __str__(self):
+        if self.rawcode is None:
+            return 'error while freezing: %s' % self.msg
         return 'error while freezing %s: %s' % (self.rawcode.source_file, self.msg)
 
 class Config:
@@ -544,6 +546,112 @@ def freeze_mpy(base_qstrs, raw_codes):
         print('    &raw_code_%s,' % rc.escaped_name)
     print('};')
 
+# Execute-in-place image, see mp_xip_header_t in py/persistentcode.h
+MP_SCOPE_FLAG_XIP = 0x40
+
+class XipImage:
+    def __init__(self):
+        self.data = bytearray()
+        self.qstrs = {}
+
+    def align(self, n):
+        while len(self.data) % n:
+            self.data.append(0)
+
+    def append(self, b, align=1):
+        self.align(align)
+        off = len(self.data)
+        self.data.extend(b)
+        return off
+
+    def qstr_index(self, qst):
+        s = global_qstrs[qst].str
+        if s not in self.qstrs:
+            if len(self.qstrs) >= 0x10000:
+                raise FreezeError(None, 'too many qstrs for an image')
+            self.qstrs[s] = len(self.qstrs)
+        return self.qstrs[s]
+
+    def write_obj(self, rc, obj):
+        if obj is Ellipsis:
+            return self.append(struct.pack('<BxxxI', ord('e'), 0), 4)
+        if is_str_type(obj):
+            obj_type, buf = 's', bytes_cons(obj, 'utf8')
+        elif is_bytes_type(obj):
+            obj_type, buf = 'b', bytes_cons(obj)
+        elif is_int_type(obj):
+            obj_type, buf = 'i', bytes_cons(str(obj), 'ascii')
+        elif type(obj) is float:
+            obj_type, buf = 'f', bytes_cons(repr(obj), 'ascii')
+        elif type(obj) is complex and obj.real == 0:
+            obj_type, buf = 'c', bytes_cons(repr(obj.imag) + 'j', 'ascii')
+        else:
+            raise FreezeError(rc, 'object %r cannot be stored in an image' % (obj,))
+        return self.append(struct.pack('<BxxxI', ord(obj_type), len(buf)) + buf + b'\0', 4)
+
+    def write_raw_code(self, rc):
+        # children and constants first, so the record can refer to them
+        rc_offs = [self.write_raw_code(child) for child in rc.raw_codes]
+        obj_offs = [self.write_obj(rc, obj) for obj in rc.objs]
+
+        # qstr operands become indices into the image's qstr table
+        bc = bytearray(rc.bytecode)
+        ip, _ = decode_uint(bc, 0)
+        ip, _ = decode_uint(bc, ip)
+        bc[ip] |= MP_SCOPE_FLAG_XIP
+        def pack(ip):
+            idx = self.qstr_index(bc[ip] | bc[ip + 1] << 8)
+            bc[ip] = idx & 0xff
+            bc[ip + 1] = idx >> 8
+        pack(rc.ip2)
+        pack(rc.ip2 + 2)
+        ip = rc.ip
+        while ip < len(bc):
+            f, sz = mp_opcode_format(bc, ip)
+            if f == MP_OPCODE_QSTR:
+                pack(ip + 1)
+            ip += sz
+        bc_off = self.append(bc)
+
+        args = [self.qstr_index(q) for q in rc.qstrs]
+        if len(args) % 2:
+            args.append(0)
+        rec = struct.pack('<IIHHHH', bc_off, len(bc), len(rc.objs), len(rc.raw_codes), len(rc.qstrs), 0)
+        rec += struct.pack('<%uH' % len(args), *args)
+        rec += struct.pack('<%uI' % (len(obj_offs) + len(rc_offs)), *(obj_offs + rc_offs))
+        return self.append(rec, 4)
+
+    def write(self, raw_codes):
+        hdr_fmt = '<4sBBBBIIIII'
+        self.append(bytes_cons(struct.calcsize(hdr_fmt)))
+        modules = [(self.append(bytes_cons(rc.source_file.str, 'utf8') + b'\0'), self.write_raw_code(rc))
+            for rc in raw_codes]
+        module_table = self.append(b''.join(struct.pack('<II', *m) for m in modules), 4)
+        qstr_offs = [0] * len(self.qstrs)
+        for s, idx in self.qstrs.items():
+            qbytes = bytes_cons(s, 'utf8')
+            if len(qbytes) >= (1 << (8 * config.MICROPY_QSTR_BYTES_IN_LEN)):
+                raise FreezeError(None, 'qstr is too long: %s' % s)
+            qhash = qstrutil.compute_hash(qbytes, config.MICROPY_QSTR_BYTES_IN_HASH)
+            le = lambda n, nbytes: bytes_cons((n >> (8 * i)) & 0xff for i in range(nbytes))
+            qstr_offs[idx] = self.append(le(qhash, config.MICROPY_QSTR_BYTES_IN_HASH)
+                + le(len(qbytes), config.MICROPY_QSTR_BYTES_IN_LEN) + qbytes + b'\0')
+        qstr_table = self.append(struct.pack('<%uI' % len(qstr_offs), *qstr_offs), 4)
+        self.align(4)
+        feature_flags = config.MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE | config.MICROPY_PY_BUILTINS_STR_UNICODE << 1
+        self.data[0:struct.calcsize(hdr_fmt)] = struct.pack(hdr_fmt,
+            bytes_cons((ord('M'), ord('X'), config.MPY_VERSION, feature_flags)),
+            config.mp_small_int_bits, config.MICROPY_QSTR_BYTES_IN_HASH, config.MICROPY_QSTR_BYTES_IN_LEN, 0,
+            len(self.data), len(self.qstrs), qstr_table, len(modules), module_table)
+        return self.data
+
+def xip_mpy(raw_codes, filename):
+    if config.MICROPY_OPT_CACHE_MAP_LOOKUP_IN_BYTECODE:
+        # the cache is written into the bytecode, which must stay read-only
+        raise FreezeError(raw_codes[0], 'images need bytecode without map lookup caching')
+    with open(filename, 'wb') as f:
+        f.write(XipImage().write(raw_codes))
+
 def main():
     import argparse
     cmd_parser = argparse.ArgumentParser(description='A tool to work with MicroPython .mpy files.')
@@ -551,8 +659,12 @@ def main():
         help='dump contents of files')
     cmd_parser.add_argument('-f', '--freeze', action='store_true',
         help='freeze files')
+    cmd_parser.add_argument('-x', '--xip', metavar='IMAGE',
+        help='link files into an execute-in-place image')
     cmd_parser.add_argument('-q', '--qstr-header',
         help='qstr header file to freeze against')
+    cmd_parser.add_argument('-mqstr-bytes-in-hash', metavar='N', type=int, default=1,
+        help='qstr hash bytes used by target if no qstr header is given (default 1)')
     cmd_parser.add_argument('-mlongint-impl', choices=['none', 'longlong', 'mpz'], default='mpz',
         help='long-int implementation used by target (default mpz)')
     cmd_parser.add_argument('-mmpz-dig-size', metavar='N', type=int, default=16,
@@ -576,7 +688,7 @@ def main():
         config.MICROPY_QSTR_BYTES_IN_HASH = int(qcfgs['BYTES_IN_HASH'])
     else:
         config.MICROPY_QSTR_BYTES_IN_LEN = 1
-        config.MICROPY_QSTR_BYTES_IN_HASH = 1
+        config.MICROPY_QSTR_BYTES_IN_HASH = args.mqstr_bytes_in_hash
         base_qstrs = {}
 
     raw_codes = [read_mpy(file) for file in args.files]
@@ -589,6 +701,12 @@ def main():
         except FreezeError as er:
             print(er, file=sys.stderr)
             sys.exit(1)
+    elif args.xip:
+        try:
+            xip_mpy(raw_codes, args.xip)
+        except FreezeError as er:
+            print(er, file=sys.stderr)
+            sys.exit(1)
 
 if __name__ == '__main__':
     main()
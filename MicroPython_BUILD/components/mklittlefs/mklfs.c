@@ -37,6 +37,8 @@
 #include <errno.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <getopt.h>
+#include <time.h>
 #include <sys/stat.h>
 
 //#include "wear_levelling.h"
@@ -57,6 +59,14 @@ static uint32_t *erase_log = NULL;
 static uint32_t *prog_log = NULL;
 static uint32_t *read_log = NULL;
 
+// image build statistics
+static bool show_stats = false;
+static uint32_t n_files = 0;
+static uint32_t n_dirs = 0;
+static uint64_t n_bytes = 0;
+static uint32_t n_progs = 0;
+static uint32_t n_erases = 0;
+
 
 // === Image access functions ===
 
@@ -74,6 +84,7 @@ int lfs_img_prog(const struct lfs_config *cfg, lfs_block_t block, lfs_off_t off,
     memcpy(lfs_image + fs_offset + ((off_t)block * cfg->block_size) + (off_t)off, (uint8_t *)buffer, (size_t)size);
     if (size != cfg->block_size) printf("SIZE=%d, BLOCK=%d, OFFSET=%d\r\n", size, block, off);
     if (prog_log) prog_log[block]++;
+    n_progs++;
     return 0;
 }
 
@@ -82,6 +93,7 @@ int lfs_img_erase(const struct lfs_config *cfg, lfs_block_t block)
 {
 	memset(lfs_image + fs_offset + ((off_t)block * cfg->block_size), 0xFF, cfg->block_size);
     if (erase_log) erase_log[block]++;
+    n_erases++;
     return 0;
 }
 
@@ -117,44 +129,47 @@ int addFile(char* name, const char* path)
         return 3;
     }
 
-    // read file size
-    fseek(src, 0, SEEK_END);
-    size_t size = ftell(src);
-    fseek(src, 0, SEEK_SET);
-
-    size_t left = size;
-    uint8_t data_byte;
-    while (left > 0){
-        if (1 != fread(&data_byte, 1, 1, src)) {
-            printf("fread error!\r\n");
-
-            fclose(src);
-            lfs_file_close(&lfs, file);
-            free(file);
-            return 1;
-        }
-        lfs_ssize_t res = lfs_file_write(&lfs, file, &data_byte, 1);
-        if (res < 0) {
-            printf("SPIFFS_write error (%d)\r\n", res);
-
-            fclose(src);
-            lfs_file_close(&lfs, file);
-            free(file);
-            return 1;
+    // Copy the file in block sized chunks, lfs writes the full blocks
+    // directly to the image, bypassing its program cache
+    uint8_t *buf = malloc(config.prog_size);
+    if (buf == NULL) {
+        printf("error: failed to allocate copy buffer\r\n");
+        fclose(src);
+        lfs_file_close(&lfs, file);
+        free(file);
+        return 1;
+    }
+
+    int res = 0;
+    size_t n;
+    while ((n = fread(buf, 1, config.prog_size, src)) > 0) {
+        lfs_ssize_t written = lfs_file_write(&lfs, file, buf, n);
+        if (written < 0) {
+            printf("lfs_file_write error (%d)\r\n", written);
+            res = 1;
+            break;
         }
-        left -= 1;
+        n_bytes += n;
+    }
+    if ((res == 0) && (ferror(src))) {
+        printf("fread error!\r\n");
+        res = 1;
     }
 
+    free(buf);
+    fclose(src);
     lfs_file_close(&lfs, file);
     free(file);
+    if (res == 0) n_files++;
 
-    return 0;
+    return res;
 }
 
 //--------------------
 int addDir(char* name)
 {
     int err = lfs_mkdir(&lfs, name);
+    if (err == 0) n_dirs++;
     return err;
 }
 
@@ -320,11 +335,33 @@ int lfs_img_mount(void)
     return 0;
 }
 
+//--------------------------------------------
+static int lfs_count(void *p, lfs_block_t b) {
+    *(lfs_size_t *)p += 1;
+    return 0;
+}
+
+//----------------------------------------
+static void print_stats(double elapsed)
+{
+    lfs_size_t in_use = 0;
+    lfs_traverse(&lfs, lfs_count, &in_use);
+
+    printf("Image statistics\r\n");
+    printf("----------------------------------\r\n");
+    printf("Files: %u, directories: %u, data: %" PRIu64 " bytes\r\n", n_files, n_dirs, n_bytes);
+    printf("Build time: %.3f s, throughput: %.2f KB/s\r\n", elapsed, (elapsed > 0) ? ((double)n_bytes / 1024.0 / elapsed) : 0.0);
+    printf("Blocks used: %u of %u (%.1f%%), data in used blocks: %.1f%%\r\n", in_use, block_count,
+            (100.0 * in_use) / block_count, (in_use > 0) ? ((100.0 * n_bytes) / ((double)in_use * block_size)) : 0.0);
+    printf("Block programs: %u, erases: %u\r\n\r\n", n_progs, n_erases);
+}
+
 //------------------------
 int lfs_create_image(void)
 {
     int err = 0;
 
+    clock_t tstart = clock();
     err = lfs_img_mount();
     if (err) return err;
 
@@ -334,6 +371,8 @@ int lfs_create_image(void)
     addFiles(image_dir, "/");
     printf("\r\n");
 
+    if (show_stats) print_stats((double)(clock() - tstart) / CLOCKS_PER_SEC);
+
     err = lfs_unmount(&lfs);
     if (err) {
         printf("Error unmounting image (%d)\r\n", err);
@@ -352,8 +391,13 @@ int main(int argc, char **argv) {
     char *cvalue = NULL;
     char *ptr;
 
+    static const struct option long_options[] = {
+        {"stats", no_argument, NULL, 's'},
+        {NULL, 0, NULL, 0}
+    };
+
     printf("\r\n");
-    while ( (c = getopt(argc, argv, "b:c:l:wT")) != -1) {
+    while ( (c = getopt_long(argc, argv, "b:c:l:wTs", long_options, NULL)) != -1) {
         switch (c) {
         case 'b':
             cvalue = optarg;
@@ -370,6 +414,9 @@ int main(int argc, char **argv) {
         case 'w':
             use_wl = true;
             break;
+        case 's':
+            show_stats = true;
+            break;
         case '?':
             break;
         default: